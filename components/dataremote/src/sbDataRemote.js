@@ -26,7 +26,8 @@
  * \file sbDataRemote.js
  * \brief Implementation of the interface sbIDataRemote
  * This implementation of sbIDataRemote uses the mozilla pref system as a
- *   backend for storing key-value pairs.
+ *   backend for storing key-value pairs. Keys managed by the data remote hub
+ *   are kept in memory by the hub instead.
  * \sa sbIDataRemote.idl  sbIDataRemote.js
  */
 
@@ -56,6 +57,7 @@ DataRemote.prototype = {
   _initialized: false,     // has init been called
   _observing: false,       // are we hooked up to the pref branch as a listener
   _prefBranch: null,       // the pref branch associated with the root
+  _hub: null,              // the data remote hub, if it manages our key
   _root: null,             // the root used to retrieve the pref branch
   _key: null,              // the section of the branch we care about ("Domain")
   _boundObserver: null,    // the object observing the change
@@ -92,18 +94,42 @@ DataRemote.prototype = {
     if (!this._prefBranch)
       throw Cr.NS_ERROR_FAILURE;
 
+    // Keys managed by the hub never touch the pref system.
+    var hub = Cc["@songbirdnest.com/Songbird/DataRemoteHub;1"]
+                .getService(Ci.sbIDataRemoteHub);
+    if (hub.isManaged(this._root + this._key))
+      this._hub = hub;
+
     this._initialized = true;
   },
 
+  // (re)register ourselves as an observer of our key
+  _addObserver: function() {
+    this._removeObserver();
+    if (this._hub)
+      this._hub.addObserver(this._root + this._key, this);
+    else
+      this._prefBranch.addObserver(this._key, this, true);
+    this._observing = true;
+  },
+
+  _removeObserver: function() {
+    if (!this._observing)
+      return;
+    if (this._hub)
+      this._hub.removeObserver(this._root + this._key, this);
+    else if (this._prefBranch)
+      this._prefBranch.removeObserver(this._key, this);
+    this._observing = false;
+  },
+
   // only needs to be called if we have bound an attribute, property or observer
   unbind: function() {
     if (!this._initialized)
       throw Cr.NS_ERROR_NOT_INITIALIZED;
-    if (this._prefBranch && this._observing)
-      this._prefBranch.removeObserver( this._key, this );
+    this._removeObserver();
 
     // clear the decks
-    this._observing = false;
     this._boundObserver = null;
     this._boundAttribute = null;
     this._boundProperty = null;
@@ -115,11 +141,7 @@ DataRemote.prototype = {
       throw Cr.NS_ERROR_NOT_INITIALIZED;
 
     // Clear and reinsert ourselves as an observer.
-    if ( this._observing )
-      this._prefBranch.removeObserver(this._key, this);
-
-    this._prefBranch.addObserver(this._key, this, true);
-    this._observing = true;
+    this._addObserver();
 
     // Now we are linked to an nsIObserver object
     this._boundObserver = aObserver;
@@ -151,11 +173,7 @@ DataRemote.prototype = {
       aEvalString = "";
 
     // Clear and reinsert ourselves as an observer.
-    if ( this._observing )
-      this._prefBranch.removeObserver(this._key, this);
-
-    this._prefBranch.addObserver(this._key, this, true);
-    this._observing = true;
+    this._addObserver();
 
     // Now we are linked to property on an element
     this._boundObserver = null;
@@ -182,11 +200,7 @@ DataRemote.prototype = {
       aEvalString = "";
 
     // Clear and reinsert ourselves as an observer.
-    if ( this._observing )
-      this._prefBranch.removeObserver(this._key, this);
-
-    this._prefBranch.addObserver(this._key, this, true);
-    this._observing = true;
+    this._addObserver();
 
     // Now we are linked to an attribute on an element
     this._boundObserver = null;
@@ -202,6 +216,8 @@ DataRemote.prototype = {
   },
 
   deleteBranch: function() {
+    if (this._hub)
+      this._hub.clearKey(this._root + this._key);
     this._prefBranch.deleteBranch(this._key);
   },
 
@@ -288,6 +304,11 @@ DataRemote.prototype = {
   _setValue: function(aValueStr) {
     // assume we are being called after the init check in another method.
 
+    if (this._hub) {
+      this._hub.setString(this._root + this._key, aValueStr);
+      return;
+    }
+
     // Make a unicode string, assign the value, set it into the preferences.
     var sString = Cc["@mozilla.org/supports-string;1"]
                             .createInstance(Ci.nsISupportsString);
@@ -301,6 +322,9 @@ DataRemote.prototype = {
   _getValue: function() {
     // assume we are being called after the init check in another method.
 
+    if (this._hub)
+      return this._hub.getString(this._root + this._key);
+
     var retval = "";
     try {
       var prefValue = this._prefBranch.getComplexValue(this._key, Ci.nsISupportsString);
@@ -324,15 +348,16 @@ DataRemote.prototype = {
   },
 
   // observe - Called when someone updates the remote data
-  // aSubject: The prefbranch object
-  // aTopic:   NS_PREFBRANCH_PREFCHANGE_TOPIC_ID
-  // aData:    the domain (key)
+  // aSubject: The prefbranch object, or null for the data remote hub
+  // aTopic:   NS_PREFBRANCH_PREFCHANGE_TOPIC_ID or the hub changed topic
+  // aData:    the domain (key), fully qualified for the hub
   observe: function(aSubject, aTopic, aData) {
     if (!this._initialized)
       throw Cr.NS_ERROR_NOT_INITIALIZED;
     
     // Early bail conditions
-    if (aData != this._key)
+    if (aData != this._key &&
+        !(this._hub && aData == this._root + this._key))
       return;
     
     // Get the value as a string - this must be called value to not break
@@ -0,0 +1,679 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2009 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+#include "sbDataRemoteHub.h"
+
+#include <nsIObserverService.h>
+#include <nsIPrefBranch.h>
+#include <nsIPrefService.h>
+#include <nsISupportsPrimitives.h>
+
+#include <nsAutoLock.h>
+#include <nsAutoPtr.h>
+#include <nsCOMArray.h>
+#include <nsComponentManagerUtils.h>
+#include <nsServiceManagerUtils.h>
+#include <nsThreadUtils.h>
+#include <nsXPCOM.h>
+#include <nsXPCOMCID.h>
+
+#include <sbStringUtils.h>
+
+/**
+ * Parse a value the same way the script data remote does: leading white
+ * space and an optional sign followed by as many digits as there are. A
+ * non-empty value without digits is "true" but has no numeric value, the
+ * empty value is zero.
+ */
+static void
+ParseDataRemoteValue(const nsAString& aValue,
+                     PRInt64* aInt,
+                     PRBool* aBool)
+{
+  *aInt = 0;
+  *aBool = PR_FALSE;
+  if (aValue.IsEmpty())
+    return;
+
+  const PRUnichar* cur = aValue.BeginReading();
+  const PRUnichar* end = aValue.EndReading();
+  while (cur < end && (*cur == ' ' || *cur == '\t' ||
+                       *cur == '\r' || *cur == '\n')) {
+    ++cur;
+  }
+
+  PRBool negative = PR_FALSE;
+  if (cur < end && (*cur == '-' || *cur == '+')) {
+    negative = (*cur == '-');
+    ++cur;
+  }
+
+  PRBool sawDigit = PR_FALSE;
+  PRInt64 value = 0;
+  for (; cur < end && *cur >= '0' && *cur <= '9'; ++cur) {
+    value = value * 10 + (*cur - '0');
+    sawDigit = PR_TRUE;
+  }
+
+  if (!sawDigit) {
+    *aBool = PR_TRUE;
+    return;
+  }
+
+  *aInt = negative ? -value : value;
+  *aBool = (*aInt != 0);
+}
+
+/**
+ * A changed slot as captured by FlushChanges under the hub lock.
+ */
+struct sbDataRemoteChange
+{
+  nsString key;
+  nsString value;
+  PRBool persistent;
+  nsCOMArray<nsIObserver> observers;
+};
+
+//-----------------------------------------------------------------------------
+// sbDataRemoteSlot
+//-----------------------------------------------------------------------------
+
+sbDataRemoteSlot::sbDataRemoteSlot(const nsAString& aKey,
+                                   PRBool aPersistent)
+: mKey(aKey),
+  mPersistent(aPersistent),
+  mDirty(PR_FALSE),
+  mType(sbIDataRemoteHub::TYPE_NONE),
+  mInt(0),
+  mBool(PR_FALSE),
+  mSequence(0)
+{
+}
+
+PRUint32
+sbDataRemoteSlot::GetVersion()
+{
+  // Round an in progress write down to the last completed one.
+  return static_cast<PRUint32>(PR_AtomicAdd(&mSequence, 0)) >> 1;
+}
+
+PRInt64
+sbDataRemoteSlot::GetInt()
+{
+  PRInt32 sequence;
+  PRInt64 value;
+  do {
+    sequence = PR_AtomicAdd(&mSequence, 0);
+    value = mInt;
+  } while ((sequence & 1) || sequence != PR_AtomicAdd(&mSequence, 0));
+
+  return value;
+}
+
+PRBool
+sbDataRemoteSlot::GetBool()
+{
+  PRInt32 sequence;
+  PRBool value;
+  do {
+    sequence = PR_AtomicAdd(&mSequence, 0);
+    value = mBool;
+  } while ((sequence & 1) || sequence != PR_AtomicAdd(&mSequence, 0));
+
+  return value;
+}
+
+already_AddRefed<nsIObserver>
+sbDataRemoteSlot::ObserverEntry::Get() const
+{
+  nsCOMPtr<nsIObserver> observer = strong;
+  if (!observer && weak) {
+    observer = do_QueryReferent(weak);
+  }
+  return observer.forget();
+}
+
+//-----------------------------------------------------------------------------
+// sbDataRemoteHub
+//-----------------------------------------------------------------------------
+
+NS_IMPL_THREADSAFE_ISUPPORTS2(sbDataRemoteHub,
+                              sbIDataRemoteHub,
+                              nsIObserver)
+
+sbDataRemoteHub::sbDataRemoteHub()
+: mLock(nsnull),
+  mFlushPending(PR_FALSE)
+{
+}
+
+sbDataRemoteHub::~sbDataRemoteHub()
+{
+  if (mLock) {
+    nsAutoLock::DestroyLock(mLock);
+  }
+}
+
+nsresult
+sbDataRemoteHub::Init()
+{
+  mLock = nsAutoLock::NewLock("sbDataRemoteHub::mLock");
+  NS_ENSURE_TRUE(mLock, NS_ERROR_OUT_OF_MEMORY);
+
+  PRBool success = mSlots.Init();
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+  nsresult rv;
+  nsCOMPtr<nsIObserverService> observerService =
+    do_GetService("@mozilla.org/observer-service;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = observerService->AddObserver(this, NS_XPCOM_SHUTDOWN_OBSERVER_ID,
+                                    PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+sbDataRemoteSlot*
+sbDataRemoteHub::GetSlot(const nsAString& aKey)
+{
+  nsAutoLock lock(mLock);
+
+  sbDataRemoteSlot* slot = nsnull;
+  mSlots.Get(aKey, &slot);
+  return slot;
+}
+
+nsresult
+sbDataRemoteHub::GetManagedSlot(const nsAString& aKey,
+                                sbDataRemoteSlot** aSlot)
+{
+  *aSlot = GetSlot(aKey);
+  NS_ENSURE_TRUE(*aSlot, NS_ERROR_NOT_AVAILABLE);
+  return NS_OK;
+}
+
+nsresult
+sbDataRemoteHub::GetSlotString(sbDataRemoteSlot* aSlot,
+                               nsAString& aValue)
+{
+  NS_ENSURE_ARG_POINTER(aSlot);
+
+  nsAutoLock lock(mLock);
+  aValue.Assign(aSlot->mString);
+  return NS_OK;
+}
+
+PRBool
+sbDataRemoteHub::WriteSlot(sbDataRemoteSlot* aSlot,
+                           PRUint32 aType,
+                           const nsAString& aString)
+{
+  if (aSlot->mString.Equals(aString)) {
+    // Unchanged values do not bump the version or notify, matching the
+    // preference system.
+    aSlot->mType = aType;
+    return PR_FALSE;
+  }
+
+  PRInt64 intValue;
+  PRBool boolValue;
+  ParseDataRemoteValue(aString, &intValue, &boolValue);
+
+  aSlot->BeginWrite();
+  aSlot->mType = aType;
+  aSlot->mString.Assign(aString);
+  aSlot->mInt = intValue;
+  aSlot->mBool = boolValue;
+  aSlot->EndWrite();
+
+  if (aSlot->mDirty) {
+    return PR_FALSE;
+  }
+
+  aSlot->mDirty = PR_TRUE;
+  mDirtySlots.AppendElement(aSlot);
+
+  if (mFlushPending) {
+    return PR_FALSE;
+  }
+
+  mFlushPending = PR_TRUE;
+  return PR_TRUE;
+}
+
+nsresult
+sbDataRemoteHub::SetSlotString(sbDataRemoteSlot* aSlot,
+                               const nsAString& aValue)
+{
+  NS_ENSURE_ARG_POINTER(aSlot);
+
+  PRBool needFlush;
+  {
+    nsAutoLock lock(mLock);
+    needFlush = WriteSlot(aSlot, TYPE_STRING, aValue);
+  }
+
+  return needFlush ? ScheduleFlush() : NS_OK;
+}
+
+nsresult
+sbDataRemoteHub::SetSlotInt(sbDataRemoteSlot* aSlot,
+                            PRInt64 aValue)
+{
+  NS_ENSURE_ARG_POINTER(aSlot);
+
+  sbAutoString value(aValue);
+
+  PRBool needFlush;
+  {
+    nsAutoLock lock(mLock);
+    needFlush = WriteSlot(aSlot, TYPE_INT, value);
+  }
+
+  return needFlush ? ScheduleFlush() : NS_OK;
+}
+
+nsresult
+sbDataRemoteHub::SetSlotBool(sbDataRemoteSlot* aSlot,
+                             PRBool aValue)
+{
+  NS_ENSURE_ARG_POINTER(aSlot);
+
+  PRBool needFlush;
+  {
+    nsAutoLock lock(mLock);
+    needFlush = WriteSlot(aSlot,
+                          TYPE_BOOL,
+                          aValue ? NS_LITERAL_STRING("1") :
+                                   NS_LITERAL_STRING("0"));
+  }
+
+  return needFlush ? ScheduleFlush() : NS_OK;
+}
+
+nsresult
+sbDataRemoteHub::ScheduleFlush()
+{
+  nsCOMPtr<nsIRunnable> runnable =
+    NS_NEW_RUNNABLE_METHOD(sbDataRemoteHub, this, FlushChanges);
+  NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+  nsresult rv = NS_DispatchToMainThread(runnable);
+  if (NS_FAILED(rv)) {
+    nsAutoLock lock(mLock);
+    mFlushPending = PR_FALSE;
+  }
+  return rv;
+}
+
+void
+sbDataRemoteHub::FlushChanges()
+{
+  NS_ASSERTION(NS_IsMainThread(), "FlushChanges off the main thread");
+
+  nsTArray<sbDataRemoteChange> changes;
+
+  {
+    nsAutoLock lock(mLock);
+
+    sbDataRemoteChange* change = changes.AppendElements(mDirtySlots.Length());
+    if (!change) {
+      NS_WARNING("Out of memory flushing data remote changes");
+      return;
+    }
+
+    for (PRUint32 i = 0; i < mDirtySlots.Length(); ++i, ++change) {
+      sbDataRemoteSlot* slot = mDirtySlots[i];
+      slot->mDirty = PR_FALSE;
+
+      change->key.Assign(slot->mKey);
+      change->value.Assign(slot->mString);
+      change->persistent = slot->mPersistent;
+
+      // Collect live observers and drop the ones that went away.
+      for (PRInt32 j = slot->mObservers.Length() - 1; j >= 0; --j) {
+        nsCOMPtr<nsIObserver> observer = slot->mObservers[j].Get();
+        if (observer) {
+          change->observers.AppendObject(observer);
+        }
+        else {
+          slot->mObservers.RemoveElementAt(j);
+        }
+      }
+    }
+
+    mDirtySlots.Clear();
+    mFlushPending = PR_FALSE;
+  }
+
+  nsresult rv;
+  nsCOMPtr<nsIPrefBranch> prefBranch;
+  for (PRUint32 i = 0; i < changes.Length(); ++i) {
+    const sbDataRemoteChange& change = changes[i];
+
+    if (change.persistent) {
+      if (!prefBranch) {
+        prefBranch = do_GetService(NS_PREFSERVICE_CONTRACTID, &rv);
+        NS_ENSURE_SUCCESS(rv, /* void */);
+      }
+
+      nsCOMPtr<nsISupportsString> value =
+        do_CreateInstance(NS_SUPPORTS_STRING_CONTRACTID, &rv);
+      if (NS_SUCCEEDED(rv)) {
+        value->SetData(change.value);
+        rv = prefBranch->SetComplexValue(
+                           NS_ConvertUTF16toUTF8(change.key).get(),
+                           NS_GET_IID(nsISupportsString),
+                           value);
+      }
+      NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to persist data remote");
+    }
+
+    // Observers were collected in reverse; notify in registration order.
+    for (PRInt32 j = change.observers.Count() - 1; j >= 0; --j) {
+      change.observers[j]->Observe(nsnull,
+                                   SB_DATAREMOTEHUB_CHANGED_TOPIC,
+                                   change.key.get());
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// sbIDataRemoteHub
+//-----------------------------------------------------------------------------
+
+NS_IMETHODIMP
+sbDataRemoteHub::ManageKey(const nsAString& aKey,
+                           PRBool aPersistent)
+{
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_UNEXPECTED);
+
+  nsresult rv;
+  nsCOMPtr<nsIPrefBranch> prefBranch =
+    do_GetService(NS_PREFSERVICE_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  NS_ConvertUTF16toUTF8 prefKey(aKey);
+
+  sbDataRemoteSlot* slot = GetSlot(aKey);
+  if (slot) {
+    nsAutoLock lock(mLock);
+    slot->mPersistent = slot->mPersistent || aPersistent;
+    return NS_OK;
+  }
+
+  nsAutoPtr<sbDataRemoteSlot> newSlot(new sbDataRemoteSlot(aKey, aPersistent));
+  NS_ENSURE_TRUE(newSlot, NS_ERROR_OUT_OF_MEMORY);
+
+  PRBool hasUserValue = PR_FALSE;
+  rv = prefBranch->PrefHasUserValue(prefKey.get(), &hasUserValue);
+  if (NS_FAILED(rv)) {
+    hasUserValue = PR_FALSE;
+  }
+
+  if (aPersistent) {
+    // Seed from the preference system, default values included.
+    nsCOMPtr<nsISupportsString> value;
+    rv = prefBranch->GetComplexValue(prefKey.get(),
+                                     NS_GET_IID(nsISupportsString),
+                                     getter_AddRefs(value));
+    if (NS_SUCCEEDED(rv) && value) {
+      PRInt64 intValue;
+      PRBool boolValue;
+      value->GetData(newSlot->mString);
+      ParseDataRemoteValue(newSlot->mString, &intValue, &boolValue);
+      newSlot->mType = TYPE_STRING;
+      newSlot->mInt = intValue;
+      newSlot->mBool = boolValue;
+    }
+  }
+  else if (hasUserValue) {
+    // Stop carrying a stale value around in the preferences file.
+    rv = prefBranch->ClearUserPref(prefKey.get());
+    NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to clear data remote pref");
+  }
+
+  nsAutoLock lock(mLock);
+  PRBool success = mSlots.Put(aKey, newSlot);
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+  newSlot.forget();
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::IsManaged(const nsAString& aKey,
+                           PRBool* _retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+  *_retval = GetSlot(aKey) != nsnull;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::GetType(const nsAString& aKey,
+                         PRUint32* _retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsAutoLock lock(mLock);
+  *_retval = slot->mType;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::GetVersion(const nsAString& aKey,
+                            PRUint32* _retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  *_retval = slot->GetVersion();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::GetString(const nsAString& aKey,
+                           nsAString& _retval)
+{
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return GetSlotString(slot, _retval);
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::SetString(const nsAString& aKey,
+                           const nsAString& aValue)
+{
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return SetSlotString(slot, aValue);
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::GetInt(const nsAString& aKey,
+                        PRInt64* _retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  *_retval = slot->GetInt();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::SetInt(const nsAString& aKey,
+                        PRInt64 aValue)
+{
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return SetSlotInt(slot, aValue);
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::GetBool(const nsAString& aKey,
+                         PRBool* _retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  *_retval = slot->GetBool();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::SetBool(const nsAString& aKey,
+                         PRBool aValue)
+{
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return SetSlotBool(slot, aValue);
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::ClearKey(const nsAString& aKey)
+{
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool needFlush;
+  {
+    nsAutoLock lock(mLock);
+    needFlush = WriteSlot(slot, TYPE_NONE, EmptyString());
+  }
+
+  return needFlush ? ScheduleFlush() : NS_OK;
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::AddObserver(const nsAString& aKey,
+                             nsIObserver* aObserver)
+{
+  NS_ENSURE_ARG_POINTER(aObserver);
+
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Resolve the weak reference before taking the lock; script observers
+  // may run code to hand it out.
+  sbDataRemoteSlot::ObserverEntry entry;
+  entry.weak = do_GetWeakReference(aObserver);
+  if (!entry.weak) {
+    entry.strong = aObserver;
+  }
+
+  rv = RemoveObserver(aKey, aObserver);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsAutoLock lock(mLock);
+  sbDataRemoteSlot::ObserverEntry* added =
+    slot->mObservers.AppendElement(entry);
+  NS_ENSURE_TRUE(added, NS_ERROR_OUT_OF_MEMORY);
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::RemoveObserver(const nsAString& aKey,
+                                nsIObserver* aObserver)
+{
+  NS_ENSURE_ARG_POINTER(aObserver);
+
+  sbDataRemoteSlot* slot;
+  nsresult rv = GetManagedSlot(aKey, &slot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCOMPtr<nsISupports> target = do_QueryInterface(aObserver);
+
+  nsAutoLock lock(mLock);
+  for (PRInt32 i = slot->mObservers.Length() - 1; i >= 0; --i) {
+    nsCOMPtr<nsIObserver> observer = slot->mObservers[i].Get();
+    nsCOMPtr<nsISupports> supports = do_QueryInterface(observer);
+    if (!observer || supports == target) {
+      slot->mObservers.RemoveElementAt(i);
+    }
+  }
+
+  return NS_OK;
+}
+
+//-----------------------------------------------------------------------------
+// nsIObserver
+//-----------------------------------------------------------------------------
+
+/* static */ PLDHashOperator PR_CALLBACK
+sbDataRemoteHub::ClearSlotObservers(nsStringHashKey::KeyType aKey,
+                                    sbDataRemoteSlot* aSlot,
+                                    void* aUserData)
+{
+  aSlot->mObservers.Clear();
+  return PL_DHASH_NEXT;
+}
+
+NS_IMETHODIMP
+sbDataRemoteHub::Observe(nsISupports* aSubject,
+                         const char* aTopic,
+                         const PRUnichar* aData)
+{
+  if (!strcmp(aTopic, NS_XPCOM_SHUTDOWN_OBSERVER_ID)) {
+    nsresult rv;
+    nsCOMPtr<nsIObserverService> observerService =
+      do_GetService("@mozilla.org/observer-service;1", &rv);
+    if (NS_SUCCEEDED(rv)) {
+      observerService->RemoveObserver(this, NS_XPCOM_SHUTDOWN_OBSERVER_ID);
+    }
+
+    // Release strongly held observers so they do not outlive XPCOM.
+    nsAutoLock lock(mLock);
+    mSlots.EnumerateRead(ClearSlotObservers, nsnull);
+  }
+
+  return NS_OK;
+}
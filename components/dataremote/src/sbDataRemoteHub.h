@@ -0,0 +1,162 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2009 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+#ifndef __SB_DATAREMOTEHUB_H__
+#define __SB_DATAREMOTEHUB_H__
+
+#include <sbIDataRemoteHub.h>
+
+#include <nsIObserver.h>
+#include <nsIWeakReference.h>
+
+#include <nsClassHashtable.h>
+#include <nsCOMPtr.h>
+#include <nsHashKeys.h>
+#include <nsStringGlue.h>
+#include <nsTArray.h>
+
+#include <pratom.h>
+#include <prlock.h>
+
+#define SB_DATAREMOTEHUB_CLASSNAME "Songbird Data Remote Hub"
+
+// {c8f04c5d-249e-46f6-a6cf-9a636d69d9d7}
+#define SB_DATAREMOTEHUB_CID \
+{ 0xc8f04c5d, 0x249e, 0x46f6, \
+  { 0xa6, 0xcf, 0x9a, 0x63, 0x6d, 0x69, 0xd9, 0xd7 } }
+
+/**
+ * \class sbDataRemoteSlot
+ * \brief Storage for a single managed data remote key.
+ *
+ * Every write keeps both the string and the numeric view of the value up to
+ * date so that any getter can be served without conversion. Writes are
+ * serialized by the hub lock and bracketed by a sequence counter; the
+ * numeric getters and the version read the counter instead of taking the
+ * lock and retry if they raced with a writer. Strings cannot be copied
+ * safely without the lock and are read through the hub.
+ *
+ * Slots are owned by the hub and never removed before it is destroyed, so
+ * holders of the hub may keep raw slot pointers.
+ */
+class sbDataRemoteSlot
+{
+  friend class sbDataRemoteHub;
+
+public:
+  sbDataRemoteSlot(const nsAString& aKey, PRBool aPersistent);
+
+  /**
+   * \brief Number of completed writes that changed the value.
+   */
+  PRUint32 GetVersion();
+
+  PRInt64 GetInt();
+  PRBool GetBool();
+
+private:
+  struct ObserverEntry
+  {
+    nsCOMPtr<nsIWeakReference> weak;
+    nsCOMPtr<nsIObserver>      strong;
+
+    already_AddRefed<nsIObserver> Get() const;
+  };
+
+  void BeginWrite() { PR_AtomicIncrement(&mSequence); }
+  void EndWrite() { PR_AtomicIncrement(&mSequence); }
+
+  const nsString mKey;
+  PRPackedBool   mPersistent;
+  PRPackedBool   mDirty;
+  PRUint32       mType;
+  nsString       mString;
+  PRInt64        mInt;
+  PRPackedBool   mBool;
+
+  // Odd while a write is in progress.
+  PRInt32        mSequence;
+
+  nsTArray<ObserverEntry> mObservers;
+};
+
+/**
+ * \class sbDataRemoteHub
+ * \brief Implementation of sbIDataRemoteHub.
+ *
+ * Changed slots are queued on a dirty list; the first change of a turn
+ * dispatches a single runnable to the main thread which notifies observers
+ * of every slot on the list and writes persistent slots back to the
+ * preference system.
+ */
+class sbDataRemoteHub : public sbIDataRemoteHub,
+                        public nsIObserver
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBIDATAREMOTEHUB
+  NS_DECL_NSIOBSERVER
+
+  sbDataRemoteHub();
+
+  nsresult Init();
+
+  /**
+   * \brief Return the slot for a managed key, or null if the key is not
+   *        managed. The slot stays valid as long as the hub is alive.
+   */
+  sbDataRemoteSlot* GetSlot(const nsAString& aKey);
+
+  nsresult GetSlotString(sbDataRemoteSlot* aSlot, nsAString& aValue);
+  nsresult SetSlotString(sbDataRemoteSlot* aSlot, const nsAString& aValue);
+  nsresult SetSlotInt(sbDataRemoteSlot* aSlot, PRInt64 aValue);
+  nsresult SetSlotBool(sbDataRemoteSlot* aSlot, PRBool aValue);
+
+private:
+  ~sbDataRemoteHub();
+
+  nsresult GetManagedSlot(const nsAString& aKey, sbDataRemoteSlot** aSlot);
+
+  // Must be called with mLock held. Returns true if the caller needs to
+  // call ScheduleFlush once the lock has been released.
+  PRBool WriteSlot(sbDataRemoteSlot* aSlot,
+                 PRUint32 aType,
+                 const nsAString& aString);
+
+  nsresult ScheduleFlush();
+  void FlushChanges();
+
+  static PLDHashOperator PR_CALLBACK
+    ClearSlotObservers(nsStringHashKey::KeyType aKey,
+                       sbDataRemoteSlot* aSlot,
+                       void* aUserData);
+
+  PRLock* mLock;
+
+  nsClassHashtable<nsStringHashKey, sbDataRemoteSlot> mSlots;
+  nsTArray<sbDataRemoteSlot*> mDirtySlots;
+  PRBool mFlushPending;
+};
+
+#endif /* __SB_DATAREMOTEHUB_H__ */
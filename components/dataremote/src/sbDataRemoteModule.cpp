@@ -24,11 +24,13 @@
 //
  */
 
+#include "sbDataRemoteHub.h"
 #include "sbDataRemoteWrapper.h"
 
 #include <nsIGenericFactory.h>
 
 NS_GENERIC_FACTORY_CONSTRUCTOR_INIT(sbDataRemoteWrapper, InitWrapper)
+NS_GENERIC_FACTORY_CONSTRUCTOR_INIT(sbDataRemoteHub, Init)
 
 // fill out data struct to register with component system
 static const nsModuleComponentInfo components[] =
@@ -38,6 +40,12 @@ static const nsModuleComponentInfo components[] =
     SB_DATAREMOTEWRAPPER_CID,
     SB_DATAREMOTEWRAPPER_CONTRACTID,
     sbDataRemoteWrapperConstructor
+  },
+  {
+    SB_DATAREMOTEHUB_CLASSNAME,
+    SB_DATAREMOTEHUB_CID,
+    SB_DATAREMOTEHUB_CONTRACTID,
+    sbDataRemoteHubConstructor
   }
 };
 
@@ -28,6 +28,9 @@
 #include <nsIProgrammingLanguage.h>
 
 #include "sbDataRemoteWrapper.h"
+#include "sbDataRemoteHub.h"
+
+#include <nsServiceManagerUtils.h>
 
 // CID for the original dataremote implementation, to which
 // this object will delegate.
@@ -50,7 +53,9 @@ NS_IMPL_THREADSAFE_CI(sbDataRemoteWrapper)
 
 sbDataRemoteWrapper::sbDataRemoteWrapper()
 : mInnerDataRemote(nsnull), 
-  mObserver(nsnull)
+  mObserver(nsnull),
+  mSlot(nsnull),
+  mCachedVersion(PR_UINT32_MAX)
 {}
 
 sbDataRemoteWrapper::~sbDataRemoteWrapper()
@@ -81,15 +86,63 @@ nsresult sbDataRemoteWrapper::InitWrapper()
 // Redirect getter/setters to methods rather than attributes
 // in order to work around BMO 304048.
 //
+// Keys managed by the data remote hub bypass the inner implementation
+// entirely.
+//
+
+/* void init (in AString aKey, [optional] in AString aRoot); */
+NS_IMETHODIMP sbDataRemoteWrapper::Init(const nsAString & aKey,
+                                        const nsAString & aRoot)
+{
+  NS_ENSURE_STATE(mInnerDataRemote);
+  nsresult rv = mInnerDataRemote->Init(aKey, aRoot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Same default root as the inner implementation.
+  nsString fullKey;
+  if (aRoot.IsEmpty())
+    fullKey.AssignLiteral("songbird.");
+  else
+    fullKey.Assign(aRoot);
+  fullKey.Append(aKey);
+
+  nsCOMPtr<sbIDataRemoteHub> hub =
+    do_GetService(SB_DATAREMOTEHUB_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // The hub lives in this library, so the cast is safe.
+  nsRefPtr<sbDataRemoteHub> hubImpl =
+    static_cast<sbDataRemoteHub*>(hub.get());
+  mSlot = hubImpl->GetSlot(fullKey);
+  if (mSlot)
+    mHub = hubImpl;
+
+  return NS_OK;
+}
 
 /* attribute AString stringValue; */
 NS_IMETHODIMP sbDataRemoteWrapper::GetStringValue(nsAString & aStringValue)
 {
+  if (mSlot) {
+    // Only copy the string out of the hub when it changed since last time.
+    PRUint32 version = mSlot->GetVersion();
+    if (version != mCachedVersion) {
+      nsresult rv = mHub->GetSlotString(mSlot, mCachedString);
+      NS_ENSURE_SUCCESS(rv, rv);
+      mCachedVersion = version;
+    }
+    aStringValue.Assign(mCachedString);
+    return NS_OK;
+  }
+
   NS_ENSURE_STATE(mInnerDataRemote);
   return mInnerDataRemote->GetAsString(aStringValue);
 }
 NS_IMETHODIMP sbDataRemoteWrapper::SetStringValue(const nsAString & aStringValue)
 {
+  if (mSlot)
+    return mHub->SetSlotString(mSlot, aStringValue);
+
   NS_ENSURE_STATE(mInnerDataRemote);
   return mInnerDataRemote->SetAsString(aStringValue);
 }
@@ -97,11 +150,20 @@ NS_IMETHODIMP sbDataRemoteWrapper::SetStringValue(const nsAString & aStringValue
 /* attribute boolean boolValue; */
 NS_IMETHODIMP sbDataRemoteWrapper::GetBoolValue(PRBool *aBoolValue)
 {
+  if (mSlot) {
+    NS_ENSURE_ARG_POINTER(aBoolValue);
+    *aBoolValue = mSlot->GetBool();
+    return NS_OK;
+  }
+
   NS_ENSURE_STATE(mInnerDataRemote);
   return mInnerDataRemote->GetAsBool(aBoolValue);
 }
 NS_IMETHODIMP sbDataRemoteWrapper::SetBoolValue(PRBool aBoolValue)
 {
+  if (mSlot)
+    return mHub->SetSlotBool(mSlot, aBoolValue);
+
   NS_ENSURE_STATE(mInnerDataRemote);
   return mInnerDataRemote->SetAsBool(aBoolValue);
 }
@@ -109,11 +171,20 @@ NS_IMETHODIMP sbDataRemoteWrapper::SetBoolValue(PRBool aBoolValue)
 /* attribute long long intValue; */
 NS_IMETHODIMP sbDataRemoteWrapper::GetIntValue(PRInt64 *aIntValue)
 {
+  if (mSlot) {
+    NS_ENSURE_ARG_POINTER(aIntValue);
+    *aIntValue = mSlot->GetInt();
+    return NS_OK;
+  }
+
   NS_ENSURE_STATE(mInnerDataRemote);
   return mInnerDataRemote->GetAsInt(aIntValue);
 }
 NS_IMETHODIMP sbDataRemoteWrapper::SetIntValue(PRInt64 aIntValue)
 {
+  if (mSlot)
+    return mHub->SetSlotInt(mSlot, aIntValue);
+
   NS_ENSURE_STATE(mInnerDataRemote);
   return mInnerDataRemote->SetAsInt(aIntValue);
 }
@@ -27,6 +27,7 @@
 
 #include <nsIClassInfo.h>
 #include <nsIObserver.h>
+#include <nsAutoPtr.h>
 #include <nsCOMPtr.h>
 #include <nsStringGlue.h>
 #include <sbIDataRemote.h>
@@ -34,6 +35,9 @@
 #include <nsComponentManagerUtils.h>
 
 
+class sbDataRemoteHub;
+class sbDataRemoteSlot;
+
 #define SB_DATAREMOTEWRAPPER_CLASSNAME \
   "Songbird Data Remote Wrapper Instance"
 
@@ -46,7 +50,6 @@
   "@songbirdnest.com/Songbird/DataRemote;1"
 
 #define NS_FORWARD_SOME_SBIDATAREMOTE_METHODS(_to) \
-  NS_SCRIPTABLE NS_IMETHOD Init(const nsAString & aKey, const nsAString & aRoot) { return !_to ? NS_ERROR_NULL_POINTER : _to->Init(aKey, aRoot); } \
   NS_SCRIPTABLE NS_IMETHOD BindProperty(nsIDOMElement *aElement, const nsAString & aProperty, PRBool aIsBool, PRBool aIsNot, const nsAString & aEvalString) { return !_to ? NS_ERROR_NULL_POINTER : _to->BindProperty(aElement, aProperty, aIsBool, aIsNot, aEvalString); } \
   NS_SCRIPTABLE NS_IMETHOD BindAttribute(nsIDOMElement *aElement, const nsAString & aProperty, PRBool aIsBool, PRBool aIsNot, const nsAString & aEvalString) { return !_to ? NS_ERROR_NULL_POINTER : _to->BindAttribute(aElement, aProperty, aIsBool, aIsNot, aEvalString); } \
   NS_SCRIPTABLE NS_IMETHOD DeleteBranch() { return !_to ? NS_ERROR_NULL_POINTER : _to->DeleteBranch(); }
@@ -73,7 +76,12 @@
  *         "There is no data, there are only prefs"
  *     http://bugzilla.songbirdnest.com/show_bug.cgi?id=10806
  *         "Memory leak during playback"
- * 
+ *
+ * Keys managed by the data remote hub are read and written natively through
+ * the hub instead of going through the script implementation and the
+ * preference system.
+ *
+ * \sa sbIDataRemoteHub
  *****************************************************************************/
 class sbDataRemoteWrapper : public sbIDataRemote,
                             public nsIClassInfo
@@ -87,6 +95,7 @@ public:
     NS_DECL_NSIOBSERVER
     NS_FORWARD_SOME_SBIDATAREMOTE_METHODS(mInnerDataRemote)
 
+    NS_SCRIPTABLE NS_IMETHOD Init(const nsAString & aKey, const nsAString & aRoot);
     NS_SCRIPTABLE NS_IMETHOD Unbind(void);
     NS_SCRIPTABLE NS_IMETHOD BindObserver(nsIObserver *aObserver, PRBool aSuppressFirst);
     NS_SCRIPTABLE NS_IMETHOD BindRemoteObserver(sbIRemoteObserver *aObserver, PRBool aSuppressFirst); 
@@ -101,6 +110,14 @@ private:
     ~sbDataRemoteWrapper();
     nsCOMPtr<sbPIDataRemote2> mInnerDataRemote;
     nsCOMPtr<nsIObserver> mObserver;
+
+    // Set when the key is managed by the data remote hub.
+    nsRefPtr<sbDataRemoteHub> mHub;
+    sbDataRemoteSlot* mSlot;
+
+    // Last string read from the hub and the slot version it was read at.
+    nsString mCachedString;
+    PRUint32 mCachedVersion;
 };
 
 #endif
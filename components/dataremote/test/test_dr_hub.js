@@ -0,0 +1,99 @@
+/**
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2008 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+ */
+
+/**
+ * \brief Data remote hub unit tests
+ */
+
+function runTest () {
+  prepDataRemotes();
+
+  var hub = Components.classes["@songbirdnest.com/Songbird/DataRemoteHub;1"]
+              .getService(Components.interfaces.sbIDataRemoteHub);
+  var prefs = Components.classes["@mozilla.org/preferences-service;1"]
+                .getService(Components.interfaces.nsIPrefBranch);
+
+  // A stale value for a volatile key is dropped from the preferences.
+  prefs.setCharPref("songbird.test.hub.volatile", "stale");
+  hub.manageKey("songbird.test.hub.volatile", false);
+  assertTrue(hub.isManaged("songbird.test.hub.volatile"));
+  assertFalse(prefs.prefHasUserValue("songbird.test.hub.volatile"));
+  assertFalse(hub.isManaged("songbird.test.hub.unmanaged"));
+
+  const drConstructor =
+    new Components.Constructor("@songbirdnest.com/Songbird/DataRemote;1",
+                               "sbIDataRemote",
+                               "init");
+  var dr = new drConstructor("test.hub.volatile", null);
+
+  // Typed slots keep every view of the value in sync.
+  dr.intValue = 42;
+  assertEqual(hub.getType("songbird.test.hub.volatile"),
+              Components.interfaces.sbIDataRemoteHub.TYPE_INT);
+  assertEqual(dr.stringValue, "42");
+  assertEqual(dr.intValue, 42);
+  assertTrue(dr.boolValue);
+  assertEqual(hub.getInt("songbird.test.hub.volatile"), 42);
+  assertFalse(prefs.prefHasUserValue("songbird.test.hub.volatile"));
+
+  // Writing the same value again does not bump the version.
+  var version = hub.getVersion("songbird.test.hub.volatile");
+  dr.intValue = 42;
+  assertEqual(hub.getVersion("songbird.test.hub.volatile"), version);
+
+  // Changes made during one turn are reported once, with the last value.
+  var notifications = 0;
+  var lastValue = null;
+  var observer = {
+    observe: function(aSubject, aTopic, aData) {
+      notifications++;
+      lastValue = aData;
+    }
+  };
+  var observed = new drConstructor("test.hub.volatile", null);
+  observed.bindObserver(observer, true);
+
+  dr.stringValue = "1";
+  dr.stringValue = "2";
+  dr.stringValue = "3";
+  assertEqual(notifications, 0);
+  sleep(100, true);
+  assertEqual(notifications, 1);
+  assertEqual(lastValue, "3");
+  observed.unbind();
+
+  // Persistent keys are seeded from and written back to the preferences.
+  prefs.setCharPref("songbird.test.hub.persistent", "7");
+  hub.manageKey("songbird.test.hub.persistent", true);
+  assertEqual(hub.getInt("songbird.test.hub.persistent"), 7);
+  hub.setString("songbird.test.hub.persistent", "8");
+  sleep(100, true);
+  assertEqual(prefs.getCharPref("songbird.test.hub.persistent"), "8");
+
+  prefs.deleteBranch("songbird.test.hub.");
+
+  return Components.results.NS_OK;
+}
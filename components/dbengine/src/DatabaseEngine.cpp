@@ -72,6 +72,7 @@
 #include <sbStringBundle.h>
 #include <sbProxiedComponentManager.h>
 #include <sbDebugUtils.h>
+#include <sbPerfStatisticsUtils.h>
 
 #if defined(_WIN32)
   #include <windows.h>
@@ -2187,6 +2188,11 @@ CDatabaseEngine::RunAnalyze()
 
       BEGIN_PERFORMANCE_LOG(strQuery, dbName);
 
+      // Always-on latency histogram of the statement, covering binding,
+      // stepping and result collection.
+      sbAutoPerfLatency perfLatency(sbIPerfStatistics::CATEGORY_DB_QUERY,
+                                    actualPreparedStatement->GetStatisticsKey());
+
       LOG("DBE: '%s' on '%s'\n",
         NS_ConvertUTF16toUTF8(dbName).get(),
         NS_ConvertUTF16toUTF8(strQuery).get());
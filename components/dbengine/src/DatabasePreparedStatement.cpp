@@ -46,7 +46,7 @@
 NS_IMPL_THREADSAFE_ISUPPORTS1(CDatabasePreparedStatement, sbIDatabasePreparedStatement)
 
 CDatabasePreparedStatement::CDatabasePreparedStatement(const nsAString &sql) 
-  : mStatement(nsnull), mSql(sql)
+  : mStatement(nsnull), mSql(sql), mSqlUTF8(NS_ConvertUTF16toUTF8(sql))
 {
 }
 
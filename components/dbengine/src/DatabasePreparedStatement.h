@@ -60,10 +60,17 @@ public:
   
   sqlite3_stmt* GetStatement(sqlite3 *db);
 
+  /**
+   * \brief The SQL text of the statement in UTF-8, used to key the
+   *        performance statistics of the statement.
+   */
+  const nsCString& GetStatisticsKey() const { return mSqlUTF8; }
+
 protected:
   CDatabaseQuery *mQuery;
   sqlite3_stmt *mStatement;
   nsString mSql;
+  nsCString mSqlUTF8;
 };
 
 #endif // __DATABASE_PREPAREDSTATEMENT_H__
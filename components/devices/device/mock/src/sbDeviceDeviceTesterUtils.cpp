@@ -28,6 +28,7 @@
 #include "sbDeviceDeviceTesterUtils.h"
 
 #include "sbDeviceUtils.h"
+#include "sbMediaInspectorPool.h"
 
 NS_IMPL_ISUPPORTS1(sbDeviceDeviceTesterUtils, sbIDeviceDeviceTesterUtils)
 
@@ -44,3 +45,17 @@ NS_IMETHODIMP sbDeviceDeviceTesterUtils::GetOrganizedPath(nsIFile *aParent, sbIM
 {
   return sbDeviceUtils::GetOrganizedPath(aParent, aItem, _retval);
 }
+
+/* sbIMediaFormat GetCachedMediaFormat (in sbIMediaItem aItem); */
+NS_IMETHODIMP sbDeviceDeviceTesterUtils::GetCachedMediaFormat(sbIMediaItem *aItem, sbIMediaFormat **_retval)
+{
+  sbMediaInspectorPool pool(1);
+  return pool.GetCachedMediaFormat(aItem, _retval);
+}
+
+/* void SetCachedMediaFormat (in sbIMediaItem aItem, in sbIMediaFormat aFormat); */
+NS_IMETHODIMP sbDeviceDeviceTesterUtils::SetCachedMediaFormat(sbIMediaItem *aItem, sbIMediaFormat *aFormat)
+{
+  sbMediaInspectorPool pool(1);
+  return pool.SetCachedMediaFormat(aItem, aFormat);
+}
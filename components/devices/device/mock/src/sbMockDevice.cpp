@@ -45,6 +45,7 @@
 #include <sbRequestItem.h>
 
 #include <sbDeviceContent.h>
+#include <sbDeviceStatistics.h>
 #include <sbVariantUtils.h>
 
 /* for an actual device, you would probably want to actually sort the prefs on
@@ -846,6 +847,105 @@ NS_IMETHODIMP sbMockDevice::PopRequest(nsIPropertyBag2 **_retval)
   return CallQueryInterface(bag, _retval);
 }
 
+/* void batchBegin (); */
+NS_IMETHODIMP sbMockDevice::BatchBegin()
+{
+  return sbBaseDevice::BatchBegin();
+}
+
+/* void batchEnd (); */
+NS_IMETHODIMP sbMockDevice::BatchEnd()
+{
+  return sbBaseDevice::BatchEnd();
+}
+
+nsresult sbMockDevice::GetDefaultStatistics(sbDeviceStatistics** aStatistics)
+{
+  nsRefPtr<sbBaseDeviceVolume> volume;
+  {
+    nsAutoLock autoVolumeLock(mVolumeLock);
+    volume = mDefaultVolume;
+  }
+  NS_ENSURE_STATE(volume);
+
+  return volume->GetStatistics(aStatistics);
+}
+
+/* void addStatisticsLibrary (); */
+NS_IMETHODIMP sbMockDevice::AddStatisticsLibrary()
+{
+  nsresult rv;
+
+  nsRefPtr<sbDeviceStatistics> statistics;
+  rv = GetDefaultStatistics(getter_AddRefs(statistics));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCOMPtr<sbIDeviceLibrary> library;
+  rv = GetDefaultLibrary(getter_AddRefs(library));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return statistics->AddLibrary(library);
+}
+
+/* void addStatisticsItem (in sbIMediaItem aMediaItem); */
+NS_IMETHODIMP sbMockDevice::AddStatisticsItem(sbIMediaItem* aMediaItem)
+{
+  nsRefPtr<sbDeviceStatistics> statistics;
+  nsresult rv = GetDefaultStatistics(getter_AddRefs(statistics));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return statistics->AddItem(aMediaItem);
+}
+
+/* void removeStatisticsItem (in sbIMediaItem aMediaItem); */
+NS_IMETHODIMP sbMockDevice::RemoveStatisticsItem(sbIMediaItem* aMediaItem)
+{
+  nsRefPtr<sbDeviceStatistics> statistics;
+  nsresult rv = GetDefaultStatistics(getter_AddRefs(statistics));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return statistics->RemoveItem(aMediaItem);
+}
+
+/* readonly attribute unsigned long statisticsAudioCount; */
+NS_IMETHODIMP sbMockDevice::GetStatisticsAudioCount(PRUint32* aAudioCount)
+{
+  NS_ENSURE_ARG_POINTER(aAudioCount);
+
+  nsRefPtr<sbDeviceStatistics> statistics;
+  nsresult rv = GetDefaultStatistics(getter_AddRefs(statistics));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  *aAudioCount = statistics->AudioCount();
+  return NS_OK;
+}
+
+/* readonly attribute unsigned long long statisticsAudioUsed; */
+NS_IMETHODIMP sbMockDevice::GetStatisticsAudioUsed(PRUint64* aAudioUsed)
+{
+  NS_ENSURE_ARG_POINTER(aAudioUsed);
+
+  nsRefPtr<sbDeviceStatistics> statistics;
+  nsresult rv = GetDefaultStatistics(getter_AddRefs(statistics));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  *aAudioUsed = statistics->AudioUsed();
+  return NS_OK;
+}
+
+/* readonly attribute boolean statisticsQueryPending; */
+NS_IMETHODIMP sbMockDevice::GetStatisticsQueryPending(PRBool* aQueryPending)
+{
+  NS_ENSURE_ARG_POINTER(aQueryPending);
+
+  nsRefPtr<sbDeviceStatistics> statistics;
+  nsresult rv = GetDefaultStatistics(getter_AddRefs(statistics));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  *aQueryPending = statistics->QueryPending();
+  return NS_OK;
+}
+
 NS_IMETHODIMP sbMockDevice::SetWarningDialogEnabled(const nsAString & aWarning, PRBool aEnabled)
 {
   return sbBaseDevice::SetWarningDialogEnabled(aWarning, aEnabled);
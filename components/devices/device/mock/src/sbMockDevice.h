@@ -32,6 +32,7 @@
 #include <sbDeviceStatusHelper.h>
 
 class sbDeviceContent;
+class sbDeviceStatistics;
 
 class sbMockDevice : public sbBaseDevice,
                      public sbIMockDevice
@@ -54,6 +55,10 @@ protected:
 
 private:
   virtual ~sbMockDevice();
+  /**
+   * Get the statistics of the default volume
+   */
+  nsresult GetDefaultStatistics(sbDeviceStatistics** aStatistics);
   /**
    * Performs the disconnect
    */
@@ -102,6 +102,7 @@ class NS_HIDDEN sbBaseDevice : public sbIDevice,
 public:
   // Friend declarations for classes used to divide up device work
   friend class sbDeviceTranscoding;
+  friend class sbMediaInspectorPool;
   friend class sbDeviceImages;
   friend class sbBaseDeviceVolume;
   friend class sbDeviceRequestThreadQueue;
@@ -341,6 +342,12 @@ public:
    */
   virtual nsresult ProcessBatch(Batch & aBatch) = 0;
 
+  /**
+   * Called on the request thread once all queued requests have been
+   * processed.  Devices that defer work across batches finish it here.
+   */
+  virtual nsresult ProcessQueueDrained() { return NS_OK; }
+
   /**
    * Set the device's previous state
    * @param aState new device state
@@ -340,19 +340,20 @@ sbDeviceRequestThreadQueue::IsDuplicateRequest(sbRequestItem * aQueueRequest,
           do_CreateInstance(SB_MUTABLEPROPERTYARRAY_CONTRACTID, &rv);
       NS_ENSURE_SUCCESS(rv, rv);
 
-      // Add the duplicate in the queue properties.
+      // Add the new request properties first so they win over the older
+      // values of the same properties.
       nsCOMPtr<sbIPropertyArray> propertyList;
+      propertyList = do_QueryInterface(request->data, &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = mergedPropertyList->AppendProperties(propertyList, PR_TRUE);
+      NS_ENSURE_SUCCESS(rv, rv);
+      // Add the duplicate in the queue properties.
       propertyList = do_QueryInterface(queueRequest->data, &rv);
       // This may be a request that doesn't contain a property array
       if (NS_SUCCEEDED(rv)) {
         rv = mergedPropertyList->AppendProperties(propertyList, PR_TRUE);
         NS_ENSURE_SUCCESS(rv, rv);
       }
-      // Add the new request properties.
-      propertyList = do_QueryInterface(request->data, &rv);
-      NS_ENSURE_SUCCESS(rv, rv);
-      rv = mergedPropertyList->AppendProperties(propertyList, PR_TRUE);
-      NS_ENSURE_SUCCESS(rv, rv);
 
       // Change the duplicate in the queue properties to the merged set.
       queueRequest->data = mergedPropertyList;
@@ -389,6 +390,79 @@ sbDeviceRequestThreadQueue::IsDuplicateRequest(sbRequestItem * aQueueRequest,
   return NS_OK;
 }
 
+/**
+ * Appends the GUID of aItem to aKey, or "-" if there is no item
+ */
+static nsresult AppendItemGuid(sbIMediaItem * aItem, nsACString & aKey)
+{
+  if (!aItem) {
+    aKey.Append('-');
+    return NS_OK;
+  }
+
+  nsString guid;
+  nsresult rv = aItem->GetGuid(guid);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  aKey.Append(NS_LossyConvertUTF16toASCII(guid));
+
+  return NS_OK;
+}
+
+nsresult
+sbDeviceRequestThreadQueue::GetDuplicateKey(sbRequestItem * aRequest,
+                                            nsACString & aKey)
+{
+  NS_ENSURE_ARG_POINTER(aRequest);
+
+  nsresult rv = NS_OK;
+
+  sbBaseDevice::TransferRequest * request =
+      static_cast<sbBaseDevice::TransferRequest*>(aRequest);
+
+  aKey.Truncate();
+
+  // Requests that don't refer to an item or list (eject, format, etc.) are
+  // only duplicates of the same request type
+  if (!request->item && !request->list) {
+    aKey.AssignLiteral("type:");
+    aKey.AppendInt(request->GetType());
+    return NS_OK;
+  }
+
+  // DupeCheck matches playlist operations against requests whose item is
+  // that playlist, so key both by the playlist
+  nsCOMPtr<sbIMediaList> playlist;
+  if (request->IsPlaylist()) {
+    playlist = request->list;
+  }
+  else if (request->item) {
+    nsCOMPtr<sbILibrary> library = do_QueryInterface(request->item);
+    if (!library) {
+      playlist = do_QueryInterface(request->item);
+    }
+  }
+  if (playlist) {
+    aKey.AssignLiteral("list:");
+    rv = AppendItemGuid(playlist, aKey);
+  }
+  else {
+    aKey.AssignLiteral("item:");
+    rv = AppendItemGuid(request->item, aKey);
+    if (NS_SUCCEEDED(rv)) {
+      aKey.Append(':');
+      rv = AppendItemGuid(request->list, aKey);
+    }
+  }
+
+  // If we can't identify the items fall back to scanning the batch
+  if (NS_FAILED(rv)) {
+    aKey.Truncate();
+  }
+
+  return NS_OK;
+}
+
 void sbDeviceRequestThreadQueue::CompleteRequests() {
 
   sbRequestThreadQueue::CompleteRequests();
@@ -532,3 +606,18 @@ sbDeviceRequestThreadQueue::ProcessBatch(Batch & aBatch)
 
   return NS_OK;
 }
+
+nsresult
+sbDeviceRequestThreadQueue::OnQueueDrained()
+{
+  TRACE_FUNCTION("");
+
+  NS_ENSURE_STATE(mBaseDevice);
+
+  nsresult rv;
+
+  rv = mBaseDevice->ProcessQueueDrained();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
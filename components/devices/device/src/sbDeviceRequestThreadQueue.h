@@ -70,12 +70,27 @@ private:
                                       bool & aIsDuplicate,
                                       bool & aContinueChecking);
 
+  /**
+   * Returns the duplicate key for a transfer request. Playlist operations are
+   * keyed by the playlist and item operations by the item and list, so the
+   * requests DupeCheck can consolidate always share a key.
+   * \param aItem the item to generate the key for
+   * \param aKey the duplicate key on return
+   */
+  virtual nsresult GetDuplicateKey(sbRequestItem * aItem,
+                                   nsACString & aKey);
+
   /**
    * Called to process a batch of requests. The implementation shoudl set the
    * processed flag as cleanupBatch will be called after this.
    */
   virtual nsresult ProcessBatch(Batch & aBatch);
 
+  /**
+   * Lets the device finish up once all queued requests have been processed.
+   */
+  virtual nsresult OnQueueDrained();
+
   /**
    * Clear this devices cancel state, if necessary, and proxy to the base
    * implementation which resets mAbortRequests and mIsHandlingRequests
@@ -42,15 +42,214 @@
 
 // Local imports.
 #include "sbBaseDevice.h"
+#include "sbDeviceUtils.h"
 
 // Songbird imports.
+#include <sbIDatabaseQuery.h>
+#include <sbIDatabaseResult.h>
 #include <sbIDeviceCapabilities.h>
+#include <sbMemoryUtils.h>
 #include <sbStandardProperties.h>
 
 // Mozilla imports.
+#include <nsComponentManagerUtils.h>
+#include <nsIPropertyBag2.h>
+#include <nsIThreadPool.h>
+#include <nsNetUtil.h>
+#include <nsServiceManagerUtils.h>
 #include <prprf.h>
 
 
+//------------------------------------------------------------------------------
+//
+// Device statistics library query.
+//
+//------------------------------------------------------------------------------
+
+//
+//   Sums of the items of a library by file extension.  The extension is what
+// follows the last "." of the content URL, as in
+// sbDeviceUtils::GetFormatTypeForURL; rtrim() strips everything but dots from
+// the end of the URL to find it.
+//
+
+#define SB_DEVICE_STATISTICS_QUERY                                             \
+  "SELECT lower(substr(mi.content_url,"                                        \
+  "                    length(rtrim(mi.content_url,"                           \
+  "                                 replace(mi.content_url, '.', ''))) + 1))"  \
+  "         AS extension,"                                                     \
+  "       count(1),"                                                           \
+  "       total(mi.content_length),"                                           \
+  "       total(rp.obj)"                                                       \
+  "  FROM media_items AS mi"                                                   \
+  "  LEFT JOIN resource_properties AS rp"                                      \
+  "    ON rp.media_item_id = mi.media_item_id"                                 \
+  "   AND rp.property_id = (SELECT property_id FROM properties"                \
+  "                          WHERE property_name = '" SB_PROPERTY_DURATION "')"\
+  " WHERE mi.is_list = 0 AND mi.content_url LIKE '%.%'"                        \
+  " GROUP BY extension"
+
+/**
+ * Runs the library statistics query on a background thread and passes the
+ * audio and video sums back to the device statistics.
+ */
+
+class sbDeviceStatisticsQuery : public nsIRunnable
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIRUNNABLE
+
+  sbDeviceStatisticsQuery(sbDeviceStatistics* aStatistics,
+                          sbIDevice*          aDevice,
+                          sbIDatabaseQuery*   aQuery,
+                          PRUint32            aGeneration) :
+    mStatistics(aStatistics),
+    mDevice(aDevice),
+    mQuery(aQuery),
+    mGeneration(aGeneration),
+    mAudioCount(0),
+    mAudioUsed(0),
+    mAudioPlayTime(0),
+    mVideoCount(0),
+    mVideoUsed(0),
+    mVideoPlayTime(0)
+  {
+  }
+
+private:
+  nsresult Sum();
+
+  static PRUint64 ParseTotal(const nsAString& aTotal);
+
+  //
+  // mStatistics                Statistics to pass the sums to.
+  // mDevice                    Keeps the device alive while summing up.
+  // mQuery                     Library statistics query.
+  // mGeneration                Statistics generation the sums are for.
+  //
+
+  nsRefPtr<sbDeviceStatistics>  mStatistics;
+  nsCOMPtr<sbIDevice>           mDevice;
+  nsCOMPtr<sbIDatabaseQuery>    mQuery;
+  PRUint32                      mGeneration;
+  PRUint32                      mAudioCount;
+  PRUint64                      mAudioUsed;
+  PRUint64                      mAudioPlayTime;
+  PRUint32                      mVideoCount;
+  PRUint64                      mVideoUsed;
+  PRUint64                      mVideoPlayTime;
+};
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbDeviceStatisticsQuery, nsIRunnable)
+
+NS_IMETHODIMP
+sbDeviceStatisticsQuery::Run()
+{
+  nsresult result = Sum();
+  mStatistics->LibraryQueryComplete(mGeneration,
+                                    result,
+                                    mAudioCount,
+                                    mAudioUsed,
+                                    mAudioPlayTime,
+                                    mVideoCount,
+                                    mVideoUsed,
+                                    mVideoPlayTime);
+  return NS_OK;
+}
+
+nsresult
+sbDeviceStatisticsQuery::Sum()
+{
+  nsresult rv;
+
+  PRInt32 dbResult;
+  rv = mQuery->Execute(&dbResult);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbResult == 0, NS_ERROR_FAILURE);
+
+  nsCOMPtr<sbIDatabaseResult> result;
+  rv = mQuery->GetResultObject(getter_AddRefs(result));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 rowCount;
+  rv = result->GetRowCount(&rowCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  for (PRUint32 row = 0; row < rowCount; row++) {
+    // Get the content type of the extension.  Other content types are
+    // collected together elsewhere in the total other statistics.
+    nsAutoString url(NS_LITERAL_STRING("."));
+    nsAutoString extension;
+    rv = result->GetRowCell(row, 0, extension);
+    NS_ENSURE_SUCCESS(rv, rv);
+    url.Append(extension);
+
+    sbExtensionToContentFormatEntry_t formatType;
+    rv = sbDeviceUtils::GetFormatTypeForURL(url, formatType);
+    if (NS_FAILED(rv))
+      continue;
+
+    nsAutoString cell;
+    rv = result->GetRowCell(row, 1, cell);
+    NS_ENSURE_SUCCESS(rv, rv);
+    PRUint32 count = cell.ToInteger(&rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = result->GetRowCell(row, 2, cell);
+    NS_ENSURE_SUCCESS(rv, rv);
+    PRUint64 used = ParseTotal(cell);
+
+    rv = result->GetRowCell(row, 3, cell);
+    NS_ENSURE_SUCCESS(rv, rv);
+    PRUint64 playTime = ParseTotal(cell);
+
+    if (formatType.ContentType == sbIDeviceCapabilities::CONTENT_AUDIO) {
+      mAudioCount += count;
+      mAudioUsed += used;
+      mAudioPlayTime += playTime;
+    } else if (formatType.ContentType == sbIDeviceCapabilities::CONTENT_VIDEO) {
+      mVideoCount += count;
+      mVideoUsed += used;
+      mVideoPlayTime += playTime;
+    }
+  }
+
+  return NS_OK;
+}
+
+/**
+ * Parse the result of an SQL total(), which is a floating point number.
+ */
+
+/* static */ PRUint64
+sbDeviceStatisticsQuery::ParseTotal(const nsAString& aTotal)
+{
+  double total;
+  if (PR_sscanf(NS_ConvertUTF16toUTF8(aTotal).get(), "%lf", &total) != 1 ||
+      total < 0) {
+    return 0;
+  }
+  return static_cast<PRUint64>(total);
+}
+
+
+//
+// Auto-disposal class wrappers.
+//
+//   sbAutoDeviceStatisticsQuery
+//                              Wrapper to stop leaving added and removed items
+//                              to the library sums of a statistics generation.
+//
+
+SB_AUTO_CLASS2(sbAutoDeviceStatisticsQuery,
+               sbDeviceStatistics*,
+               PRUint32,
+               !!mValue,
+               mValue->CancelLibraryQuery(mValue2),
+               mValue = nsnull);
+
+
 //------------------------------------------------------------------------------
 //
 // Device statistics nsISupports services.
@@ -192,10 +391,15 @@ sbDeviceStatistics::AddLibrary(sbIDeviceLibrary* aLibrary)
   rv = ClearLibraryStatistics(aLibrary);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  // Collect the media statistics from the library.
-  rv = aLibrary->EnumerateAllItems(this,
-                                   sbIMediaList::ENUMERATIONTYPE_SNAPSHOT);
-  NS_ENSURE_SUCCESS(rv, rv);
+  // Collect the media statistics from the library.  Sum them up in the
+  // database instead of enumerating every item.
+  rv = StartLibraryQuery(aLibrary);
+  if (NS_FAILED(rv)) {
+    NS_WARNING("Failed to query the device library statistics");
+    rv = aLibrary->EnumerateAllItems(this,
+                                     sbIMediaList::ENUMERATIONTYPE_SNAPSHOT);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
 
   return NS_OK;
 }
@@ -239,6 +443,16 @@ sbDeviceStatistics::AddItem(sbIMediaItem* aMediaItem)
   // Function variables.
   nsresult rv;
 
+  // The library sums being taken may or may not include the item; take them
+  // again once they are done.
+  {
+    nsAutoLock autoStatLock(mStatLock);
+    if (mQueryPending) {
+      mQueryStale = PR_TRUE;
+      return NS_OK;
+    }
+  }
+
   // Update the statistics for the added item.
   rv = UpdateForItem(aMediaItem, PR_TRUE);
   NS_ENSURE_SUCCESS(rv, rv);
@@ -262,6 +476,15 @@ sbDeviceStatistics::RemoveItem(sbIMediaItem* aMediaItem)
   // Function variables.
   nsresult rv;
 
+  // The library sums being taken may or may not include the item.
+  {
+    nsAutoLock autoStatLock(mStatLock);
+    if (mQueryPending) {
+      mQueryStale = PR_TRUE;
+      return NS_OK;
+    }
+  }
+
   // Update the statistics for the removed item.
   rv = UpdateForItem(aMediaItem, PR_FALSE);
   NS_ENSURE_SUCCESS(rv, rv);
@@ -300,6 +523,16 @@ sbDeviceStatistics::RemoveAllItems(sbIDeviceLibrary* aLibrary)
 //
 //------------------------------------------------------------------------------
 
+//
+// Library query getters.
+//
+
+PRBool sbDeviceStatistics::QueryPending()
+{
+  nsAutoLock autoStatLock(mStatLock);
+  return mQueryPending;
+}
+
 //
 // Audio count setter/getters.
 //
@@ -520,7 +753,10 @@ sbDeviceStatistics::sbDeviceStatistics() :
   mVideoUsed(0),
   mVideoPlayTime(0),
   mImageCount(0),
-  mImageUsed(0)
+  mImageUsed(0),
+  mQueryGeneration(0),
+  mQueryPending(PR_FALSE),
+  mQueryStale(PR_FALSE)
 {
 }
 
@@ -574,6 +810,14 @@ sbDeviceStatistics::ClearLibraryStatistics(sbIDeviceLibrary* aLibrary)
   // Validate arguments.
   NS_ENSURE_ARG_POINTER(aLibrary);
 
+  nsAutoLock autoStatLock(mStatLock);
+
+  // Throw away any library sums being taken.
+  mQueryGeneration++;
+  mQueryPending = PR_FALSE;
+  mQueryStale = PR_FALSE;
+  mQueryLibrary = nsnull;
+
   // Clear library statistics.
   mAudioCount = 0;
   mAudioUsed = 0;
@@ -666,3 +910,185 @@ sbDeviceStatistics::UpdateForItem(sbIMediaItem* aMediaItem,
 }
 
 
+/**
+ * Start summing up the statistics of the device library specified by aLibrary
+ * on a background thread.
+ *
+ * \param aLibrary              Device library to sum up.
+ */
+
+nsresult
+sbDeviceStatistics::StartLibraryQuery(sbIDeviceLibrary* aLibrary)
+{
+  // Validate arguments.
+  NS_ENSURE_ARG_POINTER(aLibrary);
+
+  // Function variables.
+  nsresult rv;
+
+  // Mark the sums as being taken, so that items added and removed from now on
+  // are left to them.  Stop doing so if the sums can't be taken.
+  PRUint32 generation;
+  {
+    nsAutoLock autoStatLock(mStatLock);
+    generation = mQueryGeneration;
+    mQueryPending = PR_TRUE;
+    mQueryStale = PR_FALSE;
+    mQueryLibrary = aLibrary;
+  }
+  sbAutoDeviceStatisticsQuery autoQuery(this, generation);
+
+  // The query reads the database directly, so write out any items and
+  // properties the library still has cached.  A device may add the library
+  // right after filling it in.
+  rv = aLibrary->Flush();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Get the library database file.
+  nsCOMPtr<nsIPropertyBag2> creationParameters;
+  rv = aLibrary->GetCreationParameters(getter_AddRefs(creationParameters));
+  NS_ENSURE_SUCCESS(rv, rv);
+  nsCOMPtr<nsILocalFile> databaseFile;
+  rv = creationParameters->GetPropertyAsInterface
+                             (NS_LITERAL_STRING("databaseFile"),
+                              NS_GET_IID(nsILocalFile),
+                              getter_AddRefs(databaseFile));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Set up a query on the library database the way the library factory does:
+  // the GUID is the file name without its ".db" extension and the location
+  // is its directory.
+  nsCOMPtr<sbIDatabaseQuery> query =
+    do_CreateInstance("@songbirdnest.com/Songbird/DatabaseQuery;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsAutoString leafName;
+  rv = databaseFile->GetLeafName(leafName);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(leafName.Length() > 3, NS_ERROR_UNEXPECTED);
+  rv = query->SetDatabaseGUID(Substring(leafName, 0, leafName.Length() - 3));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCOMPtr<nsIFile> databaseDirectory;
+  rv = databaseFile->GetParent(getter_AddRefs(databaseDirectory));
+  NS_ENSURE_SUCCESS(rv, rv);
+  nsCOMPtr<nsIURI> databaseLocation;
+  rv = NS_NewFileURI(getter_AddRefs(databaseLocation), databaseDirectory);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = query->SetDatabaseLocation(databaseLocation);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = query->SetAsyncQuery(PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = query->AddQuery(NS_LITERAL_STRING(SB_DEVICE_STATISTICS_QUERY));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Take the sums on a background thread.
+  nsCOMPtr<nsIRunnable> runnable =
+    new sbDeviceStatisticsQuery(this,
+                                static_cast<sbIDevice*>(mBaseDevice),
+                                query,
+                                generation);
+  NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+  nsCOMPtr<nsIThreadPool> threadPool =
+    do_GetService("@songbirdnest.com/Songbird/ThreadPoolService;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = threadPool->Dispatch(runnable, NS_DISPATCH_NORMAL);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // The sums are now completed by the query.
+  autoQuery.forget();
+
+  return NS_OK;
+}
+
+
+/**
+ * Stop leaving added and removed items to the library sums of the statistics
+ * generation specified by aGeneration.
+ */
+
+void
+sbDeviceStatistics::CancelLibraryQuery(PRUint32 aGeneration)
+{
+  nsAutoLock autoStatLock(mStatLock);
+  if (aGeneration != mQueryGeneration)
+    return;
+  mQueryPending = PR_FALSE;
+  mQueryStale = PR_FALSE;
+  mQueryLibrary = nsnull;
+}
+
+
+/**
+ * Called on a background thread with the library sums for the statistics
+ * generation specified by aGeneration.
+ */
+
+void
+sbDeviceStatistics::LibraryQueryComplete(PRUint32 aGeneration,
+                                         nsresult aResult,
+                                         PRUint32 aAudioCount,
+                                         PRUint64 aAudioUsed,
+                                         PRUint64 aAudioPlayTime,
+                                         PRUint32 aVideoCount,
+                                         PRUint64 aVideoUsed,
+                                         PRUint64 aVideoPlayTime)
+{
+  nsresult rv;
+
+  nsCOMPtr<sbIDeviceLibrary> library;
+  PRBool                     stale;
+  {
+    nsAutoLock autoStatLock(mStatLock);
+
+    // Ignore the sums if the statistics were cleared meanwhile.
+    if (aGeneration != mQueryGeneration || !mQueryPending)
+      return;
+
+    // Use the sums unless items were added or removed while summing up.
+    library = mQueryLibrary;
+    stale = mQueryStale;
+    if (NS_SUCCEEDED(aResult) && !stale) {
+      mQueryPending = PR_FALSE;
+      mQueryLibrary = nsnull;
+      mAudioCount = aAudioCount;
+      mAudioUsed = aAudioUsed;
+      mAudioPlayTime = aAudioPlayTime;
+      mVideoCount = aVideoCount;
+      mVideoUsed = aVideoUsed;
+      mVideoPlayTime = aVideoPlayTime;
+    }
+  }
+
+  // Whatever happens below, these sums are no longer being taken.
+  sbAutoDeviceStatisticsQuery autoQuery(this, aGeneration);
+
+  // Sum up again if the sums are stale.
+  if (NS_SUCCEEDED(aResult) && stale) {
+    rv = StartLibraryQuery(library);
+    if (NS_SUCCEEDED(rv)) {
+      autoQuery.forget();
+      return;
+    }
+    NS_WARNING("Failed to query the device library statistics again");
+  }
+
+  // Fall back to enumerating the library items if the sums can't be taken.
+  // Items added and removed from now on are counted as they are.
+  if (NS_FAILED(aResult) || stale) {
+    NS_WARN_IF_FALSE(NS_SUCCEEDED(aResult),
+                     "Failed to query the device library statistics");
+    autoQuery.Clear();
+    rv = library->EnumerateAllItems(this,
+                                    sbIMediaList::ENUMERATIONTYPE_SNAPSHOT);
+    NS_WARN_IF_FALSE(NS_SUCCEEDED(rv),
+                     "Failed to enumerate the device library statistics");
+  }
+
+  // Publish the new statistics.
+  rv = mBaseDevice->UpdateStatisticsProperties();
+  NS_WARN_IF_FALSE(NS_SUCCEEDED(rv),
+                   "Failed to update the device statistics properties");
+}
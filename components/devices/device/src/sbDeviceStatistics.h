@@ -46,6 +46,7 @@
 // Mozilla imports.
 #include <nsAutoLock.h>
 #include <nsCOMPtr.h>
+#include <nsStringAPI.h>
 
 
 //------------------------------------------------------------------------------
@@ -56,6 +57,13 @@
 
 /**
  * Keeps track of the used statistics on the device.
+ *
+ * The statistics of a whole library are summed up by the database, grouped by
+ * file extension, on a background thread.  Items added and removed after that
+ * are accounted for one at a time by whoever adds and removes them.  Devices
+ * that change a library in a batch, like the CD device filling in its
+ * library, add the library again afterwards instead; the statistics do not
+ * listen to the library for batch notifications themselves.
  */
 
 class sbDeviceStatistics : public sbIMediaListEnumerationListener
@@ -83,6 +91,12 @@ public:
   static nsresult New(class sbBaseDevice*  aDevice,
                       sbDeviceStatistics** aDeviceStatistics);
 
+  /**
+   * Add the device library aLibrary to the device statistics.  The statistics
+   * are summed up asynchronously; the device statistics properties are
+   * updated once they are.  May be called again after a batch of changes
+   * instead of adding and removing each item.
+   */
   nsresult AddLibrary(sbIDeviceLibrary* aLibrary);
 
   nsresult RemoveLibrary(sbIDeviceLibrary* aLibrary);
@@ -93,6 +107,12 @@ public:
 
   nsresult RemoveAllItems(sbIDeviceLibrary* aLibrary);
 
+  /**
+   * True while the sums of a library are being taken.  Items added and
+   * removed meanwhile are left to the sums.
+   */
+  PRBool QueryPending();
+
 
   //
   // Setter/getter services.
@@ -191,6 +211,22 @@ private:
   PRUint32                      mImageCount;
   PRUint64                      mImageUsed;
 
+  //
+  // mQueryGeneration           Incremented whenever the statistics are
+  //                            cleared.  Sums of an older generation are
+  //                            thrown away.
+  // mQueryPending              True while library sums are being taken.
+  // mQueryStale                True if items were added or removed while
+  //                            the sums were being taken; they are taken
+  //                            again then.
+  // mQueryLibrary              Library whose sums are being taken.
+  //
+
+  PRUint32                      mQueryGeneration;
+  PRBool                        mQueryPending;
+  PRBool                        mQueryStale;
+  nsCOMPtr<sbIDeviceLibrary>    mQueryLibrary;
+
 
   //
   // Private device statistics services.
@@ -207,6 +243,22 @@ private:
   nsresult UpdateForItem(sbIMediaItem* aMediaItem,
                          PRBool        aItemAdded);
 
+  nsresult StartLibraryQuery(sbIDeviceLibrary* aLibrary);
+
+  void CancelLibraryQuery(PRUint32 aGeneration);
+
+  friend class sbDeviceStatisticsQuery;
+  friend class sbAutoDeviceStatisticsQuery;
+
+  void LibraryQueryComplete(PRUint32 aGeneration,
+                            nsresult aResult,
+                            PRUint32 aAudioCount,
+                            PRUint64 aAudioUsed,
+                            PRUint64 aAudioPlayTime,
+                            PRUint32 aVideoCount,
+                            PRUint64 aVideoUsed,
+                            PRUint64 aVideoPlayTime);
+
 
   // Prevent derivation.
   sbDeviceStatistics(sbDeviceStatistics const &) {}
@@ -76,8 +76,14 @@ extern PRLogModuleInfo* gBaseDeviceLog;
 #define TRACE(args) do { } while(0)
 #endif
 
+// Maximum number of items to inspect at the same time when preparing a batch
+#define SB_DEVICE_TRANSCODING_MAX_INSPECTORS 4
+
 sbDeviceTranscoding::sbDeviceTranscoding(sbBaseDevice * aBaseDevice) :
-  mBaseDevice(aBaseDevice)
+  mBaseDevice(aBaseDevice),
+  mMediaInspectorPool(
+    new sbMediaInspectorPool(SB_DEVICE_TRANSCODING_MAX_INSPECTORS,
+                             aBaseDevice))
 {
 }
 
@@ -246,6 +252,31 @@ sbDeviceTranscoding::PrepareBatchForTranscoding(Batch & aBatch)
     NS_ENSURE_SUCCESS(rv, rv);
   }
 
+  // Inspect the video items up front, several at a time, so that finding
+  // their transcode profiles below only has to read the cached formats.
+  nsCOMArray<sbIMediaItem> inspectItems;
+  const Batch::const_iterator inspectEnd = aBatch.end();
+  for (Batch::const_iterator iter = aBatch.begin();
+       iter != inspectEnd;
+       ++iter) {
+    TransferRequest * request = static_cast<TransferRequest*>(*iter);
+    if (request->GetType() != sbIDevice::REQUEST_WRITE ||
+        request->IsPlaylist() ||
+        sbDeviceUtils::IsItemDRMProtected(request->item))
+      continue;
+    if (GetTranscodeType(request->item) ==
+        sbITranscodeProfile::TRANSCODE_TYPE_AUDIO_VIDEO) {
+      inspectItems.AppendObject(request->item);
+    }
+  }
+  if (inspectItems.Count() > 0 && mMediaInspectorPool) {
+    rv = mMediaInspectorPool->InspectItems(inspectItems, mBaseDevice);
+    if (rv == NS_ERROR_ABORT)
+      return rv;
+    // Anything that failed is inspected again, one at a time, below.
+    NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to inspect batch items");
+  }
+
   // Iterate over the batch getting the transcode profiles if needed.
   const Batch::const_iterator end = aBatch.end();
   for (Batch::const_iterator iter = aBatch.begin();
@@ -557,15 +588,10 @@ sbDeviceTranscoding::GetMediaFormat(PRUint32 aTranscodeType,
     return NS_OK;
   }
   else {
-    if (!mMediaInspector) {
-      mMediaInspector = do_CreateInstance(SB_MEDIAINSPECTOR_CONTRACTID, &rv);
-      NS_ENSURE_SUCCESS(rv, rv);
-    }
-    nsCOMPtr<sbIMediaFormat> mediaFormat;
-    rv = mMediaInspector->InspectMedia(aMediaItem, getter_AddRefs(mediaFormat));
+    NS_ENSURE_TRUE(mMediaInspectorPool, NS_ERROR_OUT_OF_MEMORY);
+    rv = mMediaInspectorPool->GetMediaFormat(aMediaItem, aMediaFormat);
     NS_ENSURE_SUCCESS(rv, rv);
 
-    mediaFormat.forget(aMediaFormat);
     return NS_OK;
   }
 }
@@ -573,12 +599,16 @@ sbDeviceTranscoding::GetMediaFormat(PRUint32 aTranscodeType,
 nsresult
 sbDeviceTranscoding::GetMediaInspector(sbIMediaInspector** _retval)
 {
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  // Each caller gets its own inspector, as the inspection's job progress is
+  // tied to it; the pool's inspectors are kept for batch inspection.
   nsresult rv;
-  if (!mMediaInspector) {
-    mMediaInspector = do_CreateInstance(SB_MEDIAINSPECTOR_CONTRACTID, &rv);
-    NS_ENSURE_SUCCESS(rv, rv);
-  }
-  NS_ADDREF(*_retval = mMediaInspector);
+  nsCOMPtr<sbIMediaInspector> inspector =
+    do_CreateInstance(SB_MEDIAINSPECTOR_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  inspector.forget(_retval);
   return NS_OK;
 }
 
@@ -29,6 +29,7 @@
 #include <list>
 
 // Mozilla includes
+#include <nsAutoPtr.h>
 #include <nsIArray.h>
 
 // Songbird interfaces
@@ -39,6 +40,7 @@
 
 // Songbird local includes
 #include "sbBaseDevice.h"
+#include "sbMediaInspectorPool.h"
 
 class sbIMediaInspector;
 class sbITranscodeVideoJob;
@@ -120,7 +122,7 @@ public:
   nsresult GetAudioFormatFromMediaItem(sbIMediaItem* aMediaItem,
                                        sbIMediaFormat** aMediaFormat);
   /**
-   * Get a media inspector
+   * Get a new media inspector, for an asynchronous inspection by the caller
    */
   nsresult GetMediaInspector(sbIMediaInspector** _retval);
 
@@ -140,7 +142,7 @@ private:
 
   sbBaseDevice * mBaseDevice;
   nsCOMPtr<nsIArray> mTranscodeProfiles;
-  nsCOMPtr<sbIMediaInspector> mMediaInspector;
+  nsAutoPtr<sbMediaInspectorPool> mMediaInspectorPool;
   nsCOMPtr<sbITranscodeManager> mTranscodeManager;
 };
 
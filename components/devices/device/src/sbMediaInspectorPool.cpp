@@ -0,0 +1,1024 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2011 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+#include "sbMediaInspectorPool.h"
+
+// Mozilla includes
+#include <nsAlgorithm.h>
+#include <nsAutoLock.h>
+#include <nsAutoPtr.h>
+#include <nsComponentManagerUtils.h>
+#include <nsIFile.h>
+#include <nsIFileURL.h>
+#include <nsIProperty.h>
+#include <nsISimpleEnumerator.h>
+#include <nsIURI.h>
+#include <nsIVariant.h>
+#include <nsIWritablePropertyBag2.h>
+#include <nsThreadUtils.h>
+#include <nsTArray.h>
+
+// Songbird interfaces
+#include <sbIJobCancelable.h>
+#include <sbIJobProgress.h>
+#include <sbIMediaFormatMutable.h>
+
+// Songbird includes
+#include <sbLibraryUtils.h>
+#include <sbProxiedComponentManager.h>
+#include <sbStandardProperties.h>
+#include <sbStringUtils.h>
+
+// Local includes
+#include "sbBaseDevice.h"
+#include "sbDeviceUtils.h"
+
+/*
+ * To log this module, set the following environment variable:
+ *   NSPR_LOG_MODULES=sbBaseDevice:5
+ */
+#undef LOG
+#undef TRACE
+#ifdef PR_LOGGING
+extern PRLogModuleInfo* gBaseDeviceLog;
+#define LOG(args)   PR_LOG(gBaseDeviceLog, PR_LOG_WARN,  args)
+#define TRACE(args) PR_LOG(gBaseDeviceLog, PR_LOG_DEBUG, args)
+#else
+#define LOG(args)  do{ } while(0)
+#define TRACE(args) do { } while(0)
+#endif
+
+// Version tag at the start of a cache entry; bump this when changing the
+// format below so that old entries are treated as stale.
+#define SB_MEDIA_FORMAT_CACHE_VERSION "mediaformat:1"
+
+/*
+ * The cache entry is a list of lines of the form "key=value":
+ *
+ *   mediaformat:1
+ *   signature=<content signature>
+ *   container=<container type>
+ *   video=<type>;<width>;<height>;<PAR num>;<PAR den>;<rate num>;<rate den>;
+ *         <bit rate>
+ *   audio=<type>;<bit rate>;<sample rate>;<channels>
+ *   <section>.<property name>=<type>:<value>
+ *
+ * where <section> is one of container, video or audio, and <type> is one of
+ * i (32 bit integer), l (64 bit integer), b (boolean), s (string) or
+ * c (narrow string). "%", "=", ";" and newlines are escaped in all names and
+ * values.
+ */
+
+static void
+EscapeValue(const nsAString & aValue, nsAString & aEscaped)
+{
+  aEscaped.Assign(aValue);
+  nsString_ReplaceSubstring(aEscaped, NS_LITERAL_STRING("%"),
+                            NS_LITERAL_STRING("%25"));
+  nsString_ReplaceSubstring(aEscaped, NS_LITERAL_STRING("="),
+                            NS_LITERAL_STRING("%3D"));
+  nsString_ReplaceSubstring(aEscaped, NS_LITERAL_STRING(";"),
+                            NS_LITERAL_STRING("%3B"));
+  nsString_ReplaceSubstring(aEscaped, NS_LITERAL_STRING("\n"),
+                            NS_LITERAL_STRING("%0A"));
+}
+
+static void
+UnescapeValue(const nsAString & aEscaped, nsAString & aValue)
+{
+  aValue.Assign(aEscaped);
+  nsString_ReplaceSubstring(aValue, NS_LITERAL_STRING("%0A"),
+                            NS_LITERAL_STRING("\n"));
+  nsString_ReplaceSubstring(aValue, NS_LITERAL_STRING("%3B"),
+                            NS_LITERAL_STRING(";"));
+  nsString_ReplaceSubstring(aValue, NS_LITERAL_STRING("%3D"),
+                            NS_LITERAL_STRING("="));
+  nsString_ReplaceSubstring(aValue, NS_LITERAL_STRING("%25"),
+                            NS_LITERAL_STRING("%"));
+}
+
+static void
+AppendField(nsAString & aLine, const nsAString & aValue)
+{
+  nsString escaped;
+  EscapeValue(aValue, escaped);
+  aLine.Append(escaped);
+}
+
+static nsresult
+AppendPropertyBag(nsAString & aEntry,
+                  const char * aSection,
+                  nsIPropertyBag * aProperties)
+{
+  if (!aProperties)
+    return NS_OK;
+
+  nsresult rv;
+
+  nsCOMPtr<nsISimpleEnumerator> enumerator;
+  rv = aProperties->GetEnumerator(getter_AddRefs(enumerator));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool hasMore;
+  while (NS_SUCCEEDED(enumerator->HasMoreElements(&hasMore)) && hasMore) {
+    nsCOMPtr<nsISupports> supports;
+    rv = enumerator->GetNext(getter_AddRefs(supports));
+    NS_ENSURE_SUCCESS(rv, rv);
+    nsCOMPtr<nsIProperty> property = do_QueryInterface(supports, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsString name;
+    rv = property->GetName(name);
+    NS_ENSURE_SUCCESS(rv, rv);
+    nsCOMPtr<nsIVariant> variant;
+    rv = property->GetValue(getter_AddRefs(variant));
+    NS_ENSURE_SUCCESS(rv, rv);
+    PRUint16 dataType;
+    rv = variant->GetDataType(&dataType);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsString value;
+    char type;
+    switch (dataType) {
+      case nsIDataType::VTYPE_INT8:
+      case nsIDataType::VTYPE_INT16:
+      case nsIDataType::VTYPE_INT32:
+      {
+        PRInt32 intValue;
+        rv = variant->GetAsInt32(&intValue);
+        NS_ENSURE_SUCCESS(rv, rv);
+        type = 'i';
+        value.AppendInt(intValue);
+        break;
+      }
+      case nsIDataType::VTYPE_INT64:
+      case nsIDataType::VTYPE_UINT8:
+      case nsIDataType::VTYPE_UINT16:
+      case nsIDataType::VTYPE_UINT32:
+      case nsIDataType::VTYPE_UINT64:
+      {
+        PRInt64 int64Value;
+        rv = variant->GetAsInt64(&int64Value);
+        NS_ENSURE_SUCCESS(rv, rv);
+        type = 'l';
+        value = sbAutoString(int64Value);
+        break;
+      }
+      case nsIDataType::VTYPE_BOOL:
+      {
+        PRBool boolValue;
+        rv = variant->GetAsBool(&boolValue);
+        NS_ENSURE_SUCCESS(rv, rv);
+        type = 'b';
+        value.AppendInt(boolValue ? 1 : 0);
+        break;
+      }
+      case nsIDataType::VTYPE_ASTRING:
+      case nsIDataType::VTYPE_DOMSTRING:
+      case nsIDataType::VTYPE_WCHAR_STR:
+      case nsIDataType::VTYPE_WSTRING_SIZE_IS:
+        rv = variant->GetAsAString(value);
+        NS_ENSURE_SUCCESS(rv, rv);
+        type = 's';
+        break;
+      case nsIDataType::VTYPE_CSTRING:
+      case nsIDataType::VTYPE_UTF8STRING:
+      case nsIDataType::VTYPE_CHAR_STR:
+      case nsIDataType::VTYPE_STRING_SIZE_IS:
+      {
+        nsCString cValue;
+        rv = variant->GetAsACString(cValue);
+        NS_ENSURE_SUCCESS(rv, rv);
+        type = 'c';
+        value = NS_ConvertUTF8toUTF16(cValue);
+        break;
+      }
+      default:
+        // Nothing the inspector produces; don't cache what we can't restore.
+        continue;
+    }
+
+    aEntry.AppendLiteral(aSection);
+    aEntry.Append(PRUnichar('.'));
+    AppendField(aEntry, name);
+    aEntry.Append(PRUnichar('='));
+    aEntry.Append(PRUnichar(type));
+    aEntry.Append(PRUnichar(':'));
+    AppendField(aEntry, value);
+    aEntry.Append(PRUnichar('\n'));
+  }
+
+  return NS_OK;
+}
+
+static nsresult
+SerializeMediaFormat(sbIMediaFormat * aMediaFormat,
+                     const nsAString & aSignature,
+                     nsAString & aEntry)
+{
+  NS_ENSURE_ARG_POINTER(aMediaFormat);
+
+  nsresult rv;
+
+  aEntry.AssignLiteral(SB_MEDIA_FORMAT_CACHE_VERSION "\n");
+  aEntry.AppendLiteral("signature=");
+  AppendField(aEntry, aSignature);
+  aEntry.Append(PRUnichar('\n'));
+
+  nsCOMPtr<nsIPropertyBag> properties;
+  nsString type;
+
+  nsCOMPtr<sbIMediaFormatContainer> container;
+  rv = aMediaFormat->GetContainer(getter_AddRefs(container));
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (container) {
+    rv = container->GetContainerType(type);
+    NS_ENSURE_SUCCESS(rv, rv);
+    aEntry.AppendLiteral("container=");
+    AppendField(aEntry, type);
+    aEntry.Append(PRUnichar('\n'));
+
+    rv = container->GetProperties(getter_AddRefs(properties));
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = AppendPropertyBag(aEntry, "container", properties);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  nsCOMPtr<sbIMediaFormatVideo> video;
+  rv = aMediaFormat->GetVideoStream(getter_AddRefs(video));
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (video) {
+    PRInt32 width, height, bitRate;
+    PRUint32 parNumerator, parDenominator, rateNumerator, rateDenominator;
+    rv = video->GetVideoType(type);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = video->GetVideoWidth(&width);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = video->GetVideoHeight(&height);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = video->GetVideoPAR(&parNumerator, &parDenominator);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = video->GetVideoFrameRate(&rateNumerator, &rateDenominator);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = video->GetBitRate(&bitRate);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    aEntry.AppendLiteral("video=");
+    AppendField(aEntry, type);
+    aEntry.Append(PRUnichar(';'));
+    aEntry.AppendInt(width);
+    aEntry.Append(PRUnichar(';'));
+    aEntry.AppendInt(height);
+    aEntry.Append(PRUnichar(';'));
+    aEntry.Append(sbAutoString(parNumerator));
+    aEntry.Append(PRUnichar(';'));
+    aEntry.Append(sbAutoString(parDenominator));
+    aEntry.Append(PRUnichar(';'));
+    aEntry.Append(sbAutoString(rateNumerator));
+    aEntry.Append(PRUnichar(';'));
+    aEntry.Append(sbAutoString(rateDenominator));
+    aEntry.Append(PRUnichar(';'));
+    aEntry.AppendInt(bitRate);
+    aEntry.Append(PRUnichar('\n'));
+
+    rv = video->GetProperties(getter_AddRefs(properties));
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = AppendPropertyBag(aEntry, "video", properties);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  nsCOMPtr<sbIMediaFormatAudio> audio;
+  rv = aMediaFormat->GetAudioStream(getter_AddRefs(audio));
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (audio) {
+    PRInt32 bitRate, sampleRate, channels;
+    rv = audio->GetAudioType(type);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = audio->GetBitRate(&bitRate);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = audio->GetSampleRate(&sampleRate);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = audio->GetChannels(&channels);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    aEntry.AppendLiteral("audio=");
+    AppendField(aEntry, type);
+    aEntry.Append(PRUnichar(';'));
+    aEntry.AppendInt(bitRate);
+    aEntry.Append(PRUnichar(';'));
+    aEntry.AppendInt(sampleRate);
+    aEntry.Append(PRUnichar(';'));
+    aEntry.AppendInt(channels);
+    aEntry.Append(PRUnichar('\n'));
+
+    rv = audio->GetProperties(getter_AddRefs(properties));
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = AppendPropertyBag(aEntry, "audio", properties);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+static nsresult
+SetBagProperty(nsCOMPtr<nsIWritablePropertyBag2> & aBag,
+               const nsAString & aName,
+               const nsAString & aTypedValue)
+{
+  nsresult rv;
+
+  // Values are "<type>:<value>"
+  NS_ENSURE_TRUE(aTypedValue.Length() >= 2 && aTypedValue[1] == ':',
+                 NS_ERROR_FAILURE);
+
+  if (!aBag) {
+    aBag = do_CreateInstance("@mozilla.org/hash-property-bag;1", &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  nsString value;
+  UnescapeValue(Substring(aTypedValue, 2), value);
+
+  switch (aTypedValue[0]) {
+    case 'i':
+    {
+      PRInt32 intValue = value.ToInteger(&rv, 10);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = aBag->SetPropertyAsInt32(aName, intValue);
+      break;
+    }
+    case 'l':
+    {
+      PRInt64 int64Value = nsString_ToInt64(value, &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = aBag->SetPropertyAsInt64(aName, int64Value);
+      break;
+    }
+    case 'b':
+      rv = aBag->SetPropertyAsBool(aName, value.EqualsLiteral("1"));
+      break;
+    case 's':
+      rv = aBag->SetPropertyAsAString(aName, value);
+      break;
+    case 'c':
+      rv = aBag->SetPropertyAsACString(aName, NS_ConvertUTF16toUTF8(value));
+      break;
+    default:
+      return NS_ERROR_FAILURE;
+  }
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+static nsresult
+DeserializeMediaFormat(const nsAString & aEntry,
+                       const nsAString & aSignature,
+                       sbIMediaFormat ** aMediaFormat)
+{
+  NS_ENSURE_ARG_POINTER(aMediaFormat);
+
+  nsresult rv;
+
+  nsTArray<nsString> lines;
+  nsString_Split(aEntry, NS_LITERAL_STRING("\n"), lines);
+  if (lines.Length() < 2 ||
+      !lines[0].EqualsLiteral(SB_MEDIA_FORMAT_CACHE_VERSION))
+  {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  nsCOMPtr<sbIMediaFormatContainerMutable> container;
+  nsCOMPtr<sbIMediaFormatVideoMutable> video;
+  nsCOMPtr<sbIMediaFormatAudioMutable> audio;
+  nsCOMPtr<nsIWritablePropertyBag2> containerProperties;
+  nsCOMPtr<nsIWritablePropertyBag2> videoProperties;
+  nsCOMPtr<nsIWritablePropertyBag2> audioProperties;
+  PRBool signatureMatches = PR_FALSE;
+
+  for (PRUint32 i = 1; i < lines.Length(); ++i) {
+    const nsString & line = lines[i];
+    if (line.IsEmpty())
+      continue;
+
+    PRInt32 separator = line.FindChar('=');
+    NS_ENSURE_TRUE(separator > 0, NS_ERROR_FAILURE);
+    const nsDependentSubstring key(line, 0, separator);
+    const nsDependentSubstring value(line, separator + 1);
+
+    if (key.EqualsLiteral("signature")) {
+      nsString signature;
+      UnescapeValue(value, signature);
+      signatureMatches = signature.Equals(aSignature);
+      if (!signatureMatches)
+        return NS_ERROR_NOT_AVAILABLE;
+    }
+    else if (key.EqualsLiteral("container")) {
+      container = do_CreateInstance(SB_MEDIAFORMATCONTAINER_CONTRACTID, &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+      nsString type;
+      UnescapeValue(value, type);
+      rv = container->SetContainerType(type);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    else if (key.EqualsLiteral("video")) {
+      nsTArray<nsString> fields;
+      nsString_Split(value, NS_LITERAL_STRING(";"), fields);
+      NS_ENSURE_TRUE(fields.Length() == 8, NS_ERROR_FAILURE);
+
+      PRInt32 numbers[7];
+      for (PRUint32 field = 1; field < 8; ++field) {
+        numbers[field - 1] = fields[field].ToInteger(&rv, 10);
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
+
+      video = do_CreateInstance(SB_MEDIAFORMATVIDEO_CONTRACTID, &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+      nsString type;
+      UnescapeValue(fields[0], type);
+      rv = video->SetVideoType(type);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = video->SetVideoWidth(numbers[0]);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = video->SetVideoHeight(numbers[1]);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = video->SetVideoPAR(numbers[2], numbers[3]);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = video->SetVideoFrameRate(numbers[4], numbers[5]);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = video->SetBitRate(numbers[6]);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    else if (key.EqualsLiteral("audio")) {
+      nsTArray<nsString> fields;
+      nsString_Split(value, NS_LITERAL_STRING(";"), fields);
+      NS_ENSURE_TRUE(fields.Length() == 4, NS_ERROR_FAILURE);
+
+      PRInt32 numbers[3];
+      for (PRUint32 field = 1; field < 4; ++field) {
+        numbers[field - 1] = fields[field].ToInteger(&rv, 10);
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
+
+      audio = do_CreateInstance(SB_MEDIAFORMATAUDIO_CONTRACTID, &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+      nsString type;
+      UnescapeValue(fields[0], type);
+      rv = audio->SetAudioType(type);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = audio->SetBitRate(numbers[0]);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = audio->SetSampleRate(numbers[1]);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = audio->SetChannels(numbers[2]);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    else {
+      // A property of one of the sections
+      PRInt32 dot = key.FindChar('.');
+      NS_ENSURE_TRUE(dot > 0, NS_ERROR_FAILURE);
+      const nsDependentSubstring section(key, 0, dot);
+      nsString name;
+      UnescapeValue(Substring(key, dot + 1), name);
+
+      if (section.EqualsLiteral("container"))
+        rv = SetBagProperty(containerProperties, name, value);
+      else if (section.EqualsLiteral("video"))
+        rv = SetBagProperty(videoProperties, name, value);
+      else if (section.EqualsLiteral("audio"))
+        rv = SetBagProperty(audioProperties, name, value);
+      else
+        rv = NS_ERROR_FAILURE;
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
+  NS_ENSURE_TRUE(signatureMatches, NS_ERROR_NOT_AVAILABLE);
+
+  nsCOMPtr<sbIMediaFormatMutable> mediaFormat =
+    do_CreateInstance(SB_MEDIAFORMAT_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (container) {
+    if (containerProperties) {
+      nsCOMPtr<nsIPropertyBag> bag = do_QueryInterface(containerProperties);
+      rv = container->SetProperties(bag);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    rv = mediaFormat->SetContainer(container);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+  if (video) {
+    if (videoProperties) {
+      nsCOMPtr<nsIPropertyBag> bag = do_QueryInterface(videoProperties);
+      rv = video->SetProperties(bag);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    rv = mediaFormat->SetVideoStream(video);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+  if (audio) {
+    if (audioProperties) {
+      nsCOMPtr<nsIPropertyBag> bag = do_QueryInterface(audioProperties);
+      rv = audio->SetProperties(bag);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    rv = mediaFormat->SetAudioStream(audio);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  rv = CallQueryInterface(mediaFormat.get(), aMediaFormat);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+/**
+ * Listens to one of the pool's inspectors and records the outcome of each
+ * inspection it finishes. Inspectors report progress on the main thread, so
+ * the result is read there, and handed to the thread running InspectItems
+ * under the monitor, which is then notified.
+ */
+class sbMediaInspectorPoolListener : public sbIJobProgressListener
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBIJOBPROGRESSLISTENER
+
+  sbMediaInspectorPoolListener(PRMonitor * aMonitor) :
+    mMonitor(aMonitor),
+    mIsComplete(PR_FALSE)
+  {
+  }
+
+  /**
+   * Forgets the outcome of the previous inspection. Call with the monitor
+   * held.
+   */
+  void Reset()
+  {
+    mIsComplete = PR_FALSE;
+    mMediaFormat = nsnull;
+  }
+
+  /**
+   * Returns whether the current inspection has finished, and its result if
+   * it succeeded. Call with the monitor held.
+   */
+  PRBool IsComplete(sbIMediaFormat ** aMediaFormat)
+  {
+    if (mIsComplete)
+      NS_IF_ADDREF(*aMediaFormat = mMediaFormat);
+    return mIsComplete;
+  }
+
+private:
+  ~sbMediaInspectorPoolListener()
+  {
+  }
+
+  PRMonitor * mMonitor; // Not owned
+
+  // Guarded by mMonitor
+  PRBool mIsComplete;
+  nsCOMPtr<sbIMediaFormat> mMediaFormat;
+};
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbMediaInspectorPoolListener,
+                              sbIJobProgressListener)
+
+NS_IMETHODIMP
+sbMediaInspectorPoolListener::OnJobProgress(sbIJobProgress * aJobProgress)
+{
+  NS_ENSURE_ARG_POINTER(aJobProgress);
+
+  nsresult rv;
+
+  PRUint16 status;
+  rv = aJobProgress->GetStatus(&status);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (status == sbIJobProgress::STATUS_RUNNING)
+    return NS_OK;
+
+  nsCOMPtr<sbIMediaFormat> mediaFormat;
+  if (status == sbIJobProgress::STATUS_SUCCEEDED) {
+    nsCOMPtr<sbIMediaInspector> inspector = do_QueryInterface(aJobProgress,
+                                                              &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = inspector->GetMediaFormat(getter_AddRefs(mediaFormat));
+    if (NS_FAILED(rv))
+      mediaFormat = nsnull;
+  }
+
+  nsAutoMonitor monitor(mMonitor);
+  mIsComplete = PR_TRUE;
+  mMediaFormat = mediaFormat;
+  monitor.NotifyAll();
+
+  return NS_OK;
+}
+
+/**
+ * Adds a listener to each of the pool's inspectors in turn, and removes them
+ * all when going out of scope.
+ */
+class sbMediaInspectorPoolAutoListeners
+{
+public:
+  ~sbMediaInspectorPoolAutoListeners()
+  {
+    for (PRInt32 i = 0; i < mJobs.Count(); ++i) {
+      mJobs[i]->RemoveJobProgressListener(mListeners[i]);
+    }
+  }
+
+  /**
+   * Adds a new listener, notifying aMonitor, to aInspector. Listeners are
+   * indexed in the order they were added.
+   */
+  nsresult Add(sbIMediaInspector * aInspector, PRMonitor * aMonitor)
+  {
+    NS_ENSURE_ARG_POINTER(aInspector);
+
+    nsresult rv;
+
+    // Inspectors only accept listeners on the main thread.
+    nsCOMPtr<sbIJobProgress> job = do_MainThreadQueryInterface(aInspector,
+                                                               &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsRefPtr<sbMediaInspectorPoolListener> listener =
+      new sbMediaInspectorPoolListener(aMonitor);
+    NS_ENSURE_TRUE(listener, NS_ERROR_OUT_OF_MEMORY);
+    rv = job->AddJobProgressListener(listener);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRBool success = mJobs.AppendObject(job);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+    success = !!mListeners.AppendElement(listener);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+    return NS_OK;
+  }
+
+  sbMediaInspectorPoolListener * operator[](PRUint32 aIndex)
+  {
+    return mListeners[aIndex];
+  }
+
+private:
+  nsCOMArray<sbIJobProgress> mJobs;
+  nsTArray<nsRefPtr<sbMediaInspectorPoolListener> > mListeners;
+};
+
+sbMediaInspectorPool::sbMediaInspectorPool(PRUint32 aMaxInspectors,
+                                           sbBaseDevice * aDevice) :
+  mMaxInspectors(aMaxInspectors > 0 ? aMaxInspectors : 1),
+  mDevice(aDevice),
+  mMonitor(nsAutoMonitor::NewMonitor("sbMediaInspectorPool::mMonitor"))
+{
+  NS_ASSERTION(mMonitor, "Failed to create sbMediaInspectorPool::mMonitor");
+}
+
+sbMediaInspectorPool::~sbMediaInspectorPool()
+{
+  if (mMonitor)
+    nsAutoMonitor::DestroyMonitor(mMonitor);
+}
+
+nsresult
+sbMediaInspectorPool::GetInspector(PRUint32 aIndex,
+                                   sbIMediaInspector ** aInspector)
+{
+  NS_ENSURE_ARG_POINTER(aInspector);
+  NS_ENSURE_ARG(aIndex < mMaxInspectors);
+
+  nsresult rv;
+
+  // Inspectors are created as they're first needed and then reused.
+  while ((PRUint32)mInspectors.Count() <= aIndex) {
+    nsCOMPtr<sbIMediaInspector> inspector =
+      do_CreateInstance(SB_MEDIAINSPECTOR_CONTRACTID, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+    PRBool success = mInspectors.AppendObject(inspector);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  NS_ADDREF(*aInspector = mInspectors[aIndex]);
+  return NS_OK;
+}
+
+nsresult
+sbMediaInspectorPool::GetMediaFormat(sbIMediaItem * aMediaItem,
+                                     sbIMediaFormat ** aMediaFormat)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItem);
+  NS_ENSURE_ARG_POINTER(aMediaFormat);
+
+  nsresult rv;
+
+  rv = GetCachedMediaFormat(aMediaItem, aMediaFormat);
+  if (NS_SUCCEEDED(rv))
+    return NS_OK;
+
+  nsCOMPtr<sbIMediaInspector> inspector;
+  rv = GetInspector(0, getter_AddRefs(inspector));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCOMPtr<sbIMediaFormat> mediaFormat;
+  rv = inspector->InspectMedia(aMediaItem, getter_AddRefs(mediaFormat));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = SetCachedMediaFormat(aMediaItem, mediaFormat);
+  if (NS_FAILED(rv)) {
+    NS_WARNING("Failed to cache media format");
+  }
+
+  mediaFormat.forget(aMediaFormat);
+  return NS_OK;
+}
+
+nsresult
+sbMediaInspectorPool::InspectItems(nsCOMArray<sbIMediaItem> & aMediaItems,
+                                   sbBaseDevice * aDevice)
+{
+  TRACE(("%s: %d items", __FUNCTION__, aMediaItems.Count()));
+
+  nsresult rv;
+
+  // Wait on the device's stop wait monitor if there is one, so that aborting
+  // the request wakes us up as well as finished inspections.
+  PRMonitor * monitor = mMonitor;
+  if (aDevice)
+    monitor = aDevice->mRequestThreadQueue->GetStopWaitMonitor();
+  NS_ENSURE_TRUE(monitor, NS_ERROR_UNEXPECTED);
+
+  PRUint32 slotCount = NS_MIN(mMaxInspectors,
+                              (PRUint32)aMediaItems.Count());
+
+  // The item being inspected by each inspector, or null if it's idle, and the
+  // listener collecting each inspector's results
+  nsCOMArray<sbIMediaItem> slots;
+  sbMediaInspectorPoolAutoListeners listeners;
+  for (PRUint32 slot = 0; slot < slotCount; ++slot) {
+    PRBool success = slots.AppendObject(nsnull);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+    nsCOMPtr<sbIMediaInspector> inspector;
+    rv = GetInspector(slot, getter_AddRefs(inspector));
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = listeners.Add(inspector, monitor);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  PRBool isMainThread = NS_IsMainThread();
+  PRInt32 nextItem = 0;
+  PRUint32 running = 0;
+
+  while (PR_TRUE) {
+    // Hand out items to any idle inspectors.
+    for (PRUint32 slot = 0;
+         slot < slotCount && nextItem < aMediaItems.Count();
+         ++slot)
+    {
+      if (slots[slot])
+        continue;
+
+      while (nextItem < aMediaItems.Count()) {
+        sbIMediaItem * mediaItem = aMediaItems[nextItem++];
+
+        nsCOMPtr<sbIMediaFormat> cached;
+        rv = GetCachedMediaFormat(mediaItem, getter_AddRefs(cached));
+        if (NS_SUCCEEDED(rv))
+          continue;
+
+        {
+          nsAutoMonitor mon(monitor);
+          listeners[slot]->Reset();
+        }
+
+        rv = mInspectors[slot]->InspectMediaAsync(mediaItem);
+        if (NS_FAILED(rv))
+          continue;
+
+        slots.ReplaceObjectAt(mediaItem, slot);
+        ++running;
+        break;
+      }
+    }
+
+    if (!running)
+      break;
+
+    // Wait for at least one inspection to finish, and collect the results of
+    // all that have.
+    nsCOMArray<sbIMediaItem> finishedItems;
+    nsCOMArray<sbIMediaFormat> finishedFormats;
+    PRBool aborted = PR_FALSE;
+    while (!finishedItems.Count()) {
+      {
+        nsAutoMonitor mon(monitor);
+
+        if (aDevice && aDevice->IsRequestAborted()) {
+          aborted = PR_TRUE;
+          break;
+        }
+
+        for (PRUint32 slot = 0; slot < slotCount; ++slot) {
+          if (!slots[slot])
+            continue;
+
+          nsCOMPtr<sbIMediaFormat> mediaFormat;
+          if (!listeners[slot]->IsComplete(getter_AddRefs(mediaFormat)))
+            continue;
+
+          finishedItems.AppendObject(slots[slot]);
+          finishedFormats.AppendObject(mediaFormat);
+          slots.ReplaceObjectAt(nsnull, slot);
+          --running;
+        }
+
+        // Inspections complete on the main thread, so don't block it.
+        if (!finishedItems.Count() && !isMainThread)
+          mon.Wait();
+      }
+
+      if (!finishedItems.Count() && isMainThread)
+        NS_ProcessNextEvent(nsnull, PR_TRUE);
+    }
+
+    if (aborted) {
+      for (PRUint32 slot = 0; slot < slotCount; ++slot) {
+        if (!slots[slot])
+          continue;
+        nsCOMPtr<sbIJobCancelable> cancelable =
+          do_MainThreadQueryInterface(mInspectors[slot], &rv);
+        if (NS_SUCCEEDED(rv))
+          cancelable->Cancel();
+      }
+      return NS_ERROR_ABORT;
+    }
+
+    // Cache the results outside of the monitor, as setting properties may
+    // need the main thread.
+    for (PRInt32 i = 0; i < finishedItems.Count(); ++i) {
+      if (!finishedFormats[i])
+        continue;
+      rv = SetCachedMediaFormat(finishedItems[i], finishedFormats[i]);
+      if (NS_FAILED(rv)) {
+        NS_WARNING("Failed to cache media format");
+      }
+    }
+  }
+
+  return NS_OK;
+}
+
+/* static */ nsresult
+sbMediaInspectorPool::GetContentSignature(sbIMediaItem * aMediaItem,
+                                          nsAString & aSignature)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItem);
+
+  nsresult rv;
+
+  nsCOMPtr<nsIURI> contentURI;
+  rv = aMediaItem->GetContentSrc(getter_AddRefs(contentURI));
+  NS_ENSURE_SUCCESS(rv, rv);
+  nsCOMPtr<nsIFileURL> contentFileURL = do_QueryInterface(contentURI, &rv);
+  if (NS_FAILED(rv))
+    return NS_ERROR_NOT_AVAILABLE;
+  nsCOMPtr<nsIFile> contentFile;
+  rv = contentFileURL->GetFile(getter_AddRefs(contentFile));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRInt64 fileSize;
+  rv = contentFile->GetFileSize(&fileSize);
+  if (NS_FAILED(rv))
+    return NS_ERROR_NOT_AVAILABLE;
+  PRInt64 lastModified;
+  rv = contentFile->GetLastModifiedTime(&lastModified);
+  if (NS_FAILED(rv))
+    return NS_ERROR_NOT_AVAILABLE;
+
+  nsCString spec;
+  rv = contentURI->GetSpec(spec);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  aSignature.Assign(NS_ConvertUTF8toUTF16(spec));
+  aSignature.Append(PRUnichar('|'));
+  aSignature.Append(sbAutoString(fileSize));
+  aSignature.Append(PRUnichar('|'));
+  aSignature.Append(sbAutoString(lastModified));
+
+  return NS_OK;
+}
+
+/* static */ nsresult
+sbMediaInspectorPool::GetCacheItem(sbIMediaItem * aMediaItem,
+                                   sbIMediaItem ** aCacheItem)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItem);
+  NS_ENSURE_ARG_POINTER(aCacheItem);
+
+  nsCOMPtr<sbIMediaItem> originItem;
+  nsresult rv = sbLibraryUtils::GetOriginItem(aMediaItem,
+                                              getter_AddRefs(originItem));
+  if (NS_SUCCEEDED(rv) && originItem) {
+    originItem.forget(aCacheItem);
+    return NS_OK;
+  }
+
+  NS_ADDREF(*aCacheItem = aMediaItem);
+  return NS_OK;
+}
+
+nsresult
+sbMediaInspectorPool::GetCachedMediaFormat(sbIMediaItem * aMediaItem,
+                                           sbIMediaFormat ** aMediaFormat)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItem);
+  NS_ENSURE_ARG_POINTER(aMediaFormat);
+
+  nsresult rv;
+
+  nsCOMPtr<sbIMediaItem> cacheItem;
+  rv = GetCacheItem(aMediaItem, getter_AddRefs(cacheItem));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsString entry;
+  rv = cacheItem->GetProperty(
+         NS_LITERAL_STRING(SB_PROPERTY_INSPECTED_MEDIA_FORMAT),
+         entry);
+  if (NS_FAILED(rv) || entry.IsEmpty())
+    return NS_ERROR_NOT_AVAILABLE;
+
+  nsString signature;
+  rv = GetContentSignature(cacheItem, signature);
+  if (NS_FAILED(rv))
+    return NS_ERROR_NOT_AVAILABLE;
+
+  rv = DeserializeMediaFormat(entry, signature, aMediaFormat);
+  if (NS_FAILED(rv))
+    return NS_ERROR_NOT_AVAILABLE;
+
+  return NS_OK;
+}
+
+nsresult
+sbMediaInspectorPool::SetCachedMediaFormat(sbIMediaItem * aMediaItem,
+                                           sbIMediaFormat * aMediaFormat)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItem);
+  NS_ENSURE_ARG_POINTER(aMediaFormat);
+
+  nsresult rv;
+
+  nsCOMPtr<sbIMediaItem> cacheItem;
+  rv = GetCacheItem(aMediaItem, getter_AddRefs(cacheItem));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsString signature;
+  rv = GetContentSignature(cacheItem, signature);
+  if (rv == NS_ERROR_NOT_AVAILABLE)
+    return NS_OK;
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsString entry;
+  rv = SerializeMediaFormat(aMediaFormat, signature, entry);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // The entry is only a cache; don't let the device treat it as a change to
+  // send to the device
+  nsAutoPtr<sbDeviceListenerIgnore> ignore;
+  if (mDevice)
+    ignore = new sbDeviceListenerIgnore(mDevice, cacheItem);
+
+  rv = cacheItem->SetProperty(
+         NS_LITERAL_STRING(SB_PROPERTY_INSPECTED_MEDIA_FORMAT),
+         entry);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
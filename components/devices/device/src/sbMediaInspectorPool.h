@@ -0,0 +1,130 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2011 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+#ifndef SBMEDIAINSPECTORPOOL_H_
+#define SBMEDIAINSPECTORPOOL_H_
+
+// Mozilla includes
+#include <nsCOMArray.h>
+#include <nsCOMPtr.h>
+#include <nsStringGlue.h>
+
+// NSPR includes
+#include <prmon.h>
+
+// Songbird interfaces
+#include <sbIMediaInspector.h>
+#include <sbIMediaItem.h>
+
+class sbBaseDevice;
+
+/**
+ * A bounded set of media inspectors used to discover the format of media
+ * items, with the results cached on the items themselves.
+ *
+ * The cache entry (SB_PROPERTY_INSPECTED_MEDIA_FORMAT) is kept on the item's
+ * origin item, usually in the main library, as device items are created
+ * afresh for every transfer; it falls back to the item itself if there is no
+ * origin. It records the content URL, size and modification time of the file
+ * that was inspected, and is only used while all three still match. Items
+ * that aren't local files are never cached.
+ *
+ * An instance is not thread safe; it is meant to be used from the device
+ * request thread, although it will spin the event loop if used on the main
+ * thread. Inspections finish on the main thread, which hands each result to
+ * the waiting thread through a monitor.
+ */
+class sbMediaInspectorPool
+{
+public:
+  /**
+   * \param aMaxInspectors Maximum number of items to inspect at the same time.
+   * \param aDevice        If not null, the device whose listeners should
+   *                       ignore the cache entries written on its items.
+   */
+  sbMediaInspectorPool(PRUint32 aMaxInspectors,
+                       sbBaseDevice * aDevice = nsnull);
+  ~sbMediaInspectorPool();
+
+  /**
+   * Returns the media format for aMediaItem, from the cache if it is fresh,
+   * otherwise by inspecting the item.
+   */
+  nsresult GetMediaFormat(sbIMediaItem * aMediaItem,
+                          sbIMediaFormat ** aMediaFormat);
+
+  /**
+   * Inspects the given items concurrently and caches the results. Items with a
+   * fresh cache entry are skipped; items that can't be inspected are left
+   * uncached, and will be inspected again by GetMediaFormat.
+   *
+   * \param aMediaItems Items to inspect.
+   * \param aDevice     If not null, inspection stops with NS_ERROR_ABORT once
+   *                    this device's current request is aborted.
+   */
+  nsresult InspectItems(nsCOMArray<sbIMediaItem> & aMediaItems,
+                        sbBaseDevice * aDevice);
+
+  /**
+   * Returns the cached media format for aMediaItem, or NS_ERROR_NOT_AVAILABLE
+   * if there isn't a fresh one.
+   */
+  nsresult GetCachedMediaFormat(sbIMediaItem * aMediaItem,
+                                sbIMediaFormat ** aMediaFormat);
+
+  /**
+   * Caches aMediaFormat on aMediaItem. Does nothing if the item isn't a local
+   * file.
+   */
+  nsresult SetCachedMediaFormat(sbIMediaItem * aMediaItem,
+                                sbIMediaFormat * aMediaFormat);
+
+private:
+  /**
+   * Returns the item the cache entry for aMediaItem is kept on: its origin
+   * item if it has one, otherwise aMediaItem itself.
+   */
+  static nsresult GetCacheItem(sbIMediaItem * aMediaItem,
+                               sbIMediaItem ** aCacheItem);
+
+  /**
+   * Returns the signature identifying the current content of aMediaItem,
+   * built from its content URL and the size and modification time of the
+   * file. Returns NS_ERROR_NOT_AVAILABLE if the item isn't a local file.
+   */
+  static nsresult GetContentSignature(sbIMediaItem * aMediaItem,
+                                      nsAString & aSignature);
+
+  nsresult GetInspector(PRUint32 aIndex, sbIMediaInspector ** aInspector);
+
+  PRUint32 mMaxInspectors;
+  sbBaseDevice * mDevice; // Non-owning
+  nsCOMArray<sbIMediaInspector> mInspectors;
+
+  // Notified as inspections finish when there's no device whose stop wait
+  // monitor can be used instead
+  PRMonitor * mMonitor;
+};
+
+#endif /* SBMEDIAINSPECTORPOOL_H_ */
@@ -198,6 +198,7 @@ NS_IMPL_THREADSAFE_RELEASE(sbRequestThreadQueue);
  */
 sbRequestThreadQueue::sbRequestThreadQueue() :
   mLock(nsnull),
+  mPopLock(nsnull),
   mBatchDepth(0),
   mStopWaitMonitor(nsnull),
   mAbortRequests(false),
@@ -209,6 +210,8 @@ sbRequestThreadQueue::sbRequestThreadQueue() :
   SB_PRLOG_SETUP(sbRequestThreadQueue);
 
   mLock = nsAutoLock::NewLock("sbRequestThreadQueue::mLock");
+  mPopLock = nsAutoLock::NewLock("sbRequestThreadQueue::mPopLock");
+  mDuplicateIndex.Init();
   // Create the request wait monitor.
   mStopWaitMonitor =
     nsAutoMonitor::NewMonitor("sbRequestThreadQueue::mStopWaitMonitor");
@@ -216,7 +219,7 @@ sbRequestThreadQueue::sbRequestThreadQueue() :
 
 sbRequestThreadQueue::~sbRequestThreadQueue()
 {
-  NS_ASSERTION(mRequestQueue.size() == 0,
+  NS_ASSERTION(mRequestQueue.size() == 0 && mPoppedQueue.size() == 0,
                "sbRequestThreadQueue destructor with items in queue");
   if (mStopWaitMonitor) {
     nsAutoMonitor::DestroyMonitor(mStopWaitMonitor);
@@ -224,6 +227,9 @@ sbRequestThreadQueue::~sbRequestThreadQueue()
   if (mLock) {
     nsAutoLock::DestroyLock(mLock);
   }
+  if (mPopLock) {
+    nsAutoLock::DestroyLock(mPopLock);
+  }
 }
 
 nsresult sbRequestThreadQueue::BatchBegin()
@@ -247,6 +253,8 @@ nsresult sbRequestThreadQueue::BatchEnd()
                "sbRequestThreadQueue batch depth out of balance");
   if (mBatchDepth > 0 && --mBatchDepth == 0) {
     ++mCurrentBatchId;
+    // Duplicates are only checked within a batch
+    mDuplicateIndex.Clear();
     ProcessRequest();
   }
   return NS_OK;
@@ -285,8 +293,9 @@ sbRunnableMethod(sbRequestThreadQueue & aObject,
 nsresult sbRequestThreadQueue::Start()
 {
   TRACE_FUNCTION("");
-  // Ensure we've allocated our lock and monitor
+  // Ensure we've allocated our locks and monitor
   NS_ENSURE_TRUE(mLock, NS_ERROR_OUT_OF_MEMORY);
+  NS_ENSURE_TRUE(mPopLock, NS_ERROR_OUT_OF_MEMORY);
   NS_ENSURE_TRUE(mStopWaitMonitor, NS_ERROR_OUT_OF_MEMORY);
 
   nsresult rv;
@@ -353,8 +362,12 @@ nsresult sbRequestThreadQueue::Stop()
 
   // Push the thread stop request onto the queue. This will signal the request
   // thread to shutdown
-  rv = PushRequestInternal(sbRequestItem::New(REQUEST_THREAD_STOP));
-  NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to send thread stop message");
+  {
+    nsAutoLock lock(mLock);
+    rv = PushRequestInternal(sbRequestItem::New(REQUEST_THREAD_STOP),
+                             EmptyCString());
+    NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to send thread stop message");
+  }
 
   // Process the request
   rv = ProcessRequest();
@@ -387,6 +400,7 @@ nsresult sbRequestThreadQueue::ProcessRequest()
 }
 
 nsresult sbRequestThreadQueue::FindDuplicateRequest(sbRequestItem * aItem,
+                                                    const nsACString & aKey,
                                                     bool & aIsDuplicate)
 {
   NS_ENSURE_ARG_POINTER(aItem);
@@ -398,6 +412,36 @@ nsresult sbRequestThreadQueue::FindDuplicateRequest(sbRequestItem * aItem,
   if (aItem->GetType() < sbRequestThreadQueue::USER_REQUEST_TYPES) {
     return NS_OK;
   }
+
+  // Requests without a key have to be checked against the whole batch
+  if (aKey.IsEmpty()) {
+    return ScanForDuplicateRequest(aItem, aIsDuplicate);
+  }
+
+  // Only the most recent request with the same key can be a duplicate. Any
+  // older request with the same key has already been checked against it.
+  sbRequestItem * request;
+  if (!mDuplicateIndex.Get(aKey, &request)) {
+    return NS_OK;
+  }
+  NS_ASSERTION(request->GetBatchId() == (PRUint32)mCurrentBatchId,
+               "sbRequestThreadQueue duplicate index holds a stale request");
+
+  bool continueChecking = false;
+  rv = IsDuplicateRequest(request, aItem, aIsDuplicate, continueChecking);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+nsresult sbRequestThreadQueue::ScanForDuplicateRequest(sbRequestItem * aItem,
+                                                       bool & aIsDuplicate)
+{
+  NS_ENSURE_ARG_POINTER(aItem);
+
+  nsresult rv;
+
+  aIsDuplicate = false;
   const RequestQueue::const_reverse_iterator rend = mRequestQueue.rend();
   for (RequestQueue::const_reverse_iterator riter = mRequestQueue.rbegin();
        riter != rend && !aIsDuplicate;
@@ -428,13 +472,14 @@ nsresult sbRequestThreadQueue::FindDuplicateRequest(sbRequestItem * aItem,
   return NS_OK;
 }
 
-nsresult sbRequestThreadQueue::PushRequestInternal(sbRequestItem * aRequestItem)
+nsresult sbRequestThreadQueue::PushRequestInternal(sbRequestItem * aRequestItem,
+                                                   const nsACString & aKey)
 {
   NS_ENSURE_ARG_POINTER(aRequestItem);
   nsresult rv;
 
   bool isDupe;
-  rv = FindDuplicateRequest(aRequestItem, isDupe);
+  rv = FindDuplicateRequest(aRequestItem, aKey, isDupe);
   NS_ENSURE_SUCCESS(rv, rv);
   if (isDupe) {
     return NS_OK;
@@ -445,6 +490,11 @@ nsresult sbRequestThreadQueue::PushRequestInternal(sbRequestItem * aRequestItem)
   NS_ADDREF(aRequestItem);
   mRequestQueue.push_back(aRequestItem);
 
+  if (!aKey.IsEmpty()) {
+    NS_ENSURE_TRUE(mDuplicateIndex.Put(aKey, aRequestItem),
+                   NS_ERROR_OUT_OF_MEMORY);
+  }
+
   return NS_OK;
 }
 
@@ -457,51 +507,94 @@ nsresult sbRequestThreadQueue::PushRequest(sbRequestItem * aRequestItem)
 
   nsresult rv;
 
+  // Generate the duplicate key before locking, this may need to call into
+  // the request's items
+  nsCString key;
+  if (aRequestItem->GetType() >= sbRequestThreadQueue::USER_REQUEST_TYPES) {
+    rv = GetDuplicateKey(aRequestItem, key);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  PRInt32 batchDepth;
   { /* scope for request lock */
     nsAutoLock lock(mLock);
 
-    nsAutoMonitor monitor(mStopWaitMonitor);
-    // If we're aborting or shutting down don't accept any more requests
-    if (mAbortRequests || mStopProcessing)
     {
-      return NS_ERROR_ABORT;
+      nsAutoMonitor monitor(mStopWaitMonitor);
+      // If we're aborting or shutting down don't accept any more requests
+      if (mAbortRequests || mStopProcessing)
+      {
+        return NS_ERROR_ABORT;
+      }
     }
 
-    rv = PushRequestInternal(aRequestItem);
+    rv = PushRequestInternal(aRequestItem, key);
     NS_ENSURE_SUCCESS(rv, rv);
+
+    batchDepth = mBatchDepth;
   }
 
-  NS_ASSERTION(mBatchDepth >= 0,
+  NS_ASSERTION(batchDepth >= 0,
                "Batch depth out of whack in sbBaseDevice::PushRequest");
   // Only process requests if we're not in a batch
-  if (mBatchDepth == 0) {
+  if (batchDepth == 0) {
     rv = ProcessRequest();
     NS_ENSURE_SUCCESS(rv, rv);
   }
   return NS_OK;
 }
 
+void sbRequestThreadQueue::MoveRequestsToPoppedQueueNoLock()
+{
+  if (mRequestQueue.empty()) {
+    return;
+  }
+  // The common case is the request thread has drained the popped queue so
+  // just swap the two queues
+  if (mPoppedQueue.empty()) {
+    mPoppedQueue.swap(mRequestQueue);
+  }
+  else {
+    mPoppedQueue.insert(mPoppedQueue.end(),
+                        mRequestQueue.begin(),
+                        mRequestQueue.end());
+    mRequestQueue.clear();
+  }
+  // The index only refers to requests on mRequestQueue
+  mDuplicateIndex.Clear();
+}
+
 nsresult sbRequestThreadQueue::PopBatch(Batch & aBatch)
 {
   TRACE_FUNCTION("");
   NS_ENSURE_STATE(mLock);
+  NS_ENSURE_STATE(mPopLock);
 
-  nsAutoLock lock(mLock);
+  nsAutoLock popLock(mPopLock);
 
   aBatch.clear();
 
+  // Pick up any requests that have been pushed since the last pop. Only hold
+  // mLock long enough to move them over so we don't block request producers.
+  {
+    nsAutoLock lock(mLock);
+
+    // If we're in the middle of a batch just return an empty batch
+    if (mBatchDepth > 0) {
+      LOG("Waiting on batch to complete\n");
+      return NS_OK;
+    }
+
+    MoveRequestsToPoppedQueueNoLock();
+  }
+
   // If nothing was found then just return with an empty batch
-  if (mRequestQueue.empty()) {
+  if (mPoppedQueue.empty()) {
     LOG("No requests found\n");
     return NS_OK;
   }
 
-  // If we're in the middle of a batch just return an empty batch
-  if (mBatchDepth > 0) {
-    LOG("Waiting on batch to complete\n");
-    return NS_OK;
-  }
-  RequestQueue::iterator queueIter = mRequestQueue.begin();
+  RequestQueue::iterator queueIter = mPoppedQueue.begin();
   // request queue holds on to the object
   sbRequestItem * request = *queueIter;
 
@@ -509,7 +602,7 @@ nsresult sbRequestThreadQueue::PopBatch(Batch & aBatch)
   if (!request->GetIsCountable()) {
     LOG("Single non-batch request found\n");
     aBatch.push_back(request);
-    mRequestQueue.erase(queueIter);
+    mPoppedQueue.erase(queueIter);
     // Release our reference to the request, aBatch is holding a reference to it
     NS_RELEASE(request);
     return NS_OK;
@@ -518,7 +611,7 @@ nsresult sbRequestThreadQueue::PopBatch(Batch & aBatch)
   const PRUint32 requestBatchId = request->GetBatchId();
 
   // find the end of the batch and keep track of the matching batch entries
-  const RequestQueue::const_iterator queueEnd = mRequestQueue.end();
+  const RequestQueue::const_iterator queueEnd = mPoppedQueue.end();
   while (queueIter != queueEnd &&
          requestBatchId == (*queueIter)->GetBatchId()) {
     request = *queueIter++;
@@ -528,7 +621,7 @@ nsresult sbRequestThreadQueue::PopBatch(Batch & aBatch)
   }
 
   // Remove all the items we pushed onto the batch
-  mRequestQueue.erase(mRequestQueue.begin(), queueIter);
+  mPoppedQueue.erase(mPoppedQueue.begin(), queueIter);
 
   return NS_OK;
 }
@@ -537,15 +630,19 @@ nsresult sbRequestThreadQueue::ClearRequestsNoLock(Batch & aBatch)
 {
   NS_ENSURE_STATE(mLock);
 
+  // Gather the incoming requests behind the ones already popped so the
+  // requests are cleaned up in the order they were pushed
+  MoveRequestsToPoppedQueueNoLock();
+
   // Copy all the requests on the queue to aBatch
   std::insert_iterator<Batch> insertIter(aBatch, aBatch.end());
-  std::copy(mRequestQueue.begin(), mRequestQueue.end(), insertIter);
+  std::copy(mPoppedQueue.begin(), mPoppedQueue.end(), insertIter);
 
   // Release all of our objects
-  std::for_each(mRequestQueue.begin(), mRequestQueue.end(), ReleaseRequestItem);
+  std::for_each(mPoppedQueue.begin(), mPoppedQueue.end(), ReleaseRequestItem);
 
   // Now that we have copied the requests clear our request queue
-  mRequestQueue.clear();
+  mPoppedQueue.clear();
 
   return NS_OK;
 }
@@ -557,10 +654,12 @@ nsresult sbRequestThreadQueue::ClearRequests()
   nsresult rv;
 
   NS_ENSURE_STATE(mLock);
+  NS_ENSURE_STATE(mPopLock);
 
   Batch batch;
   // Lock the queue while copy and clear it
   {
+    nsAutoLock popLock(mPopLock);
     nsAutoLock lock(mLock);
 
     rv = ClearRequestsNoLock(batch);
@@ -586,7 +685,9 @@ nsresult sbRequestThreadQueue::CancelRequests()
 
   Batch batch;
   {
-    // Have to lock mLock before mStopWaitMonitor to avoid deadlocks
+    // Have to lock mPopLock before mLock and mLock before mStopWaitMonitor to
+    // avoid deadlocks
+    nsAutoLock popLock(mPopLock);
     nsAutoLock lock(mLock);
     nsAutoMonitor monitor(mStopWaitMonitor);
     // If we're aborting set the flag, reset batch depth and clear requests
@@ -669,6 +770,24 @@ private:
   sbRequestThreadQueue * mRTQ;
   bool mAlreadyHandlingRequests;
 };
+
+/**
+ * Calls OnQueueDrained when request processing stops, whichever way it stops.
+ */
+class sbAutoQueueDrained
+{
+public:
+  sbAutoQueueDrained(sbRequestThreadQueue * aRTQ) : mRTQ(aRTQ) {}
+  ~sbAutoQueueDrained()
+  {
+    nsresult rv = mRTQ->OnQueueDrained();
+    NS_ENSURE_SUCCESS(rv, /* void */);
+  }
+private:
+  // Non-owning reference, object is assured to outlive this
+  sbRequestThreadQueue * mRTQ;
+};
+
 /**
  * Run the event.
  */
@@ -691,6 +810,10 @@ sbRTQAddedEvent::Run()
     return NS_OK;
   }
 
+  // Let the queue finish up once processing stops, including on error and
+  // abort.
+  sbAutoQueueDrained autoQueueDrained(mRTQ);
+
   // Start processing of the next request batch and set to automatically
   // complete the current request on exit.
   sbRequestThreadQueue::Batch batch;
@@ -749,6 +872,7 @@ sbRTQAddedEvent::Run()
     rv = mRTQ->PopBatch(batch);
     NS_ENSURE_SUCCESS(rv, rv);
   }
+
   return NS_OK;
 }
 
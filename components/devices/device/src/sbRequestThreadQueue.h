@@ -36,6 +36,8 @@
 #include <nsAutoLock.h>
 #include <nsAutoPtr.h>
 #include <nsCOMPtr.h>
+#include <nsDataHashtable.h>
+#include <nsStringGlue.h>
 
 #include <prlock.h>
 
@@ -61,6 +63,17 @@
  * the Batch object passed in. The sbRequestItem object holds a reference and
  * releases it when the Batch is destroyed or the item is erased via erase or
  * clear methods. Batch's destructor calls clear.
+ *
+ * The queue is a two lock queue. Producers take mLock to push requests onto
+ * the incoming queue and the request thread takes mPopLock to pull batches off
+ * of the popped queue. The request thread only takes mLock long enough to move
+ * the incoming requests over to the popped queue, so pushing from the main
+ * thread does not have to wait on the request thread building batches.
+ *
+ * Duplicate detection is limited to the current batch and is done through a
+ * hashed index of duplicate keys. Derived classes supply the key via
+ * GetDuplicateKey. Requests without a key fall back to walking the current
+ * batch backwards.
  */
 class sbRequestThreadQueue
 {
@@ -342,8 +355,10 @@ protected:
    *                             the main thread.
    *                        RT - Thread that process requests
    * mRequestQueue - MT/CT Modified
+   * mDuplicateIndex - MT Modified, RT Cleared
    * mBatchDepth - MT Write, RT Read
    * mLock - Any thread, protects  the state of the object
+   * mPopLock - RT and threads clearing requests, protects mPoppedQueue
    * mStopProcessing - ST Written, MT/RT Read
    * mAbortRequests - Can be modified by any thread, read from RT and MT
    * mIsHandlingRequests - RT Written,  Read from any thread canceling requests
@@ -368,6 +383,13 @@ protected:
    */
   PRLock * mLock;
 
+  /**
+   * This protects the popped request queue. It is held by the request thread
+   * while building batches and by threads clearing the requests. If both locks
+   * are needed mPopLock must be acquired before mLock.
+   */
+  PRLock * mPopLock;
+
   /**
    * Tracks batch depth for begin and end calls
    */
@@ -393,7 +415,7 @@ protected:
   /**
    * Performs simple cleanup of the requests queue without locking and returns
    * the cleared requests as an array. It is the caller's responsibility to
-   * lock mLock
+   * lock mPopLock and then mLock
    * \param aRequests the requests that were cleared
    */
   nsresult ClearRequestsNoLock(Batch & aRequests);
@@ -431,10 +453,26 @@ private:
   /**
    * This is the request queue that holds the requests to be processed by the
    * request thread. These are raw pointers but the reference is managed by
-   * sbRequestThreadQueue.
+   * sbRequestThreadQueue. Protected by mLock.
    */
   RequestQueue mRequestQueue;
 
+  /**
+   * Holds the requests that have been moved off of mRequestQueue by the
+   * request thread but not yet returned in a batch. References are managed
+   * the same as mRequestQueue. Protected by mPopLock.
+   */
+  RequestQueue mPoppedQueue;
+
+  /**
+   * Maps duplicate keys to the most recent request with that key in the
+   * current batch. These are non-owning pointers into mRequestQueue. This is
+   * cleared whenever the batch changes or requests leave mRequestQueue.
+   * Protected by mLock.
+   */
+  typedef nsDataHashtable<nsCStringHashKey, sbRequestItem *> DuplicateIndex;
+  DuplicateIndex mDuplicateIndex;
+
   /**
    * The thread for processing requests
    */
@@ -460,9 +498,25 @@ private:
   /**
    * Determines if the request is a duplicate of an existing item in the queue
    * \param aItem the item being checked for duplicates
+   * \param aKey the duplicate key of aItem, empty if it has none
    * \param aIsDuplicate Holds the duplicate indication on return
    */
-  nsresult FindDuplicateRequest(sbRequestItem * aItem, bool &aIsDuplicate);
+  nsresult FindDuplicateRequest(sbRequestItem * aItem,
+                                const nsACString & aKey,
+                                bool &aIsDuplicate);
+
+  /**
+   * Walks the current batch backwards looking for a duplicate of aItem. This
+   * is used for requests that don't provide a duplicate key.
+   */
+  nsresult ScanForDuplicateRequest(sbRequestItem * aItem,
+                                   bool &aIsDuplicate);
+
+  /**
+   * Moves the incoming requests onto the popped queue. Caller must hold
+   * mPopLock and mLock.
+   */
+  void MoveRequestsToPoppedQueueNoLock();
 
   /**
    * Processes any pending requests
@@ -492,7 +546,8 @@ private:
     return isHandlingRequests;
   }
 
-  nsresult PushRequestInternal(sbRequestItem * aRequestItem);
+  nsresult PushRequestInternal(sbRequestItem * aRequestItem,
+                               const nsACString & aKey);
 
   // Private interface derive classes must implement
   /**
@@ -505,6 +560,14 @@ private:
    */
   virtual nsresult OnThreadStop() { return NS_OK; }
 
+  /**
+   * Called on the request thread when request processing stops, either
+   * because all queued requests have been processed or because processing was
+   * aborted or failed, e.g. to write out state that was kept dirty across
+   * batches.
+   */
+  virtual nsresult OnQueueDrained() { return NS_OK; }
+
   /**
    * Determines if the request is a duplicate of an existing item in the queue
    * \param aItem1 the item being checked for duplicates
@@ -521,6 +584,23 @@ private:
     return NS_OK;
   }
 
+  /**
+   * Returns the key used to look up duplicates of aItem in the current batch.
+   * Two requests that IsDuplicateRequest could consider duplicates must have
+   * the same key. Only the most recent request with the same key is passed to
+   * IsDuplicateRequest. Leaving aKey empty causes the current batch to be
+   * walked instead, which is the default behavior. This is called without
+   * holding the queue lock.
+   * \param aItem the item to generate the key for
+   * \param aKey the duplicate key on return
+   */
+  virtual nsresult GetDuplicateKey(sbRequestItem * aItem,
+                                   nsACString & aKey)
+  {
+    aKey.Truncate();
+    return NS_OK;
+  }
+
   /**
    * Called to process a batch of requests. The implementation shoudl set the
    * processed flag as cleanupBatch will be called after this.
@@ -553,6 +633,11 @@ private:
    * utility class.
    */
   friend class sbAutoRequestHandling;
+
+  /**
+   * Needs access to OnQueueDrained. This is an internal utility class.
+   */
+  friend class sbAutoQueueDrained;
 };
 
 
@@ -0,0 +1,136 @@
+/* vim: set sw=2 :miv */
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2011 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+/**
+ * \brief Device request thread queue benchmark. Pushes a large number of
+ *        requests at the mock device, reports the push rate and checks that
+ *        duplicates were merged.
+ */
+
+Components.utils.import("resource://app/jsmodules/sbProperties.jsm");
+
+const REQUEST_COUNT = 100000;
+const ITEM_COUNT = 1000;
+
+function createPropertyBag(aParams) {
+  var bag = Cc["@mozilla.org/hash-property-bag;1"]
+              .createInstance(Ci.nsIWritablePropertyBag);
+  for (var name in aParams) {
+    bag.setProperty(name, aParams[name]);
+  }
+  return bag;
+}
+
+function runTest () {
+  var library = createLibrary("test_device_request_queue", null, false);
+  library.clear();
+
+  var urls = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+               .createInstance(Ci.nsIMutableArray);
+  for (var i = 0; i < ITEM_COUNT; ++i) {
+    urls.appendElement(newURI("file:///request_queue/" + i + ".mp3"), false);
+  }
+  var items = library.batchCreateMediaItems(urls, null, true);
+  assertEqual(items.length, ITEM_COUNT);
+
+  var device = Cc["@songbirdnest.com/Songbird/Device/DeviceTester/MockDevice;1"]
+                 .createInstance(Ci.sbIMockDevice);
+  device.connect();
+
+  // Every item is updated REQUEST_COUNT / ITEM_COUNT times, each time with the
+  // round number as its name. They are pushed as one batch so none are
+  // processed before the duplicates are merged; each item should reach the
+  // device once, with the name from the last round.
+  const ROUND_COUNT = REQUEST_COUNT / ITEM_COUNT;
+  device.batchBegin();
+  var start = Date.now();
+  for (var i = 0; i < REQUEST_COUNT; ++i) {
+    var item = items.queryElementAt(i % ITEM_COUNT, Ci.sbIMediaItem);
+    var properties =
+      Cc["@songbirdnest.com/Songbird/Properties/MutablePropertyArray;1"]
+        .createInstance(Ci.sbIMutablePropertyArray);
+    properties.appendProperty(SBProperties.trackName,
+                              "round " + Math.floor(i / ITEM_COUNT));
+    device.submitRequest(Ci.sbIDevice.REQUEST_UPDATE,
+                         createPropertyBag({ item: item,
+                                             list: library,
+                                             data: properties }));
+  }
+  var elapsed = Date.now() - start;
+  device.batchEnd();
+
+  log("DEVICEPERF: pushed " + REQUEST_COUNT + " requests in " + elapsed +
+      "ms (" + Math.round(REQUEST_COUNT * 1000 / Math.max(elapsed, 1)) +
+      " requests/s)");
+
+  // Drain what made it onto the queue
+  var popped = 0;
+  var seen = {};
+  var lastName = "round " + (ROUND_COUNT - 1);
+  var retryCount = 0;
+  function drain() {
+    try {
+      while (true) {
+        let request = device.popRequest();
+        if (request.getProperty("requestType") != Ci.sbIDevice.REQUEST_UPDATE) {
+          continue;
+        }
+        ++popped;
+
+        let item = request.getPropertyAsInterface("item", Ci.sbIMediaItem);
+        assertFalse(item.guid in seen, "update for an item was not merged");
+        seen[item.guid] = true;
+
+        let data = request.getPropertyAsInterface("data", Ci.sbIPropertyArray);
+        assertEqual(data.getPropertyValue(SBProperties.trackName), lastName,
+                    "the latest update did not win");
+      }
+    }
+    catch (e if e.result == Cr.NS_ERROR_NOT_AVAILABLE) {
+      // exception expected when the popped batches are exhausted
+    }
+    if (popped < ITEM_COUNT && ++retryCount < 60) {
+      doTimeout(100, drain);
+      return;
+    }
+    log("DEVICEPERF: " + popped + " requests reached the device");
+    assertEqual(popped, ITEM_COUNT, "duplicate requests were not merged");
+
+    // Wait for the device thread to shut down before finishing
+    device.QueryInterface(Ci.sbIDeviceEventTarget);
+    var handler = function handler(event) {
+      if (event.type == Ci.sbIDeviceEvent.EVENT_DEVICE_REMOVED) {
+        device.removeEventListener(handler);
+        items = null;
+        library = null;
+        testFinished();
+      }
+    }
+    device.addEventListener(handler);
+    device.disconnect();
+  }
+  doTimeout(100, drain);
+  testPending();
+}
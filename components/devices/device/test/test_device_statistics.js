@@ -0,0 +1,101 @@
+/* vim: set sw=2 :miv */
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2011 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+/**
+ * \brief Device statistics tests. Checks that items added and removed while
+ *        the statistics of a library are summed up are counted once, and
+ *        that the statistics are kept up to date item by item afterwards.
+ */
+
+Components.utils.import("resource://app/jsmodules/sbProperties.jsm");
+
+function createItem(aLibrary, aName) {
+  return aLibrary.createMediaItem(newURI("file:///device_statistics/" +
+                                         aName + ".mp3"));
+}
+
+function waitForStatistics(aDevice) {
+  while (aDevice.statisticsQueryPending) {
+    sleep(10, true);
+  }
+}
+
+function runTest () {
+  var device = Cc["@songbirdnest.com/Songbird/Device/DeviceTester/MockDevice;1"]
+                 .createInstance(Ci.sbIMockDevice);
+  device.connect();
+
+  var library = device.defaultLibrary;
+  library.clear();
+
+  var items = [];
+  for (var i = 0; i < 5; i++) {
+    items.push(createItem(library, i));
+    items[i].setProperty(SBProperties.contentLength, "1000");
+  }
+
+  // The sums of the whole library count every audio item, including the
+  // sizes that were only set in the library's cache so far
+  device.addStatisticsLibrary();
+  waitForStatistics(device);
+  assertEqual(device.statisticsAudioCount, 5);
+  assertEqual(device.statisticsAudioUsed, 5000);
+
+  // Items added and removed while the sums are taken are counted once. Like
+  // the device library listeners, add after the item is in the library and
+  // remove before it is gone.
+  device.addStatisticsLibrary();
+  var added = createItem(library, "added");
+  device.addStatisticsItem(added);
+  device.removeStatisticsItem(items[0]);
+  library.remove(items[0]);
+  waitForStatistics(device);
+  assertEqual(device.statisticsAudioCount, 5);
+
+  // Once the sums are taken, items are counted one at a time again
+  var another = createItem(library, "another");
+  device.addStatisticsItem(another);
+  assertFalse(device.statisticsQueryPending);
+  assertEqual(device.statisticsAudioCount, 6);
+  device.removeStatisticsItem(another);
+  library.remove(another);
+  assertEqual(device.statisticsAudioCount, 5);
+
+  library.clear();
+
+  // Wait for the device thread to shut down before finishing
+  device.QueryInterface(Ci.sbIDeviceEventTarget);
+  var handler = function handler(event) {
+    if (event.type == Ci.sbIDeviceEvent.EVENT_DEVICE_REMOVED) {
+      device.removeEventListener(handler);
+      items = null;
+      library = null;
+      testFinished();
+    }
+  }
+  device.addEventListener(handler);
+  device.disconnect();
+  testPending();
+}
@@ -67,6 +67,145 @@ function sbIDeviceDeviceTesterUtils_GetOrganizedPath(aUtils, aLibrary) {
   assertTrue(result.parent.parent.parent.equals(oldFile));
 }
 
+function writeTestFile(aFile, aData, aAppend) {
+  var stream = Cc["@mozilla.org/network/file-output-stream;1"]
+                 .createInstance(Ci.nsIFileOutputStream);
+  // PR_WRONLY | PR_CREATE_FILE, and PR_APPEND or PR_TRUNCATE
+  stream.init(aFile, 0x02 | 0x08 | (aAppend ? 0x10 : 0x20), 0644, 0);
+  stream.write(aData, aData.length);
+  stream.close();
+}
+
+function createMediaFormat() {
+  // Names and values use the characters the cache entry has to escape
+  var containerProperties = Cc["@mozilla.org/hash-property-bag;1"]
+                              .createInstance(Ci.nsIWritablePropertyBag2);
+  containerProperties.setPropertyAsAString("name=with;escapes",
+                                           "value%3D\nwith=;%\nescapes");
+  containerProperties.setPropertyAsBool("flag", true);
+  var container = Cc["@songbirdnest.com/Songbird/Mediacore/mediaformatcontainer;1"]
+                    .createInstance(Ci.sbIMediaFormatContainerMutable);
+  container.setContainerType("video/x-matroska");
+  container.setProperties(containerProperties);
+
+  var video = Cc["@songbirdnest.com/Songbird/Mediacore/mediaformatvideo;1"]
+                .createInstance(Ci.sbIMediaFormatVideoMutable);
+  video.setVideoType("video/x-h264");
+  video.setVideoWidth(1280);
+  video.setVideoHeight(720);
+  video.setVideoPAR(4, 3);
+  video.setVideoFrameRate(30000, 1001);
+  video.setBitRate(2500000);
+
+  var audioProperties = Cc["@mozilla.org/hash-property-bag;1"]
+                          .createInstance(Ci.nsIWritablePropertyBag2);
+  audioProperties.setPropertyAsInt32("layer", 3);
+  audioProperties.setPropertyAsInt64("samples", 0x1FFFFFFFF);
+  audioProperties.setPropertyAsACString("codec", "MPEG-1 Layer 3");
+  var audio = Cc["@songbirdnest.com/Songbird/Mediacore/mediaformataudio;1"]
+                .createInstance(Ci.sbIMediaFormatAudioMutable);
+  audio.setAudioType("audio/mpeg");
+  audio.setBitRate(192000);
+  audio.setSampleRate(44100);
+  audio.setChannels(2);
+  audio.setProperties(audioProperties);
+
+  var format = Cc["@songbirdnest.com/Songbird/Mediacore/mediaformat;1"]
+                 .createInstance(Ci.sbIMediaFormatMutable);
+  format.setContainer(container);
+  format.setVideoStream(video);
+  format.setAudioStream(audio);
+  return format;
+}
+
+function assertCacheMiss(aUtils, aItem, aMessage) {
+  try {
+    aUtils.GetCachedMediaFormat(aItem);
+    fail(aMessage);
+  }
+  catch (e if e.result == Cr.NS_ERROR_NOT_AVAILABLE) {
+  }
+}
+
+function sbIDeviceDeviceTesterUtils_CachedMediaFormat(aUtils, aLibrary) {
+  var file = Cc["@mozilla.org/file/directory_service;1"]
+               .getService(Ci.nsIProperties)
+               .get("TmpD", Ci.nsIFile);
+  file.append("test_device_utils_cache.mp3");
+  file.createUnique(Ci.nsIFile.NORMAL_FILE_TYPE, 0644);
+  writeTestFile(file, "not really an mp3", false);
+
+  var item = aLibrary.createMediaItem(newFileURI(file));
+  assertCacheMiss(aUtils, item, "cache entry found before caching");
+
+  // Round trip
+  var format = createMediaFormat();
+  aUtils.SetCachedMediaFormat(item, format);
+  var cached = aUtils.GetCachedMediaFormat(item);
+
+  assertEqual(cached.container.containerType, "video/x-matroska");
+  var properties = cached.container.properties
+                         .QueryInterface(Ci.nsIPropertyBag2);
+  assertEqual(properties.getPropertyAsAString("name=with;escapes"),
+              "value%3D\nwith=;%\nescapes");
+  assertEqual(properties.getPropertyAsBool("flag"), true);
+
+  var video = cached.videoStream;
+  assertEqual(video.videoType, "video/x-h264");
+  assertEqual(video.videoWidth, 1280);
+  assertEqual(video.videoHeight, 720);
+  var numerator = {}, denominator = {};
+  video.getVideoPAR(numerator, denominator);
+  assertEqual(numerator.value, 4);
+  assertEqual(denominator.value, 3);
+  video.getVideoFrameRate(numerator, denominator);
+  assertEqual(numerator.value, 30000);
+  assertEqual(denominator.value, 1001);
+  assertEqual(video.bitRate, 2500000);
+  assertEqual(video.properties, null);
+
+  var audio = cached.audioStream;
+  assertEqual(audio.audioType, "audio/mpeg");
+  assertEqual(audio.bitRate, 192000);
+  assertEqual(audio.sampleRate, 44100);
+  assertEqual(audio.channels, 2);
+  properties = audio.properties.QueryInterface(Ci.nsIPropertyBag2);
+  assertEqual(properties.getPropertyAsInt32("layer"), 3);
+  assertEqual(properties.getPropertyAsInt64("samples"), 0x1FFFFFFFF);
+  assertEqual(properties.getPropertyAsACString("codec"), "MPEG-1 Layer 3");
+
+  // Changing the file's modification time invalidates the entry
+  file.lastModifiedTime = file.lastModifiedTime - 60000;
+  assertCacheMiss(aUtils, item, "cache entry used after the file was touched");
+
+  // So does changing its size, once re-cached
+  aUtils.SetCachedMediaFormat(item, format);
+  aUtils.GetCachedMediaFormat(item);
+  var lastModified = file.lastModifiedTime;
+  writeTestFile(file, " with more data", true);
+  file.lastModifiedTime = lastModified;
+  assertCacheMiss(aUtils, item, "cache entry used after the file changed");
+
+  // And moving the item to another file
+  aUtils.SetCachedMediaFormat(item, format);
+  aUtils.GetCachedMediaFormat(item);
+  var otherFile = file.parent;
+  otherFile.append("test_device_utils_cache_other.mp3");
+  otherFile.createUnique(Ci.nsIFile.NORMAL_FILE_TYPE, 0644);
+  writeTestFile(otherFile, "not really an mp3", false);
+  item.contentSrc = newFileURI(otherFile);
+  assertCacheMiss(aUtils, item, "cache entry used for another file");
+
+  // Items that aren't local files are never cached
+  var remoteItem =
+    aLibrary.createMediaItem(newURI("http://0/not/a/local/file.mp3"));
+  aUtils.SetCachedMediaFormat(remoteItem, format);
+  assertCacheMiss(aUtils, remoteItem, "cache entry found for a remote item");
+
+  file.remove(false);
+  otherFile.remove(false);
+}
+
 function runTest () {
   var utils = Components.classes["@songbirdnest.com/Songbird/Device/DeviceTester/Utils;1"]
                         .createInstance(Components.interfaces.sbIDeviceDeviceTesterUtils);
@@ -86,4 +225,5 @@ function runTest () {
   library.clear();
   
   sbIDeviceDeviceTesterUtils_GetOrganizedPath(utils, library);
+  sbIDeviceDeviceTesterUtils_CachedMediaFormat(utils, library);
 }
@@ -77,6 +77,7 @@
 #include <sbIJobProgress.h>
 #include <sbIPropertyManager.h>
 #include <sbStandardProperties.h>
+#include <sbStringUtils.h>
 
 
 /* *****************************************************************************
@@ -89,13 +90,22 @@
  * SB_DOWNLOAD_DEVICE_CATEGORY  Download device category name.
  * SB_DOWNLOAD_DEVICE_ID        Download device identifier.
  * SB_DOWNLOAD_DIR_DR           Default download directory data remote.
- * SB_TMP_DIR                   Songbird temporary directory name.
- * SB_DOWNLOAD_TMP_DIR          Download device temporary directory name.
  * SB_DOWNLOAD_LIST_NAME        Download device media list name.
  * SB_STRING_BUNDLE_CHROME_URL  URL for Songbird string bundle.
  * SB_DOWNLOAD_COL_SPEC         Default download device playlist column spec.
  * SB_PREF_DOWNLOAD_LIBRARY     Download library preference name.
  * SB_PREF_WEB_LIBRARY          Web library GUID preference name.
+ * SB_PREF_DOWNLOAD_MAX_SESSIONS
+ *                              Maximum concurrent sessions preference name.
+ * SB_PREF_DOWNLOAD_MAX_SESSIONS_PER_HOST
+ *                              Maximum concurrent sessions per host
+ *                              preference name.
+ * SB_DOWNLOAD_DEFAULT_MAX_SESSIONS
+ *                              Default maximum concurrent sessions.
+ * SB_DOWNLOAD_DEFAULT_MAX_SESSIONS_PER_HOST
+ *                              Default maximum concurrent sessions per host.
+ * SB_DOWNLOAD_PARTIAL_EXTENSION
+ *                              Extension of partial download files.
  * SB_DOWNLOAD_PROGRESS_UPDATE_PERIOD_MS
  *                              Update period for download progress.
  * SB_DOWNLOAD_IDLE_TIMEOUT_MS  How long to wait after progress before 
@@ -109,8 +119,6 @@
                             NS_LITERAL_STRING("Songbird Download Device").get()
 #define SB_DOWNLOAD_DEVICE_ID   "download"
 #define SB_DOWNLOAD_DIR_DR "download.folder"
-#define SB_TMP_DIR "Songbird"
-#define SB_DOWNLOAD_TMP_DIR "DownloadDevice"
 #define SB_DOWNLOAD_LIST_NAME                                                  \
                 "&chrome://songbird/locale/songbird.properties#device.download"
 #define SB_STRING_BUNDLE_CHROME_URL                                            \
@@ -120,6 +128,12 @@
 
 #define SB_PREF_DOWNLOAD_MEDIALIST "songbird.library.download"
 #define SB_PREF_WEB_LIBRARY     "songbird.library.web"
+#define SB_PREF_DOWNLOAD_MAX_SESSIONS "songbird.download.maxSessions"
+#define SB_PREF_DOWNLOAD_MAX_SESSIONS_PER_HOST                                 \
+                                        "songbird.download.maxSessionsPerHost"
+#define SB_DOWNLOAD_DEFAULT_MAX_SESSIONS 3
+#define SB_DOWNLOAD_DEFAULT_MAX_SESSIONS_PER_HOST 2
+#define SB_DOWNLOAD_PARTIAL_EXTENSION ".part"
 #define SB_DOWNLOAD_CUSTOM_TYPE "download"
 #define SB_DOWNLOAD_PROGRESS_UPDATE_PERIOD_MS   1000
 #define SB_DOWNLOAD_IDLE_TIMEOUT_MS (60*1000)
@@ -513,7 +527,10 @@ NS_IMPL_ISUPPORTS4(sbDownloadDevice,
 sbDownloadDevice::sbDownloadDevice()
 :
     sbDeviceBase(),
-    mpDeviceMonitor(nsnull)
+    mpDeviceMonitor(nsnull),
+    mMaxSessions(SB_DOWNLOAD_DEFAULT_MAX_SESSIONS),
+    mMaxSessionsPerHost(SB_DOWNLOAD_DEFAULT_MAX_SESSIONS_PER_HOST),
+    mTransfersSuspended(PR_FALSE)
 {
 }
 
@@ -550,11 +567,11 @@ NS_IMETHODIMP sbDownloadDevice::Observe(
     NS_ENSURE_ARG_POINTER(aTopic);
 
     if (!strcmp("quit-application-granted", aTopic)) {
-        /* Shutdown the session. */
-        if (mpDownloadSession)
+        /* Shutdown the sessions.  Partial downloads are */
+        /* resumed on the next start.                     */
         {
-            mpDownloadSession->Shutdown();
-            mpDownloadSession = nsnull;
+            nsAutoMonitor mon(mpDeviceMonitor);
+            ShutdownSessions();
         }
 
         // remember to remove the observer too
@@ -613,6 +630,20 @@ NS_IMETHODIMP sbDownloadDevice::Initialize()
     mpPrefBranch = do_GetService(NS_PREFSERVICE_CONTRACTID, &rv);
     NS_ENSURE_SUCCESS(rv, rv);
 
+    /* Read the session limits.  Keep the defaults if not set. */
+    {
+        PRInt32                     prefValue;
+
+        rv = mpPrefBranch->GetIntPref(SB_PREF_DOWNLOAD_MAX_SESSIONS,
+                                      &prefValue);
+        if (NS_SUCCEEDED(rv) && (prefValue > 0))
+            mMaxSessions = prefValue;
+        rv = mpPrefBranch->GetIntPref(SB_PREF_DOWNLOAD_MAX_SESSIONS_PER_HOST,
+                                      &prefValue);
+        if (NS_SUCCEEDED(rv) && (prefValue > 0))
+            mMaxSessionsPerHost = prefValue;
+    }
+
     /* Get the library manager. */
     pLibraryManager =
             do_GetService("@songbirdnest.com/Songbird/library/Manager;1", &rv);
@@ -678,53 +709,6 @@ NS_IMETHODIMP sbDownloadDevice::Initialize()
     rv = CreateTransferQueue(mDeviceIdentifier);
     NS_ENSURE_SUCCESS(rv, rv);
 
-    /* Create temporary download directory. */
-    {
-        nsCOMPtr<nsIProperties>     pProperties;
-        PRUint32                    permissions;
-        PRBool                      exists;
-
-        /* Get the system temporary directory. */
-        pProperties = do_GetService("@mozilla.org/file/directory_service;1",
-                                    &rv);
-        NS_ENSURE_SUCCESS(rv, rv);
-        rv = pProperties->Get("TmpD",
-                              NS_GET_IID(nsIFile),
-                              getter_AddRefs(mpTmpDownloadDir));
-        NS_ENSURE_SUCCESS(rv, rv);
-        rv = mpTmpDownloadDir->GetPermissions(&permissions);
-        NS_ENSURE_SUCCESS(rv, rv);
-
-        /* Get the Songbird temporary directory and make sure it exists. */
-        rv = mpTmpDownloadDir->Append(NS_LITERAL_STRING(SB_TMP_DIR));
-        NS_ENSURE_SUCCESS(rv, rv);
-        rv = mpTmpDownloadDir->Exists(&exists);
-        NS_ENSURE_SUCCESS(rv, rv);
-        if (!exists)
-        {
-            rv = mpTmpDownloadDir->Create(nsIFile::DIRECTORY_TYPE, permissions);
-            NS_ENSURE_SUCCESS(rv, rv);
-        }
-
-        /* Get the download temporary directory and make sure it's empty.  If */
-        /* directory cannot be deleted, don't propagate error (bug #6453).    */
-        rv = mpTmpDownloadDir->Append(NS_LITERAL_STRING(SB_DOWNLOAD_TMP_DIR));
-        NS_ENSURE_SUCCESS(rv, rv);
-        rv = mpTmpDownloadDir->Exists(&exists);
-        NS_ENSURE_SUCCESS(rv, rv);
-        if (exists)
-        {
-            rv = mpTmpDownloadDir->Remove(PR_TRUE);
-            if (NS_SUCCEEDED(rv))
-                exists = PR_FALSE;
-        }
-        if (!exists)
-        {
-            rv = mpTmpDownloadDir->Create(nsIFile::DIRECTORY_TYPE, permissions);
-            NS_ENSURE_SUCCESS(rv, rv);
-        }
-    }
-
     /* Watch for the app quitting so we can gracefully abort. */
     {
         nsCOMPtr<nsIObserverService> obsSvc =
@@ -734,23 +718,6 @@ NS_IMETHODIMP sbDownloadDevice::Initialize()
         NS_ENSURE_SUCCESS(rv, rv);
     }
 
-    // Need thread pool to process file moves off the main thread.
-    nsCOMPtr<nsIThreadPool> threadPool = 
-      do_CreateInstance("@mozilla.org/thread-pool;1", &rv);
-    NS_ENSURE_SUCCESS(rv, rv);
-
-    rv = threadPool->SetIdleThreadLimit(0);
-    NS_ENSURE_SUCCESS(rv, rv);
-
-    rv = threadPool->SetIdleThreadTimeout(60000);
-    NS_ENSURE_SUCCESS(rv, rv);
-
-    rv = threadPool->SetThreadLimit(1);
-    NS_ENSURE_SUCCESS(rv, rv);
-
-    // Thread pool is setup.
-    threadPool.forget(getter_AddRefs(mFileMoveThreadPool));
-
     /* Resume incomplete transfers. */
     ResumeTransfers();
 
@@ -774,11 +741,7 @@ NS_IMETHODIMP sbDownloadDevice::Finalize()
         nsAutoMonitor mon(mpDeviceMonitor);
 
         /* Dispose of any outstanding download sessions. */
-        if (mpDownloadSession)
-        {
-            mpDownloadSession->Shutdown();
-            mpDownloadSession = nsnull;
-        }
+        ShutdownSessions();
 
         /* Remove the device transfer queue. */
         RemoveTransferQueue(mDeviceIdentifier);
@@ -1000,10 +963,12 @@ NS_IMETHODIMP sbDownloadDevice::DeleteItems(
     PRUint32                    *aItemCount)
 {
     nsCOMPtr<sbIMediaItem>      pMediaItem;
+    nsTArray<nsRefPtr<sbDownloadSession> >
+                                cancelSessions;
     PRUint32                    arrayLength;
     PRUint32                    i;
+    PRUint32                    j;
     PRBool                      equals;
-    PRBool                      cancelSession = PR_FALSE;
     PRUint32                    itemCount = 0;
     nsresult                    result1;
     nsresult                    result = NS_OK;
@@ -1045,21 +1010,29 @@ NS_IMETHODIMP sbDownloadDevice::DeleteItems(
           }
         }
 
-        /* Check if current session should be deleted. */
-        if (NS_SUCCEEDED(result) && mpDownloadSession && !cancelSession)
+        /* Check if a session should be deleted. */
+        for (j = 0; NS_SUCCEEDED(result) && (j < mDownloadSessions.Length());
+             j++)
         {
-            result1 = pMediaItem->Equals(mpDownloadSession->mpMediaItem,
+            result1 = pMediaItem->Equals(mDownloadSessions[j]->mpMediaItem,
                                          &equals);
             if (NS_SUCCEEDED(result1) && equals)
-                cancelSession = PR_TRUE;
+            {
+                cancelSessions.AppendElement(mDownloadSessions[j]);
+                break;
+            }
         }
+
+        /* The item won't be downloaded, so drop what was downloaded of it. */
+        if (NS_SUCCEEDED(result))
+            RemovePartialDownload(pMediaItem);
     }
 
-    /* Cancel the session if needed.  This counts as another deleted */
-    /* item since the item would not be in the transfer queue.       */
-    if (cancelSession)
+    /* Cancel the sessions if needed.  These count as other deleted */
+    /* items since the items would not be in the transfer queue.    */
+    for (i = 0; i < cancelSessions.Length(); i++)
     {
-        result1 = CancelSession();
+        result1 = CancelSession(cancelSessions[i]);
         if (NS_SUCCEEDED(result1))
             itemCount++;
     }
@@ -1096,14 +1069,21 @@ NS_IMETHODIMP sbDownloadDevice::DeleteAllItems(
 
     /* Remove all the items in the queue. */
     while (GetNextTransferItem(getter_AddRefs(pMediaItem)))
+    {
+        RemovePartialDownload(pMediaItem);
         itemCount++;
+    }
 
-    /* Cancel active download session. */
-    if (mpDownloadSession)
+    /* Cancel active download sessions. */
+    while (mDownloadSessions.Length() > 0)
     {
-        result1 = CancelSession();
+        nsRefPtr<sbDownloadSession> pDownloadSession = mDownloadSessions[0];
+        pMediaItem = pDownloadSession->mpMediaItem;
+        result1 = CancelSession(pDownloadSession);
         if (NS_SUCCEEDED(result1))
             itemCount++;
+        if (pMediaItem)
+            RemovePartialDownload(pMediaItem);
     }
 
     /* Return results. */
@@ -1173,14 +1153,20 @@ NS_IMETHODIMP sbDownloadDevice::SuspendTransfer(
     /* Lock the device. */
     nsAutoMonitor mon(mpDeviceMonitor);
 
-    /* If there's a download session, suspend it. */
-    if (mpDownloadSession)
+    /* Don't start any more sessions until resumed. */
+    mTransfersSuspended = PR_TRUE;
+
+    /* Suspend all download sessions. */
+    for (PRUint32 i = 0; i < mDownloadSessions.Length(); i++)
     {
-        rv = mpDownloadSession->Suspend();
+        rv = mDownloadSessions[i]->Suspend();
         NS_ENSURE_SUCCESS(rv, rv);
+        numItems++;
+    }
+    if (numItems > 0)
+    {
         rv = SetDeviceState(mDeviceIdentifier, STATE_DOWNLOAD_PAUSED);
         NS_ENSURE_SUCCESS(rv, rv);
-        numItems = 1;
     }
 
     /* Return results. */
@@ -1213,16 +1199,20 @@ NS_IMETHODIMP sbDownloadDevice::ResumeTransfer(
     /* Lock the device. */
     nsAutoMonitor mon(mpDeviceMonitor);
 
-    /* If there's a download session, resume it. */
-    if (mpDownloadSession)
+    mTransfersSuspended = PR_FALSE;
+
+    /* Resume all download sessions. */
+    for (PRUint32 i = 0; i < mDownloadSessions.Length(); i++)
     {
-        rv = mpDownloadSession->Resume();
-        NS_ENSURE_SUCCESS(rv, rv);
-        rv = SetDeviceState(mDeviceIdentifier, STATE_DOWNLOADING);
+        rv = mDownloadSessions[i]->Resume();
         NS_ENSURE_SUCCESS(rv, rv);
-        numItems = 1;
+        numItems++;
     }
 
+    /* Start any sessions that were held back while suspended. */
+    rv = RunTransferQueue();
+    NS_ENSURE_SUCCESS(rv, rv);
+
     /* Return results. */
     *aNumItems = numItems;
 
@@ -2087,55 +2077,46 @@ nsresult sbDownloadDevice::EnqueueItem(
 /*
  * RunTransferQueue
  *
- *   This function runs the transfer queue.  It will start transferring the next
- * item in the transfer queue.
+ *   This function runs the transfer queue.  It starts transferring queued items
+ * until the maximum number of sessions is running, or until no queued item can
+ * be started without going over the maximum number of sessions for its host.
  */
 
 nsresult sbDownloadDevice::RunTransferQueue()
 {
     nsCOMPtr<sbIMediaItem>      pMediaItem;
-    PRBool                      initiated = PR_FALSE;
+    nsRefPtr<sbDownloadSession> pDownloadSession;
+    nsCString                   host;
     nsresult                    result = NS_OK;
 
     /* Lock the device. */
     nsAutoMonitor mon(mpDeviceMonitor);
 
-    /* Initiate transfers until queue is busy or empty. */
-    while (   !mpDownloadSession
-           && GetNextTransferItem(getter_AddRefs(pMediaItem)))
+    /* Initiate transfers until all sessions are busy or */
+    /* nothing more can be started.                      */
+    while (   !mTransfersSuspended
+           && (mDownloadSessions.Length() < mMaxSessions)
+           && GetNextStartableItem(getter_AddRefs(pMediaItem), host))
     {
         /* Initiate item transfer. */
-        mpDownloadSession = new sbDownloadSession(this, pMediaItem);
-        if (!mpDownloadSession)
-            result = NS_ERROR_OUT_OF_MEMORY;
-        if (NS_SUCCEEDED(result))
-            result = mpDownloadSession->Initiate();
-        if (NS_SUCCEEDED(result))
-            initiated = PR_TRUE;
+        pDownloadSession = new sbDownloadSession(this, pMediaItem, host);
+        if (pDownloadSession)
+            result = pDownloadSession->Initiate();
         else
-            initiated = PR_FALSE;
+            result = NS_ERROR_OUT_OF_MEMORY;
 
-        /* Send notification that the transfer started. */
-        if (initiated)
+        /* Add the session and send notification that the transfer */
+        /* started.  Release the session if not initiated.          */
+        if (NS_SUCCEEDED(result))
+        {
+            mDownloadSessions.AppendElement(pDownloadSession);
             DoTransferStartCallback(pMediaItem);
-
-        /* Release the download session if not initiated. */
-        if (!initiated && mpDownloadSession)
-            mpDownloadSession = nsnull;
+        }
+        pDownloadSession = nsnull;
     }
 
     /* Update device state. */
-    if (mpDownloadSession)
-    {
-        if (!mpDownloadSession->IsSuspended())
-            SetDeviceState(mDeviceIdentifier, STATE_DOWNLOADING);
-        else
-            SetDeviceState(mDeviceIdentifier, STATE_DOWNLOAD_PAUSED);
-    }
-    else
-    {
-        SetDeviceState(mDeviceIdentifier, STATE_IDLE);
-    }
+    UpdateDeviceState();
 
     return result;
 }
@@ -2180,6 +2161,133 @@ PRBool sbDownloadDevice::GetNextTransferItem(
 }
 
 
+/*
+ * GetNextStartableItem
+ *
+ *   <-- appMediaItem           Next media item to start transferring.
+ *   <-- aHost                  Host the media item is downloaded from.
+ *
+ *   <-- True                   A media item to transfer was returned.
+ *       False                  No queued media item can be started.
+ *
+ *   This function returns in appMediaItem the first media item in the transfer
+ * queue whose host is below the maximum number of sessions per host, and
+ * removes it from the transfer queue.
+ */
+
+PRBool sbDownloadDevice::GetNextStartableItem(
+    sbIMediaItem                **appMediaItem,
+    nsACString                  &aHost)
+{
+    nsCOMPtr<sbIMediaItem>      pMediaItem;
+    nsCString                   host;
+    PRUint32                    i;
+    nsresult                    result;
+
+    for (i = 0; ; i++)
+    {
+        /* Get the next queued media item. */
+        result = GetItemByIndexFromTransferQueue(mDeviceIdentifier,
+                                                 i,
+                                                 getter_AddRefs(pMediaItem));
+        if (NS_FAILED(result) || !pMediaItem)
+            break;
+
+        /* Skip items from hosts that are already busy.  Items */
+        /* without a host are limited together.                */
+        if (NS_FAILED(GetItemHost(pMediaItem, host)))
+            host.Truncate();
+        if (GetHostSessionCount(host) >= mMaxSessionsPerHost)
+            continue;
+
+        /* Take the item off the queue. */
+        result = RemoveItemFromTransferQueue(mDeviceIdentifier, pMediaItem);
+        if (NS_FAILED(result))
+            break;
+
+        aHost.Assign(host);
+        NS_ADDREF(*appMediaItem = pMediaItem);
+        return (PR_TRUE);
+    }
+
+    return (PR_FALSE);
+}
+
+
+/*
+ * GetHostSessionCount
+ *
+ *   --> aHost                  Host to check.
+ *
+ *   <-- Number of active download sessions for aHost.
+ */
+
+PRUint32 sbDownloadDevice::GetHostSessionCount(
+    const nsACString            &aHost)
+{
+    PRUint32                    count = 0;
+
+    for (PRUint32 i = 0; i < mDownloadSessions.Length(); i++)
+    {
+        if (mDownloadSessions[i]->mHost.Equals(aHost))
+            count++;
+    }
+
+    return (count);
+}
+
+
+/*
+ * UpdateDeviceState
+ *
+ *   This function sets the device state from the state of the active download
+ * sessions.  The device is paused only if every session is suspended.
+ */
+
+void sbDownloadDevice::UpdateDeviceState()
+{
+    PRBool                      downloading = PR_FALSE;
+
+    if (mDownloadSessions.Length() == 0)
+    {
+        SetDeviceState(mDeviceIdentifier, STATE_IDLE);
+        return;
+    }
+
+    for (PRUint32 i = 0; i < mDownloadSessions.Length(); i++)
+    {
+        if (!mDownloadSessions[i]->IsSuspended())
+        {
+            downloading = PR_TRUE;
+            break;
+        }
+    }
+
+    if (downloading)
+        SetDeviceState(mDeviceIdentifier, STATE_DOWNLOADING);
+    else
+        SetDeviceState(mDeviceIdentifier, STATE_DOWNLOAD_PAUSED);
+}
+
+
+/*
+ * ShutdownSessions
+ *
+ *   This function shuts down and releases all download sessions.  The device
+ * must be locked.
+ */
+
+void sbDownloadDevice::ShutdownSessions()
+{
+    nsTArray<nsRefPtr<sbDownloadSession> > downloadSessions;
+
+    /* Release the sessions after shutting them down. */
+    downloadSessions.SwapElements(mDownloadSessions);
+    for (PRUint32 i = 0; i < downloadSessions.Length(); i++)
+        downloadSessions[i]->Shutdown();
+}
+
+
 /*
  * ResumeTransfers
  *
@@ -2302,20 +2410,21 @@ nsresult sbDownloadDevice::SetTransferDestination(
 /*
  * CancelSession
  *
- *   This function cancels the active download session and runs the transfer
- * queue.
+ *   --> apDownloadSession      Session to cancel.
+ *
+ *   This function cancels the download session specified by apDownloadSession
+ * and runs the transfer queue.
  */
 
-nsresult sbDownloadDevice::CancelSession()
+nsresult sbDownloadDevice::CancelSession(
+    sbDownloadSession           *apDownloadSession)
 {
+    nsRefPtr<sbDownloadSession> pDownloadSession(apDownloadSession);
     nsresult                    result = NS_OK;
 
     /* Shutdown the session. */
-    if (mpDownloadSession)
-    {
-        mpDownloadSession->Shutdown();
-        mpDownloadSession = nsnull;
-    }
+    if (mDownloadSessions.RemoveElement(pDownloadSession))
+        pDownloadSession->Shutdown();
 
     /* Run the transfer queue. */
     RunTransferQueue();
@@ -2347,8 +2456,7 @@ void sbDownloadDevice::SessionCompleted(
         DoTransferCompleteCallback(apDownloadSession->mpMediaItem, aStatus);
 
         /* Release the download session. */
-        if (apDownloadSession == mpDownloadSession)
-            mpDownloadSession = nsnull;
+        mDownloadSessions.RemoveElement(apDownloadSession);
     }
 
     /* Run the transfer queue. */
@@ -2363,49 +2471,126 @@ void sbDownloadDevice::SessionCompleted(
  ******************************************************************************/
 
 /*
- * GetTmpFile
+ * GetItemHost
  *
- *   <-- ppTmpFile              Temporary file.
+ *   --> apMediaItem            Media item to download.
+ *   <-- aHost                  Host the media item is downloaded from.
  *
- *   This function returns in ppTmpFile an nsIFile object for a unique temporary
- * file.  This function does not create the file.
+ *   This function returns in aHost the host of the content source of the media
+ * item specified by apMediaItem.  Download sessions are limited per host.
  */
 
-nsresult sbDownloadDevice::GetTmpFile(
-    nsIFile                     **ppTmpFile)
+nsresult sbDownloadDevice::GetItemHost(
+    sbIMediaItem                *apMediaItem,
+    nsACString                  &aHost)
 {
-    nsCOMPtr<nsIFile>           pTmpFile;
-    nsString                    tmpFileName;
-    PRInt32                     fileNum;
-    PRBool                      exists;
-    nsresult                    result = NS_OK;
+    nsCOMPtr<nsIURI>            pSrcURI;
+    nsresult                    rv;
 
-    /* Get a unique temporary download file. */
-    fileNum = 1;
-    do
-    {
-        /* Start at the temporary download directory. */
-        result = mpTmpDownloadDir->Clone(getter_AddRefs(pTmpFile));
+    rv = apMediaItem->GetContentSrc(getter_AddRefs(pSrcURI));
+    NS_ENSURE_SUCCESS(rv, rv);
 
-        /* Append the temporary file name. */
-        if (NS_SUCCEEDED(result))
-        {
-            tmpFileName.AssignLiteral("tmp");
-            tmpFileName.AppendInt(fileNum++);
-            result = pTmpFile->Append(tmpFileName);
-        }
+    rv = pSrcURI->GetHost(aHost);
+    NS_ENSURE_SUCCESS(rv, rv);
 
-        /* Check if the file exists. */
-        if (NS_SUCCEEDED(result))
-            result = pTmpFile->Exists(&exists);
-    }
-    while (exists && NS_SUCCEEDED(result));
+    return (NS_OK);
+}
 
-    /* Return results. */
-    if (NS_SUCCEEDED(result))
-        NS_ADDREF(*ppTmpFile = pTmpFile);
 
-    return (result);
+/*
+ * GetPartialFile
+ *
+ *   --> apMediaItem            Media item to download.
+ *   <-- ppPartialFile          Partial download file.
+ *
+ *   This function returns in ppPartialFile the file the media item specified
+ * by apMediaItem is downloaded to.  The file is in the destination directory,
+ * so completing the download only renames it, and it is named after the media
+ * item, so an interrupted download can be found and resumed later.  This
+ * function does not create the file.
+ */
+
+nsresult sbDownloadDevice::GetPartialFile(
+    sbIMediaItem                *apMediaItem,
+    nsIFile                     **ppPartialFile)
+{
+    nsCOMPtr<nsIURI>            pDstURI;
+    nsCOMPtr<nsIFileURL>        pDstFileURL;
+    nsCOMPtr<nsIFile>           pDstFile;
+    nsCOMPtr<nsIFile>           pPartialFile;
+    nsString                    dstSpec;
+    nsString                    guid;
+    PRBool                      isDirectory;
+    nsresult                    rv;
+
+    /* Get the destination. */
+    rv = apMediaItem->GetProperty(NS_LITERAL_STRING(SB_PROPERTY_DESTINATION),
+                                  dstSpec);
+    NS_ENSURE_SUCCESS(rv, rv);
+    NS_ENSURE_TRUE(!dstSpec.IsEmpty(), NS_ERROR_NOT_AVAILABLE);
+
+    rv = NS_NewURI(getter_AddRefs(pDstURI), dstSpec);
+    NS_ENSURE_SUCCESS(rv, rv);
+    pDstFileURL = do_QueryInterface(pDstURI, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = pDstFileURL->GetFile(getter_AddRefs(pDstFile));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    /* Put the partial file next to the destination file if */
+    /* the destination isn't a directory.                   */
+    rv = pDstFile->IsDirectory(&isDirectory);
+    if (NS_FAILED(rv))
+        isDirectory = PR_FALSE;
+    if (isDirectory)
+        rv = pDstFile->Clone(getter_AddRefs(pPartialFile));
+    else
+        rv = pDstFile->GetParent(getter_AddRefs(pPartialFile));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    /* Name the partial file after the media item. */
+    rv = apMediaItem->GetGuid(guid);
+    NS_ENSURE_SUCCESS(rv, rv);
+    guid.AppendLiteral(SB_DOWNLOAD_PARTIAL_EXTENSION);
+    rv = pPartialFile->Append(guid);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    NS_ADDREF(*ppPartialFile = pPartialFile);
+
+    return (NS_OK);
+}
+
+
+/*
+ * RemovePartialDownload
+ *
+ *   --> apMediaItem            Media item that won't be downloaded.
+ *
+ *   This function removes the partial download file of the media item
+ * specified by apMediaItem, if any, and forgets how to resume it.
+ */
+
+nsresult sbDownloadDevice::RemovePartialDownload(
+    sbIMediaItem                *apMediaItem)
+{
+    nsCOMPtr<nsIFile>           pPartialFile;
+    PRBool                      exists;
+    nsresult                    rv;
+
+    rv = apMediaItem->SetProperty
+                        (NS_LITERAL_STRING(SB_PROPERTY_DOWNLOAD_ENTITY_ID),
+                         SBVoidString());
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = GetPartialFile(apMediaItem, getter_AddRefs(pPartialFile));
+    if (NS_FAILED(rv))
+        return (NS_OK);
+
+    rv = pPartialFile->Exists(&exists);
+    if (NS_SUCCEEDED(rv) && exists)
+        rv = pPartialFile->Remove(PR_FALSE);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    return (NS_OK);
 }
 
 
@@ -2634,11 +2819,14 @@ nsresult sbDownloadDevice::OpenDialog(
 
 sbDownloadSession::sbDownloadSession(
     sbDownloadDevice            *pDownloadDevice,
-    sbIMediaItem                *pMediaItem)
+    sbIMediaItem                *pMediaItem,
+    const nsACString            &aHost)
 :
     mpMediaItem(pMediaItem),
+    mHost(aHost),
     mpSessionLock(nsnull),
     mpDownloadDevice(pDownloadDevice),
+    mEntityIDSaved(PR_FALSE),
     mShutdown(PR_FALSE),
     mSuspended(PR_FALSE),
     mInitialProgressBytes(0),
@@ -2725,10 +2913,6 @@ nsresult sbDownloadSession::Initiate()
     if (!mpSessionLock)
         return NS_ERROR_OUT_OF_MEMORY;
 
-    /* Get a unique temporary download file. */
-    rv = mpDownloadDevice->GetTmpFile(getter_AddRefs(mpTmpFile));
-    NS_ENSURE_SUCCESS(rv, rv);
-
     /* Set the origin URL */
     // Check if the origin URL is already set, if not copy from ContentSrc
     // We do this so that we don't overwrite the originURL with a downloaded
@@ -2789,6 +2973,42 @@ nsresult sbDownloadSession::Initiate()
     rv = pDstFile->Clone(getter_AddRefs(mpDstFile));
     NS_ENSURE_SUCCESS(rv, rv);
 
+    /* Get the partial download file.  If an earlier download of the */
+    /* media item was interrupted, pick up where it left off.        */
+    rv = sbDownloadDevice::GetPartialFile(mpMediaItem,
+                                          getter_AddRefs(mpPartialFile));
+    NS_ENSURE_SUCCESS(rv, rv);
+    {
+        nsCOMPtr<nsIFile>           pPartialDir;
+        PRBool                      exists;
+
+        /* Make sure the destination directory exists. */
+        rv = mpPartialFile->GetParent(getter_AddRefs(pPartialDir));
+        NS_ENSURE_SUCCESS(rv, rv);
+        rv = pPartialDir->Exists(&exists);
+        NS_ENSURE_SUCCESS(rv, rv);
+        if (!exists)
+        {
+            rv = pPartialDir->Create(nsIFile::DIRECTORY_TYPE, 0755);
+            NS_ENSURE_SUCCESS(rv, rv);
+        }
+    }
+    {
+        nsString                    entityID;
+        PRBool                      exists = PR_FALSE;
+
+        rv = mpMediaItem->GetProperty
+                            (NS_LITERAL_STRING(SB_PROPERTY_DOWNLOAD_ENTITY_ID),
+                             entityID);
+        if (NS_SUCCEEDED(rv) && !entityID.IsEmpty())
+            rv = mpPartialFile->Exists(&exists);
+        if (NS_SUCCEEDED(rv) && exists)
+        {
+            mEntityID = NS_ConvertUTF16toUTF8(entityID);
+            mEntityIDSaved = PR_TRUE;
+        }
+    }
+
     /* Get the destination library. */
     rv = pLibraryManager->GetMainLibrary(getter_AddRefs(mpDstLibrary));
     NS_ENSURE_SUCCESS(rv, rv);
@@ -2837,7 +3057,7 @@ nsresult sbDownloadSession::SetUpRequest()
     {
         /* We are resuming a download, initialize the channel to resume at the correct position */
         nsCOMPtr<nsIFile> clone;
-        if (NS_FAILED(mpTmpFile->Clone(getter_AddRefs(clone))) ||
+        if (NS_FAILED(mpPartialFile->Clone(getter_AddRefs(clone))) ||
             NS_FAILED(clone->GetFileSize(&mInitialProgressBytes)))
         {
             NS_WARNING("Restarting download instead of resuming: failed \
@@ -2870,7 +3090,7 @@ nsresult sbDownloadSession::SetUpRequest()
     NS_ENSURE_SUCCESS(rv, rv);
 
     /* Initiate the download. */
-    rv = mpWebBrowser->SaveChannel(mpRequest, mpTmpFile);
+    rv = mpWebBrowser->SaveChannel(mpRequest, mpPartialFile);
     if (NS_FAILED(rv))
     {
         NS_WARNING("Failed initiating download");
@@ -2879,6 +3099,35 @@ nsresult sbDownloadSession::SetUpRequest()
     return rv;
 }
 
+/*
+ * RestartRequest
+ *
+ *   Starts the download over, e.g. because the file changed on the server
+ * since the partial download was made.
+ */
+
+nsresult sbDownloadSession::RestartRequest()
+{
+    TRACE(("sbDownloadSession[0x%.8x] - RestartRequest", this));
+
+    /* Forget the partial download. */
+    mEntityID.Truncate();
+    mEntityIDSaved = PR_FALSE;
+    mInitialProgressBytes = 0;
+    mpMediaItem->SetProperty(NS_LITERAL_STRING(SB_PROPERTY_DOWNLOAD_ENTITY_ID),
+                             SBVoidString());
+
+    /* Drop the old request. */
+    mpRequest = nsnull;
+    if (mpWebBrowser)
+    {
+        mpWebBrowser->SetProgressListener(nsnull);
+        mpWebBrowser = nsnull;
+    }
+
+    return SetUpRequest();
+}
+
 /*
  * Suspend
  *
@@ -3123,6 +3372,15 @@ NS_IMETHODIMP sbDownloadSession::OnStateChange(
         if (status == NS_ERROR_ABORT)
             return NS_OK;
 
+        /* Start over if a resumed download can't be resumed after all. */
+        if (   (mInitialProgressBytes > 0)
+            && (   (status == NS_ERROR_NOT_RESUMABLE)
+                || (status == NS_ERROR_ENTITY_CHANGED)))
+        {
+            if (NS_SUCCEEDED(RestartRequest()))
+                return NS_OK;
+        }
+
         /* Check HTTP response status. */
         if (NS_SUCCEEDED(status))
         {
@@ -3160,6 +3418,10 @@ NS_IMETHODIMP sbDownloadSession::OnStateChange(
             sbAutoDownloadButtonPropertyValue property(mpMediaItem,
                                                        mpStatusTarget);
             property.value->SetMode(sbDownloadButtonPropertyValue::eFailed);
+
+            // Keep the partial download only if it can be resumed.
+            if (!mEntityIDSaved)
+                mpPartialFile->Remove(PR_FALSE);
         }
 
         /* Set the final download status. */
@@ -3249,6 +3511,9 @@ NS_IMETHODIMP sbDownloadSession::OnProgressChange(
     /* we got some progress, let's reset the idle timer */
     ResetTimers();
 
+    /* Remember how to resume the download. */
+    SaveEntityID(aRequest);
+
     /* Update progress. */
     UpdateProgress(aCurSelfProgress, aMaxSelfProgress);
 
@@ -3493,6 +3758,17 @@ nsresult sbDownloadSession::CompleteTransfer(nsIRequest* aRequest)
       }
     }
 
+    /* Move the partial download file into place.  It's in the */
+    /* destination directory already, so this only renames it.  */
+    result = mpDstFile->GetParent(getter_AddRefs(pFileDir));
+    NS_ENSURE_SUCCESS(result, result);
+    result = mpPartialFile->MoveTo(pFileDir, fileName);
+    NS_ENSURE_SUCCESS(result, result);
+
+    /* There's nothing left to resume. */
+    mpMediaItem->SetProperty(NS_LITERAL_STRING(SB_PROPERTY_DOWNLOAD_ENTITY_ID),
+                             SBVoidString());
+
     if (bChangedDstFile) {
         /* Get the destination URI spec. */
         nsCOMPtr<nsIURI> pDstURI;
@@ -3529,19 +3805,24 @@ nsresult sbDownloadSession::CompleteTransfer(nsIRequest* aRequest)
     if (NS_SUCCEEDED(result))
       result = pDstMediaList->Add(mpMediaItem);
 
-    /* Move the temporary download file to the final location. */
-    if (NS_SUCCEEDED(result))
-        result = mpDstFile->GetParent(getter_AddRefs(pFileDir));
+    /* Read the metadata of the downloaded file. */
     if (NS_SUCCEEDED(result)) {
-      nsRefPtr<sbDownloadSessionMoveHandler> moveHandler;
-      moveHandler = new sbDownloadSessionMoveHandler(mpTmpFile, 
-                                                     pFileDir, 
-                                                     fileName,
-                                                     mpMediaItem);
-      NS_ENSURE_TRUE(moveHandler, NS_ERROR_OUT_OF_MEMORY);
-
-      result = mpDownloadDevice->mFileMoveThreadPool->Dispatch(moveHandler,
-                                                               nsIEventTarget::DISPATCH_NORMAL);
+      nsCOMPtr<sbIFileMetadataService> metadataService;
+      nsCOMPtr<sbIJobProgress>         metadataJob;
+      nsCOMPtr<nsIMutableArray>        itemArray =
+        do_CreateInstance("@songbirdnest.com/moz/xpcom/threadsafe-array;1",
+                          &result);
+      NS_ENSURE_SUCCESS(result, result);
+
+      result = itemArray->AppendElement(mpMediaItem, PR_FALSE);
+      NS_ENSURE_SUCCESS(result, result);
+
+      metadataService =
+        do_GetService("@songbirdnest.com/Songbird/FileMetadataService;1",
+                      &result);
+      NS_ENSURE_SUCCESS(result, result);
+
+      result = metadataService->Read(itemArray, getter_AddRefs(metadataJob));
     }
 
     /* Update the web library with the local downloaded file URL. */
@@ -3581,6 +3862,48 @@ nsresult sbDownloadSession::CompleteTransfer(nsIRequest* aRequest)
 }
 
 
+/*
+ * SaveEntityID
+ *
+ *   --> aRequest               Download request.
+ *
+ *   This function saves the entity ID of the download request specified by
+ * aRequest to the media item, so that the download can be resumed if it fails
+ * or the application exits before it completes.  Requests that can't be
+ * resumed have no entity ID.
+ */
+
+void sbDownloadSession::SaveEntityID(
+    nsIRequest                  *aRequest)
+{
+    nsCOMPtr<nsIResumableChannel> pResumableChannel;
+    nsCString                   entityID;
+    nsresult                    rv;
+
+    /* Do nothing if already saved. */
+    if (mEntityIDSaved || !mpMediaItem)
+        return;
+
+    /* Get the entity ID. */
+    pResumableChannel = do_QueryInterface(aRequest);
+    if (!pResumableChannel)
+        return;
+    rv = pResumableChannel->GetEntityID(entityID);
+    if (NS_FAILED(rv) || entityID.IsEmpty())
+        return;
+
+    /* Save the entity ID. */
+    rv = mpMediaItem->SetProperty
+                            (NS_LITERAL_STRING(SB_PROPERTY_DOWNLOAD_ENTITY_ID),
+                             NS_ConvertUTF8toUTF16(entityID));
+    if (NS_SUCCEEDED(rv))
+    {
+        mEntityID = entityID;
+        mEntityIDSaved = PR_TRUE;
+    }
+}
+
+
 /*
  * UpdateDstLibraryMetadata
  *
@@ -4278,32 +4601,3 @@ sbAutoDownloadButtonPropertyValue::~sbAutoDownloadButtonPropertyValue()
   }
   MOZ_COUNT_DTOR(sbAutoDownloadButtonPropertyValue);
 }
-
-
-NS_IMPL_THREADSAFE_ISUPPORTS1(sbDownloadSessionMoveHandler, 
-                              nsIRunnable)
-
-NS_IMETHODIMP sbDownloadSessionMoveHandler::Run() {
-  nsresult rv = NS_ERROR_UNEXPECTED;
-  
-  rv = mSourceFile->MoveTo(mDestinationPath, mDestinationFileName);
-  NS_ENSURE_SUCCESS(rv, rv);
-
-  nsCOMPtr<sbIFileMetadataService> metadataService;
-  nsCOMPtr<sbIJobProgress>         metadataJob;
-
-  /* Create an array to contain the media items to scan. */
-  nsCOMPtr<nsIMutableArray> itemArray = 
-    do_CreateInstance("@songbirdnest.com/moz/xpcom/threadsafe-array;1", &rv);
-
-  rv = itemArray->AppendElement(mDestinationItem, PR_FALSE);
-  NS_ENSURE_SUCCESS(rv, rv);
-
-  /* Start a metadata scanning job. */
-  metadataService = 
-    do_GetService("@songbirdnest.com/Songbird/FileMetadataService;1", &rv);
-  NS_ENSURE_SUCCESS(rv, rv);
-
-  return metadataService->Read(itemArray,
-                               getter_AddRefs(metadataJob));
-}
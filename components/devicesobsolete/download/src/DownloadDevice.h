@@ -82,7 +82,7 @@
 #include <nsIPrefService.h>
 #include <nsIRunnable.h>
 #include <nsIStringBundle.h>
-#include <nsIThreadPool.h>
+#include <nsTArray.h>
 #include <prmon.h>
 
 /* Songbird imports. */
@@ -166,11 +166,14 @@ class sbDownloadDevice : public nsIObserver,
      * mpIOService              I/O service.
      * mpStringBundle           Download device string bundle.
      * mQueuedStr               Download queued string.
-     * mpTmpDownloadDir         Temporary download directory.
-     * mpDownloadSession        Current download session.
+     * mDownloadSessions        Active download sessions.
      * mpDeviceLock             Lock for download device access.
      * mDeviceIdentifier        Download device identifier.
-     * mFileMoveThreadPool      Thread pool to move files on completion
+     * mMaxSessions             Maximum number of concurrent sessions.
+     * mMaxSessionsPerHost      Maximum number of concurrent sessions
+     *                          downloading from the same host.
+     * mTransfersSuspended      True if transfers have been suspended; no new
+     *                          sessions are started until they are resumed.
      */
 
     nsCOMPtr<sbIMediaList>      mpDownloadMediaList;
@@ -182,12 +185,13 @@ class sbDownloadDevice : public nsIObserver,
     nsCOMPtr<nsIIOService>      mpIOService;
     nsCOMPtr<nsIStringBundle>   mpStringBundle;
     nsString                    mQueuedStr;
-    nsCOMPtr<nsIFile>           mpTmpDownloadDir;
-    nsRefPtr<sbDownloadSession> mpDownloadSession;
+    nsTArray<nsRefPtr<sbDownloadSession> >
+                                mDownloadSessions;
     PRMonitor                   *mpDeviceMonitor;
     nsString                    mDeviceIdentifier;
-
-    nsCOMPtr<nsIThreadPool>     mFileMoveThreadPool;
+    PRUint32                    mMaxSessions;
+    PRUint32                    mMaxSessionsPerHost;
+    PRBool                      mTransfersSuspended;
 
     /*
      * Private media list services.
@@ -216,12 +220,24 @@ class sbDownloadDevice : public nsIObserver,
     PRBool GetNextTransferItem(
         sbIMediaItem                **appMediaItem);
 
+    PRBool GetNextStartableItem(
+        sbIMediaItem                **appMediaItem,
+        nsACString                  &aHost);
+
+    PRUint32 GetHostSessionCount(
+        const nsACString            &aHost);
+
+    void UpdateDeviceState();
+
+    void ShutdownSessions();
+
     nsresult ResumeTransfers();
 
     nsresult SetTransferDestination(
         nsCOMPtr<sbIMediaItem>      pMediaItem);
 
-    nsresult CancelSession();
+    nsresult CancelSession(
+        sbDownloadSession           *apDownloadSession);
 
     void SessionCompleted(
         sbDownloadSession           *apDownloadSession,
@@ -232,8 +248,16 @@ class sbDownloadDevice : public nsIObserver,
      * Private services.
      */
 
-    nsresult GetTmpFile(
-        nsIFile                     **ppTmpFile);
+    static nsresult GetItemHost(
+        sbIMediaItem                *apMediaItem,
+        nsACString                  &aHost);
+
+    static nsresult GetPartialFile(
+        sbIMediaItem                *apMediaItem,
+        nsIFile                     **ppPartialFile);
+
+    static nsresult RemovePartialDownload(
+        sbIMediaItem                *apMediaItem);
 
     static nsresult MakeFileUnique(
         nsIFile                     *apFile);
@@ -297,11 +321,13 @@ class sbDownloadSession : public nsIWebProgressListener, nsITimerCallback
      * mpMediaItem              Media item being downloaded.
      * mSrcURISpec              Source URI spec string.
      * mDstURISpec              Destination URI spec string.
+     * mHost                    Host the media item is downloaded from.
      */
 
     nsCOMPtr<sbIMediaItem>      mpMediaItem;
     nsString                    mSrcURISpec;
     nsString                    mDstURISpec;
+    nsCString                   mHost;
 
 
     /*
@@ -318,7 +344,8 @@ class sbDownloadSession : public nsIWebProgressListener, nsITimerCallback
 
     sbDownloadSession(
         sbDownloadDevice            *pDownloadDevice,
-        sbIMediaItem                *pMediaItem);
+        sbIMediaItem                *pMediaItem,
+        const nsACString            &aHost);
 
     virtual ~sbDownloadSession();
 
@@ -351,12 +378,16 @@ class sbDownloadSession : public nsIWebProgressListener, nsITimerCallback
      * mpFileProtocolHandler    File protocol handler.
      * mpWebBrowser             Web browser used for download.
      * mpChannel                Download channel.
-     * mpTmpFile                Temporary download file.
+     * mpPartialFile            Partial download file, next to the
+     *                          destination file.
      * mpSrcURI                 Source download URI.
      * mpDstLibrary             Destination library.
      * mpDstFile                Destination download file.
      * mpDstURI                 Destination download URI.
      * mEntityID                Entity ID of the download (for resuming).
+     * mEntityIDSaved           True if the entity ID has been saved to the
+     *                          media item, so the download can be resumed
+     *                          after it fails or the application exits.
      * mShutdown                True if session has been shut down.
      * mSuspended               True if session is suspended.
      * mLastUpdate              Last time progress was updated.
@@ -376,13 +407,14 @@ class sbDownloadSession : public nsIWebProgressListener, nsITimerCallback
     nsCOMPtr<nsIWebBrowserPersist>
                                 mpWebBrowser;
     nsCOMPtr<nsIChannel>        mpRequest;
-    nsCOMPtr<nsIFile>           mpTmpFile;
+    nsCOMPtr<nsIFile>           mpPartialFile;
     nsCOMPtr<nsIURI>            mpSrcURI;
     nsCOMPtr<sbILibrary>        mpDstLibrary;
     nsCOMPtr<nsIFile>           mpDstFile;
     nsCOMPtr<nsIURI>            mpDstURI;
     nsCOMPtr<sbIMediaItem>      mpStatusTarget;
     nsCString                   mEntityID;
+    PRBool                      mEntityIDSaved;
     PRBool                      mShutdown;
     PRBool                      mSuspended;
     PRTime                      mLastUpdate;
@@ -400,6 +432,11 @@ class sbDownloadSession : public nsIWebProgressListener, nsITimerCallback
 
     nsresult SetUpRequest();
 
+    nsresult RestartRequest();
+
+    void SaveEntityID(
+        nsIRequest                  *aRequest);
+
     nsresult CompleteTransfer(nsIRequest* aRequest);
 
     nsresult UpdateDstLibraryMetadata();
@@ -520,32 +557,4 @@ private:
   PRBool mReadOnly;
 };
 
-class sbDownloadSessionMoveHandler : public nsIRunnable
-{
-public:
-  explicit sbDownloadSessionMoveHandler(nsIFile *aSourceFile,
-                                        nsIFile *aDestinationPath,
-                                        const nsAString &aDestinationFileName,
-                                        sbIMediaItem *aDestinationItem) {
-    NS_ASSERTION(aSourceFile, "aSourceFile is null!");
-    NS_ASSERTION(aDestinationPath, "aDestinationPath is null!");
-    NS_ASSERTION(aDestinationItem, "aDestinationItem is null!");
-
-    mSourceFile = aSourceFile;
-    mDestinationPath = aDestinationPath;
-    mDestinationFileName = aDestinationFileName;
-    mDestinationItem = aDestinationItem;
-  }
-
-  NS_DECL_ISUPPORTS
-  NS_DECL_NSIRUNNABLE
-
-private:
-  nsCOMPtr<nsIFile> mSourceFile;
-  nsCOMPtr<nsIFile> mDestinationPath;
-  nsString          mDestinationFileName;
-
-  nsCOMPtr<sbIMediaItem> mDestinationItem;
-};
-
 #endif // __DOWNLOAD_DEVICE_H__
@@ -0,0 +1,610 @@
+/* -*- Mode: Java; tab-width: 2; indent-tabs-mode: nil; c-basic-offset: 2 -*- */
+/* vim: set sw=2 :miv */
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2010 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+/**
+ * \file  test_download_device.js
+ * \brief Javascript source for the download device unit tests.
+ */
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+//
+// Download device unit tests.
+//
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+
+Components.utils.import("resource://gre/modules/XPCOMUtils.jsm");
+Components.utils.import("resource://app/jsmodules/sbProperties.jsm");
+Components.utils.import("resource://app/jsmodules/sbLibraryUtils.jsm");
+
+/**
+ * Run the unit tests.
+ */
+
+function runTest() {
+  // Start running the tests.
+  testDownloadDevice.start();
+}
+
+
+/**
+ * Download device tests.
+ */
+
+let testDownloadDevice = {
+  //
+  // Download device tests configuration.
+  //
+  //   maxSessions              Maximum number of concurrent download sessions.
+  //   maxSessionsPerHost       Maximum number of concurrent download sessions
+  //                            per host.
+  //   responseDelay            Time in milliseconds the server holds each
+  //                            concurrency test response open.
+  //   contentLength            Length of the served content.
+  //
+
+  maxSessions: 2,
+  maxSessionsPerHost: 1,
+  responseDelay: 500,
+  contentLength: 65536,
+
+
+  //
+  // Download device tests fields.
+  //
+  //   _testList                List of tests to run.
+  //   _nextTestIndex           Index of next test to run.
+  //   _testPendingIndicated    True if a pending test has been indicated.
+  //   _allTestsComplete        True if all tests have completed.
+  //   _server                  HTTP server.
+  //   _serverPort              HTTP server port.
+  //   _device                  Download device.
+  //   _dstDir                  Download destination directory.
+  //   _content                 Content served by the test server.
+  //   _onTransferComplete      Function called when a transfer completes.
+  //   _activeCount             Number of responses the server has open.
+  //   _activeHostCount         Number of open responses per host.
+  //   _maxActiveCount          Largest value _activeCount reached.
+  //   _maxActiveHostCount      Largest value any _activeHostCount reached.
+  //   _requestLog              Request headers seen by the server.
+  //   _pendingResponse         Response held open by the server.
+  //
+
+  _testList: null,
+  _nextTestIndex: 0,
+  _testPendingIndicated: false,
+  _allTestsComplete: false,
+  _server: null,
+  _serverPort: -1,
+  _device: null,
+  _dstDir: null,
+  _content: null,
+  _onTransferComplete: null,
+  _activeCount: 0,
+  _activeHostCount: null,
+  _maxActiveCount: 0,
+  _maxActiveHostCount: 0,
+  _requestLog: null,
+  _pendingResponse: null,
+
+
+  /**
+   * Start the tests.
+   */
+
+  start: function testDownloadDevice_start() {
+    let self = this;
+
+    // Initialize the list of tests.
+    this._testList = [];
+    this._testList.push(function() { return self._testSessionLimits(); });
+    this._testList.push(function() { return self._testRangeResume(); });
+    this._testList.push(function() { return self._testETagChanged(); });
+    this._testList.push(function()
+                          { return self._testLastModifiedChanged(); });
+
+    // Make the served content.
+    this._content = "";
+    for (let i = 0; i < this.contentLength; i++) {
+      this._content += String.fromCharCode(0x61 + (i % 26));
+    }
+
+    // Set up a test server.
+    this._serverPort = getTestServerPortNumber();
+    this._server = Cc["@mozilla.org/server/jshttp;1"]
+                     .createInstance(Ci.nsIHttpServer);
+    this._server.start(this._serverPort);
+    this._server.registerPathHandler("/limits.mp3", function(aRequest,
+                                                             aResponse) {
+      self._handleLimitsRequest(aRequest, aResponse);
+    });
+    this._server.registerPathHandler("/resume.mp3", function(aRequest,
+                                                             aResponse) {
+      self._handleResumeRequest(aRequest, aResponse);
+    });
+    this._server.registerPathHandler("/changed.mp3", function(aRequest,
+                                                              aResponse) {
+      self._handleChangedRequest(aRequest, aResponse);
+    });
+
+    // Create the download destination directory.
+    this._dstDir = Cc["@mozilla.org/file/directory_service;1"]
+                     .getService(Ci.nsIProperties)
+                     .get("TmpD", Ci.nsIFile);
+    this._dstDir.append("test_download_device");
+    this._dstDir.createUnique(Ci.nsIFile.DIRECTORY_TYPE, 0755);
+
+    // Set the session limits and create the download device.
+    let prefs = Cc["@mozilla.org/preferences-service;1"]
+                  .getService(Ci.nsIPrefBranch);
+    prefs.setIntPref("songbird.download.maxSessions", this.maxSessions);
+    prefs.setIntPref("songbird.download.maxSessionsPerHost",
+                     this.maxSessionsPerHost);
+    this._device = Cc["@songbirdnest.com/Songbird/OldDeviceImpl/DownloadDevice;1"]
+                     .createInstance(Ci.sbIDownloadDevice);
+    this._device.QueryInterface(Ci.sbIDeviceBase);
+    this._device.initialize();
+    this._device.addCallback(this);
+
+    // Start running the tests.
+    this._nextTestIndex = 0;
+    this._runNextTest();
+  },
+
+
+  /**
+   * Finish the tests.
+   */
+
+  _finish: function testDownloadDevice__finish() {
+    // Mark all tests complete.
+    this._allTestsComplete = true;
+
+    // Shut down the download device.
+    this._device.removeCallback(this);
+    this._device.finalize();
+    this._device = null;
+
+    // Remove the download destination directory.
+    this._dstDir.remove(true);
+
+    // Indicate that the test has finished if a pending test has been indicated.
+    if (this._testPendingIndicated) {
+      testFinished();
+    }
+
+    // Stop test server.
+    this._server.stop(function() {});
+  },
+
+
+  /**
+   * Run the next test.
+   */
+
+  _runNextTest: function testDownloadDevice__runNextTest() {
+    // Run tests until complete or test is pending.
+    while (1) {
+      // Finish test if no more tests to run.
+      if (this._nextTestIndex >= this._testList.length) {
+        this._finish();
+        break;
+      }
+
+      // Run the next test.  Indicate if tests are pending.
+      if (!this._testList[this._nextTestIndex++]()) {
+        // If not all tests have completed and a pending test has not been
+        // indicated, indicate a pending test.
+        if (!this._allTestsComplete && !this._testPendingIndicated) {
+          this._testPendingIndicated = true;
+          testPending();
+        }
+        break;
+      }
+    }
+  },
+
+
+  /**
+   * Test that the session limits are honored.
+   */
+
+  _testSessionLimits: function testDownloadDevice__testSessionLimits() {
+    let self = this;
+
+    // Reset the server counters.
+    this._activeCount = 0;
+    this._activeHostCount = {};
+    this._maxActiveCount = 0;
+    this._maxActiveHostCount = 0;
+
+    // Queue three downloads from one host and two from another.
+    let specList = [ "http://localhost:" + this._serverPort + "/limits.mp3?1",
+                     "http://localhost:" + this._serverPort + "/limits.mp3?2",
+                     "http://localhost:" + this._serverPort + "/limits.mp3?3",
+                     "http://127.0.0.1:" + this._serverPort + "/limits.mp3?4",
+                     "http://127.0.0.1:" + this._serverPort + "/limits.mp3?5" ];
+    let remaining = specList.length;
+    this._onTransferComplete = function(aMediaItem, aStatus) {
+      assertTrue(Components.isSuccessCode(aStatus),
+                 "Download failed: " + aStatus);
+      if (--remaining > 0)
+        return;
+
+      // No more than the session limits were ever active, and the other host
+      // was downloaded from while the first one was busy.
+      assertEqual(self._maxActiveCount, self.maxSessions);
+      assertEqual(self._maxActiveHostCount, self.maxSessionsPerHost);
+      self._runNextTest();
+    };
+    for each (let spec in specList) {
+      this._queueDownload(spec);
+    }
+
+    // Test is pending.
+    return false;
+  },
+
+
+  /**
+   * Test that a suspended download is resumed with a range request.
+   */
+
+  _testRangeResume: function testDownloadDevice__testRangeResume() {
+    let self = this;
+
+    // Queue a download.  The server sends the first half of the content and
+    // holds the response open.
+    this._requestLog = [];
+    let mediaItem = this._queueDownload("http://localhost:" + this._serverPort +
+                                        "/resume.mp3");
+    let partialFile = this._dstDir.clone();
+    partialFile.append(mediaItem.guid + ".part");
+
+    // Wait for part of the content to be written, then suspend and resume the
+    // download.
+    let resumeOffset = 0;
+    let waitForPartialFile = function() {
+      if (!partialFile.exists() || (partialFile.fileSize == 0)) {
+        doTimeout(100, waitForPartialFile);
+        return;
+      }
+      self._device.suspendTransfer("");
+      self._pendingResponse.finish();
+      self._pendingResponse = null;
+      resumeOffset = partialFile.fileSize;
+      self._device.resumeTransfer("");
+    };
+    doTimeout(100, waitForPartialFile);
+
+    // Check that the download resumed where it left off.
+    this._onTransferComplete = function(aMediaItem, aStatus) {
+      assertTrue(Components.isSuccessCode(aStatus),
+                 "Download failed: " + aStatus);
+      assertEqual(self._requestLog.length, 2);
+      assertEqual(self._requestLog[0].range, null);
+      assertEqual(self._requestLog[1].range, "bytes=" + resumeOffset + "-");
+      assertEqual(self._requestLog[1].ifMatch, "\"resume\"");
+      assertEqual(self._readContent(aMediaItem), self._content);
+      assertFalse(partialFile.exists());
+      self._runNextTest();
+    };
+
+    // Test is pending.
+    return false;
+  },
+
+
+  /**
+   * Test that a download is restarted when the entity tag changed.
+   */
+
+  _testETagChanged: function testDownloadDevice__testETagChanged() {
+    return this._testEntityChanged("%22stale%22/" + this.contentLength + "/");
+  },
+
+
+  /**
+   * Test that a download is restarted when the last modified time changed.
+   */
+
+  _testLastModifiedChanged:
+    function testDownloadDevice__testLastModifiedChanged() {
+    let lastModified = encodeURIComponent("Thu, 01 Jan 2009 00:00:00 GMT");
+    return this._testEntityChanged("/" + this.contentLength + "/" +
+                                   lastModified);
+  },
+
+
+  /**
+   * Test that a partial download with the entity ID specified by aEntityID is
+   * restarted from the beginning because the entity on the server changed.
+   *
+   * \param aEntityID           Entity ID of the partial download.
+   */
+
+  _testEntityChanged: function testDownloadDevice__testEntityChanged(aEntityID) {
+    let self = this;
+
+    // Create a media item with a stale partial download.
+    this._requestLog = [];
+    let mediaItem = this._createItem("http://localhost:" + this._serverPort +
+                                     "/changed.mp3");
+    mediaItem.setProperty(SBProperties.downloadEntityID, aEntityID);
+    let partialFile = this._dstDir.clone();
+    partialFile.append(mediaItem.guid + ".part");
+    this._writeFile(partialFile, "stale content");
+
+    // Check that the resume was refused and the download restarted.
+    this._onTransferComplete = function(aMediaItem, aStatus) {
+      assertTrue(Components.isSuccessCode(aStatus),
+                 "Download failed: " + aStatus);
+      assertEqual(self._requestLog.length, 2);
+      assertEqual(self._requestLog[0].range,
+                  "bytes=" + "stale content".length + "-");
+      assertEqual(self._requestLog[1].range, null);
+      assertEqual(self._requestLog[1].ifMatch, null);
+      assertEqual(self._requestLog[1].ifUnmodifiedSince, null);
+      assertEqual(self._readContent(aMediaItem), self._content);
+      self._runNextTest();
+    };
+
+    // Start the download.
+    this._device.downloadMediaList.add(mediaItem);
+
+    // Test is pending.
+    return false;
+  },
+
+
+  /**
+   * Handle a request made by the session limits test.  Track how many
+   * responses are open and complete each response after a delay.
+   */
+
+  _handleLimitsRequest:
+    function testDownloadDevice__handleLimitsRequest(aRequest, aResponse) {
+    let self = this;
+    let host = aRequest.host;
+
+    // Count the response as active.
+    this._activeCount++;
+    this._activeHostCount[host] = (this._activeHostCount[host] || 0) + 1;
+    this._maxActiveCount = Math.max(this._maxActiveCount, this._activeCount);
+    this._maxActiveHostCount = Math.max(this._maxActiveHostCount,
+                                        this._activeHostCount[host]);
+
+    // Send the content after a delay.
+    aResponse.processAsync();
+    doTimeout(this.responseDelay, function() {
+      self._activeCount--;
+      self._activeHostCount[host]--;
+      aResponse.setStatusLine(aRequest.httpVersion, 200, "OK");
+      aResponse.setHeader("Content-Type", "audio/mpeg", false);
+      aResponse.setHeader("Content-Length", "" + self._content.length, false);
+      aResponse.bodyOutputStream.write(self._content, self._content.length);
+      aResponse.finish();
+    });
+  },
+
+
+  /**
+   * Handle a request made by the range resume test.  Send half of the content
+   * and hold the response open for the initial request, and the requested
+   * range for a resumed request.
+   */
+
+  _handleResumeRequest:
+    function testDownloadDevice__handleResumeRequest(aRequest, aResponse) {
+    let range = this._logRequest(aRequest);
+    aResponse.setHeader("Content-Type", "audio/mpeg", false);
+    aResponse.setHeader("ETag", "\"resume\"", false);
+    aResponse.setHeader("Accept-Ranges", "bytes", false);
+
+    // Send the requested range.
+    if (range) {
+      let offset = parseInt(range.replace(/^bytes=(\d+)-$/, "$1"));
+      let body = this._content.substr(offset);
+      aResponse.setStatusLine(aRequest.httpVersion, 206, "Partial Content");
+      aResponse.setHeader("Content-Range",
+                          "bytes " + offset + "-" +
+                          (this._content.length - 1) + "/" +
+                          this._content.length,
+                          false);
+      aResponse.setHeader("Content-Length", "" + body.length, false);
+      aResponse.bodyOutputStream.write(body, body.length);
+      return;
+    }
+
+    // Send half of the content and hold the response open.
+    let body = this._content.substr(0, this._content.length / 2);
+    aResponse.processAsync();
+    aResponse.setStatusLine(aRequest.httpVersion, 200, "OK");
+    aResponse.setHeader("Content-Length", "" + this._content.length, false);
+    aResponse.bodyOutputStream.write(body, body.length);
+    this._pendingResponse = aResponse;
+  },
+
+
+  /**
+   * Handle a request made by the entity changed tests.  Refuse conditional
+   * requests and send the full content otherwise.
+   */
+
+  _handleChangedRequest:
+    function testDownloadDevice__handleChangedRequest(aRequest, aResponse) {
+    let range = this._logRequest(aRequest);
+    let log = this._requestLog[this._requestLog.length - 1];
+
+    // The entity no longer matches the partial download.
+    if (range || log.ifMatch || log.ifUnmodifiedSince) {
+      aResponse.setStatusLine(aRequest.httpVersion, 412,
+                              "Precondition Failed");
+      return;
+    }
+
+    // Send the full content.
+    aResponse.setStatusLine(aRequest.httpVersion, 200, "OK");
+    aResponse.setHeader("Content-Type", "audio/mpeg", false);
+    aResponse.setHeader("ETag", "\"current\"", false);
+    aResponse.setHeader("Last-Modified", "Fri, 01 Jan 2010 00:00:00 GMT",
+                        false);
+    aResponse.setHeader("Content-Length", "" + this._content.length, false);
+    aResponse.bodyOutputStream.write(this._content, this._content.length);
+  },
+
+
+  /**
+   * Record the conditional request headers of the request specified by
+   * aRequest and return its range header.
+   *
+   * \param aRequest            Request to record.
+   *
+   * \return                    Range header or null if none.
+   */
+
+  _logRequest: function testDownloadDevice__logRequest(aRequest) {
+    function getHeader(aName) {
+      return aRequest.hasHeader(aName) ? aRequest.getHeader(aName) : null;
+    }
+    let log = { range: getHeader("Range"),
+                ifMatch: getHeader("If-Match"),
+                ifUnmodifiedSince: getHeader("If-Unmodified-Since") };
+    this._requestLog.push(log);
+    return log.range;
+  },
+
+
+  /**
+   * Create a media item in the main library that downloads from the URI spec
+   * specified by aSpec into the test destination directory.
+   *
+   * \param aSpec               URI spec to download.
+   *
+   * \return                    Media item.
+   */
+
+  _createItem: function testDownloadDevice__createItem(aSpec) {
+    let mediaItem = LibraryUtils.mainLibrary.createMediaItem(newURI(aSpec),
+                                                             null,
+                                                             true);
+    mediaItem.setProperty(SBProperties.destination,
+                          newFileURI(this._dstDir).spec);
+    return mediaItem;
+  },
+
+
+  /**
+   * Create a media item for the URI spec specified by aSpec and add it to the
+   * download device media list.
+   *
+   * \param aSpec               URI spec to download.
+   *
+   * \return                    Media item.
+   */
+
+  _queueDownload: function testDownloadDevice__queueDownload(aSpec) {
+    let mediaItem = this._createItem(aSpec);
+    this._device.downloadMediaList.add(mediaItem);
+    return mediaItem;
+  },
+
+
+  /**
+   * Return the content of the file downloaded for the media item specified by
+   * aMediaItem.
+   *
+   * \param aMediaItem          Downloaded media item.
+   *
+   * \return                    Downloaded content.
+   */
+
+  _readContent: function testDownloadDevice__readContent(aMediaItem) {
+    let file = aMediaItem.contentSrc.QueryInterface(Ci.nsIFileURL).file;
+    let fstream = Cc["@mozilla.org/network/file-input-stream;1"]
+                    .createInstance(Ci.nsIFileInputStream);
+    let sstream = Cc["@mozilla.org/scriptableinputstream;1"]
+                    .createInstance(Ci.nsIScriptableInputStream);
+    fstream.init(file, -1, 0, 0);
+    sstream.init(fstream);
+    let data = "";
+    let str = sstream.read(4096);
+    while (str.length > 0) {
+      data += str;
+      str = sstream.read(4096);
+    }
+    sstream.close();
+    fstream.close();
+    return data;
+  },
+
+
+  /**
+   * Write the string specified by aData to the file specified by aFile.
+   *
+   * \param aFile               File to write.
+   * \param aData               Data to write.
+   */
+
+  _writeFile: function testDownloadDevice__writeFile(aFile, aData) {
+    let ostream = Cc["@mozilla.org/network/file-output-stream;1"]
+                    .createInstance(Ci.nsIFileOutputStream);
+    ostream.init(aFile, -1, -1, 0);
+    ostream.write(aData, aData.length);
+    ostream.close();
+  },
+
+
+  //----------------------------------------------------------------------------
+  //
+  // Download device sbIDeviceBaseCallback services.
+  //
+  //----------------------------------------------------------------------------
+
+  onDeviceConnect: function testDownloadDevice_onDeviceConnect(aDeviceId) {},
+  onDeviceDisconnect:
+    function testDownloadDevice_onDeviceDisconnect(aDeviceId) {},
+  onTransferStart: function testDownloadDevice_onTransferStart(aMediaItem) {},
+  onStateChanged:
+    function testDownloadDevice_onStateChanged(aDeviceId, aState) {},
+
+  onTransferComplete:
+    function testDownloadDevice_onTransferComplete(aMediaItem, aStatus) {
+    if (this._onTransferComplete)
+      this._onTransferComplete(aMediaItem, aStatus);
+  },
+
+
+  //----------------------------------------------------------------------------
+  //
+  // Download device nsISupports services.
+  //
+  //----------------------------------------------------------------------------
+
+  QueryInterface: XPCOMUtils.generateQI([Ci.sbIDeviceBaseCallback])
+};
+
@@ -59,17 +59,21 @@ static PRLogModuleInfo* gFSTreeLog = nsnull;
 
 //------------------------------------------------------------------------------
 // Utility container, helps prevent running up the tree to find the 
-// ful path of a node.
+// ful path of a node. When walking a saved tree snapshot, |savedIndex| is
+// the index of the matching saved node.
 
 struct NodeContext
 {
-  NodeContext(const nsAString & aFullPath, sbFileSystemNode *aNode)
-    : fullPath(aFullPath), node(aNode)
+  NodeContext(const nsAString & aFullPath,
+              sbFileSystemNode *aNode,
+              PRUint32 aSavedIndex = 0)
+    : fullPath(aFullPath), node(aNode), savedIndex(aSavedIndex)
   {
   }
 
   nsString fullPath;
   nsRefPtr<sbFileSystemNode> node;
+  PRUint32 savedIndex;
 };
 
 //------------------------------------------------------------------------------
@@ -166,16 +170,25 @@ sbFileSystemTree::RunBuildThread()
   nsresult rv;
 
   // If the tree should compare itself from a previous state - load that now.
+  // Sessions are mapped into memory rather than rebuilt as nodes; only
+  // sessions saved in the older format are loaded as a node tree.
   nsRefPtr<sbFileSystemNode> savedRootNode;
+  nsAutoPtr<sbFileSystemTreeSnapshot> savedSnapshot;
   if (mShouldLoadSession) {
     nsRefPtr<sbFileSystemTreeState> savedTreeState = 
       new sbFileSystemTreeState();
     NS_ASSERTION(savedTreeState, "Could not create a sbFileSystemTreeState!");
   
-    rv = savedTreeState->LoadTreeState(mSavedSessionID,
-                                       mRootPath,
-                                       &mIsRecursiveBuild,
-                                       getter_AddRefs(savedRootNode));
+    rv = savedTreeState->LoadTreeSnapshot(mSavedSessionID,
+                                          mRootPath,
+                                          &mIsRecursiveBuild,
+                                          getter_Transfers(savedSnapshot));
+    if (rv == NS_ERROR_NOT_AVAILABLE) {
+      rv = savedTreeState->LoadTreeState(mSavedSessionID,
+                                         mRootPath,
+                                         &mIsRecursiveBuild,
+                                         getter_AddRefs(savedRootNode));
+    }
     if (NS_FAILED(rv)) {
       NS_ASSERTION(NS_SUCCEEDED(rv), "Failed to load saved tree session!");
 
@@ -232,10 +245,15 @@ sbFileSystemTree::RunBuildThread()
     NS_ASSERTION(NS_SUCCEEDED(rv), "Failed to add children to root node!");
   }
 
-  if (mShouldLoadSession && savedRootNode) {
+  if (mShouldLoadSession && (savedSnapshot || savedRootNode)) {
     // Now that the saved tree has been reloaded, and the current tree has
     // been built, build a change list.
-    rv = GetTreeChanges(savedRootNode, mSessionChanges);
+    if (savedSnapshot) {
+      rv = GetTreeChanges(savedSnapshot, mSessionChanges);
+    }
+    else {
+      rv = GetTreeChanges(savedRootNode, mSessionChanges);
+    }
     if (NS_FAILED(rv)) {
       NS_WARNING("Could not get the old session tree changes!");
     }
@@ -956,6 +974,162 @@ sbFileSystemTree::GetTreeChanges(sbFileSystemNode *aOldRootNode,
   return NS_OK;
 }
 
+nsresult
+sbFileSystemTree::GetTreeChanges(sbFileSystemTreeSnapshot *aSnapshot,
+                                 sbPathChangeArray & aOutChangeArray)
+{
+  NS_ENSURE_ARG_POINTER(aSnapshot);
+  NS_ENSURE_TRUE(aSnapshot->GetNodeCount() > 0, NS_ERROR_UNEXPECTED);
+
+  // This method is called from a background thread, prevent changes
+  // to the root node until the changes have been found.
+  nsAutoLock rootNodeLock(mRootNodeLock);
+
+  nsresult rv;
+  PRInt64 lastModify;
+  rv = mRootNode->GetLastModify(&lastModify);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (lastModify != aSnapshot->GetNode(0).lastModify) {
+    rv = AppendCreatePathChangeItem(mRootPath, eChanged, aOutChangeArray);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  // The saved children of a node are stored in the same order as the live
+  // |sbNodeMap|, so both lists can be walked side by side.
+  sbNodeMap::key_compare isLess;
+
+  sbNodeContextStack nodeContextStack;
+  nodeContextStack.push(NodeContext(mRootPath, mRootNode, 0));
+
+  while (!nodeContextStack.empty()) {
+    NodeContext curNodeContext = nodeContextStack.top();
+    nodeContextStack.pop();
+
+    const sbFileSystemTreeStateNode & savedNode =
+      aSnapshot->GetNode(curNodeContext.savedIndex);
+    PRUint32 savedNext = savedNode.firstChildIndex;
+    PRUint32 savedEnd = savedNode.firstChildIndex + savedNode.childCount;
+
+    sbNodeMap *curNodeChildren = curNodeContext.node->GetChildren();
+    sbNodeMapIter next = curNodeChildren->begin();
+    sbNodeMapIter end = curNodeChildren->end();
+
+    nsString curContextRootPath = EnsureTrailingPath(curNodeContext.fullPath);
+
+    nsString savedLeafName;
+    if (savedNext < savedEnd) {
+      aSnapshot->GetLeafName(savedNext, savedLeafName);
+    }
+
+    while (next != end || savedNext < savedEnd) {
+      if (next != end &&
+          (savedNext == savedEnd || isLess(next->first, savedLeafName)))
+      {
+        // The current child is not in the saved tree. Report this node and
+        // all of its children as added events.
+        nsString curChildPath(curContextRootPath);
+        curChildPath.Append(next->first);
+
+        sbNodeContextStack addedNodeContext;
+        addedNodeContext.push(NodeContext(curChildPath, next->second));
+        rv = CreateTreeEvents(addedNodeContext, eAdded, aOutChangeArray);
+        if (NS_FAILED(rv)) {
+          NS_WARNING("Could not report tree added events!");
+        }
+        ++next;
+        continue;
+      }
+
+      nsString curChildPath(curContextRootPath);
+      if (next == end || isLess(savedLeafName, next->first)) {
+        // The saved child is gone. Report it and all of its children as
+        // removed events.
+        curChildPath.Append(savedLeafName);
+        rv = CreateSnapshotTreeEvents(aSnapshot,
+                                      savedNext,
+                                      curChildPath,
+                                      eRemoved,
+                                      aOutChangeArray);
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
+      else {
+        // The child is in both trees, look to see if it has changed.
+        curChildPath.Append(next->first);
+
+        rv = next->second->GetLastModify(&lastModify);
+        NS_ENSURE_SUCCESS(rv, rv);
+        if (lastModify != aSnapshot->GetNode(savedNext).lastModify) {
+          rv = AppendCreatePathChangeItem(curChildPath,
+                                          eChanged,
+                                          aOutChangeArray);
+          if (NS_FAILED(rv)) {
+            NS_WARNING("could not create change item!");
+          }
+        }
+
+        nodeContextStack.push(NodeContext(curChildPath,
+                                          next->second,
+                                          savedNext));
+        ++next;
+      }
+
+      ++savedNext;
+      if (savedNext < savedEnd) {
+        aSnapshot->GetLeafName(savedNext, savedLeafName);
+      }
+    }
+  }  // end while
+
+  return NS_OK;
+}
+
+nsresult
+sbFileSystemTree::CreateSnapshotTreeEvents(sbFileSystemTreeSnapshot *aSnapshot,
+                                           PRUint32 aSavedIndex,
+                                           const nsAString & aFullPath,
+                                           EChangeType aChangeType,
+                                           sbPathChangeArray & aChangeArray)
+{
+  NS_ENSURE_ARG_POINTER(aSnapshot);
+
+  nsresult rv;
+  sbNodeContextStack contextStack;
+  contextStack.push(NodeContext(aFullPath, nsnull, aSavedIndex));
+
+  while (!contextStack.empty()) {
+    NodeContext curNodeContext = contextStack.top();
+    contextStack.pop();
+
+    rv = AppendCreatePathChangeItem(curNodeContext.fullPath,
+                                    aChangeType,
+                                    aChangeArray);
+    if (NS_FAILED(rv)) {
+      NS_WARNING("Could not create a change item!");
+      continue;
+    }
+
+    const sbFileSystemTreeStateNode & savedNode =
+      aSnapshot->GetNode(curNodeContext.savedIndex);
+    if (savedNode.childCount == 0) {
+      continue;
+    }
+
+    nsString curContextPath = EnsureTrailingPath(curNodeContext.fullPath);
+    for (PRUint32 i = 0; i < savedNode.childCount; i++) {
+      PRUint32 childIndex = savedNode.firstChildIndex + i;
+      nsString leafName;
+      aSnapshot->GetLeafName(childIndex, leafName);
+
+      nsString curChildPath(curContextPath);
+      curChildPath.Append(leafName);
+      contextStack.push(NodeContext(curChildPath, nsnull, childIndex));
+    }
+  }
+
+  return NS_OK;
+}
+
 nsresult
 sbFileSystemTree::NotifyDirAdded(sbFileSystemNode *aAddedDirNode,
                                  nsAString & aFullPath)
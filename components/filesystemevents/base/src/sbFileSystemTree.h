@@ -189,6 +189,17 @@ protected:
   //
   nsresult GetTreeChanges(sbFileSystemNode *aOldRootNode,
                           sbPathChangeArray & aOutChangeArray);
+
+  //
+  // \brief Same as above, but compares the current root node against a
+  //        saved tree snapshot without building nodes for the saved tree.
+  // \param aSnapshot The saved tree snapshot to compare against the current
+  //        root node.
+  // \param aOutChangeArray The path change array to append all found changes
+  //                        into.
+  //
+  nsresult GetTreeChanges(sbFileSystemTreeSnapshot *aSnapshot,
+                          sbPathChangeArray & aOutChangeArray);
   
   //
   // \brief Notify the tree listeners that a directory was added by informing
@@ -246,6 +257,21 @@ protected:
                             EChangeType aChangeType,
                             sbPathChangeArray & aChangeArray);
 
+  //
+  // \brief Report a node of a saved tree snapshot and all of its children
+  //        with the same change event type.
+  // \param aSnapshot The saved tree snapshot.
+  // \param aSavedIndex The index of the node in the snapshot.
+  // \param aFullPath The absolute path of the node.
+  // \param aChangeType The change type to report.
+  // \param aChangeArray The change array to append the changes onto.
+  //
+  nsresult CreateSnapshotTreeEvents(sbFileSystemTreeSnapshot *aSnapshot,
+                                    PRUint32 aSavedIndex,
+                                    const nsAString & aFullPath,
+                                    EChangeType aChangeType,
+                                    sbPathChangeArray & aChangeArray);
+
   //
   // \brief Utility method for creating and appending a change item to
   //        a change array with a given node and change type.
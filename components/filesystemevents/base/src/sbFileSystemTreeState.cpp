@@ -38,40 +38,47 @@
 #include <nsIProperties.h>
 #include <nsAppDirectoryServiceDefs.h>
 #include <nsMemory.h>
-#include <stack>
+#include <nsTArray.h>
+#include <string.h>
 
 #define TREE_FOLDER_NAME           "fstrees"
 #define SESSION_FILENAME_EXTENSION ".tree"
-#define TREE_SCHEMA_VERSION        1
+#define TREE_SCHEMA_VERSION        2
+#define TREE_LEGACY_SCHEMA_VERSION 1
+#define TREE_MAGIC                 "SBFT"
+#define TREE_BYTE_ORDER_MARK       0x01020304
+
+#define TREE_FLAG_RECURSIVE        0x1
+#define TREE_NODE_FLAG_DIRECTORY   0x1
 
 
 //
-// To serialize the tree structure, the parent/child dependency is broken
-// down and recorded with ID references to their genealogy. When the tree
-// is de-serialized, the relationship is set back up using the ID of the 
-// parent and child nodes. 
-//
-// See below for a example of the sequence of data:
+// A saved tree is a single flat block that is mapped into memory when the
+// session is restored, so that it can be compared to the current tree
+// without creating a node object for every saved file:
 //
 //   FILENAME: '{sessionid}.tree'
 //   -----------------------------------------------------------
-//   | 1.) Serialization schema version (PRUint32)             |
-//   -----------------------------------------------------------
-//   | 2.) Tree root absolute path (nsString)                  |
-//   -----------------------------------------------------------
-//   | 3.) Is tree recursive watch (PRBool)                    |
-//   -----------------------------------------------------------
-//   | 4.) Number of nodes (PRUint32)                          |
+//   | 1.) Header (sbFileSystemTreeStateHeader)                |
 //   -----------------------------------------------------------
-//   | 5.) Node (sbFileSystemNode)                             |
+//   | 2.) Node array (sbFileSystemTreeStateNode * nodeCount)  |
 //   -----------------------------------------------------------
-//   | ..  Node (sbFileSystemNode)                             |
-//   -----------------------------------------------------------
-//   | ...                                                     |
+//   | 3.) String table (UTF-8 leaf names and root path)       |
 //   -----------------------------------------------------------
 //   | -> EOF                                                  |
 //   -----------------------------------------------------------
-//  
+//
+// Nodes are written breadth first starting with the root, so the children
+// of a node are always contiguous and follow their parent. Each node refers
+// to its parent and first child by index, and to its leaf name by offset
+// into the string table. All values are in native byte order; a session
+// saved on a machine with a different byte order is rejected.
+//
+// Sessions saved with schema version 1 were written with
+// |sbFileObjectOutputStream|, one serialized |sbFileSystemNode| at a time
+// after the version, root path, recursive flag and node count. They are
+// still loaded through |LoadTreeState()|.
+//
 
 NS_IMPL_THREADSAFE_ISUPPORTS0(sbFileSystemTreeState)
 
@@ -88,104 +95,95 @@ sbFileSystemTreeState::SaveTreeState(sbFileSystemTree *aTree,
                                      const nsID & aSessionID)
 {
   NS_ENSURE_ARG_POINTER(aTree);
+  NS_ENSURE_TRUE(aTree->mRootNode, NS_ERROR_UNEXPECTED);
 
-  // Setup and write the serialized data as defined above.
+  // Flatten the tree breadth first, see the format description above.
   nsresult rv;
-  nsCOMPtr<nsIFile> savedSessionFile;
-  rv = GetTreeSessionFile(aSessionID, 
-                          PR_TRUE,  // do create
-                          getter_AddRefs(savedSessionFile));
+  nsTArray<sbFileSystemTreeStateNode> nodes;
+  nsTArray<nsRefPtr<sbFileSystemNode> > nodeQueue;
+  nsCString strings;
+
+  NS_ENSURE_TRUE(nodeQueue.AppendElement(aTree->mRootNode),
+                 NS_ERROR_OUT_OF_MEMORY);
+  sbFileSystemTreeStateNode *rootEntry = nodes.AppendElement();
+  NS_ENSURE_TRUE(rootEntry, NS_ERROR_OUT_OF_MEMORY);
+  rv = FillNodeEntry(aTree->mRootNode, 0, strings, rootEntry);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  nsRefPtr<sbFileObjectOutputStream> fileObjectStream =
-    new sbFileObjectOutputStream();
-  NS_ENSURE_TRUE(fileObjectStream, NS_ERROR_OUT_OF_MEMORY);
-
-  rv = fileObjectStream->InitWithFile(savedSessionFile);
-  NS_ENSURE_SUCCESS(rv, rv);
-
-  // Now begin to write out the data in the sequence described above:
-  // 1.) The tree schema version.
-  rv = fileObjectStream->WriteUint32(TREE_SCHEMA_VERSION);
-  NS_ENSURE_SUCCESS(rv, rv);
+  for (PRUint32 i = 0; i < nodeQueue.Length(); i++) {
+    sbNodeMap *curNodeChildren = nodeQueue[i]->GetChildren();
+    nodes[i].firstChildIndex = nodeQueue.Length();
+    nodes[i].childCount = 0;
+    if (!curNodeChildren) {
+      continue;
+    }
 
-  // 2.) Tree root absolute path
-  rv = fileObjectStream->WriteString(aTree->mRootPath);
-  NS_ENSURE_SUCCESS(rv, rv);
+    sbNodeMapIter begin = curNodeChildren->begin();
+    sbNodeMapIter end = curNodeChildren->end();
+    sbNodeMapIter next;
+    for (next = begin; next != end; ++next) {
+      if (!next->second) {
+        NS_WARNING("Could not get get curChildNode!");
+        continue;
+      }
+
+      sbFileSystemTreeStateNode *childEntry = nodes.AppendElement();
+      NS_ENSURE_TRUE(childEntry, NS_ERROR_OUT_OF_MEMORY);
+      rv = FillNodeEntry(next->second, i, strings, childEntry);
+      NS_ENSURE_SUCCESS(rv, rv);
+      NS_ENSURE_TRUE(nodeQueue.AppendElement(next->second),
+                     NS_ERROR_OUT_OF_MEMORY);
+      nodes[i].childCount++;
+    }
+  }
 
-  // 3.) Is tree recursive watch.
-  rv = fileObjectStream->WritePRBool(aTree->mIsRecursiveBuild);
+  sbFileSystemTreeStateHeader header;
+  memcpy(header.magic, TREE_MAGIC, sizeof(header.magic));
+  header.byteOrderMark = TREE_BYTE_ORDER_MARK;
+  header.schemaVersion = TREE_SCHEMA_VERSION;
+  header.flags = aTree->mIsRecursiveBuild ? TREE_FLAG_RECURSIVE : 0;
+  header.nodeCount = nodes.Length();
+  header.rootPathOffset = strings.Length();
+  strings.Append(NS_ConvertUTF16toUTF8(aTree->mRootPath));
+  header.rootPathLength = strings.Length() - header.rootPathOffset;
+  header.stringTableLength = strings.Length();
+
+  // Write out the data in the sequence described above.
+  nsCOMPtr<nsIFile> savedSessionFile;
+  rv = GetTreeSessionFile(aSessionID, 
+                          PR_TRUE,  // do create
+                          getter_AddRefs(savedSessionFile));
   NS_ENSURE_SUCCESS(rv, rv);
 
-  // 4.) Number of nodes
-  PRUint32 nodeCount = 0;
-  rv = GetTreeNodeCount(aTree->mRootNode, &nodeCount);
+  nsCOMPtr<nsILocalFile> savedSessionLocalFile =
+    do_QueryInterface(savedSessionFile, &rv);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = fileObjectStream->WriteUint32(nodeCount);
+  PRFileDesc *fileDesc;
+  rv = savedSessionLocalFile->OpenNSPRFileDesc(
+         PR_WRONLY | PR_CREATE_FILE | PR_TRUNCATE,
+         0600,
+         &fileDesc);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  // 5.) Node data
-  std::stack<nsRefPtr<sbFileSystemNode> > nodeStack;
-  nodeStack.push(aTree->mRootNode);
-
-  // Used to create a unique identifier for a parent node.
-  // NOTE: The root node will always be 0.
-  PRUint32 curNodeID = 0;
-
-  while (!nodeStack.empty()) {
-    nsRefPtr<sbFileSystemNode> curNode = nodeStack.top();
-    nodeStack.pop();
-
-    if (!curNode) {
-      NS_WARNING("Coult not get the node from the node stack!");
-      continue;
-    }
-
-    // Set the id of the current node.
-    rv = curNode->SetNodeID(curNodeID);
-    if (NS_FAILED(rv)) {
-      NS_WARNING("Could not set the node ID!");
-      continue;
-    }
-
-    rv = WriteNode(fileObjectStream, curNode);
-    if (NS_FAILED(rv)) {
-      NS_WARNING("Could not write curNode to disk!");
-      continue;
-    }
+  rv = WriteBlock(fileDesc, &header, sizeof(header));
+  if (NS_SUCCEEDED(rv)) {
+    rv = WriteBlock(fileDesc,
+                    nodes.Elements(),
+                    nodes.Length() * sizeof(sbFileSystemTreeStateNode));
+  }
+  if (NS_SUCCEEDED(rv)) {
+    rv = WriteBlock(fileDesc, strings.BeginReading(), strings.Length());
+  }
 
-    sbNodeMap *curNodeChildren = curNode->GetChildren();
-    if (curNodeChildren && curNodeChildren->size() > 0) {
-      // Iterate through the entire child node map to set the parent ID 
-      // and push each node into the node stack.
-      sbNodeMapIter begin = curNodeChildren->begin();
-      sbNodeMapIter end = curNodeChildren->end();
-      sbNodeMapIter next;
-      for (next = begin; next != end; ++next) {
-        nsRefPtr<sbFileSystemNode> curChildNode(next->second);
-        if (!curChildNode) {
-          NS_WARNING("Could not get get curChildNode!");
-          continue;
-        }
-
-        rv = curChildNode->SetParentID(curNodeID);
-        if (NS_FAILED(rv)) {
-          NS_WARNING("Could not set the parent GUID!");
-          continue;
-        }
-
-        nodeStack.push(curChildNode);
-      } 
-    }
+  PR_Close(fileDesc);
 
-    // Bump the node ID count.
-    ++curNodeID;
+  if (NS_FAILED(rv)) {
+    // Don't leave a partial session behind.
+    savedSessionFile->Remove(PR_FALSE);
+    return rv;
   }
 
-  rv = fileObjectStream->Close();
-  NS_ENSURE_SUCCESS(rv, rv);
-
   return NS_OK;
 }
 
@@ -227,7 +225,7 @@ sbFileSystemTreeState::LoadTreeState(nsID & aSessionID,
 
   // For now, just ensure that the schema version is the same.
   // In the future, a migration handler will need to be written.
-  if (schemaVersion != TREE_SCHEMA_VERSION) {
+  if (schemaVersion != TREE_LEGACY_SCHEMA_VERSION) {
     return NS_ERROR_FAILURE;
   }
 
@@ -283,6 +281,46 @@ sbFileSystemTreeState::LoadTreeState(nsID & aSessionID,
   return NS_OK;
 }
 
+nsresult
+sbFileSystemTreeState::LoadTreeSnapshot(nsID & aSessionID,
+                                        nsString & aSessionAbsolutePath,
+                                        PRBool *aIsRecursiveWatch,
+                                        sbFileSystemTreeSnapshot **aOutSnapshot)
+{
+  NS_ENSURE_ARG_POINTER(aIsRecursiveWatch);
+  NS_ENSURE_ARG_POINTER(aOutSnapshot);
+
+  nsresult rv;
+  nsCOMPtr<nsIFile> savedSessionFile;
+  rv = GetTreeSessionFile(aSessionID,
+                          PR_FALSE,  // don't create
+                          getter_AddRefs(savedSessionFile));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Ensure that the session file exists.
+  PRBool exists = PR_FALSE;
+  if (NS_FAILED(savedSessionFile->Exists(&exists)) || !exists) {
+    NS_WARNING("The saved session file no longer exists!");
+    return NS_ERROR_UNEXPECTED;
+  }
+
+  nsAutoPtr<sbFileSystemTreeSnapshot> snapshot =
+    new sbFileSystemTreeSnapshot();
+  NS_ENSURE_TRUE(snapshot, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = snapshot->Init(savedSessionFile);
+  if (rv == NS_ERROR_NOT_AVAILABLE) {
+    return rv;
+  }
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  snapshot->GetRootPath(aSessionAbsolutePath);
+  *aIsRecursiveWatch = snapshot->GetIsRecursiveWatch();
+
+  *aOutSnapshot = snapshot.forget();
+  return NS_OK;
+}
+
 /* static */ nsresult
 sbFileSystemTreeState::DeleteSavedTreeState(const nsID & aSessionID)
 {
@@ -300,21 +338,6 @@ sbFileSystemTreeState::DeleteSavedTreeState(const nsID & aSessionID)
   return NS_OK;
 }
 
-nsresult
-sbFileSystemTreeState::WriteNode(sbFileObjectOutputStream *aOutputStream,
-                                 sbFileSystemNode *aOutNode)
-{
-  NS_ENSURE_ARG_POINTER(aOutputStream);
-  NS_ENSURE_ARG_POINTER(aOutNode);
-
-  nsresult rv;
-  nsCOMPtr<nsISupports> writeSupports =
-    do_QueryInterface(NS_ISUPPORTS_CAST(nsISerializable *, aOutNode), &rv);
-  NS_ENSURE_SUCCESS(rv, rv);
-
-  return aOutputStream->WriteObject(writeSupports, PR_TRUE);
-}
-
 nsresult
 sbFileSystemTreeState::ReadNode(sbFileObjectInputStream *aInputStream,
                                 sbFileSystemNode **aOutNode)
@@ -364,6 +387,57 @@ sbFileSystemTreeState::AssignRelationships(sbFileSystemNode *aChildNode,
   return NS_OK;
 }
 
+/* static */ nsresult
+sbFileSystemTreeState::FillNodeEntry(sbFileSystemNode *aNode,
+                                     PRUint32 aParentIndex,
+                                     nsACString & aStringTable,
+                                     sbFileSystemTreeStateNode *aOutEntry)
+{
+  NS_ENSURE_ARG_POINTER(aNode);
+  NS_ENSURE_ARG_POINTER(aOutEntry);
+
+  nsresult rv;
+  nsString leafName;
+  rv = aNode->GetLeafName(leafName);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool isDir;
+  rv = aNode->GetIsDir(&isDir);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = aNode->GetLastModify(&aOutEntry->lastModify);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  aOutEntry->parentIndex = aParentIndex;
+  aOutEntry->firstChildIndex = 0;
+  aOutEntry->childCount = 0;
+  aOutEntry->leafNameOffset = aStringTable.Length();
+  aStringTable.Append(NS_ConvertUTF16toUTF8(leafName));
+  aOutEntry->leafNameLength =
+    aStringTable.Length() - aOutEntry->leafNameOffset;
+  aOutEntry->flags = isDir ? TREE_NODE_FLAG_DIRECTORY : 0;
+
+  return NS_OK;
+}
+
+/* static */ nsresult
+sbFileSystemTreeState::WriteBlock(PRFileDesc *aFileDesc,
+                                  const void *aData,
+                                  PRUint32 aLength)
+{
+  NS_ENSURE_ARG_POINTER(aFileDesc);
+
+  const char *data = static_cast<const char *>(aData);
+  while (aLength > 0) {
+    PRInt32 written = PR_Write(aFileDesc, data, aLength);
+    NS_ENSURE_TRUE(written > 0, NS_ERROR_FAILURE);
+    data += written;
+    aLength -= written;
+  }
+
+  return NS_OK;
+}
+
 /* static */ nsresult
 sbFileSystemTreeState::GetTreeSessionFile(const nsID & aSessionID,
                                           PRBool aShouldCreate,
@@ -421,40 +495,138 @@ sbFileSystemTreeState::GetTreeSessionFile(const nsID & aSessionID,
   return NS_OK;
 }
 
+//------------------------------------------------------------------------------
+// sbFileSystemTreeSnapshot
+
+sbFileSystemTreeSnapshot::sbFileSystemTreeSnapshot()
+  : mFileDesc(nsnull)
+  , mFileMap(nsnull)
+  , mData(nsnull)
+  , mDataLength(0)
+  , mHeader(nsnull)
+  , mNodes(nsnull)
+  , mStrings(nsnull)
+{
+}
+
+sbFileSystemTreeSnapshot::~sbFileSystemTreeSnapshot()
+{
+  if (mData) {
+    PR_MemUnmap(mData, mDataLength);
+  }
+  if (mFileMap) {
+    PR_CloseFileMap(mFileMap);
+  }
+  if (mFileDesc) {
+    PR_Close(mFileDesc);
+  }
+}
+
 nsresult
-sbFileSystemTreeState::GetTreeNodeCount(sbFileSystemNode *aRootNode,
-                                        PRUint32 *aNodeCount)
+sbFileSystemTreeSnapshot::Init(nsIFile *aSessionFile)
 {
-  NS_ENSURE_ARG_POINTER(aRootNode);
-  NS_ENSURE_ARG_POINTER(aNodeCount);
+  NS_ENSURE_ARG_POINTER(aSessionFile);
+  NS_ENSURE_TRUE(!mData, NS_ERROR_ALREADY_INITIALIZED);
 
-  PRUint32 nodeCount = 0;
+  nsresult rv;
+  PRInt64 fileSize;
+  rv = aSessionFile->GetFileSize(&fileSize);
+  NS_ENSURE_SUCCESS(rv, rv);
 
-  std::stack<nsRefPtr<sbFileSystemNode> > nodeStack;
-  nodeStack.push(aRootNode);
+  // Sessions saved in the older format start with a big endian schema
+  // version rather than the magic string.
+  if (fileSize < (PRInt64)sizeof(sbFileSystemTreeStateHeader)) {
+    return fileSize >= 4 ? NS_ERROR_NOT_AVAILABLE : NS_ERROR_FILE_CORRUPTED;
+  }
+  NS_ENSURE_TRUE(fileSize <= PR_UINT32_MAX, NS_ERROR_FILE_TOO_BIG);
 
-  while (!nodeStack.empty()) {
-    nsRefPtr<sbFileSystemNode> curNode = nodeStack.top();
-    nodeStack.pop();
+  nsCOMPtr<nsILocalFile> sessionLocalFile =
+    do_QueryInterface(aSessionFile, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
 
-    // Increment the node count.
-    nodeCount++;
+  rv = sessionLocalFile->OpenNSPRFileDesc(PR_RDONLY, 0, &mFileDesc);
+  NS_ENSURE_SUCCESS(rv, rv);
 
-    sbNodeMap *childMap = curNode->GetChildren();
-    if (!childMap || childMap->size() == 0) {
-      continue;
-    }
-    
-    // Push all children into the stack to count.
-    sbNodeMapIter begin = childMap->begin();
-    sbNodeMapIter end = childMap->end();
-    sbNodeMapIter next;
-    for (next = begin; next != end; ++next) {
-      nodeStack.push(next->second);
-    }
+  mFileMap = PR_CreateFileMap(mFileDesc, fileSize, PR_PROT_READONLY);
+  NS_ENSURE_TRUE(mFileMap, NS_ERROR_FAILURE);
+
+  mDataLength = (PRUint32)fileSize;
+  mData = PR_MemMap(mFileMap, 0, mDataLength);
+  NS_ENSURE_TRUE(mData, NS_ERROR_FAILURE);
+
+  mHeader = static_cast<const sbFileSystemTreeStateHeader *>(mData);
+  if (memcmp(mHeader->magic, TREE_MAGIC, sizeof(mHeader->magic)) != 0) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+  NS_ENSURE_TRUE(mHeader->byteOrderMark == TREE_BYTE_ORDER_MARK,
+                 NS_ERROR_FILE_CORRUPTED);
+  NS_ENSURE_TRUE(mHeader->schemaVersion == TREE_SCHEMA_VERSION,
+                 NS_ERROR_FAILURE);
+
+  // Validate the layout up front so that lookups don't have to.
+  PRUint64 nodesLength =
+    (PRUint64)mHeader->nodeCount * sizeof(sbFileSystemTreeStateNode);
+  PRUint64 expectedLength = sizeof(sbFileSystemTreeStateHeader) +
+                            nodesLength +
+                            mHeader->stringTableLength;
+  NS_ENSURE_TRUE(mHeader->nodeCount > 0 && expectedLength == mDataLength,
+                 NS_ERROR_FILE_CORRUPTED);
+  NS_ENSURE_TRUE((PRUint64)mHeader->rootPathOffset + mHeader->rootPathLength <=
+                   mHeader->stringTableLength,
+                 NS_ERROR_FILE_CORRUPTED);
+
+  const char *data = static_cast<const char *>(mData);
+  mNodes = reinterpret_cast<const sbFileSystemTreeStateNode *>(
+             data + sizeof(sbFileSystemTreeStateHeader));
+  mStrings = data + sizeof(sbFileSystemTreeStateHeader) + nodesLength;
+
+  for (PRUint32 i = 0; i < mHeader->nodeCount; i++) {
+    const sbFileSystemTreeStateNode & node = mNodes[i];
+    // Children always follow their parent, which rules out cycles.
+    PRBool valid =
+      (PRUint64)node.leafNameOffset + node.leafNameLength <=
+        mHeader->stringTableLength &&
+      (node.childCount == 0 ||
+       (node.firstChildIndex > i &&
+        (PRUint64)node.firstChildIndex + node.childCount <=
+          mHeader->nodeCount));
+    NS_ENSURE_TRUE(valid, NS_ERROR_FILE_CORRUPTED);
   }
 
-  *aNodeCount = nodeCount;
   return NS_OK;
 }
 
+PRUint32
+sbFileSystemTreeSnapshot::GetNodeCount() const
+{
+  return mHeader ? mHeader->nodeCount : 0;
+}
+
+const sbFileSystemTreeStateNode &
+sbFileSystemTreeSnapshot::GetNode(PRUint32 aIndex) const
+{
+  NS_ASSERTION(aIndex < GetNodeCount(), "Snapshot node index out of range!");
+  return mNodes[aIndex];
+}
+
+void
+sbFileSystemTreeSnapshot::GetLeafName(PRUint32 aIndex,
+                                      nsAString & aLeafName) const
+{
+  const sbFileSystemTreeStateNode & node = GetNode(aIndex);
+  aLeafName.Assign(NS_ConvertUTF8toUTF16(mStrings + node.leafNameOffset,
+                                         node.leafNameLength));
+}
+
+void
+sbFileSystemTreeSnapshot::GetRootPath(nsAString & aRootPath) const
+{
+  aRootPath.Assign(NS_ConvertUTF8toUTF16(mStrings + mHeader->rootPathOffset,
+                                         mHeader->rootPathLength));
+}
+
+PRBool
+sbFileSystemTreeSnapshot::GetIsRecursiveWatch() const
+{
+  return (mHeader->flags & TREE_FLAG_RECURSIVE) != 0;
+}
@@ -33,6 +33,7 @@
 #include <nsIFile.h>
 #include <nsIUUIDGenerator.h>
 #include <nsStringAPI.h>
+#include <prio.h>
 
 class sbFileSystemNode;
 class sbFileSystemTree;
@@ -42,6 +43,89 @@ typedef sbNodeIDMap::value_type sbNodeIDMapPair;
 typedef sbNodeIDMap::const_iterator sbNodeIDMapIter;
 
 
+//------------------------------------------------------------------------------
+// On-disk layout of a saved tree session. See sbFileSystemTreeState.cpp for
+// a description of the file format.
+//------------------------------------------------------------------------------
+struct sbFileSystemTreeStateHeader
+{
+  char     magic[4];
+  PRUint32 byteOrderMark;
+  PRUint32 schemaVersion;
+  PRUint32 flags;
+  PRUint32 nodeCount;
+  PRUint32 stringTableLength;
+  PRUint32 rootPathOffset;
+  PRUint32 rootPathLength;
+};
+
+struct sbFileSystemTreeStateNode
+{
+  PRInt64  lastModify;
+  PRUint32 parentIndex;
+  PRUint32 firstChildIndex;
+  PRUint32 childCount;
+  PRUint32 leafNameOffset;
+  PRUint32 leafNameLength;
+  PRUint32 flags;
+};
+
+
+//------------------------------------------------------------------------------
+// A read-only view of a saved tree session, mapped into memory. Nodes are
+// stored breadth first, so the children of each node are contiguous, and in
+// the same order as the node's |sbNodeMap|.
+//------------------------------------------------------------------------------
+class sbFileSystemTreeSnapshot
+{
+public:
+  sbFileSystemTreeSnapshot();
+  ~sbFileSystemTreeSnapshot();
+
+  //
+  // \brief Map a saved session file. Returns NS_ERROR_NOT_AVAILABLE if the
+  //        file was saved in the older, stream based format.
+  // \param aSessionFile The saved session file.
+  //
+  nsresult Init(nsIFile *aSessionFile);
+
+  //
+  // \brief Get the number of nodes in the snapshot. The root node always has
+  //        the index 0.
+  //
+  PRUint32 GetNodeCount() const;
+
+  //
+  // \brief Get the node at a given index.
+  //
+  const sbFileSystemTreeStateNode & GetNode(PRUint32 aIndex) const;
+
+  //
+  // \brief Get the leaf name of the node at a given index.
+  //
+  void GetLeafName(PRUint32 aIndex, nsAString & aLeafName) const;
+
+  //
+  // \brief Get the absolute path of the root of the saved tree.
+  //
+  void GetRootPath(nsAString & aRootPath) const;
+
+  //
+  // \brief Get whether the saved tree was a recursive watch.
+  //
+  PRBool GetIsRecursiveWatch() const;
+
+private:
+  PRFileDesc                      *mFileDesc;
+  PRFileMap                       *mFileMap;
+  void                            *mData;
+  PRUint32                        mDataLength;
+  const sbFileSystemTreeStateHeader *mHeader;
+  const sbFileSystemTreeStateNode *mNodes;
+  const char                      *mStrings;
+};
+
+
 class sbFileSystemTreeState : public nsISupports
 {
 public:
@@ -53,17 +137,28 @@ public:
   nsresult SaveTreeState(sbFileSystemTree *aFileSystemTree,
                          const nsID & aSessionID);
 
+  //
+  // \brief Load a session saved in the older, stream based format into a
+  //        tree of nodes.
+  //
   nsresult LoadTreeState(nsID & aSessionID,
                          nsString & aSessionAbsolutePath,
                          PRBool *aIsRecursiveWatch,
                          sbFileSystemNode **aOutRootNode);
 
+  //
+  // \brief Map a saved session into memory without building its nodes.
+  //        Returns NS_ERROR_NOT_AVAILABLE if the session was saved in the
+  //        older format, in which case |LoadTreeState()| should be used.
+  //
+  nsresult LoadTreeSnapshot(nsID & aSessionID,
+                            nsString & aSessionAbsolutePath,
+                            PRBool *aIsRecursiveWatch,
+                            sbFileSystemTreeSnapshot **aOutSnapshot);
+
   static nsresult DeleteSavedTreeState(const nsID & aSessionID);
 
 protected:
-  nsresult WriteNode(sbFileObjectOutputStream *aOutputStream,
-                     sbFileSystemNode *aOutNode);
-  
   nsresult ReadNode(sbFileObjectInputStream *aInputStream,
                     sbFileSystemNode **aOutNode);
 
@@ -74,8 +169,14 @@ protected:
                                      PRBool aShouldCreate,
                                      nsIFile **aOutFile);
 
-  nsresult GetTreeNodeCount(sbFileSystemNode *aRootNode,
-                            PRUint32 *aNodeCount);
+  static nsresult FillNodeEntry(sbFileSystemNode *aNode,
+                                PRUint32 aParentIndex,
+                                nsACString & aStringTable,
+                                sbFileSystemTreeStateNode *aOutEntry);
+
+  static nsresult WriteBlock(PRFileDesc *aFileDesc,
+                             const void *aData,
+                             PRUint32 aLength);
 
 private:
   nsCOMPtr<nsIUUIDGenerator> mUuidGen;
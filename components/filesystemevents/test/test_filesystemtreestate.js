@@ -0,0 +1,361 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+Components.utils.import("resource://gre/modules/XPCOMUtils.jsm");
+
+//
+// \brief Test saving a watched tree in the flat session format, and finding
+//        the changes made while the watcher was stopped by comparing the
+//        live tree against the saved one. Names include non-ASCII characters
+//        to check that they survive the UTF-8 string table.
+//
+
+const STATE_SAVE    = "SAVE";
+const STATE_CHANGES = "CHANGES";
+const STATE_RESAVE  = "RESAVE";
+const STATE_NO_CHANGES = "NO CHANGES";
+
+// Non-ASCII names, avoiding characters that file systems may store decomposed
+const UNICODE_DIR = "Stra\u00DFe \u65E5\u672C\u8A9E";
+const CHANGED_FILE = "\u0438\u0437\u043C\u0435\u043D\u0435\u043D.mp3";
+const NEW_FILE = "\u043D\u043E\u0432\u044B\u0439 \u6587\u4EF6.mp3";
+const ADDED_DIR = "added \u03A9 dir";
+const REMOVED_SUBDIR = "sub \u00DF";
+
+const TREE_MAGIC = "SBFT";
+const TREE_BYTE_ORDER_MARK = 0x01020304;
+const TREE_SCHEMA_VERSION = 2;
+
+function runTest()
+{
+  // If the file-system watcher is not supported on this system, just return.
+  var fsWatcher = Cc["@songbirdnest.com/filesystem/watcher;1"]
+                    .createInstance(Ci.sbIFileSystemWatcher);
+  if (!fsWatcher.isSupported) {
+    return;
+  }
+
+  var watchDir = Cc["@mozilla.org/file/directory_service;1"]
+                   .getService(Ci.nsIProperties)
+                   .get("ProfD", Ci.nsIFile);
+  watchDir.normalize();
+  watchDir.append("tree_state_dir");
+  if (watchDir.exists()) {
+    watchDir.remove(true);
+  }
+  watchDir.create(Ci.nsIFile.DIRECTORY_TYPE, 0777);
+
+  var listener = new sbTreeStateListener(watchDir, fsWatcher);
+  listener.startTest();
+  testPending();
+}
+
+function getFile(aDir, aPath)
+{
+  var file = aDir.clone();
+  for each (var leafName in aPath) {
+    file.append(leafName);
+  }
+  return file;
+}
+
+function createFile(aDir, aPath)
+{
+  var file = getFile(aDir, aPath);
+  file.create(Ci.nsIFile.NORMAL_FILE_TYPE, 0644);
+  return file;
+}
+
+//
+// \brief Check that a saved session is in the flat format.
+//
+function checkSessionFile(aSessionGuid)
+{
+  var sessionFile = Cc["@mozilla.org/file/directory_service;1"]
+                      .getService(Ci.nsIProperties)
+                      .get("PrefD", Ci.nsIFile);
+  sessionFile.append("fstrees");
+  sessionFile.append(aSessionGuid + ".tree");
+  assertTrue(sessionFile.exists(), "session file was not saved");
+
+  var fileStream = Cc["@mozilla.org/network/file-input-stream;1"]
+                     .createInstance(Ci.nsIFileInputStream);
+  fileStream.init(sessionFile, -1, 0, 0);
+  var stream = Cc["@mozilla.org/binaryinputstream;1"]
+                 .createInstance(Ci.nsIBinaryInputStream);
+  stream.setInputStream(fileStream);
+
+  assertEqual(stream.readBytes(4), TREE_MAGIC);
+
+  // The header is written in native byte order, which the byte order mark
+  // tells; read32 reads big endian.
+  var byteOrderMark = stream.read32();
+  var schemaVersion = stream.read32();
+  if (byteOrderMark != TREE_BYTE_ORDER_MARK) {
+    assertEqual(byteOrderMark, 0x04030201);
+    schemaVersion = ((schemaVersion & 0xFF) << 24 |
+                     (schemaVersion & 0xFF00) << 8 |
+                     (schemaVersion >>> 8) & 0xFF00 |
+                     schemaVersion >>> 24) >>> 0;
+  }
+  assertEqual(schemaVersion, TREE_SCHEMA_VERSION);
+
+  stream.close();
+}
+
+function sbTreeStateListener(aWatchDir, aFSWatcher)
+{
+  this._watchDir = aWatchDir;
+  this._fsWatcher = aFSWatcher;
+  this._added = {};
+  this._removed = {};
+  this._changed = {};
+}
+
+sbTreeStateListener.prototype =
+{
+  _state:          "",
+  _sessionGuid:    null,
+  _timer:          null,
+  _changedFile:    null,
+  _unicodeDir:     null,
+
+  _log: function(aMessage)
+  {
+    dump("----------------------------------------------------------\n");
+    dump(" " + aMessage + "\n");
+    dump("----------------------------------------------------------\n");
+  },
+
+  _cleanup: function()
+  {
+    this._fsWatcher.deleteSession(this._sessionGuid);
+    this._fsWatcher = null;
+    this._watchDir.remove(true);
+    this._watchDir = null;
+    this._timer = null;
+    testFinished();
+  },
+
+  _restart: function()
+  {
+    this._added = {};
+    this._removed = {};
+    this._changed = {};
+    this._timer.initWithCallback(this,
+                                 1000,
+                                 Ci.nsITimerCallback.TYPE_ONE_SHOT);
+  },
+
+  _path: function(aPath)
+  {
+    return getFile(this._watchDir, aPath).path;
+  },
+
+  startTest: function()
+  {
+    this._timer = Cc["@mozilla.org/timer;1"].createInstance(Ci.nsITimer);
+
+    // Build a tree of a few levels, with non-ASCII file and directory names.
+    var dir = this._watchDir;
+    createFile(dir, ["unchanged.txt"]);
+    createFile(dir, ["zzz last.mp3"]);
+    this._unicodeDir = getFile(dir, [UNICODE_DIR]);
+    this._unicodeDir.create(Ci.nsIFile.DIRECTORY_TYPE, 0755);
+    this._changedFile = createFile(this._unicodeDir, [CHANGED_FILE]);
+    createFile(this._unicodeDir, ["kept.mp3"]);
+    var removedDir = getFile(dir, ["removed dir"]);
+    removedDir.create(Ci.nsIFile.DIRECTORY_TYPE, 0755);
+    createFile(removedDir, ["a.mp3"]);
+    getFile(removedDir, [REMOVED_SUBDIR]).create(Ci.nsIFile.DIRECTORY_TYPE,
+                                                 0755);
+    createFile(removedDir, [REMOVED_SUBDIR, "b.mp3"]);
+
+    this._state = STATE_SAVE;
+    this._log(this._state + ": Starting");
+    this._fsWatcher.init(this, this._watchDir.path, true);
+    this._fsWatcher.startWatching();
+  },
+
+  _makeChanges: function()
+  {
+    var dir = this._watchDir;
+
+    // Added: a file in an existing directory, and a directory with a child
+    createFile(this._unicodeDir, [NEW_FILE]);
+    var addedDir = getFile(dir, [ADDED_DIR]);
+    addedDir.create(Ci.nsIFile.DIRECTORY_TYPE, 0755);
+    createFile(addedDir, ["x.mp3"]);
+
+    // Removed: a directory and everything in it
+    getFile(dir, ["removed dir"]).remove(true);
+
+    // Changed: a file with a non-ASCII name
+    var stream = Cc["@mozilla.org/network/file-output-stream;1"]
+                   .createInstance(Ci.nsIFileOutputStream);
+    stream.init(this._changedFile, -1, -1, 0);
+    var junk = "garbage garbage garbage";
+    stream.write(junk, junk.length);
+    stream.close();
+    this._changedFile.lastModifiedTime =
+      this._changedFile.lastModifiedTime - 100000;
+  },
+
+  _checkChanges: function()
+  {
+    var expectedAdded = [
+      [UNICODE_DIR, NEW_FILE],
+      [ADDED_DIR],
+      [ADDED_DIR, "x.mp3"]
+    ];
+    var expectedRemoved = [
+      ["removed dir"],
+      ["removed dir", "a.mp3"],
+      ["removed dir", REMOVED_SUBDIR],
+      ["removed dir", REMOVED_SUBDIR, "b.mp3"]
+    ];
+
+    var self = this;
+    function checkSet(aName, aActual, aExpected) {
+      var count = 0;
+      for (var path in aActual) {
+        ++count;
+      }
+      assertEqual(count, aExpected.length,
+                  "wrong number of " + aName + " events");
+      for each (var path in aExpected) {
+        assertTrue(self._path(path) in aActual,
+                   "missing " + aName + " event for " + self._path(path));
+      }
+    }
+    checkSet("added", this._added, expectedAdded);
+    checkSet("removed", this._removed, expectedRemoved);
+
+    // Directories may also be reported as changed, depending on the
+    // resolution of the file system's modification times.
+    assertTrue(this._changedFile.path in this._changed,
+               "missing changed event for " + this._changedFile.path);
+    var allowedChanged = [this._watchDir.path,
+                          this._unicodeDir.path,
+                          this._changedFile.path];
+    for (var path in this._changed) {
+      assertTrue(allowedChanged.indexOf(path) >= 0,
+                 "unexpected changed event for " + path);
+    }
+  },
+
+  _checkNoChanges: function()
+  {
+    for each (var events in [this._added, this._removed, this._changed]) {
+      for (var path in events) {
+        doFail("unexpected event for " + path);
+      }
+    }
+  },
+
+  // sbIFileSystemListener
+  onWatcherStarted: function()
+  {
+    this._log(this._state + ": Watcher has started");
+    switch (this._state) {
+      case STATE_SAVE:
+        this._sessionGuid = this._fsWatcher.sessionGuid;
+        this._fsWatcher.stopWatching(true);
+        break;
+
+      case STATE_CHANGES:
+        // Changes found between sessions are reported before
+        // |onWatcherStarted()|.
+        this._checkChanges();
+        this._state = STATE_RESAVE;
+        this._fsWatcher.stopWatching(true);
+        break;
+
+      case STATE_NO_CHANGES:
+        this._checkNoChanges();
+        this._fsWatcher.stopWatching(false);
+        this._cleanup();
+        break;
+    }
+  },
+
+  onWatcherStopped: function()
+  {
+    this._log(this._state + ": Watcher has stopped");
+    switch (this._state) {
+      case STATE_SAVE:
+        checkSessionFile(this._sessionGuid);
+        this._makeChanges();
+        this._state = STATE_CHANGES;
+        this._restart();
+        break;
+
+      case STATE_RESAVE:
+        // The session restored from the flat format is saved in it again,
+        // and nothing has changed since.
+        checkSessionFile(this._sessionGuid);
+        this._state = STATE_NO_CHANGES;
+        this._restart();
+        break;
+    }
+  },
+
+  onWatcherError: function(aErrorType, aDescription)
+  {
+    doFail("ERROR: watcher error " + aErrorType + ": " + aDescription);
+  },
+
+  onFileSystemChanged: function(aFilePath)
+  {
+    this._log("CHANGED: " + aFilePath);
+    this._changed[aFilePath] = true;
+  },
+
+  onFileSystemRemoved: function(aFilePath)
+  {
+    this._log("REMOVED: " + aFilePath);
+    this._removed[aFilePath] = true;
+  },
+
+  onFileSystemAdded: function(aFilePath)
+  {
+    this._log("ADDED: " + aFilePath);
+    this._added[aFilePath] = true;
+  },
+
+  // nsITimerCallback
+  notify: function(aTimer)
+  {
+    this._log(this._state + ": Restarting with session " + this._sessionGuid);
+    this._fsWatcher = Cc["@songbirdnest.com/filesystem/watcher;1"]
+                        .createInstance(Ci.sbIFileSystemWatcher);
+    this._fsWatcher.initWithSession(this._sessionGuid, this);
+    this._fsWatcher.startWatching();
+  },
+
+  QueryInterface:
+    XPCOMUtils.generateQI([Ci.sbIFileSystemListener, Ci.nsITimerCallback])
+};
@@ -128,7 +128,7 @@ insert into media_list_types (type, factory_contractid) values ('simple', '@song
 /*  XXXAus: !!!WARNING!!! When changing this value, you _MUST_ update         */
 /*  sbLocalDatabaseMigrationHelper._latestSchemaVersion.                      */
 /**************************************************************************** */
-insert into library_metadata (name, value) values ('version', '29');
+insert into library_metadata (name, value) values ('version', '30');
 
 /**************************************************************************** */
 /*  XXXkreeger: !! WARNING !! When changing this schema, the |ANALYZE| data   */
@@ -0,0 +1,78 @@
+#!/usr/bin/ruby
+
+#
+# Description:
+#  Compare two JSON perf reports written by the local database perf tests
+#  (SB_PERF_REPORT, see run.sh), typically from two different builds.
+#  Prints the median and 90th percentile of every test present in both
+#  reports, the change between them, and flags tests that got slower by
+#  more than the threshold.
+#
+# Usage:
+#  ./compare-dbperf-reports.rb baseline.json candidate.json [threshold%]
+#
+# Exits with status 1 if any test regressed.
+#
+
+require 'rubygems'
+require 'json'
+
+if ARGV.length < 2
+  $stderr.puts "Usage: #{$0} baseline.json candidate.json [threshold%]"
+  exit 2
+end
+
+threshold = (ARGV[2] || 10).to_f
+
+# Collect the reports keyed by test name and library size. If a test was
+# run several times keep the run with the lowest median.
+def load_report(path)
+  results = {}
+  File.open(path).each do |line|
+    next if line.strip.empty?
+    report = JSON.parse(line)
+    key = "#{report['test']} (#{report['size']} items)"
+    if !results[key] or report['p50'] < results[key]['p50']
+      results[key] = report
+    end
+  end
+  results
+end
+
+baseline = load_report(ARGV[0])
+candidate = load_report(ARGV[1])
+
+def change(before, after)
+  return 0.0 if before.to_f == 0
+  (after.to_f - before.to_f) * 100.0 / before.to_f
+end
+
+regressed = false
+printf("%-50s %10s %10s %8s %10s %10s %8s %12s\n",
+       "test", "p50 base", "p50 new", "change",
+       "p90 base", "p90 new", "change", "mem change")
+
+(baseline.keys & candidate.keys).sort.each do |key|
+  b = baseline[key]
+  c = candidate[key]
+  p50 = change(b['p50'], c['p50'])
+  p90 = change(b['p90'], c['p90'])
+  mem = (b['memoryHighWater'] and c['memoryHighWater']) ?
+        sprintf("%+.1f%%", change(b['memoryHighWater'], c['memoryHighWater'])) :
+        "n/a"
+
+  flag = ""
+  if p50 > threshold
+    flag = "  REGRESSION"
+    regressed = true
+  end
+
+  printf("%-50s %10d %10d %+7.1f%% %10d %10d %+7.1f%% %12s%s\n",
+         key, b['p50'], c['p50'], p50, b['p90'], c['p90'], p90, mem, flag)
+end
+
+(baseline.keys - candidate.keys).sort.each do |key|
+  puts "#{key}: missing from #{ARGV[1]}"
+end
+
+exit(regressed ? 1 : 0)
@@ -37,41 +37,220 @@ var localeCollationPreviouslyEnabled = dbe.localeCollationEnabled;
 dbe.localeCollationEnabled = true;
 
 
+/**
+ * Run a perf test once. See runPerfBenchmark.
+ */
 function runPerfTest(aName, aTestFunc) {
+  runPerfBenchmark(aName, aTestFunc, 1);
+}
+
+/**
+ * \brief Time aTestFunc(library, timer) over several iterations and report
+ *        the results.
+ *
+ * The test function starts and stops the timer around the part it wants
+ * measured. The number of iterations defaults to SB_PERF_ITERATIONS, or 5.
+ *
+ * Results go to the files named by these environment variables:
+ *   SB_PERF_RESULTS  one tab separated line per test with the median time,
+ *                    for make-dbperf-spreadsheet.rb.
+ *   SB_PERF_REPORT   one JSON object per test with every sample, the
+ *                    percentiles and the memory high water mark, for
+ *                    compare-dbperf-reports.rb.
+ * The test is skipped if neither is set.
+ */
+function runPerfBenchmark(aName, aTestFunc, aIterations) {
 
   var environment = Cc["@mozilla.org/process/environment;1"]
                       .getService(Ci.nsIEnvironment);
-  var resultFile =  environment.get("SB_PERF_RESULTS");
-  if (!resultFile) {
-    log("DBPERF: " + aName + " ignored, since SB_PERF_RESULTS is not set.");
+  var resultFile = environment.get("SB_PERF_RESULTS");
+  var reportFile = environment.get("SB_PERF_REPORT");
+  if (!resultFile && !reportFile) {
+    log("DBPERF: " + aName + " ignored, since neither SB_PERF_RESULTS nor " +
+        "SB_PERF_REPORT is set.");
     return;
   }
 
+  var iterations = aIterations ||
+                   parseInt(environment.get("SB_PERF_ITERATIONS")) || 5;
+
   var library = getLibrary();
-  var timer = new Timer();
-  aTestFunc.apply(this, [library, timer]);
+  var memory = new MemoryHighWater();
+  var samples = [];
+  for (var i = 0; i < iterations; i++) {
+    var timer = new Timer();
+    aTestFunc.apply(this, [library, timer]);
+    samples.push(timer.elapsed());
+    memory.sample();
+  }
+
+  var sorted = samples.slice().sort(function(a, b) { return a - b; });
+  var median = percentile(sorted, 50);
 
   log("DBPERF: " + aName + " " + library.databaseGuid + " " +
-      library.length + " " + timer.elapsed() + "ms");
+      library.length + " " + median + "ms");
+
+  if (resultFile) {
+    appendToFile(resultFile,
+                 aName + "\t" + library.databaseGuid + "\t" +
+                 library.length + "\t" + median + "\n");
+  }
 
-  var outputFile = Cc["@mozilla.org/file/local;1"]
-                     .createInstance(Ci.nsILocalFile);
-  outputFile.initWithPath(resultFile);
+  if (reportFile) {
+    var appInfo = Cc["@mozilla.org/xre/app-info;1"]
+                    .getService(Ci.nsIXULAppInfo);
+    var total = 0;
+    for (var i = 0; i < samples.length; i++) {
+      total += samples[i];
+    }
+
+    var report = {
+      test: aName,
+      build: environment.get("SB_PERF_BUILD") || appInfo.appBuildID,
+      library: library.databaseGuid,
+      size: library.length,
+      iterations: iterations,
+      samples: samples,
+      min: sorted[0],
+      max: sorted[sorted.length - 1],
+      mean: total / samples.length,
+      p50: median,
+      p90: percentile(sorted, 90),
+      p95: percentile(sorted, 95),
+      p99: percentile(sorted, 99),
+      memoryHighWater: memory.highWater,
+      memorySource: memory.source
+    };
+    appendToFile(reportFile, JSON.stringify(report) + "\n");
+  }
+}
+
+/**
+ * Nearest rank percentile of an ascending array.
+ */
+function percentile(aSorted, aPercent) {
+  var rank = Math.ceil(aPercent / 100 * aSorted.length);
+  return aSorted[Math.max(0, rank - 1)];
+}
+
+function appendToFile(aPath, aString) {
+  var file = Cc["@mozilla.org/file/local;1"]
+               .createInstance(Ci.nsILocalFile);
+  file.initWithPath(aPath);
 
   var fos = Cc["@mozilla.org/network/file-output-stream;1"]
               .createInstance(Ci.nsIFileOutputStream);
-  var s = aName + "\t" + library.databaseGuid + "\t" +
-          library.length + "\t" + timer.elapsed() + "\n";
   // Open writeonly, createfile, append, with rw permissions for everyone
-  fos.init(outputFile, 0x02 | 0x08 | 0x10, 0666, 0);
-  fos.write(s, s.length);
+  fos.init(file, 0x02 | 0x08 | 0x10, 0666, 0);
+  fos.write(aString, aString.length);
   fos.close();
 }
 
+/**
+ * Tracks the memory high water mark of the process. On Linux the kernel
+ * keeps the peak resident size for us; elsewhere the memory reporters are
+ * sampled after every iteration and the largest value is kept.
+ */
+function MemoryHighWater() {
+  this.highWater = null;
+  this.source = null;
+}
+
+MemoryHighWater.prototype = {
+  sample: function() {
+    var value = this._readProcStatus();
+    if (value != null) {
+      this.source = "VmHWM";
+    }
+    else {
+      value = this._readReporters();
+      if (value != null) {
+        this.source = "malloc/mapped";
+      }
+    }
+
+    if (value != null && (this.highWater == null || value > this.highWater)) {
+      this.highWater = value;
+    }
+  },
+
+  _readProcStatus: function() {
+    var file = Cc["@mozilla.org/file/local;1"]
+                 .createInstance(Ci.nsILocalFile);
+    try {
+      file.initWithPath("/proc/self/status");
+      if (!file.exists()) {
+        return null;
+      }
+    }
+    catch (e) {
+      return null;
+    }
+
+    var fstream = Cc["@mozilla.org/network/file-input-stream;1"]
+                    .createInstance(Ci.nsIFileInputStream);
+    var sstream = Cc["@mozilla.org/scriptableinputstream;1"]
+                    .createInstance(Ci.nsIScriptableInputStream);
+    fstream.init(file, -1, 0, 0);
+    sstream.init(fstream);
+
+    // procfs files report a size of zero, so read until the end
+    var data = "";
+    var str = sstream.read(4096);
+    while (str.length > 0) {
+      data += str;
+      str = sstream.read(4096);
+    }
+    sstream.close();
+    fstream.close();
+
+    var match = /VmHWM:\s+(\d+) kB/.exec(data);
+    return match ? parseInt(match[1]) * 1024 : null;
+  },
+
+  _readReporters: function() {
+    if (!("nsIMemoryReporterManager" in Ci)) {
+      return null;
+    }
+
+    var manager = Cc["@mozilla.org/memory-reporter-manager;1"]
+                    .getService(Ci.nsIMemoryReporterManager);
+    var reporters = manager.enumerateReporters();
+    while (reporters.hasMoreElements()) {
+      var reporter = reporters.getNext()
+                              .QueryInterface(Ci.nsIMemoryReporter);
+      if (reporter.path == "malloc/mapped") {
+        return reporter.memoryUsed;
+      }
+    }
+    return null;
+  }
+}
+
+/**
+ * Library to run the perf tests against:
+ *   SB_PERF_LIBRARY   path of an existing library database, or
+ *   SB_PERF_GENERATE  size of a synthetic library to generate (or reuse),
+ *                     with SB_PERF_SEED as the seed (default 1), or
+ *   the main library if neither is set.
+ */
+var gPerfLibrary = null;
+
 function getLibrary() {
+  if (gPerfLibrary) {
+    return gPerfLibrary;
+  }
+
   var environment = Cc["@mozilla.org/process/environment;1"]
                       .getService(Ci.nsIEnvironment);
 
+  if (environment.exists("SB_PERF_GENERATE")) {
+    var size = parseInt(environment.get("SB_PERF_GENERATE"));
+    var seed = parseInt(environment.get("SB_PERF_SEED")) || 1;
+    gPerfLibrary = generatePerfLibrary(size, seed);
+    return gPerfLibrary;
+  }
+
   var libraryFile;
   if (!environment.exists("SB_PERF_LIBRARY")) {
     // If no library specified, just use the main library.
@@ -91,7 +270,8 @@ function getLibrary() {
   var hashBag = Cc["@mozilla.org/hash-property-bag;1"].
                 createInstance(Ci.nsIWritablePropertyBag2);
   hashBag.setPropertyAsInterface("databaseFile", file);
-  return libraryFactory.createLibrary(hashBag);
+  gPerfLibrary = libraryFactory.createLibrary(hashBag);
+  return gPerfLibrary;
 }
 
 function Timer() {
@@ -0,0 +1,430 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+ * \brief Deterministic synthetic library generator for the local database
+ *        perf tests.
+ *
+ * The same size and seed always produce the same library: the same items,
+ * in the same order, with the same properties, playlists and smart lists.
+ * Property values follow the long tail seen in real collections; a few
+ * artists own most of the tracks, most items have never been played or
+ * rated, and so on.
+ *
+ * Bump PERF_GENERATOR_VERSION whenever the output changes so that stale
+ * generated libraries are not reused.
+ */
+
+var PERF_GENERATOR_VERSION = 1;
+
+// Items are created in batches of this size
+var PERF_GENERATOR_BATCH = 1000;
+
+// All time stamps are relative to this date (2009-01-01 UTC) instead of
+// the current time, so generated libraries do not depend on when they
+// were built.
+var PERF_GENERATOR_EPOCH = 1230768000000;
+
+var PERF_WORDS = [
+  "love", "night", "heart", "dream", "fire", "blue", "rain", "light",
+  "road", "time", "world", "sun", "dance", "home", "angel", "river",
+  "summer", "shadow", "girl", "city", "moon", "gold", "wild", "black",
+  "star", "ocean", "storm", "silver", "ghost", "paper", "glass", "stone",
+  "winter", "electric", "broken", "sweet", "lonely", "golden", "secret",
+  "midnight", "crazy", "little", "young", "lost", "velvet", "burning",
+  "morning", "highway", "echo", "thunder", "mirror", "garden", "rebel",
+  "sugar", "radio", "diamond", "candle", "machine", "empire", "island",
+  "whisper", "tiger", "desert", "kingdom"
+];
+
+// A handful of words with non-ASCII characters so collation is exercised
+var PERF_ACCENTED_WORDS = [
+  "café", "señor", "über", "naïve", "déjà", "façade", "jalapeño", "Ærø"
+];
+
+// Genres with their relative weights
+var PERF_GENRES = [
+  ["Rock", 22], ["Pop", 18], ["Alternative", 10], ["Hip-Hop", 8],
+  ["Electronic", 8], ["Jazz", 6], ["Classical", 6], ["Country", 5],
+  ["R&B", 5], ["Metal", 4], ["Folk", 3], ["Blues", 2], ["Reggae", 2],
+  ["Soundtrack", 1]
+];
+
+var PERF_BITRATES = [128, 160, 192, 224, 256, 320];
+
+/**
+ * Park-Miller minimal standard generator. Exact in double arithmetic, so
+ * the sequence is the same on every platform.
+ */
+function PerfRandom(aSeed) {
+  this._state = (aSeed % 2147483646) + 1;
+}
+
+PerfRandom.prototype = {
+  // Uniform in [0, 1)
+  next: function() {
+    this._state = (this._state * 16807) % 2147483647;
+    return (this._state - 1) / 2147483646;
+  },
+
+  // Uniform integer in [0, aMax)
+  nextInt: function(aMax) {
+    return Math.floor(this.next() * aMax);
+  },
+
+  // Integer in [0, aMax) where low values are much more likely; the
+  // probability of rank r falls off roughly as 1/r, like artist
+  // popularity in real collections.
+  nextRank: function(aMax) {
+    return Math.min(aMax - 1,
+                    Math.floor(Math.exp(this.next() * Math.log(aMax + 1))) - 1);
+  },
+
+  // Number of failures before the first success
+  nextGeometric: function(aSuccess) {
+    return Math.floor(Math.log(1 - this.next()) / Math.log(1 - aSuccess));
+  },
+
+  // Pick from an array of [value, weight] pairs
+  nextWeighted: function(aChoices) {
+    var total = 0;
+    for (var i = 0; i < aChoices.length; i++) {
+      total += aChoices[i][1];
+    }
+    var target = this.next() * total;
+    for (var i = 0; i < aChoices.length; i++) {
+      target -= aChoices[i][1];
+      if (target < 0) {
+        return aChoices[i][0];
+      }
+    }
+    return aChoices[aChoices.length - 1][0];
+  }
+};
+
+/**
+ * Build a unique, stable name for the given index out of the word list.
+ */
+function perfName(aIndex) {
+  var name = PERF_WORDS[aIndex % PERF_WORDS.length];
+  var rest = Math.floor(aIndex / PERF_WORDS.length);
+  while (rest > 0) {
+    name += " " + PERF_WORDS[rest % PERF_WORDS.length];
+    rest = Math.floor(rest / PERF_WORDS.length);
+  }
+  return name.charAt(0).toUpperCase() + name.substr(1);
+}
+
+/**
+ * Name of the artist with the given popularity rank. Rank 0 is the artist
+ * with the most tracks.
+ */
+function perfArtistName(aRank) {
+  var name = perfName(aRank + 1);
+  if (aRank % 7 == 3) {
+    name = "The " + name;
+  }
+  if (aRank % 11 == 5) {
+    name += " " + PERF_ACCENTED_WORDS[aRank % PERF_ACCENTED_WORDS.length];
+  }
+  return name;
+}
+
+/**
+ * Genre of the artist with the given rank. Each artist sticks to a single
+ * genre, which keeps the genre/artist cascade realistic.
+ */
+function perfArtistGenre(aRank) {
+  var random = new PerfRandom(aRank * 7919 + 17);
+  return random.nextWeighted(PERF_GENRES);
+}
+
+/**
+ * \brief Produces the items of a synthetic library, album by album.
+ * \param aSize   Number of items to produce.
+ * \param aSeed   Seed; different seeds give different libraries.
+ * \param aPrefix Prefix for the content URLs, so that several generated
+ *                sets can live in one library.
+ */
+function PerfItemGenerator(aSize, aSeed, aPrefix) {
+  Components.utils.import("resource://app/jsmodules/sbProperties.jsm");
+
+  this._size = aSize;
+  this._random = new PerfRandom(aSeed);
+  this._prefix = aPrefix || "file:///perf/";
+  this._artistCount = Math.max(10, Math.round(aSize / 40));
+  this._albumCounts = {};
+  this._count = 0;
+  this._album = null;
+}
+
+PerfItemGenerator.prototype = {
+  hasMore: function() {
+    return this._count < this._size;
+  },
+
+  /**
+   * Return the next item as { uri: nsIURI, properties: sbIPropertyArray }.
+   */
+  next: function() {
+    if (!this._album || this._album.track > this._album.trackCount) {
+      this._album = this._nextAlbum();
+    }
+
+    var random = this._random;
+    var album = this._album;
+    var properties = SBProperties.createArray();
+
+    var trackWords = 1 + random.nextInt(4);
+    var trackName = perfName(random.nextInt(PERF_WORDS.length * 64));
+    while (--trackWords > 0) {
+      trackName += " " + PERF_WORDS[random.nextInt(PERF_WORDS.length)];
+    }
+
+    // 2 to 7 minutes, clustered around 4
+    var seconds = 120 + Math.floor((random.next() + random.next() +
+                                    random.next()) * 100);
+    var bitRate = PERF_BITRATES[random.nextInt(PERF_BITRATES.length)];
+
+    properties.appendProperty(SBProperties.trackName, trackName);
+    properties.appendProperty(SBProperties.artistName, album.artist);
+    properties.appendProperty(SBProperties.albumArtistName, album.artist);
+    properties.appendProperty(SBProperties.albumName, album.name);
+    properties.appendProperty(SBProperties.genre, album.genre);
+    properties.appendProperty(SBProperties.year, album.year);
+    properties.appendProperty(SBProperties.trackNumber, album.track);
+    properties.appendProperty(SBProperties.discNumber, album.disc);
+    properties.appendProperty(SBProperties.duration, seconds * 1000000);
+    properties.appendProperty(SBProperties.bitRate, bitRate);
+    properties.appendProperty(SBProperties.sampleRate,
+                              random.nextInt(10) == 0 ? 48000 : 44100);
+    properties.appendProperty(SBProperties.contentLength,
+                              seconds * bitRate * 125);
+
+    // Most of a collection has never been played or rated
+    if (random.nextInt(10) >= 4) {
+      var playCount = 1 + random.nextGeometric(0.2);
+      var lastPlayed = PERF_GENERATOR_EPOCH -
+                       random.nextInt(730) * 86400000 -
+                       random.nextInt(86400000);
+      properties.appendProperty(SBProperties.playCount, playCount);
+      properties.appendProperty(SBProperties.lastPlayTime, lastPlayed);
+    }
+    if (random.nextInt(100) < 15) {
+      properties.appendProperty(SBProperties.rating, 1 + random.nextInt(5));
+    }
+
+    var uri = newURI(this._prefix + album.artistRank + "/" + album.index +
+                     "/" + album.disc + "-" + album.track + ".mp3");
+
+    if (album.disc == 1 && album.discs == 2 &&
+        album.track == Math.ceil(album.trackCount / 2)) {
+      album.disc = 2;
+    }
+    album.track++;
+    this._count++;
+
+    return { uri: uri, properties: properties };
+  },
+
+  _nextAlbum: function() {
+    var random = this._random;
+    var rank = random.nextRank(this._artistCount);
+    var index = this._albumCounts[rank] || 0;
+    this._albumCounts[rank] = index + 1;
+
+    var name = perfName(random.nextInt(PERF_WORDS.length * PERF_WORDS.length));
+    if (random.nextInt(20) == 0) {
+      name = "Greatest Hits";
+    }
+    else if (random.nextInt(30) == 0) {
+      name += " (Live)";
+    }
+
+    return {
+      artistRank: rank,
+      artist: perfArtistName(rank),
+      genre: perfArtistGenre(rank),
+      index: index,
+      name: name,
+      // Skewed towards recent years
+      year: 1960 + Math.floor(49 * Math.sqrt(random.next())),
+      trackCount: 8 + random.nextInt(9),
+      track: 1,
+      discs: random.nextInt(10) == 0 ? 2 : 1,
+      disc: 1
+    };
+  }
+};
+
+/**
+ * \brief Add aCount items from the generator to the library.
+ * \return An array with a sample of up to aSampleSize of the created items,
+ *         chosen uniformly (reservoir sampling) but deterministically.
+ */
+function addPerfItems(aLibrary, aGenerator, aCount, aSampleSize) {
+  var random = new PerfRandom(aCount);
+  var sample = [];
+  var seen = 0;
+
+  while (aCount > 0 && aGenerator.hasMore()) {
+    var uris = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+                 .createInstance(Ci.nsIMutableArray);
+    var properties = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+                       .createInstance(Ci.nsIMutableArray);
+
+    var batch = Math.min(aCount, PERF_GENERATOR_BATCH);
+    for (var i = 0; i < batch && aGenerator.hasMore(); i++) {
+      var item = aGenerator.next();
+      uris.appendElement(item.uri, false);
+      properties.appendElement(item.properties, false);
+    }
+    aCount -= uris.length;
+
+    var created = aLibrary.batchCreateMediaItems(uris, properties, true);
+    if (aSampleSize) {
+      for (var i = 0; i < created.length; i++, seen++) {
+        if (sample.length < aSampleSize) {
+          sample.push(created.queryElementAt(i, Ci.sbIMediaItem));
+        }
+        else {
+          var slot = random.nextInt(seen + 1);
+          if (slot < aSampleSize) {
+            sample[slot] = created.queryElementAt(i, Ci.sbIMediaItem);
+          }
+        }
+      }
+    }
+  }
+
+  return sample;
+}
+
+/**
+ * \brief Open (or create) the library <aName>.db in the profile db folder.
+ */
+function openPerfLibrary(aName) {
+  var file = Cc["@mozilla.org/file/directory_service;1"]
+               .getService(Ci.nsIProperties)
+               .get("ProfD", Ci.nsIFile);
+  file.append("db");
+  file.append(aName + ".db");
+
+  var libraryFactory =
+    Cc["@songbirdnest.com/Songbird/Library/LocalDatabase/LibraryFactory;1"]
+      .getService(Ci.sbILibraryFactory);
+  var hashBag = Cc["@mozilla.org/hash-property-bag;1"]
+                  .createInstance(Ci.nsIWritablePropertyBag2);
+  hashBag.setPropertyAsInterface("databaseFile", file);
+  return libraryFactory.createLibrary(hashBag);
+}
+
+/**
+ * \brief Open the generated library of the given size and seed, creating it
+ *        first if needed.
+ *
+ * Libraries are kept in the profile as perf_v<version>_<size>_<seed>.db and
+ * reused by later runs.
+ */
+function generatePerfLibrary(aSize, aSeed) {
+  var library = openPerfLibrary("perf_v" + PERF_GENERATOR_VERSION + "_" +
+                                aSize + "_" + aSeed);
+
+  if (library.length >= aSize) {
+    return library;
+  }
+
+  log("DBPERF: generating library of " + aSize + " items, seed " + aSeed);
+  library.clear();
+
+  var random = new PerfRandom(aSeed + 1);
+  var generator = new PerfItemGenerator(aSize, aSeed);
+
+  // Real users have a few dozen playlists, a few of them large
+  var playlistCount = Math.max(5, Math.min(100, Math.round(aSize / 1000)));
+  var maxPlaylistLength = Math.max(50, Math.min(5000, Math.round(aSize / 10)));
+  var pool;
+
+  library.runInBatchMode(function() {
+    pool = addPerfItems(library, generator, aSize, 20000);
+  });
+
+  for (var i = 0; i < playlistCount && pool.length > 0; i++) {
+    var list = library.createMediaList("simple");
+    list.name = "Playlist " + perfName(i);
+
+    var items = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+                  .createInstance(Ci.nsIMutableArray);
+    var length = 10 + random.nextRank(maxPlaylistLength);
+    for (var j = 0; j < length; j++) {
+      items.appendElement(pool[random.nextInt(pool.length)], false);
+    }
+    list.addSome(items.enumerate());
+  }
+
+  addPerfSmartList(library, "Most Played", [
+    [SBProperties.playCount, ">", "10"]
+  ]);
+  addPerfSmartList(library, "Top Rated", [
+    [SBProperties.rating, ">=", "4"]
+  ]);
+  addPerfSmartList(library, "Rock Before 1990", [
+    [SBProperties.genre, "=", "Rock"],
+    [SBProperties.year, "<", "1990"]
+  ]);
+  addPerfSmartList(library, "Love Songs", [
+    [SBProperties.trackName, "%?%", "love"]
+  ]);
+
+  return library;
+}
+
+/**
+ * \brief Create a smart list matching all of the given
+ *        [property, operator, value] conditions.
+ */
+function addPerfSmartList(aLibrary, aName, aConditions) {
+  var propertyManager =
+    Cc["@songbirdnest.com/Songbird/Properties/PropertyManager;1"]
+      .getService(Ci.sbIPropertyManager);
+
+  var list = aLibrary.createMediaList("smart");
+  list.name = aName;
+  list.QueryInterface(Ci.sbILocalDatabaseSmartMediaList);
+  list.matchType = Ci.sbILocalDatabaseSmartMediaList.MATCH_TYPE_ALL;
+
+  for (var i = 0; i < aConditions.length; i++) {
+    var property = aConditions[i][0];
+    var info = propertyManager.getPropertyInfo(property);
+    list.appendCondition(property,
+                         info.getOperator(aConditions[i][1]),
+                         aConditions[i][2],
+                         null,
+                         "unit");
+  }
+  list.rebuild();
+  return list;
+}
@@ -3,24 +3,33 @@
 # Note: this file is for personal testing only, and is not used 
 # in the automated perf testing environment
 #
-LIBRARY_DIR="D:\\Media\SongbirdTestLibraries\\"
-RESULTS_FILE="D:\\Media\\SongbirdTestLibraries\\dbperf_results.txt"
-
-LIBRARY_FILES="test_standard_trunk.db"
-PERF_TESTS="guidarray guidarray_multisort guidarray_distinct guidarray_default_view guidarray_library_enumerate guidarray_search guidarray_search_distinct guidarray_filtering propertycache"
+# Runs the perf tests against generated libraries of each size in
+# LIBRARY_SIZES. Generated libraries are deterministic for a given size and
+# seed and are kept in the profile, so only the first run pays for creating
+# them. Set SB_PERF_LIBRARY instead to run against an existing library.
+#
+# Results are appended to RESULTS_FILE (tab separated, one line per test,
+# see make-dbperf-spreadsheet.rb) and REPORT_FILE (JSON, one object per
+# test, see compare-dbperf-reports.rb).
+#
+LIBRARY_SIZES=${LIBRARY_SIZES:-"10000 100000 1000000"}
+LIBRARY_SEED=${LIBRARY_SEED:-1}
+RESULTS_FILE=${RESULTS_FILE:-`pwd`/dbperf_results.txt}
+REPORT_FILE=${REPORT_FILE:-`pwd`/dbperf_report.json}
+ITERATIONS=${ITERATIONS:-5}
 
-#PERF_TESTS="guidarray"
+PERF_TESTS="benchmark guidarray guidarray_multisort guidarray_distinct guidarray_default_view guidarray_library_enumerate guidarray_search guidarray_search_distinct guidarray_filtering propertycache"
 
-# Stupid mac compatibility
-#alias seq=gseq
+#PERF_TESTS="benchmark"
 
-for library_file in $LIBRARY_FILES; do
+for library_size in $LIBRARY_SIZES; do
   for perf_test in $PERF_TESTS; do
-    for i in `seq 1 3`; do
-      echo $LIBRARY_DIR$library_file
-      export SB_PERF_LIBRARY=$LIBRARY_DIR$library_file
-      export SB_PERF_RESULTS=$RESULTS_FILE
-      ./songbird -test localdatabaselibraryperf:$perf_test
-    done;
+    echo "$perf_test: $library_size items, seed $LIBRARY_SEED"
+    export SB_PERF_GENERATE=$library_size
+    export SB_PERF_SEED=$LIBRARY_SEED
+    export SB_PERF_ITERATIONS=$ITERATIONS
+    export SB_PERF_RESULTS=$RESULTS_FILE
+    export SB_PERF_REPORT=$REPORT_FILE
+    ./songbird -test localdatabaselibraryperf:$perf_test
   done;
 done
@@ -0,0 +1,167 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+ * \brief Benchmark scenarios for the local database library. Run against a
+ *        generated library (SB_PERF_GENERATE) so the results can be
+ *        compared across builds.
+ */
+
+function runTest () {
+  Components.utils.import("resource://app/jsmodules/sbProperties.jsm");
+
+  runPerfBenchmark("benchmark guidarray sort", perfGuidArraySort);
+  runPerfBenchmark("benchmark guidarray multisort", perfGuidArrayMultiSort);
+  runPerfBenchmark("benchmark cascade filter", perfCascadeFilter);
+  runPerfBenchmark("benchmark search", perfSearch);
+  runPerfBenchmark("benchmark propertycache", perfPropertyCache);
+  runPerfBenchmark("benchmark batch create", perfBatchCreate);
+}
+
+function touchArray(aArray) {
+  aArray.getGuidByIndex(0);
+  aArray.getGuidByIndex(Math.floor(aArray.length / 2));
+  aArray.getGuidByIndex(aArray.length - 1);
+}
+
+function perfGuidArraySort(library, timer) {
+  var array = newGuidArray(library);
+  array.addSort(SBProperties.artistName, true);
+
+  timer.start();
+  touchArray(array);
+  timer.stop();
+}
+
+function perfGuidArrayMultiSort(library, timer) {
+  var array = newGuidArray(library);
+  array.addSort(SBProperties.artistName, true);
+  array.addSort(SBProperties.albumName, true);
+  array.addSort(SBProperties.trackNumber, true);
+
+  timer.start();
+  touchArray(array);
+  timer.stop();
+}
+
+/**
+ * Walk the default genre / artist / album cascade down to the most popular
+ * artist, reading the value counts the filter panes would show.
+ */
+function perfCascadeFilter(library, timer) {
+  var view = library.createView();
+  var cfs = view.cascadeFilterSet;
+  cfs.appendSearch(["*"], 1);
+  cfs.appendFilter(SBProperties.genre, false);
+  cfs.appendFilter(SBProperties.artistName, false);
+  cfs.appendFilter(SBProperties.albumName, false);
+
+  timer.start();
+
+  cfs.getValueCount(1, false);
+  cfs.set(1, [perfArtistGenre(0)], 1);
+  cfs.getValueCount(2, false);
+  cfs.set(2, [perfArtistName(0)], 1);
+  cfs.getValueCount(3, false);
+  view.length;
+
+  timer.stop();
+
+  cfs.clearAll();
+}
+
+function perfSearch(library, timer) {
+  var view = library.createView();
+  var cfs = view.cascadeFilterSet;
+  cfs.appendSearch(["*"], 1);
+
+  timer.start();
+
+  // A common word, a rarer word and a two word search
+  for each (var terms in [["love"], ["kingdom"], ["night", "fire"]]) {
+    cfs.set(0, terms, terms.length);
+    var length = view.length;
+    if (length > 0) {
+      view.getItemByIndex(length - 1);
+    }
+  }
+
+  timer.stop();
+
+  cfs.clearAll();
+}
+
+function perfPropertyCache(library, timer) {
+  var array = newGuidArray(library);
+  array.addSort(SBProperties.created, true);
+  array.fetchSize = 0;
+
+  var length = Math.min(array.length, 10000);
+  var guids = [];
+  for (var i = 0; i < length; i++) {
+    guids.push(array.getGuidByIndex(i));
+  }
+
+  var cache = library.QueryInterface(Ci.sbILocalDatabaseLibrary).propertyCache;
+
+  timer.start();
+
+  for (var i = 0; i < guids.length; i += 200) {
+    var chunk = guids.slice(i, i + 200);
+    var bagCount = {};
+    cache.getProperties(chunk, chunk.length, bagCount);
+  }
+
+  timer.stop();
+}
+
+/**
+ * Create 1000 new items in a scratch library. Every iteration uses the
+ * same items, so the library is cleared first.
+ */
+var gBatchCreateLibrary = null;
+
+function perfBatchCreate(library, timer) {
+  if (!gBatchCreateLibrary) {
+    gBatchCreateLibrary = openPerfLibrary("perf_batchcreate");
+  }
+  gBatchCreateLibrary.clear();
+
+  var generator = new PerfItemGenerator(1000, 1, "file:///perf-batch/");
+  var uris = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+               .createInstance(Ci.nsIMutableArray);
+  var properties = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+                     .createInstance(Ci.nsIMutableArray);
+  while (generator.hasMore()) {
+    var item = generator.next();
+    uris.appendElement(item.uri, false);
+    properties.appendElement(item.properties, false);
+  }
+
+  timer.start();
+  gBatchCreateLibrary.batchCreateMediaItems(uris, properties, true);
+  timer.stop();
+}
@@ -0,0 +1,207 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2011 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+const Cc = Components.classes;
+const Ci = Components.interfaces;
+const Cr = Components.results;
+const Cu = Components.utils;
+
+Cu.import("resource://gre/modules/XPCOMUtils.jsm");
+Cu.import("resource://app/jsmodules/sbLocalDatabaseMigrationUtils.jsm");
+Cu.import("resource://app/jsmodules/SBJobUtils.jsm");
+Cu.import("resource://app/jsmodules/GeneratorThread.jsm");
+
+const FROM_VERSION = 29;
+const TO_VERSION = 30;
+
+/* These must match SB_ORDINAL_SPACING and SB_ORDINAL_MAX in
+ * sbLocalDatabaseSimpleMediaList.cpp */
+const ORDINAL_SPACING = 65536;
+const ORDINAL_MAX = 2147483646;
+
+function LOG(s) {
+  dump("----++++----++++sbLibraryMigration " +
+       FROM_VERSION + " to " + TO_VERSION + ": " +
+       s +
+       "\n----++++----++++\n");
+}
+
+function sbLibraryMigration()
+{
+  SBLocalDatabaseMigrationUtils.BaseMigrationHandler.call(this);
+  this._errors = [];
+
+  this._progress = 0;
+  this._total = 0;
+}
+
+//-----------------------------------------------------------------------------
+// sbLocalDatabaseMigration Implementation
+//-----------------------------------------------------------------------------
+
+sbLibraryMigration.prototype = {
+  __proto__: SBLocalDatabaseMigrationUtils.BaseMigrationHandler.prototype,
+  classDescription: 'Songbird Migration Handler, version ' +
+                     FROM_VERSION + ' to ' + TO_VERSION,
+  classID: Components.ID("{6557d16c-8a77-4f8b-8413-7a26c8b55069}"),
+  contractID: SBLocalDatabaseMigrationUtils.baseHandlerContractID +
+              FROM_VERSION + 'to' + TO_VERSION,
+
+  fromVersion: FROM_VERSION,
+  toVersion: TO_VERSION,
+
+  /* Lets tests run processItems without the progress dialog */
+  get wrappedJSObject() {
+    return this;
+  },
+
+  migrate: function sbLibraryMigration_migrate(aLibrary) {
+
+    this._library = aLibrary;
+
+    var sip = Cc["@mozilla.org/supports-interface-pointer;1"]
+                .createInstance(Ci.nsISupportsInterfacePointer);
+    sip.data = this;
+
+    this._thread = new GeneratorThread(this.processItems());
+    this._thread.maxPctCPU = 95;
+    this._thread.period = 50;
+    this._thread.start();
+
+    // Show the progress dialog tethered to this job
+    SBJobUtils.showProgressDialog(sip.data, null, 0);
+  },
+
+  /* Older versions gave inserted and moved items nested ordinals like
+   * "12.0.3", which grow with every insert at the same spot.  Renumber every
+   * simple media list, keeping its order, to flat ordinals ORDINAL_SPACING
+   * apart so that later inserts can take the midpoint of a gap instead. */
+  processItems: function sbLibraryMigration_processItems() {
+    try {
+      this._titleText = "Library Migration Helper";
+      this._statusText = "Renumbering playlists...";
+      yield this.checkIfShouldUpdateAndYield();
+
+      // The ordinal column collates as a tree, so this is list order
+      var selectQuery = Cc["@songbirdnest.com/Songbird/DatabaseQuery;1"]
+                          .createInstance(Ci.sbIDatabaseQuery);
+      selectQuery.databaseLocation = this._library.databaseLocation;
+      selectQuery.setDatabaseGUID(this._library.databaseGuid);
+      selectQuery.addQuery("SELECT media_item_id, member_media_item_id " +
+                           "FROM simple_media_lists " +
+                           "ORDER BY media_item_id, ordinal");
+      var retval;
+      selectQuery.execute(retval);
+
+      var resultSet = selectQuery.getResultObject();
+      var rowCount = resultSet.getRowCount();
+      this._total = rowCount;
+
+      /* Count the items of each list first so that very long lists can be
+       * given closer ordinals that still fit */
+      var listLengths = {};
+      for (let currentRow = 0; currentRow < rowCount; currentRow++) {
+        let listId = resultSet.getRowCell(currentRow, 0);
+        listLengths[listId] = (listLengths[listId] || 0) + 1;
+      }
+
+      /* Replace the rows rather than update them; renumbering in place could
+       * collide with the unique ordinal index half way through a list */
+      var updateQuery = this.createMigrationQuery(this._library);
+      updateQuery.addQuery("DELETE FROM simple_media_lists");
+
+      var preparedInsertStatement = updateQuery.prepareQuery
+          ("INSERT INTO simple_media_lists " +
+           "(media_item_id, member_media_item_id, ordinal) VALUES (?, ?, ?)");
+
+      var currentList = null;
+      var spacing = ORDINAL_SPACING;
+      var ordinal = 0;
+      for (let currentRow = 0; currentRow < rowCount; currentRow++) {
+        yield this.checkIfShouldUpdateAndYield();
+
+        let listId = resultSet.getRowCell(currentRow, 0);
+        let memberId = resultSet.getRowCell(currentRow, 1);
+
+        if (listId != currentList) {
+          currentList = listId;
+          spacing = Math.min(ORDINAL_SPACING,
+                             Math.floor(ORDINAL_MAX / listLengths[listId]));
+          ordinal = 0;
+        }
+
+        updateQuery.addPreparedStatement(preparedInsertStatement);
+        updateQuery.bindInt32Parameter(0, listId);
+        updateQuery.bindInt32Parameter(1, memberId);
+        updateQuery.bindStringParameter(2, String(ordinal));
+        ordinal += spacing;
+
+        this._progress++;
+      }
+
+      updateQuery.addQuery("ANALYZE simple_media_lists");
+      updateQuery.addQuery("COMMIT");
+      updateQuery.execute(retval);
+
+      this._status = Ci.sbIJobProgress.STATUS_SUCCEEDED;
+      this.notifyJobProgressListeners();
+    }
+    catch (e) {
+      dump("Exception occured: " + e);
+      throw e;
+    }
+  },
+
+  /* This utility method checks if it is time to yield, and if it is, we
+   * notify the dialog so that it will pick up the updated progress
+   * and then we yield so the dialog can update itself. */
+  checkIfShouldUpdateAndYield: function
+    sbLibraryMigration_checkIfShouldUpdateAndYield() {
+    if (GeneratorThread.shouldYield()) {
+      this.notifyJobProgressListeners();
+      yield;
+    }
+  },
+
+ /* We override these methods to report the current state in the
+  * progress dialog. */
+  get status() {
+    return this._status;
+  },
+  get progress() {
+    return this._progress;
+  },
+  get total() {
+    return this._total;
+  },
+};
+
+//-----------------------------------------------------------------------------
+// Module
+//-----------------------------------------------------------------------------
+function NSGetModule(compMgr, fileSpec) {
+  return XPCOMUtils.generateModule([
+    sbLibraryMigration
+  ]);
+}
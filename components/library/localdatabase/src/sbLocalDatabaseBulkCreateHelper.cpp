@@ -0,0 +1,987 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#include "sbLocalDatabaseBulkCreateHelper.h"
+
+#include <nsArrayUtils.h>
+#include <nsComponentManagerUtils.h>
+#include <nsDataHashtable.h>
+#include <nsHashKeys.h>
+#include <nsID.h>
+#include <nsIIOService.h>
+#include <nsIMutableArray.h>
+#include <nsIURI.h>
+#include <nsIUUIDGenerator.h>
+#include <nsNetUtil.h>
+#include <nsServiceManagerUtils.h>
+#include <nsThreadUtils.h>
+#include <nsVoidArray.h>
+#include <prlog.h>
+
+#include <sbIDatabasePreparedStatement.h>
+#include <sbIDatabaseQuery.h>
+#include <sbIDatabaseResult.h>
+#include <sbIMediacoreTypeSniffer.h>
+#include <sbIMediaItem.h>
+#include <sbIMediaList.h>
+#include <sbIPropertyArray.h>
+#include <sbStandardProperties.h>
+#include <sbStringUtils.h>
+
+#include "sbLocalDatabaseLibrary.h"
+#include "sbLocalDatabasePropertyCache.h"
+#include "sbLocalDatabaseResourcePropertyBag.h"
+#include "sbLocalDatabaseSchemaInfo.h"
+#include "sbLocalDatabaseSQL.h"
+
+/**
+ * To log this module, set the following environment variable:
+ *   NSPR_LOG_MODULES=sbLocalDatabaseBulkCreateHelper:5
+ */
+#ifdef PR_LOGGING
+static PRLogModuleInfo* gBulkCreateLog = nsnull;
+#define TRACE(args) PR_LOG(gBulkCreateLog, PR_LOG_DEBUG, args)
+#define LOG(args)   PR_LOG(gBulkCreateLog, PR_LOG_WARN, args)
+#else
+#define TRACE(args) /* nothing */
+#define LOG(args)   /* nothing */
+#endif
+
+// Indexes are dropped and rebuilt without being asked to when at least this
+// many items are created and the library does not hold more items than that
+// already. Rebuilding an index costs about as much as filling it row by row
+// once the batch is the larger part of the table.
+#define DEFER_INDEXES_MIN_ITEMS 10000
+
+static PRUint32
+GetStaticPropertyDBID(const char* aPropertyID)
+{
+  for (PRUint32 i = 0; i < NS_ARRAY_LENGTH(sStaticProperties); i++) {
+    if (!strcmp(sStaticProperties[i].mPropertyID, aPropertyID)) {
+      return sStaticProperties[i].mDBID;
+    }
+  }
+  NS_NOTREACHED("Not a top level property");
+  return 0;
+}
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbLocalDatabaseBulkCreateResult,
+                              sbILocalDatabaseBulkCreateResult)
+
+NS_IMETHODIMP
+sbLocalDatabaseBulkCreateResult::GetLength(PRUint32* aLength)
+{
+  NS_ENSURE_ARG_POINTER(aLength);
+  *aLength = mGuids.Length();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseBulkCreateResult::GetGuidAt(PRUint32 aIndex,
+                                           nsAString& _retval)
+{
+  NS_ENSURE_TRUE(aIndex < mGuids.Length(), NS_ERROR_INVALID_ARG);
+  _retval.Assign(mGuids[aIndex]);
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseBulkCreateResult::GetMediaItemIdAt(PRUint32 aIndex,
+                                                  PRUint32* _retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+  NS_ENSURE_TRUE(aIndex < mMediaItemIds.Length(), NS_ERROR_INVALID_ARG);
+  *_retval = mMediaItemIds[aIndex];
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseBulkCreateResult::GetSourceIndexAt(PRUint32 aIndex,
+                                                  PRUint32* _retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+  NS_ENSURE_TRUE(aIndex < mSourceIndexes.Length(), NS_ERROR_INVALID_ARG);
+  *_retval = mSourceIndexes[aIndex];
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseBulkCreateResult::GetMediaItems(nsIArray** aMediaItems)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItems);
+  NS_IF_ADDREF(*aMediaItems = mMediaItems);
+  return NS_OK;
+}
+
+sbLocalDatabaseBulkCreateHelper::sbLocalDatabaseBulkCreateHelper
+                                   (sbLocalDatabaseLibrary* aLibrary,
+                                    PRUint32 aFlags) :
+  mLibrary(aLibrary),
+  mPropertyCache(nsnull),
+  mFlags(aFlags),
+  mLibraryLength(0)
+{
+  NS_ASSERTION(aLibrary, "aLibrary is null");
+#ifdef PR_LOGGING
+  if (!gBulkCreateLog) {
+    gBulkCreateLog = PR_NewLogModule("sbLocalDatabaseBulkCreateHelper");
+  }
+#endif
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::Run(nsIArray* aURIArray,
+                                     nsIArray* aPropertyArrayArray,
+                                     sbILocalDatabaseBulkCreateResult** _retval)
+{
+  NS_ENSURE_ARG_POINTER(aURIArray);
+  NS_ENSURE_ARG_POINTER(_retval);
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_NOT_SAME_THREAD);
+
+  TRACE(("sbLocalDatabaseBulkCreateHelper[0x%.8x] - Run(0x%x)", this, mFlags));
+
+  nsresult rv;
+
+  nsAutoPtr<nsStringArray> uris;
+  rv = mLibrary->ConvertURIsToStrings(aURIArray, getter_Transfers(uris));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (mFlags & sbILocalDatabaseLibrary::BULK_CREATE_ALLOW_DUPLICATES) {
+    return RunFiltered(uris, aPropertyArrayArray, _retval);
+  }
+
+  nsAutoPtr<nsStringArray> filteredURIs;
+  nsCOMPtr<nsIArray> filteredPropertyArrayArray;
+  nsTArray<PRUint32> sourceIndexes;
+  rv = mLibrary->FilterExistingItems(uris,
+                                     aPropertyArrayArray,
+                                     &sourceIndexes,
+                                     getter_Transfers(filteredURIs),
+                                     getter_AddRefs(filteredPropertyArrayArray));
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (uris == filteredURIs)
+    uris.forget();
+
+  rv = RunFiltered(filteredURIs, filteredPropertyArrayArray, _retval);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Map the created items back to the URIs the caller passed.
+  mResult->mSourceIndexes.SwapElements(sourceIndexes);
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::RunFiltered(nsStringArray* aURIs,
+                                             nsIArray* aPropertyArrayArray,
+                                             sbILocalDatabaseBulkCreateResult** _retval)
+{
+  NS_ENSURE_ARG_POINTER(aURIs);
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  nsresult rv;
+
+  nsCOMPtr<sbIDatabaseQuery> query;
+  rv = mLibrary->CreateQuery(getter_AddRefs(query));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = InitQuery(query, aURIs, aPropertyArrayArray);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRInt32 dbResult;
+  rv = query->Execute(&dbResult);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbResult == 0, NS_ERROR_FAILURE);
+
+  return Finish(query, _retval);
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::InitQuery(sbIDatabaseQuery* aQuery,
+                                           nsStringArray* aURIs,
+                                           nsIArray* aPropertyArrayArray)
+{
+  NS_ENSURE_ARG_POINTER(aQuery);
+  NS_ENSURE_ARG_POINTER(aURIs);
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_NOT_SAME_THREAD);
+
+  nsresult rv;
+
+  mResult = new sbLocalDatabaseBulkCreateResult();
+  NS_ENSURE_TRUE(mResult, NS_ERROR_OUT_OF_MEMORY);
+
+  // The bags are filled by the cache itself; it is always the native one.
+  mPropertyCache = static_cast<sbLocalDatabasePropertyCache*>(
+                     mLibrary->mPropertyCache.get());
+  NS_ENSURE_TRUE(mPropertyCache, NS_ERROR_NOT_INITIALIZED);
+
+  PRUint32 count = aURIs->Count();
+  for (PRUint32 i = 0; i < count; i++) {
+    NS_ENSURE_TRUE(mResult->mSourceIndexes.AppendElement(i),
+                   NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  rv = mLibrary->GetLength(&mLibraryLength);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool deferIndexes =
+    (mFlags & sbILocalDatabaseLibrary::BULK_CREATE_DEFER_INDEXES) ||
+    (count >= DEFER_INDEXES_MIN_ITEMS && count >= mLibraryLength);
+
+  rv = aQuery->AddQuery(NS_LITERAL_STRING("begin"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (count > 0) {
+    if (deferIndexes) {
+      rv = DropIndexes(aQuery);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+
+    rv = AddItems(aQuery, aURIs, aPropertyArrayArray);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (deferIndexes) {
+      rv = RestoreIndexes(aQuery);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
+  rv = aQuery->AddQuery(NS_LITERAL_STRING("commit"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (count > 0) {
+    rv = AddSelectMediaItemIds(aQuery);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::Finish(sbIDatabaseQuery* aQuery,
+                                        sbILocalDatabaseBulkCreateResult** _retval)
+{
+  NS_ENSURE_ARG_POINTER(aQuery);
+  NS_ENSURE_ARG_POINTER(_retval);
+  NS_ENSURE_TRUE(mResult, NS_ERROR_NOT_INITIALIZED);
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_NOT_SAME_THREAD);
+
+  nsresult rv;
+
+  if (mResult->mGuids.IsEmpty()) {
+    if (mFlags & sbILocalDatabaseLibrary::BULK_CREATE_RETURN_ITEMS) {
+      mResult->mMediaItems =
+        do_CreateInstance("@songbirdnest.com/moz/xpcom/threadsafe-array;1",
+                          &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+
+    NS_ADDREF(*_retval = mResult);
+    return NS_OK;
+  }
+
+  rv = ReadMediaItemIds(aQuery);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = NotifyAndGetItems();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  NS_ADDREF(*_retval = mResult);
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::AddItems(sbIDatabaseQuery* aQuery,
+                                          nsStringArray* aURIs,
+                                          nsIArray* aPropertyArrayArray)
+{
+  nsresult rv;
+
+  mUUIDGenerator = do_GetService(NS_UUID_GENERATOR_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  mIOService = do_GetIOService(&rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Every item gets the same timestamps, like items created by
+  // sbLocalDatabaseLibrary::BatchCreateMediaItems.
+  nsAutoString now;
+  sbLocalDatabaseLibrary::GetNowString(now);
+
+  PRUint32 count = aURIs->Count();
+  nsCOMArray<sbLocalDatabaseResourcePropertyBag> bags;
+  for (PRUint32 i = 0; i < count; i++) {
+    nsAutoString uriSpec;
+    aURIs->StringAt(i, uriSpec);
+
+    nsCOMPtr<sbIPropertyArray> properties;
+    if (aPropertyArrayArray) {
+      properties = do_QueryElementAt(aPropertyArrayArray, i, &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+
+    nsRefPtr<sbLocalDatabaseResourcePropertyBag> bag;
+    rv = CreateBag(uriSpec, properties, now, getter_AddRefs(bag));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRBool success = bags.AppendObject(bag);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+    if (bags.Count() == sbLocalDatabaseSQL::MediaItemsBulkInsertRowCount ||
+        i == count - 1) {
+      rv = AddMediaItemRows(aQuery, bags);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      // The property rows look up the new media items by guid, so they can
+      // only go in once the items themselves have been inserted.
+      for (PRInt32 j = 0; j < bags.Count(); j++) {
+        rv = AddPropertyRows(aQuery, bags[j]);
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
+      bags.Clear();
+    }
+  }
+
+  // Flush whatever did not fill a whole statement.
+  rv = FlushPropertyRows(aQuery);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = FlushFtsRows(aQuery);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::CreateBag(const nsAString& aURISpec,
+                                           sbIPropertyArray* aProperties,
+                                           const nsAString& aNow,
+                                           sbLocalDatabaseResourcePropertyBag** _retval)
+{
+  nsresult rv;
+  nsCOMPtr<sbIPropertyArray> properties(aProperties);
+
+  if (!properties) {
+    properties =
+      do_CreateInstance("@songbirdnest.com/Songbird/Properties/MutablePropertyArray;1", &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  // Sniff out the content type the way SetDefaultItemProperties does.
+  nsString contentType;
+  rv = properties->GetPropertyValue(
+    NS_LITERAL_STRING(SB_PROPERTY_CONTENTTYPE), contentType);
+  if (NS_FAILED(rv) || contentType.IsEmpty()) {
+    if (!mTypeSniffer) {
+      mTypeSniffer =
+        do_CreateInstance("@songbirdnest.com/Songbird/Mediacore/TypeSniffer;1", &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+
+    nsCOMPtr<nsIURI> uri;
+    rv = mIOService->NewURI(NS_ConvertUTF16toUTF8(aURISpec), nsnull,
+                            nsnull, getter_AddRefs(uri));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRBool isVideo = PR_FALSE;
+    rv = mTypeSniffer->IsValidVideoURL(uri, &isVideo);
+    if (NS_SUCCEEDED(rv) && isVideo) {
+      nsCOMPtr<sbIMutablePropertyArray> mutableProperties =
+        do_QueryInterface(properties, &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      rv = mutableProperties->AppendProperty(
+                                NS_LITERAL_STRING(SB_PROPERTY_CONTENTTYPE),
+                                NS_LITERAL_STRING("video"));
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
+  nsCOMPtr<sbIPropertyArray> filteredProperties;
+  rv = mLibrary->GetFilteredPropertiesForNewItem(properties,
+                                                 getter_AddRefs(filteredProperties));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Make a new GUID, without the curly braces ToString would add.
+  nsID id;
+  rv = mUUIDGenerator->GenerateUUIDInPlace(&id);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  char guidChars[NSID_LENGTH];
+  id.ToProvidedString(guidChars);
+
+  nsString guid(NS_ConvertASCIItoUTF16(nsDependentCString(guidChars + 1,
+                                                          NSID_LENGTH - 3)));
+
+  nsRefPtr<sbLocalDatabaseResourcePropertyBag> bag;
+  rv = mPropertyCache->CreateDetachedBag(guid,
+                                         filteredProperties,
+                                         getter_AddRefs(bag));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // These always take the values AddNewItemQuery would give them.
+  rv = bag->PutValue(GetStaticPropertyDBID(SB_PROPERTY_GUID), guid);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = bag->PutValue(GetStaticPropertyDBID(SB_PROPERTY_CONTENTURL), aURISpec);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = bag->PutValue(GetStaticPropertyDBID(SB_PROPERTY_CREATED), aNow);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = bag->PutValue(GetStaticPropertyDBID(SB_PROPERTY_UPDATED), aNow);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 hiddenDBID = GetStaticPropertyDBID(SB_PROPERTY_HIDDEN);
+  nsString hidden;
+  rv = bag->GetPropertyByID(hiddenDBID, hidden);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (hidden.IsVoid()) {
+    rv = bag->PutValue(hiddenDBID, NS_LITERAL_STRING("0"));
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  rv = bag->GetPropertyByID(GetStaticPropertyDBID(SB_PROPERTY_CONTENTTYPE),
+                            contentType);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  NS_ENSURE_TRUE(mResult->mGuids.AppendElement(guid), NS_ERROR_OUT_OF_MEMORY);
+  NS_ENSURE_TRUE(mIsAudio.AppendElement(contentType.EqualsLiteral("audio")),
+                 NS_ERROR_OUT_OF_MEMORY);
+  NS_ENSURE_TRUE(mIsVideo.AppendElement(contentType.EqualsLiteral("video")),
+                 NS_ERROR_OUT_OF_MEMORY);
+
+  NS_ADDREF(*_retval = bag);
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::AddMediaItemRows(sbIDatabaseQuery* aQuery,
+                                                  nsCOMArray<sbLocalDatabaseResourcePropertyBag>& aBags)
+{
+  nsresult rv = AddBulkStatement(aQuery,
+                                 sbLocalDatabaseSQL::MediaItemsBulkInsert,
+                                 aBags.Count(),
+                                 sbLocalDatabaseSQL::MediaItemsBulkInsertRowCount,
+                                 mMediaItemsInsert);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 param = 0;
+  for (PRInt32 i = 0; i < aBags.Count(); i++) {
+    for (PRUint32 j = 0; j < NS_ARRAY_LENGTH(sStaticProperties); j++) {
+      const sbStaticProperty& property = sStaticProperties[j];
+      if (!SB_IsBulkInsertColumn(property)) {
+        continue;
+      }
+
+      nsString value;
+      rv = aBags[i]->GetPropertyByID(property.mDBID, value);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      if (value.IsVoid()) {
+        rv = aQuery->BindNullParameter(param);
+      }
+      else if (property.mColumnType == SB_COLUMN_TYPE_INTEGER) {
+        PRUint64 intVal = nsString_ToUint64(value, &rv);
+        NS_ENSURE_SUCCESS(rv, rv);
+        rv = aQuery->BindInt64Parameter(param, intVal);
+      }
+      else {
+        rv = aQuery->BindStringParameter(param, value);
+      }
+      NS_ENSURE_SUCCESS(rv, rv);
+      param++;
+    }
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::AddPropertyRows(sbIDatabaseQuery* aQuery,
+                                                 sbLocalDatabaseResourcePropertyBag* aBag)
+{
+  nsresult rv;
+
+  nsString guid;
+  rv = aBag->GetGuid(guid);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsTArray<PRUint32> propertyDBIDs;
+  rv = aBag->GetPropertyDBIDs(propertyDBIDs);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  for (PRUint32 i = 0; i < propertyDBIDs.Length(); i++) {
+    PRUint32 propertyDBID = propertyDBIDs[i];
+
+    // Top level properties were written to media_items.
+    if (SB_IsTopLevelProperty(propertyDBID)) {
+      continue;
+    }
+
+    PropertyRow* row = mPropertyRows.AppendElement();
+    NS_ENSURE_TRUE(row, NS_ERROR_OUT_OF_MEMORY);
+
+    row->guid = guid;
+    row->propertyDBID = propertyDBID;
+
+    rv = aBag->GetPropertyByID(propertyDBID, row->value);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (row->value.IsVoid()) {
+      mPropertyRows.RemoveElementAt(mPropertyRows.Length() - 1);
+      continue;
+    }
+
+    rv = aBag->GetSearchablePropertyByID(propertyDBID, row->searchable);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aBag->GetSortablePropertyByID(propertyDBID, row->sortable);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = mPropertyCache->CreateSecondarySortValue(aBag,
+                                                  propertyDBID,
+                                                  row->secondarySortable);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (mPropertyRows.Length() ==
+          (PRUint32)sbLocalDatabaseSQL::PropertiesBulkInsertRowCount) {
+      rv = FlushPropertyRows(aQuery);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
+  nsString ftsData;
+  rv = mPropertyCache->GetFTSData(aBag, ftsData);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (!ftsData.IsEmpty()) {
+    FtsRow* row = mFtsRows.AppendElement();
+    NS_ENSURE_TRUE(row, NS_ERROR_OUT_OF_MEMORY);
+
+    row->guid = guid;
+    row->data = ftsData;
+
+    if (mFtsRows.Length() ==
+          (PRUint32)sbLocalDatabaseSQL::MediaItemsFtsAllBulkInsertRowCount) {
+      rv = FlushFtsRows(aQuery);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::FlushPropertyRows(sbIDatabaseQuery* aQuery)
+{
+  PRUint32 length = mPropertyRows.Length();
+  if (length == 0) {
+    return NS_OK;
+  }
+
+  nsresult rv = AddBulkStatement(aQuery,
+                                 sbLocalDatabaseSQL::PropertiesBulkInsert,
+                                 length,
+                                 sbLocalDatabaseSQL::PropertiesBulkInsertRowCount,
+                                 mPropertiesInsert);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 param = 0;
+  for (PRUint32 i = 0; i < length; i++) {
+    const PropertyRow& row = mPropertyRows[i];
+
+    rv = aQuery->BindStringParameter(param++, row.guid);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindInt32Parameter(param++, row.propertyDBID);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindStringParameter(param++, row.value);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindStringParameter(param++, row.searchable);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindStringParameter(param++, row.sortable);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindStringParameter(param++, row.secondarySortable);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  mPropertyRows.Clear();
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::FlushFtsRows(sbIDatabaseQuery* aQuery)
+{
+  PRUint32 length = mFtsRows.Length();
+  if (length == 0) {
+    return NS_OK;
+  }
+
+  nsresult rv = AddBulkStatement(aQuery,
+                                 sbLocalDatabaseSQL::MediaItemsFtsAllBulkInsert,
+                                 length,
+                                 sbLocalDatabaseSQL::MediaItemsFtsAllBulkInsertRowCount,
+                                 mFtsInsert);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 param = 0;
+  for (PRUint32 i = 0; i < length; i++) {
+    rv = aQuery->BindStringParameter(param++, mFtsRows[i].guid);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindStringParameter(param++, mFtsRows[i].data);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  mFtsRows.Clear();
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::AddBulkStatement(sbIDatabaseQuery* aQuery,
+                                                  BulkInsertSQL aSQL,
+                                                  PRUint32 aRowCount,
+                                                  PRUint32 aFullRowCount,
+                                                  nsCOMPtr<sbIDatabasePreparedStatement>& aFullStatement)
+{
+  NS_ASSERTION(aRowCount > 0 && aRowCount <= aFullRowCount,
+               "Bad bulk insert row count");
+
+  nsresult rv;
+  nsCOMPtr<sbIDatabasePreparedStatement> statement;
+  if (aRowCount == aFullRowCount) {
+    if (!aFullStatement) {
+      rv = aQuery->PrepareQuery(aSQL(aFullRowCount),
+                                getter_AddRefs(aFullStatement));
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    statement = aFullStatement;
+  }
+  else {
+    // A partial statement is needed at most once per table and batch.
+    rv = aQuery->PrepareQuery(aSQL(aRowCount), getter_AddRefs(statement));
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  rv = aQuery->AddPreparedStatement(statement);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::DropIndexes(sbIDatabaseQuery* aQuery)
+{
+  TRACE(("sbLocalDatabaseBulkCreateHelper[0x%.8x] - DropIndexes()", this));
+
+  nsresult rv;
+  nsCOMPtr<sbIDatabaseQuery> query;
+  rv = mLibrary->CreateQuery(getter_AddRefs(query));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Unique indexes enforce constraints and the automatic indexes behind
+  // them have no SQL, so both are left alone.
+  rv = query->AddQuery(NS_LITERAL_STRING(
+    "SELECT name, sql FROM sqlite_master WHERE "
+    "(type = 'index' AND tbl_name IN ('media_items', 'resource_properties') "
+    "AND sql IS NOT NULL AND sql NOT LIKE 'CREATE UNIQUE %') "
+    "OR name = 'sqlite_stat1'"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRInt32 dbResult;
+  rv = query->Execute(&dbResult);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbResult == 0, NS_ERROR_FAILURE);
+
+  nsCOMPtr<sbIDatabaseResult> result;
+  rv = query->GetResultObject(getter_AddRefs(result));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 rowCount;
+  rv = result->GetRowCount(&rowCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool hasStatistics = PR_FALSE;
+  nsTArray<nsString> indexNames;
+  for (PRUint32 i = 0; i < rowCount; i++) {
+    nsString name;
+    rv = result->GetRowCell(i, 0, name);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (name.EqualsLiteral("sqlite_stat1")) {
+      hasStatistics = PR_TRUE;
+      continue;
+    }
+
+    nsString sql;
+    rv = result->GetRowCell(i, 1, sql);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    NS_ENSURE_TRUE(indexNames.AppendElement(name), NS_ERROR_OUT_OF_MEMORY);
+    NS_ENSURE_TRUE(mIndexSQL.AppendElement(sql), NS_ERROR_OUT_OF_MEMORY);
+
+    nsString drop(NS_LITERAL_STRING("DROP INDEX "));
+    drop.Append(name);
+    rv = aQuery->AddQuery(drop);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  // Keep the statistics of the dropped indexes so that the query planner
+  // does not lose them until the next ANALYZE.
+  if (hasStatistics && !indexNames.IsEmpty()) {
+    rv = query->ResetQuery();
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = query->AddQuery(NS_LITERAL_STRING(
+      "SELECT tbl, idx, stat FROM sqlite_stat1 "
+      "WHERE tbl IN ('media_items', 'resource_properties')"));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = query->Execute(&dbResult);
+    NS_ENSURE_SUCCESS(rv, rv);
+    NS_ENSURE_TRUE(dbResult == 0, NS_ERROR_FAILURE);
+
+    rv = query->GetResultObject(getter_AddRefs(result));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = result->GetRowCount(&rowCount);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    for (PRUint32 i = 0; i < rowCount; i++) {
+      IndexStatistics statistics;
+      rv = result->GetRowCell(i, 1, statistics.index);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      if (!indexNames.Contains(statistics.index)) {
+        continue;
+      }
+
+      rv = result->GetRowCell(i, 0, statistics.table);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      rv = result->GetRowCell(i, 2, statistics.stat);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      NS_ENSURE_TRUE(mIndexStatistics.AppendElement(statistics),
+                     NS_ERROR_OUT_OF_MEMORY);
+    }
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::RestoreIndexes(sbIDatabaseQuery* aQuery)
+{
+  TRACE(("sbLocalDatabaseBulkCreateHelper[0x%.8x] - RestoreIndexes()", this));
+
+  nsresult rv;
+  for (PRUint32 i = 0; i < mIndexSQL.Length(); i++) {
+    rv = aQuery->AddQuery(mIndexSQL[i]);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  for (PRUint32 i = 0; i < mIndexStatistics.Length(); i++) {
+    const IndexStatistics& statistics = mIndexStatistics[i];
+
+    rv = aQuery->AddQuery(NS_LITERAL_STRING(
+      "DELETE FROM sqlite_stat1 WHERE idx = ?"));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindStringParameter(0, statistics.index);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->AddQuery(NS_LITERAL_STRING(
+      "INSERT INTO sqlite_stat1 (tbl, idx, stat) VALUES (?, ?, ?)"));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindStringParameter(0, statistics.table);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindStringParameter(1, statistics.index);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aQuery->BindStringParameter(2, statistics.stat);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::AddSelectMediaItemIds(sbIDatabaseQuery* aQuery)
+{
+  nsresult rv;
+
+  // Only the result of the last statement is kept, so this has to come
+  // after the commit.
+  nsCOMPtr<sbIDatabasePreparedStatement> select;
+  rv = aQuery->PrepareQuery(NS_LITERAL_STRING(
+    "SELECT guid, media_item_id FROM media_items WHERE media_item_id >= "
+    "(SELECT media_item_id FROM media_items WHERE guid = ?)"),
+    getter_AddRefs(select));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = aQuery->AddPreparedStatement(select);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = aQuery->BindStringParameter(0, mResult->mGuids[0]);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::ReadMediaItemIds(sbIDatabaseQuery* aQuery)
+{
+  nsresult rv;
+
+  PRInt32 dbError;
+  rv = aQuery->GetLastError(&dbError);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbError == 0, NS_ERROR_FAILURE);
+
+  nsCOMPtr<sbIDatabaseResult> result;
+  rv = aQuery->GetResultObject(getter_AddRefs(result));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 rowCount;
+  rv = result->GetRowCount(&rowCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsDataHashtable<nsStringHashKey, PRUint32> ids;
+  PRBool success = ids.Init(rowCount);
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+  for (PRUint32 i = 0; i < rowCount; i++) {
+    nsString guid;
+    rv = result->GetRowCell(i, 0, guid);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsString idString;
+    rv = result->GetRowCell(i, 1, idString);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRUint32 id = idString.ToInteger(&rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    success = ids.Put(guid, id);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  PRUint32 length = mResult->mGuids.Length();
+  NS_ENSURE_TRUE(mResult->mMediaItemIds.SetCapacity(length),
+                 NS_ERROR_OUT_OF_MEMORY);
+  for (PRUint32 i = 0; i < length; i++) {
+    PRUint32 id;
+    success = ids.Get(mResult->mGuids[i], &id);
+    NS_ENSURE_TRUE(success, NS_ERROR_UNEXPECTED);
+
+    mResult->mMediaItemIds.AppendElement(id);
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseBulkCreateHelper::NotifyAndGetItems()
+{
+  nsresult rv;
+  PRBool returnItems =
+    (mFlags & sbILocalDatabaseLibrary::BULK_CREATE_RETURN_ITEMS) != 0;
+
+  nsCOMPtr<nsIMutableArray> array;
+  if (returnItems) {
+    array = do_CreateInstance("@songbirdnest.com/moz/xpcom/threadsafe-array;1",
+                              &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  sbAutoBatchHelper batchHelper(*mLibrary);
+
+  PRUint32 length = mResult->mGuids.Length();
+  for (PRUint32 i = 0; i < length; i++) {
+    // We know the id and the type of these new media items so preload the
+    // cache with this information
+    nsAutoPtr<sbLocalDatabaseLibrary::sbMediaItemInfo>
+      newItemInfo(new sbLocalDatabaseLibrary::sbMediaItemInfo(PR_TRUE,
+                                                              mIsAudio[i],
+                                                              mIsVideo[i]));
+    NS_ENSURE_TRUE(newItemInfo, NS_ERROR_OUT_OF_MEMORY);
+
+    newItemInfo->itemID = mResult->mMediaItemIds[i];
+    newItemInfo->hasItemID = PR_TRUE;
+
+    NS_ASSERTION(!mLibrary->mMediaItemTable.Get(mResult->mGuids[i], nsnull),
+                 "Guid already exists!");
+
+    PRBool success = mLibrary->mMediaItemTable.Put(mResult->mGuids[i],
+                                                   newItemInfo);
+    NS_ENSURE_TRUE(success, NS_ERROR_FAILURE);
+    newItemInfo.forget();
+  }
+
+  // Items added, count must be invalidated too.
+  rv = mLibrary->GetArray()->Invalidate(PR_TRUE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  sbIMediaList* libraryList =
+    static_cast<sbIMediaList*>(
+      static_cast<sbLocalDatabaseMediaListBase*>(mLibrary));
+
+  for (PRUint32 i = 0; i < length; i++) {
+    // Views stop listening for the rest of the batch after the first item
+    // and invalidate once it ends, so usually only a few items are ever
+    // instantiated.
+    PRBool notify =
+      mLibrary->ShouldNotifyListeners(sbIMediaList::LISTENER_FLAGS_ITEMADDED);
+    if (!notify && !returnItems) {
+      break;
+    }
+
+    nsCOMPtr<sbIMediaItem> mediaItem;
+    rv = mLibrary->GetMediaItem(mResult->mGuids[i], getter_AddRefs(mediaItem));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (returnItems) {
+      rv = array->AppendElement(mediaItem, PR_FALSE);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+
+    if (notify) {
+      mLibrary->NotifyListenersItemAdded(libraryList,
+                                         mediaItem,
+                                         mLibraryLength + i);
+    }
+  }
+
+  mResult->mMediaItems = array;
+  return NS_OK;
+}
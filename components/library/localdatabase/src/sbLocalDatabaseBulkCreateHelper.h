@@ -0,0 +1,204 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#ifndef __SBLOCALDATABASEBULKCREATEHELPER_H__
+#define __SBLOCALDATABASEBULKCREATEHELPER_H__
+
+#include <sbILocalDatabaseLibrary.h>
+
+#include <nsAutoPtr.h>
+#include <nsCOMArray.h>
+#include <nsCOMPtr.h>
+#include <nsIArray.h>
+#include <nsStringAPI.h>
+#include <nsTArray.h>
+
+class nsIIOService;
+class nsIUUIDGenerator;
+class nsStringArray;
+class sbIDatabasePreparedStatement;
+class sbIDatabaseQuery;
+class sbIMediacoreTypeSniffer;
+class sbIPropertyArray;
+class sbLocalDatabaseLibrary;
+class sbLocalDatabasePropertyCache;
+class sbLocalDatabaseResourcePropertyBag;
+
+/**
+ * \class sbLocalDatabaseBulkCreateResult
+ * \brief The ids and guids of items created by
+ *        sbLocalDatabaseLibrary::BulkCreateMediaItems.
+ */
+class sbLocalDatabaseBulkCreateResult : public sbILocalDatabaseBulkCreateResult
+{
+  friend class sbLocalDatabaseBulkCreateHelper;
+
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBILOCALDATABASEBULKCREATERESULT
+
+private:
+  nsTArray<nsString> mGuids;
+  nsTArray<PRUint32> mMediaItemIds;
+  nsTArray<PRUint32> mSourceIndexes;
+  nsCOMPtr<nsIArray> mMediaItems;
+};
+
+/**
+ * \class sbLocalDatabaseBulkCreateHelper
+ * \brief Implements sbLocalDatabaseLibrary::BulkCreateMediaItems.
+ *
+ * Everything is written by a single query in one transaction. The
+ * media_items rows go first, MediaItemsBulkInsertRowCount at a time; the
+ * resource_properties and full text search rows of each block of items
+ * follow with statements of their own, which look up the ids of the new
+ * items by guid so that nothing has to be read back until the end. When
+ * indexes are deferred, the secondary indexes of both tables are dropped
+ * at the start of the transaction and recreated, with their statistics,
+ * before it commits.
+ *
+ * Listeners are notified once the transaction has committed. Media items
+ * are only created for as long as a listener still wants to be told about
+ * added items, or when the caller asked for them.
+ */
+class sbLocalDatabaseBulkCreateHelper
+{
+public:
+  sbLocalDatabaseBulkCreateHelper(sbLocalDatabaseLibrary* aLibrary,
+                                  PRUint32 aFlags);
+
+  nsresult Run(nsIArray* aURIArray,
+               nsIArray* aPropertyArrayArray,
+               sbILocalDatabaseBulkCreateResult** _retval);
+
+  /**
+   * \brief Like Run, for URI specs that have already been converted and, if
+   *        needed, filtered for existing items. aFlags is not checked for
+   *        BULK_CREATE_ALLOW_DUPLICATES.
+   */
+  nsresult RunFiltered(nsStringArray* aURIs,
+                       nsIArray* aPropertyArrayArray,
+                       sbILocalDatabaseBulkCreateResult** _retval);
+
+  /**
+   * \brief Add the statements that create the items of aURIs to aQuery,
+   *        which may be an asynchronous query. Nothing is filtered. Call
+   *        Finish on the main thread once aQuery has completed.
+   */
+  nsresult InitQuery(sbIDatabaseQuery* aQuery,
+                     nsStringArray* aURIs,
+                     nsIArray* aPropertyArrayArray);
+
+  /**
+   * \brief Read the ids of the items created by the query set up with
+   *        InitQuery and notify listeners of the new items.
+   */
+  nsresult Finish(sbIDatabaseQuery* aQuery,
+                  sbILocalDatabaseBulkCreateResult** _retval);
+
+private:
+  struct PropertyRow {
+    nsString guid;
+    PRUint32 propertyDBID;
+    nsString value;
+    nsString searchable;
+    nsString sortable;
+    nsString secondarySortable;
+  };
+
+  struct FtsRow {
+    nsString guid;
+    nsString data;
+  };
+
+  struct IndexStatistics {
+    nsString table;
+    nsString index;
+    nsString stat;
+  };
+
+  typedef nsString (*BulkInsertSQL)(PRUint32 aRowCount);
+
+  nsresult AddItems(sbIDatabaseQuery* aQuery,
+                    nsStringArray* aURIs,
+                    nsIArray* aPropertyArrayArray);
+
+  nsresult CreateBag(const nsAString& aURISpec,
+                     sbIPropertyArray* aProperties,
+                     const nsAString& aNow,
+                     sbLocalDatabaseResourcePropertyBag** _retval);
+
+  nsresult AddMediaItemRows(sbIDatabaseQuery* aQuery,
+                            nsCOMArray<sbLocalDatabaseResourcePropertyBag>& aBags);
+
+  nsresult AddPropertyRows(sbIDatabaseQuery* aQuery,
+                           sbLocalDatabaseResourcePropertyBag* aBag);
+
+  nsresult FlushPropertyRows(sbIDatabaseQuery* aQuery);
+
+  nsresult FlushFtsRows(sbIDatabaseQuery* aQuery);
+
+  // Add a bulk insert of aRowCount rows to aQuery. Full sized statements
+  // are prepared once and kept in aFullStatement.
+  nsresult AddBulkStatement(sbIDatabaseQuery* aQuery,
+                            BulkInsertSQL aSQL,
+                            PRUint32 aRowCount,
+                            PRUint32 aFullRowCount,
+                            nsCOMPtr<sbIDatabasePreparedStatement>& aFullStatement);
+
+  nsresult DropIndexes(sbIDatabaseQuery* aQuery);
+  nsresult RestoreIndexes(sbIDatabaseQuery* aQuery);
+
+  nsresult AddSelectMediaItemIds(sbIDatabaseQuery* aQuery);
+  nsresult ReadMediaItemIds(sbIDatabaseQuery* aQuery);
+
+  nsresult NotifyAndGetItems();
+
+  sbLocalDatabaseLibrary* mLibrary;
+  sbLocalDatabasePropertyCache* mPropertyCache;
+  PRUint32 mFlags;
+  PRUint32 mLibraryLength;
+
+  nsRefPtr<sbLocalDatabaseBulkCreateResult> mResult;
+  nsTArray<PRPackedBool> mIsAudio;
+  nsTArray<PRPackedBool> mIsVideo;
+
+  nsCOMPtr<nsIUUIDGenerator> mUUIDGenerator;
+  nsCOMPtr<nsIIOService> mIOService;
+  nsCOMPtr<sbIMediacoreTypeSniffer> mTypeSniffer;
+
+  nsTArray<PropertyRow> mPropertyRows;
+  nsTArray<FtsRow> mFtsRows;
+
+  nsCOMPtr<sbIDatabasePreparedStatement> mMediaItemsInsert;
+  nsCOMPtr<sbIDatabasePreparedStatement> mPropertiesInsert;
+  nsCOMPtr<sbIDatabasePreparedStatement> mFtsInsert;
+
+  nsTArray<nsString> mIndexSQL;
+  nsTArray<IndexStatistics> mIndexStatistics;
+};
+
+#endif /* __SBLOCALDATABASEBULKCREATEHELPER_H__ */
@@ -36,6 +36,8 @@
 #include <nsComponentManagerUtils.h>
 #include <nsServiceManagerUtils.h>
 #include <nsCOMPtr.h>
+#include <nsArrayUtils.h>
+#include <nsIMutableArray.h>
 #include <nsIStringEnumerator.h>
 #include <nsIURI.h>
 #include <nsIWeakReference.h>
@@ -58,10 +60,14 @@
 #include <sbStandardProperties.h>
 #include <sbStringUtils.h>
 #include <sbMemoryUtils.h>
+#include <sbPerfStatisticsUtils.h>
 #include <sbThreadUtils.h>
 
 #define DEFAULT_FETCH_SIZE 20
 
+// Number of prepared statements kept for reuse by UpdateQueries
+#define MAX_CACHED_STATEMENTS 64
+
 // Fetch all guids asynchronously, disabled by default.
 //#define FORCE_FETCH_ALL_GUIDS_ASYNC
 
@@ -144,6 +150,11 @@ sbLocalDatabaseGUIDArray::SetDatabaseGUID(const nsAString& aDatabaseGUID)
 {
   mDatabaseGUID = aDatabaseGUID;
 
+  // Prepared statements belong to the database they were prepared for
+  if (mStatementCache.IsInitialized()) {
+    mStatementCache.Clear();
+  }
+
   QueryInvalidate();
 
   return Invalidate(PR_FALSE);
@@ -171,6 +182,11 @@ sbLocalDatabaseGUIDArray::SetDatabaseLocation(nsIURI* aDatabaseLocation)
 {
   mDatabaseLocation = aDatabaseLocation;
 
+  // Prepared statements belong to the database they were prepared for
+  if (mStatementCache.IsInitialized()) {
+    mStatementCache.Clear();
+  }
+
   QueryInvalidate();
 
   return Invalidate(PR_FALSE);
@@ -1013,7 +1029,8 @@ sbLocalDatabaseGUIDArray::GetFirstIndexByPrefix(const nsAString& aValue,
   rv = MakeQuery(mPrefixSearchStatement, getter_AddRefs(query));
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = query->BindStringParameter(0, aValue);
+  rv = query->BindStringParameter(ParameterIndex(mPrefixSearchStatement, 0),
+                                  aValue);
   NS_ENSURE_SUCCESS(rv, rv);
 
   rv = query->Execute(&dbOk);
@@ -1405,6 +1422,9 @@ sbLocalDatabaseGUIDArray::UpdateLength()
 
   nsAutoMonitor mon(mCacheMonitor);
 
+  sbAutoPerfLatency perfLatency(sbIPerfStatistics::CATEGORY_GUID_ARRAY,
+                                NS_LITERAL_CSTRING("length"));
+
   // If we have a fetch size of 0 or PR_UINT32_MAX it means
   // we're supposed to fetch everything.  If this is
   // the case, and we don't have to worry about the
@@ -1517,6 +1537,10 @@ sbLocalDatabaseGUIDArray::UpdateQueries()
   if (mQueriesValid) {
     return NS_OK;
   }
+
+  sbAutoPerfLatency perfLatency(sbIPerfStatistics::CATEGORY_GUID_ARRAY,
+                                NS_LITERAL_CSTRING("update_queries"));
+
   /*
    * Generate a SQL statement that applies the current filter, search, and
    * primary sort for the supplied base table and constraints.
@@ -1539,6 +1563,23 @@ sbLocalDatabaseGUIDArray::UpdateQueries()
     NS_ENSURE_SUCCESS(rv, rv);
   }
 
+  if (!mStatementCache.IsInitialized()) {
+    PRBool success = mStatementCache.Init(MAX_CACHED_STATEMENTS);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  if (!mStatementParameters.IsInitialized()) {
+    PRBool success = mStatementParameters.Init();
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+  }
+  mStatementParameters.Clear();
+
+  // The values of the filters are returned separately and bound when the
+  // statements are run
+  nsCOMPtr<nsIMutableArray> parameters =
+    do_CreateInstance(NS_ARRAY_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
   /*
    * We need four different queries to do the magic here:
    *
@@ -1564,43 +1605,53 @@ sbLocalDatabaseGUIDArray::UpdateQueries()
                                  mPropertyCache);
 
   // Full Count Query
-  rv = ldq->GetFullCountQuery(mFullCountQuery);
+  rv = ldq->GetFullCountQuery(mFullCountQuery, parameters);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = query->PrepareQuery(mFullCountQuery,
-                           getter_AddRefs(mFullCountStatement));
+  rv = PrepareStatement(query,
+                        mFullCountQuery,
+                        parameters,
+                        getter_AddRefs(mFullCountStatement));
   NS_ENSURE_SUCCESS(rv, rv);
 
   // Full Guid Range Query
-  rv = ldq->GetFullGuidRangeQuery(mFullGuidRangeQuery);
+  rv = ldq->GetFullGuidRangeQuery(mFullGuidRangeQuery, parameters);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = query->PrepareQuery(mFullGuidRangeQuery,
-                           getter_AddRefs(mFullGuidRangeStatement));
+  rv = PrepareStatement(query,
+                        mFullGuidRangeQuery,
+                        parameters,
+                        getter_AddRefs(mFullGuidRangeStatement));
   NS_ENSURE_SUCCESS(rv, rv);
 
   // Non Null Count Query
-  rv = ldq->GetNonNullCountQuery(mNonNullCountQuery);
+  rv = ldq->GetNonNullCountQuery(mNonNullCountQuery, parameters);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = query->PrepareQuery(mNonNullCountQuery,
-                           getter_AddRefs(mNonNullCountStatement));
+  rv = PrepareStatement(query,
+                        mNonNullCountQuery,
+                        parameters,
+                        getter_AddRefs(mNonNullCountStatement));
   NS_ENSURE_SUCCESS(rv, rv);
 
   // Null Guid Range Query
-  rv = ldq->GetNullGuidRangeQuery(mNullGuidRangeQuery);
+  rv = ldq->GetNullGuidRangeQuery(mNullGuidRangeQuery, parameters);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = query->PrepareQuery(mNullGuidRangeQuery,
-                           getter_AddRefs(mNullGuidRangeStatement));
+  rv = PrepareStatement(query,
+                        mNullGuidRangeQuery,
+                        parameters,
+                        getter_AddRefs(mNullGuidRangeStatement));
   NS_ENSURE_SUCCESS(rv, rv);
 
   // Prefix Search Query
-  rv = ldq->GetPrefixSearchQuery(mPrefixSearchQuery);
+  rv = ldq->GetPrefixSearchQuery(mPrefixSearchQuery, parameters);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = query->PrepareQuery(mPrefixSearchQuery,
-                           getter_AddRefs(mPrefixSearchStatement));
+  rv = PrepareStatement(query,
+                        mPrefixSearchQuery,
+                        parameters,
+                        getter_AddRefs(mPrefixSearchStatement));
   NS_ENSURE_SUCCESS(rv, rv);
 
   /*
@@ -1611,28 +1662,34 @@ sbLocalDatabaseGUIDArray::UpdateQueries()
    */
   PRUint32 numSorts = mSorts.Length();
   if (numSorts > 1 && !mIsDistinct) {
-    rv = ldq->GetResortQuery(mResortQuery);
+    rv = ldq->GetResortQuery(mResortQuery, parameters);
     NS_ENSURE_SUCCESS(rv, rv);
 
-    rv = query->PrepareQuery(mResortQuery,
-                             getter_AddRefs(mResortStatement));
+    rv = PrepareStatement(query,
+                          mResortQuery,
+                          parameters,
+                          getter_AddRefs(mResortStatement));
     NS_ENSURE_SUCCESS(rv, rv);
 
-    rv = ldq->GetNullResortQuery(mNullResortQuery);
+    rv = ldq->GetNullResortQuery(mNullResortQuery, parameters);
     NS_ENSURE_SUCCESS(rv, rv);
 
-    rv = query->PrepareQuery(mNullResortQuery,
-                             getter_AddRefs(mNullResortStatement));
+    rv = PrepareStatement(query,
+                          mNullResortQuery,
+                          parameters,
+                          getter_AddRefs(mNullResortStatement));
     NS_ENSURE_SUCCESS(rv, rv);
 
     /*
      * Generate the primary sort key position query
      */
-    rv = ldq->GetPrefixSearchQuery(mPrimarySortKeyPositionQuery);
+    rv = ldq->GetPrefixSearchQuery(mPrimarySortKeyPositionQuery, parameters);
     NS_ENSURE_SUCCESS(rv, rv);
 
-    rv = query->PrepareQuery(mPrimarySortKeyPositionQuery,
-                             getter_AddRefs(mPrimarySortKeyPositionStatement));
+    rv = PrepareStatement(query,
+                          mPrimarySortKeyPositionQuery,
+                          parameters,
+                          getter_AddRefs(mPrimarySortKeyPositionStatement));
     NS_ENSURE_SUCCESS(rv, rv);
   }
 
@@ -1679,10 +1736,144 @@ sbLocalDatabaseGUIDArray::MakeQuery(sbIDatabasePreparedStatement *aStatement,
   rv = query->AddPreparedStatement(aStatement);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Bind the values of the filters, the caller binds the rest
+  StatementParameters* parameters;
+  if (mStatementParameters.IsInitialized() &&
+      mStatementParameters.Get(aStatement, &parameters)) {
+    PRUint32 count = parameters->values.Count();
+    for (PRUint32 i = 0; i < count; i++) {
+      nsIVariant* value = parameters->values[i];
+
+      PRUint16 dataType;
+      rv = value->GetDataType(&dataType);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      switch (dataType) {
+        case nsIDataType::VTYPE_VOID:
+          break;
+        case nsIDataType::VTYPE_INT32:
+        {
+          PRInt32 intValue;
+          rv = value->GetAsInt32(&intValue);
+          NS_ENSURE_SUCCESS(rv, rv);
+          rv = query->BindInt32Parameter(i, intValue);
+          break;
+        }
+        case nsIDataType::VTYPE_INT64:
+        {
+          PRInt64 intValue;
+          rv = value->GetAsInt64(&intValue);
+          NS_ENSURE_SUCCESS(rv, rv);
+          rv = query->BindInt64Parameter(i, intValue);
+          break;
+        }
+        default:
+        {
+          nsAutoString stringValue;
+          rv = value->GetAsAString(stringValue);
+          NS_ENSURE_SUCCESS(rv, rv);
+          rv = query->BindStringParameter(i, stringValue);
+          break;
+        }
+      }
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
   NS_ADDREF(*_retval = query);
   return NS_OK;
 }
 
+nsresult
+sbLocalDatabaseGUIDArray::PrepareStatement(sbIDatabaseQuery* aQuery,
+                                           const nsAString& aSql,
+                                           nsIMutableArray* aParameters,
+                                           sbIDatabasePreparedStatement** _retval)
+{
+  NS_ENSURE_ARG_POINTER(aQuery);
+  NS_ENSURE_ARG_POINTER(aParameters);
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  nsresult rv;
+
+  nsAutoPtr<StatementParameters> parameters(new StatementParameters);
+  NS_ENSURE_TRUE(parameters, NS_ERROR_OUT_OF_MEMORY);
+
+  PRUint32 length;
+  rv = aParameters->GetLength(&length);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  for (PRUint32 i = 0; i < length; i++) {
+    nsCOMPtr<nsIVariant> value = do_QueryElementAt(aParameters, i, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRUint16 dataType;
+    rv = value->GetDataType(&dataType);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (dataType == nsIDataType::VTYPE_VOID) {
+      PRUint32* index = parameters->callerIndexes.AppendElement(i);
+      NS_ENSURE_TRUE(index, NS_ERROR_OUT_OF_MEMORY);
+    }
+
+    PRBool success = parameters->values.AppendObject(value);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  rv = aParameters->Clear();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Each statement is bound to one set of values, so a cached statement that
+  // another query of this array already uses is prepared again
+  nsCOMPtr<sbIDatabasePreparedStatement> statement;
+  if (mStatementCache.Get(aSql, getter_AddRefs(statement)) &&
+      !mStatementParameters.Get(statement, nsnull)) {
+    sbPerfStatisticsCount(sbIPerfStatistics::CATEGORY_GUID_ARRAY,
+                          NS_LITERAL_CSTRING("statement_reused"),
+                          1);
+  }
+  else {
+    rv = aQuery->PrepareQuery(aSql, getter_AddRefs(statement));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    sbPerfStatisticsCount(sbIPerfStatistics::CATEGORY_GUID_ARRAY,
+                          NS_LITERAL_CSTRING("statement_prepared"),
+                          1);
+
+    if (!mStatementCache.Get(aSql, nsnull)) {
+      // The statements of the current queries are held by their members, so
+      // the cache can simply start over once it is full
+      if (mStatementCache.Count() >= MAX_CACHED_STATEMENTS) {
+        mStatementCache.Clear();
+      }
+
+      PRBool success = mStatementCache.Put(aSql, statement);
+      NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+    }
+  }
+
+  PRBool success = mStatementParameters.Put(statement, parameters);
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+  parameters.forget();
+
+  statement.forget(_retval);
+  return NS_OK;
+}
+
+PRUint32
+sbLocalDatabaseGUIDArray::ParameterIndex(sbIDatabasePreparedStatement* aStatement,
+                                         PRUint32 aIndex)
+{
+  StatementParameters* parameters;
+  if (mStatementParameters.IsInitialized() &&
+      mStatementParameters.Get(aStatement, &parameters) &&
+      aIndex < parameters->callerIndexes.Length()) {
+    return parameters->callerIndexes[aIndex];
+  }
+
+  return aIndex;
+}
+
 nsresult
 sbLocalDatabaseGUIDArray::FetchRows(PRUint32 aRequestedIndex,
                                     PRUint32 aFetchSize)
@@ -1698,6 +1889,9 @@ sbLocalDatabaseGUIDArray::FetchRows(PRUint32 aRequestedIndex,
   if (mValid == PR_FALSE)
     return NS_OK;
 
+  sbAutoPerfLatency perfLatency(sbIPerfStatistics::CATEGORY_GUID_ARRAY,
+                                NS_LITERAL_CSTRING("fetch"));
+
   /*
    * To read the full media library, two queries are used -- one for when the
    * primary sort key has values and one for when the primary sort key has
@@ -1842,10 +2036,10 @@ sbLocalDatabaseGUIDArray::ReadRowRange(sbIDatabasePreparedStatement *aStatement,
   rv = MakeQuery(aStatement, getter_AddRefs(query));
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = query->BindInt64Parameter(0, aCount);
+  rv = query->BindInt64Parameter(ParameterIndex(aStatement, 0), aCount);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = query->BindInt32Parameter(1, aStartIndex);
+  rv = query->BindInt32Parameter(ParameterIndex(aStatement, 1), aStartIndex);
   NS_ENSURE_SUCCESS(rv, rv);
 
   rv = query->Execute(&dbOk);
@@ -2183,7 +2377,7 @@ sbLocalDatabaseGUIDArray::SortRows(PRUint32 aStartIndex,
     rv = MakeQuery(mResortStatement, getter_AddRefs(query));
     NS_ENSURE_SUCCESS(rv, rv);
 
-    rv = query->BindStringParameter(0, aKey);
+    rv = query->BindStringParameter(ParameterIndex(mResortStatement, 0), aKey);
     NS_ENSURE_SUCCESS(rv, rv);
   }
 
@@ -2308,7 +2502,9 @@ sbLocalDatabaseGUIDArray::GetPrimarySortKeyPosition(const nsAString& aValue,
                    getter_AddRefs(query));
     NS_ENSURE_SUCCESS(rv, rv);
 
-    rv = query->BindStringParameter(0, aValue);
+    rv = query->BindStringParameter(
+           ParameterIndex(mPrimarySortKeyPositionStatement, 0),
+           aValue);
     NS_ENSURE_SUCCESS(rv, rv);
 
     rv = query->Execute(&dbOk);
@@ -30,14 +30,18 @@
 #include "sbLocalDatabaseGUIDArrayLengthCache.h"
 
 #include <nsAutoPtr.h>
+#include <nsCOMArray.h>
 #include <nsCOMPtr.h>
+#include <nsClassHashtable.h>
 #include <nsDataHashtable.h>
+#include <nsInterfaceHashtable.h>
 #include <nsStringGlue.h>
 #include <nsTArray.h>
 #include <sbIDatabaseQuery.h>
 #include <sbISQLBuilder.h>
 #include <nsISimpleEnumerator.h>
 #include <nsIStringEnumerator.h>
+#include <nsIVariant.h>
 #include <sbIDatabasePreparedStatement.h>
 #include <sbILocalDatabaseLibrary.h>
 #include <sbIMediaItem.h>
@@ -47,6 +51,7 @@
 #include <set>
 #include <map>
 
+class nsIMutableArray;
 class nsIURI;
 class nsIWeakReference;
 class sbILibrary;
@@ -128,6 +133,14 @@ private:
     PRUint64 rowid;
   };
 
+  // The values bound to the placeholders of a prepared statement
+  struct StatementParameters {
+    // One variant per placeholder, void for the ones the caller binds
+    nsCOMArray<nsIVariant> values;
+    // Indices of the placeholders the caller binds, in order
+    nsTArray<PRUint32> callerIndexes;
+  };
+
   ~sbLocalDatabaseGUIDArray();
 
   nsresult Initialize();
@@ -139,6 +152,19 @@ private:
 
   nsresult UpdateQueries();
 
+  // Prepare aSql, or reuse the statement prepared for it before, and keep
+  // aParameters as the values of its placeholders. aParameters is cleared
+  // so that it can be passed to the next query.
+  nsresult PrepareStatement(sbIDatabaseQuery* aQuery,
+                            const nsAString& aSql,
+                            nsIMutableArray* aParameters,
+                            sbIDatabasePreparedStatement** _retval);
+
+  // Index of the placeholder the caller binds as parameter aIndex; values of
+  // the filters may come before it
+  PRUint32 ParameterIndex(sbIDatabasePreparedStatement* aStatement,
+                          PRUint32 aIndex);
+
   nsresult GetPrimarySortKeyPosition(const nsAString& aValue,
                                      PRUint32 *_retval);
 
@@ -268,6 +294,16 @@ private:
   nsString mPrimarySortKeyPositionQuery;
   nsCOMPtr<sbIDatabasePreparedStatement> mPrimarySortKeyPositionStatement;
 
+  // Statements prepared by UpdateQueries, keyed by their SQL. The values of
+  // the filters are bound as parameters, so changing only those values
+  // reuses the statements.
+  nsInterfaceHashtable<nsStringHashKey, sbIDatabasePreparedStatement>
+    mStatementCache;
+
+  // Parameters of the current statements
+  nsClassHashtable<nsISupportsHashKey, StatementParameters>
+    mStatementParameters;
+
   // Cached versions of some of the above variables used my the fetch
   nsCOMPtr<sbIDatabasePreparedStatement> mStatementX;
   nsCOMPtr<sbIDatabasePreparedStatement> mStatementY;
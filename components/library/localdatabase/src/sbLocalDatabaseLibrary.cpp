@@ -84,12 +84,15 @@
 #include <prlog.h>
 #include <prprf.h>
 #include <prtime.h>
+#include "sbLocalDatabaseBulkCreateHelper.h"
 #include "sbLocalDatabaseCID.h"
+#include "sbLocalDatabaseLibraryStatistics.h"
 #include "sbLocalDatabaseMediaItem.h"
 #include "sbLocalDatabaseMediaListView.h"
 #include "sbLocalDatabasePropertyCache.h"
 #include "sbLocalDatabaseSimpleMediaListFactory.h"
 #include "sbLocalDatabaseSchemaInfo.h"
+#include "sbLocalDatabaseSQL.h"
 #include "sbLocalDatabaseSmartMediaListFactory.h"
 #include "sbLocalDatabaseGUIDArray.h"
 #include "sbMediaListEnumSingleItemHelper.h"
@@ -1979,7 +1982,15 @@ sbLocalDatabaseLibrary::Shutdown()
 
   // Explicitly release our property cache here so we make sure to write all
   // changes to disk (regardless of whether or not this library will be leaked)
-  // to prevent data loss.
+  // to prevent data loss. The statistics stay around since the cache still
+  // tells them about what it writes.
+  if (mStatistics) {
+#ifdef DEBUG
+    nsresult rv =
+#endif
+    mStatistics->Shutdown();
+    NS_ASSERTION(NS_SUCCEEDED(rv), "Failed to shut down library statistics");
+  }
   mPropertyCache = nsnull;
 
   mCreateMediaItemPreparedStatement = nsnull;
@@ -2195,6 +2206,25 @@ sbLocalDatabaseLibrary::CreateQuery(sbIDatabaseQuery** _retval)
   return MakeStandardQuery(_retval);
 }
 
+/**
+ * See sbILocalDatabaseLibrary
+ */
+NS_IMETHODIMP
+sbLocalDatabaseLibrary::BulkCreateMediaItems(nsIArray* aURIArray,
+                                             nsIArray* aPropertyArrayArray,
+                                             PRUint32 aFlags,
+                                             sbILocalDatabaseBulkCreateResult** _retval)
+{
+  NS_ENSURE_ARG_POINTER(aURIArray);
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  TRACE(("LocalDatabaseLibrary[0x%.8x] - BulkCreateMediaItems(0x%x)", this,
+         aFlags));
+
+  sbLocalDatabaseBulkCreateHelper helper(this, aFlags);
+  return helper.Run(aURIArray, aPropertyArrayArray, _retval);
+}
+
 /**
  * See sbILocalDatabaseLibrary
  */
@@ -3556,7 +3586,9 @@ sbLocalDatabaseLibrary::BatchCreateMediaItemsInternal(nsIArray* aURIArray,
     callback = new sbBatchCreateTimerCallback(this, aListener, query);
     NS_ENSURE_TRUE(callback, NS_ERROR_OUT_OF_MEMORY);
 
-    rv = callback->Init();
+    // Async creates started on the main thread write the items with the
+    // multi-row inserts of BulkCreateMediaItems on the database thread.
+    rv = callback->Init(NS_IsMainThread());
     NS_ENSURE_SUCCESS(rv, rv);
 
     helper = callback->BatchHelper();
@@ -3567,7 +3599,14 @@ sbLocalDatabaseLibrary::BatchCreateMediaItemsInternal(nsIArray* aURIArray,
   }
 
   // Set up the batch add query
-  rv = helper->InitQuery(query, filteredArray.forget(), filteredPropertyArrayArray);
+  if (runAsync && callback->BulkHelper()) {
+    rv = callback->InitBulkQuery(filteredArray, filteredPropertyArrayArray);
+  }
+  else {
+    rv = helper->InitQuery(query,
+                           filteredArray.forget(),
+                           filteredPropertyArrayArray);
+  }
   NS_ENSURE_SUCCESS(rv, rv);
 
   PRInt32 dbResult;
@@ -4673,7 +4712,8 @@ sbBatchCreateTimerCallback::sbBatchCreateTimerCallback(
   mListener(aListener),
   mQuery(aQuery),
   mTimer(nsnull),
-  mQueryCount(0)
+  mQueryCount(0),
+  mItemCount(0)
 {
   NS_ASSERTION(aLibrary, "Null library!");
   NS_ASSERTION(aListener, "Null listener!");
@@ -4681,14 +4721,40 @@ sbBatchCreateTimerCallback::sbBatchCreateTimerCallback(
 }
 
 nsresult
-sbBatchCreateTimerCallback::Init()
+sbBatchCreateTimerCallback::Init(PRBool aBulk)
 {
+  if (aBulk) {
+    mBulkHelper =
+      new sbLocalDatabaseBulkCreateHelper(mLibrary,
+        sbILocalDatabaseLibrary::BULK_CREATE_ALLOW_DUPLICATES |
+        sbILocalDatabaseLibrary::BULK_CREATE_RETURN_ITEMS);
+    NS_ENSURE_TRUE(mBulkHelper, NS_ERROR_OUT_OF_MEMORY);
+  }
+
   mBatchHelper = new sbBatchCreateHelper(mLibrary, this);
   NS_ENSURE_TRUE(mBatchHelper, NS_ERROR_OUT_OF_MEMORY);
 
   return NS_OK;
 }
 
+nsresult
+sbBatchCreateTimerCallback::InitBulkQuery(nsStringArray* aURIArray,
+                                          nsIArray* aPropertyArrayArray)
+{
+  NS_ENSURE_TRUE(mBulkHelper, NS_ERROR_NOT_INITIALIZED);
+
+  nsresult rv = mBulkHelper->InitQuery(mQuery,
+                                       aURIArray,
+                                       aPropertyArrayArray);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  mItemCount = aURIArray->Count();
+
+  PRUint32 queryCount = 0;
+  mQuery->GetQueryCount(&queryCount);
+  return SetQueryCount(queryCount);
+}
+
 nsresult
 sbBatchCreateTimerCallback::SetQueryCount(PRUint32 aQueryCount)
 {
@@ -4703,6 +4769,12 @@ sbBatchCreateTimerCallback::BatchHelper()
   return mBatchHelper;
 }
 
+sbLocalDatabaseBulkCreateHelper*
+sbBatchCreateTimerCallback::BulkHelper()
+{
+  return mBulkHelper;
+}
+
 NS_IMETHODIMP
 sbBatchCreateTimerCallback::Notify(nsITimer* aTimer)
 {
@@ -4723,7 +4795,14 @@ sbBatchCreateTimerCallback::Notify(nsITimer* aTimer)
 
   // Gather the media items we added and call the listener.
   nsCOMPtr<nsIArray> array;
-  if (NS_SUCCEEDED(rv)) {
+  if (NS_SUCCEEDED(rv) && mBulkHelper) {
+    nsCOMPtr<sbILocalDatabaseBulkCreateResult> result;
+    rv = mBulkHelper->Finish(mQuery, getter_AddRefs(result));
+    if (NS_SUCCEEDED(rv)) {
+      rv = result->GetMediaItems(getter_AddRefs(array));
+    }
+  }
+  else if (NS_SUCCEEDED(rv)) {
     rv = mBatchHelper->NotifyAndGetItems(getter_AddRefs(array));
   }
 
@@ -4769,8 +4848,13 @@ sbBatchCreateTimerCallback::NotifyInternal(PRBool* _retval)
       isExecuting) {
 
     // Notify listener of progress.
-    // There is one query per item, plus a BEGIN and COMMIT.
+    // There is one query per item, plus a BEGIN and COMMIT. Bulk inserts
+    // write many items per query, so scale the position instead.
     PRUint32 itemIndex = (currentQuery > 2) ? currentQuery - 2 : 0;
+    if (mBulkHelper) {
+      itemIndex = (PRUint32)((PRUint64)mItemCount * currentQuery /
+                             mQueryCount);
+    }
     mListener->OnProgress(itemIndex);
 
     *_retval = PR_FALSE;
@@ -4947,25 +5031,22 @@ sbLocalDatabaseLibrary::InitializeLibraryStatistics() {
   // make the SUM query
   rv = MakeStandardQuery(getter_AddRefs(mStatisticsSumQuery));
   NS_ENSURE_SUCCESS(rv, rv);
-  // what's the SQL?
-  NS_NAMED_MULTILINE_LITERAL_STRING(sumQuery,
-    NS_LL("SELECT value1.obj, SUM(value2.obj)")
-    NS_LL("  FROM properties AS property1")
-    NS_LL("    INNER JOIN resource_properties AS value1")
-    NS_LL("      ON value1.property_id = property1.property_id")
-    NS_LL("    INNER JOIN resource_properties AS value2")
-    NS_LL("      ON value1.media_item_id = value2.media_item_id")
-    NS_LL("    INNER JOIN properties AS property2")
-    NS_LL("      ON value2.property_id = property2.property_id")
-    NS_LL("  WHERE property1.property_name = ?")
-    NS_LL("    AND property2.property_name = ?")
-    NS_LL("  GROUP BY value1.obj")
-    NS_LL("  ORDER BY ? * SUM(value2.obj)")
-    NS_LL("  LIMIT ?;"));
   // add the SQL to the query object
-  rv = mStatisticsSumQuery->PrepareQuery(sumQuery, getter_AddRefs(mStatisticsSumPreparedStatement));
+  rv = mStatisticsSumQuery->PrepareQuery(sbLocalDatabaseSQL::StatisticsSumSelect(),
+                                         getter_AddRefs(mStatisticsSumPreparedStatement));
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // keep the sums of the common properties in memory
+  mStatistics = new sbLocalDatabaseLibraryStatistics(this);
+  NS_ENSURE_TRUE(mStatistics, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = mStatistics->Init();
+  if (NS_FAILED(rv)) {
+    NS_WARNING("Failed to initialize library statistics");
+    mStatistics = nsnull;
+    return rv;
+  }
+
   return NS_OK;
 }
 
@@ -4988,6 +5069,18 @@ sbLocalDatabaseLibrary::CollectDistinctValues(const nsAString & aProperty,
 
   switch(aCollectionMethod) {
     case COLLECT_SUM:
+      // use the in memory sums if we have them
+      if (mStatistics) {
+        rv = mStatistics->CollectSum(aProperty,
+                                     aOtherProperty,
+                                     aAscending,
+                                     aMaxResults,
+                                     _retval);
+        if (rv != NS_ERROR_NOT_AVAILABLE) {
+          return rv;
+        }
+      }
+
       query = mStatisticsSumQuery;
       query->AddPreparedStatement(mStatisticsSumPreparedStatement);
       query->BindStringParameter(0, aProperty);
@@ -5034,6 +5127,28 @@ sbLocalDatabaseLibrary::CollectDistinctValues(const nsAString & aProperty,
   return CallQueryInterface(array, _retval);
 }
 
+NS_IMETHODIMP
+sbLocalDatabaseLibrary::CollectDistinctValuesAsync(const nsAString & aProperty,
+                                                   PRUint32 aCollectionMethod,
+                                                   const nsAString & aOtherProperty,
+                                                   PRBool aAscending,
+                                                   PRUint32 aMaxResults,
+                                                   sbILibraryStatisticsListener *aListener)
+{
+  NS_ENSURE_ARG_POINTER(aListener);
+
+  // main thread only, thanks!
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_FAILURE);
+  NS_ENSURE_TRUE(aCollectionMethod == COLLECT_SUM, NS_ERROR_INVALID_ARG);
+  NS_ENSURE_STATE(mStatistics);
+
+  return mStatistics->CollectSumAsync(aProperty,
+                                      aOtherProperty,
+                                      aAscending,
+                                      aMaxResults,
+                                      aListener);
+}
+
 nsresult
 sbLocalDatabaseLibrary::NeedsReindexCollations(PRBool *aNeedsReindexCollations) {
 
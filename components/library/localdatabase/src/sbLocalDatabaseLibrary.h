@@ -32,6 +32,7 @@
 #include <sbILibrary.h>
 #include <sbILocalDatabaseLibrary.h>
 #include <sbILocalDatabaseSimpleMediaList.h>
+#include "sbLocalDatabaseBulkCreateHelper.h"
 #include "sbLocalDatabaseMediaListBase.h"
 #include <sbProxiedComponentManager.h>
 
@@ -64,6 +65,7 @@ class sbILocalDatabasePropertyCache;
 class sbILocalDatabaseGUIDArrayLengthCache;
 class sbLibraryInsertingEnumerationListener;
 class sbLibraryRemovingEnumerationListener;
+class sbLocalDatabaseLibraryStatistics;
 class sbLocalDatabaseMediaListView;
 class sbLocalDatabasePropertyCache;
 class nsIPrefBranch;
@@ -152,6 +154,8 @@ class sbLocalDatabaseLibrary : public sbLocalDatabaseMediaListBase,
   friend class sbLocalDatabasePropertyCache;
   friend class sbBatchCreateTimerCallback;
   friend class sbBatchCreateHelper;
+  friend class sbLocalDatabaseBulkCreateHelper;
+  friend class sbLocalDatabaseLibraryStatistics;
 
   struct sbMediaListFactoryInfo {
     sbMediaListFactoryInfo()
@@ -442,6 +446,8 @@ private:
   // precompiled queries for library stats
   nsCOMPtr<sbIDatabaseQuery> mStatisticsSumQuery;
   nsCOMPtr<sbIDatabasePreparedStatement> mStatisticsSumPreparedStatement;
+  // in memory sums for the common properties, written by the property cache
+  nsRefPtr<sbLocalDatabaseLibraryStatistics> mStatistics;
 
   nsresult FindMusicFolderURI(nsIURI ** aMusicFolderURI);
 
@@ -524,7 +530,12 @@ public:
                              sbIBatchCreateMediaItemsListener* aListener,
                              sbIDatabaseQuery* aQuery);
 
-  nsresult Init();
+  // When aBulk is set the items are written by a
+  // sbLocalDatabaseBulkCreateHelper; call InitBulkQuery to set up the query.
+  nsresult Init(PRBool aBulk = PR_FALSE);
+
+  nsresult InitBulkQuery(nsStringArray* aURIArray,
+                         nsIArray* aPropertyArrayArray);
 
   nsresult SetQueryCount(PRUint32 aQueryCount);
 
@@ -532,13 +543,17 @@ public:
 
   sbBatchCreateHelper* BatchHelper();
 
+  sbLocalDatabaseBulkCreateHelper* BulkHelper();
+
 private:
   sbLocalDatabaseLibrary* mLibrary;
   nsCOMPtr<sbIBatchCreateMediaItemsListener> mListener;
   nsRefPtr<sbBatchCreateHelper> mBatchHelper;
+  nsAutoPtr<sbLocalDatabaseBulkCreateHelper> mBulkHelper;
   nsCOMPtr<sbIDatabaseQuery> mQuery;
   nsITimer* mTimer;
   PRUint32 mQueryCount;
+  PRUint32 mItemCount;
 
 };
 
@@ -0,0 +1,1279 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#include "sbLocalDatabaseLibraryStatistics.h"
+
+#include <nsAutoLock.h>
+#include <nsClassHashtable.h>
+#include <nsComponentManagerUtils.h>
+#include <nsHashKeys.h>
+#include <nsIMutableArray.h>
+#include <nsIRunnable.h>
+#include <nsIThreadPool.h>
+#include <nsIVariant.h>
+#include <nsServiceManagerUtils.h>
+#include <nsThreadUtils.h>
+#include <prlog.h>
+
+#include <sbIDatabaseQuery.h>
+#include <sbIDatabaseResult.h>
+#include <sbILibraryStatistics.h>
+#include <sbILocalDatabaseMediaItem.h>
+#include <sbILocalDatabasePropertyCache.h>
+#include <sbILocalDatabaseResourcePropertyBag.h>
+#include <sbIMediaItem.h>
+#include <sbIMediaList.h>
+#include <sbStandardProperties.h>
+#include <sbStringUtils.h>
+#include <sbThreadPoolService.h>
+
+#include "sbLocalDatabaseLibrary.h"
+#include "sbLocalDatabaseResourcePropertyBag.h"
+#include "sbLocalDatabaseSchemaInfo.h"
+#include "sbLocalDatabaseSQL.h"
+
+/**
+ * To log this module, set the following environment variable:
+ *   NSPR_LOG_MODULES=sbLocalDatabaseLibraryStatistics:5
+ */
+#ifdef PR_LOGGING
+static PRLogModuleInfo* gLibraryStatisticsLog = nsnull;
+#define TRACE(args) PR_LOG(gLibraryStatisticsLog, PR_LOG_DEBUG, args)
+#define LOG(args)   PR_LOG(gLibraryStatisticsLog, PR_LOG_WARN, args)
+#else
+#define TRACE(args) /* nothing */
+#define LOG(args)   /* nothing */
+#endif
+
+typedef sbLocalDatabaseLibraryStatistics::ItemValues sbItemValues;
+typedef sbLocalDatabaseLibraryStatistics::Change sbItemChange;
+
+// The properties whose distinct values are tracked
+static const char* const
+  sGroupProperties[sbLocalDatabaseLibraryStatistics::GROUP_COUNT] = {
+  SB_PROPERTY_ARTISTNAME,
+  SB_PROPERTY_ALBUMNAME,
+  SB_PROPERTY_GENRE
+};
+
+// The properties summed up for each distinct value. The content length must
+// stay last, see sbLocalDatabaseSQL::StatisticsValuesSelect.
+static const char* const
+  sValueProperties[sbLocalDatabaseLibraryStatistics::VALUE_COUNT] = {
+  SB_PROPERTY_PLAYCOUNT,
+  SB_PROPERTY_RATING,
+  SB_PROPERTY_DURATION,
+  SB_PROPERTY_CONTENTLENGTH
+};
+
+#define CONTENT_LENGTH_SLOT (sbLocalDatabaseLibraryStatistics::VALUE_COUNT - 1)
+
+/**
+ * \brief The sums of one distinct value of a group property.
+ */
+struct sbLibraryStatisticsAggregate
+{
+  sbLibraryStatisticsAggregate(const nsAString& aValue) :
+    value(aValue),
+    itemCount(0)
+  {
+    for (PRUint32 i = 0; i < sbLocalDatabaseLibraryStatistics::VALUE_COUNT; i++) {
+      sums[i] = 0;
+      counts[i] = 0;
+    }
+  }
+
+  nsString value;
+  // The number of items with this value
+  PRUint32 itemCount;
+  // The sums of each value property, and the number of items that have it
+  PRInt64  sums[sbLocalDatabaseLibraryStatistics::VALUE_COUNT];
+  PRUint32 counts[sbLocalDatabaseLibraryStatistics::VALUE_COUNT];
+};
+
+/**
+ * \brief What one item contributes to the aggregates, so that it can be
+ *        taken back out when the item changes or goes away.
+ */
+struct sbLibraryStatisticsItem
+{
+  sbLibraryStatisticsAggregate* groups[sbLocalDatabaseLibraryStatistics::GROUP_COUNT];
+  PRInt64  values[sbLocalDatabaseLibraryStatistics::VALUE_COUNT];
+  PRUint32 valueMask;
+};
+
+/**
+ * \brief The aggregates of all tracked properties. Not thread safe.
+ */
+class sbLibraryStatisticsAggregates
+{
+public:
+  nsresult Init();
+
+  // Set the values of an item, replacing the ones it had
+  nsresult Set(PRUint32 aMediaItemId, const sbItemValues& aValues);
+  void Remove(PRUint32 aMediaItemId);
+
+  nsresult Apply(const sbItemChange& aChange)
+  {
+    if (aChange.removed) {
+      Remove(aChange.mediaItemId);
+      return NS_OK;
+    }
+    return Set(aChange.mediaItemId, aChange.values);
+  }
+
+  // Collect the values of a group ordered by the sums of a value property,
+  // like sbLocalDatabaseSQL::StatisticsSumSelect does.
+  nsresult Collect(PRUint32 aGroup,
+                   PRUint32 aValue,
+                   PRBool aAscending,
+                   PRUint32 aMaxResults,
+                   nsTArray<nsString>& aValues);
+
+private:
+  struct SortEntry {
+    PRInt64 sum;
+    const nsString* value;
+  };
+
+  class SortComparator
+  {
+  public:
+    SortComparator(PRBool aAscending) : mAscending(aAscending) {}
+
+    PRBool Equals(const SortEntry& a, const SortEntry& b) const
+    {
+      return a.sum == b.sum && a.value->Equals(*b.value);
+    }
+
+    PRBool LessThan(const SortEntry& a, const SortEntry& b) const
+    {
+      if (a.sum != b.sum) {
+        return mAscending ? a.sum < b.sum : a.sum > b.sum;
+      }
+      return a.value->Compare(*b.value) < 0;
+    }
+
+  private:
+    PRBool mAscending;
+  };
+
+  struct CollectClosure {
+    PRUint32 value;
+    nsTArray<SortEntry>* entries;
+  };
+
+  static PLDHashOperator PR_CALLBACK
+    CollectEntry(nsStringHashKey::KeyType aKey,
+                 sbLibraryStatisticsAggregate* aAggregate,
+                 void* aClosure);
+
+  void RemoveContribution(sbLibraryStatisticsItem* aItem);
+
+  nsClassHashtable<nsStringHashKey, sbLibraryStatisticsAggregate>
+    mGroups[sbLocalDatabaseLibraryStatistics::GROUP_COUNT];
+  nsClassHashtable<nsUint32HashKey, sbLibraryStatisticsItem> mItems;
+};
+
+nsresult
+sbLibraryStatisticsAggregates::Init()
+{
+  for (PRUint32 i = 0; i < sbLocalDatabaseLibraryStatistics::GROUP_COUNT; i++) {
+    NS_ENSURE_TRUE(mGroups[i].Init(), NS_ERROR_OUT_OF_MEMORY);
+  }
+  NS_ENSURE_TRUE(mItems.Init(), NS_ERROR_OUT_OF_MEMORY);
+  return NS_OK;
+}
+
+void
+sbLibraryStatisticsAggregates::RemoveContribution(sbLibraryStatisticsItem* aItem)
+{
+  for (PRUint32 i = 0; i < sbLocalDatabaseLibraryStatistics::GROUP_COUNT; i++) {
+    sbLibraryStatisticsAggregate* aggregate = aItem->groups[i];
+    if (!aggregate) {
+      continue;
+    }
+
+    for (PRUint32 j = 0; j < sbLocalDatabaseLibraryStatistics::VALUE_COUNT; j++) {
+      if (aItem->valueMask & (1 << j)) {
+        aggregate->sums[j] -= aItem->values[j];
+        aggregate->counts[j]--;
+      }
+    }
+
+    if (--aggregate->itemCount == 0) {
+      // The key is owned by the aggregate that is about to go away
+      nsString key(aggregate->value);
+      mGroups[i].Remove(key);
+    }
+    aItem->groups[i] = nsnull;
+  }
+}
+
+nsresult
+sbLibraryStatisticsAggregates::Set(PRUint32 aMediaItemId,
+                                   const sbItemValues& aValues)
+{
+  sbLibraryStatisticsItem* item = nsnull;
+  if (mItems.Get(aMediaItemId, &item)) {
+    RemoveContribution(item);
+  }
+
+  PRBool hasGroup = PR_FALSE;
+  for (PRUint32 i = 0; i < sbLocalDatabaseLibraryStatistics::GROUP_COUNT; i++) {
+    if (!aValues.groups[i].IsVoid()) {
+      hasGroup = PR_TRUE;
+      break;
+    }
+  }
+
+  // Items without any of the group properties do not count anywhere
+  if (!hasGroup) {
+    if (item) {
+      mItems.Remove(aMediaItemId);
+    }
+    return NS_OK;
+  }
+
+  if (!item) {
+    nsAutoPtr<sbLibraryStatisticsItem> newItem(new sbLibraryStatisticsItem);
+    NS_ENSURE_TRUE(newItem, NS_ERROR_OUT_OF_MEMORY);
+
+    PRBool success = mItems.Put(aMediaItemId, newItem);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+    item = newItem.forget();
+  }
+
+  item->valueMask = aValues.valueMask;
+  for (PRUint32 j = 0; j < sbLocalDatabaseLibraryStatistics::VALUE_COUNT; j++) {
+    item->values[j] = aValues.values[j];
+  }
+
+  for (PRUint32 i = 0; i < sbLocalDatabaseLibraryStatistics::GROUP_COUNT; i++) {
+    item->groups[i] = nsnull;
+    if (aValues.groups[i].IsVoid()) {
+      continue;
+    }
+
+    sbLibraryStatisticsAggregate* aggregate;
+    if (!mGroups[i].Get(aValues.groups[i], &aggregate)) {
+      nsAutoPtr<sbLibraryStatisticsAggregate> newAggregate(
+        new sbLibraryStatisticsAggregate(aValues.groups[i]));
+      NS_ENSURE_TRUE(newAggregate, NS_ERROR_OUT_OF_MEMORY);
+
+      PRBool success = mGroups[i].Put(aValues.groups[i], newAggregate);
+      NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+      aggregate = newAggregate.forget();
+    }
+
+    aggregate->itemCount++;
+    for (PRUint32 j = 0; j < sbLocalDatabaseLibraryStatistics::VALUE_COUNT; j++) {
+      if (item->valueMask & (1 << j)) {
+        aggregate->sums[j] += item->values[j];
+        aggregate->counts[j]++;
+      }
+    }
+    item->groups[i] = aggregate;
+  }
+
+  return NS_OK;
+}
+
+void
+sbLibraryStatisticsAggregates::Remove(PRUint32 aMediaItemId)
+{
+  sbLibraryStatisticsItem* item;
+  if (mItems.Get(aMediaItemId, &item)) {
+    RemoveContribution(item);
+    mItems.Remove(aMediaItemId);
+  }
+}
+
+/* static */ PLDHashOperator PR_CALLBACK
+sbLibraryStatisticsAggregates::CollectEntry(nsStringHashKey::KeyType aKey,
+                                            sbLibraryStatisticsAggregate* aAggregate,
+                                            void* aClosure)
+{
+  CollectClosure* closure = static_cast<CollectClosure*>(aClosure);
+
+  // Like the inner join of the query, skip values none of whose items have
+  // the summed property
+  if (aAggregate->counts[closure->value] == 0) {
+    return PL_DHASH_NEXT;
+  }
+
+  SortEntry* entry = closure->entries->AppendElement();
+  NS_ENSURE_TRUE(entry, PL_DHASH_STOP);
+
+  entry->sum = aAggregate->sums[closure->value];
+  entry->value = &aAggregate->value;
+  return PL_DHASH_NEXT;
+}
+
+nsresult
+sbLibraryStatisticsAggregates::Collect(PRUint32 aGroup,
+                                       PRUint32 aValue,
+                                       PRBool aAscending,
+                                       PRUint32 aMaxResults,
+                                       nsTArray<nsString>& aValues)
+{
+  NS_ASSERTION(aGroup < sbLocalDatabaseLibraryStatistics::GROUP_COUNT &&
+               aValue < sbLocalDatabaseLibraryStatistics::VALUE_COUNT,
+               "Bad statistics slot");
+
+  nsTArray<SortEntry> entries(mGroups[aGroup].Count());
+  CollectClosure closure = { aValue, &entries };
+  mGroups[aGroup].EnumerateRead(CollectEntry, &closure);
+
+  entries.Sort(SortComparator(aAscending));
+
+  PRUint32 length = PR_MIN(aMaxResults, entries.Length());
+  aValues.Clear();
+  NS_ENSURE_TRUE(aValues.SetCapacity(length), NS_ERROR_OUT_OF_MEMORY);
+  for (PRUint32 i = 0; i < length; i++) {
+    aValues.AppendElement(*entries[i].value);
+  }
+
+  return NS_OK;
+}
+
+/**
+ * \brief Loads the aggregates on a background thread.
+ */
+class sbLibraryStatisticsLoader : public nsIRunnable
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIRUNNABLE
+
+  sbLibraryStatisticsLoader(sbLocalDatabaseLibraryStatistics* aStatistics,
+                            sbIDatabaseQuery* aQuery,
+                            const PRUint32* aGroupDBIDs,
+                            const PRUint32* aValueDBIDs) :
+    mStatistics(aStatistics),
+    mQuery(aQuery),
+    mResult(NS_OK)
+  {
+    memcpy(mGroupDBIDs, aGroupDBIDs, sizeof(mGroupDBIDs));
+    memcpy(mValueDBIDs, aValueDBIDs, sizeof(mValueDBIDs));
+  }
+
+  // Called on the main thread once loading is done
+  void Complete()
+  {
+    mStatistics->LoadComplete(mResult, mAggregates.forget());
+  }
+
+private:
+  nsresult Load();
+
+  static PLDHashOperator PR_CALLBACK
+    AddItem(nsUint32HashKey::KeyType aKey,
+            sbItemValues* aValues,
+            void* aClosure);
+
+  nsRefPtr<sbLocalDatabaseLibraryStatistics> mStatistics;
+  nsCOMPtr<sbIDatabaseQuery> mQuery;
+  PRUint32 mGroupDBIDs[sbLocalDatabaseLibraryStatistics::GROUP_COUNT];
+  PRUint32 mValueDBIDs[sbLocalDatabaseLibraryStatistics::VALUE_COUNT];
+
+  nsresult mResult;
+  nsAutoPtr<sbLibraryStatisticsAggregates> mAggregates;
+};
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbLibraryStatisticsLoader, nsIRunnable)
+
+NS_IMETHODIMP
+sbLibraryStatisticsLoader::Run()
+{
+  mResult = Load();
+
+  nsCOMPtr<nsIRunnable> runnable =
+    NS_NEW_RUNNABLE_METHOD(sbLibraryStatisticsLoader, this, Complete);
+  NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+  return NS_DispatchToMainThread(runnable);
+}
+
+/* static */ PLDHashOperator PR_CALLBACK
+sbLibraryStatisticsLoader::AddItem(nsUint32HashKey::KeyType aKey,
+                                   sbItemValues* aValues,
+                                   void* aClosure)
+{
+  sbLibraryStatisticsAggregates* aggregates =
+    static_cast<sbLibraryStatisticsAggregates*>(aClosure);
+
+  nsresult rv = aggregates->Set(aKey, *aValues);
+  NS_ENSURE_SUCCESS(rv, PL_DHASH_STOP);
+
+  return PL_DHASH_NEXT;
+}
+
+nsresult
+sbLibraryStatisticsLoader::Load()
+{
+  nsresult rv;
+
+  PRInt32 dbResult;
+  rv = mQuery->Execute(&dbResult);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbResult == 0, NS_ERROR_FAILURE);
+
+  nsCOMPtr<sbIDatabaseResult> result;
+  rv = mQuery->GetResultObject(getter_AddRefs(result));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // The query is not needed anymore and is rather big
+  mQuery = nsnull;
+
+  PRUint32 rowCount;
+  rv = result->GetRowCount(&rowCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Gather the values by item first; the rows of an item are not together.
+  nsClassHashtable<nsUint32HashKey, sbItemValues> items;
+  NS_ENSURE_TRUE(items.Init(), NS_ERROR_OUT_OF_MEMORY);
+
+  for (PRUint32 row = 0; row < rowCount; row++) {
+    nsString cell;
+    rv = result->GetRowCell(row, 0, cell);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRUint32 mediaItemId = cell.ToInteger(&rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = result->GetRowCell(row, 1, cell);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    // Top level property ids do not fit in an PRInt32
+    PRUint32 propertyDBID = (PRUint32)nsString_ToUint64(cell, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = result->GetRowCell(row, 2, cell);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    sbItemValues* values;
+    if (!items.Get(mediaItemId, &values)) {
+      nsAutoPtr<sbItemValues> newValues(new sbItemValues);
+      NS_ENSURE_TRUE(newValues, NS_ERROR_OUT_OF_MEMORY);
+
+      PRBool success = items.Put(mediaItemId, newValues);
+      NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+      values = newValues.forget();
+    }
+
+    for (PRUint32 i = 0; i < sbLocalDatabaseLibraryStatistics::GROUP_COUNT; i++) {
+      if (mGroupDBIDs[i] == propertyDBID) {
+        values->groups[i] = cell;
+      }
+    }
+    for (PRUint32 i = 0; i < sbLocalDatabaseLibraryStatistics::VALUE_COUNT; i++) {
+      if (mValueDBIDs[i] == propertyDBID) {
+        // Like SUM(), count values that are not numbers as 0
+        values->values[i] = nsString_ToInt64(cell, &rv);
+        if (NS_FAILED(rv)) {
+          values->values[i] = 0;
+        }
+        values->valueMask |= 1 << i;
+      }
+    }
+  }
+
+  result = nsnull;
+
+  mAggregates = new sbLibraryStatisticsAggregates();
+  NS_ENSURE_TRUE(mAggregates, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = mAggregates->Init();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 count = items.Count();
+  NS_ENSURE_TRUE(items.EnumerateRead(AddItem, mAggregates.get()) == count,
+                 NS_ERROR_OUT_OF_MEMORY);
+
+  TRACE(("sbLibraryStatisticsLoader[0x%.8x] - Loaded %d items", this, count));
+  return NS_OK;
+}
+
+/**
+ * \brief One call to collectDistinctValuesAsync. Runs on a background thread
+ *        if the values have to be queried.
+ */
+class sbLibraryStatisticsRequest : public nsIRunnable
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIRUNNABLE
+
+  sbLibraryStatisticsRequest(PRUint32 aGroup,
+                             PRUint32 aValue,
+                             PRBool aAscending,
+                             PRUint32 aMaxResults,
+                             sbILibraryStatisticsListener* aListener) :
+    group(aGroup),
+    value(aValue),
+    ascending(aAscending),
+    maxResults(aMaxResults),
+    result(NS_OK),
+    mListener(aListener)
+  {
+  }
+
+  // Pass the values to the listener, on the main thread
+  void Notify();
+
+  PRUint32 group;
+  PRUint32 value;
+  PRBool ascending;
+  PRUint32 maxResults;
+
+  nsCOMPtr<sbIDatabaseQuery> query;
+
+  nsresult result;
+  nsTArray<nsString> values;
+
+private:
+  nsresult RunQuery();
+
+  nsCOMPtr<sbILibraryStatisticsListener> mListener;
+};
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbLibraryStatisticsRequest, nsIRunnable)
+
+NS_IMETHODIMP
+sbLibraryStatisticsRequest::Run()
+{
+  result = RunQuery();
+  query = nsnull;
+
+  nsCOMPtr<nsIRunnable> runnable =
+    NS_NEW_RUNNABLE_METHOD(sbLibraryStatisticsRequest, this, Notify);
+  NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+  return NS_DispatchToMainThread(runnable);
+}
+
+nsresult
+sbLibraryStatisticsRequest::RunQuery()
+{
+  NS_ENSURE_STATE(query);
+
+  PRInt32 dbResult;
+  nsresult rv = query->Execute(&dbResult);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbResult == 0, NS_ERROR_FAILURE);
+
+  nsCOMPtr<sbIDatabaseResult> dbResultObject;
+  rv = query->GetResultObject(getter_AddRefs(dbResultObject));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 rowCount;
+  rv = dbResultObject->GetRowCount(&rowCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  for (PRUint32 i = 0; i < rowCount; i++) {
+    nsString* cell = values.AppendElement();
+    NS_ENSURE_TRUE(cell, NS_ERROR_OUT_OF_MEMORY);
+
+    rv = dbResultObject->GetRowCell(i, 0, *cell);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+void
+sbLibraryStatisticsRequest::Notify()
+{
+  NS_ASSERTION(NS_IsMainThread(), "Notify off the main thread");
+
+  nsCOMPtr<nsIArray> array;
+  if (NS_SUCCEEDED(result)) {
+    result = sbLocalDatabaseLibraryStatistics::CreateValueArray(
+               values, getter_AddRefs(array));
+  }
+
+  // Release the listener here, it may not be safe to do so elsewhere
+  nsCOMPtr<sbILibraryStatisticsListener> listener;
+  listener.swap(mListener);
+  if (listener) {
+    listener->OnDistinctValuesCollected(result, array);
+  }
+}
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbLocalDatabaseLibraryStatistics,
+                              sbIMediaListListener)
+
+sbLocalDatabaseLibraryStatistics::sbLocalDatabaseLibraryStatistics
+                                    (sbLocalDatabaseLibrary* aLibrary) :
+  mLibrary(aLibrary),
+  mLock(nsnull),
+  mState(STATE_UNLOADED),
+  mShutdown(PR_FALSE),
+  mReloadNeeded(PR_FALSE),
+  mInvalidatePending(PR_FALSE)
+{
+  NS_ASSERTION(aLibrary, "aLibrary is null");
+#ifdef PR_LOGGING
+  if (!gLibraryStatisticsLog) {
+    gLibraryStatisticsLog = PR_NewLogModule("sbLocalDatabaseLibraryStatistics");
+  }
+#endif
+}
+
+sbLocalDatabaseLibraryStatistics::~sbLocalDatabaseLibraryStatistics()
+{
+  if (mLock) {
+    nsAutoLock::DestroyLock(mLock);
+  }
+}
+
+nsresult
+sbLocalDatabaseLibraryStatistics::Init()
+{
+  nsresult rv;
+
+  mLock = nsAutoLock::NewLock("sbLocalDatabaseLibraryStatistics::mLock");
+  NS_ENSURE_TRUE(mLock, NS_ERROR_OUT_OF_MEMORY);
+
+  mThreadPool = do_GetService(SB_THREADPOOLSERVICE_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCOMPtr<sbILocalDatabasePropertyCache> propertyCache =
+    mLibrary->mPropertyCache;
+  NS_ENSURE_STATE(propertyCache);
+
+  for (PRUint32 i = 0; i < GROUP_COUNT; i++) {
+    rv = propertyCache->GetPropertyDBID(
+           NS_ConvertASCIItoUTF16(sGroupProperties[i]), &mGroupDBIDs[i]);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+  for (PRUint32 i = 0; i < VALUE_COUNT; i++) {
+    rv = propertyCache->GetPropertyDBID(
+           NS_ConvertASCIItoUTF16(sValueProperties[i]), &mValueDBIDs[i]);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  rv = mLibrary->AddListener(this,
+                             PR_FALSE,
+                             sbIMediaList::LISTENER_FLAGS_ITEMADDED |
+                             sbIMediaList::LISTENER_FLAGS_AFTERITEMREMOVED |
+                             sbIMediaList::LISTENER_FLAGS_LISTCLEARED |
+                             sbIMediaList::LISTENER_FLAGS_BATCHBEGIN |
+                             sbIMediaList::LISTENER_FLAGS_BATCHEND,
+                             nsnull);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseLibraryStatistics::Shutdown()
+{
+  TRACE(("sbLocalDatabaseLibraryStatistics[0x%.8x] - Shutdown()", this));
+
+  nsresult rv = mLibrary->RemoveListener(this);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  {
+    nsAutoLock lock(mLock);
+    mShutdown = PR_TRUE;
+    mState = STATE_UNLOADED;
+    mAggregates = nsnull;
+    mLoadChanges.Clear();
+  }
+
+  FailPendingRequests(NS_ERROR_ABORT);
+  return NS_OK;
+}
+
+PRBool
+sbLocalDatabaseLibraryStatistics::FindSlots(const nsAString& aProperty,
+                                            const nsAString& aOtherProperty,
+                                            PRUint32* aGroup,
+                                            PRUint32* aValue)
+{
+  *aGroup = GROUP_COUNT;
+  for (PRUint32 i = 0; i < GROUP_COUNT; i++) {
+    if (aProperty.EqualsLiteral(sGroupProperties[i])) {
+      *aGroup = i;
+      break;
+    }
+  }
+
+  *aValue = VALUE_COUNT;
+  for (PRUint32 i = 0; i < VALUE_COUNT; i++) {
+    if (aOtherProperty.EqualsLiteral(sValueProperties[i])) {
+      *aValue = i;
+      break;
+    }
+  }
+
+  return *aGroup < GROUP_COUNT && *aValue < VALUE_COUNT;
+}
+
+nsresult
+sbLocalDatabaseLibraryStatistics::CollectSum(const nsAString& aProperty,
+                                             const nsAString& aOtherProperty,
+                                             PRBool aAscending,
+                                             PRUint32 aMaxResults,
+                                             nsIArray** _retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  PRUint32 group, value;
+  if (!FindSlots(aProperty, aOtherProperty, &group, &value)) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  nsTArray<nsString> values;
+  {
+    nsAutoLock lock(mLock);
+    if (mState == STATE_LOADED) {
+      nsresult rv = mAggregates->Collect(group,
+                                         value,
+                                         aAscending,
+                                         aMaxResults,
+                                         values);
+      NS_ENSURE_SUCCESS(rv, rv);
+      lock.unlock();
+
+      return CreateValueArray(values, _retval);
+    }
+  }
+
+  // Let the caller query the database this time
+  nsresult rv = EnsureLoading();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_ERROR_NOT_AVAILABLE;
+}
+
+nsresult
+sbLocalDatabaseLibraryStatistics::CollectSumAsync(const nsAString& aProperty,
+                                                  const nsAString& aOtherProperty,
+                                                  PRBool aAscending,
+                                                  PRUint32 aMaxResults,
+                                                  sbILibraryStatisticsListener* aListener)
+{
+  NS_ENSURE_ARG_POINTER(aListener);
+  NS_ASSERTION(NS_IsMainThread(), "CollectSumAsync off the main thread");
+
+  nsresult rv;
+
+  PRUint32 group, value;
+  PRBool tracked = FindSlots(aProperty, aOtherProperty, &group, &value);
+
+  nsRefPtr<sbLibraryStatisticsRequest> request =
+    new sbLibraryStatisticsRequest(group,
+                                   value,
+                                   aAscending,
+                                   aMaxResults,
+                                   aListener);
+  NS_ENSURE_TRUE(request, NS_ERROR_OUT_OF_MEMORY);
+
+  if (!tracked) {
+    rv = mLibrary->CreateQuery(getter_AddRefs(request->query));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = request->query->AddQuery(sbLocalDatabaseSQL::StatisticsSumSelect());
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = request->query->BindStringParameter(0, aProperty);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = request->query->BindStringParameter(1, aOtherProperty);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = request->query->BindInt32Parameter(2, aAscending ? 1 : -1);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = request->query->BindInt32Parameter(3, aMaxResults);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    return mThreadPool->Dispatch(request, NS_DISPATCH_NORMAL);
+  }
+
+  PRBool loaded;
+  {
+    nsAutoLock lock(mLock);
+    NS_ENSURE_FALSE(mShutdown, NS_ERROR_NOT_AVAILABLE);
+
+    loaded = mState == STATE_LOADED;
+    if (loaded) {
+      request->result = mAggregates->Collect(group,
+                                             value,
+                                             aAscending,
+                                             aMaxResults,
+                                             request->values);
+    }
+  }
+
+  if (loaded) {
+    nsCOMPtr<nsIRunnable> runnable =
+      NS_NEW_RUNNABLE_METHOD(sbLibraryStatisticsRequest, request.get(), Notify);
+    NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+    return NS_DispatchToMainThread(runnable);
+  }
+
+  nsRefPtr<sbLibraryStatisticsRequest>* pending =
+    mPendingRequests.AppendElement(request);
+  NS_ENSURE_TRUE(pending, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = EnsureLoading();
+  if (NS_FAILED(rv)) {
+    mPendingRequests.RemoveElement(request);
+    return rv;
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseLibraryStatistics::EnsureLoading()
+{
+  NS_ASSERTION(NS_IsMainThread(), "EnsureLoading off the main thread");
+
+  {
+    nsAutoLock lock(mLock);
+    NS_ENSURE_FALSE(mShutdown, NS_ERROR_NOT_AVAILABLE);
+    if (mState != STATE_UNLOADED) {
+      return NS_OK;
+    }
+    mState = STATE_LOADING;
+    mReloadNeeded = PR_FALSE;
+  }
+
+  TRACE(("sbLocalDatabaseLibraryStatistics[0x%.8x] - Loading", this));
+
+  // Bind the properties that live in resource_properties; the content length
+  // is a column of media_items.
+  NS_ASSERTION(SB_IsTopLevelProperty(mValueDBIDs[CONTENT_LENGTH_SLOT]),
+               "Content length should be a top level property");
+
+  nsCOMPtr<sbIDatabaseQuery> query;
+  nsresult rv = mLibrary->CreateQuery(getter_AddRefs(query));
+  if (NS_SUCCEEDED(rv)) {
+    rv = query->AddQuery(sbLocalDatabaseSQL::StatisticsValuesSelect(
+                           GROUP_COUNT + VALUE_COUNT - 1));
+  }
+
+  PRUint32 param = 0;
+  for (PRUint32 i = 0; NS_SUCCEEDED(rv) && i < GROUP_COUNT; i++) {
+    rv = query->BindInt32Parameter(param++, mGroupDBIDs[i]);
+  }
+  for (PRUint32 i = 0; NS_SUCCEEDED(rv) && i < VALUE_COUNT; i++) {
+    rv = query->BindInt64Parameter(param++, mValueDBIDs[i]);
+  }
+
+  if (NS_SUCCEEDED(rv)) {
+    nsRefPtr<sbLibraryStatisticsLoader> loader =
+      new sbLibraryStatisticsLoader(this, query, mGroupDBIDs, mValueDBIDs);
+    rv = loader ? mThreadPool->Dispatch(loader, NS_DISPATCH_NORMAL)
+                : NS_ERROR_OUT_OF_MEMORY;
+  }
+
+  if (NS_FAILED(rv)) {
+    nsAutoLock lock(mLock);
+    mState = STATE_UNLOADED;
+  }
+  return rv;
+}
+
+void
+sbLocalDatabaseLibraryStatistics::LoadComplete(nsresult aResult,
+                                               sbLibraryStatisticsAggregates* aAggregates)
+{
+  NS_ASSERTION(NS_IsMainThread(), "LoadComplete off the main thread");
+
+  nsAutoPtr<sbLibraryStatisticsAggregates> aggregates(aAggregates);
+  nsTArray<nsRefPtr<sbLibraryStatisticsRequest> > requests;
+  PRBool reload = PR_FALSE;
+  nsresult rv = aResult;
+
+  {
+    nsAutoLock lock(mLock);
+    if (mShutdown) {
+      return;
+    }
+
+    mState = STATE_UNLOADED;
+
+    if (NS_SUCCEEDED(rv) && mReloadNeeded) {
+      // Changes were missed while loading
+      mReloadNeeded = PR_FALSE;
+      reload = PR_TRUE;
+    }
+    else if (NS_SUCCEEDED(rv)) {
+      for (PRUint32 i = 0; NS_SUCCEEDED(rv) && i < mLoadChanges.Length(); i++) {
+        rv = aggregates->Apply(mLoadChanges[i]);
+      }
+
+      if (NS_SUCCEEDED(rv)) {
+        mAggregates = aggregates.forget();
+        mState = STATE_LOADED;
+
+        requests.SwapElements(mPendingRequests);
+        for (PRUint32 i = 0; i < requests.Length(); i++) {
+          sbLibraryStatisticsRequest* request = requests[i];
+          request->result = mAggregates->Collect(request->group,
+                                                 request->value,
+                                                 request->ascending,
+                                                 request->maxResults,
+                                                 request->values);
+        }
+      }
+    }
+    mLoadChanges.Clear();
+  }
+
+  TRACE(("sbLocalDatabaseLibraryStatistics[0x%.8x] - LoadComplete(0x%x, %d)",
+         this, rv, reload));
+
+  if (reload && !mPendingRequests.IsEmpty()) {
+    rv = EnsureLoading();
+  }
+
+  if (NS_FAILED(rv)) {
+    FailPendingRequests(rv);
+    return;
+  }
+
+  for (PRUint32 i = 0; i < requests.Length(); i++) {
+    requests[i]->Notify();
+  }
+}
+
+void
+sbLocalDatabaseLibraryStatistics::FailPendingRequests(nsresult aResult)
+{
+  nsTArray<nsRefPtr<sbLibraryStatisticsRequest> > requests;
+  requests.SwapElements(mPendingRequests);
+
+  for (PRUint32 i = 0; i < requests.Length(); i++) {
+    requests[i]->result = aResult;
+    requests[i]->values.Clear();
+    requests[i]->Notify();
+  }
+}
+
+void
+sbLocalDatabaseLibraryStatistics::Invalidate()
+{
+  TRACE(("sbLocalDatabaseLibraryStatistics[0x%.8x] - Invalidate()", this));
+
+  nsAutoLock lock(mLock);
+  if (mState == STATE_LOADING) {
+    mReloadNeeded = PR_TRUE;
+    mLoadChanges.Clear();
+  }
+  else {
+    mState = STATE_UNLOADED;
+    mAggregates = nsnull;
+  }
+}
+
+nsresult
+sbLocalDatabaseLibraryStatistics::GetItemValues(sbILocalDatabaseResourcePropertyBag* aBag,
+                                                ItemValues& aValues)
+{
+  nsresult rv;
+
+  for (PRUint32 i = 0; i < GROUP_COUNT; i++) {
+    rv = aBag->GetPropertyByID(mGroupDBIDs[i], aValues.groups[i]);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  aValues.valueMask = 0;
+  for (PRUint32 i = 0; i < VALUE_COUNT; i++) {
+    nsString value;
+    rv = aBag->GetPropertyByID(mValueDBIDs[i], value);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (!value.IsVoid()) {
+      // Like SUM(), count values that are not numbers as 0
+      aValues.values[i] = nsString_ToInt64(value, &rv);
+      if (NS_FAILED(rv)) {
+        aValues.values[i] = 0;
+      }
+      aValues.valueMask |= 1 << i;
+    }
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabaseLibraryStatistics::AddChange(sbLocalDatabaseResourcePropertyBag* aBag,
+                                            PRUint32 aMediaItemId,
+                                            ChangeArray& aChanges)
+{
+  NS_ENSURE_ARG_POINTER(aBag);
+
+  PRBool dirty = PR_FALSE;
+  for (PRUint32 i = 0; !dirty && i < GROUP_COUNT; i++) {
+    dirty = aBag->IsPropertyDirty(mGroupDBIDs[i]);
+  }
+  for (PRUint32 i = 0; !dirty && i < VALUE_COUNT; i++) {
+    dirty = aBag->IsPropertyDirty(mValueDBIDs[i]);
+  }
+  if (!dirty) {
+    return NS_OK;
+  }
+
+  Change* change = aChanges.AppendElement();
+  NS_ENSURE_TRUE(change, NS_ERROR_OUT_OF_MEMORY);
+
+  change->mediaItemId = aMediaItemId;
+  change->removed = PR_FALSE;
+  return GetItemValues(aBag, change->values);
+}
+
+void
+sbLocalDatabaseLibraryStatistics::ApplyChanges(const ChangeArray& aChanges)
+{
+  nsAutoLock lock(mLock);
+
+  switch (mState) {
+    case STATE_LOADED:
+      for (PRUint32 i = 0; i < aChanges.Length(); i++) {
+        nsresult rv = mAggregates->Apply(aChanges[i]);
+        if (NS_FAILED(rv)) {
+          NS_WARNING("Failed to update library statistics");
+          mState = STATE_UNLOADED;
+          mAggregates = nsnull;
+          break;
+        }
+      }
+      break;
+    case STATE_LOADING:
+      if (!mLoadChanges.AppendElements(aChanges)) {
+        NS_WARNING("Failed to queue library statistics changes");
+        mReloadNeeded = PR_TRUE;
+      }
+      break;
+    default:
+      // Whatever has been written is picked up by the next load
+      break;
+  }
+}
+
+nsresult
+sbLocalDatabaseLibraryStatistics::ItemChanged(sbIMediaItem* aMediaItem,
+                                              PRBool aRemoved)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItem);
+
+  // The item is already in (or gone from) the database, so there is nothing
+  // to do unless the sums are loaded or being loaded.
+  {
+    nsAutoLock lock(mLock);
+    if (mState == STATE_UNLOADED) {
+      return NS_OK;
+    }
+  }
+
+  nsresult rv;
+  nsCOMPtr<sbILocalDatabaseMediaItem> item =
+    do_QueryInterface(aMediaItem, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  ChangeArray changes(1);
+  Change* change = changes.AppendElement();
+  NS_ENSURE_TRUE(change, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = item->GetMediaItemId(&change->mediaItemId);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  change->removed = aRemoved;
+  if (!aRemoved) {
+    nsCOMPtr<sbILocalDatabaseResourcePropertyBag> bag;
+    rv = item->GetPropertyBag(getter_AddRefs(bag));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = GetItemValues(bag, change->values);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  ApplyChanges(changes);
+  return NS_OK;
+}
+
+/* static */ nsresult
+sbLocalDatabaseLibraryStatistics::CreateValueArray(const nsTArray<nsString>& aValues,
+                                                   nsIArray** _retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  nsresult rv;
+  nsCOMPtr<nsIMutableArray> array =
+    do_CreateInstance("@mozilla.org/array;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  for (PRUint32 i = 0; i < aValues.Length(); i++) {
+    nsCOMPtr<nsIWritableVariant> variant =
+      do_CreateInstance(NS_VARIANT_CONTRACTID, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = variant->SetAsAString(aValues[i]);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = array->AppendElement(variant, PR_FALSE);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return CallQueryInterface(array, _retval);
+}
+
+// sbIMediaListListener
+
+NS_IMETHODIMP
+sbLocalDatabaseLibraryStatistics::OnItemAdded(sbIMediaList* aMediaList,
+                                              sbIMediaItem* aMediaItem,
+                                              PRUint32 aIndex,
+                                              PRBool* aNoMoreForBatch)
+{
+  NS_ENSURE_ARG_POINTER(aNoMoreForBatch);
+
+  if (mBatchHelper.IsActive()) {
+    Invalidate();
+    mInvalidatePending = PR_TRUE;
+    *aNoMoreForBatch = PR_TRUE;
+    return NS_OK;
+  }
+
+  nsresult rv = ItemChanged(aMediaItem, PR_FALSE);
+  if (NS_FAILED(rv)) {
+    Invalidate();
+  }
+
+  *aNoMoreForBatch = PR_FALSE;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseLibraryStatistics::OnBeforeItemRemoved(sbIMediaList* aMediaList,
+                                                      sbIMediaItem* aMediaItem,
+                                                      PRUint32 aIndex,
+                                                      PRBool* aNoMoreForBatch)
+{
+  NS_ENSURE_ARG_POINTER(aNoMoreForBatch);
+  *aNoMoreForBatch = PR_TRUE;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseLibraryStatistics::OnAfterItemRemoved(sbIMediaList* aMediaList,
+                                                     sbIMediaItem* aMediaItem,
+                                                     PRUint32 aIndex,
+                                                     PRBool* aNoMoreForBatch)
+{
+  NS_ENSURE_ARG_POINTER(aNoMoreForBatch);
+
+  if (mBatchHelper.IsActive()) {
+    Invalidate();
+    mInvalidatePending = PR_TRUE;
+    *aNoMoreForBatch = PR_TRUE;
+    return NS_OK;
+  }
+
+  nsresult rv = ItemChanged(aMediaItem, PR_TRUE);
+  if (NS_FAILED(rv)) {
+    Invalidate();
+  }
+
+  *aNoMoreForBatch = PR_FALSE;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseLibraryStatistics::OnItemUpdated(sbIMediaList* aMediaList,
+                                                sbIMediaItem* aMediaItem,
+                                                sbIPropertyArray* aProperties,
+                                                PRBool* aNoMoreForBatch)
+{
+  // Updates are picked up when the property cache writes them
+  NS_ENSURE_ARG_POINTER(aNoMoreForBatch);
+  *aNoMoreForBatch = PR_TRUE;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseLibraryStatistics::OnItemMoved(sbIMediaList* aMediaList,
+                                              PRUint32 aFromIndex,
+                                              PRUint32 aToIndex,
+                                              PRBool* aNoMoreForBatch)
+{
+  NS_ENSURE_ARG_POINTER(aNoMoreForBatch);
+  *aNoMoreForBatch = PR_TRUE;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseLibraryStatistics::OnBeforeListCleared(sbIMediaList* aMediaList,
+                                                      PRBool aExcludeLists,
+                                                      PRBool* aNoMoreForBatch)
+{
+  NS_ENSURE_ARG_POINTER(aNoMoreForBatch);
+  *aNoMoreForBatch = PR_TRUE;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseLibraryStatistics::OnListCleared(sbIMediaList* aMediaList,
+                                                PRBool aExcludeLists,
+                                                PRBool* aNoMoreForBatch)
+{
+  NS_ENSURE_ARG_POINTER(aNoMoreForBatch);
+
+  Invalidate();
+
+  *aNoMoreForBatch = PR_FALSE;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseLibraryStatistics::OnBatchBegin(sbIMediaList* aMediaList)
+{
+  mBatchHelper.Begin();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseLibraryStatistics::OnBatchEnd(sbIMediaList* aMediaList)
+{
+  mBatchHelper.End();
+
+  // A load started during the batch may have missed the rest of it
+  if (!mBatchHelper.IsActive() && mInvalidatePending) {
+    Invalidate();
+    mInvalidatePending = PR_FALSE;
+  }
+
+  return NS_OK;
+}
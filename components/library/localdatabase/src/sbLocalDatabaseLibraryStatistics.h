@@ -0,0 +1,202 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#ifndef __SBLOCALDATABASELIBRARYSTATISTICS_H__
+#define __SBLOCALDATABASELIBRARYSTATISTICS_H__
+
+#include <sbIMediaListListener.h>
+#include <sbLibraryUtils.h>
+
+#include <nsAutoPtr.h>
+#include <nsCOMPtr.h>
+#include <nsStringAPI.h>
+#include <nsTArray.h>
+#include <prlock.h>
+
+class nsIArray;
+class nsIThreadPool;
+class sbILibraryStatisticsListener;
+class sbILocalDatabaseResourcePropertyBag;
+class sbLibraryStatisticsAggregates;
+class sbLibraryStatisticsRequest;
+class sbLocalDatabaseLibrary;
+class sbLocalDatabaseResourcePropertyBag;
+
+/**
+ * \class sbLocalDatabaseLibraryStatistics
+ * \brief Keeps the sums behind sbILibraryStatistics::collectDistinctValues
+ *        in memory for the most common properties.
+ *
+ * For every artist, album and genre the sums of the play counts, ratings,
+ * durations and content lengths of its items are loaded once, on a
+ * background thread, and then kept up to date from the writes of the
+ * property cache and from the items added to and removed from the library.
+ * Collecting those sums is then a lookup that never touches the database.
+ *
+ * Within a batch, the first added or removed item throws the sums away
+ * instead; they are loaded again when next asked for.
+ */
+class sbLocalDatabaseLibraryStatistics : public sbIMediaListListener
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBIMEDIALISTLISTENER
+
+  enum {
+    GROUP_COUNT = 3,
+    VALUE_COUNT = 4
+  };
+
+  // The values of the tracked properties of one media item. Groups that are
+  // not set are void, values that are not set have their bit in valueMask
+  // cleared.
+  struct ItemValues {
+    ItemValues() : valueMask(0)
+    {
+      for (PRUint32 i = 0; i < GROUP_COUNT; i++) {
+        groups[i].SetIsVoid(PR_TRUE);
+      }
+    }
+
+    nsString groups[GROUP_COUNT];
+    PRInt64  values[VALUE_COUNT];
+    PRUint32 valueMask;
+  };
+
+  struct Change {
+    PRUint32     mediaItemId;
+    PRBool       removed;
+    ItemValues   values;
+  };
+
+  typedef nsTArray<Change> ChangeArray;
+
+  sbLocalDatabaseLibraryStatistics(sbLocalDatabaseLibrary* aLibrary);
+
+  nsresult Init();
+  nsresult Shutdown();
+
+  /**
+   * \brief Collect sums like COLLECT_SUM on the calling (main) thread.
+   * \return NS_ERROR_NOT_AVAILABLE if the properties are not tracked or the
+   *         sums are not loaded yet. Loading is started in the latter case.
+   */
+  nsresult CollectSum(const nsAString& aProperty,
+                      const nsAString& aOtherProperty,
+                      PRBool aAscending,
+                      PRUint32 aMaxResults,
+                      nsIArray** _retval);
+
+  /**
+   * \brief Collect sums like COLLECT_SUM and pass them to aListener. Sums of
+   *        properties that are not tracked are queried on a background
+   *        thread.
+   */
+  nsresult CollectSumAsync(const nsAString& aProperty,
+                           const nsAString& aOtherProperty,
+                           PRBool aAscending,
+                           PRUint32 aMaxResults,
+                           sbILibraryStatisticsListener* aListener);
+
+  /**
+   * \brief Called by the property cache for each bag it writes. Appends a
+   *        change to aChanges if any tracked property of aBag is dirty.
+   */
+  nsresult AddChange(sbLocalDatabaseResourcePropertyBag* aBag,
+                     PRUint32 aMediaItemId,
+                     ChangeArray& aChanges);
+
+  /**
+   * \brief Apply changes once they have been written to the database. May
+   *        be called on any thread.
+   */
+  void ApplyChanges(const ChangeArray& aChanges);
+
+  /**
+   * \brief Called on the main thread when loading the sums has finished.
+   *        Takes ownership of aAggregates.
+   */
+  void LoadComplete(nsresult aResult,
+                    sbLibraryStatisticsAggregates* aAggregates);
+
+  static nsresult CreateValueArray(const nsTArray<nsString>& aValues,
+                                   nsIArray** _retval);
+
+private:
+  ~sbLocalDatabaseLibraryStatistics();
+
+  enum State {
+    STATE_UNLOADED,
+    STATE_LOADING,
+    STATE_LOADED
+  };
+
+  nsresult GetItemValues(sbILocalDatabaseResourcePropertyBag* aBag,
+                         ItemValues& aValues);
+
+  nsresult ItemChanged(sbIMediaItem* aMediaItem, PRBool aRemoved);
+
+  // Find the slots of tracked properties. Returns PR_FALSE if either
+  // property is not tracked.
+  PRBool FindSlots(const nsAString& aProperty,
+                   const nsAString& aOtherProperty,
+                   PRUint32* aGroup,
+                   PRUint32* aValue);
+
+  // Start loading the sums unless they are loaded or being loaded.
+  nsresult EnsureLoading();
+
+  // Throw the sums away, e.g. because changes were missed during a batch.
+  void Invalidate();
+
+  void FailPendingRequests(nsresult aResult);
+
+  sbLocalDatabaseLibrary* mLibrary;
+  nsCOMPtr<nsIThreadPool> mThreadPool;
+
+  PRUint32 mGroupDBIDs[GROUP_COUNT];
+  PRUint32 mValueDBIDs[VALUE_COUNT];
+
+  // Protects everything below except mPendingRequests, mBatchHelper and
+  // mInvalidatePending, which are only used on the main thread.
+  PRLock* mLock;
+  State mState;
+  PRBool mShutdown;
+  // Set when the sums were invalidated while loading; the loaded sums are
+  // stale then.
+  PRBool mReloadNeeded;
+  nsAutoPtr<sbLibraryStatisticsAggregates> mAggregates;
+  // Changes made while loading, applied once the load completes. Applying
+  // a change sets the values of an item, so it does not matter whether the
+  // load already saw it.
+  ChangeArray mLoadChanges;
+
+  nsTArray<nsRefPtr<sbLibraryStatisticsRequest> > mPendingRequests;
+  sbLibraryBatchHelper mBatchHelper;
+  PRBool mInvalidatePending;
+};
+
+#endif /* __SBLOCALDATABASELIBRARYSTATISTICS_H__ */
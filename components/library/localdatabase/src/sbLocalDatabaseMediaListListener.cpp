@@ -301,6 +301,23 @@ sbLocalDatabaseMediaListListener::ListenerCount()
   return mListenerArray.Length();
 }
 
+PRBool
+sbLocalDatabaseMediaListListener::ShouldNotifyListeners(PRUint32 aFlags)
+{
+  NS_ASSERTION(mListenerArrayLock, "You haven't called Init yet!");
+
+  nsAutoLock lock(mListenerArrayLock);
+
+  PRUint32 length = mListenerArray.Length();
+  for (PRUint32 i = 0; i < length; i++) {
+    if (mListenerArray[i]->ShouldNotify(aFlags)) {
+      return PR_TRUE;
+    }
+  }
+
+  return PR_FALSE;
+}
+
 nsresult
 sbLocalDatabaseMediaListListener::SnapshotListenerArray(sbMediaListListenersArray& aArray,
                                                         PRUint32 aFlags,
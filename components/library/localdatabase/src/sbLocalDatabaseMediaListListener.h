@@ -155,6 +155,10 @@ protected:
   // Return the number of listeners
   PRUint32 ListenerCount();
 
+  // Return true if any listener still wants to be notified of aFlags in the
+  // current batch
+  PRBool ShouldNotifyListeners(PRUint32 aFlags);
+
   // Enumerate listeners and call OnItemAdded
   void NotifyListenersItemAdded(sbIMediaList* aList,
                                 sbIMediaItem* aItem,
@@ -77,7 +77,7 @@ sbLocalDatabaseMigrationHelper.prototype = {
                        Ci.sbIJobProgress,
                        Ci.sbIJobCancelable ],
 
-  _latestSchemaVersion: 29,
+  _latestSchemaVersion: 30,
   _lowestFromSchemaVersion: Number.MAX_VALUE,
 
   _migrationHandlers:   null,
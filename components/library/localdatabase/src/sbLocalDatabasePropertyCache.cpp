@@ -53,6 +53,7 @@
 #include "sbDatabaseResultStringEnumerator.h"
 #include "sbLocalDatabaseGUIDArray.h"
 #include "sbLocalDatabaseLibrary.h"
+#include "sbLocalDatabaseLibraryStatistics.h"
 #include "sbLocalDatabaseResourcePropertyBag.h"
 #include "sbLocalDatabaseSchemaInfo.h"
 #include <sbIJobProgressService.h>
@@ -60,12 +61,14 @@
 #include <sbStringBundle.h>
 #include <sbStringUtils.h>
 #include <sbMediaListBatchCallback.h>
+#include <sbIIdentityService.h>
 #include <sbIPropertyArray.h>
 #include <sbIPropertyInfo.h>
 #include "sbLocalDatabaseSQL.h"
 #include <sbIDatabaseQuery.h>
 #include <sbThreadPoolService.h>
 #include <sbDebugUtils.h>
+#include <sbPerfStatisticsUtils.h>
 
 /*
  * To log this module, set the following environment variable:
@@ -572,6 +575,9 @@ nsresult sbLocalDatabasePropertyCache::RetrieveProperties(
   T & aGUIDs,
   nsCOMArray<sbLocalDatabaseResourcePropertyBag> & aBags)
 {
+  sbAutoPerfLatency perfLatency(sbIPerfStatistics::CATEGORY_PROPERTY_CACHE,
+                                NS_LITERAL_CSTRING("retrieve"));
+
   nsresult rv;
   PRInt32 const libraryItemPosition = aGUIDs.IndexOf(mLibraryResourceGUID);
   // blank out the library guid so we don't process it as a media item
@@ -781,6 +787,7 @@ sbLocalDatabasePropertyCache::GetProperties(const PRUnichar **aGUIDArray,
   nsTArray<nsString> misses(CACHE_SIZE);
   PRUint32 i;
   PRBool cacheUpdated = PR_FALSE;
+  PRUint32 missCount = 0;
 
   nsAutoMonitor mon(mMonitor);
 
@@ -812,6 +819,7 @@ sbLocalDatabasePropertyCache::GetProperties(const PRUnichar **aGUIDArray,
     }
     else {
       // Save the miss guid and index so we can retrieve it later
+      ++missCount;
       PRUint32 * const newIndex = missesIndex.AppendElement(i);
       NS_ENSURE_TRUE(newIndex, NS_ERROR_OUT_OF_MEMORY);
 
@@ -874,6 +882,13 @@ sbLocalDatabasePropertyCache::GetProperties(const PRUnichar **aGUIDArray,
     return rv;
   }
 
+  sbPerfStatisticsCount(sbIPerfStatistics::CATEGORY_PROPERTY_CACHE,
+                        NS_LITERAL_CSTRING("hit"),
+                        aGUIDArrayCount - missCount);
+  sbPerfStatisticsCount(sbIPerfStatistics::CATEGORY_PROPERTY_CACHE,
+                        NS_LITERAL_CSTRING("miss"),
+                        missCount);
+
   *aPropertyArrayCount = aGUIDArrayCount;
   *aPropertyArray = propertyBagArray.forget();
   return NS_OK;
@@ -1128,6 +1143,11 @@ sbLocalDatabasePropertyCache::Write()
 
   nsCOMPtr<sbIDatabaseQuery> query;
   PRUint32 dirtyItemCount;
+
+  // Changes to the properties the library keeps sums of
+  nsRefPtr<sbLocalDatabaseLibraryStatistics> statistics = mLibrary->mStatistics;
+  sbLocalDatabaseLibraryStatistics::ChangeArray statisticsChanges;
+
   { // find the new dirty properties
     DirtyItems dirtyItems;
 
@@ -1179,45 +1199,15 @@ sbLocalDatabasePropertyCache::Write()
         rv = bag->EnumerateDirty(EnumDirtyProps, (void *) &dirtyPropertyEnumerator, &dirtyPropsCount);
         NS_ENSURE_SUCCESS(rv, rv);
 
-        // Build a new FTS data table entry by concatenating all the user-viewable properties.
-        // NOTE: This includes both top-level and not-top-level properties!
-        // TODO: Look at top level properties to see if you want them searchable!
-        nsString newFTSData;
-        nsCOMPtr<nsIStringEnumerator> bagProperties;
-        rv = bag->GetIds(getter_AddRefs(bagProperties));
-        NS_ENSURE_SUCCESS(rv, rv);
-        PRBool hasMore;
-        while (NS_SUCCEEDED(bagProperties->HasMore(&hasMore)) && hasMore) {
-          nsAutoString propertyId;
-          rv = bagProperties->GetNext(propertyId);
-          NS_ENSURE_SUCCESS(rv, rv);
-
-          PRBool hasProperty, isUserViewable;
-          rv = mPropertyManager->HasProperty(propertyId, &hasProperty);
+        if (statistics && !isLibrary) {
+          rv = statistics->AddChange(bag, mediaItemId, statisticsChanges);
           NS_ENSURE_SUCCESS(rv, rv);
-          if (!hasProperty) {
-            continue;
-          }
-
-          nsCOMPtr<sbIPropertyInfo> propertyInfo;
-          rv = mPropertyManager->GetPropertyInfo(propertyId,
-                                                 getter_AddRefs(propertyInfo));
-          NS_ENSURE_SUCCESS(rv,rv);
-          rv = propertyInfo->GetUserViewable(&isUserViewable);
-          NS_ENSURE_SUCCESS(rv,rv);
-
-          if (isUserViewable) {
-            PRUint32 propertyDBID;
-            rv = GetPropertyDBID(propertyId, &propertyDBID);
-            NS_ENSURE_SUCCESS(rv, rv);
-            nsString propertySearchable;
-            rv = bag->GetSearchablePropertyByID(propertyDBID, propertySearchable);
-            NS_ENSURE_SUCCESS(rv, rv);
-            newFTSData.Append(propertySearchable);
-            newFTSData.AppendLiteral(" ");
-          }
         }
 
+        nsString newFTSData;
+        rv = GetFTSData(bag, newFTSData);
+        NS_ENSURE_SUCCESS(rv, rv);
+
         if (!newFTSData.IsEmpty()) {
           rv = query->AddPreparedStatement(mMediaItemsFtsAllInsertPreparedStatement);
           NS_ENSURE_SUCCESS(rv, rv);
@@ -1243,6 +1233,10 @@ sbLocalDatabasePropertyCache::Write()
   NS_ENSURE_SUCCESS(rv, rv);
   NS_ENSURE_TRUE(dbOk == 0, NS_ERROR_FAILURE);
 
+  if (statistics && statisticsChanges.Length()) {
+    statistics->ApplyChanges(statisticsChanges);
+  }
+
   if(!NS_IsMainThread()) {
     nsCOMPtr<nsIThread> mainThread;
     rv = NS_GetMainThread(getter_AddRefs(mainThread));
@@ -1753,6 +1747,133 @@ sbLocalDatabasePropertyCache::InsertPropertyIDInLibrary(const nsAString& aProper
   return NS_OK;
 }
 
+nsresult
+sbLocalDatabasePropertyCache::GetFTSData(sbLocalDatabaseResourcePropertyBag* aBag,
+                                         nsAString& _retval)
+{
+  NS_ENSURE_ARG_POINTER(aBag);
+  nsresult rv;
+  _retval.Truncate();
+
+  // Build a new FTS data table entry by concatenating all the user-viewable properties.
+  // NOTE: This includes both top-level and not-top-level properties!
+  // TODO: Look at top level properties to see if you want them searchable!
+  nsCOMPtr<nsIStringEnumerator> bagProperties;
+  rv = aBag->GetIds(getter_AddRefs(bagProperties));
+  NS_ENSURE_SUCCESS(rv, rv);
+  PRBool hasMore;
+  while (NS_SUCCEEDED(bagProperties->HasMore(&hasMore)) && hasMore) {
+    nsAutoString propertyId;
+    rv = bagProperties->GetNext(propertyId);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRBool hasProperty, isUserViewable;
+    rv = mPropertyManager->HasProperty(propertyId, &hasProperty);
+    NS_ENSURE_SUCCESS(rv, rv);
+    if (!hasProperty) {
+      continue;
+    }
+
+    nsCOMPtr<sbIPropertyInfo> propertyInfo;
+    rv = mPropertyManager->GetPropertyInfo(propertyId,
+                                           getter_AddRefs(propertyInfo));
+    NS_ENSURE_SUCCESS(rv,rv);
+    rv = propertyInfo->GetUserViewable(&isUserViewable);
+    NS_ENSURE_SUCCESS(rv,rv);
+
+    if (isUserViewable) {
+      PRUint32 propertyDBID;
+      rv = GetPropertyDBID(propertyId, &propertyDBID);
+      NS_ENSURE_SUCCESS(rv, rv);
+      nsString propertySearchable;
+      rv = aBag->GetSearchablePropertyByID(propertyDBID, propertySearchable);
+      NS_ENSURE_SUCCESS(rv, rv);
+      _retval.Append(propertySearchable);
+      _retval.AppendLiteral(" ");
+    }
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbLocalDatabasePropertyCache::CreateDetachedBag(const nsAString& aGuid,
+                                                sbIPropertyArray* aProperties,
+                                                sbLocalDatabaseResourcePropertyBag** _retval)
+{
+  NS_ENSURE_ARG_POINTER(aProperties);
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  nsRefPtr<sbLocalDatabaseResourcePropertyBag> bag =
+    new sbLocalDatabaseResourcePropertyBag(this, 0, aGuid);
+  NS_ENSURE_TRUE(bag, NS_ERROR_OUT_OF_MEMORY);
+
+  nsresult rv = bag->Init();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 length;
+  rv = aProperties->GetLength(&length);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool needsIdentity = PR_FALSE;
+  for (PRUint32 i = 0; i < length; i++) {
+    nsCOMPtr<sbIProperty> property;
+    rv = aProperties->GetPropertyAt(i, getter_AddRefs(property));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsString id;
+    rv = property->GetId(id);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsString value;
+    rv = property->GetValue(value);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRUint32 propertyDBID = GetPropertyDBIDInternal(id);
+    NS_ENSURE_TRUE(propertyDBID, NS_ERROR_FAILURE);
+
+    // Validate the same way sbLocalDatabaseResourcePropertyBag::SetProperty
+    // does.
+    nsCOMPtr<sbIPropertyInfo> propertyInfo;
+    rv = mPropertyManager->GetPropertyInfo(id, getter_AddRefs(propertyInfo));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRBool valid = PR_FALSE;
+    rv = propertyInfo->Validate(value, &valid);
+    NS_ENSURE_SUCCESS(rv, rv);
+    NS_ENSURE_TRUE(valid, NS_ERROR_ILLEGAL_VALUE);
+
+    rv = bag->PutValue(propertyDBID, value);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (!needsIdentity) {
+      rv = propertyInfo->GetUsedInIdentity(&needsIdentity);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
+  if (needsIdentity) {
+    nsCOMPtr<sbIIdentityService> idService =
+      do_GetService("@songbirdnest.com/Songbird/IdentityService;1", &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsString identity;
+    rv = idService->CalculateIdentityForBag(bag, identity);
+    if (rv != NS_ERROR_NOT_AVAILABLE) {
+      NS_ENSURE_SUCCESS(rv, rv);
+      if (!identity.IsVoid()) {
+        rv = bag->PutValue(GetPropertyDBIDInternal(
+                             NS_LITERAL_STRING(SB_PROPERTY_METADATA_HASH_IDENTITY)),
+                           identity);
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
+    }
+  }
+
+  NS_ADDREF(*_retval = bag);
+  return NS_OK;
+}
+
 nsresult
 sbLocalDatabasePropertyCache::CreateSecondarySortValue(
     sbILocalDatabaseResourcePropertyBag* aBag,
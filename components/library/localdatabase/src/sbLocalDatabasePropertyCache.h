@@ -108,6 +108,19 @@ public:
   nsresult CreateSecondarySortValue(sbILocalDatabaseResourcePropertyBag* aBag,
                                     PRUint32 aPropertyDBID, 
                                     nsAString& _retval);
+
+  // Build the full text search data of a bag by concatenating the searchable
+  // values of its user viewable properties
+  nsresult GetFTSData(sbLocalDatabaseResourcePropertyBag* aBag,
+                      nsAString& _retval);
+
+  // Create a bag holding aProperties for an item that is not in the database
+  // yet, e.g. for bulk inserts. The bag is not cached and nothing is marked
+  // dirty; values are validated and the metadata hash identity is computed
+  // as if they had been set on a cached bag.
+  nsresult CreateDetachedBag(const nsAString& aGuid,
+                             sbIPropertyArray* aProperties,
+                             sbLocalDatabaseResourcePropertyBag** _retval);
 private:
   nsresult Shutdown();
 
@@ -109,7 +109,8 @@ sbLocalDatabaseQuery::sbLocalDatabaseQuery(const nsAString& aBaseTable,
 }
 
 nsresult
-sbLocalDatabaseQuery::GetFullCountQuery(nsAString& aQuery)
+sbLocalDatabaseQuery::GetFullCountQuery(nsAString& aQuery,
+                                        nsIMutableArray* aParameters)
 {
   nsresult rv;
 
@@ -130,14 +131,15 @@ sbLocalDatabaseQuery::GetFullCountQuery(nsAString& aQuery)
   rv = AddFilters();
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = mBuilder->ToString(aQuery);
+  rv = mBuilder->ToParameterizedString(aParameters, aQuery);
   NS_ENSURE_SUCCESS(rv, rv);
 
   return NS_OK;
 }
 
 nsresult
-sbLocalDatabaseQuery::GetFullGuidRangeQuery(nsAString& aQuery)
+sbLocalDatabaseQuery::GetFullGuidRangeQuery(nsAString& aQuery,
+                                            nsIMutableArray* aParameters)
 {
   nsresult rv;
 
@@ -182,14 +184,15 @@ sbLocalDatabaseQuery::GetFullGuidRangeQuery(nsAString& aQuery)
   rv = AddRange();
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = mBuilder->ToString(aQuery);
+  rv = mBuilder->ToParameterizedString(aParameters, aQuery);
   NS_ENSURE_SUCCESS(rv, rv);
 
   return NS_OK;
 }
 
 nsresult
-sbLocalDatabaseQuery::GetNonNullCountQuery(nsAString& aQuery)
+sbLocalDatabaseQuery::GetNonNullCountQuery(nsAString& aQuery,
+                                           nsIMutableArray* aParameters)
 {
   nsresult rv;
 
@@ -214,14 +217,15 @@ sbLocalDatabaseQuery::GetNonNullCountQuery(nsAString& aQuery)
   rv = AddNonNullPrimarySortConstraint();
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = mBuilder->ToString(aQuery);
+  rv = mBuilder->ToParameterizedString(aParameters, aQuery);
   NS_ENSURE_SUCCESS(rv, rv);
 
   return NS_OK;
 }
 
 nsresult
-sbLocalDatabaseQuery::GetNullGuidRangeQuery(nsAString& aQuery)
+sbLocalDatabaseQuery::GetNullGuidRangeQuery(nsAString& aQuery,
+                                            nsIMutableArray* aParameters)
 {
   nsresult rv;
 
@@ -255,14 +259,15 @@ sbLocalDatabaseQuery::GetNullGuidRangeQuery(nsAString& aQuery)
   rv = AddRange();
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = mBuilder->ToString(aQuery);
+  rv = mBuilder->ToParameterizedString(aParameters, aQuery);
   NS_ENSURE_SUCCESS(rv, rv);
 
   return NS_OK;
 }
 
 nsresult
-sbLocalDatabaseQuery::GetPrefixSearchQuery(nsAString& aQuery)
+sbLocalDatabaseQuery::GetPrefixSearchQuery(nsAString& aQuery,
+                                           nsIMutableArray* aParameters)
 {
   nsresult rv;
 
@@ -314,14 +319,15 @@ sbLocalDatabaseQuery::GetPrefixSearchQuery(nsAString& aQuery)
   rv = mBuilder->AddCriterion(criterion);
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = mBuilder->ToString(aQuery);
+  rv = mBuilder->ToParameterizedString(aParameters, aQuery);
   NS_ENSURE_SUCCESS(rv, rv);
 
   return NS_OK;
 }
 
 nsresult
-sbLocalDatabaseQuery::GetResortQuery(nsAString& aQuery)
+sbLocalDatabaseQuery::GetResortQuery(nsAString& aQuery,
+                                     nsIMutableArray* aParameters)
 {
   NS_ENSURE_FALSE(mIsDistinct, NS_ERROR_UNEXPECTED);
   NS_ENSURE_TRUE(mSorts->Length() > 1, NS_ERROR_UNEXPECTED);
@@ -390,14 +396,15 @@ sbLocalDatabaseQuery::GetResortQuery(nsAString& aQuery)
   rv = AddMultiSorts();
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = mBuilder->ToString(aQuery);
+  rv = mBuilder->ToParameterizedString(aParameters, aQuery);
   NS_ENSURE_SUCCESS(rv, rv);
 
   return NS_OK;
 }
 
 nsresult
-sbLocalDatabaseQuery::GetNullResortQuery(nsAString& aQuery)
+sbLocalDatabaseQuery::GetNullResortQuery(nsAString& aQuery,
+                                         nsIMutableArray* aParameters)
 {
   NS_ENSURE_FALSE(mIsDistinct, NS_ERROR_UNEXPECTED);
   NS_ENSURE_TRUE(mSorts->Length() > 1, NS_ERROR_UNEXPECTED);
@@ -463,7 +470,7 @@ sbLocalDatabaseQuery::GetNullResortQuery(nsAString& aQuery)
   rv = AddMultiSorts();
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = mBuilder->ToString(aQuery);
+  rv = mBuilder->ToParameterizedString(aParameters, aQuery);
   NS_ENSURE_SUCCESS(rv, rv);
 
   return NS_OK;
@@ -32,6 +32,7 @@
 #include <nsStringGlue.h>
 #include "sbLocalDatabaseGUIDArray.h" // for FilterSpec
 
+class nsIMutableArray;
 class sbIDatabaseQuery;
 class sbILocalDatabasePropertyCache;
 class sbISQLBuilder;
@@ -52,13 +53,23 @@ public:
                          PRBool aDistinctWithSortableValues,
                          sbILocalDatabasePropertyCache* aPropertyCache);
 
-  nsresult GetFullCountQuery(nsAString& aQuery);
-  nsresult GetFullGuidRangeQuery(nsAString& aQuery);
-  nsresult GetNonNullCountQuery(nsAString& aQuery);
-  nsresult GetNullGuidRangeQuery(nsAString& aQuery);
-  nsresult GetPrefixSearchQuery(nsAString& aQuery);
-  nsresult GetResortQuery(nsAString& aQuery);
-  nsresult GetNullResortQuery(nsAString& aQuery);
+  // The Get*Query methods return the query with the values of its criteria
+  // replaced by placeholders and append those values to aParameters, see
+  // sbISQLBuilder::toParameterizedString
+  nsresult GetFullCountQuery(nsAString& aQuery,
+                             nsIMutableArray* aParameters);
+  nsresult GetFullGuidRangeQuery(nsAString& aQuery,
+                                 nsIMutableArray* aParameters);
+  nsresult GetNonNullCountQuery(nsAString& aQuery,
+                                nsIMutableArray* aParameters);
+  nsresult GetNullGuidRangeQuery(nsAString& aQuery,
+                                 nsIMutableArray* aParameters);
+  nsresult GetPrefixSearchQuery(nsAString& aQuery,
+                                nsIMutableArray* aParameters);
+  nsresult GetResortQuery(nsAString& aQuery,
+                          nsIMutableArray* aParameters);
+  nsresult GetNullResortQuery(nsAString& aQuery,
+                              nsIMutableArray* aParameters);
   PRBool   GetIsFullLibrary();
 
 private:
@@ -127,13 +127,10 @@ sbLocalDatabaseResourcePropertyBag::GetIds(nsIStringEnumerator **aIDs)
   NS_ENSURE_ARG_POINTER(aIDs);
 
   nsTArray<PRUint32> propertyDBIDs;
-  mValueMap.EnumerateRead(PropertyBagKeysToArray, &propertyDBIDs);
-
-  PRUint32 len = mValueMap.Count();
-  if (propertyDBIDs.Length() < len) {
-    return NS_ERROR_OUT_OF_MEMORY;
-  }
+  nsresult rv = GetPropertyDBIDs(propertyDBIDs);
+  NS_ENSURE_SUCCESS(rv, rv);
 
+  PRUint32 len = propertyDBIDs.Length();
   nsTArray<nsString> propertyIDs;
   for (PRUint32 i = 0; i < len; i++) {
     nsString propertyID;
@@ -404,6 +401,17 @@ sbLocalDatabaseResourcePropertyBag::PutValue(PRUint32 aPropertyID,
   return NS_OK;
 }
 
+nsresult
+sbLocalDatabaseResourcePropertyBag::GetPropertyDBIDs(nsTArray<PRUint32>& aPropertyDBIDs)
+{
+  mValueMap.EnumerateRead(PropertyBagKeysToArray, &aPropertyDBIDs);
+  if (aPropertyDBIDs.Length() < mValueMap.Count()) {
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+
+  return NS_OK;
+}
+
 PRBool
 sbLocalDatabaseResourcePropertyBag::IsPropertyDirty(PRUint32 aPropertyDBID)
 {
@@ -62,6 +62,8 @@ public:
   nsresult PutValue(PRUint32 aPropertyID,
                     const nsAString& aValue);
 
+  nsresult GetPropertyDBIDs(nsTArray<PRUint32>& aPropertyDBIDs);
+
   PRBool IsPropertyDirty(PRUint32 aPropertyDBID);
   nsresult EnumerateDirty(nsTHashtable<nsUint32HashKey>::Enumerator aEnumFunc, void *aClosure, PRUint32 *aDirtyCount);
   nsresult ClearDirty();
@@ -162,3 +162,93 @@ nsString sbLocalDatabaseSQL::PropertiesDelete()
   return NS_LITERAL_STRING("DELETE FROM resource_properties WHERE media_item_id = ? AND property_id = ? ");
 }
 
+nsString sbLocalDatabaseSQL::StatisticsSumSelect()
+{
+  return NS_LITERAL_STRING("SELECT value1.obj, SUM(value2.obj) \
+                              FROM properties AS property1 \
+                                INNER JOIN resource_properties AS value1 \
+                                  ON value1.property_id = property1.property_id \
+                                INNER JOIN resource_properties AS value2 \
+                                  ON value1.media_item_id = value2.media_item_id \
+                                INNER JOIN properties AS property2 \
+                                  ON value2.property_id = property2.property_id \
+                              WHERE property1.property_name = ? \
+                                AND property2.property_name = ? \
+                              GROUP BY value1.obj \
+                              ORDER BY ? * SUM(value2.obj) \
+                              LIMIT ?");
+}
+
+nsString sbLocalDatabaseSQL::StatisticsValuesSelect(PRUint32 aPropertyCount)
+{
+  nsString sql(NS_LITERAL_STRING("SELECT media_item_id, property_id, obj \
+                                  FROM resource_properties \
+                                  WHERE property_id IN ("));
+  for (PRUint32 i = 0; i < aPropertyCount; i++) {
+    if (i != 0) {
+      sql.AppendLiteral(", ");
+    }
+    sql.AppendLiteral("?");
+  }
+  sql.AppendLiteral(") UNION ALL \
+                     SELECT media_item_id, ?, content_length \
+                     FROM media_items \
+                     WHERE content_length IS NOT NULL");
+  return sql;
+}
+
+/**
+ * Builds an INSERT ... SELECT of aRowCount rows joined with UNION ALL, which
+ * unlike multi-row VALUES lists is understood by every SQLite version we ship.
+ */
+static
+nsString BulkInsert(nsAString const & aInsert,
+                    nsAString const & aRow,
+                    PRUint32 aRowCount)
+{
+  nsString sql(aInsert);
+  for (PRUint32 row = 0; row < aRowCount; ++row) {
+    if (row != 0) {
+      sql.AppendLiteral(" UNION ALL");
+    }
+    sql.AppendLiteral(" SELECT ");
+    sql.Append(aRow);
+  }
+  return sql;
+}
+
+nsString sbLocalDatabaseSQL::MediaItemsBulkInsert(PRUint32 aRowCount)
+{
+  nsString insert(NS_LITERAL_STRING("INSERT INTO media_items ("));
+  nsString row;
+  for (PRUint32 property = 0; property < NS_ARRAY_LENGTH(sStaticProperties); ++property) {
+    if (!SB_IsBulkInsertColumn(sStaticProperties[property])) {
+      continue;
+    }
+    if (!row.IsEmpty()) {
+      insert.AppendLiteral(", ");
+      row.AppendLiteral(", ");
+    }
+    insert.AppendLiteral(sStaticProperties[property].mColumn);
+    row.AppendLiteral("?");
+  }
+  insert.AppendLiteral(")");
+
+  return BulkInsert(insert, row, aRowCount);
+}
+
+nsString sbLocalDatabaseSQL::PropertiesBulkInsert(PRUint32 aRowCount)
+{
+  return BulkInsert(NS_LITERAL_STRING("INSERT INTO resource_properties \
+                                       (media_item_id, property_id, obj, obj_searchable, obj_sortable, obj_secondary_sortable)"),
+                    NS_LITERAL_STRING("(SELECT media_item_id FROM media_items WHERE guid = ?), ?, ?, ?, ?, ?"),
+                    aRowCount);
+}
+
+nsString sbLocalDatabaseSQL::MediaItemsFtsAllBulkInsert(PRUint32 aRowCount)
+{
+  return BulkInsert(NS_LITERAL_STRING("INSERT INTO resource_properties_fts_all \
+                                       (rowid, alldata)"),
+                    NS_LITERAL_STRING("(SELECT media_item_id FROM media_items WHERE guid = ?), ?"),
+                    aRowCount);
+}
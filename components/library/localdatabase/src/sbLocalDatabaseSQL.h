@@ -82,12 +82,48 @@ public:
    * Removes a property given the item ID and property ID
    */
   static nsString PropertiesDelete();
+  /**
+   * Inserts aRowCount media items. Each row binds the bulk insert columns
+   * (see SB_IsBulkInsertColumn) in the order of sStaticProperties.
+   */
+  static nsString MediaItemsBulkInsert(PRUint32 aRowCount);
+  /**
+   * Inserts aRowCount properties of new media items. Each row binds the guid
+   * of the item, the property id, and the obj, obj_searchable, obj_sortable
+   * and obj_secondary_sortable values.
+   */
+  static nsString PropertiesBulkInsert(PRUint32 aRowCount);
+  /**
+   * Inserts the full text search data of aRowCount new media items. Each row
+   * binds the guid of the item and its data.
+   */
+  static nsString MediaItemsFtsAllBulkInsert(PRUint32 aRowCount);
+  /**
+   * Selects the distinct values of one property ordered by the sum of the
+   * values of another. Binds the two property names, 1 or -1 for ascending
+   * or descending order and the maximum number of values.
+   */
+  static nsString StatisticsSumSelect();
+  /**
+   * Selects (media_item_id, property_id, value) of aPropertyCount properties
+   * of resource_properties, followed by the content length of every media
+   * item. Binds the property ids and then the id to report for the content
+   * length.
+   */
+  static nsString StatisticsValuesSelect(PRUint32 aPropertyCount);
 
   // These are the number of "IN" bind variables for statements which use them.
   // They are tuned to optimize performance.
   static const int MediaItemBindCount = 50;
   static const int SecondaryPropertyBindCount = 50;
 
+  // These are the number of rows of the bulk insert statements. They must
+  // stay below SQLite's limits of 999 bind variables and 500 compound select
+  // terms per statement.
+  static const int MediaItemsBulkInsertRowCount = 100;
+  static const int PropertiesBulkInsertRowCount = 150;
+  static const int MediaItemsFtsAllBulkInsertRowCount = 400;
+
 private:
   nsString mMediaItemColumns;
   nsString mMediaItemColumnsWithID;
@@ -195,6 +195,16 @@ SB_GetTopLevelPropertyColumn(const PRUint32 aPropertyDBID,
   return NS_ERROR_NOT_AVAILABLE;
 }
 
+// Media lists are never bulk inserted, so sbLocalDatabaseSQL's bulk insert
+// statements leave their columns to the defaults.
+static inline PRBool
+SB_IsBulkInsertColumn(const sbStaticProperty& aProperty)
+{
+  nsDependentCString propertyID(aProperty.mPropertyID);
+  return !propertyID.EqualsLiteral(SB_PROPERTY_LISTTYPE) &&
+         !propertyID.EqualsLiteral(SB_PROPERTY_ISLIST);
+}
+
 static inline PRInt32
 SB_GetPropertyId(const nsAString& aProperty,
                  sbILocalDatabasePropertyCache* aPropertyCache)
@@ -27,7 +27,9 @@
 
 #include <nsIArray.h>
 #include <nsIClassInfoImpl.h>
+#include <nsIIdleService.h>
 #include <nsIMutableArray.h>
+#include <nsIObserver.h>
 #include <nsIProgrammingLanguage.h>
 #include <nsISimpleEnumerator.h>
 #include <nsIURI.h>
@@ -51,6 +53,8 @@
 #include <nsCOMPtr.h>
 #include <nsComponentManagerUtils.h>
 #include <nsMemory.h>
+#include <nsServiceManagerUtils.h>
+#include <nsThreadUtils.h>
 #include <nsXPCOMCID.h>
 #include <pratom.h>
 #include <sbLocalDatabaseMediaListView.h>
@@ -61,6 +65,21 @@
 #define DEFAULT_SORT_PROPERTY NS_LITERAL_STRING(SB_PROPERTY_ORDINAL)
 #define DEFAULT_FETCH_SIZE 1000
 
+// New ordinals are flat integers this far apart, so that about 16 items can
+// be inserted or moved between any two neighbours, each at the midpoint of
+// the gap, before the list has to be renumbered. The tree collation compares
+// path segments as 32 bit integers, which bounds the range. A path sorts
+// before its own sub-paths, so PR_INT32_MAX is kept free for sub-paths that
+// go after the end of a list which has no flat ordinals left there.
+#define SB_ORDINAL_SPACING 65536
+#define SB_ORDINAL_MAX     (PR_INT32_MAX - 1)
+#define SB_ORDINAL_MIN     (-PR_INT32_MAX)
+
+// How long the user has to be idle before a list is renumbered, in seconds
+#define SB_ORDINAL_REBALANCE_IDLE_TIME 5
+
+#define SB_IDLE_SERVICE_CONTRACTID "@mozilla.org/widget/idleservice;1"
+
 /**
  * To log this class, set the following environment variable:
  *   NSPR_LOG_MODULES=sbLocalDatabaseSimpleMediaList:5
@@ -69,6 +88,33 @@
 static PRLogModuleInfo* gLocalDatabaseSimpleMediaListLog = nsnull;
 #endif /* PR_LOGGING */
 
+/**
+ * Get the first path segment of an ordinal. Every ordinal whose first segment
+ * is smaller sorts before aOrdinal, every one whose first segment is larger
+ * sorts after it.
+ */
+static nsresult
+GetFirstPathSegment(const nsAString& aOrdinal, PRInt64* aValue)
+{
+  PRInt32 pos = aOrdinal.FindChar('.');
+  PRUint32 length = pos >= 0 ? (PRUint32)pos : aOrdinal.Length();
+
+  nsresult rv;
+  *aValue = Substring(aOrdinal, 0, length).ToInteger(&rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+static void
+AssignOrdinal(nsAString& aOrdinal, PRInt64 aValue)
+{
+  NS_ASSERTION(aValue >= SB_ORDINAL_MIN && aValue <= SB_ORDINAL_MAX,
+               "Ordinal out of range");
+  aOrdinal.Truncate();
+  aOrdinal.AppendInt((PRInt32)aValue);
+}
+
 #define TRACE(args) PR_LOG(gLocalDatabaseSimpleMediaListLog, PR_LOG_DEBUG, args)
 #define LOG(args)   PR_LOG(gLocalDatabaseSimpleMediaListLog, PR_LOG_WARN, args)
 
@@ -211,6 +257,53 @@ private:
 NS_IMPL_THREADSAFE_ISUPPORTS1(sbLocalDatabaseSimpleMediaListAddSomeAsyncRunner,
                               nsIRunnable);
 
+/**
+ * Renumbers a simple media list once the user has been idle for a while, so
+ * that inserts never wait for it. Holds on to the list until then.
+ */
+class sbSimpleMediaListRebalanceObserver : public nsIObserver
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIOBSERVER
+
+  explicit sbSimpleMediaListRebalanceObserver(
+    sbLocalDatabaseSimpleMediaList* aList)
+    : mList(aList) {}
+
+private:
+  nsRefPtr<sbLocalDatabaseSimpleMediaList> mList;
+};
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbSimpleMediaListRebalanceObserver,
+                              nsIObserver);
+
+NS_IMETHODIMP
+sbSimpleMediaListRebalanceObserver::Observe(nsISupports* aSubject,
+                                            const char* aTopic,
+                                            const PRUnichar* aData)
+{
+  // Keep waiting if the user came back before we got to it
+  if (strcmp(aTopic, "idle")) {
+    return NS_OK;
+  }
+
+  // Removing ourselves drops the idle service's reference
+  nsRefPtr<sbSimpleMediaListRebalanceObserver> kungFuDeathGrip(this);
+
+  nsresult rv;
+  nsCOMPtr<nsIIdleService> idleService =
+    do_GetService(SB_IDLE_SERVICE_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = idleService->RemoveIdleObserver(this, SB_ORDINAL_REBALANCE_IDLE_TIME);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  mList->RebalanceWhenIdle();
+
+  return NS_OK;
+}
+
 // This class is stack-only but needs to act like an XPCOM object.  Add dummy
 // AddRef/Release methods so the ref count is always 1
 NS_IMETHODIMP_(nsrefcnt)
@@ -552,6 +645,28 @@ sbSimpleMediaListInsertingEnumerationListener::OnEnumerationEnd(sbIMediaList* aM
 
   nsString ordinal = mStartingOrdinal;
 
+  // A flat starting ordinal is either the single slot found between two
+  // items or the next ordinal after the end of the list. In the latter case
+  // spread the items out so that later inserts between them keep flat
+  // ordinals. Otherwise count up the last segment of the sub-path and
+  // renumber the list later.
+  PRBool isFlat = ordinal.FindChar('.') < 0;
+  PRInt64 ordinalValue = 0;
+  PRInt64 ordinalStep = SB_ORDINAL_SPACING;
+  if (isFlat) {
+    ordinalValue = ordinal.ToInteger(&rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (itemCount > 1) {
+      ordinalStep = PR_MIN(ordinalStep,
+                           (SB_ORDINAL_MAX - ordinalValue) / (itemCount - 1));
+      if (ordinalStep == 0) {
+        isFlat = PR_FALSE;
+        ordinal.AppendLiteral(".0");
+      }
+    }
+  }
+
   // For each item, new or existing, go through and add the item to the media
   // list
   for (PRUint32 index = 0; index < itemCount; index++) {
@@ -594,12 +709,18 @@ sbSimpleMediaListInsertingEnumerationListener::OnEnumerationEnd(sbIMediaList* aM
     rv = query->BindInt32Parameter(0, mediaItemId);
     NS_ENSURE_SUCCESS(rv, rv);
 
+    if (isFlat) {
+      AssignOrdinal(ordinal, ordinalValue + index * ordinalStep);
+    }
+
     rv = query->BindStringParameter(1, ordinal);
     NS_ENSURE_SUCCESS(rv, rv);
 
     // Increment the ordinal
-    rv = mFriendList->AddToLastPathSegment(ordinal, 1);
-    NS_ENSURE_SUCCESS(rv, rv);
+    if (!isFlat) {
+      rv = mFriendList->AddToLastPathSegment(ordinal, 1);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
   }
 
   rv = query->AddQuery(NS_LITERAL_STRING("commit"));
@@ -617,6 +738,10 @@ sbSimpleMediaListInsertingEnumerationListener::OnEnumerationEnd(sbIMediaList* aM
   rv = mFriendList->UpdateLastModifiedTime();
   NS_ENSURE_SUCCESS(rv, rv);
 
+  if (!isFlat) {
+    mFriendList->ScheduleRebalance();
+  }
+
   // Notify our listeners if we have any
   if (mFriendList->ListenerCount() > 0) {
     for (PRUint32 index = 0; index < itemCount; index++) {
@@ -793,6 +918,7 @@ NS_IMPL_CI_INTERFACE_GETTER7(sbLocalDatabaseSimpleMediaList,
                              sbIOrderableMediaList);
 
 sbLocalDatabaseSimpleMediaList::sbLocalDatabaseSimpleMediaList()
+: mRebalancePending(PR_FALSE)
 {
   MOZ_COUNT_CTOR(sbLocalDatabaseSimpleMediaList);
 #ifdef PR_LOGGING
@@ -1742,12 +1868,47 @@ sbLocalDatabaseSimpleMediaList::GetIndexByOrdinal(const nsAString& aOrdinal,
     }
   }
 
-  // Not cached, search the database
-  PRUint32 index;
-  rv = GetArray()->GetFirstIndexByPrefix(aOrdinal, &index);
-  if (NS_SUCCEEDED(rv)) {
-    *_retval = index;
-    return NS_OK;
+  // Not cached. Ordinals are unique within the list, so the index of an
+  // ordinal is the number of ordinals that sort before it, which the
+  // database can count from the ordinal index without loading the list.
+  nsCOMPtr<sbIDatabaseQuery> query;
+  rv = MakeStandardQuery(getter_AddRefs(query));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = query->AddQuery(mGetIndexByOrdinalQuery);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = query->BindStringParameter(0, aOrdinal);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRInt32 dbOk;
+  rv = query->Execute(&dbOk);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbOk == 0, NS_ERROR_FAILURE);
+
+  nsCOMPtr<sbIDatabaseResult> result;
+  rv = query->GetResultObject(getter_AddRefs(result));
+  NS_ENSURE_TRUE(result, NS_ERROR_FAILURE);
+
+  PRUint32 rowCount;
+  rv = result->GetRowCount(&rowCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (rowCount == 1) {
+    nsAutoString count;
+    rv = result->GetRowCell(0, 0, count);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    // The last ordinal counted is the one we asked for if it is in the list
+    nsAutoString lastOrdinal;
+    rv = result->GetRowCell(0, 1, lastOrdinal);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRUint32 index = count.ToInteger(&rv);
+    if (NS_SUCCEEDED(rv) && index > 0 && lastOrdinal.Equals(aOrdinal)) {
+      *_retval = index - 1;
+      return NS_OK;
+    }
   }
 
   return NS_ERROR_NOT_AVAILABLE;
@@ -2071,6 +2232,9 @@ sbLocalDatabaseSimpleMediaList::MoveSomeInternal(PRUint32* aFromIndexArray,
   rv = UpdateLastModifiedTime();
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // The moved items were given sub-path ordinals
+  ScheduleRebalance();
+
   return NS_OK;
 }
 
@@ -2101,9 +2265,35 @@ sbLocalDatabaseSimpleMediaList::GetNextOrdinal(nsAString& aValue)
     NS_ENSURE_SUCCESS(rv, rv);
   }
 
-  rv = AddToLastPathSegment(aValue, 1);
+  // Anything with a larger first path segment sorts after the last item
+  PRInt64 last;
+  rv = GetFirstPathSegment(aValue, &last);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  if (last >= SB_ORDINAL_MAX) {
+    // No flat ordinal is left after the end of the list. Count up sub-paths
+    // of PR_INT32_MAX instead until the list is renumbered.
+    ScheduleRebalance();
+
+    if (CountLevels(aValue) > 0) {
+      return AddToLastPathSegment(aValue, 1);
+    }
+
+    NS_ENSURE_TRUE(last < PR_INT32_MAX, NS_ERROR_FAILURE);
+
+    aValue.Truncate();
+    aValue.AppendInt(PR_INT32_MAX);
+    aValue.AppendLiteral(".0");
+    return NS_OK;
+  }
+
+  PRInt64 step = PR_MIN(SB_ORDINAL_SPACING, (SB_ORDINAL_MAX - last + 1) / 2);
+  if (step < SB_ORDINAL_SPACING) {
+    ScheduleRebalance();
+  }
+
+  AssignOrdinal(aValue, last + step);
+
   return NS_OK;
 }
 
@@ -2113,8 +2303,8 @@ sbLocalDatabaseSimpleMediaList::GetBeforeOrdinal(PRUint32 aIndex,
 {
   nsresult rv;
 
-  // If we want to insert before the first index, get the ordinal of the
-  // first index and trim off everything but the first path and subtract 1
+  // If we want to insert before the first index, get the first path segment
+  // of the ordinal of the first index and go a step below it
   if (aIndex == 0) {
     PRBool cached;
     rv = GetArray()->IsIndexCached(0, &cached);
@@ -2130,18 +2320,32 @@ sbLocalDatabaseSimpleMediaList::GetBeforeOrdinal(PRUint32 aIndex,
       NS_ENSURE_SUCCESS(rv, rv);
     }
 
-    // Trim off additional path segments, if any
-    PRUint32 pos = ordinal.FindChar('.');
-    if (pos >= 0) {
-      ordinal.SetLength(pos);
+    PRInt64 first;
+    rv = GetFirstPathSegment(ordinal, &first);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (first <= SB_ORDINAL_MIN) {
+      // No flat ordinal is left before the start of the list. Sub-paths of
+      // the first ordinal sort before it, so count those down instead until
+      // the list is renumbered.
+      ScheduleRebalance();
+
+      aValue = ordinal;
+      if (CountLevels(aValue) > 0) {
+        return AddToLastPathSegment(aValue, -1);
+      }
+
+      aValue.AppendLiteral(".0");
+      return NS_OK;
     }
 
-    PRInt32 value = ordinal.ToInteger(&rv) - 1;
-    NS_ENSURE_SUCCESS(rv, rv);
+    PRInt64 step = PR_MIN(SB_ORDINAL_SPACING,
+                          (first - SB_ORDINAL_MIN + 1) / 2);
+    if (step < SB_ORDINAL_SPACING) {
+      ScheduleRebalance();
+    }
 
-    nsAutoString newOrdinal;
-    newOrdinal.AppendInt(value);
-    aValue = newOrdinal;
+    AssignOrdinal(aValue, first - step);
 
     return NS_OK;
   }
@@ -2156,6 +2360,32 @@ sbLocalDatabaseSimpleMediaList::GetBeforeOrdinal(PRUint32 aIndex,
   rv = GetArray()->GetSortPropertyValueByIndex(aIndex, belowOrdinal);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Any flat ordinal strictly between the first path segments of the two
+  // sorts between them, so take the midpoint while there is a gap
+  PRInt64 above;
+  rv = GetFirstPathSegment(aboveOrdinal, &above);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRInt64 below;
+  rv = GetFirstPathSegment(belowOrdinal, &below);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (below - above >= 2) {
+    PRInt64 value = (above + below) / 2;
+
+    // Renumber before the next insert here runs out of room
+    if (value - above < 2 || below - value < 2) {
+      ScheduleRebalance();
+    }
+
+    AssignOrdinal(aValue, value);
+    return NS_OK;
+  }
+
+  // The gap is used up, so make a path that sorts between the two and
+  // renumber the list once it is left alone
+  ScheduleRebalance();
+
   PRUint32 aboveLevels = CountLevels(aboveOrdinal);
   PRUint32 belowLevels = CountLevels(belowOrdinal);
 
@@ -2217,6 +2447,149 @@ sbLocalDatabaseSimpleMediaList::CountLevels(const nsAString& aPath)
   return count;
 }
 
+void
+sbLocalDatabaseSimpleMediaList::ScheduleRebalance()
+{
+  // The idle service lives on the main thread, inserts may happen elsewhere
+  if (!NS_IsMainThread()) {
+    nsCOMPtr<nsIRunnable> event =
+      NS_NEW_RUNNABLE_METHOD(sbLocalDatabaseSimpleMediaList,
+                             this,
+                             ScheduleRebalance);
+    NS_ENSURE_TRUE(event, /* void */);
+
+    nsresult rv = NS_DispatchToMainThread(event);
+    NS_ENSURE_SUCCESS(rv, /* void */);
+    return;
+  }
+
+  if (mRebalancePending) {
+    return;
+  }
+
+  nsresult rv;
+  nsCOMPtr<nsIIdleService> idleService =
+    do_GetService(SB_IDLE_SERVICE_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, /* void */);
+
+  nsCOMPtr<nsIObserver> observer =
+    new sbSimpleMediaListRebalanceObserver(this);
+  NS_ENSURE_TRUE(observer, /* void */);
+
+  rv = idleService->AddIdleObserver(observer, SB_ORDINAL_REBALANCE_IDLE_TIME);
+  NS_ENSURE_SUCCESS(rv, /* void */);
+
+  mRebalancePending = PR_TRUE;
+}
+
+void
+sbLocalDatabaseSimpleMediaList::RebalanceWhenIdle()
+{
+  NS_ASSERTION(NS_IsMainThread(), "Idle observers run on the main thread");
+
+  mRebalancePending = PR_FALSE;
+
+  nsresult rv = RebalanceOrdinals();
+  if (rv == NS_ERROR_NOT_AVAILABLE) {
+    // The list is being enumerated, try again the next time the user is idle
+    ScheduleRebalance();
+    return;
+  }
+  NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to renumber the list ordinals");
+}
+
+NS_IMETHODIMP
+sbLocalDatabaseSimpleMediaList::RebalanceOrdinals()
+{
+  TRACE(("LocalDatabaseSimpleMediaList[0x%.8x] - RebalanceOrdinals()", this));
+
+  nsresult rv;
+  PRInt32 dbOk;
+
+  nsAutoMonitor mon(mFullArrayMonitor);
+
+  // Don't renumber the items under an enumeration
+  if (mLockedEnumerationActive) {
+    return NS_ERROR_NOT_AVAILABLE;
+  }
+
+  nsCOMPtr<sbIDatabaseQuery> query;
+  rv = MakeStandardQuery(getter_AddRefs(query));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = query->AddQuery(mGetMembersInOrderQuery);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = query->Execute(&dbOk);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbOk == 0, NS_ERROR_FAILURE);
+
+  nsCOMPtr<sbIDatabaseResult> result;
+  rv = query->GetResultObject(getter_AddRefs(result));
+  NS_ENSURE_TRUE(result, NS_ERROR_FAILURE);
+
+  PRUint32 rowCount;
+  rv = result->GetRowCount(&rowCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (rowCount == 0) {
+    return NS_OK;
+  }
+
+  // Very long lists get closer ordinals so that they all fit
+  PRInt64 spacing = PR_MIN(SB_ORDINAL_SPACING, SB_ORDINAL_MAX / rowCount);
+
+  // Rewriting the rows in place could collide with the unique ordinal index
+  // half way through, so the rows are replaced instead, all at once
+  nsCOMPtr<sbIDatabaseQuery> updateQuery;
+  rv = MakeStandardQuery(getter_AddRefs(updateQuery));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = updateQuery->AddQuery(NS_LITERAL_STRING("begin"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = updateQuery->AddQuery(mDeleteAllQuery);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsAutoString ordinal;
+  for (PRUint32 i = 0; i < rowCount; i++) {
+    nsAutoString memberId;
+    rv = result->GetRowCell(i, 0, memberId);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRUint32 mediaItemId = memberId.ToInteger(&rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    AssignOrdinal(ordinal, i * spacing);
+
+    rv = updateQuery->AddQuery(mInsertIntoListQuery);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = updateQuery->BindInt32Parameter(0, mediaItemId);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = updateQuery->BindStringParameter(1, ordinal);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  rv = updateQuery->AddQuery(NS_LITERAL_STRING("commit"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = updateQuery->Execute(&dbOk);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbOk == 0, NS_ERROR_FAILURE);
+
+  // The order of the items has not changed, but every cached ordinal has.
+  // Views keep the ordinals of their items too, so within a batch tell them
+  // to reload once it ends.
+  sbAutoBatchHelper batchHelper(*this);
+
+  rv = Invalidate(PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
 nsresult
 sbLocalDatabaseSimpleMediaList::CreateQueries()
 {
@@ -2280,6 +2653,80 @@ sbLocalDatabaseSimpleMediaList::CreateQueries()
   rv = builder->ToString(mGetFirstOrdinalQuery);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Create the ordinal to index query
+  // select
+  //   count(1), max(ordinal)
+  // from
+  //   simple_media_lists
+  // where
+  //   media_item_id = x and
+  //   ordinal <= ?
+  nsCOMPtr<sbISQLSelectBuilder> ordinalBuilder =
+    do_CreateInstance(SB_SQLBUILDER_SELECT_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->SetBaseTableName(NS_LITERAL_STRING("simple_media_lists"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->AddColumn(EmptyString(), NS_LITERAL_STRING("count(1)"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->AddColumn(EmptyString(),
+                                 NS_LITERAL_STRING("max(ordinal)"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->CreateMatchCriterionLong(EmptyString(),
+                                                NS_LITERAL_STRING("media_item_id"),
+                                                sbISQLSelectBuilder::MATCH_EQUALS,
+                                                mediaItemId,
+                                                getter_AddRefs(criterion));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->AddCriterion(criterion);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->CreateMatchCriterionParameter(EmptyString(),
+                                                     NS_LITERAL_STRING("ordinal"),
+                                                     sbISQLSelectBuilder::MATCH_LESSEQUAL,
+                                                     getter_AddRefs(criterion));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->AddCriterion(criterion);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->ToString(mGetIndexByOrdinalQuery);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Create the query that gets the members in order, used to renumber the
+  // list
+  rv = ordinalBuilder->Reset();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->SetBaseTableName(NS_LITERAL_STRING("simple_media_lists"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->AddColumn(EmptyString(),
+                                 NS_LITERAL_STRING("member_media_item_id"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->CreateMatchCriterionLong(EmptyString(),
+                                                NS_LITERAL_STRING("media_item_id"),
+                                                sbISQLSelectBuilder::MATCH_EQUALS,
+                                                mediaItemId,
+                                                getter_AddRefs(criterion));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->AddCriterion(criterion);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->AddOrder(EmptyString(),
+                                NS_LITERAL_STRING("ordinal"),
+                                PR_TRUE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = ordinalBuilder->ToString(mGetMembersInOrderQuery);
+  NS_ENSURE_SUCCESS(rv, rv);
+
   // Create the query used by contains to see if a guid is in this list
   rv = builder->ClearColumns();
   NS_ENSURE_SUCCESS(rv, rv);
@@ -46,6 +46,7 @@ class sbIMediaItem;
 class sbIMediaList;
 class sbIMediaListView;
 class sbSimpleMediaListInsertingEnumerationListener;
+class sbSimpleMediaListRebalanceObserver;
 class sbSimpleMediaListRemovingEnumerationListener;
 
 class sbLocalDatabaseSimpleMediaList : public sbLocalDatabaseMediaListBase,
@@ -54,6 +55,7 @@ class sbLocalDatabaseSimpleMediaList : public sbLocalDatabaseMediaListBase,
 {
 public:
   friend class sbSimpleMediaListInsertingEnumerationListener;
+  friend class sbSimpleMediaListRebalanceObserver;
   friend class sbSimpleMediaListRemovingEnumerationListener;
 
   NS_DECL_ISUPPORTS_INHERITED
@@ -110,6 +112,13 @@ private:
 
   PRUint32 CountLevels(const nsAString& aPath);
 
+  // Renumber the list the next time the user is idle. May be called on any
+  // thread.
+  void ScheduleRebalance();
+
+  // Called by the idle observer set up in ScheduleRebalance
+  void RebalanceWhenIdle();
+
   nsresult CreateQueries();
 
   nsresult NotifyCopyListener(sbIMediaItem *aSourceItem,
@@ -141,6 +150,16 @@ private:
   // Get first ordinal
   nsString mGetFirstOrdinalQuery;
 
+  // Count the items up to and including a given ordinal
+  nsString mGetIndexByOrdinalQuery;
+
+  // Get the members of the list in order, used to renumber it
+  nsString mGetMembersInOrderQuery;
+
+  // Whether an idle observer is waiting to renumber the list after an insert
+  // or move that could not be given a flat ordinal. Main thread only.
+  PRBool mRebalancePending;
+
   // Copy Listener
   nsCOMPtr<sbILocalDatabaseMediaListCopyListener> mCopyListener;
 
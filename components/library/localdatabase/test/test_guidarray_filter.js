@@ -0,0 +1,108 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2008 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+ * \brief Test that changing the filter values of a GUID array gives the right
+ *        items while reusing its prepared statements, and that filters with
+ *        more values than SQLite allows parameters still work.
+ */
+
+const ARTIST = "http://songbirdnest.com/data/1.0#artistName";
+
+function getCounter(aStats, aKey) {
+  var snapshot = JSON.parse(aStats.snapshot(false));
+  var name = aStats.getCategoryName(Ci.sbIPerfStatistics.CATEGORY_GUID_ARRAY);
+  var counters = snapshot.counters[name];
+  return counters && counters[aKey] ? counters[aKey] : 0;
+}
+
+function getArtist(aLibrary, aArray, aIndex) {
+  return aLibrary.getMediaItem(aArray.getGuidByIndex(aIndex))
+                 .getProperty(ARTIST);
+}
+
+function assertFiltered(aLibrary, aArray, aValues, aArtist, aCount) {
+  aArray.clearFilters();
+  aArray.addFilter(ARTIST, new StringArrayEnumerator(aValues), false);
+  assertEqual(aArray.length, aCount);
+  for (var i = 0; i < aArray.length; i++) {
+    assertEqual(getArtist(aLibrary, aArray, i), aArtist);
+  }
+}
+
+function runTest () {
+
+  var databaseGUID = "test_guidarray_filter";
+  var library = createLibrary(databaseGUID);
+
+  var array = makeArray(library);
+  array.baseTable = "media_items";
+  array.addSort(ARTIST, true);
+
+  // Count the items of each artist without a filter
+  var counts = {};
+  var artists = [];
+  for (var i = 0; i < array.length; i++) {
+    var artist = getArtist(library, array, i);
+    if (!artist) {
+      continue;
+    }
+    if (!(artist in counts)) {
+      counts[artist] = 0;
+      artists.push(artist);
+    }
+    counts[artist]++;
+  }
+  assertTrue(artists.length > 2);
+
+  var stats = Cc["@songbirdnest.com/Songbird/PerfStatistics;1"]
+                .getService(Ci.sbIPerfStatistics);
+  var statsEnabled = stats.enabled;
+  stats.enabled = true;
+
+  // The first filter value prepares the statements, the others only bind
+  // their values to them
+  assertFiltered(library, array, [artists[0]], artists[0], counts[artists[0]]);
+  var reused = getCounter(stats, "statement_reused");
+  for (var i = 1; i < artists.length; i++) {
+    assertFiltered(library, array, [artists[i]], artists[i],
+                   counts[artists[i]]);
+  }
+  assertTrue(getCounter(stats, "statement_reused") > reused);
+
+  // Too many values to bind; they are written into the statement instead
+  var values = [artists[1]];
+  for (var i = 0; i < 1200; i++) {
+    values.push("No Such Artist " + i);
+  }
+  assertFiltered(library, array, values, artists[1], counts[artists[1]]);
+
+  // Back to few values after many
+  assertFiltered(library, array, [artists[2]], artists[2],
+                 counts[artists[2]]);
+
+  stats.enabled = statsEnabled;
+}
@@ -0,0 +1,209 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2008 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+ * \brief Test file
+ */
+
+function makeBatch(aCount, aPrefix) {
+  var SB_NS = "http://songbirdnest.com/data/1.0#";
+
+  var uris = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+               .createInstance(Ci.nsIMutableArray);
+  var properties = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+                     .createInstance(Ci.nsIMutableArray);
+  for (var i = 1; i <= aCount; i++) {
+    uris.appendElement(newURI("file:///foo/" + aPrefix + i + ".mp3"), false);
+    var props = Cc["@songbirdnest.com/Songbird/Properties/MutablePropertyArray;1"]
+                  .createInstance(Ci.sbIMutablePropertyArray);
+    props.appendProperty(SB_NS + "contentLength", i);
+    props.appendProperty(SB_NS + "trackNumber", i);
+    properties.appendElement(props, false);
+  }
+  return [uris, properties];
+}
+
+function checkItems(aLibrary, aResult, aCount, aPrefix) {
+  var SB_NS = "http://songbirdnest.com/data/1.0#";
+
+  assertEqual(aResult.length, aCount);
+  for (var i = 0; i < aCount; i++) {
+    var item = aLibrary.getMediaItem(aResult.getGuidAt(i));
+    assertEqual(item.contentSrc.spec,
+                "file:///foo/" + aPrefix + (aResult.getSourceIndexAt(i) + 1) + ".mp3");
+    assertEqual(item.QueryInterface(Ci.sbILocalDatabaseMediaItem).mediaItemId,
+                aResult.getMediaItemIdAt(i));
+
+    var listener = {
+      _item: null,
+      onEnumerationBegin: function() {
+      },
+      onEnumeratedItem: function(list, item) {
+        this._item = item;
+        return Ci.sbIMediaListEnumerationListener.CANCEL;
+      },
+      onEnumerationEnd: function() {
+      }
+    };
+
+    aLibrary.enumerateItemsByProperty(SB_NS + "contentURL",
+                                      item.contentSrc.spec,
+                                      listener,
+                                      Ci.sbIMediaList.ENUMERATIONTYPE_SNAPSHOT);
+
+    assertEqual(listener._item, item);
+    assertEqual(item.getProperty(SB_NS + "contentLength"),
+                "" + (aResult.getSourceIndexAt(i) + 1));
+    assertEqual(item.getProperty(SB_NS + "trackNumber"),
+                "" + (aResult.getSourceIndexAt(i) + 1));
+    assertEqual(item.getProperty(SB_NS + "hidden"), "0");
+  }
+}
+
+function runTest () {
+
+  var SB_NS = "http://songbirdnest.com/data/1.0#";
+  var databaseGUID = "test_bulkcreate";
+  var library = createLibrary(databaseGUID);
+  var localLibrary = library.QueryInterface(Ci.sbILocalDatabaseLibrary);
+
+  var libraryListener = new TestMediaListListener();
+  library.addListener(libraryListener);
+
+  // More items than fit in a single statement of any of the tables
+  var batch = makeBatch(500, "");
+  var result = localLibrary.bulkCreateMediaItems(batch[0], batch[1], 0);
+  checkItems(library, result, 500, "");
+  assertEqual(result.mediaItems, null);
+  assertEqual(library.length, 500);
+
+  // Check the order of the notifications
+  assertEqual(libraryListener.added.length, 500);
+  for (var i = 1; i <= 500; i++) {
+    assertEqual(libraryListener.added[i - 1].item.contentSrc.spec,
+                "file:///foo/" + i + ".mp3");
+    assertEqual(libraryListener.added[i - 1].index, i - 1);
+  }
+  libraryListener.reset();
+
+  // Items that already exist are skipped
+  result = localLibrary.bulkCreateMediaItems(batch[0], batch[1], 0);
+  assertEqual(result.length, 0);
+  assertEqual(libraryListener.added.length, 0);
+  assertEqual(library.length, 500);
+
+  // Unless duplicates are allowed, and the items are returned when asked for
+  batch = makeBatch(10, "");
+  result = localLibrary.bulkCreateMediaItems(
+             batch[0], batch[1],
+             Ci.sbILocalDatabaseLibrary.BULK_CREATE_ALLOW_DUPLICATES |
+             Ci.sbILocalDatabaseLibrary.BULK_CREATE_RETURN_ITEMS);
+  checkItems(library, result, 10, "");
+  assertEqual(result.mediaItems.length, 10);
+  for (var i = 0; i < 10; i++) {
+    var item = result.mediaItems.queryElementAt(i, Ci.sbIMediaItem);
+    assertEqual(item.guid, result.getGuidAt(i));
+  }
+  assertEqual(library.length, 510);
+  libraryListener.reset();
+
+  // Only the new URIs of a partly known batch are created
+  batch = makeBatch(20, "");
+  var more = makeBatch(20, "more");
+  for (var i = 0; i < 20; i++) {
+    batch[0].appendElement(more[0].queryElementAt(i, Ci.nsIURI), false);
+    batch[1].appendElement(more[1].queryElementAt(i, Ci.sbIPropertyArray), false);
+  }
+  result = localLibrary.bulkCreateMediaItems(batch[0], batch[1], 0);
+  assertEqual(result.length, 20);
+  for (var i = 0; i < 20; i++) {
+    assertEqual(result.getSourceIndexAt(i), 20 + i);
+  }
+  assertEqual(library.length, 530);
+  libraryListener.reset();
+
+  // Indexes are rebuilt when deferred
+  batch = makeBatch(300, "deferred");
+  result = localLibrary.bulkCreateMediaItems(
+             batch[0], batch[1],
+             Ci.sbILocalDatabaseLibrary.BULK_CREATE_DEFER_INDEXES);
+  checkItems(library, result, 300, "deferred");
+  assertEqual(library.length, 830);
+
+  var query = localLibrary.createQuery();
+  query.addQuery("SELECT COUNT(*) FROM sqlite_master WHERE type = 'index' " +
+                 "AND tbl_name = 'resource_properties'");
+  assertEqual(query.execute(), 0);
+  assertTrue(parseInt(query.getResultObject().getRowCell(0, 0)) > 0);
+  libraryListener.reset();
+
+  // Async batch creates write their items with the bulk inserts as well
+  batch = makeBatch(250, "async");
+  var lastProgress = 0;
+  var asyncListener = {
+    onProgress: function(aIndex) {
+      assertTrue(aIndex >= lastProgress);
+      assertTrue(aIndex <= 250);
+      lastProgress = aIndex;
+    },
+    onComplete: function(aMediaItems, aResult) {
+      assertEqual(aResult, Cr.NS_OK);
+      assertEqual(aMediaItems.length, 250);
+      assertEqual(libraryListener.added.length, 250);
+      for (var i = 0; i < 250; i++) {
+        var item = aMediaItems.queryElementAt(i, Ci.sbIMediaItem);
+        assertEqual(item.contentSrc.spec,
+                    "file:///foo/async" + (i + 1) + ".mp3");
+        assertEqual(item.getProperty(SB_NS + "trackNumber"), "" + (i + 1));
+        assertEqual(item.getProperty(SB_NS + "hidden"), "0");
+        assertEqual(libraryListener.added[i].item, item);
+        assertEqual(libraryListener.added[i].index, 830 + i);
+      }
+      assertEqual(library.length, 1080);
+      libraryListener.reset();
+
+      // Nothing is created when every item exists already
+      library.batchCreateMediaItemsAsync(existingListener,
+                                         batch[0], batch[1], false);
+    }
+  };
+
+  var existingListener = {
+    onProgress: function(aIndex) {},
+    onComplete: function(aMediaItems, aResult) {
+      assertEqual(aResult, Cr.NS_OK);
+      assertEqual(aMediaItems.length, 0);
+      assertEqual(libraryListener.added.length, 0);
+      assertEqual(library.length, 1080);
+
+      library.removeListener(libraryListener);
+      testFinished();
+    }
+  };
+
+  library.batchCreateMediaItemsAsync(asyncListener, batch[0], batch[1], false);
+  testPending();
+}
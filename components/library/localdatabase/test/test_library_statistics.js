@@ -98,4 +98,41 @@ function runTest () {
         library.collectDistinctValues(SBProperties.artistName, 
           sbILibraryStatistics.COLLECT_SUM, SBProperties.rating, false, 2)), 
       ["A", "C"])
+
+  // the async version answers from the in memory sums once loaded, so make
+  // sure the database has everything first
+  library.flush();
+
+  function collectAsync(aAscending, aMaxResults) {
+    var values;
+    library.collectDistinctValuesAsync(SBProperties.artistName,
+      sbILibraryStatistics.COLLECT_SUM, SBProperties.rating, aAscending,
+      aMaxResults,
+      function onDistinctValuesCollected(aResult, aValues) {
+        assertEqual(aResult, Components.results.NS_OK);
+        values = array2array(aValues);
+        testFinished();
+      });
+    testPending();
+    return values;
+  }
+
+  assertArraysEqual(collectAsync(false, 100), ["A", "C", "B", "D", "E"]);
+  assertArraysEqual(collectAsync(true, 2), ["E", "D"]);
+
+  // the sums follow changes written by the property cache
+  var changed = library.getItemsByProperty(SBProperties.artistName, "E")
+                       .queryElementAt(0, Components.interfaces.sbIMediaItem);
+  changed.setProperty(SBProperties.rating, 5);
+  library.flush();
+
+  assertArraysEqual(collectAsync(false, 100), ["A", "C", "B", "E", "D"]);
+  assertArraysEqual(array2array(
+        library.collectDistinctValues(SBProperties.artistName,
+          sbILibraryStatistics.COLLECT_SUM, SBProperties.rating, false, 100)),
+      ["A", "C", "B", "E", "D"])
+
+  // and removed items
+  library.remove(changed);
+  assertArraysEqual(collectAsync(false, 100), ["A", "C", "B", "D"]);
 }
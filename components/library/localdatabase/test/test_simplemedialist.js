@@ -339,6 +339,22 @@ function runTest () {
   a = a.concat(b);
   assertList(list, a);
 
+  // Insert at the same spot until the gap between the flat ordinals there
+  // is used up, so that inserts fall back to sub-paths
+  item = library.getMediaItem("3E6DD1C2-AD99-11DB-9321-C22AB7121F49");
+  for (var i = 0; i < 40; i++) {
+    list.insertBefore(2, item);
+    a.splice(2, 0, item.guid);
+  }
+  assertList(list, a);
+
+  item = library.getMediaItem("3E6D8050-AD99-11DB-9321-C22AB7121F49");
+  for (var i = 0; i < 40; i++) {
+    list.insertBefore(list.length - 1, item);
+    a.splice(a.length - 1, 0, item.guid);
+  }
+  assertList(list, a);
+
   // Test insertAllBefore.
   var insertItems = [];
   insertItems[0] = library.getMediaItem("3E6DD1C2-AD99-11DB-9321-C22AB7121F49");
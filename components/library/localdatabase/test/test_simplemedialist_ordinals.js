@@ -0,0 +1,247 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2010 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+/**
+ * \brief Test the ordinals of simple media lists: renumbering, running out
+ *        of room at either end, looking up indexes by ordinal and the
+ *        migration that flattens old nested ordinals.
+ */
+
+Components.utils.import("resource://app/jsmodules/ArrayConverter.jsm");
+
+const ORDINAL_SPACING = 65536;
+
+const SOURCE_LIST_GUID = "7e8dcc95-7a1d-4bb3-9b14-d4906a9952cb";
+
+const MIGRATION_HANDLER_CONTRACTID =
+  "@songbirdnest.com/Songbird/Library/LocalDatabase/Migration/Handler/29to30";
+
+function getOrdinals(databaseGUID, list) {
+  var rows = execQuery(databaseGUID,
+                       "select s.ordinal from simple_media_lists s " +
+                       "join media_items m " +
+                       "on s.media_item_id = m.media_item_id " +
+                       "where m.guid = '" + list.guid + "' " +
+                       "order by s.ordinal");
+  return rows.map(function(row) row[0]);
+}
+
+function setOrdinal(databaseGUID, list, oldOrdinal, newOrdinal) {
+  execQuery(databaseGUID,
+            "update simple_media_lists set ordinal = '" + newOrdinal + "' " +
+            "where ordinal = '" + oldOrdinal + "' and media_item_id = " +
+            "(select media_item_id from media_items " +
+            "where guid = '" + list.guid + "')");
+  list.QueryInterface(Ci.sbILocalDatabaseSimpleMediaList).invalidate(true);
+}
+
+function assertFlatOrdinals(ordinals) {
+  for (var i = 0; i < ordinals.length; i++) {
+    assertEqual(ordinals[i], String(i * ORDINAL_SPACING));
+  }
+}
+
+function hasNestedOrdinals(ordinals) {
+  return ordinals.some(function(ordinal) ordinal.indexOf(".") >= 0);
+}
+
+function makeList(library, items, count) {
+  var list = library.createMediaList("simple");
+  var guids = [];
+  for (var i = 0; i < count; i++) {
+    list.add(items[i]);
+    guids.push(items[i].guid);
+  }
+  return [list, guids];
+}
+
+function testRebalance(databaseGUID, library, items) {
+  var [list, a] = makeList(library, items, 3);
+  assertFlatOrdinals(getOrdinals(databaseGUID, list));
+
+  // Use up the gap between the first two items
+  for (var i = 0; i < 20; i++) {
+    list.insertBefore(1, items[3 + (i % 5)]);
+    a.splice(1, 0, items[3 + (i % 5)].guid);
+  }
+  assertList(list, a);
+  assertTrue(hasNestedOrdinals(getOrdinals(databaseGUID, list)));
+
+  var sml = list.QueryInterface(Ci.sbILocalDatabaseSimpleMediaList);
+
+  // The list is not renumbered under a locked enumeration
+  var listener = new TestMediaListEnumerationListener();
+  listener.enumItemFunction = function onItem(list, item) {
+    try {
+      sml.rebalanceOrdinals();
+      fail("Renumbered the list during a locked enumeration");
+    }
+    catch (e) {
+      assertEqual(e.result, Cr.NS_ERROR_NOT_AVAILABLE);
+    }
+    return Ci.sbIMediaListEnumerationListener.CANCEL;
+  };
+  list.enumerateAllItems(listener, Ci.sbIMediaList.ENUMERATIONTYPE_LOCKING);
+
+  sml.rebalanceOrdinals();
+  assertFlatOrdinals(getOrdinals(databaseGUID, list));
+  assertList(list, a);
+
+  // Inserts go back to flat ordinals in the middle of the new gaps
+  list.insertBefore(1, items[0]);
+  a.splice(1, 0, items[0].guid);
+  assertList(list, a);
+  assertEqual(getOrdinals(databaseGUID, list)[1],
+              String(ORDINAL_SPACING / 2));
+
+  library.remove(list);
+}
+
+function testOutOfRoom(databaseGUID, library, items) {
+  var [list, a] = makeList(library, items, 3);
+  var ordinals = getOrdinals(databaseGUID, list);
+
+  // Move the last item to the largest flat ordinal. Appends continue with
+  // sub-paths after it without renumbering the list.
+  setOrdinal(databaseGUID, list, ordinals[2], "2147483646");
+  list.add(items[3]);
+  list.add(items[4]);
+  a.push(items[3].guid, items[4].guid);
+  assertList(list, a);
+  assertEqual(getOrdinals(databaseGUID, list).join(),
+              [ordinals[0], ordinals[1], "2147483646",
+               "2147483647.0", "2147483647.1"].join());
+
+  // Likewise, prepends count down sub-paths of the smallest flat ordinal
+  setOrdinal(databaseGUID, list, ordinals[0], "-2147483647");
+  list.insertBefore(0, items[5]);
+  list.insertBefore(0, items[6]);
+  a.unshift(items[6].guid, items[5].guid);
+  assertList(list, a);
+  assertEqual(getOrdinals(databaseGUID, list).slice(0, 4).join(),
+              ["-2147483647.-1", "-2147483647.0", "-2147483647",
+               ordinals[1]].join());
+
+  library.remove(list);
+}
+
+function testIndexByOrdinal(databaseGUID, library, items) {
+  var [list, a] = makeList(library, items, 5);
+
+  // Mix flat and nested ordinals
+  for (var i = 0; i < 20; i++) {
+    list.insertBefore(2, items[5 + (i % 3)]);
+  }
+  list.insertAllBefore(1, ArrayConverter.enumerator([items[8], items[9]]));
+
+  var ordinals = getOrdinals(databaseGUID, list);
+  assertTrue(hasNestedOrdinals(ordinals));
+
+  // Drop the cached ordinals so that the index is counted in the database
+  var sml = list.QueryInterface(Ci.sbILocalDatabaseSimpleMediaList);
+  sml.invalidate(true);
+
+  for (var i = ordinals.length - 1; i >= 0; i--) {
+    assertEqual(sml.getIndexByOrdinal(ordinals[i]), i);
+  }
+
+  // Ordinals that are not in the list are not found, even when they sort
+  // between ordinals that are
+  for each (var ordinal in [ordinals[1] + ".5", "-1", "2147483647"]) {
+    sml.invalidate(true);
+    try {
+      sml.getIndexByOrdinal(ordinal);
+      fail("Found the index of ordinal " + ordinal);
+    }
+    catch (e) {
+      assertEqual(e.result, Cr.NS_ERROR_NOT_AVAILABLE);
+    }
+  }
+
+  library.remove(list);
+}
+
+function testMigration(databaseGUID, library, items) {
+  var [list, a] = makeList(library, items, 5);
+  var [otherList, b] = makeList(library, items.slice(5), 3);
+
+  // Give the first list the nested ordinals older versions made. The
+  // ordinals are written in an order that differs from the list order.
+  var nested = ["7", "3.1.0", "3.1", "3", "3.-2"];
+  execQuery(databaseGUID,
+            "delete from simple_media_lists where media_item_id = " +
+            "(select media_item_id from media_items " +
+            "where guid = '" + list.guid + "')");
+  for (var i = 0; i < nested.length; i++) {
+    execQuery(databaseGUID,
+              "insert into simple_media_lists " +
+              "(media_item_id, member_media_item_id, ordinal) " +
+              "select l.media_item_id, m.media_item_id, '" + nested[i] + "' " +
+              "from media_items l, media_items m " +
+              "where l.guid = '" + list.guid + "' " +
+              "and m.guid = '" + a[i] + "'");
+  }
+
+  // Nested ordinals sort before their parents
+  var expected = [a[4], a[1], a[2], a[3], a[0]];
+
+  var handler = Cc[MIGRATION_HANDLER_CONTRACTID]
+                  .createInstance(Ci.sbILocalDatabaseMigrationHandler)
+                  .wrappedJSObject;
+  handler._library = library.QueryInterface(Ci.sbILocalDatabaseLibrary);
+
+  // Run the migration without its progress dialog
+  for (let step in handler.processItems()) {}
+  assertEqual(handler.status, Ci.sbIJobProgress.STATUS_SUCCEEDED);
+
+  list.QueryInterface(Ci.sbILocalDatabaseSimpleMediaList).invalidate(true);
+  otherList.QueryInterface(Ci.sbILocalDatabaseSimpleMediaList)
+           .invalidate(true);
+
+  assertFlatOrdinals(getOrdinals(databaseGUID, list));
+  assertList(list, expected);
+
+  assertFlatOrdinals(getOrdinals(databaseGUID, otherList));
+  assertList(otherList, b);
+
+  library.remove(list);
+  library.remove(otherList);
+}
+
+function runTest () {
+
+  var databaseGUID = "test_simplemedialist_ordinals";
+  var library = createLibrary(databaseGUID);
+
+  var source = library.getMediaItem(SOURCE_LIST_GUID);
+  var items = [];
+  for (var i = 0; i < 10; i++) {
+    items.push(source.getItemByIndex(i));
+  }
+
+  testRebalance(databaseGUID, library, items);
+  testOutOfRoom(databaseGUID, library, items);
+  testIndexByOrdinal(databaseGUID, library, items);
+  testMigration(databaseGUID, library, items);
+}
@@ -32,14 +32,17 @@
 #include <sbIMediacore.h>
 #include <sbIMediacoreError.h>
 #include <sbIMediacoreEventListener.h>
+#include <sbIPerfStatistics.h>
 
 #include <sbMediacoreEvent.h>
+#include <sbPerfStatisticsUtils.h>
 #include <sbProxiedComponentManager.h>
 
 /* ctor / dtor */
 sbBaseMediacoreEventTarget::sbBaseMediacoreEventTarget(sbIMediacoreEventTarget * aTarget)
   : mTarget(aTarget),
-    mMonitor(nsAutoMonitor::NewMonitor("sbBaseMediacoreEventTarget::mMonitor"))
+    mMonitor(nsAutoMonitor::NewMonitor("sbBaseMediacoreEventTarget::mMonitor")),
+    mAsyncSequence(0)
 {
 }
 sbBaseMediacoreEventTarget::~sbBaseMediacoreEventTarget()
@@ -47,6 +50,111 @@ sbBaseMediacoreEventTarget::~sbBaseMediacoreEventTarget()
   nsAutoMonitor::DestroyMonitor(mMonitor);
 }
 
+/* static */ PRUint32
+sbBaseMediacoreEventTarget::GetEventMask(PRUint32 aType)
+{
+  if (aType & sbIMediacoreEvent::ERROR_EVENT) {
+    return sbIMediacoreEventListenerOptions::MASK_ERROR;
+  }
+  if (aType >= sbIMediacoreEvent::CUSTOM_EVENT_BASE) {
+    return sbIMediacoreEventListenerOptions::MASK_CUSTOM;
+  }
+  // one bit per 0x1000 block of event types
+  return 1 << ((aType >> 12) & 0x1f);
+}
+
+/* static */ PRBool
+sbBaseMediacoreEventTarget::IsCoalescedType(PRUint32 aType)
+{
+  switch (aType) {
+    case sbIMediacoreEvent::DURATION_CHANGE:
+    case sbIMediacoreEvent::VOLUME_CHANGE:
+    case sbIMediacoreEvent::MUTE_CHANGE:
+    case sbIMediacoreEvent::BUFFERING:
+    case sbIMediacoreEvent::VIDEO_SIZE_CHANGED:
+      return PR_TRUE;
+  }
+  return PR_FALSE;
+}
+
+nsresult
+sbBaseMediacoreEventTarget::DispatchCoalesced(sbIMediacoreEvent *aEvent,
+                                              PRUint32 aType)
+{
+  NS_ENSURE_TRUE(mMonitor, NS_ERROR_NOT_INITIALIZED);
+
+  PRBool replaced = PR_FALSE;
+  PRBool dropped = PR_FALSE;
+  PRUint32 sequence = 0;
+  {
+    nsAutoMonitor mon(mMonitor);
+    for (PRUint32 i = 0; i < mPendingEvents.Length(); ++i) {
+      if (mPendingEvents[i].type != aType) {
+        continue;
+      }
+      if (mPendingEvents[i].sequence == mAsyncSequence) {
+        // nothing was dispatched after the pending event, so the helper that
+        // is already queued can pick up this event in its place
+        mPendingEvents[i].event = aEvent;
+        replaced = PR_TRUE;
+      }
+      else {
+        // other events were dispatched since; drop the pending event and
+        // queue this one behind them so that the order is kept
+        mPendingEvents.RemoveElementAt(i);
+        dropped = PR_TRUE;
+      }
+      break;
+    }
+
+    if (!replaced) {
+      PendingEvent* pending = mPendingEvents.AppendElement();
+      NS_ENSURE_TRUE(pending, NS_ERROR_OUT_OF_MEMORY);
+      pending->type = aType;
+      pending->sequence = sequence = ++mAsyncSequence;
+      pending->event = aEvent;
+    }
+  }
+
+  if (replaced || dropped) {
+    nsCAutoString perfKey;
+    perfKey.AssignLiteral("coalesced.");
+    perfKey.AppendInt(PRInt32(aType));
+    sbPerfStatisticsCount(sbIPerfStatistics::CATEGORY_MEDIACORE_EVENT,
+                          perfKey);
+  }
+  if (replaced) {
+    return NS_OK;
+  }
+
+  nsRefPtr<CoalescedDispatchHelper> dispatchHelper =
+    new CoalescedDispatchHelper(this, mTarget, sequence);
+  nsresult rv = dispatchHelper ? NS_DispatchToMainThread(dispatchHelper)
+                               : NS_ERROR_OUT_OF_MEMORY;
+  if (NS_FAILED(rv)) {
+    nsCOMPtr<sbIMediacoreEvent> failed = TakePendingEvent(sequence);
+    return rv;
+  }
+  return NS_OK;
+}
+
+already_AddRefed<sbIMediacoreEvent>
+sbBaseMediacoreEventTarget::TakePendingEvent(PRUint32 aSequence)
+{
+  NS_ENSURE_TRUE(mMonitor, nsnull);
+  nsAutoMonitor mon(mMonitor);
+
+  for (PRUint32 i = 0; i < mPendingEvents.Length(); ++i) {
+    if (mPendingEvents[i].sequence == aSequence) {
+      sbIMediacoreEvent* event = nsnull;
+      mPendingEvents[i].event.swap(event);
+      mPendingEvents.RemoveElementAt(i);
+      return event;
+    }
+  }
+  return nsnull;
+}
+
 
 /* boolean dispatchEvent (in sbIMediacoreEvent aEvent, [optional] PRBool aAsync); */
 nsresult
@@ -59,6 +167,20 @@ sbBaseMediacoreEventTarget::DispatchEvent(sbIMediacoreEvent *aEvent,
   // Note: in the async case, we need to make a new runnable, because
   // DispatchEvent has an out param, and XPCOM proxies can't deal with that.
   if (aAsync) {
+    PRUint32 type;
+    rv = aEvent->GetType(&type);
+    NS_ENSURE_SUCCESS(rv, rv);
+    if (IsCoalescedType(type)) {
+      return DispatchCoalesced(aEvent, type);
+    }
+
+    // pending coalesced events must not be replaced past this one
+    {
+      NS_ENSURE_TRUE(mMonitor, NS_ERROR_NOT_INITIALIZED);
+      nsAutoMonitor mon(mMonitor);
+      ++mAsyncSequence;
+    }
+
     nsRefPtr<AsyncDispatchHelper> dispatchHelper =
       new AsyncDispatchHelper(static_cast<sbIMediacoreEventTarget*>(mTarget), aEvent);
     NS_ENSURE_TRUE(dispatchHelper, NS_ERROR_OUT_OF_MEMORY);
@@ -106,6 +228,17 @@ sbBaseMediacoreEventTarget::DispatchEventInternal(sbIMediacoreEvent *aEvent,
   rv = event->SetTarget(mTarget);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // time how long the listeners take, keyed by event type
+  PRUint32 type = 0;
+  rv = aEvent->GetType(&type);
+  NS_ENSURE_SUCCESS(rv, rv);
+  PRUint32 eventMask = GetEventMask(type);
+  nsCAutoString perfKey;
+  perfKey.AssignLiteral("type.");
+  perfKey.AppendInt(PRInt32(type));
+  sbAutoPerfLatency perfLatency(sbIPerfStatistics::CATEGORY_MEDIACORE_EVENT,
+                                perfKey);
+
   // store the state into our state stack, so if any listener removes a
   // listener we get updated
   mStates.Push(&state);
@@ -115,6 +248,14 @@ sbBaseMediacoreEventTarget::DispatchEventInternal(sbIMediacoreEvent *aEvent,
     *_retval = PR_FALSE;
 
   for (state.index = 0; state.index < state.length; ++state.index) {
+    // the options may move once a listener runs; they are only used before
+    const ListenerOptions& options = mListenerOptions[state.index];
+    if (!(options.eventMask & eventMask)) {
+      continue;
+    }
+    sbAutoPerfLatency listenerLatency(
+                        sbIPerfStatistics::CATEGORY_MEDIACORE_EVENT,
+                        options.perfKey);
     rv = mListeners[state.index]->OnMediacoreEvent(aEvent);
     /* the return value is only checked on debug builds */
     #if DEBUG
@@ -166,8 +307,35 @@ sbBaseMediacoreEventTarget::AddListener(sbIMediacoreEventListener *aListener)
     // the listener already exists, do not re-add
     return NS_SUCCESS_LOSS_OF_INSIGNIFICANT_DATA;
   }
+
+  ListenerOptions options;
+  options.eventMask = sbIMediacoreEventListenerOptions::MASK_ALL;
+  options.perfKey.AssignLiteral("listener.");
+
+  nsString listenerName;
+  nsCOMPtr<sbIMediacoreEventListenerOptions> listenerOptions =
+    do_QueryInterface(aListener);
+  if (listenerOptions) {
+    rv = listenerOptions->GetEventMask(&options.eventMask);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = listenerOptions->GetListenerName(listenerName);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+  if (listenerName.IsEmpty()) {
+    options.perfKey.AppendLiteral("anonymous");
+  }
+  else {
+    options.perfKey.Append(NS_ConvertUTF16toUTF8(listenerName));
+  }
+
+  ListenerOptions* appended = mListenerOptions.AppendElement(options);
+  NS_ENSURE_TRUE(appended, NS_ERROR_OUT_OF_MEMORY);
   PRBool succeeded = mListeners.AppendObject(aListener);
-  return succeeded ? NS_OK : NS_ERROR_FAILURE;
+  if (!succeeded) {
+    mListenerOptions.RemoveElementAt(mListenerOptions.Length() - 1);
+    return NS_ERROR_FAILURE;
+  }
+  return NS_OK;
 }
 
   /* void removeEventListener (in sbIMediacoreEventListener aListener); */
@@ -203,6 +371,7 @@ sbBaseMediacoreEventTarget::RemoveListener(sbIMediacoreEventListener *aListener)
   // remove the listener
   PRBool succeeded = mListeners.RemoveObjectAt(indexToRemove);
   NS_ENSURE_TRUE(succeeded, NS_ERROR_FAILURE);
+  mListenerOptions.RemoveElementAt(indexToRemove);
 
   // fix up the stack to account for the removed listener
   // (decrease the stored length of the listener array)
@@ -214,3 +383,6 @@ sbBaseMediacoreEventTarget::RemoveListener(sbIMediacoreEventListener *aListener)
 
 NS_IMPL_THREADSAFE_ISUPPORTS1(sbBaseMediacoreEventTarget::AsyncDispatchHelper, 
                               nsIRunnable);
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbBaseMediacoreEventTarget::CoalescedDispatchHelper,
+                              nsIRunnable);
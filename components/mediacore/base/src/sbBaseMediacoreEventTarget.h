@@ -32,6 +32,8 @@
 #include <nsCOMPtr.h>
 #include <nsDeque.h>
 #include <nsIThread.h>
+#include <nsStringAPI.h>
+#include <nsTArray.h>
 #include <nsThreadUtils.h>
 #include <prmon.h>
 #include "sbMediacoreEvent.h"
@@ -50,7 +52,12 @@ class sbIMediacoreEventListener;
  * Base implementation of a mediacore event target.
  * This class provides a thread safe implementation of an event target. All events are dispatched on
  * the main thread.
- * TODO: Revisit the main thread dispatching this may prove a bottleneck for media cores.
+ *
+ * Listeners implementing sbIMediacoreEventListenerOptions are only called
+ * with the event types in their mask. Asynchronous dispatches of events that only carry a
+ * current value (buffering, volume, ...) are coalesced: while one is still
+ * pending, a newer event of the same type replaces it. If other events were
+ * dispatched in between, the newer event is delivered after them instead.
  */
 class sbBaseMediacoreEventTarget {
 public:
@@ -81,9 +88,56 @@ protected:
   nsresult DispatchEventInternal(sbIMediacoreEvent *aEvent, PRBool* _retval);
 
 private:
+  /**
+   * The options of a listener, read when it is added
+   */
+  struct ListenerOptions {
+    PRUint32 eventMask;
+    // key of the listener's latency in the performance statistics
+    nsCString perfKey;
+  };
+
+  /**
+   * An asynchronously dispatched event that is waiting for the main thread
+   */
+  struct PendingEvent {
+    PRUint32 type;
+    // the value of mAsyncSequence when the event was queued
+    PRUint32 sequence;
+    nsCOMPtr<sbIMediacoreEvent> event;
+  };
+
+  /**
+   * Returns the sbIMediacoreEventListenerOptions mask bit of an event type
+   */
+  static PRUint32 GetEventMask(PRUint32 aType);
+
+  /**
+   * Returns true if only the latest event of the type matters
+   */
+  static PRBool IsCoalescedType(PRUint32 aType);
+
+  /**
+   * Queue an asynchronous dispatch of a coalesced event type, replacing an
+   * event of that type that has not been dispatched yet
+   */
+  nsresult DispatchCoalesced(sbIMediacoreEvent *aEvent, PRUint32 aType);
+
+  /**
+   * Remove and return the pending event queued at the sequence number, if
+   * it has not been dropped
+   */
+  already_AddRefed<sbIMediacoreEvent> TakePendingEvent(PRUint32 aSequence);
+
   sbIMediacoreEventTarget * mTarget;
   nsCOMArray<sbIMediacoreEventListener> mListeners;
+  // the options of each listener, at the same index as in mListeners
+  nsTArray<ListenerOptions> mListenerOptions;
   PRMonitor* mMonitor;
+  // coalesced events waiting to be dispatched, protected by mMonitor
+  nsTArray<PendingEvent> mPendingEvents;
+  // counts asynchronous dispatches, protected by mMonitor
+  PRUint32 mAsyncSequence;
   /**
    * Tracks the state of the dispatch. This prevents dispatches to removed
    * events as well as ensuring that newly added events see the event
@@ -98,6 +152,7 @@ private:
   // our stack of states (holds *pointers* to DispatchStates)
   nsDeque mStates;
   friend class RemovalHelper;
+  friend class CoalescedDispatchHelper;
 
   /**
    * Helper classes used to enumerate the list of states and remove any that
@@ -164,6 +219,46 @@ private:
       nsCOMPtr<sbIMediacoreEventTarget> mTarget;
       nsCOMPtr<sbIMediacoreEvent> mEvent;
   };
+
+  // helper class for coalesced event dispatch; dispatches the latest event
+  // that replaced the one it was queued for, unless that was dropped
+  class CoalescedDispatchHelper : public nsIRunnable
+  {
+    NS_DECL_ISUPPORTS
+    public:
+      /**
+       * Initializes the dispatch helper. aTarget owns aBase and keeps it
+       * alive.
+       */
+      CoalescedDispatchHelper(sbBaseMediacoreEventTarget* aBase,
+                              sbIMediacoreEventTarget* aTarget,
+                              PRUint32 aSequence)
+        : mBase(aBase), mTarget(aTarget), mSequence(aSequence)
+      {
+        NS_ASSERTION(aBase, "CoalescedDispatchHelper: no base target");
+        NS_ASSERTION(aTarget, "CoalescedDispatchHelper: no target");
+      }
+      /**
+       * Dispatches the pending event, if any
+       */
+      NS_IMETHODIMP Run()
+      {
+        NS_ASSERTION(NS_IsMainThread(),
+                     "CoalescedDispatchHelper: not on main thread!");
+
+        nsCOMPtr<sbIMediacoreEvent> event =
+          mBase->TakePendingEvent(mSequence);
+        if (event) {
+          /* ignore return value */
+          mTarget->DispatchEvent(event, PR_FALSE, nsnull);
+        }
+        return NS_OK;
+      }
+    private:
+      sbBaseMediacoreEventTarget* mBase;
+      nsCOMPtr<sbIMediacoreEventTarget> mTarget;
+      PRUint32 mSequence;
+  };
 };
 
 #endif /* SBBASEMEDIACOREEVENTTARGET_H_ */
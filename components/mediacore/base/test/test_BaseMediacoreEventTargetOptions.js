@@ -0,0 +1,165 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2008 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+ * \brief Test listener options and coalescing of the media core event target
+ */
+
+Components.utils.import("resource://gre/modules/XPCOMUtils.jsm");
+
+const Options = Ci.sbIMediacoreEventListenerOptions;
+
+function testListener(aEventMask) {
+  this.log = [];
+  this.eventMask = aEventMask;
+}
+
+testListener.prototype = {
+  QueryInterface: XPCOMUtils.generateQI([Ci.sbIMediacoreEventListener,
+                                         Ci.sbIMediacoreEventListenerOptions]),
+  listenerName: "test",
+  onMediacoreEvent: function(event) {
+    this.log.push(event);
+  }
+}
+
+function dummyCore() {
+}
+
+dummyCore.prototype = {
+  QueryInterface: XPCOMUtils.generateQI([Ci.sbIMediacore]),
+}
+
+function createEventTarget() {
+  return Cc["@songbirdnest.com/mediacore/sbTestDummyMediacoreManager;1"]
+           .createInstance(Ci.sbIMediacoreEventTarget);
+}
+
+function createEvent(type, data) {
+  var creator = Cc["@songbirdnest.com/mediacore/sbTestMediacoreEventCreator;1"]
+                  .createInstance(Ci.sbITestMediacoreEventCreator);
+  return creator.create(type, null, data, new dummyCore());
+}
+
+/**
+ * Dispatch the events asynchronously, followed by a STREAM_END, and return
+ * the types and data the listener saw once the STREAM_END arrived
+ */
+function dispatchAsync(eventTarget, listener, events) {
+  for each (let [type, data] in events) {
+    eventTarget.dispatchEvent(createEvent(type, data), true);
+  }
+  eventTarget.dispatchEvent(createEvent(Ci.sbIMediacoreEvent.STREAM_END,
+                                        null),
+                            true);
+
+  function ended() {
+    return listener.log.some(function(event)
+                               event.type == Ci.sbIMediacoreEvent.STREAM_END);
+  }
+  while (!ended()) {
+    sleep(10, true);
+  }
+
+  var seen = listener.log.map(function(event) [event.type, event.data]);
+  listener.log = [];
+  return seen;
+}
+
+function assertEvents(seen, expected) {
+  assertEqual(seen.length, expected.length, "wrong number of events");
+  for (let i = 0; i < expected.length; ++i) {
+    assertEqual(seen[i][0], expected[i][0], "wrong event type at " + i);
+    assertEqual(seen[i][1], expected[i][1], "wrong event data at " + i);
+  }
+}
+
+function testCoalescing() {
+  const VOLUME = Ci.sbIMediacoreEvent.VOLUME_CHANGE;
+  const MUTE = Ci.sbIMediacoreEvent.MUTE_CHANGE;
+  const START = Ci.sbIMediacoreEvent.STREAM_START;
+  const END = Ci.sbIMediacoreEvent.STREAM_END;
+
+  var eventTarget = createEventTarget();
+  var listener = new testListener(Options.MASK_ALL);
+  eventTarget.addListener(listener);
+
+  // Back to back events of a type collapse into the latest one
+  assertEvents(dispatchAsync(eventTarget, listener,
+                             [[VOLUME, 1], [VOLUME, 2], [VOLUME, 3]]),
+               [[VOLUME, 3], [END, null]]);
+
+  // Events of different coalesced types are independent
+  assertEvents(dispatchAsync(eventTarget, listener,
+                             [[VOLUME, 1], [MUTE, true], [VOLUME, 2],
+                              [MUTE, false]]),
+               [[VOLUME, 2], [MUTE, false], [END, null]]);
+
+  // A newer event is delivered after the events dispatched since the one it
+  // replaces, not at that one's place
+  assertEvents(dispatchAsync(eventTarget, listener,
+                             [[VOLUME, 1], [START, null], [VOLUME, 2]]),
+               [[START, null], [VOLUME, 2], [END, null]]);
+
+  // Synchronous dispatches are never coalesced
+  eventTarget.dispatchEvent(createEvent(VOLUME, 1), false);
+  eventTarget.dispatchEvent(createEvent(VOLUME, 2), false);
+  assertEvents(listener.log.map(function(event) [event.type, event.data]),
+               [[VOLUME, 1], [VOLUME, 2]]);
+  listener.log = [];
+
+  eventTarget.removeListener(listener);
+}
+
+function testEventMask() {
+  var eventTarget = createEventTarget();
+  var stateListener = new testListener(Options.MASK_STREAM_STATE);
+  var errorListener = new testListener(Options.MASK_ERROR);
+  eventTarget.addListener(stateListener);
+  eventTarget.addListener(errorListener);
+
+  for each (let type in [Ci.sbIMediacoreEvent.METADATA_CHANGE,
+                         Ci.sbIMediacoreEvent.STREAM_START,
+                         Ci.sbIMediacoreEvent.BUFFERING,
+                         Ci.sbIMediacoreEvent.STREAM_STOP,
+                         Ci.sbIMediacoreEvent.ERROR_EVENT]) {
+    eventTarget.dispatchEvent(createEvent(type, null), false);
+  }
+
+  assertEqual(stateListener.log.map(function(event) event.type).join(),
+              [Ci.sbIMediacoreEvent.STREAM_START,
+               Ci.sbIMediacoreEvent.STREAM_STOP].join());
+  assertEqual(errorListener.log.map(function(event) event.type).join(),
+              [Ci.sbIMediacoreEvent.ERROR_EVENT].join());
+
+  eventTarget.removeListener(stateListener);
+  eventTarget.removeListener(errorListener);
+}
+
+function runTest () {
+  testCoalescing();
+  testEventMask();
+}
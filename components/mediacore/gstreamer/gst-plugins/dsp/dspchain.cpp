@@ -0,0 +1,608 @@
+/* GStreamer
+ * Copyright (C) <2010> Pioneers of the Inevitable <songbird@songbirdnest.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more
+ */
+
+/**
+ * SECTION:element-sbdspchain
+ *
+ * Runs playback audio through a configurable list of processing stages:
+ * a loudness normalizing dynamic EQ ("dynamic-eq") and a lookahead peak
+ * limiter ("limiter"). See dspstages.h for how stages are written.
+ *
+ * Stages that delay the audio, like the limiter, add to latency queries, and
+ * the audio they still hold at EOS is pushed out before the EOS.
+ *
+ * When stats-interval is set, an element message named "sb-dsp-stats" is
+ * posted after each interval of audio, with the number of frames processed,
+ * and for each stage the time it took ("<stage>-time", in ns) and that time
+ * as a fraction of the audio's duration ("<stage>-load"). The "clock" field
+ * says how the time was measured: "thread-cpu" for the streaming thread's
+ * CPU time, or "wall" where the platform has no such clock.
+ *
+ * The element can be tried out on its own, e.g.
+ *
+ *   gst-launch-0.10 -m audiotestsrc num-buffers=500 volume=1.0 !
+ *     audioconvert ! sbdspchain stages=dynamic-eq,limiter
+ *     stats-interval=1000 ! fakesink
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstbasetransform.h>
+
+#include "dspplugin.h"
+#include "dspstages.h"
+
+typedef struct _GstSbDspChain GstSbDspChain;
+typedef struct _GstSbDspChainClass GstSbDspChainClass;
+
+struct _GstSbDspChain {
+  GstBaseTransform parent;
+
+  /* Property values, protected by the object lock. changed is set whenever
+   * they are, and cleared once the chain has picked them up. */
+  gchar *stages;
+  DspSettings settings;
+  guint stats_interval;
+  gboolean stages_changed;
+  gboolean changed;
+
+  /* Delay added by the stages; protected by the object lock */
+  GstClockTime latency;
+
+  /* Only used from the streaming thread */
+  DspChain *chain;
+  gint rate;
+  gint channels;
+  /* End of the last buffer processed */
+  GstClockTime next_timestamp;
+
+  GstPadQueryFunction base_src_query;
+};
+
+struct _GstSbDspChainClass {
+  GstBaseTransformClass parent_class;
+};
+
+GST_DEBUG_CATEGORY_STATIC (sb_dsp_chain_debug);
+#define GST_CAT_DEFAULT sb_dsp_chain_debug
+
+static const GstElementDetails gst_sb_dsp_chain_details =
+GST_ELEMENT_DETAILS ((gchar *)"Playback DSP chain",
+    (gchar *)"Filter/Effect/Audio",
+    (gchar *)"Normalizes loudness and limits peaks",
+    (gchar *)"Pioneers of the Inevitable <songbird@songbirdnest.com");
+
+#define DSP_CHAIN_CAPS \
+    "audio/x-raw-float, " \
+    "width = (int) 32, " \
+    "endianness = (int) BYTE_ORDER, " \
+    "rate = (int) [ 1, MAX ], " \
+    "channels = (int) [ 1, 8 ]"
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (DSP_CHAIN_CAPS));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (DSP_CHAIN_CAPS));
+
+#define DEFAULT_STAGES "limiter"
+
+#ifdef DSP_HAVE_THREAD_CPU_TIME
+#define STATS_CLOCK "thread-cpu"
+#else
+#define STATS_CLOCK "wall"
+#endif
+
+enum
+{
+  PROP_0,
+  PROP_STAGES,
+  PROP_LIMITER_THRESHOLD,
+  PROP_LIMITER_LOOKAHEAD,
+  PROP_LIMITER_RELEASE,
+  PROP_DYNAMIC_EQ_TARGET,
+  PROP_DYNAMIC_EQ_MAX_GAIN,
+  PROP_STATS_INTERVAL,
+};
+
+static void gst_sb_dsp_chain_finalize (GObject * object);
+static void gst_sb_dsp_chain_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_sb_dsp_chain_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+
+static gboolean gst_sb_dsp_chain_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps);
+static GstFlowReturn gst_sb_dsp_chain_transform_ip (GstBaseTransform * trans,
+    GstBuffer * buf);
+static gboolean gst_sb_dsp_chain_start (GstBaseTransform * trans);
+static gboolean gst_sb_dsp_chain_stop (GstBaseTransform * trans);
+static gboolean gst_sb_dsp_chain_event (GstBaseTransform * trans,
+    GstEvent * event);
+static gboolean gst_sb_dsp_chain_src_query (GstPad * pad, GstQuery * query);
+
+static void gst_sb_dsp_chain_update (GstSbDspChain * self);
+static void gst_sb_dsp_chain_drain (GstSbDspChain * self);
+static void gst_sb_dsp_chain_post_stats (GstSbDspChain * self);
+
+GST_BOILERPLATE (GstSbDspChain, gst_sb_dsp_chain, GstBaseTransform,
+    GST_TYPE_BASE_TRANSFORM);
+
+static void
+gst_sb_dsp_chain_base_init (gpointer g_class)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (g_class);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+
+  gst_element_class_set_details (element_class, &gst_sb_dsp_chain_details);
+}
+
+static void
+gst_sb_dsp_chain_class_init (GstSbDspChainClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstBaseTransformClass *gstbasetransform_class;
+  DspSettings defaults;
+
+  gobject_class = (GObjectClass *) klass;
+  gstbasetransform_class = (GstBaseTransformClass *) klass;
+
+  dsp_settings_init_defaults (&defaults);
+
+  gobject_class->finalize = gst_sb_dsp_chain_finalize;
+  gobject_class->set_property = gst_sb_dsp_chain_set_property;
+  gobject_class->get_property = gst_sb_dsp_chain_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_STAGES,
+      g_param_spec_string ("stages", "Stages",
+          "Comma separated list of the stages to run, in order: "
+          "dynamic-eq, limiter", DEFAULT_STAGES,
+          (GParamFlags) G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_LIMITER_THRESHOLD,
+      g_param_spec_double ("limiter-threshold", "Limiter threshold",
+          "Highest peak level the limiter lets through, in dBFS",
+          -24.0, 0.0, defaults.limiter_threshold,
+          (GParamFlags) G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_LIMITER_LOOKAHEAD,
+      g_param_spec_uint ("limiter-lookahead", "Limiter lookahead",
+          "How far ahead the limiter looks for peaks, in ms. The audio is "
+          "delayed by this much",
+          1, 50, defaults.limiter_lookahead,
+          (GParamFlags) G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_LIMITER_RELEASE,
+      g_param_spec_uint ("limiter-release", "Limiter release",
+          "Time constant of the limiter's recovery after a peak, in ms",
+          1, 5000, defaults.limiter_release,
+          (GParamFlags) G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_DYNAMIC_EQ_TARGET,
+      g_param_spec_double ("dynamic-eq-target", "Dynamic EQ target",
+          "Loudness the dynamic EQ aims for, in dBFS RMS",
+          -40.0, 0.0, defaults.dynamic_eq_target,
+          (GParamFlags) G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_DYNAMIC_EQ_MAX_GAIN,
+      g_param_spec_double ("dynamic-eq-max-gain", "Dynamic EQ maximum gain",
+          "Most the dynamic EQ will boost or cut by, in dB",
+          0.0, 24.0, defaults.dynamic_eq_max_gain,
+          (GParamFlags) G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Statistics interval",
+          "Post an sb-dsp-stats message after this much audio, in ms. "
+          "0 to disable",
+          0, G_MAXUINT, 0, (GParamFlags) G_PARAM_READWRITE));
+
+  gstbasetransform_class->set_caps =
+      GST_DEBUG_FUNCPTR (gst_sb_dsp_chain_set_caps);
+  gstbasetransform_class->transform_ip =
+      GST_DEBUG_FUNCPTR (gst_sb_dsp_chain_transform_ip);
+  gstbasetransform_class->start = GST_DEBUG_FUNCPTR (gst_sb_dsp_chain_start);
+  gstbasetransform_class->stop = GST_DEBUG_FUNCPTR (gst_sb_dsp_chain_stop);
+  gstbasetransform_class->event = GST_DEBUG_FUNCPTR (gst_sb_dsp_chain_event);
+
+  GST_DEBUG_CATEGORY_INIT (sb_dsp_chain_debug, "sbdspchain", 0,
+      "Playback DSP chain");
+}
+
+static void
+gst_sb_dsp_chain_init (GstSbDspChain * self, GstSbDspChainClass * g_class)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (self);
+
+  self->stages = g_strdup (DEFAULT_STAGES);
+  dsp_settings_init_defaults (&self->settings);
+  self->stats_interval = 0;
+  self->stages_changed = TRUE;
+  self->changed = TRUE;
+  self->latency = 0;
+
+  self->chain = new DspChain ();
+  self->rate = 0;
+  self->channels = 0;
+  self->next_timestamp = GST_CLOCK_TIME_NONE;
+
+  gst_base_transform_set_in_place (trans, TRUE);
+
+  /* Add our delay to latency queries */
+  self->base_src_query = GST_PAD_QUERYFUNC (trans->srcpad);
+  gst_pad_set_query_function (trans->srcpad,
+      GST_DEBUG_FUNCPTR (gst_sb_dsp_chain_src_query));
+}
+
+static void
+gst_sb_dsp_chain_finalize (GObject * object)
+{
+  GstSbDspChain *self = GST_SB_DSP_CHAIN (object);
+
+  delete self->chain;
+  self->chain = NULL;
+
+  g_free (self->stages);
+  self->stages = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_sb_dsp_chain_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstSbDspChain *self = GST_SB_DSP_CHAIN (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_STAGES:
+      g_free (self->stages);
+      self->stages = g_value_dup_string (value);
+      self->stages_changed = TRUE;
+      break;
+    case PROP_LIMITER_THRESHOLD:
+      self->settings.limiter_threshold = g_value_get_double (value);
+      break;
+    case PROP_LIMITER_LOOKAHEAD:
+      self->settings.limiter_lookahead = g_value_get_uint (value);
+      break;
+    case PROP_LIMITER_RELEASE:
+      self->settings.limiter_release = g_value_get_uint (value);
+      break;
+    case PROP_DYNAMIC_EQ_TARGET:
+      self->settings.dynamic_eq_target = g_value_get_double (value);
+      break;
+    case PROP_DYNAMIC_EQ_MAX_GAIN:
+      self->settings.dynamic_eq_max_gain = g_value_get_double (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      self->stats_interval = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  /* The statistics interval doesn't need the stages reconfigured */
+  if (prop_id != PROP_STATS_INTERVAL)
+    self->changed = TRUE;
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_sb_dsp_chain_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstSbDspChain *self = GST_SB_DSP_CHAIN (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_STAGES:
+      g_value_set_string (value, self->stages);
+      break;
+    case PROP_LIMITER_THRESHOLD:
+      g_value_set_double (value, self->settings.limiter_threshold);
+      break;
+    case PROP_LIMITER_LOOKAHEAD:
+      g_value_set_uint (value, self->settings.limiter_lookahead);
+      break;
+    case PROP_LIMITER_RELEASE:
+      g_value_set_uint (value, self->settings.limiter_release);
+      break;
+    case PROP_DYNAMIC_EQ_TARGET:
+      g_value_set_double (value, self->settings.dynamic_eq_target);
+      break;
+    case PROP_DYNAMIC_EQ_MAX_GAIN:
+      g_value_set_double (value, self->settings.dynamic_eq_max_gain);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, self->stats_interval);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static gboolean
+gst_sb_dsp_chain_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
+{
+  GstSbDspChain *self = GST_SB_DSP_CHAIN (trans);
+  GstStructure *structure = gst_caps_get_structure (incaps, 0);
+  gint rate, channels;
+
+  if (!gst_structure_get_int (structure, "rate", &rate) ||
+      !gst_structure_get_int (structure, "channels", &channels)) {
+    GST_WARNING_OBJECT (self, "Caps without rate or channels");
+    return FALSE;
+  }
+
+  self->rate = rate;
+  self->channels = channels;
+
+  GST_OBJECT_LOCK (self);
+  self->changed = TRUE;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_sb_dsp_chain_update (self);
+
+  return TRUE;
+}
+
+static gboolean
+gst_sb_dsp_chain_start (GstBaseTransform * trans)
+{
+  GstSbDspChain *self = GST_SB_DSP_CHAIN (trans);
+
+  self->next_timestamp = GST_CLOCK_TIME_NONE;
+
+  return TRUE;
+}
+
+static gboolean
+gst_sb_dsp_chain_stop (GstBaseTransform * trans)
+{
+  GstSbDspChain *self = GST_SB_DSP_CHAIN (trans);
+
+  self->chain->Reset ();
+  self->chain->ResetStats ();
+
+  return TRUE;
+}
+
+static gboolean
+gst_sb_dsp_chain_event (GstBaseTransform * trans, GstEvent * event)
+{
+  GstSbDspChain *self = GST_SB_DSP_CHAIN (trans);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_STOP:
+      self->chain->Reset ();
+      self->next_timestamp = GST_CLOCK_TIME_NONE;
+      break;
+    case GST_EVENT_EOS:
+      gst_sb_dsp_chain_drain (self);
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->event (trans, event);
+}
+
+static gboolean
+gst_sb_dsp_chain_src_query (GstPad * pad, GstQuery * query)
+{
+  GstSbDspChain *self = GST_SB_DSP_CHAIN (gst_pad_get_parent (pad));
+  gboolean res;
+
+  if (!self)
+    return FALSE;
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_LATENCY) {
+    res = gst_pad_peer_query (GST_BASE_TRANSFORM (self)->sinkpad, query);
+    if (res) {
+      gboolean live;
+      GstClockTime min, max, latency;
+
+      gst_query_parse_latency (query, &live, &min, &max);
+
+      GST_OBJECT_LOCK (self);
+      latency = self->latency;
+      GST_OBJECT_UNLOCK (self);
+
+      min += latency;
+      if (GST_CLOCK_TIME_IS_VALID (max))
+        max += latency;
+      gst_query_set_latency (query, live, min, max);
+    }
+  } else {
+    res = self->base_src_query (pad, query);
+  }
+
+  gst_object_unref (self);
+  return res;
+}
+
+/* Pick up changed properties. Streaming thread only. */
+static void
+gst_sb_dsp_chain_update (GstSbDspChain * self)
+{
+  gchar *stages = NULL;
+  gboolean stages_changed;
+  DspSettings settings;
+
+  GST_OBJECT_LOCK (self);
+  if (!self->changed) {
+    GST_OBJECT_UNLOCK (self);
+    return;
+  }
+  stages_changed = self->stages_changed;
+  if (stages_changed)
+    stages = g_strdup (self->stages);
+  settings = self->settings;
+  self->stages_changed = FALSE;
+  self->changed = FALSE;
+  GST_OBJECT_UNLOCK (self);
+
+  if (stages_changed) {
+    if (!self->chain->SetStages (stages))
+      GST_WARNING_OBJECT (self, "Could not use all of the stages \"%s\"",
+          stages);
+    g_free (stages);
+  }
+
+  if (self->rate <= 0 || self->channels <= 0)
+    return;
+
+  self->chain->Configure (self->rate, self->channels, settings);
+
+  GstClockTime latency = gst_util_uint64_scale_int (
+      self->chain->GetLatency (), GST_SECOND, self->rate);
+  gboolean latency_changed;
+
+  GST_OBJECT_LOCK (self);
+  latency_changed = (latency != self->latency);
+  self->latency = latency;
+  GST_OBJECT_UNLOCK (self);
+
+  if (latency_changed) {
+    gst_element_post_message (GST_ELEMENT (self),
+        gst_message_new_latency (GST_OBJECT (self)));
+  }
+}
+
+static GstFlowReturn
+gst_sb_dsp_chain_transform_ip (GstBaseTransform * trans, GstBuffer * buf)
+{
+  GstSbDspChain *self = GST_SB_DSP_CHAIN (trans);
+
+  gst_sb_dsp_chain_update (self);
+
+  if (self->rate <= 0 || self->channels <= 0 ||
+      !self->chain->GetStageCount ())
+    return GST_FLOW_OK;
+
+  GstClockTime timestamp = GST_BUFFER_TIMESTAMP (buf);
+  guint frames = GST_BUFFER_SIZE (buf) / (sizeof (gfloat) * self->channels);
+  self->chain->Process ((gfloat *) GST_BUFFER_DATA (buf), frames);
+
+  if (GST_CLOCK_TIME_IS_VALID (timestamp)) {
+    self->next_timestamp = timestamp + gst_util_uint64_scale_int (frames,
+        GST_SECOND, self->rate);
+  }
+
+  gst_sb_dsp_chain_post_stats (self);
+
+  return GST_FLOW_OK;
+}
+
+/* Push out the audio the stages are still holding back by running silence
+ * through them, so that the end of the stream is not cut off. Streaming
+ * thread only. */
+static void
+gst_sb_dsp_chain_drain (GstSbDspChain * self)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (self);
+  GstBuffer *buf;
+  GstFlowReturn ret;
+
+  if (self->rate <= 0 || self->channels <= 0 ||
+      !self->chain->GetStageCount ())
+    return;
+
+  guint frames = self->chain->GetLatency ();
+  if (!frames)
+    return;
+
+  ret = gst_pad_alloc_buffer_and_set_caps (trans->srcpad,
+      GST_BUFFER_OFFSET_NONE, frames * self->channels * sizeof (gfloat),
+      GST_PAD_CAPS (trans->srcpad), &buf);
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (self, "Could not allocate a buffer to drain into: %s",
+        gst_flow_get_name (ret));
+    return;
+  }
+
+  memset (GST_BUFFER_DATA (buf), 0, GST_BUFFER_SIZE (buf));
+  self->chain->Process ((gfloat *) GST_BUFFER_DATA (buf), frames);
+
+  GST_BUFFER_TIMESTAMP (buf) = self->next_timestamp;
+  GST_BUFFER_DURATION (buf) = gst_util_uint64_scale_int (frames, GST_SECOND,
+      self->rate);
+
+  GST_DEBUG_OBJECT (self, "Draining %u frames", frames);
+  ret = gst_pad_push (trans->srcpad, buf);
+  if (ret != GST_FLOW_OK)
+    GST_DEBUG_OBJECT (self, "Drain push failed: %s", gst_flow_get_name (ret));
+
+  self->next_timestamp = GST_CLOCK_TIME_NONE;
+}
+
+static void
+gst_sb_dsp_chain_post_stats (GstSbDspChain * self)
+{
+  guint interval;
+
+  GST_OBJECT_LOCK (self);
+  interval = self->stats_interval;
+  GST_OBJECT_UNLOCK (self);
+
+  guint64 frames = self->chain->GetStatsFrames ();
+  if (!interval ||
+      frames < gst_util_uint64_scale_int (interval, self->rate, 1000))
+    return;
+
+  GstClockTime duration = gst_util_uint64_scale_int (frames, GST_SECOND,
+      self->rate);
+  GstStructure *structure = gst_structure_new ("sb-dsp-stats",
+      "frames", G_TYPE_UINT64, frames,
+      "duration", G_TYPE_UINT64, duration,
+      "clock", G_TYPE_STRING, STATS_CLOCK,
+      NULL);
+
+  for (guint i = 0; i < self->chain->GetStageCount (); i++) {
+    const char *name = self->chain->GetStageName (i);
+    guint64 time = self->chain->GetStageTime (i);
+    gchar *field;
+
+    field = g_strdup_printf ("%s-time", name);
+    gst_structure_set (structure, field, G_TYPE_UINT64, time, NULL);
+    g_free (field);
+
+    field = g_strdup_printf ("%s-load", name);
+    gst_structure_set (structure, field, G_TYPE_DOUBLE,
+        (gdouble) time / duration, NULL);
+    g_free (field);
+  }
+
+  self->chain->ResetStats ();
+
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_element (GST_OBJECT (self), structure));
+}
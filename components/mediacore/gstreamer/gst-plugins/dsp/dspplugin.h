@@ -0,0 +1,39 @@
+/* GStreamer
+ * Copyright (C) <2010> Pioneers of the Inevitable <songbird@songbirdnest.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+
+#define GST_DSP_VERSION "1.0.0"
+#define GST_DSP_LICENSE "LGPL"
+#define GST_DSP_PACKAGE "GStreamer DSP Plugin for Nightingale"
+#define GST_DSP_ORIGIN "http://www.getnightingale.com"
+#ifndef PACKAGE
+#define PACKAGE "Nightingale"
+#endif
+
+GType gst_sb_dsp_chain_get_type (void);
+#define GST_TYPE_SB_DSP_CHAIN \
+  (gst_sb_dsp_chain_get_type())
+#define GST_SB_DSP_CHAIN(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_SB_DSP_CHAIN,GstSbDspChain))
+#define GST_SB_DSP_CHAIN_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_SB_DSP_CHAIN,GstSbDspChainClass))
+#define GST_IS_SB_DSP_CHAIN(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_SB_DSP_CHAIN))
+#define GST_IS_SB_DSP_CHAIN_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_SB_DSP_CHAIN))
@@ -0,0 +1,525 @@
+/* GStreamer
+ * Copyright (C) <2010> Pioneers of the Inevitable <songbird@songbirdnest.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "dspstages.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void
+dsp_settings_init_defaults (DspSettings * settings)
+{
+  settings->limiter_threshold = -0.3;
+  settings->limiter_lookahead = 5;
+  settings->limiter_release = 100;
+  settings->dynamic_eq_target = -18.0;
+  settings->dynamic_eq_max_gain = 12.0;
+}
+
+/* Time used by the calling thread, in ns. Where there is no per thread CPU
+ * clock this is the wall clock, which also counts time spent preempted. */
+static inline guint64
+thread_time ()
+{
+#ifdef DSP_HAVE_THREAD_CPU_TIME
+  struct timespec ts;
+
+  if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+  return GST_TIMESPEC_TO_TIME (ts);
+#else
+  return gst_util_get_timestamp ();
+#endif
+}
+
+static inline gdouble
+db_to_gain (gdouble db)
+{
+  return pow (10.0, db / 20.0);
+}
+
+/* Brick wall peak limiter. The audio is delayed by the lookahead so the gain
+ * can be brought down before a peak arrives rather than after it.
+ *
+ * The gain for each frame is the running average, over the lookahead, of the
+ * smallest gain any frame in the lookahead needs. Every term of that average
+ * covers the frame leaving the delay line, so the gain applied to it is never
+ * more than it needs, and the gain ramps down smoothly over the lookahead
+ * instead of stepping. Rises in gain are then slowed by the release time. */
+class DspLimiterStage : public DspStage
+{
+public:
+  DspLimiterStage () : channels (0), lookahead (0), delay (NULL),
+      min_values (NULL), min_indexes (NULL), box (NULL) {}
+
+  virtual ~DspLimiterStage ()
+  {
+    Free ();
+  }
+
+  virtual const char *GetName () const { return "limiter"; }
+
+  virtual void Configure (gint rate, guint aChannels,
+      const DspSettings & settings)
+  {
+    Free ();
+
+    channels = aChannels;
+    threshold = (gfloat) db_to_gain (settings.limiter_threshold);
+    lookahead = MAX ((guint) ((guint64) settings.limiter_lookahead * rate /
+            1000), 1);
+
+    gdouble release_frames = MAX (settings.limiter_release * rate / 1000.0,
+        1.0);
+    release_coeff = (gfloat) (1.0 - exp (-1.0 / release_frames));
+
+    delay = g_new (gfloat, channels * (lookahead + DSP_BLOCK_FRAMES));
+    min_values = g_new (gfloat, lookahead + 1);
+    min_indexes = g_new (gint64, lookahead + 1);
+    box = g_new (gfloat, lookahead);
+
+    Reset ();
+  }
+
+  virtual void Reset ()
+  {
+    if (!delay)
+      return;
+
+    memset (delay, 0,
+        sizeof (gfloat) * channels * (lookahead + DSP_BLOCK_FRAMES));
+    for (guint i = 0; i < lookahead; i++)
+      box[i] = 1.0f;
+    box_sum = lookahead;
+    box_position = 0;
+    min_head = 0;
+    min_count = 0;
+    gain = 1.0f;
+    frame = 0;
+  }
+
+  virtual guint GetLatency () const { return lookahead; }
+
+  virtual void Process (DspBlock & block)
+  {
+    if (!delay || block.channel_count != channels)
+      return;
+
+    guint frames = block.frames;
+    gfloat peaks[DSP_BLOCK_FRAMES];
+    gfloat gains[DSP_BLOCK_FRAMES];
+
+    for (guint i = 0; i < frames; i++)
+      peaks[i] = 0.0f;
+    for (guint c = 0; c < channels; c++) {
+      const gfloat *samples = block.channels[c];
+      for (guint i = 0; i < frames; i++) {
+        gfloat value = fabsf (samples[i]);
+        peaks[i] = value > peaks[i] ? value : peaks[i];
+      }
+    }
+
+    guint capacity = lookahead + 1;
+    for (guint i = 0; i < frames; i++, frame++) {
+      gfloat required = peaks[i] > threshold ? threshold / peaks[i] : 1.0f;
+
+      /* Sliding minimum over the last lookahead + 1 frames, kept as a queue
+       * of increasing values */
+      if (min_count && min_indexes[min_head] < frame - (gint64) lookahead) {
+        min_head = (min_head + 1) % capacity;
+        min_count--;
+      }
+      while (min_count &&
+          min_values[(min_head + min_count - 1) % capacity] >= required)
+        min_count--;
+      guint tail = (min_head + min_count) % capacity;
+      min_values[tail] = required;
+      min_indexes[tail] = frame;
+      min_count++;
+
+      gfloat minimum = min_values[min_head];
+      box_sum += minimum - box[box_position];
+      box[box_position] = minimum;
+      box_position = (box_position + 1) % lookahead;
+
+      gfloat target = (gfloat) (box_sum / lookahead);
+      if (target < gain)
+        gain = target;
+      else
+        gain += (target - gain) * release_coeff;
+      gains[i] = gain;
+    }
+
+    for (guint c = 0; c < channels; c++) {
+      gfloat *line = delay + c * (lookahead + DSP_BLOCK_FRAMES);
+      gfloat *samples = block.channels[c];
+
+      memcpy (line + lookahead, samples, sizeof (gfloat) * frames);
+      for (guint i = 0; i < frames; i++)
+        samples[i] = line[i] * gains[i];
+      memmove (line, line + frames, sizeof (gfloat) * lookahead);
+    }
+  }
+
+private:
+  void Free ()
+  {
+    g_free (delay);
+    g_free (min_values);
+    g_free (min_indexes);
+    g_free (box);
+    delay = NULL;
+    min_values = NULL;
+    min_indexes = NULL;
+    box = NULL;
+  }
+
+  guint channels;
+  gfloat threshold;
+  guint lookahead;
+  gfloat release_coeff;
+
+  /* Per channel: lookahead frames of history followed by room for a block */
+  gfloat *delay;
+
+  /* Ring buffer of the sliding minimum queue */
+  gfloat *min_values;
+  gint64 *min_indexes;
+  guint min_head;
+  guint min_count;
+
+  /* The last lookahead minimums, for the running average */
+  gfloat *box;
+  guint box_position;
+  gdouble box_sum;
+
+  gfloat gain;
+  gint64 frame;
+};
+
+/* Loudness normalizing dynamic EQ.
+ *
+ * Each channel is split into a low band and the rest with a one pole
+ * crossover. The short term loudness of the whole signal and of the low band
+ * are tracked, ignoring near silence so that quiet passages and gaps are not
+ * pulled up. The overall gain moves the loudness towards the target, and the
+ * low band is partly corrected towards a reference balance, so thin or boomy
+ * recordings come out closer to each other. Gain changes are ramped across
+ * each block. */
+#define DYNAMIC_EQ_CROSSOVER 150.0     /* Hz */
+#define DYNAMIC_EQ_TIME_CONSTANT 3.0   /* seconds */
+#define DYNAMIC_EQ_GATE 1e-6           /* mean square, -60 dBFS */
+#define DYNAMIC_EQ_LOW_REFERENCE -6.0  /* dB relative to the whole signal */
+#define DYNAMIC_EQ_LOW_MAX_GAIN 6.0    /* dB */
+#define DYNAMIC_EQ_LOW_CORRECTION 0.5
+
+class DspDynamicEqStage : public DspStage
+{
+public:
+  DspDynamicEqStage () : channels (0) {}
+
+  virtual const char *GetName () const { return "dynamic-eq"; }
+
+  virtual void Configure (gint rate, guint aChannels,
+      const DspSettings & settings)
+  {
+    channels = aChannels;
+    sample_rate = rate;
+    target = settings.dynamic_eq_target;
+    max_gain = settings.dynamic_eq_max_gain;
+    crossover_coeff = (gfloat) (1.0 - exp (-2.0 * M_PI * DYNAMIC_EQ_CROSSOVER /
+            rate));
+    Reset ();
+  }
+
+  virtual void Reset ()
+  {
+    for (guint c = 0; c < DSP_MAX_CHANNELS; c++)
+      low_state[c] = 0.0f;
+    level = 0.0;
+    low_level = 0.0;
+    gain = 1.0f;
+    low_gain = 1.0f;
+  }
+
+  virtual void Process (DspBlock & block)
+  {
+    if (!channels || block.channel_count != channels)
+      return;
+
+    guint frames = block.frames;
+    gdouble sum = 0.0;
+    gdouble low_sum = 0.0;
+
+    for (guint c = 0; c < channels; c++) {
+      const gfloat *samples = block.channels[c];
+      gfloat *low = low_band[c];
+      gfloat state = low_state[c];
+
+      for (guint i = 0; i < frames; i++) {
+        state += (samples[i] - state) * crossover_coeff;
+        low[i] = state;
+      }
+      low_state[c] = state;
+
+      for (guint i = 0; i < frames; i++) {
+        sum += samples[i] * samples[i];
+        low_sum += low[i] * low[i];
+      }
+    }
+
+    gdouble mean_square = sum / (frames * channels);
+    if (mean_square > DYNAMIC_EQ_GATE) {
+      gdouble low_mean_square = low_sum / (frames * channels);
+      if (level == 0.0) {
+        level = mean_square;
+        low_level = low_mean_square;
+      } else {
+        gdouble coeff = 1.0 - exp (-(gdouble) frames /
+            (DYNAMIC_EQ_TIME_CONSTANT * sample_rate));
+        level += (mean_square - level) * coeff;
+        low_level += (low_mean_square - low_level) * coeff;
+      }
+    }
+
+    gfloat new_gain = gain;
+    gfloat new_low_gain = low_gain;
+    if (level > 0.0) {
+      gdouble level_db = 10.0 * log10 (level);
+      new_gain = (gfloat) db_to_gain (CLAMP (target - level_db,
+              -max_gain, max_gain));
+
+      if (low_level > 0.0) {
+        gdouble balance = 10.0 * log10 (low_level) - level_db;
+        gdouble low_db = (DYNAMIC_EQ_LOW_REFERENCE - balance) *
+            DYNAMIC_EQ_LOW_CORRECTION;
+        new_low_gain = (gfloat) db_to_gain (CLAMP (low_db,
+                -DYNAMIC_EQ_LOW_MAX_GAIN, DYNAMIC_EQ_LOW_MAX_GAIN));
+      }
+    }
+
+    gfloat gains[DSP_BLOCK_FRAMES];
+    gfloat low_gains[DSP_BLOCK_FRAMES];
+    gfloat step = (new_gain - gain) / frames;
+    gfloat low_step = (new_low_gain - low_gain) / frames;
+    for (guint i = 0; i < frames; i++) {
+      gains[i] = gain + step * (i + 1);
+      /* Extra gain for the low band, on top of the overall gain */
+      low_gains[i] = low_gain + low_step * (i + 1) - 1.0f;
+    }
+    gain = new_gain;
+    low_gain = new_low_gain;
+
+    for (guint c = 0; c < channels; c++) {
+      gfloat *samples = block.channels[c];
+      const gfloat *low = low_band[c];
+      for (guint i = 0; i < frames; i++)
+        samples[i] = (samples[i] + low[i] * low_gains[i]) * gains[i];
+    }
+  }
+
+private:
+  guint channels;
+  gint sample_rate;
+  gdouble target;
+  gdouble max_gain;
+  gfloat crossover_coeff;
+
+  gfloat low_band[DSP_MAX_CHANNELS][DSP_BLOCK_FRAMES];
+  gfloat low_state[DSP_MAX_CHANNELS];
+
+  /* Smoothed mean squares of the signal and its low band */
+  gdouble level;
+  gdouble low_level;
+
+  /* Gains reached at the end of the last block */
+  gfloat gain;
+  gfloat low_gain;
+};
+
+static DspStage *
+create_dynamic_eq_stage ()
+{
+  return new DspDynamicEqStage ();
+}
+
+static DspStage *
+create_limiter_stage ()
+{
+  return new DspLimiterStage ();
+}
+
+static const struct {
+  const char *name;
+  DspStage *(*create) ();
+} stage_table[] = {
+  { "dynamic-eq", create_dynamic_eq_stage },
+  { "limiter", create_limiter_stage },
+};
+
+DspStage *
+dsp_stage_create (const char *name)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (stage_table); i++) {
+    if (!strcmp (stage_table[i].name, name))
+      return stage_table[i].create ();
+  }
+  return NULL;
+}
+
+DspChain::DspChain () : stage_count (0), channels (0), stats_frames (0)
+{
+  ResetStats ();
+}
+
+DspChain::~DspChain ()
+{
+  Clear ();
+}
+
+void
+DspChain::Clear ()
+{
+  for (guint i = 0; i < stage_count; i++)
+    delete stages[i];
+  stage_count = 0;
+}
+
+gboolean
+DspChain::SetStages (const char *names)
+{
+  gboolean result = TRUE;
+
+  Clear ();
+  ResetStats ();
+
+  if (!names)
+    return TRUE;
+
+  gchar **list = g_strsplit (names, ",", -1);
+  for (gchar **name = list; *name; name++) {
+    g_strstrip (*name);
+    if (!**name)
+      continue;
+
+    if (stage_count == DSP_MAX_STAGES) {
+      result = FALSE;
+      break;
+    }
+
+    DspStage *stage = dsp_stage_create (*name);
+    if (!stage) {
+      result = FALSE;
+      continue;
+    }
+    stages[stage_count++] = stage;
+  }
+  g_strfreev (list);
+
+  return result;
+}
+
+void
+DspChain::Configure (gint rate, guint aChannels, const DspSettings & settings)
+{
+  channels = MIN (aChannels, DSP_MAX_CHANNELS);
+  for (guint i = 0; i < stage_count; i++)
+    stages[i]->Configure (rate, channels, settings);
+}
+
+void
+DspChain::Reset ()
+{
+  for (guint i = 0; i < stage_count; i++)
+    stages[i]->Reset ();
+}
+
+guint
+DspChain::GetLatency () const
+{
+  guint latency = 0;
+  for (guint i = 0; i < stage_count; i++)
+    latency += stages[i]->GetLatency ();
+  return latency;
+}
+
+void
+DspChain::Process (gfloat * samples, guint frames)
+{
+  if (!stage_count || !channels)
+    return;
+
+  DspBlock block;
+  block.channel_count = channels;
+  for (guint c = 0; c < channels; c++)
+    block.channels[c] = planar[c];
+
+  for (guint done = 0; done < frames; done += block.frames) {
+    gfloat *interleaved = samples + done * channels;
+
+    block.frames = MIN (frames - done, DSP_BLOCK_FRAMES);
+
+    for (guint c = 0; c < channels; c++) {
+      gfloat *out = planar[c];
+      for (guint i = 0; i < block.frames; i++)
+        out[i] = interleaved[i * channels + c];
+    }
+
+    for (guint s = 0; s < stage_count; s++) {
+      guint64 start = thread_time ();
+      stages[s]->Process (block);
+      stage_time[s] += thread_time () - start;
+    }
+
+    for (guint c = 0; c < channels; c++) {
+      const gfloat *in = planar[c];
+      for (guint i = 0; i < block.frames; i++)
+        interleaved[i * channels + c] = in[i];
+    }
+  }
+
+  stats_frames += frames;
+}
+
+const char *
+DspChain::GetStageName (guint index) const
+{
+  g_return_val_if_fail (index < stage_count, NULL);
+  return stages[index]->GetName ();
+}
+
+guint64
+DspChain::GetStageTime (guint index) const
+{
+  g_return_val_if_fail (index < stage_count, 0);
+  return stage_time[index];
+}
+
+void
+DspChain::ResetStats ()
+{
+  for (guint i = 0; i < DSP_MAX_STAGES; i++)
+    stage_time[i] = 0;
+  stats_frames = 0;
+}
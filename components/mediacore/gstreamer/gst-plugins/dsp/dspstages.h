@@ -0,0 +1,140 @@
+/* GStreamer
+ * Copyright (C) <2010> Pioneers of the Inevitable <songbird@songbirdnest.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more
+ */
+
+#ifndef __DSP_STAGES_H__
+#define __DSP_STAGES_H__
+
+#include <time.h>
+
+#include <glib.h>
+
+/* The processing stages run by the sbdspchain element.
+ *
+ * The chain cuts the incoming interleaved float audio into blocks of at most
+ * DSP_BLOCK_FRAMES frames and hands each stage one channel per array, so the
+ * per sample loops run over short contiguous arrays that the compiler can
+ * vectorize. Stages process blocks in place.
+ *
+ * To add a stage, subclass DspStage and add it to the table in dspstages.cpp;
+ * it can then be named in the element's "stages" property.
+ *
+ * Nothing here is thread safe; the element only uses a chain from its
+ * streaming thread.
+ */
+
+#define DSP_BLOCK_FRAMES 256
+#define DSP_MAX_CHANNELS 8
+#define DSP_MAX_STAGES 8
+
+/* Stage times are measured with the thread's CPU clock where there is one */
+#ifdef CLOCK_THREAD_CPUTIME_ID
+#define DSP_HAVE_THREAD_CPU_TIME 1
+#endif
+#define DSP_MAX_CHANNELS 8
+#define DSP_MAX_STAGES 8
+
+/* Settings shared by all stages; each uses the ones it needs */
+struct DspSettings {
+  /* Peak limiter ceiling in dBFS, lookahead and release times in ms */
+  gdouble limiter_threshold;
+  guint limiter_lookahead;
+  guint limiter_release;
+
+  /* Loudness the dynamic EQ aims for, in dBFS RMS, and the most it will boost
+   * or cut by, in dB */
+  gdouble dynamic_eq_target;
+  gdouble dynamic_eq_max_gain;
+};
+
+void dsp_settings_init_defaults (DspSettings * settings);
+
+struct DspBlock {
+  gfloat *channels[DSP_MAX_CHANNELS];
+  guint channel_count;
+  guint frames;
+};
+
+class DspStage
+{
+public:
+  virtual ~DspStage () {}
+
+  /* The name used in the "stages" property and in statistics */
+  virtual const char *GetName () const = 0;
+
+  /* Called before the first block, and whenever the format or settings
+   * change. Implies Reset. */
+  virtual void Configure (gint rate, guint channels,
+      const DspSettings & settings) = 0;
+
+  /* Forget the audio seen so far, e.g. after a seek */
+  virtual void Reset () = 0;
+
+  /* How far this stage delays its output, in frames */
+  virtual guint GetLatency () const { return 0; }
+
+  virtual void Process (DspBlock & block) = 0;
+};
+
+/* Returns a new stage with the given name, or NULL if there is none */
+DspStage *dsp_stage_create (const char *name);
+
+/* Runs a list of stages over interleaved audio, and keeps track of the time
+ * each one takes */
+class DspChain
+{
+public:
+  DspChain ();
+  ~DspChain ();
+
+  /* Replace the stages with those named in the comma separated list. Returns
+   * FALSE if any name was not recognised; the others are still used. */
+  gboolean SetStages (const char *names);
+
+  void Configure (gint rate, guint channels, const DspSettings & settings);
+  void Reset ();
+
+  /* Total delay of all stages, in frames */
+  guint GetLatency () const;
+
+  /* Process frames of interleaved audio in place */
+  void Process (gfloat * samples, guint frames);
+
+  guint GetStageCount () const { return stage_count; }
+  const char *GetStageName (guint index) const;
+
+  /* Time spent in the given stage since the last ResetStats, in ns: CPU time
+   * if DSP_HAVE_THREAD_CPU_TIME is defined, wall clock time otherwise */
+  guint64 GetStageTime (guint index) const;
+
+  /* Frames processed since the last ResetStats */
+  guint64 GetStatsFrames () const { return stats_frames; }
+
+  void ResetStats ();
+
+private:
+  void Clear ();
+
+  /* One channel per row; first so that it starts the allocation */
+  gfloat planar[DSP_MAX_CHANNELS][DSP_BLOCK_FRAMES];
+
+  DspStage *stages[DSP_MAX_STAGES];
+  guint64 stage_time[DSP_MAX_STAGES];
+  guint stage_count;
+
+  guint channels;
+  guint64 stats_frames;
+};
+
+#endif /* __DSP_STAGES_H__ */
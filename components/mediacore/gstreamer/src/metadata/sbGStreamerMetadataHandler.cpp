@@ -119,9 +119,7 @@ sbGStreamerMetadataHandler::Init()
   NS_ENSURE_TRUE(mLock, NS_ERROR_OUT_OF_MEMORY);
   
   // initialize GStreamer
-  nsresult rv;
-  nsCOMPtr<nsISupports> gstService =
-    do_GetService(SBGSTREAMERSERVICE_CONTRACTID , &rv);
+  nsresult rv = EnsureGStreamerInitialized();
   NS_ENSURE_SUCCESS(rv, rv);
 
   return NS_OK;
@@ -0,0 +1,379 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2011 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+
+#include "sbAudioAnalysisKernels.h"
+
+#include <math.h>
+#include <string.h>
+
+// The peak and sum of squares kernels have an SSE path where the compiler
+// targets it; the IIR filters are recursive and stay scalar.
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define SB_AUDIO_ANALYSIS_SSE 1
+#include <xmmintrin.h>
+#endif
+
+//------------------------------------------------------------------------------
+//
+// Simple kernels
+//
+//------------------------------------------------------------------------------
+
+float sbAudioPeak(const float *aSamples, PRUint32 aCount)
+{
+  PRUint32 i = 0;
+  float peak = 0.0f;
+
+#ifdef SB_AUDIO_ANALYSIS_SSE
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  __m128 peaks = _mm_setzero_ps();
+  for (; i + 4 <= aCount; i += 4) {
+    __m128 values = _mm_andnot_ps(signMask, _mm_loadu_ps(aSamples + i));
+    peaks = _mm_max_ps(peaks, values);
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, peaks);
+  for (PRUint32 lane = 0; lane < 4; ++lane) {
+    if (lanes[lane] > peak) {
+      peak = lanes[lane];
+    }
+  }
+#endif
+
+  for (; i < aCount; ++i) {
+    float value = fabsf(aSamples[i]);
+    if (value > peak) {
+      peak = value;
+    }
+  }
+  return peak;
+}
+
+double sbAudioSumOfSquares(const float *aSamples, PRUint32 aCount)
+{
+  PRUint32 i = 0;
+  double sum = 0.0;
+
+#ifdef SB_AUDIO_ANALYSIS_SSE
+  __m128 sums = _mm_setzero_ps();
+  for (; i + 4 <= aCount; i += 4) {
+    __m128 values = _mm_loadu_ps(aSamples + i);
+    sums = _mm_add_ps(sums, _mm_mul_ps(values, values));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, sums);
+  sum = (double)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+  for (; i < aCount; ++i) {
+    sum += (double)aSamples[i] * aSamples[i];
+  }
+  return sum;
+}
+
+//------------------------------------------------------------------------------
+//
+// sbReplayGainAnalysis
+//
+//------------------------------------------------------------------------------
+
+// Equal loudness filter coefficients for 44100 Hz from the ReplayGain
+// reference implementation.
+static const double YULE_B[11] = {
+   0.05418656406430, -0.02911007808948, -0.00848709379851, -0.00851165645469,
+  -0.00834990904936,  0.02245293253339, -0.02596338512915,  0.01624864962975,
+  -0.00240879051584,  0.00674613682247, -0.00187763777362
+};
+static const double YULE_A[11] = {
+   1.0,              -3.47845948550071,  6.36317777566148, -8.54751527471874,
+   9.47693607801280, -8.81498681370155,  6.85401540936998, -4.39470996079559,
+   2.19611684890774, -0.75104302451432,  0.13149317958808
+};
+static const double BUTTER_B[3] = {
+   0.98500175787242, -1.97000351574484,  0.98500175787242
+};
+static const double BUTTER_A[3] = {
+   1.0,              -1.96977855582618,  0.97022847566350
+};
+
+// Loudness of the pink noise reference signal
+static const double PINK_REF = 64.82;
+
+// The reference implementation works on 16 bit sample values
+static const double SAMPLE_SCALE = 32768.0;
+
+// 50ms RMS windows
+static const PRUint32 WINDOW_FRAMES = sbReplayGainAnalysis::SAMPLE_RATE / 20;
+
+sbReplayGainAnalysis::sbReplayGainAnalysis() :
+  mWindowSum(0.0),
+  mWindowFrames(0),
+  mPeak(0.0f)
+{
+  mHistogram.AppendElements(HISTOGRAM_SIZE);
+  memset(mHistogram.Elements(), 0, HISTOGRAM_SIZE * sizeof(PRUint32));
+  ResetFilters();
+}
+
+void sbReplayGainAnalysis::ResetFilters()
+{
+  memset(mYuleIn, 0, sizeof(mYuleIn));
+  memset(mYuleOut, 0, sizeof(mYuleOut));
+  memset(mButterIn, 0, sizeof(mButterIn));
+  memset(mButterOut, 0, sizeof(mButterOut));
+}
+
+void sbReplayGainAnalysis::FilterChannel(const float *aSamples,
+                                         PRUint32 aFrames,
+                                         PRUint32 aChannel,
+                                         float *aOut)
+{
+  double *yuleIn = mYuleIn[aChannel];
+  double *yuleOut = mYuleOut[aChannel];
+  double *butterIn = mButterIn[aChannel];
+  double *butterOut = mButterOut[aChannel];
+
+  for (PRUint32 frame = 0; frame < aFrames; ++frame) {
+    double x = aSamples[frame * CHANNELS + aChannel] * SAMPLE_SCALE;
+
+    // Yule-Walker. The 1e-10 keeps the filter out of denormals on silence.
+    double y = 1e-10 + YULE_B[0] * x;
+    for (PRUint32 tap = 0; tap < 10; ++tap) {
+      y += YULE_B[tap + 1] * yuleIn[tap] - YULE_A[tap + 1] * yuleOut[tap];
+    }
+    memmove(yuleIn + 1, yuleIn, 9 * sizeof(double));
+    memmove(yuleOut + 1, yuleOut, 9 * sizeof(double));
+    yuleIn[0] = x;
+    yuleOut[0] = y;
+
+    // Butterworth high pass
+    double z = BUTTER_B[0] * y +
+               BUTTER_B[1] * butterIn[0] + BUTTER_B[2] * butterIn[1] -
+               BUTTER_A[1] * butterOut[0] - BUTTER_A[2] * butterOut[1];
+    butterIn[1] = butterIn[0];
+    butterIn[0] = y;
+    butterOut[1] = butterOut[0];
+    butterOut[0] = z;
+
+    aOut[frame] = (float)z;
+  }
+}
+
+void sbReplayGainAnalysis::Process(const float *aSamples, PRUint32 aFrames)
+{
+  if (!aSamples || !aFrames) {
+    return;
+  }
+
+  float peak = sbAudioPeak(aSamples, aFrames * CHANNELS);
+  if (peak > mPeak) {
+    mPeak = peak;
+  }
+
+  while (aFrames > 0) {
+    // Never filter past the end of the current window
+    PRUint32 frames = WINDOW_FRAMES - mWindowFrames;
+    if (frames > aFrames) {
+      frames = aFrames;
+    }
+    if (mFiltered.Length() < frames) {
+      mFiltered.SetLength(frames);
+    }
+
+    for (PRUint32 channel = 0; channel < CHANNELS; ++channel) {
+      FilterChannel(aSamples, frames, channel, mFiltered.Elements());
+      mWindowSum += sbAudioSumOfSquares(mFiltered.Elements(), frames);
+    }
+
+    mWindowFrames += frames;
+    if (mWindowFrames == WINDOW_FRAMES) {
+      FlushWindow();
+    }
+
+    aSamples += frames * CHANNELS;
+    aFrames -= frames;
+  }
+}
+
+void sbReplayGainAnalysis::FlushWindow()
+{
+  double meanSquare = mWindowSum / (mWindowFrames * CHANNELS);
+  double value = STEPS_PER_DB * 10.0 * log10(meanSquare + 1e-37);
+
+  PRUint32 index = 0;
+  if (value > 0) {
+    index = (PRUint32)value;
+    if (index >= HISTOGRAM_SIZE) {
+      index = HISTOGRAM_SIZE - 1;
+    }
+  }
+  ++mHistogram[index];
+
+  mWindowSum = 0.0;
+  mWindowFrames = 0;
+}
+
+void
+sbReplayGainAnalysis::AccumulateHistogram(Histogram & aAlbumHistogram) const
+{
+  if (aAlbumHistogram.Length() < HISTOGRAM_SIZE) {
+    PRUint32 oldLength = aAlbumHistogram.Length();
+    aAlbumHistogram.SetLength(HISTOGRAM_SIZE);
+    memset(aAlbumHistogram.Elements() + oldLength,
+           0,
+           (HISTOGRAM_SIZE - oldLength) * sizeof(PRUint32));
+  }
+  for (PRUint32 index = 0; index < HISTOGRAM_SIZE; ++index) {
+    aAlbumHistogram[index] += mHistogram[index];
+  }
+}
+
+/* static */ double
+sbReplayGainAnalysis::GainFromHistogram(const Histogram & aHistogram)
+{
+  PRUint64 windows = 0;
+  for (PRUint32 index = 0; index < aHistogram.Length(); ++index) {
+    windows += aHistogram[index];
+  }
+  if (!windows) {
+    return 0.0;
+  }
+
+  // Find the loudness at the 95th percentile
+  PRInt64 upper = (PRInt64)ceil(windows * 0.05);
+  PRUint32 index = aHistogram.Length();
+  while (index-- > 0) {
+    upper -= aHistogram[index];
+    if (upper <= 0) {
+      break;
+    }
+  }
+
+  return PINK_REF - (double)index / STEPS_PER_DB;
+}
+
+//------------------------------------------------------------------------------
+//
+// sbTempoAnalysis
+//
+//------------------------------------------------------------------------------
+
+// Minimum normalized autocorrelation of the onsets at the chosen lag
+static const double MIN_CORRELATION = 0.1;
+
+sbTempoAnalysis::sbTempoAnalysis() :
+  mHopEnergy(0.0),
+  mHopFrames(0)
+{
+}
+
+void sbTempoAnalysis::Process(const float *aSamples, PRUint32 aFrames)
+{
+  for (PRUint32 frame = 0; frame < aFrames; ++frame) {
+    double mono = 0.5 * (aSamples[frame * CHANNELS] +
+                         aSamples[frame * CHANNELS + 1]);
+    mHopEnergy += mono * mono;
+    if (++mHopFrames == HOP_FRAMES) {
+      mEnvelope.AppendElement((float)log10(mHopEnergy / HOP_FRAMES + 1e-10));
+      mHopEnergy = 0.0;
+      mHopFrames = 0;
+    }
+  }
+}
+
+PRUint32 sbTempoAnalysis::GetBPM() const
+{
+  const double envelopeRate = (double)SAMPLE_RATE / HOP_FRAMES;
+  const PRUint32 minLag = (PRUint32)floor(60.0 * envelopeRate / MAX_BPM);
+  const PRUint32 maxLag = (PRUint32)ceil(60.0 * envelopeRate / MIN_BPM);
+
+  const PRUint32 length = mEnvelope.Length();
+  if (length < 2 * maxLag + 2) {
+    return 0;
+  }
+
+  // Onsets are increases in energy, with the mean removed so silence and
+  // steady passages don't dominate the autocorrelation
+  nsTArray<float> onsets;
+  onsets.SetLength(length - 1);
+  double mean = 0.0;
+  for (PRUint32 i = 1; i < length; ++i) {
+    float rise = mEnvelope[i] - mEnvelope[i - 1];
+    onsets[i - 1] = rise > 0.0f ? rise : 0.0f;
+    mean += onsets[i - 1];
+  }
+  mean /= onsets.Length();
+  double variance = 0.0;
+  for (PRUint32 i = 0; i < onsets.Length(); ++i) {
+    onsets[i] -= (float)mean;
+    variance += (double)onsets[i] * onsets[i];
+  }
+  variance /= onsets.Length();
+  if (variance <= 0.0) {
+    return 0;
+  }
+
+  // Score each lag, weighting towards 120 BPM to avoid picking half or double
+  // the tempo
+  nsTArray<double> scores;
+  scores.SetLength(maxLag + 2);
+  PRUint32 bestLag = 0;
+  double bestScore = 0.0;
+  double bestCorrelation = 0.0;
+  for (PRUint32 lag = minLag; lag <= maxLag + 1; ++lag) {
+    const PRUint32 count = onsets.Length() - lag;
+    double sum = 0.0;
+    for (PRUint32 i = 0; i < count; ++i) {
+      sum += (double)onsets[i] * onsets[i + lag];
+    }
+    double bpm = 60.0 * envelopeRate / lag;
+    double octaves = log(bpm / 120.0) / log(2.0);
+    scores[lag] = (sum / count) * exp(-0.5 * octaves * octaves);
+    if (lag <= maxLag && scores[lag] > bestScore) {
+      bestScore = scores[lag];
+      bestCorrelation = sum / count;
+      bestLag = lag;
+    }
+  }
+
+  // Without a clearly periodic onset pattern there is no tempo to report
+  if (!bestLag || bestCorrelation / variance < MIN_CORRELATION) {
+    return 0;
+  }
+
+  // Refine the lag by fitting a parabola through its neighbours
+  double lag = bestLag;
+  if (bestLag > minLag) {
+    double left = scores[bestLag - 1];
+    double right = scores[bestLag + 1];
+    double denominator = left - 2.0 * bestScore + right;
+    if (denominator < 0.0) {
+      lag += 0.5 * (left - right) / denominator;
+    }
+  }
+
+  return (PRUint32)floor(60.0 * envelopeRate / lag + 0.5);
+}
@@ -0,0 +1,168 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2011 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+
+#ifndef _SB_AUDIO_ANALYSIS_KERNELS_H_
+#define _SB_AUDIO_ANALYSIS_KERNELS_H_
+
+#include <nsTArray.h>
+#include <prtypes.h>
+
+/**
+ * \file  sbAudioAnalysisKernels.h
+ * \brief Sample processing kernels used by the audio analyzer.
+ *
+ * All kernels work on interleaved stereo float samples at 44100 Hz, which is
+ * what the analyzer constrains sbGStreamerAudioProcessor to deliver. None of
+ * them are thread safe; each analysis task owns its own instances.
+ */
+
+/**
+ * Returns the largest absolute sample value in aSamples.
+ */
+float sbAudioPeak(const float *aSamples, PRUint32 aCount);
+
+/**
+ * Returns the sum of the squares of aSamples.
+ */
+double sbAudioSumOfSquares(const float *aSamples, PRUint32 aCount);
+
+/**
+ * ReplayGain loudness analysis, following the reference ReplayGain algorithm:
+ * an equal loudness filter (Yule-Walker followed by a Butterworth high pass),
+ * the RMS of each 50ms window recorded in a histogram, and the 95th
+ * percentile of that histogram compared against the pink noise reference.
+ */
+class sbReplayGainAnalysis
+{
+public:
+  enum {
+    SAMPLE_RATE = 44100,
+    CHANNELS = 2,
+    // 100 histogram steps per dB over 120 dB
+    STEPS_PER_DB = 100,
+    MAX_DB = 120,
+    HISTOGRAM_SIZE = STEPS_PER_DB * MAX_DB
+  };
+
+  typedef nsTArray<PRUint32> Histogram;
+
+  sbReplayGainAnalysis();
+
+  /**
+   * Processes aFrames frames of interleaved stereo audio.
+   */
+  void Process(const float *aSamples, PRUint32 aFrames);
+
+  /**
+   * Resets the filter state, e.g. after a gap in the audio.
+   */
+  void ResetFilters();
+
+  /**
+   * Returns the track gain in dB, or 0 if no audio was processed.
+   */
+  double GetGain() const
+  {
+    return GainFromHistogram(mHistogram);
+  }
+
+  /**
+   * Returns the largest absolute sample value processed.
+   */
+  float GetPeak() const
+  {
+    return mPeak;
+  }
+
+  /**
+   * Adds the track's loudness histogram to aAlbumHistogram
+   */
+  void AccumulateHistogram(Histogram & aAlbumHistogram) const;
+
+  /**
+   * Returns the gain in dB for the given (possibly album) histogram
+   */
+  static double GainFromHistogram(const Histogram & aHistogram);
+
+private:
+  void FilterChannel(const float *aSamples,
+                     PRUint32 aFrames,
+                     PRUint32 aChannel,
+                     float *aOut);
+
+  void FlushWindow();
+
+  // Filter histories per channel. The Yule filter is order 10 and the
+  // Butterworth filter order 2.
+  double mYuleIn[CHANNELS][10];
+  double mYuleOut[CHANNELS][10];
+  double mButterIn[CHANNELS][2];
+  double mButterOut[CHANNELS][2];
+
+  // Scratch buffer holding one channel of filtered output
+  nsTArray<float> mFiltered;
+
+  Histogram mHistogram;
+  double mWindowSum;
+  PRUint32 mWindowFrames;
+  float mPeak;
+};
+
+/**
+ * Tempo estimation from the autocorrelation of an onset envelope. The envelope
+ * is the log energy of each hop of mono audio; onsets are its positive
+ * differences.
+ */
+class sbTempoAnalysis
+{
+public:
+  enum {
+    SAMPLE_RATE = 44100,
+    CHANNELS = 2,
+    HOP_FRAMES = 512,
+    MIN_BPM = 60,
+    MAX_BPM = 180
+  };
+
+  sbTempoAnalysis();
+
+  /**
+   * Processes aFrames frames of interleaved stereo audio.
+   */
+  void Process(const float *aSamples, PRUint32 aFrames);
+
+  /**
+   * Returns the estimated tempo in beats per minute, or 0 if there wasn't
+   * enough audio to make an estimate.
+   */
+  PRUint32 GetBPM() const;
+
+private:
+  nsTArray<float> mEnvelope;
+  double mHopEnergy;
+  PRUint32 mHopFrames;
+};
+
+#endif /* _SB_AUDIO_ANALYSIS_KERNELS_H_ */
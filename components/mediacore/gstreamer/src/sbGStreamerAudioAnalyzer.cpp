@@ -0,0 +1,1013 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#include "sbGStreamerAudioAnalyzer.h"
+
+#include "sbGStreamerAudioProcessor.h"
+
+#include <sbClassInfoUtils.h>
+#include <sbPropertiesCID.h>
+#include <sbStandardProperties.h>
+#include <sbStringUtils.h>
+#include <sbTArrayStringEnumerator.h>
+
+#include <sbIMediaInspector.h>
+#include <sbIMediacoreError.h>
+#include <sbIPropertyArray.h>
+
+#include <nsArrayUtils.h>
+#include <nsComponentManagerUtils.h>
+#include <nsThreadUtils.h>
+#include <nsIVariant.h>
+
+#include <pratom.h>
+#include <prlog.h>
+#include <prprf.h>
+#include <prsystem.h>
+
+/**
+ * To log this class, set the following environment variable in a debug build:
+ *  NSPR_LOG_MODULES=sbGStreamerAudioAnalyzer:5 (or :3 for LOG messages only)
+ */
+#ifdef PR_LOGGING
+static PRLogModuleInfo* gGStreamerAudioAnalyzer =
+  PR_NewLogModule("sbGStreamerAudioAnalyzer");
+#define LOG(args) PR_LOG(gGStreamerAudioAnalyzer, PR_LOG_WARNING, args)
+#define TRACE(args) PR_LOG(gGStreamerAudioAnalyzer, PR_LOG_DEBUG, args)
+#else /* PR_LOGGING */
+#define LOG(args)   /* nothing */
+#define TRACE(args) /* nothing */
+#endif /* PR_LOGGING */
+
+// Size, in samples, of the blocks we ask the audio processor for. This is
+// 4096 stereo frames, or about 93ms of audio.
+#define ANALYSIS_BLOCK_SIZE 8192
+
+// Decoding is suspended once this many blocks are waiting for the analysis
+// thread, and resumed once the backlog drops to ANALYSIS_RESUME_BLOCKS.
+#define ANALYSIS_MAX_PENDING_BLOCKS 32
+#define ANALYSIS_RESUME_BLOCKS 8
+
+// Upper bound on the default number of items analysed at once; decoding is
+// also disk bound, so more than this rarely helps.
+#define ANALYSIS_MAX_DEFAULT_CONCURRENCY 4
+
+/**
+ * A block of decoded audio on its way to the analysis thread.
+ */
+class sbAudioAnalysisBlock : public nsRunnable
+{
+public:
+  sbAudioAnalysisBlock(sbAudioAnalysisTask *aTask) :
+    mTask(aTask)
+  {
+  }
+
+  NS_IMETHOD Run()
+  {
+    mTask->ProcessBlock(mSamples.Elements(), mSamples.Length());
+    return NS_OK;
+  }
+
+  nsTArray<float> mSamples;
+
+private:
+  nsRefPtr<sbAudioAnalysisTask> mTask;
+};
+
+static nsresult
+FormatDecimal(double aValue, nsAString & aString)
+{
+  char buffer[32];
+  PRUint32 length = PR_snprintf(buffer, sizeof(buffer), "%.6f", aValue);
+  NS_ENSURE_TRUE(length > 0 && length < sizeof(buffer), NS_ERROR_FAILURE);
+
+  aString.Assign(NS_ConvertASCIItoUTF16(buffer, length));
+  return NS_OK;
+}
+
+static nsresult
+FormatGain(double aGain, nsAString & aString)
+{
+  char buffer[32];
+  PRUint32 length = PR_snprintf(buffer, sizeof(buffer), "%.2f", aGain);
+  NS_ENSURE_TRUE(length > 0 && length < sizeof(buffer), NS_ERROR_FAILURE);
+
+  aString.Assign(NS_ConvertASCIItoUTF16(buffer, length));
+  return NS_OK;
+}
+
+//------------------------------------------------------------------------------
+//
+// sbAudioAnalysisTask
+//
+//------------------------------------------------------------------------------
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbAudioAnalysisTask,
+                              sbIMediacoreAudioProcessorListener)
+
+sbAudioAnalysisTask::sbAudioAnalysisTask(sbGStreamerAudioAnalyzer *aAnalyzer,
+                                         sbIMediaItem *aMediaItem,
+                                         nsIThread *aThread,
+                                         const nsAString & aAlbumKey) :
+  mAnalyzer(aAnalyzer),
+  mMediaItem(aMediaItem),
+  mThread(aThread),
+  mAlbumKey(aAlbumKey),
+  mPendingBlocks(0),
+  mSuspended(PR_FALSE),
+  mFinishing(PR_FALSE),
+  mFailed(PR_FALSE),
+  mGain(0.0),
+  mPeak(0.0f),
+  mBPM(0)
+{
+}
+
+sbAudioAnalysisTask::~sbAudioAnalysisTask()
+{
+}
+
+nsresult
+sbAudioAnalysisTask::Start()
+{
+  TRACE(("sbAudioAnalysisTask[0x%.8x] - Start", this));
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_FAILURE);
+
+  nsresult rv;
+  mProcessor = do_CreateInstance(SB_GSTREAMER_AUDIO_PROCESSOR_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mProcessor->SetConstraintSampleRate(sbReplayGainAnalysis::SAMPLE_RATE);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = mProcessor->SetConstraintChannelCount(sbReplayGainAnalysis::CHANNELS);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = mProcessor->SetConstraintAudioFormat(
+          sbIMediacoreAudioProcessor::FORMAT_FLOAT);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = mProcessor->SetConstraintBlockSize(ANALYSIS_BLOCK_SIZE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mProcessor->Init(this);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mProcessor->Start(mMediaItem);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+void
+sbAudioAnalysisTask::Cancel()
+{
+  NS_ASSERTION(NS_IsMainThread(),
+    "sbAudioAnalysisTask::Cancel is main thread only!");
+
+  if (mFinishing)
+    return;
+
+  mFailed = PR_TRUE;
+  nsresult rv = StopAndFinish();
+  NS_ENSURE_SUCCESS(rv, /* void */);
+}
+
+nsresult
+sbAudioAnalysisTask::StopAndFinish()
+{
+  NS_ENSURE_FALSE(mFinishing, NS_ERROR_ALREADY_INITIALIZED);
+  mFinishing = PR_TRUE;
+
+  nsresult rv;
+  if (mProcessor) {
+    // This fails if the processor never started; we still need to finish so
+    // that the analyzer hears about this item.
+    rv = mProcessor->Stop();
+    if (NS_FAILED(rv)) {
+      NS_WARNING("Failed to stop audio processor");
+    }
+  }
+
+  nsCOMPtr<nsIRunnable> runnable =
+    NS_NEW_RUNNABLE_METHOD(sbAudioAnalysisTask, this, Finish);
+  NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = mThread->Dispatch(runnable, NS_DISPATCH_NORMAL);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+void
+sbAudioAnalysisTask::ProcessBlock(const float *aSamples, PRUint32 aCount)
+{
+  PRUint32 frames = aCount / sbReplayGainAnalysis::CHANNELS;
+  mReplayGain.Process(aSamples, frames);
+  mTempo.Process(aSamples, frames);
+
+  if (PR_AtomicDecrement(&mPendingBlocks) == ANALYSIS_RESUME_BLOCKS) {
+    nsCOMPtr<nsIRunnable> runnable =
+      NS_NEW_RUNNABLE_METHOD(sbAudioAnalysisTask, this, Resume);
+    NS_ENSURE_TRUE(runnable, /* void */);
+
+    nsresult rv = NS_DispatchToMainThread(runnable);
+    NS_ENSURE_SUCCESS(rv, /* void */);
+  }
+}
+
+void
+sbAudioAnalysisTask::ResetFilters()
+{
+  mReplayGain.ResetFilters();
+}
+
+void
+sbAudioAnalysisTask::Finish()
+{
+  TRACE(("sbAudioAnalysisTask[0x%.8x] - Finish", this));
+
+  if (!mFailed) {
+    mGain = mReplayGain.GetGain();
+    mPeak = mReplayGain.GetPeak();
+    mBPM = mTempo.GetBPM();
+    mReplayGain.AccumulateHistogram(mHistogram);
+
+    // A stream with less than one analysis window of audio has no loudness
+    // to speak of; don't write a gain of zero for it.
+    PRUint64 windows = 0;
+    for (PRUint32 index = 0; index < mHistogram.Length(); ++index) {
+      windows += mHistogram[index];
+    }
+    if (!windows) {
+      mFailed = PR_TRUE;
+    }
+  }
+
+  nsCOMPtr<nsIRunnable> runnable =
+    NS_NEW_RUNNABLE_METHOD(sbAudioAnalysisTask, this, NotifyComplete);
+  NS_ENSURE_TRUE(runnable, /* void */);
+
+  nsresult rv = NS_DispatchToMainThread(runnable);
+  NS_ENSURE_SUCCESS(rv, /* void */);
+}
+
+void
+sbAudioAnalysisTask::Resume()
+{
+  if (!mSuspended || mFinishing)
+    return;
+
+  mSuspended = PR_FALSE;
+  nsresult rv = mProcessor->Resume();
+  NS_ENSURE_SUCCESS(rv, /* void */);
+}
+
+void
+sbAudioAnalysisTask::NotifyComplete()
+{
+  // Drop the processor, and with it its reference to us.
+  mProcessor = nsnull;
+
+  mAnalyzer->OnTaskComplete(this);
+  mAnalyzer = nsnull;
+}
+
+/* sbIMediacoreAudioProcessorListener interface implementation */
+
+NS_IMETHODIMP
+sbAudioAnalysisTask::OnFloatAudioDecoded(PRUint32 aSampleNumber,
+                                         PRUint32 aNumSamples,
+                                         float *aSampleData)
+{
+  NS_ENSURE_ARG_POINTER(aSampleData);
+
+  if (mFinishing)
+    return NS_OK;
+
+  nsRefPtr<sbAudioAnalysisBlock> block = new sbAudioAnalysisBlock(this);
+  NS_ENSURE_TRUE(block, NS_ERROR_OUT_OF_MEMORY);
+
+  float *samples = block->mSamples.AppendElements(aSampleData, aNumSamples);
+  NS_ENSURE_TRUE(samples, NS_ERROR_OUT_OF_MEMORY);
+
+  nsresult rv = mThread->Dispatch(block, NS_DISPATCH_NORMAL);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Don't let decoding run arbitrarily far ahead of the analysis thread.
+  if (PR_AtomicIncrement(&mPendingBlocks) >= ANALYSIS_MAX_PENDING_BLOCKS &&
+      !mSuspended)
+  {
+    mSuspended = PR_TRUE;
+    rv = mProcessor->Suspend();
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbAudioAnalysisTask::OnIntegerAudioDecoded(PRUint32 aSampleNumber,
+                                           PRUint32 aNumSamples,
+                                           PRInt16 *aSampleData)
+{
+  // We constrain the processor to float output.
+  NS_NOTREACHED("Integer samples delivered to the audio analyzer");
+  return NS_ERROR_NOT_IMPLEMENTED;
+}
+
+NS_IMETHODIMP
+sbAudioAnalysisTask::OnEvent(PRUint32 aEventType, nsIVariant *aDetails)
+{
+  nsresult rv;
+
+  if (mFinishing)
+    return NS_OK;
+
+  switch (aEventType) {
+    case sbIMediacoreAudioProcessorListener::EVENT_START:
+    {
+      // The kernels only handle the format we asked for.
+      nsCOMPtr<nsISupports> supports;
+      rv = aDetails->GetAsISupports(getter_AddRefs(supports));
+      NS_ENSURE_SUCCESS(rv, rv);
+      nsCOMPtr<sbIMediaFormatAudio> format = do_QueryInterface(supports, &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      PRInt32 sampleRate, channels;
+      rv = format->GetSampleRate(&sampleRate);
+      NS_ENSURE_SUCCESS(rv, rv);
+      rv = format->GetChannels(&channels);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      if (sampleRate != sbReplayGainAnalysis::SAMPLE_RATE ||
+          channels != sbReplayGainAnalysis::CHANNELS)
+      {
+        LOG(("Unexpected analysis format %d Hz, %d channels",
+             sampleRate, channels));
+        mFailed = PR_TRUE;
+        rv = StopAndFinish();
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
+      break;
+    }
+    case sbIMediacoreAudioProcessorListener::EVENT_GAP:
+    {
+      // Don't let the filters ring across a discontinuity.
+      nsCOMPtr<nsIRunnable> runnable =
+        NS_NEW_RUNNABLE_METHOD(sbAudioAnalysisTask, this, ResetFilters);
+      NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+      rv = mThread->Dispatch(runnable, NS_DISPATCH_NORMAL);
+      NS_ENSURE_SUCCESS(rv, rv);
+      break;
+    }
+    case sbIMediacoreAudioProcessorListener::EVENT_EOS:
+      rv = StopAndFinish();
+      NS_ENSURE_SUCCESS(rv, rv);
+      break;
+    case sbIMediacoreAudioProcessorListener::EVENT_ERROR:
+    {
+      mFailed = PR_TRUE;
+
+      nsCOMPtr<nsISupports> supports;
+      rv = aDetails->GetAsISupports(getter_AddRefs(supports));
+      if (NS_SUCCEEDED(rv)) {
+        nsCOMPtr<sbIMediacoreError> error = do_QueryInterface(supports, &rv);
+        if (NS_SUCCEEDED(rv)) {
+          error->GetMessage(mErrorMessage);
+        }
+      }
+
+      rv = StopAndFinish();
+      NS_ENSURE_SUCCESS(rv, rv);
+      break;
+    }
+    default:
+      break;
+  }
+
+  return NS_OK;
+}
+
+//------------------------------------------------------------------------------
+//
+// sbGStreamerAudioAnalyzer
+//
+//------------------------------------------------------------------------------
+
+NS_IMPL_THREADSAFE_ISUPPORTS4(sbGStreamerAudioAnalyzer,
+                              nsIClassInfo,
+                              sbIGStreamerAudioAnalyzer,
+                              sbIJobProgress,
+                              sbIJobCancelable)
+
+NS_IMPL_CI_INTERFACE_GETTER3(sbGStreamerAudioAnalyzer,
+                             sbIGStreamerAudioAnalyzer,
+                             sbIJobProgress,
+                             sbIJobCancelable)
+
+NS_DECL_CLASSINFO(sbGStreamerAudioAnalyzer);
+NS_IMPL_THREADSAFE_CI(sbGStreamerAudioAnalyzer);
+
+sbGStreamerAudioAnalyzer::sbGStreamerAudioAnalyzer() :
+  mMaxConcurrentItems(1),
+  mOverwriteBPM(PR_FALSE),
+  mStarted(PR_FALSE),
+  mCancelled(PR_FALSE),
+  mNextItem(0),
+  mCompletedItems(0),
+  mStatus(sbIJobProgress::STATUS_RUNNING) // There is no NOT_STARTED
+{
+}
+
+sbGStreamerAudioAnalyzer::~sbGStreamerAudioAnalyzer()
+{
+}
+
+nsresult
+sbGStreamerAudioAnalyzer::Init()
+{
+  PRInt32 processors = PR_GetNumberOfProcessors();
+  if (processors > 1) {
+    mMaxConcurrentItems = PR_MIN((PRUint32)processors,
+                                 ANALYSIS_MAX_DEFAULT_CONCURRENCY);
+  }
+
+  PRBool success = mAlbums.Init();
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+  return NS_OK;
+}
+
+/* sbIGStreamerAudioAnalyzer interface implementation */
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetMaxConcurrentItems(PRUint32 *aMaxConcurrentItems)
+{
+  NS_ENSURE_ARG_POINTER(aMaxConcurrentItems);
+
+  *aMaxConcurrentItems = mMaxConcurrentItems;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::SetMaxConcurrentItems(PRUint32 aMaxConcurrentItems)
+{
+  NS_ENSURE_ARG(aMaxConcurrentItems > 0);
+  NS_ENSURE_FALSE(mStarted, NS_ERROR_ALREADY_INITIALIZED);
+
+  mMaxConcurrentItems = aMaxConcurrentItems;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetOverwriteBPM(PRBool *aOverwriteBPM)
+{
+  NS_ENSURE_ARG_POINTER(aOverwriteBPM);
+
+  *aOverwriteBPM = mOverwriteBPM;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::SetOverwriteBPM(PRBool aOverwriteBPM)
+{
+  mOverwriteBPM = aOverwriteBPM;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::AnalyzeItems(nsIArray *aMediaItems)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItems);
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_FAILURE);
+  NS_ENSURE_FALSE(mStarted, NS_ERROR_ALREADY_INITIALIZED);
+
+  nsresult rv;
+
+  mStarted = PR_TRUE;
+
+  PRUint32 length;
+  rv = aMediaItems->GetLength(&length);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Gather the items and count the tracks of each album up front, so that we
+  // know when the last track of an album has been analysed.
+  for (PRUint32 i = 0; i < length; ++i) {
+    nsCOMPtr<sbIMediaItem> mediaItem = do_QueryElementAt(aMediaItems, i, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRBool success = mMediaItems.AppendObject(mediaItem);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+    nsString albumKey;
+    rv = GetAlbumKey(mediaItem, albumKey);
+    NS_ENSURE_SUCCESS(rv, rv);
+    if (albumKey.IsEmpty())
+      continue;
+
+    AlbumInfo *album;
+    if (!mAlbums.Get(albumKey, &album)) {
+      nsAutoPtr<AlbumInfo> newAlbum(new AlbumInfo());
+      NS_ENSURE_TRUE(newAlbum, NS_ERROR_OUT_OF_MEMORY);
+      success = mAlbums.Put(albumKey, newAlbum);
+      NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+      album = newAlbum.forget();
+    }
+    album->mRemaining++;
+  }
+
+  if (!mMediaItems.Count()) {
+    // Nothing to do, but listeners still want to hear that we're done.
+    nsCOMPtr<nsIRunnable> runnable =
+      NS_NEW_RUNNABLE_METHOD(sbGStreamerAudioAnalyzer, this, Complete);
+    NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+    rv = NS_DispatchToMainThread(runnable);
+    NS_ENSURE_SUCCESS(rv, rv);
+    return NS_OK;
+  }
+
+  rv = StartTasks();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+nsresult
+sbGStreamerAudioAnalyzer::GetAlbumKey(sbIMediaItem *aMediaItem,
+                                      nsAString & aAlbumKey)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItem);
+
+  nsresult rv;
+
+  aAlbumKey.Truncate();
+
+  nsString albumName;
+  rv = aMediaItem->GetProperty(NS_LITERAL_STRING(SB_PROPERTY_ALBUMNAME),
+                               albumName);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Items without an album don't get an album gain.
+  if (albumName.IsEmpty())
+    return NS_OK;
+
+  nsString artistName;
+  rv = aMediaItem->GetProperty(NS_LITERAL_STRING(SB_PROPERTY_ALBUMARTISTNAME),
+                               artistName);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (artistName.IsEmpty()) {
+    rv = aMediaItem->GetProperty(NS_LITERAL_STRING(SB_PROPERTY_ARTISTNAME),
+                                 artistName);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  aAlbumKey.Assign(artistName);
+  aAlbumKey.Append(PRUnichar('\t'));
+  aAlbumKey.Append(albumName);
+
+  return NS_OK;
+}
+
+nsresult
+sbGStreamerAudioAnalyzer::StartTasks()
+{
+  nsresult rv;
+
+  while (!mCancelled &&
+         mNextItem < (PRUint32)mMediaItems.Count() &&
+         mRunningTasks.Length() < mMaxConcurrentItems)
+  {
+    sbIMediaItem *mediaItem = mMediaItems[mNextItem++];
+
+    // Reuse an idle analysis thread if there is one.
+    nsCOMPtr<nsIThread> thread;
+    PRInt32 idleCount = mIdleThreads.Count();
+    if (idleCount) {
+      thread = mIdleThreads[idleCount - 1];
+      mIdleThreads.RemoveObjectAt(idleCount - 1);
+    }
+    else {
+      rv = NS_NewThread(getter_AddRefs(thread));
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      PRBool success = mThreads.AppendObject(thread);
+      NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+    }
+
+    nsString albumKey;
+    rv = GetAlbumKey(mediaItem, albumKey);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsRefPtr<sbAudioAnalysisTask> task =
+      new sbAudioAnalysisTask(this, mediaItem, thread, albumKey);
+    NS_ENSURE_TRUE(task, NS_ERROR_OUT_OF_MEMORY);
+
+    nsRefPtr<sbAudioAnalysisTask> *appended =
+      mRunningTasks.AppendElement(task);
+    NS_ENSURE_TRUE(appended, NS_ERROR_OUT_OF_MEMORY);
+
+    rv = task->Start();
+    if (NS_FAILED(rv)) {
+      // Report this item as failed, but carry on with the rest.
+      task->Cancel();
+    }
+  }
+
+  return NS_OK;
+}
+
+void
+sbGStreamerAudioAnalyzer::OnTaskComplete(sbAudioAnalysisTask *aTask)
+{
+  NS_ASSERTION(NS_IsMainThread(),
+    "sbGStreamerAudioAnalyzer::OnTaskComplete is main thread only!");
+  NS_ENSURE_TRUE(aTask, /* void */);
+
+  nsresult rv;
+
+  // Keep the task alive while we look at its results.
+  nsRefPtr<sbAudioAnalysisTask> task = aTask;
+  mRunningTasks.RemoveElement(task);
+
+  PRBool success = mIdleThreads.AppendObject(task->Thread());
+  NS_ENSURE_TRUE(success, /* void */);
+
+  mCompletedItems++;
+
+  if (!mCancelled) {
+    if (task->Failed()) {
+      nsString contentURL;
+      task->MediaItem()->GetProperty(NS_LITERAL_STRING(SB_PROPERTY_CONTENTURL),
+                                     contentURL);
+      nsString message = contentURL;
+      if (!task->ErrorMessage().IsEmpty()) {
+        message.AppendLiteral(": ");
+        message.Append(task->ErrorMessage());
+      }
+      mErrorMessages.AppendElement(message);
+    }
+    else {
+      rv = WriteTrackResults(task);
+      if (NS_FAILED(rv)) {
+        NS_WARNING("Failed to write audio analysis results");
+      }
+    }
+
+    AlbumInfo *album;
+    if (!task->AlbumKey().IsEmpty() &&
+        mAlbums.Get(task->AlbumKey(), &album))
+    {
+      if (!task->Failed()) {
+        sbReplayGainAnalysis::Histogram const & histogram =
+          task->GetHistogram();
+        if (album->mHistogram.Length() < histogram.Length()) {
+          album->mHistogram.SetLength(histogram.Length());
+          for (PRUint32 i = 0; i < histogram.Length(); ++i) {
+            album->mHistogram[i] = 0;
+          }
+        }
+        for (PRUint32 i = 0; i < histogram.Length(); ++i) {
+          album->mHistogram[i] += histogram[i];
+        }
+        album->mPeak = PR_MAX(album->mPeak, task->Peak());
+        album->mMediaItems.AppendObject(task->MediaItem());
+      }
+
+      if (--album->mRemaining == 0) {
+        rv = WriteAlbumResults(album);
+        if (NS_FAILED(rv)) {
+          NS_WARNING("Failed to write album analysis results");
+        }
+        mAlbums.Remove(task->AlbumKey());
+      }
+    }
+  }
+
+  rv = StartTasks();
+  if (NS_FAILED(rv)) {
+    NS_WARNING("Failed to start audio analysis");
+    mCancelled = PR_TRUE;
+  }
+
+  if (mRunningTasks.IsEmpty() &&
+      (mCancelled || mNextItem >= (PRUint32)mMediaItems.Count()))
+  {
+    Complete();
+    return;
+  }
+
+  OnJobProgress();
+}
+
+nsresult
+sbGStreamerAudioAnalyzer::WriteTrackResults(sbAudioAnalysisTask *aTask)
+{
+  NS_ENSURE_ARG_POINTER(aTask);
+
+  nsresult rv;
+
+  nsCOMPtr<sbIMutablePropertyArray> properties =
+    do_CreateInstance(SB_MUTABLEPROPERTYARRAY_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsString value;
+  rv = FormatGain(aTask->Gain(), value);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = properties->AppendProperty(
+          NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_TRACK_GAIN), value);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = FormatDecimal(aTask->Peak(), value);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = properties->AppendProperty(
+          NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_TRACK_PEAK), value);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (aTask->BPM()) {
+    PRBool writeBPM = mOverwriteBPM;
+    if (!writeBPM) {
+      rv = aTask->MediaItem()->GetProperty(NS_LITERAL_STRING(SB_PROPERTY_BPM),
+                                           value);
+      writeBPM = NS_FAILED(rv) || value.IsEmpty();
+    }
+    if (writeBPM) {
+      value.Truncate();
+      value.AppendInt(aTask->BPM());
+      rv = properties->AppendProperty(NS_LITERAL_STRING(SB_PROPERTY_BPM),
+                                      value);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
+  rv = aTask->MediaItem()->SetProperties(properties);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+nsresult
+sbGStreamerAudioAnalyzer::WriteAlbumResults(AlbumInfo *aAlbum)
+{
+  NS_ENSURE_ARG_POINTER(aAlbum);
+
+  // None of the album's tracks could be analysed.
+  if (!aAlbum->mMediaItems.Count())
+    return NS_OK;
+
+  nsresult rv;
+
+  nsCOMPtr<sbIMutablePropertyArray> properties =
+    do_CreateInstance(SB_MUTABLEPROPERTYARRAY_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsString value;
+  rv = FormatGain(sbReplayGainAnalysis::GainFromHistogram(aAlbum->mHistogram),
+                  value);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = properties->AppendProperty(
+          NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_ALBUM_GAIN), value);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = FormatDecimal(aAlbum->mPeak, value);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = properties->AppendProperty(
+          NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_ALBUM_PEAK), value);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  for (PRInt32 i = 0; i < aAlbum->mMediaItems.Count(); ++i) {
+    rv = aAlbum->mMediaItems[i]->SetProperties(properties);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+void
+sbGStreamerAudioAnalyzer::Complete()
+{
+  TRACE(("sbGStreamerAudioAnalyzer[0x%.8x] - Complete", this));
+
+  for (PRInt32 i = 0; i < mThreads.Count(); ++i) {
+    mThreads[i]->Shutdown();
+  }
+  mThreads.Clear();
+  mIdleThreads.Clear();
+  mAlbums.Clear();
+
+  // We don't have a 'cancelled' state.
+  if (mCancelled || mErrorMessages.Length())
+    mStatus = sbIJobProgress::STATUS_FAILED;
+  else
+    mStatus = sbIJobProgress::STATUS_SUCCEEDED;
+
+  OnJobProgress();
+}
+
+/* sbIJobCancelable interface implementation */
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetCanCancel(PRBool *aCanCancel)
+{
+  NS_ENSURE_ARG_POINTER(aCanCancel);
+
+  *aCanCancel = PR_TRUE;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::Cancel()
+{
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_FAILURE);
+
+  if (mCancelled || mStatus != sbIJobProgress::STATUS_RUNNING)
+    return NS_OK;
+
+  mCancelled = PR_TRUE;
+
+  // Each task reports back through OnTaskComplete once it has wound down;
+  // the last one to do so completes the job.
+  nsTArray<nsRefPtr<sbAudioAnalysisTask> > tasks(mRunningTasks);
+  for (PRUint32 i = 0; i < tasks.Length(); ++i) {
+    tasks[i]->Cancel();
+  }
+
+  return NS_OK;
+}
+
+/* sbIJobProgress interface implementation */
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetStatus(PRUint16 *aStatus)
+{
+  NS_ENSURE_ARG_POINTER(aStatus);
+
+  *aStatus = mStatus;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetBlocked(PRBool *aBlocked)
+{
+  NS_ENSURE_ARG_POINTER(aBlocked);
+
+  *aBlocked = PR_FALSE;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetStatusText(nsAString& aText)
+{
+  nsresult rv = NS_ERROR_FAILURE;
+
+  switch (mStatus) {
+    case sbIJobProgress::STATUS_FAILED:
+      rv = SBGetLocalizedString(aText,
+              NS_LITERAL_STRING("mediacore.gstreamer.analysis.failed"));
+      break;
+    case sbIJobProgress::STATUS_SUCCEEDED:
+      rv = SBGetLocalizedString(aText,
+              NS_LITERAL_STRING("mediacore.gstreamer.analysis.succeeded"));
+      break;
+    case sbIJobProgress::STATUS_RUNNING:
+      rv = SBGetLocalizedString(aText,
+              NS_LITERAL_STRING("mediacore.gstreamer.analysis.running"));
+      break;
+    default:
+      NS_NOTREACHED("Status is invalid");
+  }
+
+  return rv;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetTitleText(nsAString& aText)
+{
+  return SBGetLocalizedString(aText,
+          NS_LITERAL_STRING("mediacore.gstreamer.analysis.title"));
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetProgress(PRUint32* aProgress)
+{
+  NS_ENSURE_ARG_POINTER(aProgress);
+
+  *aProgress = mCompletedItems;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetTotal(PRUint32* aTotal)
+{
+  NS_ENSURE_ARG_POINTER(aTotal);
+
+  *aTotal = mMediaItems.Count();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetErrorCount(PRUint32* aErrorCount)
+{
+  NS_ENSURE_ARG_POINTER(aErrorCount);
+  NS_ASSERTION(NS_IsMainThread(),
+          "sbIJobProgress::GetErrorCount is main thread only!");
+
+  *aErrorCount = mErrorMessages.Length();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::GetErrorMessages(nsIStringEnumerator** aMessages)
+{
+  NS_ENSURE_ARG_POINTER(aMessages);
+  NS_ASSERTION(NS_IsMainThread(),
+    "sbIJobProgress::GetErrorMessages is main thread only!");
+
+  *aMessages = nsnull;
+
+  nsCOMPtr<nsIStringEnumerator> enumerator =
+    new sbTArrayStringEnumerator(&mErrorMessages);
+  NS_ENSURE_TRUE(enumerator, NS_ERROR_OUT_OF_MEMORY);
+
+  enumerator.forget(aMessages);
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::AddJobProgressListener(
+        sbIJobProgressListener *aListener)
+{
+  NS_ENSURE_ARG_POINTER(aListener);
+  NS_ASSERTION(NS_IsMainThread(), \
+    "sbGStreamerAudioAnalyzer::AddJobProgressListener is main thread only!");
+
+  PRInt32 index = mProgressListeners.IndexOf(aListener);
+  if (index >= 0) {
+    // the listener already exists, do not re-add
+    return NS_SUCCESS_LOSS_OF_INSIGNIFICANT_DATA;
+  }
+  PRBool succeeded = mProgressListeners.AppendObject(aListener);
+  NS_ENSURE_TRUE(succeeded, NS_ERROR_FAILURE);
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerAudioAnalyzer::RemoveJobProgressListener(
+        sbIJobProgressListener* aListener)
+{
+  NS_ENSURE_ARG_POINTER(aListener);
+  NS_ASSERTION(NS_IsMainThread(), \
+    "sbGStreamerAudioAnalyzer::RemoveJobProgressListener is main thread only!");
+
+  PRInt32 indexToRemove = mProgressListeners.IndexOf(aListener);
+  if (indexToRemove < 0) {
+    // No such listener, don't try to remove. This is OK.
+    return NS_OK;
+  }
+
+  // remove the listener
+  PRBool succeeded = mProgressListeners.RemoveObjectAt(indexToRemove);
+  NS_ENSURE_TRUE(succeeded, NS_ERROR_FAILURE);
+
+  return NS_OK;
+}
+
+// Call all job progress listeners
+nsresult
+sbGStreamerAudioAnalyzer::OnJobProgress()
+{
+  TRACE(("sbGStreamerAudioAnalyzer::OnJobProgress[0x%.8x]", this));
+  NS_ASSERTION(NS_IsMainThread(), \
+    "sbGStreamerAudioAnalyzer::OnJobProgress is main thread only!");
+
+  // Announce our status to the world
+  for (PRInt32 i = mProgressListeners.Count() - 1; i >= 0; --i) {
+     // Ignore any errors from listeners
+     mProgressListeners[i]->OnJobProgress(this);
+  }
+  return NS_OK;
+}
@@ -0,0 +1,193 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#ifndef _SB_GSTREAMER_AUDIO_ANALYZER_H_
+#define _SB_GSTREAMER_AUDIO_ANALYZER_H_
+
+#include <nsCOMPtr.h>
+#include <nsCOMArray.h>
+#include <nsAutoPtr.h>
+#include <nsClassHashtable.h>
+#include <nsTArray.h>
+#include <nsStringGlue.h>
+
+#include <nsIArray.h>
+#include <nsIClassInfo.h>
+#include <nsIThread.h>
+
+#include <sbIMediaItem.h>
+#include <sbIMediacoreAudioProcessor.h>
+#include <sbIMediacoreAudioProcessorListener.h>
+#include <sbIJobProgress.h>
+#include <sbIJobCancelable.h>
+
+#include "sbIGStreamerAudioAnalyzer.h"
+#include "sbAudioAnalysisKernels.h"
+
+class sbGStreamerAudioAnalyzer;
+
+/**
+ * Analysis of a single media item. Decoded audio arrives from an
+ * sbGStreamerAudioProcessor on the main thread and is handed, in order, to
+ * the analysis thread the task was given; the kernels only ever run there.
+ * Once the item is done the task reports back to the analyzer on the main
+ * thread.
+ */
+class sbAudioAnalysisTask : public sbIMediacoreAudioProcessorListener
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBIMEDIACOREAUDIOPROCESSORLISTENER
+
+  sbAudioAnalysisTask(sbGStreamerAudioAnalyzer *aAnalyzer,
+                      sbIMediaItem *aMediaItem,
+                      nsIThread *aThread,
+                      const nsAString & aAlbumKey);
+
+  // Main thread only.
+  nsresult Start();
+  void Cancel();
+
+  // Analysis thread only.
+  void ProcessBlock(const float *aSamples, PRUint32 aCount);
+  void ResetFilters();
+  void Finish();
+
+  // Main thread only.
+  void Resume();
+  void NotifyComplete();
+
+  // Results; only valid once the analyzer has been notified of completion.
+  sbIMediaItem * MediaItem() { return mMediaItem; }
+  nsIThread * Thread() { return mThread; }
+  const nsString & AlbumKey() const { return mAlbumKey; }
+  PRBool Failed() const { return mFailed; }
+  const nsString & ErrorMessage() const { return mErrorMessage; }
+  double Gain() const { return mGain; }
+  float Peak() const { return mPeak; }
+  PRUint32 BPM() const { return mBPM; }
+  const sbReplayGainAnalysis::Histogram & GetHistogram() const
+  {
+    return mHistogram;
+  }
+
+private:
+  virtual ~sbAudioAnalysisTask();
+
+  // Stop decoding and queue the final step of the analysis behind any audio
+  // already sent to the analysis thread.
+  nsresult StopAndFinish();
+
+  nsRefPtr<sbGStreamerAudioAnalyzer> mAnalyzer;
+  nsCOMPtr<sbIMediaItem> mMediaItem;
+  nsCOMPtr<nsIThread> mThread;
+  nsCOMPtr<sbIMediacoreAudioProcessor> mProcessor;
+  nsString mAlbumKey;
+
+  // Owned by the analysis thread until Finish() has run.
+  sbReplayGainAnalysis mReplayGain;
+  sbTempoAnalysis mTempo;
+
+  // Number of sample blocks dispatched to the analysis thread but not yet
+  // processed. Decoding is suspended while too many are outstanding.
+  PRInt32 mPendingBlocks;
+  PRBool mSuspended;
+  PRBool mFinishing;
+
+  PRBool mFailed;
+  nsString mErrorMessage;
+  double mGain;
+  float mPeak;
+  PRUint32 mBPM;
+  sbReplayGainAnalysis::Histogram mHistogram;
+};
+
+/**
+ * Batch ReplayGain and tempo analyser. Keeps up to maxConcurrentItems
+ * sbAudioAnalysisTasks running, each with its own analysis thread, and writes
+ * the results to the media items as they finish. Album gain is written once
+ * every track of an album has been analysed.
+ */
+class sbGStreamerAudioAnalyzer : public sbIGStreamerAudioAnalyzer,
+                                 public sbIJobProgress,
+                                 public sbIJobCancelable,
+                                 public nsIClassInfo
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSICLASSINFO
+  NS_DECL_SBIGSTREAMERAUDIOANALYZER
+  NS_DECL_SBIJOBPROGRESS
+  NS_DECL_SBIJOBCANCELABLE
+
+  sbGStreamerAudioAnalyzer();
+
+  nsresult Init();
+
+  // Called on the main thread by a task once it has finished or failed.
+  void OnTaskComplete(sbAudioAnalysisTask *aTask);
+
+private:
+  virtual ~sbGStreamerAudioAnalyzer();
+
+  struct AlbumInfo
+  {
+    AlbumInfo() : mPeak(0.0f), mRemaining(0) {}
+
+    sbReplayGainAnalysis::Histogram mHistogram;
+    float mPeak;
+    PRUint32 mRemaining;
+    nsCOMArray<sbIMediaItem> mMediaItems;
+  };
+
+  nsresult GetAlbumKey(sbIMediaItem *aMediaItem, nsAString & aAlbumKey);
+  nsresult StartTasks();
+  nsresult WriteTrackResults(sbAudioAnalysisTask *aTask);
+  nsresult WriteAlbumResults(AlbumInfo *aAlbum);
+  void Complete();
+  nsresult OnJobProgress();
+
+  PRUint32 mMaxConcurrentItems;
+  PRBool mOverwriteBPM;
+  PRBool mStarted;
+  PRBool mCancelled;
+
+  nsCOMArray<sbIMediaItem> mMediaItems;
+  PRUint32 mNextItem;
+  PRUint32 mCompletedItems;
+
+  nsTArray<nsRefPtr<sbAudioAnalysisTask> > mRunningTasks;
+  nsCOMArray<nsIThread> mThreads;
+  nsCOMArray<nsIThread> mIdleThreads;
+
+  nsClassHashtable<nsStringHashKey, AlbumInfo> mAlbums;
+
+  PRUint16 mStatus;
+  nsTArray<nsString> mErrorMessages;
+  nsCOMArray<sbIJobProgressListener> mProgressListeners;
+};
+
+#endif // _SB_GSTREAMER_AUDIO_ANALYZER_H_
@@ -0,0 +1,501 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#include "sbGStreamerCapabilityIndex.h"
+
+#include <nsCOMPtr.h>
+#include <nsIFile.h>
+#include <nsIInputStream.h>
+#include <nsILineInputStream.h>
+#include <nsIOutputStream.h>
+#include <nsNetUtil.h>
+#include <prio.h>
+#include <prlog.h>
+
+#include <sbStringUtils.h>
+
+#include <string.h>
+
+// The first line of a saved index. Bump the version whenever the format
+// changes so that old indexes are rebuilt rather than misread.
+#define INDEX_HEADER "# sbGStreamerCapabilityIndex 1"
+
+#define INDEX_SEPARATOR "\t"
+
+/**
+ * To log this class, set the following environment variable in a debug build:
+ *
+ *  NSPR_LOG_MODULES=sbGStreamerCapabilityIndex:5 (or :3 for LOG messages only)
+ *
+ */
+#ifdef PR_LOGGING
+
+static PRLogModuleInfo* gGStreamerCapabilityIndex =
+  PR_NewLogModule("sbGStreamerCapabilityIndex");
+
+#define LOG(args)                                          \
+  if (gGStreamerCapabilityIndex)                           \
+    PR_LOG(gGStreamerCapabilityIndex, PR_LOG_WARNING, args)
+
+#define TRACE(args)                                        \
+  if (gGStreamerCapabilityIndex)                           \
+    PR_LOG(gGStreamerCapabilityIndex, PR_LOG_DEBUG, args)
+
+#else /* PR_LOGGING */
+
+#define LOG(args)   /* nothing */
+#define TRACE(args) /* nothing */
+
+#endif /* PR_LOGGING */
+
+sbGStreamerCapabilityIndex::sbGStreamerCapabilityIndex()
+{
+}
+
+sbGStreamerCapabilityIndex::~sbGStreamerCapabilityIndex()
+{
+  Clear();
+}
+
+void
+sbGStreamerCapabilityIndex::Clear()
+{
+  for (PRUint32 i = 0; i < mFactories.Length(); i++) {
+    nsTArray<PadTemplate> &padTemplates = mFactories[i].padTemplates;
+    for (PRUint32 j = 0; j < padTemplates.Length(); j++) {
+      if (padTemplates[j].parsedCaps) {
+        gst_caps_unref(padTemplates[j].parsedCaps);
+      }
+    }
+  }
+
+  mPlugins.Clear();
+  mFactories.Clear();
+  mTypeFinds.Clear();
+}
+
+PRBool
+sbGStreamerCapabilityIndex::IsEmpty()
+{
+  return mPlugins.IsEmpty() && mFactories.IsEmpty() && mTypeFinds.IsEmpty();
+}
+
+nsresult
+sbGStreamerCapabilityIndex::Build()
+{
+  Clear();
+
+  GList *plugins = gst_default_registry_get_plugin_list();
+  for (GList *walk = plugins; walk; walk = g_list_next(walk)) {
+    GstPlugin *plugin = GST_PLUGIN(walk->data);
+    nsCString *name =
+      mPlugins.AppendElement(nsDependentCString(gst_plugin_get_name(plugin)));
+    if (!name) {
+      gst_plugin_list_free(plugins);
+      return NS_ERROR_OUT_OF_MEMORY;
+    }
+  }
+  gst_plugin_list_free(plugins);
+
+  nsresult rv = NS_OK;
+
+  GList *features =
+    gst_registry_get_feature_list(gst_registry_get_default(),
+                                  GST_TYPE_ELEMENT_FACTORY);
+  for (GList *walk = features; walk && NS_SUCCEEDED(rv);
+       walk = g_list_next(walk))
+  {
+    rv = AddFactory(GST_ELEMENT_FACTORY(walk->data));
+  }
+  gst_plugin_feature_list_free(features);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  features = gst_registry_get_feature_list(gst_registry_get_default(),
+                                           GST_TYPE_TYPE_FIND_FACTORY);
+  for (GList *walk = features; walk && NS_SUCCEEDED(rv);
+       walk = g_list_next(walk))
+  {
+    rv = AddTypeFind(GST_TYPE_FIND_FACTORY(walk->data));
+  }
+  gst_plugin_feature_list_free(features);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  LOG(("sbGStreamerCapabilityIndex[0x%.8x] - Built: %d plugins, "
+       "%d element factories, %d typefinders", this, mPlugins.Length(),
+       mFactories.Length(), mTypeFinds.Length()));
+
+  return NS_OK;
+}
+
+nsresult
+sbGStreamerCapabilityIndex::AddFactory(GstElementFactory *aFactory)
+{
+  Factory *factory = mFactories.AppendElement();
+  NS_ENSURE_TRUE(factory, NS_ERROR_OUT_OF_MEMORY);
+
+  factory->name = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(aFactory));
+  factory->klass = gst_element_factory_get_klass(aFactory);
+  factory->rank = gst_plugin_feature_get_rank(GST_PLUGIN_FEATURE(aFactory));
+
+  // The static caps strings are kept in the registry, so none of this loads
+  // the plugin
+  const GList *templates =
+    gst_element_factory_get_static_pad_templates(aFactory);
+  for (const GList *walk = templates; walk; walk = g_list_next(walk)) {
+    GstStaticPadTemplate *templ = (GstStaticPadTemplate *)(walk->data);
+    if (templ->direction != GST_PAD_SRC && templ->direction != GST_PAD_SINK) {
+      continue;
+    }
+
+    PadTemplate *padTemplate = factory->padTemplates.AppendElement();
+    NS_ENSURE_TRUE(padTemplate, NS_ERROR_OUT_OF_MEMORY);
+
+    padTemplate->isSource = (templ->direction == GST_PAD_SRC);
+    padTemplate->caps = templ->static_caps.string;
+    padTemplate->parsedCaps = NULL;
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbGStreamerCapabilityIndex::AddTypeFind(GstTypeFindFactory *aFactory)
+{
+  gchar **extensions = gst_type_find_factory_get_extensions(aFactory);
+  if (!extensions) {
+    // Nothing to look up
+    return NS_OK;
+  }
+
+  TypeFind *typeFind = mTypeFinds.AppendElement();
+  NS_ENSURE_TRUE(typeFind, NS_ERROR_OUT_OF_MEMORY);
+
+  typeFind->name = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(aFactory));
+  for (gchar **extension = extensions; *extension; extension++) {
+    nsCString *appended =
+      typeFind->extensions.AppendElement(nsDependentCString(*extension));
+    NS_ENSURE_TRUE(appended, NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  return NS_OK;
+}
+
+PRBool
+sbGStreamerCapabilityIndex::HasPlugin(const nsACString &aName)
+{
+  return mPlugins.Contains(aName);
+}
+
+nsresult
+sbGStreamerCapabilityIndex::GetTypeFindExtensions(
+                                        const nsACString &aPrefix,
+                                        nsTArray<nsCString> &aExtensions)
+{
+  for (PRUint32 i = 0; i < mTypeFinds.Length(); i++) {
+    if (!StringBeginsWith(mTypeFinds[i].name, aPrefix)) {
+      continue;
+    }
+
+    nsCString *appended =
+      aExtensions.AppendElements(mTypeFinds[i].extensions);
+    NS_ENSURE_TRUE(appended, NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  return NS_OK;
+}
+
+const char *
+sbGStreamerCapabilityIndex::FindMatchingElementName(GstCaps *aSrcCaps,
+                                                    const char *aTypeName)
+{
+  if (!aSrcCaps || !aTypeName)
+    return NULL;
+
+  Factory *bestFactory = NULL;
+
+  for (PRUint32 i = 0; i < mFactories.Length(); i++) {
+    Factory &factory = mFactories[i];
+
+    if (strstr(factory.klass.get(), aTypeName) == NULL) {
+      /* Wrong type, don't check further */
+      continue;
+    }
+
+    /* Blacklist ffmux and ffenc. We don't want to accidently use these on
+       linux systems where they might be loaded from the system. */
+    if (strstr(factory.name.get(), "ffmux") != NULL ||
+        strstr(factory.name.get(), "ffenc") != NULL)
+      continue;
+
+    // Find the highest-ranked element that we considered acceptable.
+    if (bestFactory && factory.rank <= bestFactory->rank) {
+      continue;
+    }
+
+    for (PRUint32 j = 0; j < factory.padTemplates.Length(); j++) {
+      PadTemplate &padTemplate = factory.padTemplates[j];
+
+      /* Only want source pad templates */
+      if (!padTemplate.isSource) {
+        continue;
+      }
+
+      if (!padTemplate.parsedCaps) {
+        padTemplate.parsedCaps = gst_caps_from_string(padTemplate.caps.get());
+        if (!padTemplate.parsedCaps) {
+          continue;
+        }
+      }
+
+      GstCaps *intersect = gst_caps_intersect(padTemplate.parsedCaps,
+                                              aSrcCaps);
+      PRBool compatible = !gst_caps_is_empty(intersect);
+      gst_caps_unref(intersect);
+
+      if (compatible) {
+        bestFactory = &factory;
+        break;
+      }
+    }
+  }
+
+  if (!bestFactory)
+    return NULL;
+
+  return bestFactory->name.get();
+}
+
+nsresult
+sbGStreamerCapabilityIndex::Save(nsIFile *aFile, const nsACString &aStamp)
+{
+  NS_ENSURE_ARG_POINTER(aFile);
+
+  nsresult rv;
+
+  NS_NAMED_LITERAL_CSTRING(separator, INDEX_SEPARATOR);
+
+  // One record per line, with tab separated fields.  Pad templates belong to
+  // the factory above them.
+  nsCString output;
+  output.AppendLiteral(INDEX_HEADER "\n");
+  output.AppendLiteral("stamp" INDEX_SEPARATOR);
+  output.Append(aStamp);
+  output.Append('\n');
+
+  for (PRUint32 i = 0; i < mPlugins.Length(); i++) {
+    output.AppendLiteral("plugin" INDEX_SEPARATOR);
+    output.Append(mPlugins[i]);
+    output.Append('\n');
+  }
+
+  for (PRUint32 i = 0; i < mFactories.Length(); i++) {
+    const Factory &factory = mFactories[i];
+    output.AppendLiteral("factory" INDEX_SEPARATOR);
+    output.Append(factory.name);
+    output.Append(separator);
+    output.AppendInt(factory.rank);
+    output.Append(separator);
+    output.Append(factory.klass);
+    output.Append('\n');
+
+    for (PRUint32 j = 0; j < factory.padTemplates.Length(); j++) {
+      const PadTemplate &padTemplate = factory.padTemplates[j];
+      if (padTemplate.isSource) {
+        output.AppendLiteral("src" INDEX_SEPARATOR);
+      }
+      else {
+        output.AppendLiteral("sink" INDEX_SEPARATOR);
+      }
+      output.Append(padTemplate.caps);
+      output.Append('\n');
+    }
+  }
+
+  for (PRUint32 i = 0; i < mTypeFinds.Length(); i++) {
+    const TypeFind &typeFind = mTypeFinds[i];
+    output.AppendLiteral("typefind" INDEX_SEPARATOR);
+    output.Append(typeFind.name);
+    for (PRUint32 j = 0; j < typeFind.extensions.Length(); j++) {
+      output.Append(separator);
+      output.Append(typeFind.extensions[j]);
+    }
+    output.Append('\n');
+  }
+
+  nsCOMPtr<nsIFile> parent;
+  rv = aFile->GetParent(getter_AddRefs(parent));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool exists;
+  rv = parent->Exists(&exists);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (!exists) {
+    rv = parent->Create(nsIFile::DIRECTORY_TYPE, 0755);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  nsCOMPtr<nsIOutputStream> outputStream;
+  rv = NS_NewLocalFileOutputStream(getter_AddRefs(outputStream),
+                                   aFile,
+                                   PR_WRONLY | PR_CREATE_FILE | PR_TRUNCATE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 bytesOut = 0;
+  rv = outputStream->Write(output.BeginReading(), output.Length(), &bytesOut);
+
+  // Close it off regardless of the error
+  nsresult rvclose = outputStream->Close();
+
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(bytesOut == output.Length(), NS_ERROR_UNEXPECTED);
+  NS_ENSURE_SUCCESS(rvclose, rvclose);
+
+  return NS_OK;
+}
+
+nsresult
+sbGStreamerCapabilityIndex::Load(nsIFile *aFile, const nsACString &aStamp)
+{
+  NS_ENSURE_ARG_POINTER(aFile);
+
+  nsresult rv;
+
+  Clear();
+
+  PRBool exists;
+  rv = aFile->Exists(&exists);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (!exists) {
+    return NS_ERROR_FILE_NOT_FOUND;
+  }
+
+  nsCOMPtr<nsIInputStream> inputStream;
+  rv = NS_NewLocalFileInputStream(getter_AddRefs(inputStream), aFile);
+  NS_ENSURE_SUCCESS(rv, rv);
+  nsCOMPtr<nsILineInputStream> lineStream(do_QueryInterface(inputStream, &rv));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool more = PR_TRUE;
+  nsCString line;
+
+  // The header and the stamp have to match before anything else is read
+  rv = lineStream->ReadLine(line, &more);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (!line.EqualsLiteral(INDEX_HEADER)) {
+    LOG(("sbGStreamerCapabilityIndex[0x%.8x] - Unknown index format", this));
+    return NS_ERROR_UNEXPECTED;
+  }
+
+  nsCString expectedStamp(NS_LITERAL_CSTRING("stamp" INDEX_SEPARATOR));
+  expectedStamp.Append(aStamp);
+  rv = lineStream->ReadLine(line, &more);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (!line.Equals(expectedStamp)) {
+    LOG(("sbGStreamerCapabilityIndex[0x%.8x] - Index is out of date", this));
+    return NS_ERROR_UNEXPECTED;
+  }
+
+  NS_NAMED_LITERAL_CSTRING(separator, INDEX_SEPARATOR);
+  nsTArray<nsCString> fields;
+  Factory *factory = nsnull;
+
+  while (more) {
+    rv = lineStream->ReadLine(line, &more);
+    if (NS_FAILED(rv)) {
+      break;
+    }
+    if (line.IsEmpty()) {
+      continue;
+    }
+
+    nsCString_Split(line, separator, fields);
+    const nsCString &type = fields[0];
+
+    if (type.EqualsLiteral("plugin") && fields.Length() == 2) {
+      if (!mPlugins.AppendElement(fields[1])) {
+        rv = NS_ERROR_OUT_OF_MEMORY;
+        break;
+      }
+    }
+    else if (type.EqualsLiteral("factory") && fields.Length() == 4) {
+      factory = mFactories.AppendElement();
+      if (!factory) {
+        rv = NS_ERROR_OUT_OF_MEMORY;
+        break;
+      }
+      factory->name = fields[1];
+      factory->rank = fields[2].ToInteger(&rv);
+      if (NS_FAILED(rv)) {
+        break;
+      }
+      factory->klass = fields[3];
+    }
+    else if ((type.EqualsLiteral("src") || type.EqualsLiteral("sink")) &&
+             fields.Length() == 2 && factory)
+    {
+      PadTemplate *padTemplate = factory->padTemplates.AppendElement();
+      if (!padTemplate) {
+        rv = NS_ERROR_OUT_OF_MEMORY;
+        break;
+      }
+      padTemplate->isSource = type.EqualsLiteral("src");
+      padTemplate->caps = fields[1];
+      padTemplate->parsedCaps = NULL;
+    }
+    else if (type.EqualsLiteral("typefind") && fields.Length() >= 2) {
+      TypeFind *typeFind = mTypeFinds.AppendElement();
+      if (!typeFind) {
+        rv = NS_ERROR_OUT_OF_MEMORY;
+        break;
+      }
+      typeFind->name = fields[1];
+      for (PRUint32 i = 2; i < fields.Length(); i++) {
+        if (!typeFind->extensions.AppendElement(fields[i])) {
+          rv = NS_ERROR_OUT_OF_MEMORY;
+          break;
+        }
+      }
+    }
+    else {
+      rv = NS_ERROR_UNEXPECTED;
+      break;
+    }
+  }
+
+  inputStream->Close();
+
+  if (NS_FAILED(rv)) {
+    LOG(("sbGStreamerCapabilityIndex[0x%.8x] - Bad index file", this));
+    Clear();
+    return rv;
+  }
+
+  LOG(("sbGStreamerCapabilityIndex[0x%.8x] - Loaded: %d plugins, "
+       "%d element factories, %d typefinders", this, mPlugins.Length(),
+       mFactories.Length(), mTypeFinds.Length()));
+
+  return NS_OK;
+}
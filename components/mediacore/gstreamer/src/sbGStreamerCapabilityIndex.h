@@ -0,0 +1,114 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#ifndef __SB_GSTREAMERCAPABILITYINDEX_H__
+#define __SB_GSTREAMERCAPABILITYINDEX_H__
+
+#include <nsStringAPI.h>
+#include <nsTArray.h>
+
+#include <gst/gst.h>
+
+class nsIFile;
+
+/**
+ * \class sbGStreamerCapabilityIndex
+ * \brief What the installed GStreamer plugins can do, without the registry.
+ *
+ * Holds the names of the installed plugins, the class, rank and pad caps of
+ * every element factory, and the file extensions of every typefinder. The
+ * index is built from the registry once and saved to the profile, so that
+ * later sessions can answer capability questions before GStreamer has been
+ * initialized.
+ *
+ * Saved indexes carry a stamp describing the registry they were built from,
+ * and are only loaded if the stamp still matches.
+ *
+ * Not thread safe; the owner must serialize access.
+ */
+class sbGStreamerCapabilityIndex
+{
+public:
+  sbGStreamerCapabilityIndex();
+  ~sbGStreamerCapabilityIndex();
+
+  // Read an index saved by Save. Fails, leaving the index empty, if the file
+  // is missing, unreadable or was saved with a different stamp.
+  nsresult Load(nsIFile *aFile, const nsACString &aStamp);
+
+  nsresult Save(nsIFile *aFile, const nsACString &aStamp);
+
+  // Replace the contents with what the default registry holds. GStreamer must
+  // have been initialized.
+  nsresult Build();
+
+  PRBool IsEmpty();
+
+  PRBool HasPlugin(const nsACString &aName);
+
+  // Append the extensions of the typefinders whose names (which are media
+  // types, e.g. "audio/x-flac") start with aPrefix.
+  nsresult GetTypeFindExtensions(const nsACString &aPrefix,
+                                 nsTArray<nsCString> &aExtensions);
+
+  // Find the highest ranked element factory whose class contains aTypeName
+  // and that has a source pad template compatible with aSrcCaps. Returns NULL
+  // if there is none. GStreamer must have been initialized. The name stays
+  // valid until the index is next built, loaded or cleared.
+  const char *FindMatchingElementName(GstCaps *aSrcCaps,
+                                      const char *aTypeName);
+
+  void Clear();
+
+private:
+  struct PadTemplate {
+    PRBool isSource;
+    nsCString caps;
+    // Parsed from caps the first time it is matched against
+    GstCaps *parsedCaps;
+  };
+
+  struct Factory {
+    nsCString name;
+    nsCString klass;
+    PRUint32 rank;
+    nsTArray<PadTemplate> padTemplates;
+  };
+
+  struct TypeFind {
+    nsCString name;
+    nsTArray<nsCString> extensions;
+  };
+
+  nsresult AddFactory(GstElementFactory *aFactory);
+  nsresult AddTypeFind(GstTypeFindFactory *aFactory);
+
+  nsTArray<nsCString> mPlugins;
+  nsTArray<Factory> mFactories;
+  nsTArray<TypeFind> mTypeFinds;
+};
+
+#endif /* __SB_GSTREAMERCAPABILITYINDEX_H__ */
@@ -123,18 +123,8 @@ sbGStreamerMediaContainer::Init()
   // Initialize GStreamer.  Adapted from sbGStreamerPipeline.cpp
   // http://src.songbirdnest.com/xref/trunk/components/mediacore/gstreamer/src/sbGStreamerPipeline.cpp#87
 
-  // We need to make sure the gstreamer service component has been loaded
-  // since it calls gst_init for us.
-  nsresult rv;
-  nsCOMPtr<sbIGStreamerService> gstreamer;
-  if (!NS_IsMainThread()) {
-    gstreamer = do_ProxiedGetService(SBGSTREAMERSERVICE_CONTRACTID, &rv);
-  }
-  else {
-    gstreamer = do_GetService(SBGSTREAMERSERVICE_CONTRACTID, &rv);
-  }
+  nsresult rv = EnsureGStreamerInitialized();
   NS_ENSURE_SUCCESS(rv, rv);
-  (void)gstreamer;
 
   // Create the loop in which the typefind pipeline will run:
   mLoop = g_main_loop_new (NULL, FALSE);
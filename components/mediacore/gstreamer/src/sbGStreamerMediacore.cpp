@@ -35,13 +35,16 @@
 #include <nsIURI.h>
 #include <nsIURL.h>
 #include <nsIRunnable.h>
+#include <nsITimer.h>
 #include <nsIIOService.h>
 #include <nsIPrefBranch2.h>
 #include <nsIObserver.h>
 #include <nsThreadUtils.h>
 #include <nsCOMPtr.h>
+#include <nsAutoLock.h>
 #include <prlog.h>
 #include <prprf.h>
+#include <prdtoa.h>
 
 // Required to crack open the DOM XUL Element and get a native window handle.
 #include <nsIBaseWindow.h>
@@ -98,6 +101,27 @@
 
 #define MAX_FILE_SIZE_FOR_ACCURATE_SEEK (20 * 1024 * 1024)
 
+// How often to check whether the next item should be prefetched, in ms
+#define PREFETCH_CHECK_INTERVAL 1000
+
+// Default for songbird.mediacore.gstreamer.prefetchtime, in seconds
+#define PREFETCH_TIME_DEFAULT 10
+
+// Limits for songbird.mediacore.dynamicEQ.targetLoudness, in dB; those of
+// sbdspchain
+#define DYNAMIC_EQ_TARGET_MIN -40
+#define DYNAMIC_EQ_TARGET_MAX 0
+
+#define DSP_CHAIN_FACTORY_NAME "sbdspchain"
+
+// How often the DSP chain reports how long its stages take, in ms, when
+// logging
+#define DSP_STATS_INTERVAL 10000
+
+// Transitions that take longer than this (in ms) are not counted as gaps;
+// playback was stopped and later started again.
+#define TRANSITION_GAP_MAX 10000
+
 #define EQUALIZER_FACTORY_NAME "equalizer-10bands"
 
 #define EQUALIZER_DEFAULT_BAND_COUNT \
@@ -132,6 +156,33 @@ static PRLogModuleInfo* gGStreamerMediacore =
 
 #endif /* PR_LOGGING */
 
+// Add an event probe to aElement's sink pad; returns the probe's id, or 0
+static gulong
+AddSinkEventProbe(GstElement *aElement, GCallback aProbe, gpointer aData)
+{
+  GstPad *pad = gst_element_get_static_pad (aElement, "sink");
+  if (!pad)
+    return 0;
+
+  gulong id = gst_pad_add_event_probe (pad, aProbe, aData);
+  gst_object_unref (pad);
+  return id;
+}
+
+static void
+RemoveSinkEventProbe(GstElement *aElement, gulong aProbeId)
+{
+  if (!aProbeId)
+    return;
+
+  GstPad *pad = gst_element_get_static_pad (aElement, "sink");
+  if (!pad)
+    return;
+
+  gst_pad_remove_event_probe (pad, aProbeId);
+  gst_object_unref (pad);
+}
+
 NS_IMPL_THREADSAFE_ADDREF(sbGStreamerMediacore)
 NS_IMPL_THREADSAFE_RELEASE(sbGStreamerMediacore)
 
@@ -168,7 +219,13 @@ sbGStreamerMediacore::sbGStreamerMediacore() :
     mPlatformInterface(nsnull),
     mPrefs(nsnull),
     mReplaygainElement(nsnull),
+    mReplaygainProbeId(0),
+    mReplaygainLock(nsnull),
+    mReplaygainFallback(0.0),
+    mReplaygainFallbackPending(PR_FALSE),
+    mReplaygainFlushed(PR_FALSE),
     mEqualizerElement(nsnull),
+    mDSPChainElement(nsnull),
     mTags(NULL),
     mProperties(nsnull),
     mStopped(PR_FALSE),
@@ -190,7 +247,15 @@ sbGStreamerMediacore::sbGStreamerMediacore() :
     mCurrentAudioCaps(NULL),
     mAudioBinGhostPad(NULL),
     mHasVideo(PR_FALSE),
-    mHasAudio(PR_FALSE)
+    mHasAudio(PR_FALSE),
+    mPrefetchTime(PREFETCH_TIME_DEFAULT * 1000),
+    mPrefetchDone(PR_FALSE),
+    mTransitionStart(0),
+    mTransitionCount(0),
+    mLastTransitionGap(0),
+    mMaxTransitionGap(0),
+    mTotalTransitionGap(0),
+    mGaplessTransitionCount(0)
 {
   mBaseEventTarget = new sbBaseMediacoreEventTarget(this);
   NS_WARN_IF_FALSE(mBaseEventTarget,
@@ -199,21 +264,32 @@ sbGStreamerMediacore::sbGStreamerMediacore() :
 
 sbGStreamerMediacore::~sbGStreamerMediacore()
 {
+  if (mPrefetchTimer)
+    mPrefetchTimer->Cancel();
+
   if (mTags)
     gst_tag_list_free(mTags);
 
-  if (mReplaygainElement)
+  if (mReplaygainElement) {
+    RemoveSinkEventProbe (mReplaygainElement, mReplaygainProbeId);
     gst_object_unref (mReplaygainElement);
+  }
 
   if (mEqualizerElement)
     gst_object_unref (mEqualizerElement);
 
+  if (mDSPChainElement)
+    gst_object_unref (mDSPChainElement);
+
   std::vector<GstElement *>::const_iterator it = mAudioFilters.begin();
   for ( ; it < mAudioFilters.end(); ++it)
     gst_object_unref (*it);
 
   if (mMonitor)
     nsAutoMonitor::DestroyMonitor(mMonitor);
+
+  if (mReplaygainLock)
+    nsAutoLock::DestroyLock(mReplaygainLock);
 }
 
 nsresult
@@ -224,6 +300,10 @@ sbGStreamerMediacore::Init()
   mMonitor = nsAutoMonitor::NewMonitor("sbGStreamerMediacore::mMonitor");
   NS_ENSURE_TRUE(mMonitor, NS_ERROR_OUT_OF_MEMORY);
 
+  mReplaygainLock =
+    nsAutoLock::NewLock("sbGStreamerMediacore::mReplaygainLock");
+  NS_ENSURE_TRUE(mReplaygainLock, NS_ERROR_OUT_OF_MEMORY);
+
   rv = sbBaseMediacore::InitBaseMediacore();
   NS_ENSURE_SUCCESS(rv, rv);
 
@@ -239,6 +319,12 @@ sbGStreamerMediacore::Init()
   rv = InitPreferences();
   NS_ENSURE_SUCCESS(rv, rv);
 
+  mPrefetcher = new sbGStreamerPrefetcher();
+  NS_ENSURE_TRUE(mPrefetcher, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = mPrefetcher->Init();
+  NS_ENSURE_SUCCESS(rv, rv);
+
   nsCOMPtr<sbIMediacore> core = do_QueryInterface(
           NS_ISUPPORTS_CAST(sbIMediacore *, this), &rv);
   NS_ENSURE_SUCCESS(rv, rv);
@@ -346,6 +432,22 @@ sbGStreamerMediacore::ReadPreferences()
   mAudioSinkBufferTime = audioSinkBufferTime;
   mStreamingBufferSize = streamingBufferSize;
 
+  /* In seconds */
+  const char *PREFETCH_TIME_PREF = "songbird.mediacore.gstreamer.prefetchtime";
+
+  PRInt32 prefetchTime = PREFETCH_TIME_DEFAULT;
+  rv = mPrefs->GetPrefType(PREFETCH_TIME_PREF, &prefType);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (prefType == nsIPrefBranch::PREF_INT) {
+    rv = mPrefs->GetIntPref(PREFETCH_TIME_PREF, &prefetchTime);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (prefetchTime < 0)
+      prefetchTime = 0;
+  }
+
+  mPrefetchTime = prefetchTime * 1000;
+
   const char *NORMALIZATION_ENABLED_PREF =
       "songbird.mediacore.normalization.enabled";
   const char *NORMALIZATION_MODE_PREF =
@@ -361,12 +463,17 @@ sbGStreamerMediacore::ReadPreferences()
   if (normalizationEnabled) {
     if (!mReplaygainElement) {
       mReplaygainElement = gst_element_factory_make ("rgvolume", NULL);
+      NS_ENSURE_TRUE(mReplaygainElement, NS_ERROR_FAILURE);
 
       // Ref and sink the object to take ownership; we'll keep track of it
       // from here on.
       gst_object_ref (mReplaygainElement);
       gst_object_sink (mReplaygainElement);
 
+      // Watch for the start of each track, to switch to its fallback gain
+      mReplaygainProbeId = AddSinkEventProbe (mReplaygainElement,
+              G_CALLBACK (replaygainEventProbe), this);
+
       rv = AddAudioFilter(mReplaygainElement);
       NS_ENSURE_SUCCESS(rv, rv);
     }
@@ -393,11 +500,95 @@ sbGStreamerMediacore::ReadPreferences()
       rv = RemoveAudioFilter(mReplaygainElement);
       NS_ENSURE_SUCCESS(rv, rv);
 
+      RemoveSinkEventProbe (mReplaygainElement, mReplaygainProbeId);
+      mReplaygainProbeId = 0;
+
       gst_object_unref (mReplaygainElement);
       mReplaygainElement = NULL;
     }
   }
 
+  /* The DSP chain: the dynamic EQ, then the limiter, which has to come last
+   * to catch the peaks of the others */
+  const char *LIMITER_ENABLED_PREF = "songbird.mediacore.limiter.enabled";
+  const char *DYNAMIC_EQ_ENABLED_PREF = "songbird.mediacore.dynamicEQ.enabled";
+  /* In dBFS RMS */
+  const char *DYNAMIC_EQ_TARGET_PREF =
+      "songbird.mediacore.dynamicEQ.targetLoudness";
+
+  PRBool limiterEnabled = PR_FALSE;
+  rv = mPrefs->GetPrefType(LIMITER_ENABLED_PREF, &prefType);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (prefType == nsIPrefBranch::PREF_BOOL) {
+    rv = mPrefs->GetBoolPref(LIMITER_ENABLED_PREF, &limiterEnabled);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  PRBool dynamicEQEnabled = PR_FALSE;
+  rv = mPrefs->GetPrefType(DYNAMIC_EQ_ENABLED_PREF, &prefType);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (prefType == nsIPrefBranch::PREF_BOOL) {
+    rv = mPrefs->GetBoolPref(DYNAMIC_EQ_ENABLED_PREF, &dynamicEQEnabled);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  PRInt32 dynamicEQTarget = -18;
+  rv = mPrefs->GetPrefType(DYNAMIC_EQ_TARGET_PREF, &prefType);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (prefType == nsIPrefBranch::PREF_INT) {
+    rv = mPrefs->GetIntPref(DYNAMIC_EQ_TARGET_PREF, &dynamicEQTarget);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    dynamicEQTarget = PR_MAX(DYNAMIC_EQ_TARGET_MIN,
+                             PR_MIN(dynamicEQTarget, DYNAMIC_EQ_TARGET_MAX));
+  }
+
+  nsCString stages;
+  if (dynamicEQEnabled)
+    stages.AppendLiteral("dynamic-eq,");
+  if (limiterEnabled)
+    stages.AppendLiteral("limiter,");
+
+  if (!stages.IsEmpty()) {
+    // Drop the trailing comma
+    stages.SetLength(stages.Length() - 1);
+
+    if (!mDSPChainElement) {
+      mDSPChainElement = gst_element_factory_make (DSP_CHAIN_FACTORY_NAME,
+                                                   NULL);
+      NS_WARN_IF_FALSE(mDSPChainElement, "No support for the DSP chain.");
+
+      if (mDSPChainElement) {
+        // Ref and sink the object to take ownership; we'll keep track of it
+        // from here on.
+        gst_object_ref (mDSPChainElement);
+        gst_object_sink (mDSPChainElement);
+
+        rv = AddAudioFilter(mDSPChainElement);
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
+    }
+  }
+  else if (mDSPChainElement) {
+    rv = RemoveAudioFilter(mDSPChainElement);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    gst_object_unref (mDSPChainElement);
+    mDSPChainElement = NULL;
+  }
+
+  if (mDSPChainElement) {
+    g_object_set (mDSPChainElement,
+                  "stages", stages.get(),
+                  "dynamic-eq-target", (gdouble) dynamicEQTarget,
+                  NULL);
+#ifdef PR_LOGGING
+    g_object_set (mDSPChainElement,
+                  "stats-interval", (guint) DSP_STATS_INTERVAL,
+                  NULL);
+#endif
+  }
+
   return NS_OK;
 }
 
@@ -412,6 +603,107 @@ sbGStreamerMediacore::aboutToFinishHandler(GstElement *playbin, gpointer data)
   return;
 }
 
+/* static */ void
+sbGStreamerMediacore::prefetchTimerCallback(nsITimer *aTimer, void *aClosure)
+{
+  sbGStreamerMediacore *core = static_cast<sbGStreamerMediacore*>(aClosure);
+  core->CheckPrefetch();
+}
+
+void
+sbGStreamerMediacore::StartPrefetchTimer()
+{
+  NS_ASSERTION(NS_IsMainThread(), "StartPrefetchTimer off the main thread");
+
+  if (!mPrefetchTime || !mPrefetcher)
+    return;
+
+  nsresult rv;
+  if (!mPrefetchTimer) {
+    mPrefetchTimer = do_CreateInstance(NS_TIMER_CONTRACTID, &rv);
+    NS_ENSURE_SUCCESS(rv, /* void */);
+  }
+
+  rv = mPrefetchTimer->InitWithFuncCallback(prefetchTimerCallback,
+                                            this,
+                                            PREFETCH_CHECK_INTERVAL,
+                                            nsITimer::TYPE_REPEATING_SLACK);
+  NS_ENSURE_SUCCESS(rv, /* void */);
+}
+
+void
+sbGStreamerMediacore::StopPrefetchTimer()
+{
+  if (mPrefetchTimer)
+    mPrefetchTimer->Cancel();
+}
+
+void
+sbGStreamerMediacore::CheckPrefetch()
+{
+  nsAutoMonitor mon(mMonitor);
+
+  if (mPrefetchDone || !mPrefetchTime || !mPrefetcher || !mPipeline)
+    return;
+
+  nsCOMPtr<sbIMediacoreSequencer> sequencer = mSequencer;
+  PRUint32 prefetchTime = mPrefetchTime;
+  mon.Exit();
+
+  if (!sequencer)
+    return;
+
+  PRUint64 duration, position;
+  if (NS_FAILED(OnGetDuration(&duration)) ||
+      NS_FAILED(OnGetPosition(&position)) ||
+      position + prefetchTime < duration) {
+    return;
+  }
+
+  nsCOMPtr<sbIMediaItem> item;
+  nsresult rv = sequencer->GetNextItem(getter_AddRefs(item));
+  NS_ENSURE_SUCCESS(rv, /* void */);
+
+  mon.Enter();
+  mPrefetchDone = PR_TRUE;
+  mon.Exit();
+
+  if (!item)
+    return;
+
+  nsCOMPtr<nsIURI> uri;
+  rv = item->GetContentSrc(getter_AddRefs(uri));
+  NS_ENSURE_SUCCESS(rv, /* void */);
+
+  rv = mPrefetcher->Prefetch(uri);
+  NS_ENSURE_SUCCESS(rv, /* void */);
+}
+
+void
+sbGStreamerMediacore::RecordTransitionGap()
+{
+  nsAutoMonitor lock(mMonitor);
+
+  if (!mTransitionStart)
+    return;
+
+  PRUint32 gap =
+    PR_IntervalToMilliseconds(PR_IntervalNow() - mTransitionStart);
+  mTransitionStart = 0;
+
+  if (gap > TRANSITION_GAP_MAX)
+    return;
+
+  mTransitionCount++;
+  mLastTransitionGap = gap;
+  mMaxTransitionGap = PR_MAX(mMaxTransitionGap, gap);
+  mTotalTransitionGap += gap;
+
+  LOG(("Transition gap %u ms (max %u ms, average %u ms over %u)",
+       gap, mMaxTransitionGap,
+       (PRUint32)(mTotalTransitionGap / mTransitionCount), mTransitionCount));
+}
+
 GstElement *
 sbGStreamerMediacore::CreateSinkFromPrefs(const char *aSinkDescription)
 {
@@ -941,7 +1233,12 @@ void sbGStreamerMediacore::HandleAboutToFinishSignal()
     mCurrentUri = uri;
     mUri = itemuri;
 
+    // The current track is still playing; switch gain when the next starts
+    QueueReplaygainFallback(item);
+
     mPlayingGaplessly = PR_TRUE;
+    mPrefetchDone = PR_FALSE;
+    mGaplessTransitionCount++;
 
     /* Ideally we wouldn't dispatch this until actual audio output of this new
      * file has started, but playbin2 doesn't tell us about that yet */
@@ -951,6 +1248,112 @@ void sbGStreamerMediacore::HandleAboutToFinishSignal()
   return;
 }
 
+void sbGStreamerMediacore::SetReplaygainFallback(sbIMediaItem *aItem)
+{
+  if (!mReplaygainElement)
+    return;
+
+  gdouble gain = GetReplaygainFallback(aItem);
+
+  {
+    nsAutoLock lock(mReplaygainLock);
+    mReplaygainFallbackPending = PR_FALSE;
+  }
+
+  LOG(("Setting ReplayGain fallback gain to %f", gain));
+  g_object_set (mReplaygainElement, "fallback-gain", gain, NULL);
+}
+
+void sbGStreamerMediacore::QueueReplaygainFallback(sbIMediaItem *aItem)
+{
+  if (!mReplaygainElement)
+    return;
+
+  gdouble gain = GetReplaygainFallback(aItem);
+
+  LOG(("Queueing ReplayGain fallback gain of %f", gain));
+
+  nsAutoLock lock(mReplaygainLock);
+  mReplaygainFallback = gain;
+  mReplaygainFallbackPending = PR_TRUE;
+}
+
+/* static */ gboolean
+sbGStreamerMediacore::replaygainEventProbe(GstPad *pad, GstEvent *event,
+        gpointer data)
+{
+  sbGStreamerMediacore *core = static_cast<sbGStreamerMediacore*>(data);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_STOP:
+      core->mReplaygainFlushed = PR_TRUE;
+      break;
+    case GST_EVENT_NEWSEGMENT: {
+      gboolean update;
+      gst_event_parse_new_segment (event, &update, NULL, NULL, NULL, NULL,
+              NULL);
+      if (update)
+        break;
+
+      // A segment after a flush is a seek within the current track; any other
+      // one starts the next track of a gapless sequence
+      PRBool flushed = core->mReplaygainFlushed;
+      core->mReplaygainFlushed = PR_FALSE;
+      if (flushed)
+        break;
+
+      gdouble gain;
+      {
+        nsAutoLock lock(core->mReplaygainLock);
+        if (!core->mReplaygainFallbackPending)
+          break;
+        gain = core->mReplaygainFallback;
+        core->mReplaygainFallbackPending = PR_FALSE;
+      }
+
+      // rgvolume sees this segment next, so the new gain starts with the
+      // track's first sample
+      LOG(("Setting ReplayGain fallback gain to %f", gain));
+      g_object_set (core->mReplaygainElement, "fallback-gain", gain, NULL);
+      break;
+    }
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+gdouble sbGStreamerMediacore::GetReplaygainFallback(sbIMediaItem *aItem)
+{
+  gdouble gain = 0.0;
+
+  if (aItem) {
+    gboolean albumMode = TRUE;
+    g_object_get (mReplaygainElement, "album-mode", &albumMode, NULL);
+
+    nsString value;
+    nsresult rv = NS_ERROR_NOT_AVAILABLE;
+    if (albumMode) {
+      rv = aItem->GetProperty(
+              NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_ALBUM_GAIN), value);
+    }
+    if (NS_FAILED(rv) || value.IsEmpty()) {
+      rv = aItem->GetProperty(
+              NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_TRACK_GAIN), value);
+    }
+    if (NS_SUCCEEDED(rv) && !value.IsEmpty()) {
+      NS_LossyConvertUTF16toASCII gainString(value);
+      char *end = nsnull;
+      PRFloat64 parsed = PR_strtod(gainString.get(), &end);
+      if (end && end != gainString.get())
+        gain = parsed;
+    }
+  }
+
+  return gain;
+}
+
 void sbGStreamerMediacore::HandleTagMessage(GstMessage *message)
 {
   GstTagList *tag_list;
@@ -994,12 +1397,18 @@ void sbGStreamerMediacore::HandleStateChangedMessage(GstMessage *message)
     if (pendingstate == GST_STATE_VOID_PENDING && newstate == mTargetState) {
       if (newstate == GST_STATE_PLAYING) {
         mHasReachedPlaying = PR_TRUE;
+        RecordTransitionGap();
+        StartPrefetchTimer();
         DispatchMediacoreEvent (sbIMediacoreEvent::STREAM_START);
       }
-      else if (newstate == GST_STATE_PAUSED)
+      else if (newstate == GST_STATE_PAUSED) {
+        StopPrefetchTimer();
         DispatchMediacoreEvent (sbIMediacoreEvent::STREAM_PAUSE);
+      }
       else if (newstate == GST_STATE_NULL)
       {
+        StopPrefetchTimer();
+
         // Distinguish between 'stopped via API' and 'stopped due to error or
         // reaching EOS'
         if (mStopped) {
@@ -1287,6 +1696,8 @@ void sbGStreamerMediacore::HandleEOSMessage(GstMessage *message)
   nsAutoMonitor lock(mMonitor);
   GstElement *pipeline = (GstElement *)g_object_ref (mPipeline);
   mTargetState = GST_STATE_NULL;
+  // The gap to the next track runs until it reaches PLAYING
+  mTransitionStart = PR_IntervalNow();
   lock.Exit();
 
   // Shut down the pipeline. This will cause us to send a STREAM_END
@@ -1478,6 +1889,13 @@ void sbGStreamerMediacore::HandleMessage (GstMessage *message)
       } else if (gst_is_missing_plugin_message(message)) {
         HandleMissingPluginMessage(message);
       }
+#ifdef PR_LOGGING
+      else if (gst_structure_has_name (message->structure, "sb-dsp-stats")) {
+        gchar *stats = gst_structure_to_string (message->structure);
+        LOG(("DSP chain: %s", stats));
+        g_free (stats);
+      }
+#endif
       break;
     }
     default:
@@ -1653,11 +2071,7 @@ void sbGStreamerMediacore::AbortAndRestartPlayback()
 /*virtual*/ nsresult
 sbGStreamerMediacore::OnInitBaseMediacore()
 {
-  nsresult rv;
-
-  // Ensure the service component is loaded; it initialises GStreamer for us.
-  nsCOMPtr<sbIGStreamerService> service =
-    do_GetService(SBGSTREAMERSERVICE_CONTRACTID, &rv);
+  nsresult rv = EnsureGStreamerInitialized();
   NS_ENSURE_SUCCESS(rv, rv);
 
   return NS_OK;
@@ -1673,6 +2087,11 @@ sbGStreamerMediacore::OnGetCapabilities()
 /*virtual*/ nsresult
 sbGStreamerMediacore::OnShutdown()
 {
+  // Cancel a prefetch in progress; this doesn't wait for its I/O
+  StopPrefetchTimer();
+  if (mPrefetcher)
+    mPrefetcher->Shutdown();
+
   nsAutoMonitor lock(mMonitor);
 
   if (mPipeline) {
@@ -1844,11 +2263,26 @@ sbGStreamerMediacore::OnSetUri(nsIURI *aURI)
   rv = CreatePlaybackPipeline();
   NS_ENSURE_SUCCESS (rv,rv);
 
-  nsAutoMonitor lock(mMonitor);
-
   rv = aURI->GetSpec(spec);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Find the item being played, if the sequencer is driving us, so that any
+  // analysed ReplayGain values can be handed to rgvolume. Don't call into the
+  // sequencer while holding our monitor.
+  nsCOMPtr<sbIMediaItem> item;
+  if (mSequencer) {
+    rv = mSequencer->GetCurrentItem(getter_AddRefs(item));
+    if (NS_SUCCEEDED(rv) && item) {
+      nsString contentURL;
+      rv = item->GetProperty(NS_LITERAL_STRING(SB_PROPERTY_CONTENTURL),
+                             contentURL);
+      if (NS_FAILED(rv) || !contentURL.Equals(NS_ConvertUTF8toUTF16(spec)))
+        item = nsnull;
+    }
+  }
+
+  nsAutoMonitor lock(mMonitor);
+
   rv = GetFileSize (aURI, &mResourceSize);
   if (rv == NS_ERROR_NO_INTERFACE) {
     // Not being a file is fine - that's just something non-local
@@ -1863,6 +2297,9 @@ sbGStreamerMediacore::OnSetUri(nsIURI *aURI)
   /* Set the URI to play */
   g_object_set (G_OBJECT (mPipeline), "uri", spec.get(), NULL);
   mCurrentUri = spec;
+  mPrefetchDone = PR_FALSE;
+
+  SetReplaygainFallback(item);
 
   return NS_OK;
 }
@@ -2115,6 +2552,10 @@ sbGStreamerMediacore::OnPause()
 sbGStreamerMediacore::OnStop()
 {
   nsAutoMonitor lock(mMonitor);
+  // Stopping while playing ends the sequence, there's no next track to
+  // measure a gap to. After EOS we're already heading for NULL.
+  if (mTargetState != GST_STATE_NULL)
+    mTransitionStart = 0;
   mTargetState = GST_STATE_NULL;
   mStopped = PR_TRUE;
   // If we get stopped without ever starting, that's ok...
@@ -2332,6 +2773,79 @@ sbGStreamerMediacore::GetGstreamerVersion(nsAString& aGStreamerVersion)
   return NS_OK;
 }
 
+NS_IMETHODIMP
+sbGStreamerMediacore::GetTransitionCount(PRUint32 *aTransitionCount)
+{
+  NS_ENSURE_ARG_POINTER(aTransitionCount);
+  nsAutoMonitor lock(mMonitor);
+  *aTransitionCount = mTransitionCount;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerMediacore::GetLastTransitionGap(PRUint32 *aLastTransitionGap)
+{
+  NS_ENSURE_ARG_POINTER(aLastTransitionGap);
+  nsAutoMonitor lock(mMonitor);
+  *aLastTransitionGap = mLastTransitionGap;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerMediacore::GetMaxTransitionGap(PRUint32 *aMaxTransitionGap)
+{
+  NS_ENSURE_ARG_POINTER(aMaxTransitionGap);
+  nsAutoMonitor lock(mMonitor);
+  *aMaxTransitionGap = mMaxTransitionGap;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerMediacore::GetAverageTransitionGap(PRUint32 *aAverageTransitionGap)
+{
+  NS_ENSURE_ARG_POINTER(aAverageTransitionGap);
+  nsAutoMonitor lock(mMonitor);
+  *aAverageTransitionGap = mTransitionCount ?
+    (PRUint32)(mTotalTransitionGap / mTransitionCount) : 0;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerMediacore::GetGaplessTransitionCount(
+        PRUint32 *aGaplessTransitionCount)
+{
+  NS_ENSURE_ARG_POINTER(aGaplessTransitionCount);
+  nsAutoMonitor lock(mMonitor);
+  *aGaplessTransitionCount = mGaplessTransitionCount;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerMediacore::GetPrefetchCount(PRUint32 *aPrefetchCount)
+{
+  NS_ENSURE_ARG_POINTER(aPrefetchCount);
+  *aPrefetchCount = mPrefetcher ? mPrefetcher->GetPrefetchCount() : 0;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerMediacore::GetLastPrefetchTime(PRUint32 *aLastPrefetchTime)
+{
+  NS_ENSURE_ARG_POINTER(aLastPrefetchTime);
+  *aLastPrefetchTime = mPrefetcher ? mPrefetcher->GetLastPrefetchTime() : 0;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerMediacore::Prefetch(nsIURI *aURI)
+{
+  NS_ENSURE_ARG_POINTER(aURI);
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_NOT_SAME_THREAD);
+  NS_ENSURE_STATE(mPrefetcher);
+
+  return mPrefetcher->Prefetch(aURI);
+}
+
 // Forwarding functions for sbIMediacoreEventTarget interface
 
 NS_IMETHODIMP
@@ -2425,7 +2939,15 @@ sbGStreamerMediacore::AddAudioFilter(GstElement *aElement)
   // Hold a reference to the element
   gst_object_ref (aElement);
 
-  mAudioFilters.push_back(aElement);
+  // Keep the DSP chain last, so its limiter sees the output of every other
+  // filter
+  std::vector<GstElement *>::iterator it =
+      std::find(mAudioFilters.begin(), mAudioFilters.end(), mDSPChainElement);
+  if (mDSPChainElement && aElement != mDSPChainElement &&
+      it != mAudioFilters.end())
+    mAudioFilters.insert(it, aElement);
+  else
+    mAudioFilters.push_back(aElement);
 
   return NS_OK;
 }
@@ -58,9 +58,11 @@
 #include "sbIGstPlatformInterface.h"
 #include "sbIGstAudioFilter.h"
 #include "sbGStreamerMediacoreUtils.h"
+#include "sbGStreamerPrefetcher.h"
 
 #include <vector>
 
+class nsITimer;
 class nsIURI;
 
 class sbGStreamerMediacore : public sbBaseMediacore,
@@ -163,12 +165,32 @@ protected:
 
   void AbortAndRestartPlayback();
 
+  // Set rgvolume's fallback gain, for streams that carry no ReplayGain tags
+  // of their own, from the ReplayGain properties stored on aItem (if any).
+  // SetReplaygainFallback applies it now; QueueReplaygainFallback once the
+  // next track starts playing, for gapless transitions.
+  void SetReplaygainFallback(sbIMediaItem *aItem);
+  void QueueReplaygainFallback(sbIMediaItem *aItem);
+  gdouble GetReplaygainFallback(sbIMediaItem *aItem);
+
   bool SetPropertyOnChild(GstElement *aElement,
           const char *aPropertyName, gint64 aPropertyValue);
 
+  // Prefetch the next item once the current one is within mPrefetchTime of
+  // its end. Checked periodically while playing.
+  void StartPrefetchTimer();
+  void StopPrefetchTimer();
+  void CheckPrefetch();
+
+  // Count the time since mTransitionStart as a gap between two tracks.
+  void RecordTransitionGap();
+
 private:
   // Static helpers for C callback
   static void aboutToFinishHandler(GstElement *playbin, gpointer data);
+  static gboolean replaygainEventProbe(GstPad *pad, GstEvent *event,
+          gpointer data);
+  static void prefetchTimerCallback(nsITimer *aTimer, void *aClosure);
   static void videoCapsSetHelper(GObject *obj, GParamSpec *pspec,
           sbGStreamerMediacore *core);
   static void currentVideoSetHelper(GObject *obj, GParamSpec *pspec,
@@ -195,7 +217,16 @@ protected:
   std::vector<GstElement*> mAudioFilters;
 
   GstElement *mReplaygainElement;
+  gulong mReplaygainProbeId; // Event probe on mReplaygainElement's sink pad
+
+  // Protects mReplaygainFallback and mReplaygainFallbackPending, which hand
+  // the next track's fallback gain to the streaming thread.
+  PRLock *mReplaygainLock;
+  gdouble mReplaygainFallback;
+  PRBool mReplaygainFallbackPending;
+  PRBool mReplaygainFlushed; // Streaming thread only
   GstElement *mEqualizerElement;
+  GstElement *mDSPChainElement; // sbdspchain element; always the last filter
 
   // Metadata, both in original GstTagList form, and transformed into an
   // sbIPropertyArray. Both may be NULL.
@@ -259,6 +290,21 @@ protected:
 
   PRBool mHasVideo;          // True if we're playing video currently.
   PRBool mHasAudio;          // True if we're playing audio currently.
+
+  nsRefPtr<sbGStreamerPrefetcher> mPrefetcher;
+  nsCOMPtr<nsITimer> mPrefetchTimer;
+  PRUint32 mPrefetchTime;    // How long before the end of a track to
+                             // prefetch the next one, in ms. 0 to disable.
+  PRBool mPrefetchDone;      // The next item has been prefetched for the
+                             // current track.
+
+  PRIntervalTime mTransitionStart; // When the last track ended, or 0 if not
+                                   // between tracks.
+  PRUint32 mTransitionCount;       // Transition gap statistics, in ms.
+  PRUint32 mLastTransitionGap;
+  PRUint32 mMaxTransitionGap;
+  PRUint64 mTotalTransitionGap;
+  PRUint32 mGaplessTransitionCount;
 };
 
 #endif /* __SB_GSTREAMERMEDIACORE_H__ */
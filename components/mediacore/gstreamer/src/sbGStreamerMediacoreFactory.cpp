@@ -41,6 +41,7 @@
 
 #include "sbGStreamerMediacore.h"
 #include "sbGStreamerMediacoreCID.h"
+#include "sbGStreamerService.h"
 
 /**
  * To log this class, set the following environment variable in a debug build:
@@ -95,8 +96,9 @@ sbGStreamerMediacoreFactory::Init()
   nsresult rv = sbBaseMediacoreFactory::InitBaseMediacoreFactory();
   NS_ENSURE_SUCCESS(rv, rv);
 
-  /* Ensure GStreamer has been loaded by getting the gstreamer service
-   * component (which loads and initialises gstreamer for us).
+  /* Ensure the gstreamer service component has been loaded, so that it can
+   * set up the environment gstreamer needs.  GStreamer itself is only
+   * initialized once something needs it.
    */
   nsCOMPtr<sbIGStreamerService> service =
     do_GetService(SBGSTREAMERSERVICE_CONTRACTID, &rv);
@@ -193,6 +195,14 @@ sbGStreamerMediacoreFactory::OnGetCapabilities(
 
     nsTArray<nsString> audioExtensions;
     nsTArray<nsString> videoExtensions;
+
+    // Plugins and typefinders come from the service's capability index, so
+    // this does not have to wait for GStreamer to be initialized.
+    nsCOMPtr<sbIGStreamerService> service =
+      do_GetService(SBGSTREAMERSERVICE_CONTRACTID, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+    sbGStreamerService *gstService =
+      static_cast<sbGStreamerService *>(service.get());
     
     // XXX Mook: we have a silly list of blacklisted extensions because we don't
     // support them and we're being stupid and guessing things based on them.
@@ -276,53 +286,36 @@ sbGStreamerMediacoreFactory::OnGetCapabilities(
 #endif
 
       // Check for the 'qtvideowrapper' plugin to add mp4/m4v extensions.
-      GstPlugin *plugin = gst_default_registry_find_plugin("qtvideowrapper");
-      if (plugin) {
+      if (gstService->HasPlugin(NS_LITERAL_CSTRING("qtvideowrapper"))) {
         videoExtensions.AppendElement(NS_LITERAL_STRING("mp4"));
         videoExtensions.AppendElement(NS_LITERAL_STRING("m4v"));
         videoExtensions.AppendElement(NS_LITERAL_STRING("mov"));
-        gst_object_unref(plugin);
       }
     }
 
-    GList *walker, *list;
-
-    list = gst_type_find_factory_get_list ();
-    walker = list;
-    while (walker) {
-      GstTypeFindFactory *factory = GST_TYPE_FIND_FACTORY (walker->data);
-      gboolean blacklisted = FALSE;
-      const gchar* factoryName = gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory));
-      gboolean isAudioFactory = g_str_has_prefix(factoryName, "audio/");
-
-      gchar **factoryexts = gst_type_find_factory_get_extensions (factory);
-      if (factoryexts) {
-        while (*factoryexts) {
-          gboolean isAudioExtension = isAudioFactory;
-          nsCString extension(*factoryexts);
-          nsCString delimitedExtension(extension);
-          delimitedExtension.Insert(',', 0);
-          delimitedExtension.Append(',');
-          
-          blacklisted = (blacklistExtensions.Find(delimitedExtension) != -1);
-          #if PR_LOGGING
-            if (blacklisted) {
-                LOG(("sbGStreamerMediacoreFactory: Ignoring extension '%s'", *factoryexts));
-            }
-          #endif /* PR_LOGGING */
-
-          if (!blacklisted && isAudioExtension) {
-            audioExtensions.AppendElement(NS_ConvertUTF8toUTF16(*factoryexts));
-            LOG(("sbGStreamerMediacoreFactory: registering audio extension %s\n",
-                  *factoryexts));
-          }
-
-          factoryexts++;
-        }
+    nsTArray<nsCString> typeFindExtensions;
+    rv = gstService->GetTypeFindExtensions(NS_LITERAL_CSTRING("audio/"),
+                                           typeFindExtensions);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    for (PRUint32 i = 0; i < typeFindExtensions.Length(); i++) {
+      const nsCString &extension = typeFindExtensions[i];
+      nsCString delimitedExtension(extension);
+      delimitedExtension.Insert(',', 0);
+      delimitedExtension.Append(',');
+
+      PRBool blacklisted =
+        (blacklistExtensions.Find(delimitedExtension) != -1);
+      if (blacklisted) {
+        LOG(("sbGStreamerMediacoreFactory: Ignoring extension '%s'",
+             extension.get()));
+        continue;
       }
-      walker = g_list_next (walker);
+
+      audioExtensions.AppendElement(NS_ConvertUTF8toUTF16(extension));
+      LOG(("sbGStreamerMediacoreFactory: registering audio extension %s\n",
+           extension.get()));
     }
-    g_list_free (list);
 
     for (unsigned int i = 0; i < NS_ARRAY_LENGTH(extraAudioExtensions); i++) {
       nsString ext = NS_ConvertUTF8toUTF16(extraAudioExtensions[i]);
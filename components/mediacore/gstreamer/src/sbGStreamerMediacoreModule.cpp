@@ -40,6 +40,7 @@
 #include "sbGStreamerTranscodeDeviceConfigurator.h"
 #include "sbGStreamerTranscodeAudioConfigurator.h"
 #include "sbGStreamerAudioProcessor.h"
+#include "sbGStreamerAudioAnalyzer.h"
 #include "metadata/sbGStreamerMetadataHandler.h"
 
 NS_GENERIC_FACTORY_CONSTRUCTOR_INIT(sbGStreamerService, Init)
@@ -60,6 +61,7 @@ NS_GENERIC_FACTORY_CONSTRUCTOR(sbGStreamerTranscodeDeviceConfigurator)
 NS_GENERIC_FACTORY_CONSTRUCTOR(sbGStreamerTranscodeAudioConfigurator)
 
 NS_GENERIC_FACTORY_CONSTRUCTOR_INIT(sbGStreamerAudioProcessor, InitGStreamer)
+NS_GENERIC_FACTORY_CONSTRUCTOR_INIT(sbGStreamerAudioAnalyzer, Init)
 
 static const nsModuleComponentInfo components[] =
 {
@@ -130,6 +132,12 @@ static const nsModuleComponentInfo components[] =
     SB_GSTREAMER_AUDIO_PROCESSOR_CID,
     SB_GSTREAMER_AUDIO_PROCESSOR_CONTRACTID,
     sbGStreamerAudioProcessorConstructor
+  },
+  {
+    SB_GSTREAMER_AUDIO_ANALYZER_CLASSNAME,
+    SB_GSTREAMER_AUDIO_ANALYZER_CID,
+    SB_GSTREAMER_AUDIO_ANALYZER_CONTRACTID,
+    sbGStreamerAudioAnalyzerConstructor
   }
 };
 
@@ -122,10 +122,17 @@ nsresult GetMediacoreErrorFromGstError(GError *gerror, nsString aResource,
                                        GStreamer::pipelineOp_t aPipelineOp,
                                        sbIMediacoreError **_retval);
 
+/**
+ * Initialize GStreamer, waiting for it if that is already under way.  Must be
+ * called before using any GStreamer API; may be called from any thread.
+ */
+nsresult
+EnsureGStreamerInitialized();
+
 /**
  * Find an element name for an element that can produce caps compatible with
  * 'srcCapsString' on its source pad, and has a klass name include 'typeName'.
- * Returns NULL if none is found.
+ * Returns NULL if none is found.  GStreamer must have been initialized.
  *
  * e.g. Call FindMatchingElementName("application/ogg", "Muxer") to get an ogg
  *      muxer element name ("oggmux" will be returned).
@@ -89,19 +89,8 @@ sbGStreamerPipeline::InitGStreamer()
 {
   TRACE(("sbGStreamerPipeline[0x%.8x] - Initialise", this));
 
-  nsresult rv;
-
-  // We need to make sure the gstreamer service component has been loaded
-  // since it calls gst_init for us.
-  if (!NS_IsMainThread()) {
-    nsCOMPtr<sbIGStreamerService> service = 
-      do_ProxiedGetService(SBGSTREAMERSERVICE_CONTRACTID, &rv);
-  }
-  else {
-    nsCOMPtr<sbIGStreamerService> service =
-      do_GetService(SBGSTREAMERSERVICE_CONTRACTID, &rv);
-    NS_ENSURE_SUCCESS(rv, rv);
-  }
+  nsresult rv = EnsureGStreamerInitialized();
+  NS_ENSURE_SUCCESS(rv, rv);
 
   mMonitor = nsAutoMonitor::NewMonitor("sbGStreamerPipeline::mMonitor");
   NS_ENSURE_TRUE(mMonitor, NS_ERROR_OUT_OF_MEMORY);
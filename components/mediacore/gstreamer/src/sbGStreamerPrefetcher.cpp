@@ -0,0 +1,325 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#include "sbGStreamerPrefetcher.h"
+
+#include <nsAutoLock.h>
+#include <nsAutoPtr.h>
+#include <nsIFileURL.h>
+#include <nsILocalFile.h>
+#include <nsIRunnable.h>
+#include <nsIThread.h>
+#include <nsIURI.h>
+#include <nsThreadUtils.h>
+#include <pratom.h>
+#include <prinrval.h>
+#include <prio.h>
+#include <prlog.h>
+
+#if defined(XP_UNIX)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// How much of the start and the end of a file to read. Most containers keep
+// everything a demuxer needs to preroll within these.
+#define PREFETCH_HEAD_SIZE (512 * 1024)
+#define PREFETCH_TAIL_SIZE (64 * 1024)
+#define PREFETCH_BUFFER_SIZE (64 * 1024)
+
+/**
+ * To log this class, set the following environment variable in a debug build:
+ *
+ *  NSPR_LOG_MODULES=sbGStreamerPrefetcher:5 (or :3 for LOG messages only)
+ *
+ */
+#ifdef PR_LOGGING
+
+static PRLogModuleInfo* gGStreamerPrefetcher =
+  PR_NewLogModule("sbGStreamerPrefetcher");
+
+#define LOG(args)                                          \
+  if (gGStreamerPrefetcher)                                \
+    PR_LOG(gGStreamerPrefetcher, PR_LOG_WARNING, args)
+
+#define TRACE(args)                                        \
+  if (gGStreamerPrefetcher)                                \
+    PR_LOG(gGStreamerPrefetcher, PR_LOG_DEBUG, args)
+
+#else /* PR_LOGGING */
+
+#define LOG(args)   /* nothing */
+#define TRACE(args) /* nothing */
+
+#endif /* PR_LOGGING */
+
+class sbGStreamerPrefetchRunnable : public nsIRunnable
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIRUNNABLE
+
+  sbGStreamerPrefetchRunnable(sbGStreamerPrefetcher *aPrefetcher,
+                              nsILocalFile *aFile) :
+    mPrefetcher(aPrefetcher),
+    mFile(aFile)
+  {
+  }
+
+private:
+  nsRefPtr<sbGStreamerPrefetcher> mPrefetcher;
+  nsCOMPtr<nsILocalFile> mFile;
+};
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbGStreamerPrefetchRunnable, nsIRunnable)
+
+/**
+ * Shuts down the prefetch thread on the main thread.  This is dispatched by
+ * the prefetch thread itself once it has run everything queued before it, so
+ * the main thread never waits for a read in progress.
+ */
+class sbGStreamerPrefetchThreadShutdown : public nsIRunnable
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_NSIRUNNABLE
+
+  sbGStreamerPrefetchThreadShutdown(nsIThread *aThread) :
+    mThread(aThread)
+  {
+  }
+
+private:
+  nsCOMPtr<nsIThread> mThread;
+};
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbGStreamerPrefetchThreadShutdown, nsIRunnable)
+
+NS_IMETHODIMP
+sbGStreamerPrefetchThreadShutdown::Run()
+{
+  if (!NS_IsMainThread()) {
+    // On the prefetch thread; everything queued before has been run
+    return NS_DispatchToMainThread(this);
+  }
+
+  mThread->Shutdown();
+  mThread = nsnull;
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbGStreamerPrefetchRunnable::Run()
+{
+  PRIntervalTime start = PR_IntervalNow();
+
+  if (mPrefetcher->IsCancelled())
+    return NS_OK;
+
+#if defined(XP_UNIX) && defined(POSIX_FADV_WILLNEED)
+  // Ask the kernel to read the whole file ahead; this returns immediately.
+  nsCString path;
+  if (NS_SUCCEEDED(mFile->GetNativePath(path))) {
+    int fd = open(path.BeginReading(), O_RDONLY);
+    if (fd >= 0) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+      close(fd);
+    }
+  }
+#endif
+
+  PRFileDesc *fd = nsnull;
+  nsresult rv = mFile->OpenNSPRFileDesc(PR_RDONLY, 0, &fd);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  char *buffer = new char[PREFETCH_BUFFER_SIZE];
+  if (!buffer) {
+    PR_Close(fd);
+    return NS_ERROR_OUT_OF_MEMORY;
+  }
+
+  // Read the head of the file; this is what blocks on a disk spinning up or
+  // a share reconnecting.
+  PRInt32 total = 0;
+  while (total < PREFETCH_HEAD_SIZE && !mPrefetcher->IsCancelled()) {
+    PRInt32 read = PR_Read(fd, buffer, PREFETCH_BUFFER_SIZE);
+    if (read <= 0)
+      break;
+    total += read;
+  }
+
+  // And the tail, for tags and index tables stored at the end
+  if (total >= PREFETCH_HEAD_SIZE &&
+      PR_Seek64(fd, -PREFETCH_TAIL_SIZE, PR_SEEK_END) >= 0) {
+    PRInt32 remaining = PREFETCH_TAIL_SIZE;
+    while (remaining > 0 && !mPrefetcher->IsCancelled()) {
+      PRInt32 read = PR_Read(fd, buffer, PR_MIN(remaining,
+                                                PREFETCH_BUFFER_SIZE));
+      if (read <= 0)
+        break;
+      remaining -= read;
+    }
+  }
+
+  delete [] buffer;
+  PR_Close(fd);
+
+  if (mPrefetcher->IsCancelled())
+    return NS_OK;
+
+  mPrefetcher->PrefetchComplete(
+          PR_IntervalToMilliseconds(PR_IntervalNow() - start));
+
+  return NS_OK;
+}
+
+NS_IMPL_THREADSAFE_ADDREF(sbGStreamerPrefetcher)
+NS_IMPL_THREADSAFE_RELEASE(sbGStreamerPrefetcher)
+
+sbGStreamerPrefetcher::sbGStreamerPrefetcher() :
+    mCancelled(PR_FALSE),
+    mLock(nsnull),
+    mPrefetchCount(0),
+    mLastPrefetchTime(0)
+{
+}
+
+sbGStreamerPrefetcher::~sbGStreamerPrefetcher()
+{
+  Shutdown();
+
+  if (mLock)
+    nsAutoLock::DestroyLock(mLock);
+}
+
+nsresult
+sbGStreamerPrefetcher::Init()
+{
+  mLock = nsAutoLock::NewLock("sbGStreamerPrefetcher::mLock");
+  NS_ENSURE_TRUE(mLock, NS_ERROR_OUT_OF_MEMORY);
+
+  return NS_OK;
+}
+
+void
+sbGStreamerPrefetcher::Shutdown()
+{
+  // Stop the reads of the prefetches in progress or queued
+  PR_AtomicSet(&mCancelled, PR_TRUE);
+
+  // Rather than joining the thread here, which would block on a read in
+  // progress, let the thread hand itself to the main thread for shutdown
+  // once it's done.
+  if (mThread) {
+    nsCOMPtr<nsIRunnable> runnable =
+      new sbGStreamerPrefetchThreadShutdown(mThread);
+    if (!runnable || NS_FAILED(mThread->Dispatch(runnable,
+                                                 NS_DISPATCH_NORMAL))) {
+      NS_WARNING("Failed to dispatch the prefetch thread shutdown");
+    }
+    mThread = nsnull;
+  }
+}
+
+PRBool
+sbGStreamerPrefetcher::IsCancelled()
+{
+  return PR_AtomicAdd(&mCancelled, 0) != 0;
+}
+
+nsresult
+sbGStreamerPrefetcher::Prefetch(nsIURI *aURI)
+{
+  NS_ENSURE_ARG_POINTER(aURI);
+  NS_ASSERTION(NS_IsMainThread(), "Prefetch off the main thread");
+  NS_ENSURE_STATE(!IsCancelled());
+
+  nsresult rv;
+
+  nsCString spec;
+  rv = aURI->GetSpec(spec);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (spec.Equals(mLastSpec))
+    return NS_OK;
+
+  nsCOMPtr<nsIFileURL> fileUrl = do_QueryInterface(aURI, &rv);
+  if (rv == NS_ERROR_NO_INTERFACE) {
+    // Not a local file, nothing to do
+    return NS_OK;
+  }
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCOMPtr<nsIFile> file;
+  rv = fileUrl->GetFile(getter_AddRefs(file));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCOMPtr<nsILocalFile> localFile = do_QueryInterface(file, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // The thread is only created once something needs prefetching
+  if (!mThread) {
+    rv = NS_NewThread(getter_AddRefs(mThread));
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  nsCOMPtr<nsIRunnable> runnable =
+    new sbGStreamerPrefetchRunnable(this, localFile);
+  NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = mThread->Dispatch(runnable, NS_DISPATCH_NORMAL);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  LOG(("Prefetching \"%s\"", spec.get()));
+  mLastSpec = spec;
+
+  return NS_OK;
+}
+
+void
+sbGStreamerPrefetcher::PrefetchComplete(PRUint32 aTime)
+{
+  LOG(("Prefetch took %u ms", aTime));
+
+  nsAutoLock lock(mLock);
+  mPrefetchCount++;
+  mLastPrefetchTime = aTime;
+}
+
+PRUint32
+sbGStreamerPrefetcher::GetPrefetchCount()
+{
+  nsAutoLock lock(mLock);
+  return mPrefetchCount;
+}
+
+PRUint32
+sbGStreamerPrefetcher::GetLastPrefetchTime()
+{
+  nsAutoLock lock(mLock);
+  return mLastPrefetchTime;
+}
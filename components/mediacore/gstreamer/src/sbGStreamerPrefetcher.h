@@ -0,0 +1,96 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2009 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#ifndef __SB_GSTREAMERPREFETCHER_H__
+#define __SB_GSTREAMERPREFETCHER_H__
+
+#include <nsCOMPtr.h>
+#include <nsISupportsImpl.h>
+#include <nsStringAPI.h>
+#include <prlock.h>
+
+class nsIThread;
+class nsIURI;
+
+/**
+ * \class sbGStreamerPrefetcher
+ * \brief Warms the OS cache for the track that will play next.
+ *
+ * The head and the tail of the file, where demuxers find their headers,
+ * tags and index tables, are read on a background thread, and the OS is
+ * asked to read ahead the rest. This wakes up spun down disks and network
+ * shares before the pipeline opens the file, so that prerolling the next
+ * track doesn't stall on I/O.
+ *
+ * Only local files are prefetched.
+ *
+ * The prefetcher is reference counted because prefetches in progress hold a
+ * reference to it; Shutdown doesn't wait for them.
+ */
+class sbGStreamerPrefetcher
+{
+public:
+  sbGStreamerPrefetcher();
+
+  NS_IMETHOD_(nsrefcnt) AddRef(void);
+  NS_IMETHOD_(nsrefcnt) Release(void);
+
+  nsresult Init();
+
+  // Cancel the prefetches in progress and shut the background thread down
+  // once it's idle. Does not block on I/O.
+  void Shutdown();
+
+  // True once Shutdown has been called. Checked by the background thread
+  // between reads.
+  PRBool IsCancelled();
+
+  // Start prefetching aURI on the background thread. Does nothing if aURI
+  // was the last URI prefetched, or is not a local file.
+  nsresult Prefetch(nsIURI *aURI);
+
+  // Called on the background thread when a prefetch has finished.
+  void PrefetchComplete(PRUint32 aTime);
+
+  PRUint32 GetPrefetchCount();
+  PRUint32 GetLastPrefetchTime();
+
+private:
+  ~sbGStreamerPrefetcher();
+
+  nsAutoRefCnt mRefCnt;
+  nsCOMPtr<nsIThread> mThread;
+  nsCString mLastSpec;
+  PRInt32 mCancelled;
+
+  // Protects the statistics below, which are updated on the background
+  // thread.
+  PRLock *mLock;
+  PRUint32 mPrefetchCount;
+  PRUint32 mLastPrefetchTime; // In milliseconds
+};
+
+#endif /* __SB_GSTREAMERPREFETCHER_H__ */
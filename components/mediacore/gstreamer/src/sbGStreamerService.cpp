@@ -23,6 +23,7 @@
  */
 
 #include "sbGStreamerService.h"
+#include "sbGStreamerCapabilityIndex.h"
 #include "sbGStreamerMediacoreUtils.h"
 #include <gst/pbutils/descriptions.h>
 #include <glib.h>
@@ -44,6 +45,7 @@
 #include <nsXULAppAPI.h>
 #include <nsISimpleEnumerator.h>
 #include <nsIPrefBranch.h>
+#include <nsAutoLock.h>
 
 #include <sbStringUtils.h>
 
@@ -99,7 +101,9 @@ get_rank_name (gint rank)
 
 NS_IMPL_THREADSAFE_ISUPPORTS1(sbGStreamerService, sbIGStreamerService)
 
-sbGStreamerService::sbGStreamerService()
+sbGStreamerService::sbGStreamerService() :
+  mMonitor(nsnull),
+  mInitialized(PR_FALSE)
 {
   LOG(("sbGStreamerService[0x%.8x] - ctor", this));
 }
@@ -107,6 +111,10 @@ sbGStreamerService::sbGStreamerService()
 sbGStreamerService::~sbGStreamerService()
 {
   LOG(("sbGStreamerService[0x%.8x] - dtor", this));
+
+  if (mMonitor) {
+    nsAutoMonitor::DestroyMonitor(mMonitor);
+  }
 }
 
 /**
@@ -375,6 +383,12 @@ sbGStreamerService::Init()
 
 #endif // GST_SYSTEM
 
+  // Part of the capability index stamp, as a change in plugin directories
+  // means a different set of plugins.
+  CopyUTF16toUTF8(pluginPaths, mPluginPaths);
+  mPluginPaths.Append('|');
+  mPluginPaths.Append(NS_ConvertUTF16toUTF8(systemPluginPaths));
+
   // Set registry path
   nsCOMPtr<nsIFile> registryPath;
   rv = GetGStreamerRegistryFile(getter_AddRefs(registryPath));
@@ -401,20 +415,190 @@ sbGStreamerService::Init()
   // Update the gstreamer registry file if needed.
   UpdateGStreamerRegistryFile();
 
+  mRegistryFile = registryPath;
+
+  mMonitor = nsAutoMonitor::NewMonitor("sbGStreamerService::mMonitor");
+  NS_ENSURE_TRUE(mMonitor, NS_ERROR_OUT_OF_MEMORY);
+
+  mCapabilityIndex = new sbGStreamerCapabilityIndex();
+  NS_ENSURE_TRUE(mCapabilityIndex, NS_ERROR_OUT_OF_MEMORY);
+
+  // Load the capability index saved by an earlier session, so capability
+  // queries can be answered without initializing GStreamer.  GStreamer itself
+  // is only initialized when something first needs it; see
+  // EnsureInitialized.
+  rv = GetCapabilityIndexFile(getter_AddRefs(mCapabilityIndexFile));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = GetRegistryStamp(mCapabilityIndexStamp);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mCapabilityIndex->Load(mCapabilityIndexFile, mCapabilityIndexStamp);
+  if (NS_FAILED(rv)) {
+    LOG(("sbGStreamerService[0x%.8x] - No usable capability index", this));
+  }
+
+  // GLib must be told about threads before GStreamer is used from more than
+  // one of them.
+  if (!g_thread_supported()) {
+    g_thread_init(NULL);
+  }
+
+  return NS_OK;
+}
+
+void
+sbGStreamerService::InitGStreamer()
+{
+  TRACE(("sbGStreamerService[0x%.8x] - InitGStreamer", this));
+
   gst_init(NULL, NULL);
 
   // Register our custom tags.
   RegisterCustomTags();
 
+  // gst_init may have rebuilt the registry, in which case the saved index no
+  // longer describes it.
+  nsCString stamp;
+  nsresult rv = GetRegistryStamp(stamp);
+  NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to get the registry stamp");
+
+  PRBool needIndex;
+  {
+    nsAutoMonitor mon(mMonitor);
+    needIndex = mCapabilityIndex->IsEmpty() ||
+                !stamp.Equals(mCapabilityIndexStamp);
+  }
+
+  // The loaded index keeps answering queries while the new one is built.
+  nsAutoPtr<sbGStreamerCapabilityIndex> index;
+  if (needIndex) {
+    index = new sbGStreamerCapabilityIndex();
+    if (index) {
+      rv = index->Build();
+      if (NS_SUCCEEDED(rv)) {
+        rv = index->Save(mCapabilityIndexFile, stamp);
+        NS_WARN_IF_FALSE(NS_SUCCEEDED(rv),
+                         "Failed to save the capability index");
+      }
+      else {
+        NS_WARNING("Failed to build the capability index");
+        index = nsnull;
+      }
+    }
+  }
+
+  {
+    nsAutoMonitor mon(mMonitor);
+    if (index) {
+      mCapabilityIndex = index.forget();
+      mCapabilityIndexStamp = stamp;
+    }
+    mInitialized = PR_TRUE;
+    mon.NotifyAll();
+  }
+
+  // Threads can only be shut down from the main thread.
+  nsCOMPtr<nsIRunnable> event =
+    NS_NEW_RUNNABLE_METHOD(sbGStreamerService, this, ShutdownInitThread);
+  if (event) {
+    NS_DispatchToMainThread(event);
+  }
+}
+
+void
+sbGStreamerService::ShutdownInitThread()
+{
+  NS_ASSERTION(NS_IsMainThread(), "Not on main thread");
+
+  nsCOMPtr<nsIThread> thread;
+  {
+    nsAutoMonitor mon(mMonitor);
+    thread.swap(mInitThread);
+  }
+
+  if (thread) {
+    thread->Shutdown();
+  }
+}
+
+NS_IMETHODIMP
+sbGStreamerService::EnsureInitialized()
+{
+  NS_ENSURE_TRUE(mMonitor, NS_ERROR_NOT_INITIALIZED);
+
+  nsAutoMonitor mon(mMonitor);
+
+  if (!mInitialized && !mInitThread) {
+    nsCOMPtr<nsIRunnable> event =
+      NS_NEW_RUNNABLE_METHOD(sbGStreamerService, this, InitGStreamer);
+    NS_ENSURE_TRUE(event, NS_ERROR_OUT_OF_MEMORY);
+
+    nsresult rv = NS_NewThread(getter_AddRefs(mInitThread), event);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  while (!mInitialized) {
+    mon.Wait();
+  }
+
   return NS_OK;
 }
 
+void
+sbGStreamerService::WaitForCapabilityIndex()
+{
+  if (!mCapabilityIndex->IsEmpty() || mInitialized) {
+    return;
+  }
+
+  // There was no saved index, so the registry has to be read.  The monitor is
+  // reentrant, and waiting in it releases every entry.
+  nsresult rv = EnsureInitialized();
+  NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to initialize GStreamer");
+}
+
+PRBool
+sbGStreamerService::HasPlugin(const nsACString &aName)
+{
+  NS_ENSURE_TRUE(mMonitor, PR_FALSE);
+
+  nsAutoMonitor mon(mMonitor);
+  WaitForCapabilityIndex();
+  return mCapabilityIndex->HasPlugin(aName);
+}
+
+nsresult
+sbGStreamerService::GetTypeFindExtensions(const nsACString &aPrefix,
+                                          nsTArray<nsCString> &aExtensions)
+{
+  NS_ENSURE_TRUE(mMonitor, NS_ERROR_NOT_INITIALIZED);
+
+  nsAutoMonitor mon(mMonitor);
+  WaitForCapabilityIndex();
+  return mCapabilityIndex->GetTypeFindExtensions(aPrefix, aExtensions);
+}
+
+const char *
+sbGStreamerService::FindMatchingElementName(GstCaps *aSrcCaps,
+                                            const char *aTypeName)
+{
+  NS_ENSURE_TRUE(mMonitor, NULL);
+
+  nsAutoMonitor mon(mMonitor);
+  NS_ASSERTION(mInitialized, "GStreamer has not been initialized");
+  return mCapabilityIndex->FindMatchingElementName(aSrcCaps, aTypeName);
+}
+
 NS_IMETHODIMP
 sbGStreamerService::Inspect(sbIGStreamerInspectHandler* aHandler)
 {
   NS_ENSURE_ARG_POINTER(aHandler);
   nsresult rv;
 
+  rv = EnsureInitialized();
+  NS_ENSURE_SUCCESS(rv, rv);
+
   char libvisual[10] = "libvisual";
 
   GList *plugins, *orig_plugins;
@@ -680,3 +864,59 @@ sbGStreamerService::GetGStreamerRegistryFile(nsIFile **aOutRegistryFile)
   return NS_OK;
 }
 
+nsresult
+sbGStreamerService::GetCapabilityIndexFile(nsIFile **aOutIndexFile)
+{
+  NS_ENSURE_ARG_POINTER(aOutIndexFile);
+  *aOutIndexFile = nsnull;
+
+  // Keep the index next to the registry it was built from
+  nsCOMPtr<nsIFile> indexFile;
+  nsresult rv = GetGStreamerRegistryFile(getter_AddRefs(indexFile));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = indexFile->SetLeafName(NS_LITERAL_STRING("capabilities.dat"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  indexFile.forget(aOutIndexFile);
+  return NS_OK;
+}
+
+nsresult
+sbGStreamerService::GetRegistryStamp(nsACString &aStamp)
+{
+  NS_ENSURE_STATE(mRegistryFile);
+
+  nsresult rv;
+
+  // gst_version may be called before gst_init
+  guint major, minor, micro, nano;
+  gst_version(&major, &minor, &micro, &nano);
+
+  // The registry is rewritten whenever GStreamer finds plugins have changed,
+  // and deleted by UpdateGStreamerRegistryFile when the component registry
+  // has, so its modification time covers both.
+  PRInt64 lastModifiedTime = 0;
+  PRBool exists;
+  rv = mRegistryFile->Exists(&exists);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (exists) {
+    rv = mRegistryFile->GetLastModifiedTime(&lastModifiedTime);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  aStamp.Truncate();
+  aStamp.AppendInt(major);
+  aStamp.Append('.');
+  aStamp.AppendInt(minor);
+  aStamp.Append('.');
+  aStamp.AppendInt(micro);
+  aStamp.Append('.');
+  aStamp.AppendInt(nano);
+  aStamp.Append(' ');
+  aStamp.Append(NS_ConvertUTF16toUTF8(sbAutoString(lastModifiedTime)));
+  aStamp.Append(' ');
+  aStamp.Append(mPluginPaths);
+
+  return NS_OK;
+}
@@ -25,11 +25,19 @@
 #ifndef _SB_GSTREAMER_SERVICE_H_
 #define _SB_GSTREAMER_SERVICE_H_
 
+#include <nsAutoPtr.h>
 #include <nsCOMPtr.h>
+#include <nsStringAPI.h>
+#include <nsTArray.h>
+#include <prmon.h>
 #include "sbIGStreamerService.h"
 
 #include <gst/gst.h>
 
+class nsIFile;
+class nsIThread;
+class sbGStreamerCapabilityIndex;
+
 class sbGStreamerService : public sbIGStreamerService
 {
 public:
@@ -40,8 +48,25 @@ public:
 
   sbGStreamerService();
 
+  // Capability queries, answered from the capability index.  These are safe
+  // to call from any thread.  The first two only wait for GStreamer to be
+  // initialized if there was no saved index to load at startup.
+  PRBool HasPlugin(const nsACString &aName);
+  nsresult GetTypeFindExtensions(const nsACString &aPrefix,
+                                 nsTArray<nsCString> &aExtensions);
+
+  // See FindMatchingElementName in sbGStreamerMediacoreUtils.h.  GStreamer
+  // must have been initialized, which the caller has done to get aSrcCaps.
+  const char *FindMatchingElementName(GstCaps *aSrcCaps,
+                                      const char *aTypeName);
+
 private:
 
+  // Runs on mInitThread
+  void InitGStreamer();
+
+  void ShutdownInitThread();
+
   nsresult InspectFactory(GstElementFactory* aFactory,
                           sbIGStreamerInspectHandler* aHandler);
 
@@ -53,7 +78,33 @@ private:
 
   nsresult GetGStreamerRegistryFile(nsIFile **aOutRegistryFile);
 
+  nsresult GetCapabilityIndexFile(nsIFile **aOutIndexFile);
+
+  // Describes the registry, so that a saved capability index is only used
+  // with the registry and plugins it was built from.
+  nsresult GetRegistryStamp(nsACString &aStamp);
+
+  // Wait for the capability index, if there was no saved one to load.  The
+  // caller must be in mMonitor.
+  void WaitForCapabilityIndex();
+
   virtual ~sbGStreamerService();
+
+  // Set up by Init, then read only
+  nsCOMPtr<nsIFile> mRegistryFile;
+  nsCOMPtr<nsIFile> mCapabilityIndexFile;
+  nsCString mPluginPaths;
+
+  // Protects the members below, and is notified once GStreamer has been
+  // initialized.
+  PRMonitor *mMonitor;
+  PRBool mInitialized;
+  // Started by the first EnsureInitialized call, from whichever thread that
+  // is; shut down and released on the main thread.
+  nsCOMPtr<nsIThread> mInitThread;
+  nsAutoPtr<sbGStreamerCapabilityIndex> mCapabilityIndex;
+  // The stamp of the index loaded at startup
+  nsCString mCapabilityIndexStamp;
 };
 
 #endif // _SB_GSTREAMER_SERVICE_H_
@@ -874,7 +874,10 @@ sbGStreamerTranscodeAudioConfigurator::GetAvailableProfiles(nsIArray * *aAvailab
     NS_ENSURE_TRUE(initSuccess, NS_ERROR_OUT_OF_MEMORY);
   }
 
-  nsresult rv;
+  // Checking the profiles builds caps
+  nsresult rv = EnsureGStreamerInitialized();
+  NS_ENSURE_SUCCESS(rv, rv);
+
   PRBool hasMoreElements;
   nsCOMPtr<nsISimpleEnumerator> dirEnum;
 
@@ -0,0 +1,120 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#include "sbTestAudioAnalysis.h"
+
+#include <nsTArray.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "sbAudioAnalysisKernels.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// The kernels are fed this many frames at a time, as the analyzer would be
+#define BLOCK_FRAMES 4096
+
+// Length of each click of a click track, in frames
+#define CLICK_FRAMES (sbTempoAnalysis::SAMPLE_RATE / 100)
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbTestAudioAnalysis,
+                              sbITestAudioAnalysis)
+
+// Fill aSamples with aDuration ms of interleaved stereo silence
+static void
+AllocateSignal(nsTArray<float> & aSamples, PRUint32 aDuration)
+{
+  PRUint32 frames =
+    (PRUint32)((PRUint64)aDuration * sbReplayGainAnalysis::SAMPLE_RATE / 1000);
+  aSamples.SetLength(frames * sbReplayGainAnalysis::CHANNELS);
+  memset(aSamples.Elements(), 0, aSamples.Length() * sizeof(float));
+}
+
+NS_IMETHODIMP
+sbTestAudioAnalysis::ReplayGainOfSine(double aFrequency,
+                                      double aAmplitude,
+                                      PRUint32 aDuration,
+                                      double *_retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  nsTArray<float> samples;
+  AllocateSignal(samples, aDuration);
+  PRUint32 frames = samples.Length() / sbReplayGainAnalysis::CHANNELS;
+
+  for (PRUint32 i = 0; i < frames; ++i) {
+    float value = (float)(aAmplitude *
+        sin(2.0 * M_PI * aFrequency * i / sbReplayGainAnalysis::SAMPLE_RATE));
+    samples[2 * i] = value;
+    samples[2 * i + 1] = value;
+  }
+
+  sbReplayGainAnalysis analysis;
+  for (PRUint32 done = 0; done < frames; done += BLOCK_FRAMES) {
+    analysis.Process(samples.Elements() + 2 * done,
+                     PR_MIN(BLOCK_FRAMES, frames - done));
+  }
+
+  *_retval = analysis.GetGain();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestAudioAnalysis::TempoOfClicks(double aBPM,
+                                   PRUint32 aDuration,
+                                   PRUint32 *_retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+  NS_ENSURE_ARG(aBPM > 0);
+
+  nsTArray<float> samples;
+  AllocateSignal(samples, aDuration);
+  PRUint32 frames = samples.Length() / sbTempoAnalysis::CHANNELS;
+
+  double period = 60.0 * sbTempoAnalysis::SAMPLE_RATE / aBPM;
+  for (double start = 0; start < frames; start += period) {
+    PRUint32 first = (PRUint32)floor(start + 0.5);
+    for (PRUint32 i = 0; i < CLICK_FRAMES && first + i < frames; ++i) {
+      // A decaying tone burst
+      float value = (float)(0.5 * (1.0 - (double)i / CLICK_FRAMES) *
+          sin(2.0 * M_PI * 1000.0 * i / sbTempoAnalysis::SAMPLE_RATE));
+      samples[2 * (first + i)] = value;
+      samples[2 * (first + i) + 1] = value;
+    }
+  }
+
+  sbTempoAnalysis analysis;
+  for (PRUint32 done = 0; done < frames; done += BLOCK_FRAMES) {
+    analysis.Process(samples.Elements() + 2 * done,
+                     PR_MIN(BLOCK_FRAMES, frames - done));
+  }
+
+  *_retval = analysis.GetBPM();
+  return NS_OK;
+}
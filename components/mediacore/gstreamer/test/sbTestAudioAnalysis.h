@@ -0,0 +1,52 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#ifndef __SB_TESTAUDIOANALYSIS_H__
+#define __SB_TESTAUDIOANALYSIS_H__
+
+#include "sbITestAudioAnalysis.h"
+
+class sbTestAudioAnalysis : public sbITestAudioAnalysis
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBITESTAUDIOANALYSIS
+};
+
+#define SB_TEST_AUDIO_ANALYSIS_CLASSNAME                   \
+  "sbTestAudioAnalysis"
+#define SB_TEST_AUDIO_ANALYSIS_CONTRACTID                  \
+  "@songbirdnest.com/mediacore/sbTestAudioAnalysis;1"
+
+#define SB_TEST_AUDIO_ANALYSIS_CID                         \
+{ /* 2f4555c0-1646-471a-a01e-c9ccd39f8393 */               \
+  0x2f4555c0,                                              \
+  0x1646,                                                  \
+  0x471a,                                                  \
+  { 0xa0, 0x1e, 0xc9, 0xcc, 0xd3, 0x9f, 0x83, 0x93 }       \
+}
+
+#endif /* __SB_TESTAUDIOANALYSIS_H__ */
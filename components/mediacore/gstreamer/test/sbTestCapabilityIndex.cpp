@@ -0,0 +1,271 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#include "sbTestCapabilityIndex.h"
+
+#include <nsIFile.h>
+#include <nsMemory.h>
+#include <nsServiceManagerUtils.h>
+#include <nsStringAPI.h>
+#include <nsTArray.h>
+
+#include <gst/gst.h>
+#include <string.h>
+
+#include "sbGStreamerCapabilityIndex.h"
+#include "sbIGStreamerService.h"
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbTestCapabilityIndex,
+                   sbITestCapabilityIndex)
+
+sbTestCapabilityIndex::sbTestCapabilityIndex()
+{
+}
+
+sbTestCapabilityIndex::~sbTestCapabilityIndex()
+{
+}
+
+nsresult
+sbTestCapabilityIndex::EnsureGStreamer()
+{
+  nsresult rv;
+
+  nsCOMPtr<sbIGStreamerService> service =
+    do_GetService(SBGSTREAMERSERVICE_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = service->EnsureInitialized();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (!mIndex) {
+    mIndex = new sbGStreamerCapabilityIndex();
+    NS_ENSURE_TRUE(mIndex, NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestCapabilityIndex::BuildAndSave(nsIFile *aFile,
+                                    const nsACString &aStamp)
+{
+  NS_ENSURE_ARG_POINTER(aFile);
+
+  nsresult rv = EnsureGStreamer();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mIndex->Build();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return mIndex->Save(aFile, aStamp);
+}
+
+NS_IMETHODIMP
+sbTestCapabilityIndex::Load(nsIFile *aFile,
+                            const nsACString &aStamp,
+                            PRBool *_retval)
+{
+  NS_ENSURE_ARG_POINTER(aFile);
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  nsresult rv = EnsureGStreamer();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  *_retval = NS_SUCCEEDED(mIndex->Load(aFile, aStamp));
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestCapabilityIndex::GetIsEmpty(PRBool *aIsEmpty)
+{
+  NS_ENSURE_ARG_POINTER(aIsEmpty);
+  *aIsEmpty = !mIndex || mIndex->IsEmpty();
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestCapabilityIndex::HasPlugin(const nsACString &aName,
+                                 PRBool *_retval)
+{
+  NS_ENSURE_ARG_POINTER(_retval);
+  NS_ENSURE_STATE(mIndex);
+
+  *_retval = mIndex->HasPlugin(aName);
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestCapabilityIndex::GetTypeFindExtensions(const nsACString &aPrefix,
+                                             PRUint32 *aCount,
+                                             char ***aExtensions)
+{
+  NS_ENSURE_ARG_POINTER(aCount);
+  NS_ENSURE_ARG_POINTER(aExtensions);
+  NS_ENSURE_STATE(mIndex);
+
+  nsTArray<nsCString> extensions;
+  nsresult rv = mIndex->GetTypeFindExtensions(aPrefix, extensions);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  char **out = static_cast<char **>(
+    nsMemory::Alloc(PR_MAX(extensions.Length(), 1) * sizeof(char *)));
+  NS_ENSURE_TRUE(out, NS_ERROR_OUT_OF_MEMORY);
+
+  for (PRUint32 i = 0; i < extensions.Length(); i++) {
+    out[i] = ToNewCString(extensions[i]);
+    if (!out[i]) {
+      NS_FREE_XPCOM_ALLOCATED_POINTER_ARRAY(i, out);
+      return NS_ERROR_OUT_OF_MEMORY;
+    }
+  }
+
+  *aCount = extensions.Length();
+  *aExtensions = out;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestCapabilityIndex::FindMatchingElementName(const nsACString &aCaps,
+                                               const nsACString &aTypeName,
+                                               nsACString &_retval)
+{
+  NS_ENSURE_STATE(mIndex);
+
+  GstCaps *caps = gst_caps_from_string(nsCString(aCaps).get());
+  NS_ENSURE_TRUE(caps, NS_ERROR_INVALID_ARG);
+
+  const char *name =
+    mIndex->FindMatchingElementName(caps, nsCString(aTypeName).get());
+  gst_caps_unref(caps);
+
+  if (name) {
+    _retval.Assign(name);
+  }
+  else {
+    _retval.Truncate();
+  }
+  return NS_OK;
+}
+
+typedef struct {
+  GstCaps *srccaps;
+  const char *type;
+} TypeMatchingInfo;
+
+static gboolean
+match_element_filter (GstPluginFeature * feature, TypeMatchingInfo * data)
+{
+  const gchar *klass;
+  const GList *templates;
+  GList *walk;
+  GstElementFactory * factory;
+  const char *name;
+
+  /* we only care about element factories */
+  if (!GST_IS_ELEMENT_FACTORY (feature))
+    return FALSE;
+
+  factory = GST_ELEMENT_FACTORY (feature);
+
+  klass = gst_element_factory_get_klass (factory);
+
+  if (strstr (klass, data->type) == NULL) {
+    /* Wrong type, don't check further */
+    return FALSE;
+  }
+
+  /* Blacklist ffmux and ffenc. */
+  name = gst_plugin_feature_get_name (feature);
+  if (strstr (name, "ffmux") != NULL ||
+      strstr (name, "ffenc") != NULL)
+    return FALSE;
+
+  templates = gst_element_factory_get_static_pad_templates (factory);
+  for (walk = (GList *) templates; walk; walk = g_list_next (walk)) {
+    GstStaticPadTemplate *templ = (GstStaticPadTemplate *)(walk->data);
+
+    /* Only want source pad templates */
+    if (templ->direction == GST_PAD_SRC) {
+      GstCaps *template_caps = gst_static_caps_get (&templ->static_caps);
+      GstCaps *intersect;
+
+      intersect = gst_caps_intersect (template_caps, data->srccaps);
+      gst_caps_unref (template_caps);
+
+      if (!gst_caps_is_empty (intersect)) {
+        gst_caps_unref (intersect);
+        return TRUE;
+      }
+      gst_caps_unref (intersect);
+    }
+  }
+
+  return FALSE;
+}
+
+NS_IMETHODIMP
+sbTestCapabilityIndex::FindRegistryElementName(const nsACString &aCaps,
+                                               const nsACString &aTypeName,
+                                               nsACString &_retval)
+{
+  nsresult rv = EnsureGStreamer();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  GstCaps *caps = gst_caps_from_string(nsCString(aCaps).get());
+  NS_ENSURE_TRUE(caps, NS_ERROR_INVALID_ARG);
+
+  nsCString typeName(aTypeName);
+  TypeMatchingInfo data;
+  data.srccaps = caps;
+  data.type = typeName.get();
+
+  GList *list = gst_default_registry_feature_filter (
+          (GstPluginFeatureFilter)match_element_filter, FALSE, &data);
+
+  guint bestrank = 0;
+  GstElementFactory *bestfactory = NULL;
+  for (GList *walk = list; walk; walk = g_list_next (walk)) {
+    GstElementFactory *factory = GST_ELEMENT_FACTORY (walk->data);
+    guint rank = gst_plugin_feature_get_rank (GST_PLUGIN_FEATURE (factory));
+
+    // Find the highest-ranked element that we considered acceptable.
+    if (!bestfactory || rank > bestrank) {
+      bestfactory = factory;
+      bestrank = rank;
+    }
+  }
+
+  if (bestfactory) {
+    _retval.Assign(gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (bestfactory)));
+  }
+  else {
+    _retval.Truncate();
+  }
+
+  gst_plugin_feature_list_free (list);
+  gst_caps_unref (caps);
+  return NS_OK;
+}
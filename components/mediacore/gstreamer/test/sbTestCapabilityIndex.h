@@ -0,0 +1,65 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#ifndef __SB_TESTCAPABILITYINDEX_H__
+#define __SB_TESTCAPABILITYINDEX_H__
+
+#include <nsAutoPtr.h>
+
+#include "sbITestCapabilityIndex.h"
+
+class sbGStreamerCapabilityIndex;
+
+class sbTestCapabilityIndex : public sbITestCapabilityIndex
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBITESTCAPABILITYINDEX
+
+  sbTestCapabilityIndex();
+
+private:
+  ~sbTestCapabilityIndex();
+
+  nsresult EnsureGStreamer();
+
+  nsAutoPtr<sbGStreamerCapabilityIndex> mIndex;
+};
+
+#define SB_TEST_CAPABILITY_INDEX_CLASSNAME                 \
+  "sbTestCapabilityIndex"
+#define SB_TEST_CAPABILITY_INDEX_CONTRACTID                \
+  "@songbirdnest.com/mediacore/sbTestCapabilityIndex;1"
+
+#define SB_TEST_CAPABILITY_INDEX_CID                       \
+{ /* 4a0e8c73-d15b-4f2e-9b67-3c81e5f0a92d */               \
+  0x4a0e8c73,                                              \
+  0xd15b,                                                  \
+  0x4f2e,                                                  \
+  { 0x9b, 0x67, 0x3c, 0x81, 0xe5, 0xf0, 0xa9, 0x2d }       \
+}
+
+#endif /* __SB_TESTCAPABILITYINDEX_H__ */
@@ -0,0 +1,312 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#include "sbTestDspPipeline.h"
+
+#include <nsComponentManagerUtils.h>
+#include <nsIWritablePropertyBag2.h>
+#include <nsMemory.h>
+#include <nsServiceManagerUtils.h>
+#include <nsStringAPI.h>
+
+#include <math.h>
+
+#include "sbIGStreamerService.h"
+
+// How long a run may take before it is given up on
+#define RUN_TIMEOUT (60 * GST_SECOND)
+
+NS_IMPL_THREADSAFE_ISUPPORTS1(sbTestDspPipeline,
+                              sbITestDspPipeline)
+
+sbTestDspPipeline::sbTestDspPipeline() :
+  mFramesIn(0),
+  mFramesOut(0),
+  mPeak(0.0),
+  mEnvelopeFrames(0),
+  mStatsCount(0),
+  mStats(NULL)
+{
+}
+
+sbTestDspPipeline::~sbTestDspPipeline()
+{
+  Clear();
+}
+
+void
+sbTestDspPipeline::Clear()
+{
+  mFramesIn = 0;
+  mFramesOut = 0;
+  mPeak = 0.0;
+  mEnvelope.Clear();
+  mEnvelopeFrames = 0;
+  mStatsCount = 0;
+  if (mStats) {
+    gst_structure_free (mStats);
+    mStats = NULL;
+  }
+}
+
+NS_IMETHODIMP
+sbTestDspPipeline::Run(const nsACString & aDescription)
+{
+  nsresult rv;
+
+  nsCOMPtr<sbIGStreamerService> service =
+    do_GetService(SBGSTREAMERSERVICE_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+  rv = service->EnsureInitialized();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  Clear();
+
+  GError *error = NULL;
+  GstElement *pipeline =
+    gst_parse_launch (nsCString(aDescription).get(), &error);
+  if (error) {
+    NS_WARNING(error->message);
+    g_error_free (error);
+  }
+  NS_ENSURE_TRUE(pipeline, NS_ERROR_FAILURE);
+
+  GstElement *dsp = gst_bin_get_by_name (GST_BIN (pipeline), "dsp");
+  GstElement *sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  GstPad *dspSinkPad = dsp ? gst_element_get_static_pad (dsp, "sink") : NULL;
+
+  if (!sink || !dspSinkPad) {
+    rv = NS_ERROR_INVALID_ARG;
+  }
+  else {
+    gst_pad_add_buffer_probe (dspSinkPad, G_CALLBACK (OnChainBuffer), this);
+
+    g_object_set (sink, "signal-handoffs", TRUE, NULL);
+    g_signal_connect (sink, "handoff", G_CALLBACK (OnSinkHandoff), this);
+
+    rv = RunToEOS(pipeline);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  if (dspSinkPad)
+    gst_object_unref (dspSinkPad);
+  if (sink)
+    gst_object_unref (sink);
+  if (dsp)
+    gst_object_unref (dsp);
+  gst_object_unref (pipeline);
+
+  return rv;
+}
+
+nsresult
+sbTestDspPipeline::RunToEOS(GstElement *aPipeline)
+{
+  GstStateChangeReturn ret =
+    gst_element_set_state (aPipeline, GST_STATE_PLAYING);
+  NS_ENSURE_TRUE(ret != GST_STATE_CHANGE_FAILURE, NS_ERROR_FAILURE);
+
+  GstBus *bus = gst_element_get_bus (aPipeline);
+  nsresult rv = NS_ERROR_FAILURE;
+
+  for (;;) {
+    GstMessage *message = gst_bus_timed_pop_filtered (bus, RUN_TIMEOUT,
+        (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR |
+                          GST_MESSAGE_ELEMENT));
+    if (!message) {
+      NS_WARNING("Timed out waiting for EOS");
+      break;
+    }
+
+    GstMessageType type = GST_MESSAGE_TYPE (message);
+    if (type == GST_MESSAGE_ELEMENT &&
+        gst_structure_has_name (message->structure, "sb-dsp-stats")) {
+      if (mStats)
+        gst_structure_free (mStats);
+      mStats = gst_structure_copy (message->structure);
+      mStatsCount++;
+    }
+    gst_message_unref (message);
+
+    if (type == GST_MESSAGE_EOS) {
+      rv = NS_OK;
+      break;
+    }
+    if (type == GST_MESSAGE_ERROR)
+      break;
+  }
+
+  gst_object_unref (bus);
+  return rv;
+}
+
+/* static */ gboolean
+sbTestDspPipeline::OnChainBuffer(GstPad *aPad, GstBuffer *aBuffer,
+                                 gpointer aData)
+{
+  sbTestDspPipeline *self = static_cast<sbTestDspPipeline*>(aData);
+
+  GstCaps *caps = GST_BUFFER_CAPS (aBuffer);
+  gint channels;
+  if (!caps || !gst_structure_get_int (gst_caps_get_structure (caps, 0),
+                                       "channels", &channels)) {
+    return TRUE;
+  }
+
+  self->mFramesIn += GST_BUFFER_SIZE (aBuffer) / (sizeof (gfloat) * channels);
+  return TRUE;
+}
+
+/* static */ void
+sbTestDspPipeline::OnSinkHandoff(GstElement *aSink, GstBuffer *aBuffer,
+                                 GstPad *aPad, gpointer aData)
+{
+  sbTestDspPipeline *self = static_cast<sbTestDspPipeline*>(aData);
+
+  GstCaps *caps = GST_BUFFER_CAPS (aBuffer);
+  if (!caps)
+    return;
+  GstStructure *structure = gst_caps_get_structure (caps, 0);
+  gint rate, channels;
+  if (!gst_structure_get_int (structure, "rate", &rate) ||
+      !gst_structure_get_int (structure, "channels", &channels)) {
+    return;
+  }
+
+  PRUint32 entryFrames = PR_MAX(rate / 100, 1);
+  const gfloat *samples = (const gfloat *) GST_BUFFER_DATA (aBuffer);
+  PRUint32 frames = GST_BUFFER_SIZE (aBuffer) / (sizeof (gfloat) * channels);
+
+  for (PRUint32 i = 0; i < frames; i++) {
+    if (!self->mEnvelopeFrames)
+      self->mEnvelope.AppendElement(0.0);
+    double &entry = self->mEnvelope[self->mEnvelope.Length() - 1];
+
+    for (gint c = 0; c < channels; c++) {
+      double value = fabs (samples[i * channels + c]);
+      entry = PR_MAX(entry, value);
+      self->mPeak = PR_MAX(self->mPeak, value);
+    }
+
+    if (++self->mEnvelopeFrames == entryFrames)
+      self->mEnvelopeFrames = 0;
+  }
+
+  self->mFramesOut += frames;
+}
+
+NS_IMETHODIMP
+sbTestDspPipeline::GetFramesIn(PRUint64 *aFramesIn)
+{
+  NS_ENSURE_ARG_POINTER(aFramesIn);
+  *aFramesIn = mFramesIn;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestDspPipeline::GetFramesOut(PRUint64 *aFramesOut)
+{
+  NS_ENSURE_ARG_POINTER(aFramesOut);
+  *aFramesOut = mFramesOut;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestDspPipeline::GetPeak(double *aPeak)
+{
+  NS_ENSURE_ARG_POINTER(aPeak);
+  *aPeak = mPeak;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestDspPipeline::GetEnvelope(PRUint32 *aCount,
+                               double **aEnvelope)
+{
+  NS_ENSURE_ARG_POINTER(aCount);
+  NS_ENSURE_ARG_POINTER(aEnvelope);
+
+  *aCount = mEnvelope.Length();
+  *aEnvelope = nsnull;
+  if (!*aCount)
+    return NS_OK;
+
+  *aEnvelope = static_cast<double*>(
+      nsMemory::Clone(mEnvelope.Elements(), *aCount * sizeof(double)));
+  NS_ENSURE_TRUE(*aEnvelope, NS_ERROR_OUT_OF_MEMORY);
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbTestDspPipeline::GetStatsCount(PRUint32 *aStatsCount)
+{
+  NS_ENSURE_ARG_POINTER(aStatsCount);
+  *aStatsCount = mStatsCount;
+  return NS_OK;
+}
+
+// A GstStructureForeachFunc. Copies the fields sb-dsp-stats uses to the
+// nsIWritablePropertyBag2 in aUserData.
+static gboolean
+CopyStatsField(GQuark aFieldId, const GValue *aValue, gpointer aUserData)
+{
+  nsIWritablePropertyBag2 *bag =
+    static_cast<nsIWritablePropertyBag2*>(aUserData);
+  NS_ConvertASCIItoUTF16 name(g_quark_to_string (aFieldId));
+  nsresult rv = NS_OK;
+
+  if (G_VALUE_HOLDS_UINT64 (aValue))
+    rv = bag->SetPropertyAsUint64(name, g_value_get_uint64 (aValue));
+  else if (G_VALUE_HOLDS_DOUBLE (aValue))
+    rv = bag->SetPropertyAsDouble(name, g_value_get_double (aValue));
+  else if (G_VALUE_HOLDS_STRING (aValue))
+    rv = bag->SetPropertyAsACString(name,
+        nsDependentCString(g_value_get_string (aValue)));
+  NS_ENSURE_SUCCESS(rv, FALSE);
+
+  return TRUE;
+}
+
+NS_IMETHODIMP
+sbTestDspPipeline::GetStats(nsIPropertyBag2 **aStats)
+{
+  NS_ENSURE_ARG_POINTER(aStats);
+
+  *aStats = nsnull;
+  if (!mStats)
+    return NS_OK;
+
+  nsresult rv;
+  nsCOMPtr<nsIWritablePropertyBag2> bag =
+    do_CreateInstance("@songbirdnest.com/moz/xpcom/sbpropertybag;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  gboolean ok = gst_structure_foreach (mStats, CopyStatsField, bag);
+  NS_ENSURE_TRUE(ok, NS_ERROR_FAILURE);
+
+  return CallQueryInterface(bag, aStats);
+}
@@ -0,0 +1,82 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#ifndef __SB_TESTDSPPIPELINE_H__
+#define __SB_TESTDSPPIPELINE_H__
+
+#include <nsTArray.h>
+
+#include <gst/gst.h>
+
+#include "sbITestDspPipeline.h"
+
+class sbTestDspPipeline : public sbITestDspPipeline
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBITESTDSPPIPELINE
+
+  sbTestDspPipeline();
+
+private:
+  ~sbTestDspPipeline();
+
+  void Clear();
+
+  // Run the pipeline until EOS or an error; fails on an error
+  nsresult RunToEOS(GstElement *aPipeline);
+
+  // Audio going into the chain. Streaming thread.
+  static gboolean OnChainBuffer(GstPad *aPad, GstBuffer *aBuffer,
+                                gpointer aData);
+  // Audio coming out of the chain. Streaming thread.
+  static void OnSinkHandoff(GstElement *aSink, GstBuffer *aBuffer,
+                            GstPad *aPad, gpointer aData);
+
+  PRUint64 mFramesIn;
+  PRUint64 mFramesOut;
+  double mPeak;
+  nsTArray<double> mEnvelope;
+  PRUint32 mEnvelopeFrames;          // Frames in the last envelope entry
+
+  PRUint32 mStatsCount;
+  GstStructure *mStats;              // The last sb-dsp-stats message
+};
+
+#define SB_TEST_DSP_PIPELINE_CLASSNAME                     \
+  "sbTestDspPipeline"
+#define SB_TEST_DSP_PIPELINE_CONTRACTID                    \
+  "@songbirdnest.com/mediacore/sbTestDspPipeline;1"
+
+#define SB_TEST_DSP_PIPELINE_CID                           \
+{ /* 937ea894-c3a8-4a29-806d-21dace7a8c62 */               \
+  0x937ea894,                                              \
+  0xc3a8,                                                  \
+  0x4a29,                                                  \
+  { 0x80, 0x6d, 0x21, 0xda, 0xce, 0x7a, 0x8c, 0x62 }       \
+}
+
+#endif /* __SB_TESTDSPPIPELINE_H__ */
@@ -0,0 +1,67 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+* \file  sbTestGStreamerModule.cpp
+* \brief Songbird GStreamer Test Component Factory and Main Entry Point.
+*/
+
+#include <nsCOMPtr.h>
+#include <nsServiceManagerUtils.h>
+#include <nsICategoryManager.h>
+#include <nsIGenericFactory.h>
+
+#include "sbTestAudioAnalysis.h"
+#include "sbTestDspPipeline.h"
+#include "sbTestCapabilityIndex.h"
+
+NS_GENERIC_FACTORY_CONSTRUCTOR(sbTestAudioAnalysis);
+NS_GENERIC_FACTORY_CONSTRUCTOR(sbTestDspPipeline);
+NS_GENERIC_FACTORY_CONSTRUCTOR(sbTestCapabilityIndex);
+
+static nsModuleComponentInfo sbTestGStreamerComponents[] =
+{
+  {
+    SB_TEST_AUDIO_ANALYSIS_CLASSNAME,
+    SB_TEST_AUDIO_ANALYSIS_CID,
+    SB_TEST_AUDIO_ANALYSIS_CONTRACTID,
+    sbTestAudioAnalysisConstructor
+  },
+  {
+    SB_TEST_DSP_PIPELINE_CLASSNAME,
+    SB_TEST_DSP_PIPELINE_CID,
+    SB_TEST_DSP_PIPELINE_CONTRACTID,
+    sbTestDspPipelineConstructor
+  },
+  {
+    SB_TEST_CAPABILITY_INDEX_CLASSNAME,
+    SB_TEST_CAPABILITY_INDEX_CID,
+    SB_TEST_CAPABILITY_INDEX_CONTRACTID,
+    sbTestCapabilityIndexConstructor
+  }
+};
+
+NS_IMPL_NSGETMODULE(SongbirdTestGStreamer, sbTestGStreamerComponents)
@@ -0,0 +1,170 @@
+/* vim: set sw=2 : miv*/
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2010 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+/**
+ * \brief Test that the audio analysis kernels measure generated signals of
+ *        known loudness and tempo correctly, and that the audio analyzer
+ *        writes ReplayGain track and album properties for some short sample
+ *        files.
+ */
+
+Components.utils.import("resource://gre/modules/XPCOMUtils.jsm");
+
+if (typeof(Cc) == "undefined")
+  this.Cc = Components.classes;
+if (typeof(Ci) == "undefined")
+  this.Ci = Components.interfaces;
+
+var TEST_FILES = newAppRelativeFile("testharness/gstreamer/files");
+
+const K_FILES = ["simple.ogg", "surround51.ogg"];
+
+const SBProperties = {
+  trackGain: "http://songbirdnest.com/data/1.0#replayGainTrackGain",
+  trackPeak: "http://songbirdnest.com/data/1.0#replayGainTrackPeak",
+  albumGain: "http://songbirdnest.com/data/1.0#replayGainAlbumGain",
+  albumPeak: "http://songbirdnest.com/data/1.0#replayGainAlbumPeak",
+  albumName: "http://songbirdnest.com/data/1.0#albumName"
+};
+
+function checkGain(item, prop) {
+  var value = item.getProperty(prop);
+  assertTrue(value, prop + " was not set");
+  var gain = parseFloat(value);
+  assertTrue(!isNaN(gain) && gain > -50 && gain < 60,
+             prop + " has an unreasonable value " + value);
+  return gain;
+}
+
+function checkPeak(item, prop) {
+  var value = item.getProperty(prop);
+  assertTrue(value, prop + " was not set");
+  var peak = parseFloat(value);
+  assertTrue(peak > 0 && peak <= 1.5,
+             prop + " has an unreasonable value " + value);
+  return peak;
+}
+
+function testGeneratedSignals() {
+  var analysis = Cc["@songbirdnest.com/mediacore/sbTestAudioAnalysis;1"]
+                   .createInstance(Ci.sbITestAudioAnalysis);
+
+  // A full scale 1 kHz sine is 14.17 dB louder than the pink noise reference
+  var fullScale = analysis.replayGainOfSine(1000, 1.0, 5000);
+  assertTrue(Math.abs(fullScale + 14.17) <= 0.1,
+             "full scale sine gain " + fullScale);
+
+  // Each halving of the level needs 6.02 dB more gain
+  var level = 1.0;
+  var gain = fullScale;
+  for (var i = 0; i < 3; i++) {
+    level /= 2;
+    var quieter = analysis.replayGainOfSine(1000, level, 5000);
+    assertTrue(Math.abs(quieter - gain - 6.02) <= 0.05,
+               "gain at " + level + " was " + quieter);
+    gain = quieter;
+  }
+
+  // The equal loudness filter hears 440 Hz as quieter than 1 kHz
+  assertTrue(analysis.replayGainOfSine(440, 0.5, 5000) >
+             analysis.replayGainOfSine(1000, 0.5, 5000),
+             "440 Hz was not weighted down");
+
+  for each (let bpm in [70, 100, 120, 128, 140]) {
+    let tempo = analysis.tempoOfClicks(bpm, 30000);
+    assertTrue(Math.abs(tempo - bpm) <= 1,
+               "click track at " + bpm + " BPM measured " + tempo);
+  }
+
+  // Too short to measure
+  assertEqual(analysis.tempoOfClicks(120, 2000), 0);
+}
+
+function runTest() {
+  testGeneratedSignals();
+
+  var library = createLibrary("test_audio_analysis");
+
+  var ioService = Cc["@mozilla.org/network/io-service;1"]
+                    .getService(Ci.nsIIOService);
+
+  var items = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+                .createInstance(Ci.nsIMutableArray);
+  for each (var filename in K_FILES) {
+    var file = TEST_FILES.clone();
+    file.append(filename);
+
+    var item = library.createMediaItem(ioService.newFileURI(file, false));
+    item.setProperty(SBProperties.albumName, "test_audio_analysis");
+    items.appendElement(item, false);
+  }
+
+  var analyzer =
+    Cc["@songbirdnest.com/Songbird/Mediacore/GStreamer/AudioAnalyzer;1"]
+      .createInstance(Ci.sbIGStreamerAudioAnalyzer);
+  assertTrue(analyzer, "failed to create analyzer");
+  assertTrue(analyzer.maxConcurrentItems > 0,
+             "analyzer should run at least one item at a time");
+
+  var listener = {
+    onJobProgress: function(job) {
+      if (job.status == Ci.sbIJobProgress.STATUS_RUNNING)
+        return;
+
+      job.removeJobProgressListener(this);
+
+      assertEqual(Ci.sbIJobProgress.STATUS_SUCCEEDED, job.status);
+      assertEqual(K_FILES.length, job.progress);
+
+      var albumPeak = 0;
+      for (var i = 0; i < items.length; i++) {
+        var item = items.queryElementAt(i, Ci.sbIMediaItem);
+        checkGain(item, SBProperties.trackGain);
+        albumPeak = Math.max(albumPeak,
+                             checkPeak(item, SBProperties.trackPeak));
+      }
+
+      // Both items are on the same album, so share the album values; the
+      // album peak is the loudest of the track peaks.
+      var first = items.queryElementAt(0, Ci.sbIMediaItem);
+      var second = items.queryElementAt(1, Ci.sbIMediaItem);
+      checkGain(first, SBProperties.albumGain);
+      assertEqual(first.getProperty(SBProperties.albumGain),
+                  second.getProperty(SBProperties.albumGain));
+      assertEqual(albumPeak, checkPeak(first, SBProperties.albumPeak));
+
+      analyzer = null;
+      testFinished();
+    },
+
+    QueryInterface: XPCOMUtils.generateQI([Ci.sbIJobProgressListener])
+  };
+
+  var job = analyzer.QueryInterface(Ci.sbIJobProgress);
+  job.addJobProgressListener(listener);
+  analyzer.analyzeItems(items);
+
+  testPending();
+}
@@ -0,0 +1,125 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+ * \brief Test the sbdspchain element offline: run a test tone through it into
+ *        a fakesink and check the limiter's ceiling and the statistics it
+ *        posts.
+ */
+
+const RATE = 44100;
+
+// audiotestsrc buffers of 10 ms, so that each buffer is one envelope entry
+const SAMPLES_PER_BUFFER = RATE / 100;
+
+function createPipeline() {
+  return Cc["@songbirdnest.com/mediacore/sbTestDspPipeline;1"]
+           .createInstance(Ci.sbITestDspPipeline);
+}
+
+/**
+ * Describe a pipeline playing a 1 kHz tone of the given volume for the given
+ * length in ms through the chain with the given properties
+ */
+function describe(volume, length, dspProperties) {
+  return "audiotestsrc freq=1000 volume=" + volume +
+         " samplesperbuffer=" + SAMPLES_PER_BUFFER +
+         " num-buffers=" + (length / 10) +
+         " ! audioconvert" +
+         " ! audio/x-raw-float,width=32,rate=" + RATE + ",channels=2" +
+         " ! sbdspchain name=dsp " + dspProperties +
+         " ! fakesink name=sink";
+}
+
+function assertClose(actual, expected, tolerance, message) {
+  assertTrue(Math.abs(actual - expected) <= tolerance,
+             message + ": expected " + expected + ", got " + actual);
+}
+
+function testLimiter() {
+  var pipeline = createPipeline();
+  var ceiling = Math.pow(10, -6 / 20);
+
+  // A full scale tone is held at the ceiling
+  pipeline.run(describe(1.0, 3000,
+                        "stages=limiter limiter-threshold=-6 " +
+                        "stats-interval=1000"));
+
+  // The lookahead held back at EOS comes out too
+  assertEqual(pipeline.framesOut, pipeline.framesIn,
+              "frames lost in the limiter");
+
+  assertTrue(pipeline.peak <= ceiling * 1.0001,
+             "peak " + pipeline.peak + " above the ceiling " + ceiling);
+
+  var envelope = pipeline.getEnvelope({});
+  // Skip the delay and the first peak's attack
+  for (var i = 2; i < envelope.length - 1; i++) {
+    assertClose(envelope[i], ceiling, ceiling * 0.02,
+                "level at " + (i * 10) + " ms");
+  }
+
+  // A tone under the ceiling goes through untouched
+  pipeline.run(describe(0.25, 1000, "stages=limiter limiter-threshold=-6"));
+  assertEqual(pipeline.framesOut, pipeline.framesIn,
+              "frames lost in the limiter");
+  assertClose(pipeline.peak, 0.25, 0.0025, "untouched peak");
+}
+
+function testStats() {
+  var pipeline = createPipeline();
+
+  pipeline.run(describe(0.5, 3000,
+                        "stages=dynamic-eq,limiter stats-interval=1000"));
+
+  // One message per second of audio
+  assertEqual(pipeline.statsCount, 3);
+
+  var stats = pipeline.stats;
+  assertTrue(stats, "no statistics");
+  assertEqual(stats.getPropertyAsUint64("frames"), RATE);
+  assertEqual(stats.getPropertyAsUint64("duration"), 1000000000);
+  assertTrue(["thread-cpu", "wall"].indexOf(
+               stats.getPropertyAsACString("clock")) >= 0,
+             "unknown clock " + stats.getPropertyAsACString("clock"));
+
+  for each (let stage in ["dynamic-eq", "limiter"]) {
+    let time = stats.getPropertyAsUint64(stage + "-time");
+    let load = stats.getPropertyAsDouble(stage + "-load");
+    assertTrue(time < 1000000000, stage + " took longer than the audio");
+    assertClose(load, time / 1000000000, 1e-6, stage + " load");
+  }
+
+  // Without an interval there are none
+  pipeline.run(describe(0.5, 1000, "stages=limiter"));
+  assertEqual(pipeline.statsCount, 0);
+  assertEqual(pipeline.stats, null);
+}
+
+function runTest() {
+  testLimiter();
+  testStats();
+}
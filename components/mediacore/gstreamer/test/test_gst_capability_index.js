@@ -0,0 +1,135 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+ * \brief Test the capability index the GStreamer service saves to the
+ *        profile: it must survive a save and load, be rejected when the
+ *        registry stamp changes, and pick the same elements as walking the
+ *        registry does.
+ */
+
+// Pairs of source caps and element class to look up
+const LOOKUPS = [
+  ["application/ogg", "Muxer"],
+  ["video/x-matroska", "Muxer"],
+  ["audio/x-vorbis", "Encoder"],
+  ["audio/x-flac", "Encoder"],
+  ["audio/mpeg, mpegversion=(int)1, layer=(int)3", "Encoder"],
+  ["audio/mpeg, mpegversion=(int)4", "Encoder"],
+  ["video/x-theora", "Encoder"],
+  ["application/x-id3", "Formatter"],
+  ["audio/x-no-such-format", "Encoder"]
+];
+
+function createIndex() {
+  return Cc["@songbirdnest.com/mediacore/sbTestCapabilityIndex;1"]
+           .createInstance(Ci.sbITestCapabilityIndex);
+}
+
+function getIndexFile() {
+  var file = Cc["@mozilla.org/file/directory_service;1"]
+               .getService(Ci.nsIProperties)
+               .get("ProfD", Ci.nsIFile);
+  file.append("test-gst-capability-index.dat");
+  return file;
+}
+
+function testRoundTrip(aFile) {
+  var built = createIndex();
+  built.buildAndSave(aFile, "stamp-1");
+  assertTrue(aFile.exists(), "index file should have been saved");
+  assertFalse(built.isEmpty, "built index should not be empty");
+
+  var loaded = createIndex();
+  assertTrue(loaded.load(aFile, "stamp-1"),
+             "index should load with the stamp it was saved with");
+  assertFalse(loaded.isEmpty, "loaded index should not be empty");
+
+  for each (let plugin in ["coreelements", "typefindfunctions", "nosuchplugin"]) {
+    assertEqual(loaded.hasPlugin(plugin), built.hasPlugin(plugin),
+                "plugin " + plugin + " should survive the round trip");
+  }
+  assertTrue(loaded.hasPlugin("coreelements"),
+             "coreelements should be in the index");
+
+  for each (let prefix in ["audio/", "video/", "application/ogg"]) {
+    assertEqual(loaded.getTypeFindExtensions(prefix).sort().join(","),
+                built.getTypeFindExtensions(prefix).sort().join(","),
+                "typefind extensions for " + prefix +
+                " should survive the round trip");
+  }
+
+  for each (let [caps, type] in LOOKUPS) {
+    assertEqual(loaded.findMatchingElementName(caps, type),
+                built.findMatchingElementName(caps, type),
+                "lookup of " + type + " for " + caps +
+                " should survive the round trip");
+  }
+}
+
+function testStampMismatch(aFile) {
+  var index = createIndex();
+  assertFalse(index.load(aFile, "stamp-2"),
+              "index saved with another stamp should be rejected");
+  assertTrue(index.isEmpty, "rejected index should be left empty");
+  assertFalse(index.hasPlugin("coreelements"),
+              "rejected index should not answer from the file");
+
+  var missing = aFile.clone();
+  missing.leafName = "test-gst-capability-index-missing.dat";
+  assertFalse(index.load(missing, "stamp-1"),
+              "missing index file should be rejected");
+}
+
+function testMatchesRegistry(aFile) {
+  var index = createIndex();
+  assertTrue(index.load(aFile, "stamp-1"), "index should load");
+
+  for each (let [caps, type] in LOOKUPS) {
+    assertEqual(index.findMatchingElementName(caps, type),
+                index.findRegistryElementName(caps, type),
+                "index and registry should agree on the " + type +
+                " for " + caps);
+  }
+}
+
+function runTest() {
+  var file = getIndexFile();
+  if (file.exists()) {
+    file.remove(false);
+  }
+
+  try {
+    testRoundTrip(file);
+    testStampMismatch(file);
+    testMatchesRegistry(file);
+  }
+  finally {
+    if (file.exists()) {
+      file.remove(false);
+    }
+  }
+}
@@ -57,7 +57,8 @@ function runTest() {
 
   var platform = getPlatform();
 
-  assertContains(list, ["staticelements", "ogg", "vorbis", "mozilla"]);
+  assertContains(list, ["staticelements", "ogg", "vorbis", "mozilla",
+                        "sbdsp"]);
 
   switch (platform) {
     case "Windows_NT":
@@ -0,0 +1,104 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2008 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+ * \brief Test that the GStreamer mediacore prefetches local files only, and
+ *        that shutting it down doesn't wait for a prefetch in progress.
+ */
+
+var TEST_FILES = newAppRelativeFile("testharness/gstreamer/files");
+
+function createMediacore(aName) {
+  var factory = Cc["@songbirdnest.com/Songbird/Mediacore/GStreamerMediacoreFactory;1"]
+                  .getService(Ci.sbIMediacoreFactory);
+  return factory.create(aName).QueryInterface(Ci.sbIGStreamerMediacore);
+}
+
+function getFileURI(aFileName) {
+  var file = TEST_FILES.clone();
+  file.append(aFileName);
+  return newFileURI(file);
+}
+
+function waitForPrefetchCount(aCore, aCount) {
+  var start = Date.now();
+  while (aCore.prefetchCount < aCount && Date.now() - start < 10000) {
+    sleep(50, true);
+  }
+}
+
+function testPrefetch() {
+  var core = createMediacore("test_prefetch");
+
+  // Misses: a URI that isn't a local file and a file that doesn't exist are
+  // not prefetched.
+  core.prefetch(newURI("http://localhost/simple.ogg"));
+  core.prefetch(getFileURI("nonexistent.ogg"));
+
+  // Hit: a local file is prefetched.  The prefetches run in order, so the
+  // misses are done once it has completed.
+  core.prefetch(getFileURI("simple.ogg"));
+  waitForPrefetchCount(core, 1);
+  assertEqual(core.prefetchCount, 1);
+
+  // Prefetching the same file again does nothing.
+  core.prefetch(getFileURI("simple.ogg"));
+  core.prefetch(getFileURI("video.ogg"));
+  waitForPrefetchCount(core, 2);
+  assertEqual(core.prefetchCount, 2);
+
+  core.QueryInterface(Ci.sbIMediacore).shutdown();
+}
+
+function testShutdownDuringPrefetch() {
+  var core = createMediacore("test_prefetch_shutdown");
+
+  // Shut down with prefetches queued.  This must not wait for them, and they
+  // are cancelled.
+  core.prefetch(getFileURI("surround51.ogg"));
+  core.prefetch(getFileURI("video.ogg"));
+  core.QueryInterface(Ci.sbIMediacore).shutdown();
+  var count = core.prefetchCount;
+  assertTrue(count <= 1, "Prefetches ran after shutdown");
+
+  // Let the prefetch thread shut itself down, then check nothing else ran.
+  sleep(500, true);
+  assertEqual(core.prefetchCount, count);
+
+  // Nothing is prefetched after shutdown.
+  var prefetchFailed = false;
+  try {
+    core.prefetch(getFileURI("simple.ogg"));
+  } catch (e) {
+    prefetchFailed = true;
+  }
+  assertTrue(prefetchFailed, "Prefetch after shutdown did not fail");
+}
+
+function runTest() {
+  testPrefetch();
+  testShutdownDuringPrefetch();
+}
@@ -28,6 +28,12 @@
 #ifndef __SB_MEDIACOREDATAREMOTES_H__
 #define __SB_MEDIACOREDATAREMOTES_H__
 
+/**
+ * Root the data remotes below are created under; keys registered with the
+ * data remote hub are fully qualified.
+ */
+#define SB_MEDIACORE_DATAREMOTE_ROOT "songbird."
+
 /**
  * Faceplate DataRemotes
  */
@@ -26,6 +26,7 @@
 #include "sbMediacoreManager.h"
 
 #include <nsIAppStartupNotifier.h>
+#include <nsIChannel.h>
 #include <nsIClassInfoImpl.h>
 #include <nsIDOMDocument.h>
 #include <nsIDOMElement.h>
@@ -37,6 +38,7 @@
 #include <nsIProgrammingLanguage.h>
 #include <nsISupportsPrimitives.h>
 #include <nsIThread.h>
+#include <nsIURL.h>
 
 #include <nsArrayUtils.h>
 #include <nsAutoLock.h>
@@ -77,6 +79,7 @@
 /* default size of hashtable for active core instances */
 #define SB_CORE_HASHTABLE_SIZE    (4)
 #define SB_FACTORY_HASHTABLE_SIZE (4)
+#define SB_VOTING_CACHE_SIZE      (16)
 
 /* default base instance name */
 #define SB_CORE_BASE_NAME   "mediacore"
@@ -141,6 +144,8 @@ NS_IMPL_THREADSAFE_CI(sbMediacoreManager)
 sbMediacoreManager::sbMediacoreManager()
 : mMonitor(nsnull)
 , mLastCore(0)
+, mVotingCacheHits(0)
+, mVotingCacheMisses(0)
 , mFullscreen(PR_FALSE)
 , mVideoWindowMonitor(nsnull)
 , mLastVideoWindow(0)
@@ -232,6 +237,12 @@ sbMediacoreManager::Init()
   success = mFactories.Init(SB_FACTORY_HASHTABLE_SIZE);
   NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
 
+  success = mCoreFactories.Init(SB_CORE_HASHTABLE_SIZE);
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+  success = mVotingCache.Init(SB_VOTING_CACHE_SIZE);
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
   // Register all factories.
   nsresult rv = NS_ERROR_UNEXPECTED;
 
@@ -407,6 +418,8 @@ sbMediacoreManager::Shutdown()
 
   mFactories.Clear();
   mCores.Clear();
+  mCoreFactories.Clear();
+  mVotingCache.Clear();
 
   return NS_OK;
 }
@@ -445,6 +458,62 @@ sbMediacoreManager::VoteWithURIOrChannel(nsIURI *aURI,
   nsresult rv = votingChain->Init();
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Items of the same kind get the same votes, so skip asking the cores
+  // (and creating new ones just to ask them) when the answer is cached.
+  nsString cacheKey;
+  rv = GetVotingCacheKey(aURI, aChannel, cacheKey);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if(!cacheKey.IsEmpty()) {
+    VotingCacheEntries cachedVotes;
+    PRBool cached = PR_FALSE;
+
+    nsAutoMonitor mon(mMonitor);
+
+    VotingCacheEntries *entries = nsnull;
+    if(mVotingCache.Get(cacheKey, &entries) && entries) {
+      cached = PR_TRUE;
+      cachedVotes = *entries;
+      ++mVotingCacheHits;
+    }
+    else {
+      ++mVotingCacheMisses;
+    }
+
+    LOG(("[sbMediacoreManager] - Voting cache %s, hit rate %u/%u",
+         cached ? "hit" : "miss",
+         mVotingCacheHits,
+         mVotingCacheHits + mVotingCacheMisses));
+
+    mon.Exit();
+
+    if(cached) {
+      rv = VoteFromCache(cachedVotes, votingChain);
+      if(NS_SUCCEEDED(rv)) {
+        NS_ADDREF(*_retval = votingChain);
+        return NS_OK;
+      }
+
+      // A core could not be created; forget the votes and vote again.
+      mon.Enter();
+      mVotingCache.Remove(cacheKey);
+      mon.Exit();
+
+      NS_NEWXPCOM(votingChain, sbMediacoreVotingChain);
+      NS_ENSURE_TRUE(votingChain, NS_ERROR_OUT_OF_MEMORY);
+
+      rv = votingChain->Init();
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
+  // The votes cast below, to be cached if every voter's factory is known
+  nsAutoPtr<VotingCacheEntries> votes;
+  if(!cacheKey.IsEmpty()) {
+    votes = new VotingCacheEntries();
+    NS_ENSURE_TRUE(votes, NS_ERROR_OUT_OF_MEMORY);
+  }
+
   nsCOMPtr<nsIArray> instances;
 
   // First go through the active instances to see if one of them
@@ -482,12 +551,39 @@ sbMediacoreManager::VoteWithURIOrChannel(nsIURI *aURI,
       NS_ENSURE_SUCCESS(rv, rv);
 
       ++found;
+
+      if(votes) {
+        nsString instanceName;
+        rv = mediacore->GetInstanceName(instanceName);
+        NS_ENSURE_SUCCESS(rv, rv);
+
+        nsCOMPtr<sbIMediacoreFactory> factory;
+        nsAutoMonitor mon(mMonitor);
+        if(mCoreFactories.Get(instanceName, getter_AddRefs(factory)) &&
+           factory) {
+          VotingCacheEntry *entry = votes->AppendElement();
+          NS_ENSURE_TRUE(entry, NS_ERROR_OUT_OF_MEMORY);
+          entry->factory = factory;
+          entry->result = result;
+        }
+        else {
+          // Without its factory this vote can't be replayed.
+          votes = nsnull;
+        }
+      }
     }
   }
 
   // Always prefer already instantiated objects, even if they may potentially
   // have a lower rank than registered factories.
   if(found) {
+    if(votes) {
+      nsAutoMonitor mon(mMonitor);
+      PRBool success = mVotingCache.Put(cacheKey, votes);
+      NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+      votes.forget();
+    }
+
     NS_ADDREF(*_retval = votingChain);
     return NS_OK;
   }
@@ -542,14 +638,174 @@ sbMediacoreManager::VoteWithURIOrChannel(nsIURI *aURI,
     if(result > 0) {
       rv = votingChain->AddVoteResult(result, mediacore);
       NS_ENSURE_SUCCESS(rv, rv);
+
+      if(votes) {
+        VotingCacheEntry *entry = votes->AppendElement();
+        NS_ENSURE_TRUE(entry, NS_ERROR_OUT_OF_MEMORY);
+        entry->factory = factory;
+        entry->result = result;
+      }
     }
   }
 
+  if(votes) {
+    nsAutoMonitor mon(mMonitor);
+    PRBool success = mVotingCache.Put(cacheKey, votes);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+    votes.forget();
+  }
+
   NS_ADDREF(*_retval = votingChain);
 
   return NS_OK;
 }
 
+nsresult
+sbMediacoreManager::GetVotingCacheKey(nsIURI *aURI,
+                                      nsIChannel *aChannel,
+                                      nsAString &aKey)
+{
+  TRACE(("sbMediacoreManager[0x%x] - GetVotingCacheKey", this));
+
+  aKey.Truncate();
+
+  nsresult rv = NS_ERROR_UNEXPECTED;
+  nsCOMPtr<nsIURI> uri = aURI;
+
+  nsCString contentType;
+  if(aChannel) {
+    if(!uri) {
+      rv = aChannel->GetURI(getter_AddRefs(uri));
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+
+    // Not every channel knows its content type before it is opened.
+    rv = aChannel->GetContentType(contentType);
+    if(NS_FAILED(rv)) {
+      contentType.Truncate();
+    }
+  }
+  NS_ENSURE_TRUE(uri, NS_ERROR_UNEXPECTED);
+
+  nsCString scheme;
+  rv = uri->GetScheme(scheme);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCString extension;
+  nsCOMPtr<nsIURL> url = do_QueryInterface(uri, &rv);
+  if(NS_SUCCEEDED(rv)) {
+    rv = url->GetFileExtension(extension);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  if(extension.IsEmpty() && contentType.IsEmpty()) {
+    return NS_OK;
+  }
+
+  ToLowerCase(extension);
+
+  nsCString key(scheme);
+  key.Append('|');
+  key.Append(extension);
+  key.Append('|');
+  key.Append(contentType);
+
+  CopyUTF8toUTF16(key, aKey);
+
+  return NS_OK;
+}
+
+nsresult
+sbMediacoreManager::VoteFromCache(const VotingCacheEntries &aVotes,
+                                  sbMediacoreVotingChain *aVotingChain)
+{
+  TRACE(("sbMediacoreManager[0x%x] - VoteFromCache", this));
+  NS_ENSURE_ARG_POINTER(aVotingChain);
+
+  nsresult rv = NS_ERROR_UNEXPECTED;
+
+  for(PRUint32 current = 0; current < aVotes.Length(); ++current) {
+    nsCOMPtr<sbIMediacore> mediacore;
+    rv = GetMediacoreForFactory(aVotes[current].factory,
+                                getter_AddRefs(mediacore));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = aVotingChain->AddVoteResult(aVotes[current].result, mediacore);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+struct sbMediacoreFindCoreArgs
+{
+  sbIMediacoreFactory *factory;
+  nsString instanceName;
+};
+
+/* static */ PLDHashOperator
+sbMediacoreManager::FindCoreByFactory(const nsAString& aKey,
+                                      sbIMediacoreFactory* aData,
+                                      void* aUserArg)
+{
+  sbMediacoreFindCoreArgs *args =
+    static_cast<sbMediacoreFindCoreArgs *>(aUserArg);
+
+  if(aData == args->factory) {
+    args->instanceName = aKey;
+    return PL_DHASH_STOP;
+  }
+
+  return PL_DHASH_NEXT;
+}
+
+nsresult
+sbMediacoreManager::GetMediacoreForFactory(sbIMediacoreFactory *aFactory,
+                                           sbIMediacore **_retval)
+{
+  TRACE(("sbMediacoreManager[0x%x] - GetMediacoreForFactory", this));
+  NS_ENSURE_TRUE(mMonitor, NS_ERROR_NOT_INITIALIZED);
+  NS_ENSURE_ARG_POINTER(aFactory);
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  nsresult rv = NS_ERROR_UNEXPECTED;
+
+  nsAutoMonitor mon(mMonitor);
+
+  // Like voting, prefer the core that is already playing.
+  if(mPrimaryCore) {
+    nsString instanceName;
+    rv = mPrimaryCore->GetInstanceName(instanceName);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsCOMPtr<sbIMediacoreFactory> factory;
+    if(mCoreFactories.Get(instanceName, getter_AddRefs(factory)) &&
+       factory == aFactory) {
+      NS_ADDREF(*_retval = mPrimaryCore);
+      return NS_OK;
+    }
+  }
+
+  sbMediacoreFindCoreArgs args;
+  args.factory = aFactory;
+  mCoreFactories.EnumerateRead(sbMediacoreManager::FindCoreByFactory, &args);
+
+  if(!args.instanceName.IsEmpty() &&
+     mCores.Get(args.instanceName, _retval) && *_retval) {
+    return NS_OK;
+  }
+
+  mon.Exit();
+
+  nsString mediacoreInstanceName;
+  GenerateInstanceName(mediacoreInstanceName);
+
+  rv = CreateMediacoreWithFactory(aFactory, mediacoreInstanceName, _retval);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
 // ----------------------------------------------------------------------------
 // sbBaseMediacoreMultibandEqualizer overrides
 // ----------------------------------------------------------------------------
@@ -1473,6 +1729,32 @@ sbMediacoreManager::SetPrimaryCore(sbIMediacore * aPrimaryCore)
   return NS_OK;
 }
 
+NS_IMETHODIMP
+sbMediacoreManager::GetVotingCacheHits(PRUint32 *aVotingCacheHits)
+{
+  TRACE(("sbMediacoreManager[0x%x] - GetVotingCacheHits", this));
+  NS_ENSURE_TRUE(mMonitor, NS_ERROR_NOT_INITIALIZED);
+  NS_ENSURE_ARG_POINTER(aVotingCacheHits);
+
+  nsAutoMonitor mon(mMonitor);
+  *aVotingCacheHits = mVotingCacheHits;
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbMediacoreManager::GetVotingCacheMisses(PRUint32 *aVotingCacheMisses)
+{
+  TRACE(("sbMediacoreManager[0x%x] - GetVotingCacheMisses", this));
+  NS_ENSURE_TRUE(mMonitor, NS_ERROR_NOT_INITIALIZED);
+  NS_ENSURE_ARG_POINTER(aVotingCacheMisses);
+
+  nsAutoMonitor mon(mMonitor);
+  *aVotingCacheMisses = mVotingCacheMisses;
+
+  return NS_OK;
+}
+
 // ----------------------------------------------------------------------------
 // sbIMediacoreFactoryRegistrar Interface
 // ----------------------------------------------------------------------------
@@ -1574,6 +1856,9 @@ sbMediacoreManager::CreateMediacore(const nsAString & aContractID,
   PRBool success = mCores.Put(aInstanceName, *_retval);
   NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
 
+  success = mCoreFactories.Put(aInstanceName, coreFactory);
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
   return NS_OK;
 }
 
@@ -1598,9 +1883,14 @@ sbMediacoreManager::CreateMediacoreWithFactory(sbIMediacoreFactory *aFactory,
   rv = aFactory->Create(aInstanceName, _retval);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  nsAutoMonitor mon(mMonitor);
+
   PRBool success = mCores.Put(aInstanceName, *_retval);
   NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
 
+  success = mCoreFactories.Put(aInstanceName, aFactory);
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
   return NS_OK;
 }
 
@@ -1643,6 +1933,7 @@ sbMediacoreManager::DestroyMediacore(const nsAString & aInstanceName)
   NS_ENSURE_SUCCESS(rv, rv);
 
   mCores.Remove(aInstanceName);
+  mCoreFactories.Remove(aInstanceName);
 
   return NS_OK;
 }
@@ -1659,6 +1950,9 @@ sbMediacoreManager::RegisterFactory(sbIMediacoreFactory *aFactory)
   PRBool success = mFactories.Put(aFactory, aFactory);
   NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
 
+  // The new factory may vote higher than the cached winners.
+  mVotingCache.Clear();
+
   return NS_OK;
 }
 
@@ -1673,6 +1967,9 @@ sbMediacoreManager::UnregisterFactory(sbIMediacoreFactory *aFactory)
 
   mFactories.Remove(aFactory);
 
+  // Cached votes may refer to the factory.
+  mVotingCache.Clear();
+
   return NS_OK;
 }
 
@@ -28,6 +28,7 @@
 #include <sbIMediacoreManager.h>
 
 #include <nsAutoPtr.h>
+#include <nsClassHashtable.h>
 #include <nsIClassInfo.h>
 #include <nsIDOMEvent.h>
 #include <nsIDOMEventListener.h>
@@ -36,6 +37,7 @@
 #include <nsIObserver.h>
 
 #include <nsHashKeys.h>
+#include <nsTArray.h>
 #include <prmon.h>
 
 // Interfaces
@@ -52,6 +54,7 @@
 
 // Forward declared classes
 class sbBaseMediacoreEventTarget;
+class sbMediacoreVotingChain;
 
 class sbMediacoreManager : public sbBaseMediacoreMultibandEqualizer,
                            public sbBaseMediacoreVolumeControl,
@@ -134,12 +137,47 @@ protected:
                                 nsIChannel *aChannel,
                                 sbIMediacoreVotingChain **_retval);
 
+  // A vote remembered by the voting cache
+  struct VotingCacheEntry {
+    nsCOMPtr<sbIMediacoreFactory> factory;
+    PRUint32 result;
+  };
+  typedef nsTArray<VotingCacheEntry> VotingCacheEntries;
+
+  // Build the voting cache key for aURI or aChannel. The key is left empty
+  // when there is nothing but the scheme to tell URIs apart.
+  nsresult GetVotingCacheKey(nsIURI *aURI,
+                             nsIChannel *aChannel,
+                             nsAString &aKey);
+
+  // Fill aVotingChain from cached votes, with one core per factory.
+  nsresult VoteFromCache(const VotingCacheEntries &aVotes,
+                         sbMediacoreVotingChain *aVotingChain);
+
+  // Get a live core made by aFactory, preferring the primary core, or
+  // create one.
+  nsresult GetMediacoreForFactory(sbIMediacoreFactory *aFactory,
+                                  sbIMediacore **_retval);
+
+  static NS_HIDDEN_(PLDHashOperator)
+    FindCoreByFactory(const nsAString& aKey,
+                      sbIMediacoreFactory* aData,
+                      void* aUserArg);
+
   PRMonitor* mMonitor;
   PRUint32   mLastCore;
 
   nsInterfaceHashtableMT<nsStringHashKey, sbIMediacore> mCores;
   nsInterfaceHashtableMT<nsISupportsHashKey, sbIMediacoreFactory> mFactories;
 
+  // The factory each core was created with, by instance name
+  nsInterfaceHashtableMT<nsStringHashKey, sbIMediacoreFactory> mCoreFactories;
+
+  // Winning factories and their votes, by scheme, extension and MIME type
+  nsClassHashtableMT<nsStringHashKey, VotingCacheEntries> mVotingCache;
+  PRUint32 mVotingCacheHits;
+  PRUint32 mVotingCacheMisses;
+
   nsCOMPtr<sbIMediacore>                mPrimaryCore;
   nsCOMPtr<sbIMediacoreSequencer>       mSequencer;
   nsAutoPtr<sbBaseMediacoreEventTarget> mBaseEventTarget;
@@ -99,4 +99,19 @@ static nsModuleComponentInfo sbMediacoreManagerComponents[] =
   }
 };
 
-NS_IMPL_NSGETMODULE(SongbirdMediacoreManager, sbMediacoreManagerComponents)
+PR_STATIC_CALLBACK(nsresult)
+sbMediacoreManagerModuleConstructor(nsIModule* aSelf)
+{
+  return sbMediacoreTypeSniffer::InitContentTypeCache();
+}
+
+PR_STATIC_CALLBACK(void)
+sbMediacoreManagerModuleDestructor(nsIModule* aSelf)
+{
+  sbMediacoreTypeSniffer::ShutdownContentTypeCache();
+}
+
+NS_IMPL_NSGETMODULE_WITH_CTOR_DTOR(SongbirdMediacoreManager,
+                                   sbMediacoreManagerComponents,
+                                   sbMediacoreManagerModuleConstructor,
+                                   sbMediacoreManagerModuleDestructor)
@@ -51,6 +51,7 @@
 #include <prtime.h>
 
 #include <sbICascadeFilterSet.h>
+#include <sbIDataRemoteHub.h>
 #include <sbIFilterableMediaListView.h>
 #include <sbILibrary.h>
 #include <sbILibraryConstraints.h>
@@ -438,6 +439,29 @@ sbMediacoreSequencer::BindDataRemotes()
   // Metadata DataRemotes
   //
 
+  // The duration and position remotes are rewritten on every position
+  // update. Keep them in memory only instead of in the preferences.
+  {
+    static const char* const volatileKeys[] = {
+      SB_MEDIACORE_DATAREMOTE_METADATA_LENGTH,
+      SB_MEDIACORE_DATAREMOTE_METADATA_LENGTH_STR,
+      SB_MEDIACORE_DATAREMOTE_METADATA_POSITION,
+      SB_MEDIACORE_DATAREMOTE_METADATA_POSITION_STR,
+      SB_MEDIACORE_DATAREMOTE_METADATA_REMAINING_STR
+    };
+
+    nsCOMPtr<sbIDataRemoteHub> hub =
+      do_GetService(SB_DATAREMOTEHUB_CONTRACTID, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    for (PRUint32 i = 0; i < NS_ARRAY_LENGTH(volatileKeys); ++i) {
+      nsString key(NS_LITERAL_STRING(SB_MEDIACORE_DATAREMOTE_ROOT));
+      key.AppendLiteral(volatileKeys[i]);
+      rv = hub->ManageKey(key, PR_FALSE);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+  }
+
   // Metadata Album
   mDataRemoteMetadataAlbum =
     do_CreateInstance("@songbirdnest.com/Songbird/DataRemote;1", &rv);
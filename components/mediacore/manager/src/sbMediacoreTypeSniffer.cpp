@@ -26,11 +26,14 @@
 
 #include "sbMediacoreTypeSniffer.h"
 
+#include <nsIFileURL.h>
+#include <nsILocalFile.h>
 #include <nsIURI.h>
 #include <nsIURL.h>
 
 #include <nsAutoLock.h>
 #include <nsArrayUtils.h>
+#include <nsAutoPtr.h>
 #include <nsComponentManagerUtils.h>
 #include <nsMemory.h>
 #include <nsServiceManagerUtils.h>
@@ -44,10 +47,310 @@
 #include <sbProxiedComponentManager.h>
 #include <sbStringUtils.h>
 
+#include <prio.h>
+#include <string.h>
+
 const char *gBannedWebExtensions[] = {"htm", "html", "php", "php3"};
 const PRUint16 gBannedWebExtensionsSize =
   sizeof(gBannedWebExtensions) / sizeof(gBannedWebExtensions[0]);
 
+// Extensions of formats that SniffContentType recognizes. Files with these
+// extensions that do not hold recognizable content are not media.
+const char *gSniffedExtensions[] = {"mp3", "flac", "ogg", "oga", "ogv",
+                                    "m4a", "m4b", "m4p", "m4v", "mp4",
+                                    "mov", "3gp", "wav", "avi", "wma",
+                                    "wmv", "asf", "mkv", "mka", "webm"};
+const PRUint16 gSniffedExtensionsSize =
+  sizeof(gSniffedExtensions) / sizeof(gSniffedExtensions[0]);
+
+// How much of a file is read to sniff its content type
+#define SB_TYPESNIFFER_SNIFF_SIZE 4096
+
+// Cached content types are dropped all at once when there are this many
+#define SB_TYPESNIFFER_CACHE_SIZE 4096
+
+PRLock* sbMediacoreTypeSniffer::sContentTypeCacheLock = nsnull;
+nsClassHashtable<nsStringHashKey,
+                 sbMediacoreTypeSniffer::ContentTypeCacheEntry>*
+  sbMediacoreTypeSniffer::sContentTypeCache = nsnull;
+
+//------------------------------------------------------------------------------
+// Content sniffing
+//------------------------------------------------------------------------------
+
+static PRBool
+HasBytesAt(const PRUint8* aBuffer,
+           PRUint32 aLength,
+           PRUint32 aOffset,
+           const char* aBytes,
+           PRUint32 aCount)
+{
+  return aOffset + aCount <= aLength &&
+         memcmp(aBuffer + aOffset, aBytes, aCount) == 0;
+}
+
+static PRBool
+ContainsBytes(const PRUint8* aBuffer,
+              PRUint32 aLength,
+              const char* aBytes,
+              PRUint32 aCount)
+{
+  for (PRUint32 offset = 0; offset + aCount <= aLength; ++offset) {
+    if (memcmp(aBuffer + offset, aBytes, aCount) == 0) {
+      return PR_TRUE;
+    }
+  }
+  return PR_FALSE;
+}
+
+// Bitrates in kbit/s by bitrate index for MPEG-1 layers I, II and III and
+// MPEG-2/2.5 layers I and II/III
+static const PRUint16 gMPEGBitrates[5][15] = {
+  { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+  { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+  { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+  { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+  { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+};
+
+// Sample rates by sample rate index for MPEG-1, MPEG-2 and MPEG-2.5
+static const PRUint32 gMPEGSampleRates[3][3] = {
+  { 44100, 48000, 32000 },
+  { 22050, 24000, 16000 },
+  { 11025, 12000, 8000 }
+};
+
+/**
+ * Return the length of the MPEG audio frame whose header is at aHeader, or 0
+ * if it is not a valid frame header.
+ */
+static PRUint32
+GetMPEGFrameLength(const PRUint8* aHeader)
+{
+  if (aHeader[0] != 0xFF || (aHeader[1] & 0xE0) != 0xE0) {
+    return 0;
+  }
+
+  PRUint32 version = (aHeader[1] >> 3) & 0x03;  // 0: 2.5, 2: 2, 3: 1
+  PRUint32 layer = (aHeader[1] >> 1) & 0x03;    // 1: III, 2: II, 3: I
+  PRUint32 bitrateIndex = aHeader[2] >> 4;
+  PRUint32 sampleRateIndex = (aHeader[2] >> 2) & 0x03;
+  PRUint32 padding = (aHeader[2] >> 1) & 0x01;
+  if (version == 1 || layer == 0 || bitrateIndex == 0 ||
+      bitrateIndex == 15 || sampleRateIndex == 3) {
+    return 0;
+  }
+
+  PRUint32 table;
+  if (version == 3) {
+    table = 3 - layer;
+  }
+  else {
+    table = layer == 3 ? 3 : 4;
+  }
+  PRUint32 bitrate = gMPEGBitrates[table][bitrateIndex] * 1000;
+  PRUint32 sampleRate =
+    gMPEGSampleRates[version == 3 ? 0 : (version == 2 ? 1 : 2)]
+                    [sampleRateIndex];
+
+  if (layer == 3) {
+    return (12 * bitrate / sampleRate + padding) * 4;
+  }
+  if (layer == 1 && version != 3) {
+    return 72 * bitrate / sampleRate + padding;
+  }
+  return 144 * bitrate / sampleRate + padding;
+}
+
+/**
+ * Look for MPEG audio frames in aBuffer. A frame counts if the frame after it
+ * is valid too, or if it starts the buffer and the buffer ends before the
+ * next frame.
+ */
+static PRBool
+HasMPEGFrames(const PRUint8* aBuffer, PRUint32 aLength)
+{
+  for (PRUint32 offset = 0; offset + 4 <= aLength; ++offset) {
+    PRUint32 frameLength = GetMPEGFrameLength(aBuffer + offset);
+    if (!frameLength) {
+      continue;
+    }
+    PRUint32 next = offset + frameLength;
+    if (next + 4 > aLength) {
+      if (offset == 0) {
+        return PR_TRUE;
+      }
+      continue;
+    }
+    if (GetMPEGFrameLength(aBuffer + next)) {
+      return PR_TRUE;
+    }
+  }
+  return PR_FALSE;
+}
+
+/**
+ * Get the MIME type of the content starting with aBuffer. aContentType is
+ * left empty if the content is not recognized. ID3v2 tags must have been
+ * skipped already.
+ */
+static void
+SniffContentType(const PRUint8* aBuffer,
+                 PRUint32 aLength,
+                 nsACString& aContentType)
+{
+  aContentType.Truncate();
+
+  // FLAC
+  if (HasBytesAt(aBuffer, aLength, 0, "fLaC", 4)) {
+    aContentType.AssignLiteral("audio/x-flac");
+    return;
+  }
+
+  // Ogg; Theora means video
+  if (HasBytesAt(aBuffer, aLength, 0, "OggS", 4)) {
+    if (ContainsBytes(aBuffer, aLength, "\x80theora", 7)) {
+      aContentType.AssignLiteral("video/ogg");
+    }
+    else {
+      aContentType.AssignLiteral("audio/ogg");
+    }
+    return;
+  }
+
+  // MP4 and QuickTime, by major brand
+  if (HasBytesAt(aBuffer, aLength, 4, "ftyp", 4) && aLength >= 12) {
+    if (HasBytesAt(aBuffer, aLength, 8, "M4A ", 4) ||
+        HasBytesAt(aBuffer, aLength, 8, "M4B ", 4) ||
+        HasBytesAt(aBuffer, aLength, 8, "M4P ", 4)) {
+      aContentType.AssignLiteral("audio/mp4");
+    }
+    else if (HasBytesAt(aBuffer, aLength, 8, "qt  ", 4)) {
+      aContentType.AssignLiteral("video/quicktime");
+    }
+    else if (HasBytesAt(aBuffer, aLength, 8, "3gp", 3) ||
+             HasBytesAt(aBuffer, aLength, 8, "3g2", 3)) {
+      aContentType.AssignLiteral("video/3gpp");
+    }
+    else {
+      aContentType.AssignLiteral("video/mp4");
+    }
+    return;
+  }
+
+  // Classic QuickTime files have no ftyp atom and start with another
+  // top-level atom
+  static const char* const quickTimeAtoms[] = {"moov", "mdat", "wide",
+                                               "free", "skip", "pnot"};
+  for (PRUint32 i = 0; i < NS_ARRAY_LENGTH(quickTimeAtoms); i++) {
+    if (HasBytesAt(aBuffer, aLength, 4, quickTimeAtoms[i], 4)) {
+      aContentType.AssignLiteral("video/quicktime");
+      return;
+    }
+  }
+
+  // RIFF WAVE and AVI
+  if (HasBytesAt(aBuffer, aLength, 0, "RIFF", 4)) {
+    if (HasBytesAt(aBuffer, aLength, 8, "WAVE", 4)) {
+      aContentType.AssignLiteral("audio/x-wav");
+    }
+    else if (HasBytesAt(aBuffer, aLength, 8, "AVI ", 4)) {
+      aContentType.AssignLiteral("video/x-msvideo");
+    }
+    return;
+  }
+
+  // ASF; a video stream properties object means video
+  static const char asfHeader[] = "\x30\x26\xB2\x75\x8E\x66\xCF\x11"
+                                  "\xA6\xD9\x00\xAA\x00\x62\xCE\x6C";
+  static const char asfVideoMedia[] = "\xC0\xEF\x19\xBC\x4D\x5B\xCF\x11"
+                                      "\xA8\xFD\x00\x80\x5F\x5C\x44\x2B";
+  if (HasBytesAt(aBuffer, aLength, 0, asfHeader, 16)) {
+    if (ContainsBytes(aBuffer, aLength, asfVideoMedia, 16)) {
+      aContentType.AssignLiteral("video/x-ms-wmv");
+    }
+    else {
+      aContentType.AssignLiteral("audio/x-ms-wma");
+    }
+    return;
+  }
+
+  // Matroska and WebM, by EBML document type
+  if (HasBytesAt(aBuffer, aLength, 0, "\x1A\x45\xDF\xA3", 4)) {
+    if (ContainsBytes(aBuffer, aLength, "webm", 4)) {
+      aContentType.AssignLiteral("video/webm");
+    }
+    else if (ContainsBytes(aBuffer, aLength, "matroska", 8)) {
+      aContentType.AssignLiteral("video/x-matroska");
+    }
+    return;
+  }
+
+  // MPEG audio
+  if (HasMPEGFrames(aBuffer, aLength)) {
+    aContentType.AssignLiteral("audio/mpeg");
+    return;
+  }
+}
+
+/**
+ * Read the start of aFile and get the MIME type of its content, skipping any
+ * ID3v2 tag first. aContentType is left empty if the content is not
+ * recognized.
+ */
+static nsresult
+SniffFileContentType(nsILocalFile* aFile, nsACString& aContentType)
+{
+  aContentType.Truncate();
+
+  PRFileDesc* fd;
+  nsresult rv = aFile->OpenNSPRFileDesc(PR_RDONLY, 0, &fd);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint8 buffer[SB_TYPESNIFFER_SNIFF_SIZE];
+  PRInt32 length = PR_Read(fd, buffer, sizeof(buffer));
+
+  // An ID3v2 tag may prefix MP3 and, rarely, other formats. Its size is a
+  // 28 bit "syncsafe" integer that does not include the 10 byte header.
+  PRBool hasID3 = PR_FALSE;
+  PRInt64 offset = 0;
+  while (length >= 10 &&
+         HasBytesAt(buffer, length, 0, "ID3", 3) &&
+         !((buffer[6] | buffer[7] | buffer[8] | buffer[9]) & 0x80)) {
+    hasID3 = PR_TRUE;
+    PRInt64 tagEnd = offset + 10 +
+                     ((buffer[6] << 21) | (buffer[7] << 14) |
+                      (buffer[8] << 7) | buffer[9]);
+    // The footer flag adds another 10 bytes
+    if (buffer[5] & 0x10) {
+      tagEnd += 10;
+    }
+    if (PR_Seek64(fd, tagEnd, PR_SEEK_SET) != tagEnd) {
+      length = 0;
+      break;
+    }
+    offset = tagEnd;
+    length = PR_Read(fd, buffer, sizeof(buffer));
+  }
+  PR_Close(fd);
+
+  if (length > 0) {
+    SniffContentType(buffer, length, aContentType);
+  }
+
+  // A tagged file with nothing recognizable after the tag is still most
+  // likely MP3, e.g. with padding or junk between the tag and the audio.
+  if (hasID3 && aContentType.IsEmpty()) {
+    aContentType.AssignLiteral("audio/mpeg");
+  }
+
+  return NS_OK;
+}
+
+//------------------------------------------------------------------------------
+// sbMediacoreTypeSniffer
+//------------------------------------------------------------------------------
+
 NS_IMPL_THREADSAFE_ISUPPORTS1(sbMediacoreTypeSniffer,
                               sbIMediacoreTypeSniffer)
 
@@ -95,6 +398,9 @@ sbMediacoreTypeSniffer::Init()
   success = mAllExtensions.Init();
   NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
 
+  success = mSniffedExtensions.Init();
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
   nsCOMPtr<nsIArray> factories;
   rv = mFactoryRegistrar->GetFactories(getter_AddRefs(factories));
   NS_ENSURE_SUCCESS(rv, rv);
@@ -210,6 +516,123 @@ sbMediacoreTypeSniffer::Init()
     mBannedWebExtensions.PutEntry(nsDependentCString(gBannedWebExtensions[current]));
   }
 
+  for(PRUint16 current = 0; current < gSniffedExtensionsSize; ++current) {
+    mSniffedExtensions.PutEntry(nsDependentCString(gSniffedExtensions[current]));
+  }
+
+  return NS_OK;
+}
+
+/* static */ nsresult
+sbMediacoreTypeSniffer::InitContentTypeCache()
+{
+  NS_ENSURE_FALSE(sContentTypeCacheLock, NS_ERROR_ALREADY_INITIALIZED);
+
+  sContentTypeCacheLock =
+    nsAutoLock::NewLock("sbMediacoreTypeSniffer::sContentTypeCacheLock");
+  NS_ENSURE_TRUE(sContentTypeCacheLock, NS_ERROR_OUT_OF_MEMORY);
+
+  sContentTypeCache =
+    new nsClassHashtable<nsStringHashKey, ContentTypeCacheEntry>();
+  NS_ENSURE_TRUE(sContentTypeCache, NS_ERROR_OUT_OF_MEMORY);
+
+  PRBool success = sContentTypeCache->Init();
+  NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+  return NS_OK;
+}
+
+/* static */ void
+sbMediacoreTypeSniffer::ShutdownContentTypeCache()
+{
+  delete sContentTypeCache;
+  sContentTypeCache = nsnull;
+
+  if (sContentTypeCacheLock) {
+    nsAutoLock::DestroyLock(sContentTypeCacheLock);
+    sContentTypeCacheLock = nsnull;
+  }
+}
+
+nsresult
+sbMediacoreTypeSniffer::GetContentTypeForLocalFile(nsIURI* aURI,
+                                                   nsACString& _retval)
+{
+  NS_ENSURE_ARG_POINTER(aURI);
+
+  _retval.Truncate();
+
+  nsresult rv;
+  nsCOMPtr<nsIFileURL> fileURL = do_QueryInterface(aURI, &rv);
+  if (NS_FAILED(rv)) {
+    return NS_OK;
+  }
+
+  nsCOMPtr<nsIFile> file;
+  rv = fileURL->GetFile(getter_AddRefs(file));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCOMPtr<nsILocalFile> localFile = do_QueryInterface(file, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool isFile = PR_FALSE;
+  rv = localFile->IsFile(&isFile);
+  if (NS_FAILED(rv) || !isFile) {
+    return NS_OK;
+  }
+
+  nsString path;
+  rv = localFile->GetPath(path);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRInt64 fileSize;
+  rv = localFile->GetFileSize(&fileSize);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRInt64 lastModified;
+  rv = localFile->GetLastModifiedTime(&lastModified);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  NS_ENSURE_TRUE(sContentTypeCacheLock, NS_ERROR_NOT_INITIALIZED);
+
+  {
+    nsAutoLock lock(sContentTypeCacheLock);
+
+    ContentTypeCacheEntry* entry;
+    if (sContentTypeCache->Get(path, &entry) &&
+        entry->fileSize == fileSize &&
+        entry->lastModified == lastModified) {
+      _retval.Assign(entry->contentType);
+      return NS_OK;
+    }
+  }
+
+  // Read the file without holding the lock; two threads sniffing the same
+  // file at once just cache the same type twice.
+  nsCString contentType;
+  rv = SniffFileContentType(localFile, contentType);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsAutoPtr<ContentTypeCacheEntry> entry(new ContentTypeCacheEntry);
+  NS_ENSURE_TRUE(entry, NS_ERROR_OUT_OF_MEMORY);
+  entry->fileSize = fileSize;
+  entry->lastModified = lastModified;
+  entry->contentType = contentType;
+
+  {
+    nsAutoLock lock(sContentTypeCacheLock);
+
+    if (sContentTypeCache->Count() >= SB_TYPESNIFFER_CACHE_SIZE) {
+      sContentTypeCache->Clear();
+    }
+
+    PRBool success = sContentTypeCache->Put(path, entry);
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+    entry.forget();
+  }
+
+  _retval.Assign(contentType);
+
   return NS_OK;
 }
 
@@ -290,13 +713,13 @@ sbMediacoreTypeSniffer::IsValidMediaURL(nsIURI *aURL,
     return NS_OK;
   }
 
-  // XXXAus: For the time being, if there's no extension we'll pretend like it
-  //         is not media.
-  *_retval = PR_FALSE;
+  // Without an extension, have a look at the content of local files.
+  // Anything else is not media.
+  nsCString contentType;
+  rv = GetContentTypeForLocalFile(aURL, contentType);
+  NS_ENSURE_SUCCESS(rv, rv);
 
-  // XXXAus: Below are comments for implementing further functionality.
-  // Looks like we'll have to crack open the file or connect to the server
-  // to have a look at the content type.
+  *_retval = !contentType.IsEmpty();
 
   return NS_OK;
 }
@@ -321,10 +744,15 @@ sbMediacoreTypeSniffer::IsValidAudioURL(nsIURI *aURL, PRBool *aRetVal)
     }
 
     *aRetVal = PR_FALSE;
+    return NS_OK;
   }
 
-  // Assume that this URL is not an audio file.
-  *aRetVal = PR_FALSE;
+  // Without an extension, have a look at the content of local files.
+  nsCString contentType;
+  rv = GetContentTypeForLocalFile(aURL, contentType);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  *aRetVal = StringBeginsWith(contentType, NS_LITERAL_CSTRING("audio/"));
   return NS_OK;
 }
 
@@ -355,13 +783,12 @@ sbMediacoreTypeSniffer::IsValidVideoURL(nsIURI *aURL,
     return NS_OK;
   }
 
-  // XXXAus: For the time being, if there's no extension we'll pretend like there
-  //         is no video.
-  *_retval = PR_FALSE;
+  // Without an extension, have a look at the content of local files.
+  nsCString contentType;
+  rv = GetContentTypeForLocalFile(aURL, contentType);
+  NS_ENSURE_SUCCESS(rv, rv);
 
-  // XXXAus: Below are comments for implementing further functionality.
-  // Looks like we'll have to crack open the file or connect to the server
-  // to have a look at the content type.
+  *_retval = StringBeginsWith(contentType, NS_LITERAL_CSTRING("video/"));
 
   return NS_OK;
 }
@@ -456,6 +883,64 @@ sbMediacoreTypeSniffer::IsValidWebSafePlaylistURL(nsIURI *aURL,
   return NS_OK;
 }
 
+NS_IMETHODIMP
+sbMediacoreTypeSniffer::GetContentTypeForURL(nsIURI *aURL,
+                                             nsACString &_retval)
+{
+  NS_ENSURE_ARG_POINTER(aURL);
+
+  nsresult rv = GetContentTypeForLocalFile(aURL, _retval);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbMediacoreTypeSniffer::IsValidMediaContentURL(nsIURI *aURL,
+                                               PRBool *_retval)
+{
+  NS_ENSURE_ARG_POINTER(aURL);
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  nsresult rv = IsValidMediaURL(aURL, _retval);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Extension-less files were sniffed already, and extensions of formats
+  // that cannot be sniffed have to be trusted.
+  if (!*_retval) {
+    return NS_OK;
+  }
+
+  nsCString fileExtension;
+  rv = GetFileExtensionFromURI(aURL, fileExtension);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (fileExtension.IsEmpty()) {
+    return NS_OK;
+  }
+
+  {
+    nsAutoMonitor mon(mMonitor);
+    if (!mSniffedExtensions.GetEntry(fileExtension)) {
+      return NS_OK;
+    }
+  }
+
+  // Any recognized media will do; a misnamed file still plays.
+  nsCOMPtr<nsIFileURL> fileURL = do_QueryInterface(aURL, &rv);
+  if (NS_FAILED(rv)) {
+    return NS_OK;
+  }
+
+  nsCString contentType;
+  rv = GetContentTypeForLocalFile(aURL, contentType);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  *_retval = !contentType.IsEmpty();
+
+  return NS_OK;
+}
+
 template<class EntryType>
 PLDHashOperator PR_CALLBACK EnumerateAllExtensions(EntryType* aEntry,
                                                    void *aUserArg)
@@ -29,9 +29,11 @@
 
 #include <nsIStringEnumerator.h>
 
+#include <nsClassHashtable.h>
 #include <nsCOMPtr.h>
 #include <nsHashKeys.h>
 #include <nsTHashtable.h>
+#include <prlock.h>
 #include <prmon.h>
 
 #include <sbIMediacoreManager.h>
@@ -47,12 +49,35 @@ public:
 
   nsresult Init();
 
+  // The content type cache is shared by all type sniffers and lives as long
+  // as the module.
+  static nsresult InitContentTypeCache();
+  static void ShutdownContentTypeCache();
+
 private:
   virtual ~sbMediacoreTypeSniffer();
 
   nsresult GetFileExtensionFromURI(nsIURI* aURI,
                                    nsACString& _retval);
 
+  // Get the content type of the local file aURI from the content type cache,
+  // or sniff it and cache it. _retval is left empty when aURI is not a local
+  // file or its content is not recognized.
+  nsresult GetContentTypeForLocalFile(nsIURI* aURI,
+                                      nsACString& _retval);
+
+  // A content type remembered for a file path, valid as long as the size
+  // and modification time of the file stay the same.
+  struct ContentTypeCacheEntry {
+    PRInt64   fileSize;
+    PRInt64   lastModified;
+    nsCString contentType;
+  };
+
+  static PRLock* sContentTypeCacheLock;
+  static nsClassHashtable<nsStringHashKey, ContentTypeCacheEntry>*
+    sContentTypeCache;
+
 protected:
   PRMonitor *mMonitor;
 
@@ -65,4 +90,7 @@ protected:
   nsTHashtable<nsCStringHashKey> mBannedWebExtensions;
 
   nsTHashtable<nsCStringHashKey> mAllExtensions;
+
+  // Extensions of formats whose content can be sniffed
+  nsTHashtable<nsCStringHashKey> mSniffedExtensions;
 };
@@ -41,6 +41,9 @@ function runTest () {
   log("Testing basic event target functionality\n");
   testSimpleListener(mediacoreManager);
 
+  log("Testing the voting cache\n");
+  testVotingCache(mediacoreManager);
+
   // TODO: XXX Remove when manager fully meets unit test requirements
   return;
 
@@ -164,6 +167,117 @@ dummyMediacore.prototype = {
   QueryInterface: XPCOMUtils.generateQI([Ci.sbIMediacore]),
 }
 
+/**
+ * Voting cache testing
+ */
+function voteCountingMediacore(aInstanceName) {
+  this.wrappedJSObject = this;
+  this.instanceName = aInstanceName;
+  this.votes = 0;
+}
+
+voteCountingMediacore.prototype = {
+  QueryInterface: XPCOMUtils.generateQI([Ci.sbIMediacore,
+                                         Ci.sbIMediacoreVotingParticipant]),
+  capabilities: null,
+  status: null,
+  sequencer: null,
+  shutdown: function() {},
+  voteWithURI: function(aURI) {
+    ++this.votes;
+    return /\/voting\/cache\//.test(aURI.spec) ? 1000 : 0;
+  },
+  voteWithChannel: function(aChannel) {
+    return this.voteWithURI(aChannel.URI);
+  }
+}
+
+function voteCountingFactory(aName) {
+  this.name = aName;
+  this.contractID = "@songbirdnest.com/Songbird/Mediacore/Test/" + aName + ";1";
+  this.cores = [];
+}
+
+voteCountingFactory.prototype = {
+  QueryInterface: XPCOMUtils.generateQI([Ci.sbIMediacoreFactory]),
+  capabilities: null,
+  create: function(aInstanceName) {
+    var core = new voteCountingMediacore(aInstanceName);
+    this.cores.push(core);
+    return core;
+  },
+  get votes() {
+    return this.cores.reduce(function(aSum, aCore) {
+                               return aSum + aCore.votes;
+                             }, 0);
+  }
+}
+
+function testVotingCache(mediaManager) {
+  var registrar = mediaManager.QueryInterface(Ci.sbIMediacoreFactoryRegistrar);
+  var voting = mediaManager.QueryInterface(Ci.sbIMediacoreVoting);
+  var stats = mediaManager.QueryInterface(Ci.sbPIMediacoreManager);
+
+  function vote(aSpec) {
+    var chain = voting.voteWithURI(newURI(aSpec));
+    var cores = chain.mediacoreChain;
+    for (var i = 0; i < cores.length; ++i) {
+      var core = cores.queryElementAt(i, Ci.sbIMediacore).wrappedJSObject;
+      if (core instanceof voteCountingMediacore) {
+        return core;
+      }
+    }
+    return null;
+  }
+
+  var factory = new voteCountingFactory("voting-cache");
+  registrar.registerFactory(factory);
+
+  // The first vote for a key asks the cores
+  var hits = stats.votingCacheHits;
+  var misses = stats.votingCacheMisses;
+  var core = vote("file:///voting/cache/first.sbtestvote");
+  assertTrue(core, "the test core did not win the vote");
+  assertEqual(factory.votes, 1);
+  assertEqual(stats.votingCacheMisses, misses + 1);
+
+  // A second vote for the same scheme, extension and MIME type is answered
+  // from the cache, by the same core
+  assertEqual(vote("file:///voting/cache/other/second.SBTESTVOTE"), core);
+  assertEqual(factory.votes, 1);
+  assertEqual(stats.votingCacheHits, hits + 1);
+
+  // Another extension is a different key, and so is another scheme. The
+  // live core wins both, so no new core is created.
+  assertEqual(vote("file:///voting/cache/third.sbtestother"), core);
+  assertEqual(factory.votes, 2);
+  assertEqual(vote("http://localhost/voting/cache/first.sbtestvote"), core);
+  assertEqual(factory.votes, 3);
+  assertEqual(vote("file:///voting/cache/first.sbtestvote"), core);
+  assertEqual(factory.votes, 3);
+
+  // Registering a factory clears the cache
+  var otherFactory = new voteCountingFactory("voting-cache-other");
+  registrar.registerFactory(otherFactory);
+  assertEqual(vote("file:///voting/cache/first.sbtestvote"), core);
+  assertEqual(factory.votes, 4);
+  assertEqual(vote("file:///voting/cache/first.sbtestvote"), core);
+  assertEqual(factory.votes, 4);
+
+  // So does unregistering one
+  registrar.unregisterFactory(otherFactory);
+  assertEqual(vote("file:///voting/cache/first.sbtestvote"), core);
+  assertEqual(factory.votes, 5);
+  assertEqual(vote("file:///voting/cache/first.sbtestvote"), core);
+  assertEqual(factory.votes, 5);
+
+  assertEqual(factory.cores.length, 1);
+  assertEqual(otherFactory.cores.length, 0);
+
+  registrar.unregisterFactory(factory);
+  registrar.destroyMediacore(core.instanceName);
+}
+
 function testSimpleListener(mediaManager) {
   var listener = new testListener();
 
@@ -87,4 +87,84 @@ function runTest () {
 
   allExtensions.sort();
   log("All playlist file extensions: " + allExtensions.join());
+
+  testContentSniffing(typeSniffer);
+}
+
+function testContentSniffing(typeSniffer) {
+  // Not a local file
+  var uri = newURI("http://example.com/file.mp3");
+  assertEqual(typeSniffer.getContentTypeForURL(uri), "");
+
+  // FLAC without an extension is media
+  var flacFile = writeTempFile("sniffed", "fLaC\0\0\0\x22");
+  var flacURI = newFileURI(flacFile);
+  assertEqual(typeSniffer.getContentTypeForURL(flacURI), "audio/x-flac");
+  assertTrue(typeSniffer.isValidMediaURL(flacURI),
+             "FLAC content should be media.");
+  assertTrue(typeSniffer.isValidAudioURL(flacURI),
+             "FLAC content should be audio.");
+  assertFalse(typeSniffer.isValidVideoURL(flacURI),
+              "FLAC content should not be video.");
+
+  // An ID3 tag followed by MPEG frames
+  var header = "\xFF\xFB\x90\x00";
+  var frame = header + new Array(417 - header.length + 1).join("\0");
+  var mp3File = writeTempFile("sniffed.mp3",
+                              "ID3\x03\0\0\0\0\0\x04\0\0\0\0" +
+                              frame + frame);
+  var mp3URI = newFileURI(mp3File);
+  assertEqual(typeSniffer.getContentTypeForURL(mp3URI), "audio/mpeg");
+  assertTrue(typeSniffer.isValidMediaContentURL(mp3URI),
+             "MP3 content should be media.");
+
+  // Classic QuickTime files start with an atom other than ftyp
+  for each (let atom in ["moov", "mdat", "wide", "free", "skip", "pnot"]) {
+    let movFile = writeTempFile("sniffed.mov",
+                                "\0\0\0\x08" + atom + "\0\0\0\x08mdat");
+    let movURI = newFileURI(movFile);
+    assertEqual(typeSniffer.getContentTypeForURL(movURI), "video/quicktime",
+                "QuickTime content starting with " + atom);
+    // Where .mov is a media extension, its content has to be recognized
+    if (typeSniffer.isValidMediaURL(movURI)) {
+      assertTrue(typeSniffer.isValidMediaContentURL(movURI),
+                 "QuickTime content should be media.");
+    }
+  }
+
+  // A text file named like an MP3 is not media
+  var textFile = writeTempFile("misnamed.mp3", "This is not an MP3 file.");
+  var textURI = newFileURI(textFile);
+  assertEqual(typeSniffer.getContentTypeForURL(textURI), "");
+  assertTrue(typeSniffer.isValidMediaURL(textURI),
+             "The extension alone should still count as media.");
+  assertFalse(typeSniffer.isValidMediaContentURL(textURI),
+              "Text content should not be media.");
+
+  // Changing the file is noticed despite the cache
+  writeFile(textFile, "RIFF\0\0\0\0WAVEfmt ");
+  textFile.lastModifiedTime = Date.now() + 10000;
+  assertEqual(typeSniffer.getContentTypeForURL(newFileURI(textFile)),
+              "audio/x-wav");
+}
+
+function writeTempFile(name, data) {
+  var file = Cc["@mozilla.org/file/directory_service;1"]
+               .getService(Ci.nsIProperties)
+               .get("TmpD", Ci.nsIFile);
+  file.append(name);
+  file.createUnique(Ci.nsIFile.NORMAL_FILE_TYPE, 0664);
+  var registerFileForDelete = Cc["@mozilla.org/uriloader/external-helper-app-service;1"]
+                                .getService(Ci.nsPIExternalAppLauncher);
+  registerFileForDelete.deleteTemporaryFileOnExit(file);
+  writeFile(file, data);
+  return file;
+}
+
+function writeFile(file, data) {
+  var stream = Cc["@mozilla.org/network/file-output-stream;1"]
+                 .createInstance(Ci.nsIFileOutputStream);
+  stream.init(file, 0x02 | 0x08 | 0x20, 0664, 0);
+  stream.write(data, data.length);
+  stream.close();
 }
@@ -40,6 +40,8 @@
 #include "sbFileMetadataService.h"
 #include "sbMetadataJobItem.h"
 
+#include <sbPerfStatisticsUtils.h>
+
 #include "prlog.h"
 
 // DEFINES ====================================================================
@@ -245,10 +247,21 @@ NS_IMETHODIMP sbBackgroundThreadMetadataProcessor::Run()
 
     PRBool async = PR_FALSE;
     PRInt32 operationRetVal;
-    if (jobType == sbMetadataJob::TYPE_WRITE) {
-      rv = handler->Write(&operationRetVal);
-    } else {
-      rv = handler->Read(&operationRetVal);
+    {
+      sbAutoPerfLatency perfLatency(
+        sbIPerfStatistics::CATEGORY_METADATA,
+        nsDependentCString(jobType == sbMetadataJob::TYPE_WRITE ?
+                           "write" : "read"));
+      if (jobType == sbMetadataJob::TYPE_WRITE) {
+        rv = handler->Write(&operationRetVal);
+      } else {
+        rv = handler->Read(&operationRetVal);
+      }
+      if (NS_FAILED(rv)) {
+        perfLatency.Cancel();
+        sbPerfStatisticsCount(sbIPerfStatistics::CATEGORY_METADATA,
+                              NS_LITERAL_CSTRING("failed"));
+      }
     }
 
     // According to |sbIMetadataHandler| |write()| or |read()| will return 
@@ -354,6 +354,14 @@ DirectoryImportJob.prototype = {
       var fileScanQuery = this._fileScanQuery;
       this._fileExtensions.forEach(function(ext) { fileScanQuery.addFileExtension(ext) });
 
+      // Skip misnamed files before the metadata scan gets to them, and find
+      // media files without an extension.
+      try {
+        fileScanQuery.checkContent = true;
+      } catch (e) {
+        Cu.reportError(e);
+      }
+
       // Assign the unsupported file extensions as flagged extensions in the scanner.
       if (this._flaggedFileExtensions) {
         this._flaggedFileExtensions.forEach(function(ext) {
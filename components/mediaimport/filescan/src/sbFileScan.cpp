@@ -346,7 +346,12 @@ NS_IMETHODIMP sbFileScanQuery::AddFilePath(const nsAString &strFilePath)
 {
   PRBool isFlagged = PR_FALSE;
   const nsAutoString strExtension = GetExtensionFromFilename(strFilePath);
-  if (m_lastSeenExtension.IsEmpty() ||
+  PRBool hasExtension = !strExtension.IsEmpty() &&
+                        strExtension.FindChar(NS_L('/')) < 0;
+  if (!hasExtension && m_pTypeSniffer) {
+    // Leave files without an extension to the content check.
+  }
+  else if (m_lastSeenExtension.IsEmpty() ||
       !m_lastSeenExtension.Equals(strExtension, CaseInsensitiveCompare)) {
     // m_lastSeenExtension could be set multiple times without lock guarded
     // in theory. However, the race is benign and in practice, it is rare.
@@ -360,6 +365,13 @@ NS_IMETHODIMP sbFileScanQuery::AddFilePath(const nsAString &strFilePath)
     }
   }
 
+  if (m_pTypeSniffer && !isFlagged &&
+      !VerifyFileContent(strFilePath, hasExtension)) {
+    LOG("sbFileScanQuery::AddFilePath, content is not media: (%s)\n",
+         NS_LossyConvertUTF16toASCII(strFilePath).get());
+    return NS_OK;
+  }
+
   nsresult rv;
   nsCOMPtr<nsISupportsString> string =
     do_CreateInstance("@mozilla.org/supports-string;1", &rv);
@@ -586,6 +598,29 @@ PRBool sbFileScanQuery::VerifyFileExtension(const nsAString &strExtension,
   return isValid;
 } //VerifyFileExtension
 
+//-----------------------------------------------------------------------------
+PRBool sbFileScanQuery::VerifyFileContent(const nsAString &strFilePath,
+                                          PRBool bHasExtension)
+{
+  nsCOMPtr<nsIURI> uri;
+  nsresult rv = NS_NewURI(getter_AddRefs(uri), strFilePath);
+  NS_ENSURE_SUCCESS(rv, PR_FALSE);
+
+  PRBool isMedia = PR_FALSE;
+  rv = m_pTypeSniffer->IsValidMediaContentURL(uri, &isMedia);
+  NS_ENSURE_SUCCESS(rv, PR_FALSE);
+  if (isMedia || !bHasExtension)
+    return isMedia;
+
+  // The extension was accepted above, so only reject files whose extension
+  // the type sniffer knows as media but whose content it does not.
+  PRBool isMediaExtension = PR_FALSE;
+  rv = m_pTypeSniffer->IsValidMediaURL(uri, &isMediaExtension);
+  NS_ENSURE_SUCCESS(rv, PR_FALSE);
+
+  return !isMediaExtension;
+} //VerifyFileContent
+
 //-----------------------------------------------------------------------------
 /* attribute boolean wantContentURLs; */
 NS_IMETHODIMP sbFileScanQuery::
@@ -604,6 +639,34 @@ NS_IMETHODIMP sbFileScanQuery::
   return NS_OK;
 } //SetWantLibraryContentURIs
 
+//-----------------------------------------------------------------------------
+/* attribute boolean checkContent; */
+NS_IMETHODIMP sbFileScanQuery::GetCheckContent(PRBool *aCheckContent)
+{
+  NS_ENSURE_ARG_POINTER(aCheckContent);
+  *aCheckContent = m_pTypeSniffer != nsnull;
+  return NS_OK;
+} //GetCheckContent
+
+//-----------------------------------------------------------------------------
+NS_IMETHODIMP sbFileScanQuery::SetCheckContent(PRBool aCheckContent)
+{
+  if (!aCheckContent) {
+    m_pTypeSniffer = nsnull;
+    return NS_OK;
+  }
+
+  if (!m_pTypeSniffer) {
+    nsresult rv;
+    m_pTypeSniffer =
+      do_CreateInstance("@songbirdnest.com/Songbird/Mediacore/TypeSniffer;1",
+                        &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+} //SetCheckContent
+
 
 //*****************************************************************************
 //  sbFileScan Class
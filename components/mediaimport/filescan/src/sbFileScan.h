@@ -37,6 +37,8 @@
 
 #include "sbIFileScan.h"
 
+#include <sbIMediacoreTypeSniffer.h>
+
 #include <nscore.h>
 #include <nsCOMPtr.h>
 
@@ -98,6 +100,8 @@ protected:
   nsString GetExtensionFromFilename(const nsAString &strFilename);
   PRBool VerifyFileExtension(const nsAString &strExtension,
                              PRBool *aOutIsFlaggedExtension);
+  PRBool VerifyFileContent(const nsAString &strFilePath,
+                           PRBool bHasExtension);
 
   PRLock* m_pDirectoryLock;
   nsString m_strDirectory;
@@ -109,6 +113,9 @@ protected:
   PRBool m_bRecurse;
   PRBool m_bWantLibraryContentURIs;
 
+  // set when checkContent is set, before scanning starts
+  nsCOMPtr<sbIMediacoreTypeSniffer> m_pTypeSniffer;
+
   PRLock* m_pScanningLock;
   PRBool m_bIsScanning;
 
@@ -40,7 +40,9 @@
 
 #define SB_DBQUERY_CONTRACTID "@songbirdnest.com/Songbird/DatabaseQuery;1"
 
-sbiTunesDatabaseServices::sbiTunesDatabaseServices() : mResetPending(PR_FALSE) {
+sbiTunesDatabaseServices::sbiTunesDatabaseServices() :
+  mPendingSignatures(0),
+  mResetPending(PR_FALSE) {
 }
 
 sbiTunesDatabaseServices::~sbiTunesDatabaseServices() {
@@ -66,6 +68,21 @@ sbiTunesDatabaseServices::Initialize() {
   rv = mDBQuery->AddQuery(sql);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Signatures of the imported tracks, used to only process the tracks that
+  // changed since the last import
+  sql.AssignLiteral("CREATE TABLE IF NOT EXISTS itunes_track_signatures "
+                    "(itunes_id TEXT UNIQUE NOT NULL, "
+                    "library_id TEXT NOT NULL, "
+                    "signature TEXT NOT NULL)");
+  rv = mDBQuery->AddQuery(sql);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  sql.AssignLiteral("CREATE INDEX IF NOT EXISTS "
+                    "idx_itunes_track_signatures_library_id "
+                    "ON itunes_track_signatures (library_id)");
+  rv = mDBQuery->AddQuery(sql);
+  NS_ENSURE_SUCCESS(rv, rv);
+
   PRBool dbOK;
   rv = mDBQuery->Execute(&dbOK);
   NS_ENSURE_SUCCESS(rv, rv);
@@ -84,7 +101,36 @@ sbiTunesDatabaseServices::Initialize() {
   NS_NAMED_LITERAL_STRING(DELETE_SQL, 
                           "DELETE FROM itunes_id_map WHERE songbird_id = ?");
 
-  rv = mDBQuery->PrepareQuery(SELECT_SQL, getter_AddRefs(mDeleteMapID));
+  rv = mDBQuery->PrepareQuery(DELETE_SQL, getter_AddRefs(mDeleteMapID));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  mSignatureQuery = do_CreateInstance(SB_DBQUERY_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+  
+  rv = mSignatureQuery->SetAsyncQuery(PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+  
+  rv = mSignatureQuery->SetDatabaseGUID(NS_LITERAL_STRING("songbird"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  NS_NAMED_LITERAL_STRING(INSERT_SIGNATURE_SQL,
+                          "INSERT OR REPLACE INTO itunes_track_signatures "
+                          "(itunes_id, library_id, signature) VALUES (?, ?, ?)");
+  rv = mSignatureQuery->PrepareQuery(INSERT_SIGNATURE_SQL,
+                                     getter_AddRefs(mInsertSignature));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  NS_NAMED_LITERAL_STRING(DELETE_SIGNATURE_SQL,
+                          "DELETE FROM itunes_track_signatures "
+                          "WHERE itunes_id = ?");
+  rv = mSignatureQuery->PrepareQuery(DELETE_SIGNATURE_SQL,
+                                     getter_AddRefs(mDeleteSignature));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  NS_NAMED_LITERAL_STRING(DELETE_ITUNES_ID_SQL,
+                          "DELETE FROM itunes_id_map WHERE itunes_id = ?");
+  rv = mSignatureQuery->PrepareQuery(DELETE_ITUNES_ID_SQL,
+                                     getter_AddRefs(mDeleteiTunesID));
   NS_ENSURE_SUCCESS(rv, rv);
   
   return NS_OK;
@@ -159,3 +205,164 @@ sbiTunesDatabaseServices::RemoveSBIDEntry(nsAString const & aSongbirdID) {
 
   return NS_OK;
 }
+
+nsresult
+sbiTunesDatabaseServices::GetTrackSignatures(nsAString const & aiTunesLibID,
+                                             TrackSignatureMap & aSignatures) {
+  aSignatures.clear();
+
+  // Only signatures that still have a mapping are of use, a track without
+  // one is treated as new
+  nsString sql;
+  sql.AssignLiteral("SELECT s.itunes_id, s.signature, m.songbird_id "
+                    "FROM itunes_track_signatures s "
+                    "JOIN itunes_id_map m ON m.itunes_id = s.itunes_id "
+                    "WHERE s.library_id = ?");
+  nsCOMPtr<sbIDatabasePreparedStatement> statement;
+  nsresult rv = mDBQuery->PrepareQuery(sql, getter_AddRefs(statement));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mDBQuery->AddPreparedStatement(statement);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mDBQuery->BindStringParameter(0, aiTunesLibID);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRInt32 dbOK;
+  rv = mDBQuery->Execute(&dbOK);
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(dbOK == 0, NS_ERROR_FAILURE);
+
+  nsCOMPtr<sbIDatabaseResult> result;
+  rv = mDBQuery->GetResultObject(getter_AddRefs(result));
+  NS_ENSURE_TRUE(result, NS_ERROR_FAILURE);
+
+  PRUint32 rowCount;
+  rv = result->GetRowCount(&rowCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // The stored ID is the composite of the library and track IDs
+  PRUint32 const libIDLength = aiTunesLibID.Length();
+  nsString iTunesID;
+  for (PRUint32 row = 0; row < rowCount; ++row) {
+    rv = result->GetRowCell(row, 0, iTunesID);
+    NS_ENSURE_SUCCESS(rv, rv);
+    if (iTunesID.Length() <= libIDLength) {
+      continue;
+    }
+    TrackSignature & entry = aSignatures[nsString(Substring(iTunesID,
+                                                            libIDLength))];
+    rv = result->GetRowCell(row, 1, entry.signature);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = result->GetRowCell(row, 2, entry.songbirdID);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbiTunesDatabaseServices::BeginTrackSignatures() {
+  if (mPendingSignatures > 0) {
+    return NS_OK;
+  }
+  return mSignatureQuery->AddQuery(NS_LITERAL_STRING("BEGIN"));
+}
+
+nsresult
+sbiTunesDatabaseServices::StoreTrackSignature(nsAString const & aiTunesLibID,
+                                              nsAString const & aiTunesID,
+                                              nsAString const & aSignature) {
+  nsresult rv = BeginTrackSignatures();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mSignatureQuery->AddPreparedStatement(mInsertSignature);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsString compositeID(aiTunesLibID);
+  compositeID.Append(aiTunesID);
+  rv = mSignatureQuery->BindStringParameter(0, compositeID);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mSignatureQuery->BindStringParameter(1, aiTunesLibID);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mSignatureQuery->BindStringParameter(2, aSignature);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  ++mPendingSignatures;
+
+  return NS_OK;
+}
+
+nsresult
+sbiTunesDatabaseServices::RemoveTrackSignature(nsAString const & aiTunesLibID,
+                                               nsAString const & aiTunesID) {
+  nsString compositeID(aiTunesLibID);
+  compositeID.Append(aiTunesID);
+
+  nsresult rv = BeginTrackSignatures();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mSignatureQuery->AddPreparedStatement(mDeleteSignature);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mSignatureQuery->BindStringParameter(0, compositeID);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  ++mPendingSignatures;
+
+  return NS_OK;
+}
+
+nsresult
+sbiTunesDatabaseServices::RemoveTrack(nsAString const & aiTunesLibID,
+                                      nsAString const & aiTunesID) {
+  nsString compositeID(aiTunesLibID);
+  compositeID.Append(aiTunesID);
+
+  nsresult rv = BeginTrackSignatures();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mSignatureQuery->AddPreparedStatement(mDeleteSignature);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mSignatureQuery->BindStringParameter(0, compositeID);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mSignatureQuery->AddPreparedStatement(mDeleteiTunesID);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mSignatureQuery->BindStringParameter(0, compositeID);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  ++mPendingSignatures;
+
+  return NS_OK;
+}
+
+nsresult
+sbiTunesDatabaseServices::FlushTrackSignatures() {
+  if (mPendingSignatures == 0) {
+    return NS_OK;
+  }
+  mPendingSignatures = 0;
+
+  nsresult rv = mSignatureQuery->AddQuery(NS_LITERAL_STRING("COMMIT"));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRInt32 dbOK;
+  rv = mSignatureQuery->Execute(&dbOK);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (dbOK != 0) {
+    // Don't leave the transaction open, the signatures will be stored again
+    // by the next import
+    rv = mSignatureQuery->AddQuery(NS_LITERAL_STRING("ROLLBACK"));
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = mSignatureQuery->Execute(&dbOK);
+    NS_ENSURE_SUCCESS(rv, rv);
+    return NS_ERROR_FAILURE;
+  }
+
+  return NS_OK;
+}
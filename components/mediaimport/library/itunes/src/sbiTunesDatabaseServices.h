@@ -27,6 +27,8 @@
 #ifndef ITUNESDATABASESERVICES_H_
 #define ITUNESDATABASESERVICES_H_
 
+#include <map>
+
 #include <nsStringAPI.h>
 
 #include "sbiTunesImporterCommon.h"
@@ -40,6 +42,20 @@ class sbIDatabasePreparedStatement;
 class sbiTunesDatabaseServices
 {
 public:
+  /**
+   * The stored signature of an iTunes track and the Songbird ID it is
+   * mapped to
+   */
+  struct TrackSignature
+  {
+    nsString signature;
+    nsString songbirdID;
+  };
+  /**
+   * Stored track signatures keyed by iTunes track ID
+   */
+  typedef std::map<nsString, TrackSignature> TrackSignatureMap;
+
   /**
    * Initializes flags
    */
@@ -73,9 +89,54 @@ public:
    * \param aSongbirdID the Songbird ID of the mapping to be removed
    */
   nsresult RemoveSBIDEntry(nsAString const & aSongbirdID);
+  /**
+   * Loads the signatures of all tracks of an iTunes library that are mapped
+   * to a Songbird ID
+   * \param aiTunesLibID the library ID of the iTunes library
+   * \param aSignatures the map that receives the signatures
+   */
+  nsresult GetTrackSignatures(nsAString const & aiTunesLibID,
+                              TrackSignatureMap & aSignatures);
+  /**
+   * Queues storing the signature of an iTunes track. Nothing is written
+   * until FlushTrackSignatures is called.
+   * \param aiTunesLibID the library ID of the iTunes item
+   * \param aiTunesID the ID of the iTunes item
+   * \param aSignature the signature of the iTunes item
+   */
+  nsresult StoreTrackSignature(nsAString const & aiTunesLibID,
+                               nsAString const & aiTunesID,
+                               nsAString const & aSignature);
+  /**
+   * Queues removing the signature of an iTunes track. Nothing is written
+   * until FlushTrackSignatures is called.
+   * \param aiTunesLibID the library ID of the iTunes item
+   * \param aiTunesID the ID of the iTunes item
+   */
+  nsresult RemoveTrackSignature(nsAString const & aiTunesLibID,
+                                nsAString const & aiTunesID);
+  /**
+   * Queues removing the signature and the ID mapping of an iTunes track
+   * that is no longer in the iTunes library. Nothing is written until
+   * FlushTrackSignatures is called.
+   * \param aiTunesLibID the library ID of the iTunes item
+   * \param aiTunesID the ID of the iTunes item
+   */
+  nsresult RemoveTrack(nsAString const & aiTunesLibID,
+                       nsAString const & aiTunesID);
+  /**
+   * Writes the queued signature changes in a single transaction
+   */
+  nsresult FlushTrackSignatures();
 private:
   typedef nsCOMPtr<sbIDatabasePreparedStatement> PreparedStatementPtr;
   
+  /**
+   * Starts the transaction of the signature changes before the first one
+   * is queued
+   */
+  nsresult BeginTrackSignatures();
+  
   /**
    * Synchronous query object
    */
@@ -96,6 +157,31 @@ private:
    */
   PreparedStatementPtr mDeleteMapID;
   
+  /**
+   * Query object that collects the signature changes until they are flushed
+   */
+  sbIDatabaseQueryPtr mSignatureQuery;
+  
+  /**
+   * Number of signature changes in mSignatureQuery
+   */
+  PRUint32 mPendingSignatures;
+  
+  /**
+   * Insert signature prepared statement
+   */
+  PreparedStatementPtr mInsertSignature;
+  
+  /**
+   * Delete signature prepared statement
+   */
+  PreparedStatementPtr mDeleteSignature;
+  
+  /**
+   * Delete mapping by iTunes ID prepared statement
+   */
+  PreparedStatementPtr mDeleteiTunesID;
+  
   /**
    * Flag to denote that a reset is pending
    */
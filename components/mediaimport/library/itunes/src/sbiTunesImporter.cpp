@@ -39,6 +39,7 @@
 #include <nsXPCOMCIDInternal.h>
 #include <nsIArray.h>
 #include <nsIBufferedStreams.h>
+#include <nsICryptoHash.h>
 #include <nsIFile.h>
 #include <nsIFileURL.h>
 #include <nsIInputStream.h>
@@ -431,6 +432,9 @@ sbiTunesImporter::Initialize()
 {
   nsresult rv = miTunesLibSig.Initialize();
   NS_ENSURE_SUCCESS(rv, rv);
+
+  mTrackHash = do_CreateInstance("@mozilla.org/security/hash;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
   
   mIOService = 
     do_CreateInstance("@mozilla.org/network/io-service;1", &rv);
@@ -603,6 +607,7 @@ sbiTunesImporter::Import(const nsAString & aLibFilePath,
   mMissingMediaCount = 0;
   mTrackCount = 0;
   mUnsupportedMediaCount = 0;
+  mTrackSignatures.clear();
 
   mLibraryPath = aLibFilePath;
   mImport = aCheckForChanges ? PR_FALSE : PR_TRUE;
@@ -748,6 +753,15 @@ NS_IMETHODIMP sbiTunesImporter::OnTopLevelProperties(sbIStringMap *aProperties)
   id.Append(miTunesLibID);
   rv = miTunesLibSig.Update(id);
   NS_ENSURE_SUCCESS(rv, rv);
+
+  // Load the signatures of the tracks imported from this library before,
+  // only tracks that were added or changed since then need processing. If
+  // a previous import was interrupted this picks up where it left off.
+  rv = miTunesDBServices.GetTrackSignatures(miTunesLibID, mTrackSignatures);
+  if (NS_FAILED(rv)) {
+    NS_WARNING("Failed to load the iTunes track signatures");
+    mTrackSignatures.clear();
+  }
   
   return NS_OK;
 }
@@ -765,7 +779,7 @@ sbiTunesImporter::OnTrack(sbIStringMap *aProperties) {
   nsAutoPtr<iTunesTrack> track(new iTunesTrack);
   NS_ENSURE_TRUE(track, NS_ERROR_OUT_OF_MEMORY);
 
-  rv  = track->Initialize(aProperties);
+  rv  = track->Initialize(aProperties, mTrackHash);
   NS_ENSURE_SUCCESS(rv, rv);
 
 #ifdef DEBUG  
@@ -789,8 +803,11 @@ sbiTunesImporter::OnTrack(sbIStringMap *aProperties) {
 
 NS_IMETHODIMP 
 sbiTunesImporter::OnTracksComplete() {
-  if (!mStatus->CancelRequested() && mTrackBatch.size() > 0) {
-    ProcessTrackBatch();
+  if (!mStatus->CancelRequested()) {
+    if (mTrackBatch.size() > 0) {
+      ProcessTrackBatch();
+    }
+    ProcessRemovedTracks();
   }
   return NS_OK;
 }
@@ -1076,8 +1093,12 @@ sbiTunesImporter::ProcessPlaylistItems(sbIMediaList * aMediaList,
     
     TrackIDMap::const_iterator iter = mTrackIDMap.find(trackID);
     if (iter != mTrackIDMap.end()) {
+      // Unchanged tracks aren't looked up during the import, so the item
+      // may have been removed from the library since
       rv = mLibrary->GetItemByGuid(iter->second, getter_AddRefs(mediaItem));
-      NS_ENSURE_SUCCESS(rv, rv);
+      if (NS_FAILED(rv)) {
+        continue;
+      }
       
       rv = tracks->AppendElement(mediaItem, PR_FALSE);
       NS_ENSURE_SUCCESS(rv, rv);
@@ -1342,6 +1363,8 @@ EnumReadFunc(nsAString const & aKey,
 
 nsresult sbiTunesImporter::ProcessUpdates() {
   nsresult rv;
+  sbiTunesDatabaseServices::TrackSignatureMap::iterator const sigEnd =
+    mTrackSignatures.end();
   TrackBatch::iterator const end = mTrackBatch.end();
   for (TrackBatch::iterator iter = mTrackBatch.begin();
        iter != end;
@@ -1352,66 +1375,123 @@ nsresult sbiTunesImporter::ProcessUpdates() {
     nsCOMPtr<nsIURI> uri;
     iTunesTrack * const track = *iter;
     nsString guid;
-    rv = miTunesDBServices.GetSBIDFromITID(miTunesLibID, track->mTrackID, guid);
-    if (NS_SUCCEEDED(rv) && !guid.IsEmpty()) {
-      nsString name;
-      track->mProperties.Get(NS_LITERAL_STRING(SB_PROPERTY_TRACKNAME), &name);
-      
-      mTrackIDMap.insert(TrackIDMap::value_type(track->mTrackID, guid));
-      track->mSBGuid = guid;
+    PRBool unchanged = PR_FALSE;
+    sbiTunesDatabaseServices::TrackSignatureMap::iterator const sigIter =
+      mTrackSignatures.find(track->mTrackID);
+    if (sigIter != sigEnd) {
+      guid = sigIter->second.songbirdID;
+      unchanged = sigIter->second.signature.Equals(track->mSignature);
+      mTrackSignatures.erase(sigIter);
+    }
+    else {
+      // Tracks imported before signatures were stored only have a mapping
+      rv = miTunesDBServices.GetSBIDFromITID(miTunesLibID,
+                                             track->mTrackID,
+                                             guid);
+      if (NS_FAILED(rv)) {
+        guid.Truncate();
+      }
+    }
+    if (!guid.IsEmpty()) {
       nsCOMPtr<sbIMediaItem> mediaItem;
       rv = mLibrary->GetMediaItem(guid, getter_AddRefs(mediaItem));
-      if (NS_SUCCEEDED(rv)) {
+      if (NS_FAILED(rv)) {
+        // The media item was deleted since the track was imported. Forget
+        // the track so it is imported again as a new item
+        rv = miTunesDBServices.RemoveSBIDEntry(guid);
+        NS_ENSURE_SUCCESS(rv, rv);
+        rv = miTunesDBServices.RemoveTrackSignature(miTunesLibID,
+                                                    track->mTrackID);
+        NS_ENSURE_SUCCESS(rv, rv);
         mFoundChanges = PR_TRUE;
-        *iter = nsnull;
-      
-        nsCOMPtr<sbIPropertyArray> properties;
-        rv = mediaItem->GetProperties(nsnull, getter_AddRefs(properties));
+        continue;
+      }
+      mTrackIDMap.insert(TrackIDMap::value_type(track->mTrackID, guid));
+      *iter = nsnull;
+      // Nothing changed since the track was imported, it only needs to be
+      // known to the playlists
+      if (unchanged) {
+        DestructiTunesTrack(track);
+        continue;
+      }
+      track->mSBGuid = guid;
+
+      nsCOMPtr<sbIPropertyArray> properties;
+      rv = mediaItem->GetProperties(nsnull, getter_AddRefs(properties));
+      if (NS_SUCCEEDED(rv)) {
+        sbiTunesImporterEnumeratePropertiesData data(properties, &rv);
+        NS_ENSURE_SUCCESS(rv, rv);
+        // Get the content URL and compare against the track URL. If
+        // we fail to get it continue on, and let the downstream code
+        // deal with it.
+        nsString contentURL;
+        NS_NAMED_LITERAL_STRING(CONTENT_URL, SB_PROPERTY_CONTENTURL);
+        rv = properties->GetPropertyValue(CONTENT_URL,
+                                          contentURL);
         if (NS_SUCCEEDED(rv)) {
-          sbiTunesImporterEnumeratePropertiesData data(properties, &rv);
+          // Get the track URI, compare to the songbird URI, if it's changed
+          // we need to add it into the changed property array
+          track->GetTrackURI(GetOSType(), 
+                             mIOService,
+                             miTunesLibSig, 
+                             getter_AddRefs(uri));
+          nsCOMPtr<nsIURI> fixedUri;
+          rv = sbLibraryUtils::GetContentURI(uri, getter_AddRefs(fixedUri));
           NS_ENSURE_SUCCESS(rv, rv);
-          // Get the content URL and compare against the track URL. If
-          // we fail to get it continue on, and let the downstream code
-          // deal with it.
-          nsString contentURL;
-          NS_NAMED_LITERAL_STRING(CONTENT_URL, SB_PROPERTY_CONTENTURL);
-          rv = properties->GetPropertyValue(CONTENT_URL,
-                                            contentURL);
-          if (NS_SUCCEEDED(rv)) {
-            // Get the track URI, compare to the songbird URI, if it's changed
-            // we need to add it into the changed property array
-            track->GetTrackURI(GetOSType(), 
-                               mIOService,
-                               miTunesLibSig, 
-                               getter_AddRefs(uri));
-            nsCOMPtr<nsIURI> fixedUri;
-            rv = sbLibraryUtils::GetContentURI(uri, getter_AddRefs(fixedUri));
-            NS_ENSURE_SUCCESS(rv, rv);
-            nsCString trackCURI;
-            rv = fixedUri->GetSpec(trackCURI);
-            if (NS_SUCCEEDED(rv)) {      
-              nsString const & trackURI = NS_ConvertUTF8toUTF16(trackCURI);
-              if (!trackURI.Equals(contentURL)) {
-                data.mChangedProperties->AppendProperty(CONTENT_URL,
-                                                        trackURI);
-              }
+          nsCString trackCURI;
+          rv = fixedUri->GetSpec(trackCURI);
+          if (NS_SUCCEEDED(rv)) {      
+            nsString const & trackURI = NS_ConvertUTF8toUTF16(trackCURI);
+            if (!trackURI.Equals(contentURL)) {
+              data.mChangedProperties->AppendProperty(CONTENT_URL,
+                                                      trackURI);
             }
           }
-          // Enumerate the track properties and compare them to the Songbird
-          // ones and build a property array of the ones that are different
-          track->mProperties.EnumerateRead(EnumReadFunc, &data);
-          if (data.NeedsUpdating()) {
-            rv = mediaItem->SetProperties(data.mChangedProperties);
-            NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), 
-                             "Failed to set a property on iTunes import");
-          }
         }
+        // Enumerate the track properties and compare them to the Songbird
+        // ones and build a property array of the ones that are different
+        track->mProperties.EnumerateRead(EnumReadFunc, &data);
+        if (data.NeedsUpdating()) {
+          mFoundChanges = PR_TRUE;
+          rv = mediaItem->SetProperties(data.mChangedProperties);
+          NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), 
+                           "Failed to set a property on iTunes import");
+        }
+        rv = miTunesDBServices.StoreTrackSignature(miTunesLibID,
+                                                   track->mTrackID,
+                                                   track->mSignature);
+        NS_ENSURE_SUCCESS(rv, rv);
       }
+      DestructiTunesTrack(track);
     }
   }
   return NS_OK;
 }
 
+nsresult
+sbiTunesImporter::ProcessRemovedTracks() {
+  // Whatever is left was imported before but wasn't seen this time. The
+  // Songbird media items are left alone, only the mappings are forgotten so
+  // the tracks are imported again should they come back.
+  nsresult rv;
+  sbiTunesDatabaseServices::TrackSignatureMap::const_iterator const end =
+    mTrackSignatures.end();
+  for (sbiTunesDatabaseServices::TrackSignatureMap::const_iterator iter =
+         mTrackSignatures.begin();
+       iter != end;
+       ++iter) {
+    rv = miTunesDBServices.RemoveTrack(miTunesLibID, iter->first);
+    NS_ENSURE_SUCCESS(rv, rv);
+    mFoundChanges = PR_TRUE;
+  }
+  mTrackSignatures.clear();
+
+  rv = miTunesDBServices.FlushTrackSignatures();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
 nsresult 
 sbiTunesImporter::ProcessNewItems(
   TracksByID & aTrackMap,
@@ -1616,6 +1696,11 @@ sbiTunesImporter::ProcessCreatedItems(
                                    track->mTrackID,
                                    track->mSBGuid);
       NS_ENSURE_SUCCESS(rv, rv);
+
+      rv = miTunesDBServices.StoreTrackSignature(miTunesLibID,
+                                                 track->mTrackID,
+                                                 track->mSignature);
+      NS_ENSURE_SUCCESS(rv, rv);
     }
   }
   return NS_OK;
@@ -1642,11 +1727,16 @@ nsresult sbiTunesImporter::ProcessTrackBatch() {
   if (newItems) {
     rv = ProcessCreatedItems(newItems, trackMap);
     NS_ENSURE_SUCCESS(rv, rv);
-  
-    std::for_each(mTrackBatch.begin(), mTrackBatch.end(), DestructiTunesTrack);
   }
   
+  std::for_each(mTrackBatch.begin(), mTrackBatch.end(), DestructiTunesTrack);
   mTrackBatch.clear();
+
+  // Write the signatures of the batch at once. This is the checkpoint an
+  // interrupted import resumes from.
+  rv = miTunesDBServices.FlushTrackSignatures();
+  NS_ENSURE_SUCCESS(rv, rv);
+
   return NS_OK;
 }
 
@@ -1658,8 +1748,10 @@ sbiTunesImporter::iTunesTrack::~iTunesTrack() {
 }
 
 nsresult 
-sbiTunesImporter::iTunesTrack::Initialize(sbIStringMap * aProperties) {
+sbiTunesImporter::iTunesTrack::Initialize(sbIStringMap * aProperties,
+                                          nsICryptoHash * aHash) {
   NS_ENSURE_ARG_POINTER(aProperties);
+  NS_ENSURE_ARG_POINTER(aHash);
   
   nsresult rv = aProperties->Get(NS_LITERAL_STRING("Track ID"), mTrackID);
   NS_ENSURE_SUCCESS(rv, rv);
@@ -1675,6 +1767,14 @@ sbiTunesImporter::iTunesTrack::Initialize(sbIStringMap * aProperties) {
   
   rv = mProperties.Put(location, URI);
   NS_ENSURE_SUCCESS(rv, rv);
+
+  // The signature covers the imported values in the order of gPropertyMap,
+  // each value terminated so that moving text between properties changes it
+  rv = aHash->Init(nsICryptoHash::MD5);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCString signatureData = NS_ConvertUTF16toUTF8(URI);
+  signatureData.Append('\n');
   
   for (unsigned int index = 0; index < NS_ARRAY_LENGTH(gPropertyMap); ++index) {
     PropertyMap const & propertyMapEntry = gPropertyMap[index];
@@ -1688,11 +1788,24 @@ sbiTunesImporter::iTunesTrack::Initialize(sbIStringMap * aProperties) {
       }
       mProperties.Put(NS_ConvertASCIItoUTF16(propertyMapEntry.SBProperty),
                       value);
+      signatureData.Append(NS_ConvertUTF16toUTF8(value));
     }
+    signatureData.Append('\n');
   }
 
-  mProperties.Put(NS_LITERAL_STRING(SB_PROPERTY_CONTENTTYPE),
-                  GetContentType(aProperties));
+  nsString const & contentType = GetContentType(aProperties);
+  mProperties.Put(NS_LITERAL_STRING(SB_PROPERTY_CONTENTTYPE), contentType);
+  signatureData.Append(NS_ConvertUTF16toUTF8(contentType));
+
+  rv = aHash->Update(
+         reinterpret_cast<PRUint8 const *>(signatureData.BeginReading()),
+         signatureData.Length());
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCString hash;
+  rv = aHash->Finish(PR_TRUE, hash);
+  NS_ENSURE_SUCCESS(rv, rv);
+  mSignature = NS_ConvertASCIItoUTF16(hash);
 
   return NS_OK;
 }
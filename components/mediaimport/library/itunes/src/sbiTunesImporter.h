@@ -46,6 +46,7 @@
 
 // Mozilla forwards
 class nsIArray;
+class nsICryptoHash;
 class nsIIOService;
 class nsIInputStream;
 
@@ -111,6 +112,7 @@ private:
 
   // Various nCOMPtr handy typedefs
   typedef nsCOMPtr<nsIThread>                   nsIThreadPtr;
+  typedef nsCOMPtr<nsICryptoHash>               nsICryptoHashPtr;
 
   typedef nsCOMPtr<sbIAlbumArtFetcherSet>       sbIAlbumArtFetcherSetPtr;
   typedef nsCOMPtr<sbIMediacoreTypeSniffer>     sbIMediacoreTypeSnifferPtr;
@@ -153,7 +155,8 @@ private:
   struct iTunesTrack {
     iTunesTrack();
     ~iTunesTrack();
-    nsresult Initialize(sbIStringMap * aProperties);
+    nsresult Initialize(sbIStringMap * aProperties,
+                        nsICryptoHash * aHash);
     nsString GetContentType(sbIStringMap *aProperties);
     nsresult GetPropertyArray(sbIPropertyArray ** aPropertyArray);
     nsresult GetTrackURI(sbiTunesImporter::OSType aOSType, 
@@ -162,6 +165,10 @@ private:
                          nsIURI ** aURI);
     nsString mTrackID;
     nsString mSBGuid;
+    /**
+     * Hash of the imported properties, used to detect changed tracks
+     */
+    nsString mSignature;
     StringMap mProperties;
     nsCOMPtr<nsIURI> mURI;
   };
@@ -279,6 +286,16 @@ private:
    * Mapping of the iTunes ID to the songbird ID
    */
   TrackIDMap mTrackIDMap;
+  /**
+   * The stored signatures of the tracks imported from this iTunes library.
+   * Tracks are removed as they are seen, what is left once all tracks have
+   * been read are tracks that were removed from iTunes.
+   */
+  sbiTunesDatabaseServices::TrackSignatureMap mTrackSignatures;
+  /**
+   * Hash used to compute the track signatures
+   */
+  nsICryptoHashPtr mTrackHash;
   /**
    * Our type sniffer for determining supported media times
    */
@@ -357,9 +374,16 @@ private:
    */
   nsresult ProcessTrackBatch();
   /**
-   * Processes the tracks that exist and need updating in mTrackBatch
+   * Processes the tracks that exist and need updating in mTrackBatch.
+   * Tracks whose signature did not change since the last import are
+   * skipped.
    */
   nsresult ProcessUpdates();
+  /**
+   * Forgets the tracks that were imported before but are no longer in the
+   * iTunes library
+   */
+  nsresult ProcessRemovedTracks();
   /**
    * Hold over from old botched thread implementation
    */
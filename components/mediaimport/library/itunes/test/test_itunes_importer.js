@@ -39,6 +39,11 @@
 //------------------------------------------------------------------------------
 //------------------------------------------------------------------------------
 
+Components.utils.import("resource://gre/modules/XPCOMUtils.jsm");
+Components.utils.import("resource://app/jsmodules/ArrayConverter.jsm");
+Components.utils.import("resource://app/jsmodules/sbProperties.jsm");
+Components.utils.import("resource://app/jsmodules/sbLibraryUtils.jsm");
+
 /**
  * Run the unit tests.
  */
@@ -51,5 +56,117 @@ function runTest() {
                  .getService(Ci.sbILibraryImporter);
   } catch (ex) {}
   assertTrue(importer, "iTunes importer component is not available.");
+
+  testReimportDeletedItem(importer);
+}
+
+
+/**
+ * Test that a track whose media item was deleted after it was imported is
+ * imported again, even though the track itself did not change.
+ */
+
+function testReimportDeletedItem(aImporter) {
+  var library = LibraryUtils.mainLibrary;
+
+  // Use a unique library ID so earlier runs don't interfere.
+  var libraryID = "";
+  for (var i = 0; i < 16; i++) {
+    libraryID += Math.floor(Math.random() * 16).toString(16).toUpperCase();
+  }
+  var persistentID = "0123456789ABCDEF";
+
+  // Create the track media file and the iTunes library file.
+  var dir = Cc["@mozilla.org/file/directory_service;1"]
+              .getService(Ci.nsIProperties)
+              .get("TmpD", Ci.nsIFile);
+  dir.append("test_itunes_importer");
+  dir.createUnique(Ci.nsIFile.DIRECTORY_TYPE, 0755);
+  var mediaFile = dir.clone();
+  mediaFile.append("track.mp3");
+  mediaFile.create(Ci.nsIFile.NORMAL_FILE_TYPE, 0644);
+  var libraryFile = dir.clone();
+  libraryFile.append("iTunes Music Library.xml");
+
+  var xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" +
+            "<plist version=\"1.0\">\n" +
+            "<dict>\n" +
+            "  <key>Major Version</key><integer>1</integer>\n" +
+            "  <key>Minor Version</key><integer>1</integer>\n" +
+            "  <key>Library Persistent ID</key><string>" + libraryID +
+              "</string>\n" +
+            "  <key>Tracks</key>\n" +
+            "  <dict>\n" +
+            "    <key>100</key>\n" +
+            "    <dict>\n" +
+            "      <key>Track ID</key><integer>100</integer>\n" +
+            "      <key>Name</key><string>Deleted Track</string>\n" +
+            "      <key>Kind</key><string>MPEG audio file</string>\n" +
+            "      <key>Persistent ID</key><string>" + persistentID +
+              "</string>\n" +
+            "      <key>Track Type</key><string>File</string>\n" +
+            "      <key>Location</key><string>file://localhost" +
+              newFileURI(mediaFile).path + "</string>\n" +
+            "    </dict>\n" +
+            "  </dict>\n" +
+            "  <key>Playlists</key>\n" +
+            "  <array>\n" +
+            "  </array>\n" +
+            "</dict>\n" +
+            "</plist>\n";
+  var ostream = Cc["@mozilla.org/network/file-output-stream;1"]
+                  .createInstance(Ci.nsIFileOutputStream);
+  ostream.init(libraryFile, -1, -1, 0);
+  ostream.write(xml, xml.length);
+  ostream.close();
+
+  function getImportedItems() {
+    try {
+      return ArrayConverter.JSArray(
+               library.getItemsByProperty(SBProperties.iTunesGUID,
+                                          persistentID));
+    } catch (ex if ex.result == Cr.NS_ERROR_NOT_AVAILABLE) {
+      return [];
+    }
+  }
+
+  aImporter.initialize();
+  aImporter.setListener({
+    onLibraryChanged: function(aLibFilePath, aGUID) {},
+    onImportError: function() {},
+    onNonExistentMedia: function(aNonExistentMediaCount, aTrackCount) {},
+    onUnsupportedMedia: function() {},
+    onDirtyPlaylist: function(aPlaylistName, aApplyAll) { return "keep"; },
+    QueryInterface: XPCOMUtils.generateQI([Ci.sbILibraryImporterListener])
+  });
+
+  // Import the track, delete its media item and import it again.
+  importLibrary(aImporter, libraryFile.path);
+  var items = getImportedItems();
+  assertEqual(items.length, 1, "Track was not imported.");
+  library.remove(items[0]);
+  assertEqual(getImportedItems().length, 0);
+  importLibrary(aImporter, libraryFile.path);
+  items = getImportedItems();
+  assertEqual(items.length, 1, "Deleted track was not imported again.");
+
+  // Clean up.
+  library.remove(items[0]);
+  aImporter.finalize();
+  dir.remove(true);
+}
+
+
+/**
+ * Import the iTunes library file specified by aPath and wait for the import to
+ * finish.
+ */
+
+function importLibrary(aImporter, aPath) {
+  var job = aImporter.import(aPath, "songbird", false);
+  while (job.status == Ci.sbIJobProgress.STATUS_RUNNING) {
+    sleep(100, true);
+  }
+  assertEqual(job.status, Ci.sbIJobProgress.STATUS_SUCCEEDED);
 }
 
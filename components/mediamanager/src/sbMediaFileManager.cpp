@@ -26,6 +26,7 @@
 
 // Songbird includes
 #include "sbMediaFileManager.h"
+#include <sbFileCopyEngine.h>
 #include <sbILibraryUtils.h>
 #include <sbIMediaItem.h>
 #include <sbIPropertyInfo.h>
@@ -47,6 +48,7 @@
 #include <nsIPropertyBag2.h>
 #include <nsIStringBundle.h>
 #include <nsUnicharUtils.h>
+#include <nsAutoLock.h>
 
 #define PERMISSIONS_FILE  0644
 
@@ -98,7 +100,8 @@ static PRLogModuleInfo* gMediaFileManagerLog = nsnull;
  * \brief Constructor of the sbMediaFileManager component.
  */
 sbMediaFileManager::sbMediaFileManager()
-  : mInitialized(PR_FALSE)
+  : mInitialized(PR_FALSE),
+    mCopyEngineLock(nsnull)
 {
 #ifdef PR_LOGGING
   if (!gMediaFileManagerLog) {
@@ -114,6 +117,10 @@ sbMediaFileManager::sbMediaFileManager()
 sbMediaFileManager::~sbMediaFileManager()
 {
   TRACE(("%s", __FUNCTION__));
+
+  if (mCopyEngineLock) {
+    nsAutoLock::DestroyLock(mCopyEngineLock);
+  }
 }
 
 /**
@@ -185,6 +192,11 @@ NS_IMETHODIMP sbMediaFileManager::Init(nsIPropertyBag2 *aProperties)
   rv = InitMediaFoldersMap(properties);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  if (!mCopyEngineLock) {
+    mCopyEngineLock = nsAutoLock::NewLock("sbMediaFileManager::mCopyEngineLock");
+    NS_ENSURE_TRUE(mCopyEngineLock, NS_ERROR_OUT_OF_MEMORY);
+  }
+
   mInitialized = PR_TRUE;
 
   return NS_OK;
@@ -1384,8 +1396,16 @@ sbMediaFileManager::CopyRename(sbIMediaItem *aMediaItem,
   rv = GetMediaFolder(aSrcFile, getter_AddRefs(mediaFolder));
   NS_ENSURE_SUCCESS(rv, rv);
   if (!mediaFolder) {
-    // Copy since the original is not in the managed folder
-    rv = aSrcFile->CopyTo(newParentDir, newFilename);
+    // Copy since the original is not in the managed folder.  This goes
+    // through the copy engine, which avoids passing the data through user
+    // space where the platform allows it.
+    NS_ENSURE_TRUE(mCopyEngineLock, NS_ERROR_NOT_INITIALIZED);
+    nsAutoLock lock(mCopyEngineLock);
+    if (!mCopyEngine) {
+      mCopyEngine = new sbFileCopyEngine();
+      NS_ENSURE_TRUE(mCopyEngine, NS_ERROR_OUT_OF_MEMORY);
+    }
+    rv = mCopyEngine->CopyFile(aSrcFile, aDestFile);
     NS_ENSURE_SUCCESS(rv, rv);
     // TODO: Do some checks to make sure we successfully copied the file.
   } else {
@@ -38,6 +38,10 @@
 #include <nsTArray.h>
 #include <nsCOMPtr.h>
 #include <nsNetUtil.h>
+#include <nsAutoPtr.h>
+#include <prlock.h>
+
+class sbFileCopyEngine;
 
 #define SB_MEDIAFILEMANAGER_DESCRIPTION              \
   "Songbird Media File Manager Implementation"
@@ -155,5 +159,11 @@ private:
   NameTemplateMap                           mFolderNameTemplates;
   
   PRBool                                    mInitialized;
+
+  // Copies files from outside the managed folders. Created on first use and
+  // reused for every copy, so its buffer is only allocated once;
+  // mCopyEngineLock serializes its use.
+  PRLock *                                  mCopyEngineLock;
+  nsAutoPtr<sbFileCopyEngine>               mCopyEngine;
 };
 
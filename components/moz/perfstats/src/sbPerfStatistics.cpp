@@ -0,0 +1,991 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2009 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+#include "sbPerfStatistics.h"
+
+#include <nsIFile.h>
+#include <nsIObserverService.h>
+#include <nsIOutputStream.h>
+#include <nsIPrefBranch.h>
+#include <nsIPrefService.h>
+
+#include <nsAutoLock.h>
+#include <nsNetUtil.h>
+#include <nsServiceManagerUtils.h>
+#include <nsThreadUtils.h>
+#include <nsXPCOM.h>
+
+#include <sbStringUtils.h>
+
+#include <pratom.h>
+#include <prlog.h>
+
+/**
+ * To log this module, set the following environment variable:
+ *   NSPR_LOG_MODULES=sbPerfStatistics:5
+ */
+#ifdef PR_LOGGING
+static PRLogModuleInfo* gPerfStatisticsLog = nsnull;
+#define TRACE(args) PR_LOG(gPerfStatisticsLog, PR_LOG_DEBUG, args)
+#define LOG(args)   PR_LOG(gPerfStatisticsLog, PR_LOG_WARN, args)
+#else
+#define TRACE(args) /* nothing */
+#define LOG(args)   /* nothing */
+#endif
+
+#define SB_PERFSTATISTICS_ENABLED_PREF "songbird.perfstats.enabled"
+
+// Longest key kept, in bytes.
+#define SB_PERFSTATISTICS_MAX_KEY_LENGTH 256
+
+// Most distinct keys kept per category before keys are folded into
+// SB_PERFSTATISTICS_OVERFLOW_KEY.
+#define SB_PERFSTATISTICS_MAX_KEYS 512
+#define SB_PERFSTATISTICS_OVERFLOW_KEY "(other)"
+
+#define SB_PERFSTATISTICS_EXITED_THREADS "(exited)"
+
+static const char* const kCategoryNames[sbIPerfStatistics::CATEGORY_COUNT] = {
+  "db.query",
+  "propertycache",
+  "guidarray",
+  "metadata",
+  "mediacore.event",
+  "other"
+};
+
+/**
+ * \brief Append aValue to aJSON as a quoted JSON string.
+ */
+static void
+AppendJSONString(nsACString& aJSON, const nsACString& aValue)
+{
+  static const char kHexDigits[] = "0123456789abcdef";
+
+  aJSON.Append('"');
+
+  const char* current = aValue.BeginReading();
+  const char* end = aValue.EndReading();
+  for (; current < end; ++current) {
+    unsigned char c = static_cast<unsigned char>(*current);
+    switch (c) {
+      case '"':
+        aJSON.AppendLiteral("\\\"");
+        break;
+      case '\\':
+        aJSON.AppendLiteral("\\\\");
+        break;
+      case '\n':
+        aJSON.AppendLiteral("\\n");
+        break;
+      case '\r':
+        aJSON.AppendLiteral("\\r");
+        break;
+      case '\t':
+        aJSON.AppendLiteral("\\t");
+        break;
+      default:
+        if (c < 0x20) {
+          aJSON.AppendLiteral("\\u00");
+          aJSON.Append(kHexDigits[c >> 4]);
+          aJSON.Append(kHexDigits[c & 0xf]);
+        }
+        else {
+          aJSON.Append(*current);
+        }
+        break;
+    }
+  }
+
+  aJSON.Append('"');
+}
+
+/**
+ * \brief Append "aName": to aJSON.
+ */
+static void
+AppendJSONName(nsACString& aJSON, const char* aName)
+{
+  AppendJSONString(aJSON, nsDependentCString(aName));
+  aJSON.Append(':');
+}
+
+//------------------------------------------------------------------------------
+// sbPerfHistogram
+//------------------------------------------------------------------------------
+
+sbPerfHistogram::sbPerfHistogram() :
+  count(0),
+  total(0),
+  min(0),
+  max(0)
+{
+  memset(buckets, 0, sizeof(buckets));
+}
+
+/* static */ PRUint32
+sbPerfHistogram::BucketFor(PRUint64 aMicroseconds)
+{
+  PRUint32 bucket = 0;
+  while (aMicroseconds && bucket < sbIPerfStatistics::BUCKET_COUNT - 1) {
+    aMicroseconds >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+void
+sbPerfHistogram::Add(PRUint64 aMicroseconds)
+{
+  if (!count || aMicroseconds < min) {
+    min = aMicroseconds;
+  }
+  if (aMicroseconds > max) {
+    max = aMicroseconds;
+  }
+
+  ++count;
+  total += aMicroseconds;
+  ++buckets[BucketFor(aMicroseconds)];
+}
+
+void
+sbPerfHistogram::Merge(const sbPerfHistogram& aOther)
+{
+  if (!aOther.count) {
+    return;
+  }
+
+  if (!count || aOther.min < min) {
+    min = aOther.min;
+  }
+  if (aOther.max > max) {
+    max = aOther.max;
+  }
+
+  count += aOther.count;
+  total += aOther.total;
+  for (PRUint32 i = 0; i < sbIPerfStatistics::BUCKET_COUNT; ++i) {
+    buckets[i] += aOther.buckets[i];
+  }
+}
+
+PRUint64
+sbPerfHistogram::Percentile(PRUint32 aPercent) const
+{
+  if (!count) {
+    return 0;
+  }
+
+  PRUint64 target = (count * aPercent + 99) / 100;
+  if (!target) {
+    target = 1;
+  }
+
+  PRUint64 seen = 0;
+  for (PRUint32 i = 0; i < sbIPerfStatistics::BUCKET_COUNT - 1; ++i) {
+    seen += buckets[i];
+    if (seen >= target) {
+      // Bucket i holds [2^(i-1), 2^i), and bucket 0 only holds 0.
+      PRUint64 upper = (PRUint64(1) << i) - 1;
+      return upper < max ? upper : max;
+    }
+  }
+
+  // Only the open ended last bucket is left.
+  return max;
+}
+
+//------------------------------------------------------------------------------
+// sbPerfStatisticsSet
+//------------------------------------------------------------------------------
+
+struct sbPerfStatisticsEnumeration
+{
+  sbPerfStatisticsSet* set;
+  nsACString*          json;
+  PRUint32             category;
+  PRBool               first;
+};
+
+sbPerfStatisticsSet::sbPerfStatisticsSet() :
+  mSamples(0)
+{
+}
+
+nsresult
+sbPerfStatisticsSet::Init()
+{
+  for (PRUint32 i = 0; i < sbIPerfStatistics::CATEGORY_COUNT; ++i) {
+    PRBool success = mHistograms[i].Init();
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+
+    success = mCounters[i].Init();
+    NS_ENSURE_TRUE(success, NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  return NS_OK;
+}
+
+sbPerfHistogram*
+sbPerfStatisticsSet::GetHistogram(PRUint32 aCategory, const nsACString& aKey)
+{
+  nsClassHashtable<nsCStringHashKey, sbPerfHistogram>& histograms =
+    mHistograms[aCategory];
+
+  sbPerfHistogram* histogram = nsnull;
+  if (aKey.Length() <= SB_PERFSTATISTICS_MAX_KEY_LENGTH &&
+      histograms.Get(aKey, &histogram)) {
+    return histogram;
+  }
+
+  nsCAutoString key;
+  if (aKey.Length() > SB_PERFSTATISTICS_MAX_KEY_LENGTH) {
+    // Don't cut a UTF-8 sequence in half.
+    PRUint32 length = SB_PERFSTATISTICS_MAX_KEY_LENGTH;
+    while (length && (aKey.BeginReading()[length] & 0xC0) == 0x80) {
+      --length;
+    }
+    key.Assign(Substring(aKey, 0, length));
+    if (histograms.Get(key, &histogram)) {
+      return histogram;
+    }
+  }
+  else {
+    key.Assign(aKey);
+  }
+
+  if (histograms.Count() >= SB_PERFSTATISTICS_MAX_KEYS) {
+    key.AssignLiteral(SB_PERFSTATISTICS_OVERFLOW_KEY);
+    if (histograms.Get(key, &histogram)) {
+      return histogram;
+    }
+  }
+
+  nsAutoPtr<sbPerfHistogram> newHistogram(new sbPerfHistogram());
+  NS_ENSURE_TRUE(newHistogram, nsnull);
+
+  PRBool success = histograms.Put(key, newHistogram);
+  NS_ENSURE_TRUE(success, nsnull);
+
+  return newHistogram.forget();
+}
+
+void
+sbPerfStatisticsSet::RecordLatency(PRUint32 aCategory,
+                                   const nsACString& aKey,
+                                   PRUint64 aMicroseconds)
+{
+  sbPerfHistogram* histogram = GetHistogram(aCategory, aKey);
+  if (histogram) {
+    histogram->Add(aMicroseconds);
+    ++mSamples;
+  }
+}
+
+void
+sbPerfStatisticsSet::AddToCounter(PRUint32 aCategory,
+                                  const nsACString& aKey,
+                                  PRInt64 aDelta)
+{
+  nsDataHashtable<nsCStringHashKey, PRInt64>& counters = mCounters[aCategory];
+
+  // Counter keys are chosen by the callers rather than taken from data, so
+  // they are only truncated, never folded.
+  PRUint32 length = aKey.Length();
+  if (length > SB_PERFSTATISTICS_MAX_KEY_LENGTH) {
+    length = SB_PERFSTATISTICS_MAX_KEY_LENGTH;
+  }
+  const nsACString& key = Substring(aKey, 0, length);
+
+  PRInt64 value = 0;
+  counters.Get(key, &value);
+  counters.Put(key, value + aDelta);
+}
+
+/* static */ PLDHashOperator PR_CALLBACK
+sbPerfStatisticsSet::MergeHistogram(nsCStringHashKey::KeyType aKey,
+                                    sbPerfHistogram* aHistogram,
+                                    void* aUserData)
+{
+  sbPerfStatisticsEnumeration* enumeration =
+    static_cast<sbPerfStatisticsEnumeration*>(aUserData);
+
+  sbPerfHistogram* histogram =
+    enumeration->set->GetHistogram(enumeration->category, aKey);
+  NS_ENSURE_TRUE(histogram, PL_DHASH_STOP);
+
+  histogram->Merge(*aHistogram);
+  return PL_DHASH_NEXT;
+}
+
+/* static */ PLDHashOperator PR_CALLBACK
+sbPerfStatisticsSet::MergeCounter(nsCStringHashKey::KeyType aKey,
+                                  PRInt64 aValue,
+                                  void* aUserData)
+{
+  sbPerfStatisticsEnumeration* enumeration =
+    static_cast<sbPerfStatisticsEnumeration*>(aUserData);
+
+  enumeration->set->AddToCounter(enumeration->category, aKey, aValue);
+  return PL_DHASH_NEXT;
+}
+
+void
+sbPerfStatisticsSet::Merge(sbPerfStatisticsSet& aOther)
+{
+  sbPerfStatisticsEnumeration enumeration;
+  enumeration.set = this;
+  enumeration.json = nsnull;
+  enumeration.first = PR_TRUE;
+
+  for (PRUint32 i = 0; i < sbIPerfStatistics::CATEGORY_COUNT; ++i) {
+    enumeration.category = i;
+    aOther.mHistograms[i].EnumerateRead(MergeHistogram, &enumeration);
+    aOther.mCounters[i].EnumerateRead(MergeCounter, &enumeration);
+  }
+
+  mSamples += aOther.mSamples;
+}
+
+void
+sbPerfStatisticsSet::Clear()
+{
+  for (PRUint32 i = 0; i < sbIPerfStatistics::CATEGORY_COUNT; ++i) {
+    mHistograms[i].Clear();
+    mCounters[i].Clear();
+  }
+
+  mSamples = 0;
+}
+
+/* static */ PLDHashOperator PR_CALLBACK
+sbPerfStatisticsSet::AppendHistogram(nsCStringHashKey::KeyType aKey,
+                                     sbPerfHistogram* aHistogram,
+                                     void* aUserData)
+{
+  sbPerfStatisticsEnumeration* enumeration =
+    static_cast<sbPerfStatisticsEnumeration*>(aUserData);
+  nsACString& json = *enumeration->json;
+
+  if (!enumeration->first) {
+    json.Append(',');
+  }
+  enumeration->first = PR_FALSE;
+
+  AppendJSONString(json, aKey);
+  json.AppendLiteral(":{");
+
+  AppendJSONName(json, "count");
+  json.Append(sbCAutoString(aHistogram->count));
+  json.Append(',');
+  AppendJSONName(json, "total");
+  json.Append(sbCAutoString(aHistogram->total));
+  json.Append(',');
+  AppendJSONName(json, "min");
+  json.Append(sbCAutoString(aHistogram->min));
+  json.Append(',');
+  AppendJSONName(json, "max");
+  json.Append(sbCAutoString(aHistogram->max));
+  json.Append(',');
+  AppendJSONName(json, "mean");
+  json.Append(sbCAutoString(aHistogram->count ?
+                            aHistogram->total / aHistogram->count :
+                            PRUint64(0)));
+  json.Append(',');
+  AppendJSONName(json, "p50");
+  json.Append(sbCAutoString(aHistogram->Percentile(50)));
+  json.Append(',');
+  AppendJSONName(json, "p90");
+  json.Append(sbCAutoString(aHistogram->Percentile(90)));
+  json.Append(',');
+  AppendJSONName(json, "p99");
+  json.Append(sbCAutoString(aHistogram->Percentile(99)));
+  json.Append(',');
+
+  // Trailing empty buckets are left out.
+  PRUint32 bucketCount = sbIPerfStatistics::BUCKET_COUNT;
+  while (bucketCount && !aHistogram->buckets[bucketCount - 1]) {
+    --bucketCount;
+  }
+
+  AppendJSONName(json, "buckets");
+  json.Append('[');
+  for (PRUint32 i = 0; i < bucketCount; ++i) {
+    if (i) {
+      json.Append(',');
+    }
+    json.Append(sbCAutoString(aHistogram->buckets[i]));
+  }
+  json.AppendLiteral("]}");
+
+  return PL_DHASH_NEXT;
+}
+
+/* static */ PLDHashOperator PR_CALLBACK
+sbPerfStatisticsSet::AppendCounter(nsCStringHashKey::KeyType aKey,
+                                   PRInt64 aValue,
+                                   void* aUserData)
+{
+  sbPerfStatisticsEnumeration* enumeration =
+    static_cast<sbPerfStatisticsEnumeration*>(aUserData);
+  nsACString& json = *enumeration->json;
+
+  if (!enumeration->first) {
+    json.Append(',');
+  }
+  enumeration->first = PR_FALSE;
+
+  AppendJSONString(json, aKey);
+  json.Append(':');
+  json.Append(sbCAutoString(aValue));
+
+  return PL_DHASH_NEXT;
+}
+
+void
+sbPerfStatisticsSet::AppendHistogramsJSON(nsACString& aJSON)
+{
+  sbPerfStatisticsEnumeration enumeration;
+  enumeration.set = this;
+  enumeration.json = &aJSON;
+
+  aJSON.Append('{');
+  for (PRUint32 i = 0; i < sbIPerfStatistics::CATEGORY_COUNT; ++i) {
+    if (i) {
+      aJSON.Append(',');
+    }
+    AppendJSONName(aJSON, kCategoryNames[i]);
+    aJSON.Append('{');
+
+    enumeration.category = i;
+    enumeration.first = PR_TRUE;
+    mHistograms[i].EnumerateRead(AppendHistogram, &enumeration);
+
+    aJSON.Append('}');
+  }
+  aJSON.Append('}');
+}
+
+void
+sbPerfStatisticsSet::AppendCountersJSON(nsACString& aJSON)
+{
+  sbPerfStatisticsEnumeration enumeration;
+  enumeration.set = this;
+  enumeration.json = &aJSON;
+
+  aJSON.Append('{');
+  for (PRUint32 i = 0; i < sbIPerfStatistics::CATEGORY_COUNT; ++i) {
+    if (i) {
+      aJSON.Append(',');
+    }
+    AppendJSONName(aJSON, kCategoryNames[i]);
+    aJSON.Append('{');
+
+    enumeration.category = i;
+    enumeration.first = PR_TRUE;
+    mCounters[i].EnumerateRead(AppendCounter, &enumeration);
+
+    aJSON.Append('}');
+  }
+  aJSON.Append('}');
+}
+
+//------------------------------------------------------------------------------
+// sbPerfThreadStatistics
+//------------------------------------------------------------------------------
+
+sbPerfThreadStatistics::sbPerfThreadStatistics(sbPerfStatistics* aOwner,
+                                               const nsACString& aName) :
+  owner(aOwner),
+  lock(nsAutoLock::NewLock("sbPerfThreadStatistics::lock")),
+  name(aName)
+{
+  MOZ_COUNT_CTOR(sbPerfThreadStatistics);
+}
+
+sbPerfThreadStatistics::~sbPerfThreadStatistics()
+{
+  MOZ_COUNT_DTOR(sbPerfThreadStatistics);
+
+  if (lock) {
+    nsAutoLock::DestroyLock(lock);
+  }
+}
+
+//------------------------------------------------------------------------------
+// sbPerfStatistics
+//------------------------------------------------------------------------------
+
+NS_IMPL_THREADSAFE_ISUPPORTS2(sbPerfStatistics,
+                              sbIPerfStatistics,
+                              nsIObserver)
+
+sbPerfStatistics::sbPerfStatistics() :
+  mLock(nsnull),
+  mThreadIndex(0),
+  mEnabled(PR_TRUE),
+  mShutdown(PR_FALSE),
+  mHeldReferencesReleased(PR_FALSE),
+  mThreadSerial(0),
+  mResetTime(PR_Now())
+{
+#ifdef PR_LOGGING
+  if (!gPerfStatisticsLog) {
+    gPerfStatisticsLog = PR_NewLogModule("sbPerfStatistics");
+  }
+#endif
+}
+
+sbPerfStatistics::~sbPerfStatistics()
+{
+  // Every thread statistics object and every held cache reference keeps us
+  // alive, so there can't be any left by now.
+  NS_ASSERTION(mThreads.IsEmpty(), "Destroyed with live thread statistics");
+  NS_ASSERTION(mHeldReferences.IsEmpty(), "Destroyed with held references");
+
+  if (mLock) {
+    nsAutoLock::DestroyLock(mLock);
+  }
+}
+
+nsresult
+sbPerfStatistics::Init()
+{
+  TRACE(("sbPerfStatistics[0x%x] - Init", this));
+
+  // Preferences and the observer service are main thread only.
+  NS_ENSURE_TRUE(NS_IsMainThread(), NS_ERROR_NOT_SAME_THREAD);
+
+  nsresult rv;
+
+  mLock = nsAutoLock::NewLock("sbPerfStatistics::mLock");
+  NS_ENSURE_TRUE(mLock, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = mRetired.Init();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRStatus status = PR_NewThreadPrivateIndex(&mThreadIndex,
+                                             ReleaseThreadStatistics);
+  NS_ENSURE_TRUE(status == PR_SUCCESS, NS_ERROR_FAILURE);
+
+  nsCOMPtr<nsIPrefBranch> prefBranch =
+    do_GetService(NS_PREFSERVICE_CONTRACTID, &rv);
+  if (NS_SUCCEEDED(rv)) {
+    PRBool enabled;
+    rv = prefBranch->GetBoolPref(SB_PERFSTATISTICS_ENABLED_PREF, &enabled);
+    if (NS_SUCCEEDED(rv)) {
+      mEnabled = enabled;
+    }
+  }
+
+  nsCOMPtr<nsIObserverService> observerService =
+    do_GetService("@mozilla.org/observer-service;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = observerService->AddObserver(this,
+                                    NS_XPCOM_SHUTDOWN_OBSERVER_ID,
+                                    PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = observerService->AddObserver(this,
+                                    NS_XPCOM_SHUTDOWN_THREADS_OBSERVER_ID,
+                                    PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+sbPerfThreadStatistics*
+sbPerfStatistics::GetThreadStatistics()
+{
+  if (mShutdown) {
+    return nsnull;
+  }
+
+  sbPerfThreadStatistics* thread =
+    static_cast<sbPerfThreadStatistics*>(PR_GetThreadPrivate(mThreadIndex));
+  if (thread) {
+    return thread;
+  }
+
+  nsCAutoString name;
+  if (NS_IsMainThread()) {
+    name.AssignLiteral("main");
+  }
+  else {
+    nsAutoLock lock(mLock);
+    name.AssignLiteral("thread-");
+    name.AppendInt(PRInt32(++mThreadSerial));
+  }
+
+  nsAutoPtr<sbPerfThreadStatistics> newThread(
+    new sbPerfThreadStatistics(this, name));
+  NS_ENSURE_TRUE(newThread && newThread->lock, nsnull);
+
+  nsresult rv = newThread->statistics.Init();
+  NS_ENSURE_SUCCESS(rv, nsnull);
+
+  {
+    nsAutoLock lock(mLock);
+    if (mShutdown) {
+      return nsnull;
+    }
+
+    sbPerfThreadStatistics** added = mThreads.AppendElement(newThread.get());
+    NS_ENSURE_TRUE(added, nsnull);
+  }
+
+  PRStatus status = PR_SetThreadPrivate(mThreadIndex, newThread);
+  if (status != PR_SUCCESS) {
+    NS_WARNING("Failed to store thread statistics");
+    nsAutoLock lock(mLock);
+    mThreads.RemoveElement(newThread.get());
+    return nsnull;
+  }
+
+  return newThread.forget();
+}
+
+void
+sbPerfStatistics::RetireThread(sbPerfThreadStatistics* aThread)
+{
+  TRACE(("sbPerfStatistics[0x%x] - RetireThread %s",
+         this, aThread->name.get()));
+
+  nsAutoLock lock(mLock);
+
+  {
+    nsAutoLock threadLock(aThread->lock);
+    mRetired.Merge(aThread->statistics);
+  }
+
+  mThreads.RemoveElement(aThread);
+}
+
+void
+sbPerfStatistics::ReleaseHeldReferences()
+{
+  TRACE(("sbPerfStatistics[0x%x] - ReleaseHeldReferences", this));
+
+  nsTArray<sbIPerfStatistics**> heldReferences;
+  {
+    nsAutoLock lock(mLock);
+    mHeldReferencesReleased = PR_TRUE;
+    heldReferences.SwapElements(mHeldReferences);
+
+    // Clear the caches first; threads reading a cache that is being cleared
+    // still use a live service since the service manager holds it too.
+    for (PRUint32 i = 0; i < heldReferences.Length(); ++i) {
+      *heldReferences[i] = nsnull;
+    }
+  }
+
+  for (PRUint32 i = 0; i < heldReferences.Length(); ++i) {
+    NS_RELEASE_THIS();
+  }
+}
+
+/* static */ void PR_CALLBACK
+sbPerfStatistics::ReleaseThreadStatistics(void* aPrivate)
+{
+  sbPerfThreadStatistics* thread =
+    static_cast<sbPerfThreadStatistics*>(aPrivate);
+
+  thread->owner->RetireThread(thread);
+
+  // May release the last reference to the service.
+  delete thread;
+}
+
+NS_IMETHODIMP
+sbPerfStatistics::GetEnabled(PRBool* aEnabled)
+{
+  NS_ENSURE_ARG_POINTER(aEnabled);
+  *aEnabled = mEnabled && !mShutdown;
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPerfStatistics::SetEnabled(PRBool aEnabled)
+{
+  PR_AtomicSet(&mEnabled, aEnabled ? PR_TRUE : PR_FALSE);
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPerfStatistics::RecordLatency(PRUint32 aCategory,
+                                const nsACString& aKey,
+                                PRUint64 aMicroseconds)
+{
+  NS_ENSURE_TRUE(aCategory < CATEGORY_COUNT, NS_ERROR_INVALID_ARG);
+
+  if (!mEnabled) {
+    return NS_OK;
+  }
+
+  sbPerfThreadStatistics* thread = GetThreadStatistics();
+  if (!thread) {
+    return NS_OK;
+  }
+
+  nsAutoLock lock(thread->lock);
+  thread->statistics.RecordLatency(aCategory, aKey, aMicroseconds);
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPerfStatistics::AddToCounter(PRUint32 aCategory,
+                               const nsACString& aKey,
+                               PRInt64 aDelta)
+{
+  NS_ENSURE_TRUE(aCategory < CATEGORY_COUNT, NS_ERROR_INVALID_ARG);
+
+  if (!mEnabled) {
+    return NS_OK;
+  }
+
+  sbPerfThreadStatistics* thread = GetThreadStatistics();
+  if (!thread) {
+    return NS_OK;
+  }
+
+  nsAutoLock lock(thread->lock);
+  thread->statistics.AddToCounter(aCategory, aKey, aDelta);
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPerfStatistics::GetCategoryName(PRUint32 aCategory, nsACString& _retval)
+{
+  NS_ENSURE_TRUE(aCategory < CATEGORY_COUNT, NS_ERROR_INVALID_ARG);
+  _retval.Assign(kCategoryNames[aCategory]);
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPerfStatistics::Snapshot(PRBool aReset, nsAString& _retval)
+{
+  nsresult rv;
+
+  sbPerfStatisticsSet totals;
+  rv = totals.Init();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCString threads;
+  PRTime now = PR_Now();
+  PRTime interval;
+
+  {
+    nsAutoLock lock(mLock);
+
+    interval = now - mResetTime;
+
+    for (PRUint32 i = 0; i < mThreads.Length(); ++i) {
+      sbPerfThreadStatistics* thread = mThreads[i];
+      nsAutoLock threadLock(thread->lock);
+
+      totals.Merge(thread->statistics);
+
+      if (i) {
+        threads.Append(',');
+      }
+      threads.Append('{');
+      AppendJSONName(threads, "name");
+      AppendJSONString(threads, thread->name);
+      threads.Append(',');
+      AppendJSONName(threads, "samples");
+      threads.Append(sbCAutoString(thread->statistics.mSamples));
+      threads.Append(',');
+      AppendJSONName(threads, "counters");
+      thread->statistics.AppendCountersJSON(threads);
+      threads.Append('}');
+
+      if (aReset) {
+        thread->statistics.Clear();
+      }
+    }
+
+    totals.Merge(mRetired);
+
+    if (!mThreads.IsEmpty()) {
+      threads.Append(',');
+    }
+    threads.Append('{');
+    AppendJSONName(threads, "name");
+    AppendJSONString(threads,
+                     NS_LITERAL_CSTRING(SB_PERFSTATISTICS_EXITED_THREADS));
+    threads.Append(',');
+    AppendJSONName(threads, "samples");
+    threads.Append(sbCAutoString(mRetired.mSamples));
+    threads.Append(',');
+    AppendJSONName(threads, "counters");
+    mRetired.AppendCountersJSON(threads);
+    threads.Append('}');
+
+    if (aReset) {
+      mRetired.Clear();
+      mResetTime = now;
+    }
+  }
+
+  nsCString json;
+  json.Append('{');
+  AppendJSONName(json, "timestamp");
+  json.Append(sbCAutoString(PRInt64(now / PR_USEC_PER_MSEC)));
+  json.Append(',');
+  AppendJSONName(json, "interval");
+  json.Append(sbCAutoString(PRInt64(interval / PR_USEC_PER_MSEC)));
+  json.Append(',');
+  AppendJSONName(json, "samples");
+  json.Append(sbCAutoString(totals.mSamples));
+  json.Append(',');
+  AppendJSONName(json, "histograms");
+  totals.AppendHistogramsJSON(json);
+  json.Append(',');
+  AppendJSONName(json, "counters");
+  totals.AppendCountersJSON(json);
+  json.Append(',');
+  AppendJSONName(json, "threads");
+  json.Append('[');
+  json.Append(threads);
+  json.AppendLiteral("]}");
+
+  CopyUTF8toUTF16(json, _retval);
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPerfStatistics::Reset()
+{
+  nsAutoLock lock(mLock);
+
+  for (PRUint32 i = 0; i < mThreads.Length(); ++i) {
+    nsAutoLock threadLock(mThreads[i]->lock);
+    mThreads[i]->statistics.Clear();
+  }
+
+  mRetired.Clear();
+  mResetTime = PR_Now();
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPerfStatistics::DumpToFile(nsIFile* aFile, PRBool aReset)
+{
+  NS_ENSURE_ARG_POINTER(aFile);
+
+  nsresult rv;
+
+  nsString snapshot;
+  rv = Snapshot(aReset, snapshot);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  NS_ConvertUTF16toUTF8 output(snapshot);
+  output.Append('\n');
+
+  nsCOMPtr<nsIOutputStream> outputStream;
+  rv = NS_NewLocalFileOutputStream(getter_AddRefs(outputStream),
+                                   aFile,
+                                   PR_APPEND | PR_CREATE_FILE | PR_WRONLY);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 bytesOut = 0;
+  rv = outputStream->Write(output.BeginReading(), output.Length(), &bytesOut);
+
+  // Close it off regardless of the error
+  nsresult rvclose = outputStream->Close();
+
+  NS_ENSURE_SUCCESS(rv, rv);
+  NS_ENSURE_TRUE(bytesOut == output.Length(), NS_ERROR_UNEXPECTED);
+  NS_ENSURE_SUCCESS(rvclose, rvclose);
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP_(PRBool)
+sbPerfStatistics::HoldReference(sbIPerfStatistics** aCache)
+{
+  NS_ENSURE_TRUE(aCache, PR_FALSE);
+
+  nsAutoLock lock(mLock);
+
+  if (mHeldReferencesReleased) {
+    return PR_FALSE;
+  }
+
+  // Threads of the same library may race to fill the cache.
+  if (mHeldReferences.Contains(aCache)) {
+    return PR_TRUE;
+  }
+
+  sbIPerfStatistics*** added = mHeldReferences.AppendElement(aCache);
+  NS_ENSURE_TRUE(added, PR_FALSE);
+
+  NS_ADDREF_THIS();
+  *aCache = this;
+
+  return PR_TRUE;
+}
+
+NS_IMETHODIMP
+sbPerfStatistics::Observe(nsISupports* aSubject,
+                          const char* aTopic,
+                          const PRUnichar* aData)
+{
+  if (!strcmp(aTopic, NS_XPCOM_SHUTDOWN_OBSERVER_ID)) {
+    nsresult rv;
+    nsCOMPtr<nsIObserverService> observerService =
+      do_GetService("@mozilla.org/observer-service;1", &rv);
+    if (NS_SUCCEEDED(rv)) {
+      observerService->RemoveObserver(this, NS_XPCOM_SHUTDOWN_OBSERVER_ID);
+    }
+
+    ReleaseHeldReferences();
+  }
+  else if (!strcmp(aTopic, NS_XPCOM_SHUTDOWN_THREADS_OBSERVER_ID)) {
+    nsresult rv;
+    nsCOMPtr<nsIObserverService> observerService =
+      do_GetService("@mozilla.org/observer-service;1", &rv);
+    if (NS_SUCCEEDED(rv)) {
+      observerService->RemoveObserver(this,
+                                      NS_XPCOM_SHUTDOWN_THREADS_OBSERVER_ID);
+    }
+
+    {
+      nsAutoLock lock(mLock);
+      mShutdown = PR_TRUE;
+    }
+
+    // Thread pools have been shut down by now; retire the statistics of the
+    // main thread so that it drops its reference to us.
+    PR_SetThreadPrivate(mThreadIndex, nsnull);
+  }
+
+  return NS_OK;
+}
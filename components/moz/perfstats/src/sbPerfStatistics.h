@@ -0,0 +1,209 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2009 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+#ifndef __SB_PERFSTATISTICS_H__
+#define __SB_PERFSTATISTICS_H__
+
+#include <sbIPerfStatistics.h>
+
+#include <nsIObserver.h>
+
+#include <nsAutoPtr.h>
+#include <nsClassHashtable.h>
+#include <nsDataHashtable.h>
+#include <nsHashKeys.h>
+#include <nsStringGlue.h>
+#include <nsTArray.h>
+
+#include <prlock.h>
+#include <prthread.h>
+
+#define SB_PERFSTATISTICS_CLASSNAME "Songbird Performance Statistics"
+
+// {f450df94-bf3d-4310-837a-7d79b5402568}
+#define SB_PERFSTATISTICS_CID \
+{ 0xf450df94, 0xbf3d, 0x4310, \
+  { 0x83, 0x7a, 0x7d, 0x79, 0xb5, 0x40, 0x25, 0x68 } }
+
+/**
+ * \brief Latency histogram of a single key, in microseconds.
+ */
+struct sbPerfHistogram
+{
+  sbPerfHistogram();
+
+  void Add(PRUint64 aMicroseconds);
+  void Merge(const sbPerfHistogram& aOther);
+
+  /**
+   * \brief Estimate a percentile from the buckets. The estimate is the
+   *        largest value of the bucket holding the percentile, clamped to the
+   *        largest sample.
+   */
+  PRUint64 Percentile(PRUint32 aPercent) const;
+
+  static PRUint32 BucketFor(PRUint64 aMicroseconds);
+
+  PRUint64 count;
+  PRUint64 total;
+  PRUint64 min;
+  PRUint64 max;
+  PRUint64 buckets[sbIPerfStatistics::BUCKET_COUNT];
+};
+
+/**
+ * \brief Histograms and counters of every category.
+ *
+ * Not thread safe; each instance is protected by the lock of its owner.
+ */
+class sbPerfStatisticsSet
+{
+public:
+  sbPerfStatisticsSet();
+
+  nsresult Init();
+
+  void RecordLatency(PRUint32 aCategory,
+                     const nsACString& aKey,
+                     PRUint64 aMicroseconds);
+  void AddToCounter(PRUint32 aCategory,
+                    const nsACString& aKey,
+                    PRInt64 aDelta);
+
+  void Merge(sbPerfStatisticsSet& aOther);
+  void Clear();
+
+  void AppendHistogramsJSON(nsACString& aJSON);
+  void AppendCountersJSON(nsACString& aJSON);
+
+  PRUint64 mSamples;
+
+private:
+  // Return the histogram for a key, creating it if needed. Long keys are
+  // truncated and, once a category holds too many distinct keys, new keys
+  // are folded into a single overflow key so that statements with inlined
+  // values cannot grow the tables without bound.
+  sbPerfHistogram* GetHistogram(PRUint32 aCategory, const nsACString& aKey);
+
+  static PLDHashOperator PR_CALLBACK
+    MergeHistogram(nsCStringHashKey::KeyType aKey,
+                   sbPerfHistogram* aHistogram,
+                   void* aUserData);
+  static PLDHashOperator PR_CALLBACK
+    MergeCounter(nsCStringHashKey::KeyType aKey,
+                 PRInt64 aValue,
+                 void* aUserData);
+  static PLDHashOperator PR_CALLBACK
+    AppendHistogram(nsCStringHashKey::KeyType aKey,
+                    sbPerfHistogram* aHistogram,
+                    void* aUserData);
+  static PLDHashOperator PR_CALLBACK
+    AppendCounter(nsCStringHashKey::KeyType aKey,
+                  PRInt64 aValue,
+                  void* aUserData);
+
+  nsClassHashtable<nsCStringHashKey, sbPerfHistogram>
+    mHistograms[sbIPerfStatistics::CATEGORY_COUNT];
+  nsDataHashtable<nsCStringHashKey, PRInt64>
+    mCounters[sbIPerfStatistics::CATEGORY_COUNT];
+};
+
+class sbPerfStatistics;
+
+/**
+ * \brief Statistics recorded by a single thread.
+ *
+ * The lock is only ever contended by snapshots and resets.
+ */
+struct sbPerfThreadStatistics
+{
+  sbPerfThreadStatistics(sbPerfStatistics* aOwner, const nsACString& aName);
+  ~sbPerfThreadStatistics();
+
+  // Keeps the service alive until the thread has exited.
+  nsRefPtr<sbPerfStatistics> owner;
+  PRLock*                    lock;
+  nsCString                  name;
+  sbPerfStatisticsSet        statistics;
+};
+
+/**
+ * \class sbPerfStatistics
+ * \brief Implementation of sbIPerfStatistics.
+ *
+ * Each recording thread lazily gets an sbPerfThreadStatistics stored in
+ * thread private data. When the thread exits, its statistics are merged into
+ * mRetired so that snapshots still include them. The main thread's
+ * statistics are retired on xpcom-shutdown-threads, after which nothing more
+ * is recorded.
+ *
+ * References held for the native helpers (see HoldReference) are released
+ * on xpcom-shutdown. The service manager still holds the service until after
+ * xpcom-shutdown-threads, so threads still recording are not affected.
+ */
+class sbPerfStatistics : public sbIPerfStatistics,
+                         public nsIObserver
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBIPERFSTATISTICS
+  NS_DECL_NSIOBSERVER
+
+  sbPerfStatistics();
+
+  nsresult Init();
+
+private:
+  ~sbPerfStatistics();
+
+  /**
+   * \brief Return the statistics of the calling thread, creating them on
+   *        first use. Returns null once shutdown has started.
+   */
+  sbPerfThreadStatistics* GetThreadStatistics();
+
+  void RetireThread(sbPerfThreadStatistics* aThread);
+
+  void ReleaseHeldReferences();
+
+  static void PR_CALLBACK ReleaseThreadStatistics(void* aPrivate);
+
+  PRLock* mLock;
+
+  PRUintn  mThreadIndex;
+  PRInt32  mEnabled;
+  PRInt32  mShutdown;
+  PRBool   mHeldReferencesReleased;
+  PRUint32 mThreadSerial;
+  PRTime   mResetTime;
+
+  // Threads which are still alive, in the order they first recorded.
+  nsTArray<sbPerfThreadStatistics*> mThreads;
+  sbPerfStatisticsSet               mRetired;
+
+  // Caches holding a reference, see HoldReference.
+  nsTArray<sbIPerfStatistics**>     mHeldReferences;
+};
+
+#endif /* __SB_PERFSTATISTICS_H__ */
@@ -0,0 +1,94 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2009 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+#include "sbPerfStatistics.h"
+
+#include <nsICategoryManager.h>
+#include <nsIGenericFactory.h>
+#include <nsServiceManagerUtils.h>
+
+NS_GENERIC_FACTORY_CONSTRUCTOR_INIT(sbPerfStatistics, Init)
+
+/**
+ * The service reads preferences when it is created, so it is created on the
+ * main thread at app-startup rather than by the first thread to record.
+ */
+static NS_METHOD
+sbPerfStatisticsRegister(nsIComponentManager*         aCompMgr,
+                         nsIFile*                     aPath,
+                         const char*                  aLoaderStr,
+                         const char*                  aType,
+                         const nsModuleComponentInfo* aInfo)
+{
+  nsresult rv;
+
+  nsCOMPtr<nsICategoryManager> categoryManager =
+    do_GetService(NS_CATEGORYMANAGER_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = categoryManager->AddCategoryEntry("app-startup",
+                                         SB_PERFSTATISTICS_CLASSNAME,
+                                         "service,"
+                                         SB_PERFSTATISTICS_CONTRACTID,
+                                         PR_TRUE,
+                                         PR_TRUE,
+                                         nsnull);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+static NS_METHOD
+sbPerfStatisticsUnregister(nsIComponentManager*         aCompMgr,
+                           nsIFile*                     aPath,
+                           const char*                  aLoaderStr,
+                           const nsModuleComponentInfo* aInfo)
+{
+  nsresult rv;
+
+  nsCOMPtr<nsICategoryManager> categoryManager =
+    do_GetService(NS_CATEGORYMANAGER_CONTRACTID, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = categoryManager->DeleteCategoryEntry("app-startup",
+                                            SB_PERFSTATISTICS_CLASSNAME,
+                                            PR_TRUE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+static const nsModuleComponentInfo components[] =
+{
+  {
+    SB_PERFSTATISTICS_CLASSNAME,
+    SB_PERFSTATISTICS_CID,
+    SB_PERFSTATISTICS_CONTRACTID,
+    sbPerfStatisticsConstructor,
+    sbPerfStatisticsRegister,
+    sbPerfStatisticsUnregister
+  }
+};
+
+NS_IMPL_NSGETMODULE(SongbirdPerfStatisticsModule, components)
@@ -0,0 +1,189 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2009 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+#ifndef __SB_PERFSTATISTICSUTILS_H__
+#define __SB_PERFSTATISTICSUTILS_H__
+
+/**
+ * \file sbPerfStatisticsUtils.h
+ * \brief Helpers for recording into sbIPerfStatistics from native code.
+ *
+ * The helpers are header only so that components can use them without
+ * linking against anything; they only need the perfstats public and src
+ * directories on their include path.
+ *
+ *   {
+ *     sbAutoPerfLatency latency(sbIPerfStatistics::CATEGORY_GUID_ARRAY,
+ *                               NS_LITERAL_CSTRING("fetch"));
+ *     ...
+ *   }
+ *
+ *   sbPerfStatisticsCount(sbIPerfStatistics::CATEGORY_PROPERTY_CACHE,
+ *                         NS_LITERAL_CSTRING("hit"),
+ *                         hits);
+ */
+
+#include <sbIPerfStatistics.h>
+
+#include <nsIServiceManager.h>
+
+#include <nsServiceManagerUtils.h>
+#include <nsStringGlue.h>
+#include <nsThreadUtils.h>
+#include <nsXPCOM.h>
+
+#include <pratom.h>
+#include <prtime.h>
+
+/**
+ * \brief Return the statistics service, or null if it is not available or
+ *        recording is disabled.
+ *
+ * The service is looked up once per component library and cached, so that
+ * recording never goes through the service manager. The service releases the
+ * cached reference on xpcom-shutdown (see sbIPerfStatistics::holdReference),
+ * after which nothing is looked up again.
+ *
+ * Only the main thread may create the service. Other threads record nothing
+ * until it has been created, which normally happens at app-startup.
+ */
+inline sbIPerfStatistics*
+sbGetPerfStatistics()
+{
+  static sbIPerfStatistics* sStatistics = nsnull;
+  static PRInt32 sReleased = PR_FALSE;
+
+  sbIPerfStatistics* statistics = sStatistics;
+  if (!statistics) {
+    if (sReleased) {
+      return nsnull;
+    }
+
+    nsresult rv;
+    if (!NS_IsMainThread()) {
+      nsCOMPtr<nsIServiceManager> serviceManager;
+      rv = NS_GetServiceManager(getter_AddRefs(serviceManager));
+      if (NS_FAILED(rv)) {
+        return nsnull;
+      }
+
+      PRBool instantiated = PR_FALSE;
+      rv = serviceManager->IsServiceInstantiatedByContractID(
+                             SB_PERFSTATISTICS_CONTRACTID,
+                             NS_GET_IID(sbIPerfStatistics),
+                             &instantiated);
+      if (NS_FAILED(rv) || !instantiated) {
+        return nsnull;
+      }
+    }
+
+    nsCOMPtr<sbIPerfStatistics> service =
+      do_GetService(SB_PERFSTATISTICS_CONTRACTID, &rv);
+    if (NS_FAILED(rv)) {
+      return nsnull;
+    }
+
+    if (!service->HoldReference(&sStatistics)) {
+      PR_AtomicSet(&sReleased, PR_TRUE);
+      return nsnull;
+    }
+
+    // The service manager keeps the service alive past the point where the
+    // cached reference is released.
+    statistics = service;
+  }
+
+  PRBool enabled = PR_FALSE;
+  nsresult rv = statistics->GetEnabled(&enabled);
+  if (NS_FAILED(rv) || !enabled) {
+    return nsnull;
+  }
+
+  return statistics;
+}
+
+/**
+ * \brief Add aDelta to a counter of the statistics service, if enabled.
+ */
+inline void
+sbPerfStatisticsCount(PRUint32 aCategory,
+                      const nsACString& aKey,
+                      PRInt64 aDelta = 1)
+{
+  sbIPerfStatistics* statistics = sbGetPerfStatistics();
+  if (statistics) {
+    statistics->AddToCounter(aCategory, aKey, aDelta);
+  }
+}
+
+/**
+ * \class sbAutoPerfLatency
+ * \brief Record the lifetime of the object as a latency sample.
+ *
+ * The key is copied; literal and shared strings are cheap to copy. Nothing
+ * is timed if recording is disabled when the object is created.
+ */
+class sbAutoPerfLatency
+{
+public:
+  sbAutoPerfLatency(PRUint32 aCategory, const nsACString& aKey) :
+    mStatistics(sbGetPerfStatistics()),
+    mCategory(aCategory),
+    mStart(0)
+  {
+    if (mStatistics) {
+      mKey.Assign(aKey);
+      mStart = PR_Now();
+    }
+  }
+
+  ~sbAutoPerfLatency()
+  {
+    if (mStatistics) {
+      PRTime elapsed = PR_Now() - mStart;
+      mStatistics->RecordLatency(mCategory,
+                                 mKey,
+                                 elapsed > 0 ? PRUint64(elapsed) : 0);
+    }
+  }
+
+  /**
+   * \brief Do not record a sample, e.g. because the operation failed early.
+   */
+  void Cancel() { mStatistics = nsnull; }
+
+private:
+  // Not to be copied or allocated on the heap.
+  sbAutoPerfLatency(const sbAutoPerfLatency&);
+  sbAutoPerfLatency& operator=(const sbAutoPerfLatency&);
+  static void* operator new(size_t) CPP_THROW_NEW;
+  static void operator delete(void*);
+
+  sbIPerfStatistics* mStatistics;
+  PRUint32           mCategory;
+  nsCString          mKey;
+  PRTime             mStart;
+};
+
+#endif /* __SB_PERFSTATISTICSUTILS_H__ */
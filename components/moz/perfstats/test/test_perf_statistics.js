@@ -0,0 +1,145 @@
+/**
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2008 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+ */
+
+/**
+ * \brief Performance statistics service unit tests
+ */
+
+function runTest () {
+  var stats = Cc["@songbirdnest.com/Songbird/PerfStatistics;1"]
+                .getService(Ci.sbIPerfStatistics);
+  stats.enabled = true;
+  stats.reset();
+
+  const CATEGORY = Ci.sbIPerfStatistics.CATEGORY_OTHER;
+  const CATEGORY_NAME = stats.getCategoryName(CATEGORY);
+  assertEqual(CATEGORY_NAME, "other");
+  assertEqual(stats.getCategoryName(Ci.sbIPerfStatistics.CATEGORY_DB_QUERY),
+              "db.query");
+
+  // Samples land in log2 buckets of microseconds.
+  stats.recordLatency(CATEGORY, "test", 0);
+  stats.recordLatency(CATEGORY, "test", 1);
+  stats.recordLatency(CATEGORY, "test", 3);
+  stats.recordLatency(CATEGORY, "test", 1000);
+  stats.addToCounter(CATEGORY, "counter", 5);
+  stats.addToCounter(CATEGORY, "counter", -2);
+
+  var snapshot = JSON.parse(stats.snapshot(false));
+  var histogram = snapshot.histograms[CATEGORY_NAME]["test"];
+  assertEqual(histogram.count, 4);
+  assertEqual(histogram.total, 1004);
+  assertEqual(histogram.min, 0);
+  assertEqual(histogram.max, 1000);
+  assertEqual(histogram.mean, 251);
+  assertEqual(histogram.buckets.length, 11);
+  assertEqual(histogram.buckets[0], 1);
+  assertEqual(histogram.buckets[1], 1);
+  assertEqual(histogram.buckets[2], 1);
+  assertEqual(histogram.buckets[10], 1);
+  // Percentiles report the largest value of their bucket, so the second of
+  // the four samples (1us, bucket [1, 2)) gives 1.
+  assertEqual(histogram.p50, 1);
+  assertEqual(histogram.p90, 1000);
+  assertEqual(histogram.p99, 1000);
+  assertEqual(snapshot.counters[CATEGORY_NAME]["counter"], 3);
+  assertEqual(snapshot.samples, 4);
+
+  // Every category is reported, even without samples.
+  assertTrue("mediacore.event" in snapshot.histograms);
+  assertTrue("propertycache" in snapshot.counters);
+
+  // The main thread is reported with its own counters.
+  var main = snapshot.threads.filter(function(t) t.name == "main")[0];
+  assertTrue(main);
+  assertEqual(main.samples, 4);
+  assertEqual(main.counters[CATEGORY_NAME]["counter"], 3);
+
+  // Keys are escaped and long keys are truncated.
+  var longKey = "SELECT \"x\"\n" + new Array(400).join("a");
+  stats.recordLatency(CATEGORY, longKey, 10);
+  snapshot = JSON.parse(stats.snapshot(false));
+  var keys = [key for (key in snapshot.histograms[CATEGORY_NAME])];
+  assertEqual(keys.length, 2);
+  var truncated = keys.filter(function(k) k != "test")[0];
+  assertEqual(truncated.length, 256);
+  assertEqual(truncated, longKey.substr(0, 256));
+
+  // Snapshots can reset what they report.
+  snapshot = JSON.parse(stats.snapshot(true));
+  assertEqual(snapshot.samples, 5);
+  snapshot = JSON.parse(stats.snapshot(false));
+  assertEqual(snapshot.samples, 0);
+  assertFalse("test" in snapshot.histograms[CATEGORY_NAME]);
+
+  // Nothing is recorded while disabled.
+  stats.enabled = false;
+  stats.recordLatency(CATEGORY, "test", 1);
+  stats.enabled = true;
+  snapshot = JSON.parse(stats.snapshot(false));
+  assertEqual(snapshot.samples, 0);
+
+  // Unknown categories are rejected.
+  try {
+    stats.recordLatency(Ci.sbIPerfStatistics.CATEGORY_COUNT, "test", 1);
+    fail("Recorded into an unknown category");
+  }
+  catch (e) {
+    assertEqual(e.result, Cr.NS_ERROR_INVALID_ARG);
+  }
+
+  // Dumps are appended as one line of JSON each.
+  var file = Cc["@mozilla.org/file/directory_service;1"]
+               .getService(Ci.nsIProperties)
+               .get("TmpD", Ci.nsIFile);
+  file.append("test_perf_statistics.json");
+  file.createUnique(Ci.nsIFile.NORMAL_FILE_TYPE, 0644);
+
+  stats.recordLatency(CATEGORY, "test", 1);
+  stats.dumpToFile(file, false);
+  stats.dumpToFile(file, true);
+
+  var lines = readFile(file).split("\n");
+  assertEqual(lines.length, 3);
+  assertEqual(lines[2], "");
+  assertEqual(JSON.parse(lines[0]).samples, 1);
+  assertEqual(JSON.parse(lines[1]).samples, 1);
+  assertEqual(JSON.parse(stats.snapshot(false)).samples, 0);
+
+  file.remove(false);
+}
+
+function readFile(aFile) {
+  var stream = Cc["@mozilla.org/network/file-input-stream;1"]
+                 .createInstance(Ci.nsIFileInputStream);
+  stream.init(aFile, -1, 0, 0);
+  var scriptable = Cc["@mozilla.org/scriptableinputstream;1"]
+                     .createInstance(Ci.nsIScriptableInputStream);
+  scriptable.init(stream);
+  var data = scriptable.read(scriptable.available());
+  scriptable.close();
+  return data;
+}
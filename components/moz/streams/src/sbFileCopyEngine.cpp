@@ -0,0 +1,218 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2011 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+
+#include "sbFileCopyEngine.h"
+
+// Mozilla includes
+#include <nsCOMPtr.h>
+#include <nsILocalFile.h>
+
+// NSPR includes
+#include <prlog.h>
+#include <prmem.h>
+
+// Songbird includes
+#include <sbMemoryUtils.h>
+
+// Local includes
+#include "sbFileUtils.h"
+
+#if defined(XP_UNIX) && !defined(XP_MACOSX)
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <private/pprio.h>
+#endif
+
+/**
+ * To log this module, set the following environment variable:
+ *   NSPR_LOG_MODULES=sbFileCopyEngine:5
+ */
+#ifdef PR_LOGGING
+static PRLogModuleInfo* gFileCopyEngineLog = nsnull;
+#define TRACE(args) PR_BEGIN_MACRO \
+  if (!gFileCopyEngineLog) \
+    gFileCopyEngineLog = PR_NewLogModule("sbFileCopyEngine"); \
+  PR_LOG(gFileCopyEngineLog, PR_LOG_DEBUG, args); \
+PR_END_MACRO
+#define LOG(args) PR_BEGIN_MACRO \
+  if (!gFileCopyEngineLog) \
+    gFileCopyEngineLog = PR_NewLogModule("sbFileCopyEngine"); \
+  PR_LOG(gFileCopyEngineLog, PR_LOG_WARN, args); \
+PR_END_MACRO
+#else
+#define TRACE(args) /* nothing */
+#define LOG(args)   /* nothing */
+#endif
+
+// Alignment of the copy buffer, a multiple of any disk block size
+#define SB_FILE_COPY_BUFFER_ALIGNMENT 4096
+
+SB_AUTO_NULL_CLASS(sbAutoPRFileDesc, PRFileDesc*, PR_Close(mValue));
+
+sbFileCopyEngine::sbFileCopyEngine() :
+  mAllocation(nsnull),
+  mBuffer(nsnull)
+{
+}
+
+sbFileCopyEngine::~sbFileCopyEngine()
+{
+  if (mAllocation)
+    PR_Free(mAllocation);
+}
+
+nsresult
+sbFileCopyEngine::CopyFile(nsIFile * aSource, nsIFile * aDestination)
+{
+  NS_ENSURE_ARG_POINTER(aSource);
+  NS_ENSURE_ARG_POINTER(aDestination);
+
+  nsresult rv;
+
+  nsCOMPtr<nsILocalFile> source = do_QueryInterface(aSource, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+  nsCOMPtr<nsILocalFile> destination = do_QueryInterface(aDestination, &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 permissions;
+  rv = source->GetPermissions(&permissions);
+  if (NS_FAILED(rv))
+    permissions = SB_DEFAULT_FILE_PERMISSIONS;
+
+  nsCOMPtr<nsIFile> parent;
+  rv = destination->GetParent(getter_AddRefs(parent));
+  NS_ENSURE_SUCCESS(rv, rv);
+  PRBool exists;
+  rv = parent->Exists(&exists);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (!exists) {
+    rv = parent->Create(nsIFile::DIRECTORY_TYPE,
+                        SB_DEFAULT_DIRECTORY_PERMISSIONS);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  sbAutoPRFileDesc sourceFD;
+  rv = source->OpenNSPRFileDesc(PR_RDONLY, 0, sourceFD.StartAssignment());
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  sbAutoPRFileDesc destinationFD;
+  rv = destination->OpenNSPRFileDesc(PR_WRONLY | PR_CREATE_FILE | PR_TRUNCATE,
+                                     permissions,
+                                     destinationFD.StartAssignment());
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = CopyData(sourceFD, destinationFD);
+  if (NS_SUCCEEDED(rv) && PR_Close(destinationFD.forget()) != PR_SUCCESS)
+    rv = NS_ERROR_FILE_ACCESS_DENIED;
+  if (NS_FAILED(rv)) {
+    TRACE(("sbFileCopyEngine::CopyFile: failed 0x%08x", rv));
+    destinationFD.Clear();
+    destination->Remove(PR_FALSE);
+    return rv;
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbFileCopyEngine::CopyData(PRFileDesc * aSource, PRFileDesc * aDestination)
+{
+#if defined(XP_UNIX) && !defined(XP_MACOSX)
+  // Let the kernel copy the data without passing it through user space,
+  // falling back to the next method if the file systems don't support it.
+  // Each method copies from the current file offsets, so a fallback part way
+  // through continues where the previous method stopped.
+  int sourceFD = PR_FileDesc2NativeHandle(aSource);
+  int destinationFD = PR_FileDesc2NativeHandle(aDestination);
+
+#ifdef __NR_copy_file_range
+  while (PR_TRUE) {
+    long copied = syscall(__NR_copy_file_range,
+                          sourceFD, NULL,
+                          destinationFD, NULL,
+                          (size_t)SB_FILE_COPY_CHUNK_SIZE,
+                          0);
+    if (copied == 0)
+      return NS_OK;
+    if (copied < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+          errno != EOPNOTSUPP)
+        return NS_ERROR_FILE_ACCESS_DENIED;
+      break;
+    }
+  }
+#endif
+
+  while (PR_TRUE) {
+    ssize_t copied = sendfile(destinationFD,
+                              sourceFD,
+                              NULL,
+                              SB_FILE_COPY_CHUNK_SIZE);
+    if (copied == 0)
+      return NS_OK;
+    if (copied < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != ENOSYS && errno != EINVAL)
+        return NS_ERROR_FILE_ACCESS_DENIED;
+      break;
+    }
+  }
+#endif
+
+  // Plain buffered copy. Align the buffer so the platform can skip its own
+  // copy on direct I/O capable file systems.
+  if (!mBuffer) {
+    mAllocation = static_cast<char*>(
+      PR_Malloc(SB_FILE_COPY_BUFFER_SIZE + SB_FILE_COPY_BUFFER_ALIGNMENT));
+    NS_ENSURE_TRUE(mAllocation, NS_ERROR_OUT_OF_MEMORY);
+    PRUptrdiff address = reinterpret_cast<PRUptrdiff>(mAllocation);
+    address = (address + SB_FILE_COPY_BUFFER_ALIGNMENT - 1) &
+              ~((PRUptrdiff)SB_FILE_COPY_BUFFER_ALIGNMENT - 1);
+    mBuffer = reinterpret_cast<char*>(address);
+  }
+
+  while (PR_TRUE) {
+    PRInt32 bytesRead = PR_Read(aSource, mBuffer, SB_FILE_COPY_BUFFER_SIZE);
+    NS_ENSURE_TRUE(bytesRead >= 0, NS_ERROR_FILE_ACCESS_DENIED);
+    if (bytesRead == 0)
+      return NS_OK;
+
+    PRInt32 bytesWritten = 0;
+    while (bytesWritten < bytesRead) {
+      PRInt32 written = PR_Write(aDestination,
+                                 mBuffer + bytesWritten,
+                                 bytesRead - bytesWritten);
+      NS_ENSURE_TRUE(written > 0, NS_ERROR_FILE_NO_DEVICE_SPACE);
+      bytesWritten += written;
+    }
+  }
+
+  return NS_OK;
+}
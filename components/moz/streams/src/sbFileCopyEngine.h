@@ -0,0 +1,88 @@
+/*
+ *=BEGIN SONGBIRD GPL
+ *
+ * This file is part of the Songbird web player.
+ *
+ * Copyright(c) 2005-2011 POTI, Inc.
+ * http://www.songbirdnest.com
+ *
+ * This file may be licensed under the terms of of the
+ * GNU General Public License Version 2 (the ``GPL'').
+ *
+ * Software distributed under the License is distributed
+ * on an ``AS IS'' basis, WITHOUT WARRANTY OF ANY KIND, either
+ * express or implied. See the GPL for the specific language
+ * governing rights and limitations.
+ *
+ * You should have received a copy of the GPL along with this
+ * program. If not, go to http://www.gnu.org/licenses/gpl.html
+ * or write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *=END SONGBIRD GPL
+ */
+
+
+#ifndef SBFILECOPYENGINE_H_
+#define SBFILECOPYENGINE_H_
+
+// Mozilla includes
+#include <nsIFile.h>
+
+// NSPR includes
+#include <prio.h>
+
+//
+// Copy engine settings.
+//
+//   SB_FILE_COPY_BUFFER_SIZE   Size of the buffer used when the platform has
+//                              no kernel copy call.
+//   SB_FILE_COPY_CHUNK_SIZE    Maximum number of bytes passed to one kernel
+//                              copy call.
+//
+
+#define SB_FILE_COPY_BUFFER_SIZE             (1024 * 1024)
+#define SB_FILE_COPY_CHUNK_SIZE              (8 * 1024 * 1024)
+
+/**
+ * Copies files using the kernel's file to file copy calls where they are
+ * available (copy_file_range or sendfile on Linux), and a large aligned buffer
+ * otherwise.
+ *
+ * Usage:
+ *
+ *   sbFileCopyEngine engine;
+ *   rv = engine.CopyFile(source, destination);
+ *
+ * Files are copied on the calling thread, and like nsIFile::CopyTo, are left
+ * for the operating system to flush to disk. The buffer is allocated on first
+ * use and kept for later copies, so an engine should be reused for a series
+ * of copies. An instance is not thread safe.
+ */
+class sbFileCopyEngine
+{
+public:
+  sbFileCopyEngine();
+
+  ~sbFileCopyEngine();
+
+  /**
+   * Copy aSource to aDestination. The destination is overwritten, and its
+   * parent directory created if needed. If the copy fails, the destination is
+   * removed.
+   */
+  nsresult CopyFile(nsIFile * aSource, nsIFile * aDestination);
+
+private:
+  nsresult CopyData(PRFileDesc * aSource, PRFileDesc * aDestination);
+
+  //
+  //   mAllocation              Memory holding mBuffer.
+  //   mBuffer                  Aligned copy buffer, within mAllocation.
+  //
+
+  char * mAllocation;
+  char * mBuffer;
+};
+
+#endif /* SBFILECOPYENGINE_H_ */
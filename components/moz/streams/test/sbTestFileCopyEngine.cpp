@@ -0,0 +1,50 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#include "sbTestFileCopyEngine.h"
+
+#include <sbFileCopyEngine.h>
+
+NS_IMPL_ISUPPORTS1(sbTestFileCopyEngine, sbITestFileCopyEngine)
+
+sbTestFileCopyEngine::sbTestFileCopyEngine()
+{
+}
+
+sbTestFileCopyEngine::~sbTestFileCopyEngine()
+{
+}
+
+NS_IMETHODIMP
+sbTestFileCopyEngine::CopyFile(nsIFile * aSource, nsIFile * aDestination)
+{
+  if (!mEngine) {
+    mEngine = new sbFileCopyEngine();
+    NS_ENSURE_TRUE(mEngine, NS_ERROR_OUT_OF_MEMORY);
+  }
+
+  return mEngine->CopyFile(aSource, aDestination);
+}
@@ -0,0 +1,65 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+#ifndef sbTestFileCopyEngine_h
+#define sbTestFileCopyEngine_h
+
+#include <nsAutoPtr.h>
+
+#include "sbITestFileCopyEngine.h"
+
+class sbFileCopyEngine;
+
+class sbTestFileCopyEngine : public sbITestFileCopyEngine
+{
+public:
+  NS_DECL_ISUPPORTS
+  NS_DECL_SBITESTFILECOPYENGINE
+
+  sbTestFileCopyEngine();
+
+private:
+  ~sbTestFileCopyEngine();
+
+  nsAutoPtr<sbFileCopyEngine> mEngine;
+};
+
+#define SB_TEST_FILE_COPY_ENGINE_DESCRIPTION              \
+  "Songbird Test File Copy Engine"
+#define SB_TEST_FILE_COPY_ENGINE_CONTRACTID               \
+  "@songbirdnest.com/Songbird/sbTestFileCopyEngine;1"
+#define SB_TEST_FILE_COPY_ENGINE_CLASSNAME                \
+  "sbTestFileCopyEngine"
+
+#define SB_TEST_FILE_COPY_ENGINE_CID                      \
+{ /* 210a5860-8136-4d91-aa30-91e738c27c4c */              \
+  0x210a5860,                                             \
+  0x8136,                                                 \
+  0x4d91,                                                 \
+  { 0xaa, 0x30, 0x91, 0xe7, 0x38, 0xc2, 0x7c, 0x4c }      \
+}
+
+#endif /* sbTestFileCopyEngine_h */
@@ -0,0 +1,141 @@
+/*
+//
+// BEGIN SONGBIRD GPL
+//
+// This file is part of the Songbird web player.
+//
+// Copyright(c) 2005-2010 POTI, Inc.
+// http://songbirdnest.com
+//
+// This file may be licensed under the terms of of the
+// GNU General Public License Version 2 (the "GPL").
+//
+// Software distributed under the License is distributed
+// on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, either
+// express or implied. See the GPL for the specific language
+// governing rights and limitations.
+//
+// You should have received a copy of the GPL along with this
+// program. If not, go to http://www.gnu.org/licenses/gpl.html
+// or write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+//
+// END SONGBIRD GPL
+//
+*/
+
+/**
+ * \file  test_file_copy_engine.js
+ * \brief Javascript source for the file copy engine unit tests.
+ */
+
+/**
+ * Write aLength bytes of a repeating, non-uniform pattern to aFile.
+ */
+function writeTestFile(aFile, aLength) {
+  var pattern = "";
+  for (var i = 0; i < 1021; ++i) {
+    pattern += String.fromCharCode(32 + (i * 7) % 95);
+  }
+
+  var stream = Cc["@mozilla.org/network/file-output-stream;1"]
+                 .createInstance(Ci.nsIFileOutputStream);
+  // PR_WRONLY | PR_CREATE_FILE | PR_TRUNCATE
+  stream.init(aFile, 0x02 | 0x08 | 0x20, 0644, 0);
+  var written = 0;
+  while (written < aLength) {
+    var data = pattern.substr(0, aLength - written);
+    stream.write(data, data.length);
+    written += data.length;
+  }
+  stream.close();
+}
+
+function testCopy(aEngine, aDir) {
+  // Larger than the copy buffer, and not a multiple of its size
+  var source = aDir.clone();
+  source.append("source.dat");
+  writeTestFile(source, 2 * 1024 * 1024 + 12345);
+
+  // The destination's parent directories are created
+  var destination = aDir.clone();
+  destination.append("a");
+  destination.append("b");
+  destination.append("destination.dat");
+  aEngine.copyFile(source, destination);
+  assertEqual(destination.fileSize, source.fileSize);
+  assertFilesEqual(source, destination, "copy differs from its source");
+
+  // An existing destination is overwritten, including when it's longer
+  var smallSource = aDir.clone();
+  smallSource.append("small.dat");
+  writeTestFile(smallSource, 100);
+  aEngine.copyFile(smallSource, destination);
+  assertEqual(destination.fileSize, 100);
+  assertFilesEqual(smallSource, destination, "overwrite differs from source");
+
+  // Empty files
+  var emptySource = aDir.clone();
+  emptySource.append("empty.dat");
+  writeTestFile(emptySource, 0);
+  var emptyDestination = aDir.clone();
+  emptyDestination.append("empty copy.dat");
+  aEngine.copyFile(emptySource, emptyDestination);
+  assertTrue(emptyDestination.exists(), "empty file not copied");
+  assertEqual(emptyDestination.fileSize, 0);
+}
+
+function testFailureCleanup(aEngine, aDir) {
+  // A missing source fails before anything is created
+  var missing = aDir.clone();
+  missing.append("missing.dat");
+  var destination = aDir.clone();
+  destination.append("failed.dat");
+  var failed = false;
+  try {
+    aEngine.copyFile(missing, destination);
+  }
+  catch (e) {
+    failed = true;
+  }
+  assertTrue(failed, "copying a missing file succeeded");
+  assertFalse(destination.exists(), "destination left by a missing source");
+
+  // A source that opens but can't be read fails part way through the copy,
+  // after the destination was created
+  if (getPlatform() != "Windows_NT") {
+    var unreadable = aDir.clone();
+    unreadable.append("directory");
+    unreadable.create(Ci.nsIFile.DIRECTORY_TYPE, 0755);
+    failed = false;
+    try {
+      aEngine.copyFile(unreadable, destination);
+    }
+    catch (e) {
+      failed = true;
+    }
+    assertTrue(failed, "copying a directory succeeded");
+    assertFalse(destination.exists(), "destination left by a failed copy");
+  }
+
+  // The engine still works after a failure
+  var source = aDir.clone();
+  source.append("after failure.dat");
+  writeTestFile(source, 4096);
+  aEngine.copyFile(source, destination);
+  assertFilesEqual(source, destination, "copy after failure differs");
+}
+
+function runTest() {
+  var engine = Cc["@songbirdnest.com/Songbird/sbTestFileCopyEngine;1"]
+                 .createInstance(Ci.sbITestFileCopyEngine);
+
+  var dir = Cc["@songbirdnest.com/Songbird/TemporaryFileService;1"]
+              .getService(Ci.sbITemporaryFileService)
+              .createFile(Ci.nsIFile.DIRECTORY_TYPE);
+
+  testCopy(engine, dir);
+  testFailureCleanup(engine, dir);
+
+  dir.remove(true);
+}
@@ -2000,6 +2000,9 @@ function plCmd_GetSelectedItemWrapperForPlaylist(aPlaylist) {
 function plCmd_QueueSaveToPlaylist_TriggerCallback(aContext, aSubMenuId, aCommandId, aHost) {
   var queueService = Cc["@songbirdnest.com/Songbird/playqueue/service;1"]
                        .getService(Ci.sbIPlayQueueService);
+  // The rest of long lists queued as segments is not in the queue list yet
+  if (queueService.pendingLength > 0 && !queueService.operationInProgress)
+    queueService.expandPending();
   var newMediaList = aContext.window.makeNewPlaylist("simple");
   newMediaList.addAll(queueService.mediaList);
 }
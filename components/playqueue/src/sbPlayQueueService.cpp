@@ -29,11 +29,14 @@
 
 #include "sbPlayQueueService.h"
 
+#include <nsAppDirectoryServiceDefs.h>
 #include <nsIAppStartupNotifier.h>
 #include <nsICategoryManager.h>
+#include <nsIFile.h>
 #include <nsIObserverService.h>
 #include <nsIPrefBranch.h>
 #include <nsIPrefService.h>
+#include <nsIProperties.h>
 #include <nsIStringBundle.h>
 #include <nsIVariant.h>
 #include <nsServiceManagerUtils.h>
@@ -50,6 +53,7 @@
 #include <sbIOrderableMediaList.h>
 #include <sbLibraryManager.h>
 #include <sbPropertiesCID.h>
+#include <sbFileObjectStreams.h>
 #include <sbStandardProperties.h>
 #include <sbStringUtils.h>
 
@@ -74,6 +78,26 @@
 
 #define SB_BUNDLE_URL "chrome://songbird/locale/songbird.properties"
 
+/*
+ * Lists and views longer than this are queued as segments, and segments are
+ * added to the queue list this many items at a time
+ */
+#define SB_PLAYQUEUE_SEGMENT_CHUNK 100
+
+/*
+ * The next chunk of a segment is added once the current index gets this
+ * close to the end of the part of the segment that is in the queue list
+ */
+#define SB_PLAYQUEUE_SEGMENT_LOOKAHEAD 20
+
+/*
+ * View segments that are still pending at shutdown are saved to this file in
+ * the profile and restored on the next start, rather than being added to the
+ * queue list in full
+ */
+#define SB_PLAYQUEUE_SEGMENTS_FILENAME "playqueue-segments.dat"
+#define SB_PLAYQUEUE_SEGMENTS_SCHEMA_VERSION 1
+
 #define SB_PLAYQUEUE_PANE_TITLE NS_LITERAL_STRING("playqueue.pane.title")
 #define SB_LIBRARY_TRACKSADDED NS_LITERAL_STRING("library.tracksadded")
 
@@ -212,6 +236,7 @@ sbPlayQueueService::sbPlayQueueService()
     mSequencerOnQueue(PR_FALSE),
     mSequencerPlayingOrPaused(PR_FALSE),
     mOperationInProgress(PR_FALSE),
+    mExpandPending(PR_FALSE),
     mLibraryListener(nsnull),
     mWeakMediacoreManager(nsnull),
     mAsyncListener(nsnull)
@@ -302,6 +327,7 @@ sbPlayQueueService::Finalize()
   }
 
   mRemovedItemGUIDs.Clear();
+  mSegments.Clear();
 
   if (mInitialized) {
     nsCOMPtr<nsIObserverService> observerService =
@@ -376,9 +402,13 @@ sbPlayQueueService::SetIndex(PRUint32 aIndex)
   }
 
   // Notify listeners.
-  if (mIndex != oldIndex)
+  if (mIndex != oldIndex) {
     mListeners.EnumerateEntries(OnIndexUpdatedCallback, &mIndex);
 
+    // Playback may have got close to the pending items of a segment
+    ScheduleExpandSegments();
+  }
+
   return NS_OK;
 }
 
@@ -394,6 +424,37 @@ sbPlayQueueService::GetOperationInProgress(PRBool *aOperationInProgress)
   return NS_OK;
 }
 
+NS_IMETHODIMP
+sbPlayQueueService::GetPendingLength(PRUint32* aPendingLength)
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+
+  NS_ENSURE_ARG_POINTER(aPendingLength);
+
+  *aPendingLength = 0;
+  for (PRUint32 i = 0; i < mSegments.Length(); ++i) {
+    *aPendingLength += mSegments[i].end - mSegments[i].next;
+  }
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPlayQueueService::ExpandPending()
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+
+  NS_ASSERTION(NS_IsMainThread(),
+    "ExpandPending() must be called from the main thread");
+  NS_ENSURE_TRUE(mInitialized, NS_ERROR_NOT_INITIALIZED);
+  NS_ENSURE_FALSE(mOperationInProgress, NS_ERROR_NOT_AVAILABLE);
+
+  nsresult rv = ExpandSegments(PR_TRUE, PR_TRUE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
 NS_IMETHODIMP
 sbPlayQueueService::QueueNext(sbIMediaItem* aMediaItem)
 {
@@ -430,8 +491,19 @@ sbPlayQueueService::QueueNext(sbIMediaItem* aMediaItem)
 
   nsCOMPtr<sbIMediaList> itemAsList = do_QueryInterface(aMediaItem, &rv);
   if (NS_SUCCEEDED(rv)) {
-    // The item is a mediaList
-    if (callQueueLast) {
+    // The item is a mediaList. Long lists are queued as a segment whose items
+    // are added as playback gets close to them.
+    PRUint32 listLength;
+    rv = itemAsList->GetLength(&listLength);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (listLength > SB_PLAYQUEUE_SEGMENT_CHUNK) {
+      nsCOMPtr<sbIMediaListView> view;
+      rv = itemAsList->CreateView(nsnull, getter_AddRefs(view));
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      rv = QueueSegment(view, callQueueLast ? length : insertBeforeIndex);
+    } else if (callQueueLast) {
       rv = QueueLastInternal(itemAsList);
     } else {
       rv = QueueNextInternal(itemAsList, insertBeforeIndex);
@@ -471,8 +543,24 @@ sbPlayQueueService::QueueLast(sbIMediaItem* aMediaItem)
 
   nsCOMPtr<sbIMediaList> itemAsList = do_QueryInterface(aMediaItem, &rv);
   if (NS_SUCCEEDED(rv)) {
-    // The item is a medialist
-    rv = QueueLastInternal(itemAsList);
+    // The item is a medialist. Long lists are queued as a segment.
+    PRUint32 listLength;
+    rv = itemAsList->GetLength(&listLength);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (listLength > SB_PLAYQUEUE_SEGMENT_CHUNK) {
+      nsCOMPtr<sbIMediaListView> view;
+      rv = itemAsList->CreateView(nsnull, getter_AddRefs(view));
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      PRUint32 length;
+      rv = mMediaList->GetLength(&length);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      rv = QueueSegment(view, length);
+    } else {
+      rv = QueueLastInternal(itemAsList);
+    }
   } else {
     rv = QueueLastInternal(aMediaItem);
   }
@@ -538,6 +626,14 @@ sbPlayQueueService::QueueSomeNext(nsISimpleEnumerator* aMediaItems)
   NS_ENSURE_TRUE(mInitialized, NS_ERROR_NOT_INITIALIZED);
   nsresult rv;
 
+  nsCOMPtr<nsIMutableArray> items;
+  rv = DrainEnumerator(aMediaItems, getter_AddRefs(items));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 count;
+  rv = items->GetLength(&count);
+  NS_ENSURE_SUCCESS(rv, rv);
+
   mIgnoreListListener = PR_TRUE;
 
   rv = NotifyQueueOperationStarted();
@@ -551,8 +647,20 @@ sbPlayQueueService::QueueSomeNext(nsISimpleEnumerator* aMediaItems)
   rv = mMediaList->GetLength(&length);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Many items are queued as a segment, like long lists
+  if (count > SB_PLAYQUEUE_SEGMENT_CHUNK) {
+    rv = QueueSomeSegment(items, PR_MIN(insertBeforeIndex, length));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    return NS_OK;
+  }
+
+  nsCOMPtr<nsISimpleEnumerator> enumerator;
+  rv = items->Enumerate(getter_AddRefs(enumerator));
+  NS_ENSURE_SUCCESS(rv, rv);
+
   if (insertBeforeIndex >= length) {
-    rv = mMediaList->AddMediaItems(aMediaItems, mAsyncListener, true);
+    rv = mMediaList->AddMediaItems(enumerator, mAsyncListener, true);
     NS_ENSURE_SUCCESS(rv, rv);
   } else {
     nsCOMPtr<sbIOrderableMediaList> orderedList =
@@ -560,7 +668,7 @@ sbPlayQueueService::QueueSomeNext(nsISimpleEnumerator* aMediaItems)
     NS_ENSURE_SUCCESS(rv, rv);
 
     rv = orderedList->InsertSomeBeforeAsync(insertBeforeIndex,
-                                            aMediaItems,
+                                            enumerator,
                                             mAsyncListener);
     NS_ENSURE_SUCCESS(rv, rv);
   }
@@ -581,14 +689,100 @@ sbPlayQueueService::QueueSomeLast(nsISimpleEnumerator* aMediaItems)
   NS_ENSURE_TRUE(mInitialized, NS_ERROR_NOT_INITIALIZED);
   nsresult rv;
 
+  nsCOMPtr<nsIMutableArray> items;
+  rv = DrainEnumerator(aMediaItems, getter_AddRefs(items));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 count;
+  rv = items->GetLength(&count);
+  NS_ENSURE_SUCCESS(rv, rv);
+
   mIgnoreListListener = PR_TRUE;
 
   rv = NotifyQueueOperationStarted();
   NS_ENSURE_SUCCESS(rv, rv);
 
-  rv = mMediaList->AddMediaItems(aMediaItems, mAsyncListener, true);
+  if (count > SB_PLAYQUEUE_SEGMENT_CHUNK) {
+    PRUint32 length;
+    rv = mMediaList->GetLength(&length);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = QueueSomeSegment(items, length);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    return NS_OK;
+  }
+
+  nsCOMPtr<nsISimpleEnumerator> enumerator;
+  rv = items->Enumerate(getter_AddRefs(enumerator));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = mMediaList->AddMediaItems(enumerator, mAsyncListener, true);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPlayQueueService::QueueViewNext(sbIMediaListView* aView)
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+
+  NS_ASSERTION(NS_IsMainThread(),
+    "QueueViewNext() must be called from the main thread");
+  NS_ASSERTION(!mOperationInProgress,
+    "QueueViewNext() should not be called while an async operation is in progress");
+  NS_ENSURE_ARG_POINTER(aView);
+  NS_ENSURE_TRUE(mInitialized, NS_ERROR_NOT_INITIALIZED);
+  nsresult rv;
+
+  // Queue a clone so that the view can keep changing in the UI
+  nsCOMPtr<sbIMediaListView> view;
+  rv = aView->Clone(getter_AddRefs(view));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  mIgnoreListListener = PR_TRUE;
+
+  // Same insertion point as QueueNext()
+  PRUint32 insertBeforeIndex =
+      (mSequencerOnQueue && mSequencerPlayingOrPaused) ? mIndex + 1 : mIndex;
+
+  rv = QueueSegment(view, insertBeforeIndex);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  mIgnoreListListener = PR_FALSE;
+
+  return NS_OK;
+}
+
+NS_IMETHODIMP
+sbPlayQueueService::QueueViewLast(sbIMediaListView* aView)
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+
+  NS_ASSERTION(NS_IsMainThread(),
+    "QueueViewLast() must be called from the main thread");
+  NS_ASSERTION(!mOperationInProgress,
+    "QueueViewLast() should not be called while an async operation is in progress");
+  NS_ENSURE_ARG_POINTER(aView);
+  NS_ENSURE_TRUE(mInitialized, NS_ERROR_NOT_INITIALIZED);
+  nsresult rv;
+
+  nsCOMPtr<sbIMediaListView> view;
+  rv = aView->Clone(getter_AddRefs(view));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRUint32 length;
+  rv = mMediaList->GetLength(&length);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  mIgnoreListListener = PR_TRUE;
+
+  rv = QueueSegment(view, length);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  mIgnoreListListener = PR_FALSE;
+
   return NS_OK;
 }
 
@@ -605,6 +799,8 @@ sbPlayQueueService::ClearAll()
 
   mIgnoreListListener = PR_TRUE;
 
+  mSegments.Clear();
+
   // Remove all non-list items from the play queue library.
   nsresult rv = mLibrary->ClearItems();
   NS_ENSURE_SUCCESS(rv, rv);
@@ -727,6 +923,590 @@ sbPlayQueueService::QueueLastInternal(sbIMediaList* aMediaList)
   return NS_OK;
 }
 
+nsresult
+sbPlayQueueService::QueueSegment(sbIMediaListView* aView,
+                                 PRUint32 aInsertBeforeIndex)
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+  NS_ENSURE_ARG_POINTER(aView);
+  nsresult rv;
+
+  PRUint32 length;
+  rv = aView->GetLength(&length);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (length == 0) {
+    return NS_OK;
+  }
+
+  Segment* segment = mSegments.AppendElement();
+  NS_ENSURE_TRUE(segment, NS_ERROR_OUT_OF_MEMORY);
+  segment->view = aView;
+  segment->next = 0;
+  segment->end = length;
+
+  rv = StartSegment(aInsertBeforeIndex);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+nsresult
+sbPlayQueueService::QueueSegment(nsIArray* aItems,
+                                 PRUint32 aInsertBeforeIndex)
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+  NS_ENSURE_ARG_POINTER(aItems);
+  nsresult rv;
+
+  PRUint32 length;
+  rv = aItems->GetLength(&length);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  if (length == 0) {
+    return NS_OK;
+  }
+
+  Segment* segment = mSegments.AppendElement();
+  NS_ENSURE_TRUE(segment, NS_ERROR_OUT_OF_MEMORY);
+  segment->items = aItems;
+  segment->next = 0;
+  segment->end = length;
+
+  rv = StartSegment(aInsertBeforeIndex);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+nsresult
+sbPlayQueueService::StartSegment(PRUint32 aInsertBeforeIndex)
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+  NS_ENSURE_STATE(!mSegments.IsEmpty());
+  nsresult rv;
+
+  // Add the first chunk right away so that the segment can start playing.
+  // While the queue is shuffled, add all of it.
+  PRUint32 segmentIndex = mSegments.Length() - 1;
+  PRUint32 count = IsQueueShuffled() ? mSegments[segmentIndex].end :
+                                       SB_PLAYQUEUE_SEGMENT_CHUNK;
+  rv = ExpandSegment(segmentIndex, aInsertBeforeIndex, count);
+  if (NS_FAILED(rv)) {
+    if (segmentIndex < mSegments.Length()) {
+      mSegments.RemoveElementAt(segmentIndex);
+    }
+    return rv;
+  }
+
+  ScheduleExpandSegments();
+
+  return NS_OK;
+}
+
+nsresult
+sbPlayQueueService::ExpandSegment(PRUint32 aSegment,
+                                  PRUint32 aInsertBeforeIndex,
+                                  PRUint32 aCount)
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+  NS_ENSURE_TRUE(aSegment < mSegments.Length(), NS_ERROR_INVALID_ARG);
+  nsresult rv;
+
+  nsCOMPtr<nsIMutableArray> items =
+    do_CreateInstance("@songbirdnest.com/moz/xpcom/threadsafe-array;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  Segment& segment = mSegments[aSegment];
+  PRUint32 end = PR_MIN(segment.next + aCount, segment.end);
+  PRUint32 count = 0;
+  for (PRUint32 i = segment.next; i < end; ++i) {
+    nsCOMPtr<sbIMediaItem> item;
+    if (segment.view) {
+      rv = segment.view->GetItemByIndex(i, getter_AddRefs(item));
+    } else {
+      item = do_QueryElementAt(segment.items, i, &rv);
+    }
+    if (NS_FAILED(rv)) {
+      // The source got shorter since it was queued
+      segment.end = end = i;
+      break;
+    }
+
+    rv = items->AppendElement(item, PR_FALSE);
+    NS_ENSURE_SUCCESS(rv, rv);
+    ++count;
+  }
+  segment.next = end;
+
+  if (count > 0) {
+    nsCOMPtr<nsISimpleEnumerator> enumerator;
+    rv = items->Enumerate(getter_AddRefs(enumerator));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRUint32 length;
+    rv = mMediaList->GetLength(&length);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    if (aInsertBeforeIndex >= length) {
+      aInsertBeforeIndex = length;
+      rv = mMediaList->AddMediaItems(enumerator, nsnull, PR_FALSE);
+      NS_ENSURE_SUCCESS(rv, rv);
+    } else {
+      nsCOMPtr<sbIOrderableMediaList> orderedList =
+          do_QueryInterface(mMediaList, &rv);
+      NS_ENSURE_SUCCESS(rv, rv);
+
+      rv = orderedList->InsertSomeBefore(aInsertBeforeIndex, enumerator);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+
+    // The rest of the segment goes after the last item just added. Look the
+    // segment up again, list notifications may have run.
+    NS_ENSURE_TRUE(aSegment < mSegments.Length(), NS_ERROR_UNEXPECTED);
+    rv = mMediaList->GetItemByIndex(aInsertBeforeIndex + count - 1,
+                                    getter_AddRefs(mSegments[aSegment].anchor));
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  if (mSegments[aSegment].next >= mSegments[aSegment].end) {
+    mSegments.RemoveElementAt(aSegment);
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbPlayQueueService::ExpandSegments(PRBool aAll, PRBool aIncludeViews)
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+  nsresult rv;
+
+  // An asynchronous queue operation schedules another expansion when it
+  // completes
+  if (!mInitialized || mOperationInProgress) {
+    return NS_OK;
+  }
+
+  PRUint32 length;
+  rv = mMediaList->GetLength(&length);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Walk backwards, expanding a segment may remove it
+  for (PRInt32 i = mSegments.Length() - 1; i >= 0; --i) {
+    if (!aIncludeViews && mSegments[i].view) {
+      continue;
+    }
+
+    // If the anchor was removed from the queue, append the rest instead
+    PRUint32 insertBeforeIndex = length;
+    if (mSegments[i].anchor) {
+      PRUint32 anchorIndex;
+      rv = mMediaList->IndexOf(mSegments[i].anchor, 0, &anchorIndex);
+      if (NS_SUCCEEDED(rv)) {
+        insertBeforeIndex = anchorIndex + 1;
+      }
+    }
+
+    if (!aAll &&
+        insertBeforeIndex > mIndex + SB_PLAYQUEUE_SEGMENT_LOOKAHEAD) {
+      continue;
+    }
+
+    LOG(("Expanding segment %d before index %u", i, insertBeforeIndex));
+
+    PRUint32 count = aAll ? mSegments[i].end - mSegments[i].next :
+                            SB_PLAYQUEUE_SEGMENT_CHUNK;
+
+    // Like QueueSomeBefore(), let OnItemAdded() move mIndex if the items go
+    // before it
+    mIgnoreListListener = insertBeforeIndex > mIndex;
+    rv = ExpandSegment(i, insertBeforeIndex, count);
+    mIgnoreListListener = PR_FALSE;
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = mMediaList->GetLength(&length);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+void
+sbPlayQueueService::ScheduleExpandSegments()
+{
+  if (mSegments.IsEmpty() || mExpandPending) {
+    return;
+  }
+
+  nsCOMPtr<nsIRunnable> runnable =
+    NS_NEW_RUNNABLE_METHOD(sbPlayQueueService, this, ExpandSegmentsCallback);
+  if (runnable && NS_SUCCEEDED(NS_DispatchToMainThread(runnable))) {
+    mExpandPending = PR_TRUE;
+  }
+}
+
+void
+sbPlayQueueService::ExpandSegmentsCallback()
+{
+  mExpandPending = PR_FALSE;
+
+  nsresult rv = ExpandSegments(IsQueueShuffled(), PR_TRUE);
+  NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to expand play queue segments");
+}
+
+nsresult
+sbPlayQueueService::SaveSegments()
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+  nsresult rv;
+
+  nsCOMPtr<nsIFile> file;
+  rv = GetSegmentsFile(getter_AddRefs(file));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Segments of an array that could not be expanded are lost
+  PRUint32 count = 0;
+  for (PRUint32 i = 0; i < mSegments.Length(); ++i) {
+    if (mSegments[i].view) {
+      ++count;
+    }
+  }
+  if (count == 0) {
+    PRBool exists = PR_FALSE;
+    if (NS_SUCCEEDED(file->Exists(&exists)) && exists) {
+      rv = file->Remove(PR_FALSE);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    return NS_OK;
+  }
+
+  nsRefPtr<sbFileObjectOutputStream> stream = new sbFileObjectOutputStream();
+  NS_ENSURE_TRUE(stream, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = stream->InitWithFile(file);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = WriteSegments(stream, count);
+  stream->Close();
+
+  if (NS_FAILED(rv)) {
+    // Don't leave a partial file behind
+    file->Remove(PR_FALSE);
+    return rv;
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbPlayQueueService::WriteSegments(sbFileObjectOutputStream* aStream,
+                                  PRUint32                  aCount)
+{
+  NS_ENSURE_ARG_POINTER(aStream);
+  nsresult rv;
+
+  rv = aStream->WriteUint32(SB_PLAYQUEUE_SEGMENTS_SCHEMA_VERSION);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = aStream->WriteUint32(aCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  for (PRUint32 i = 0; i < mSegments.Length(); ++i) {
+    Segment& segment = mSegments[i];
+    if (!segment.view) {
+      continue;
+    }
+
+    nsCOMPtr<sbIMediaList> list;
+    rv = segment.view->GetMediaList(getter_AddRefs(list));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsCOMPtr<sbILibrary> library;
+    rv = list->GetLibrary(getter_AddRefs(library));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsString libraryGUID, listGUID, anchorGUID;
+    rv = library->GetGuid(libraryGUID);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = list->GetGuid(listGUID);
+    NS_ENSURE_SUCCESS(rv, rv);
+    if (segment.anchor) {
+      rv = segment.anchor->GetGuid(anchorGUID);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+
+    // Views that can't describe their state are restored unsorted and
+    // unfiltered
+    nsCOMPtr<sbIMediaListViewState> state;
+    rv = segment.view->GetState(getter_AddRefs(state));
+    if (NS_FAILED(rv)) {
+      state = nsnull;
+    }
+
+    rv = aStream->WriteString(libraryGUID);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = aStream->WriteString(listGUID);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = aStream->WritePRBool(state != nsnull);
+    NS_ENSURE_SUCCESS(rv, rv);
+    if (state) {
+      rv = aStream->WriteObject(state, PR_TRUE);
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    rv = aStream->WriteUint32(segment.next);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = aStream->WriteUint32(segment.end);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = aStream->WriteString(anchorGUID);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  return NS_OK;
+}
+
+nsresult
+sbPlayQueueService::RestoreSegments()
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+  nsresult rv;
+
+  nsCOMPtr<nsIFile> file;
+  rv = GetSegmentsFile(getter_AddRefs(file));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool exists = PR_FALSE;
+  if (NS_FAILED(file->Exists(&exists)) || !exists) {
+    return NS_OK;
+  }
+
+  nsRefPtr<sbFileObjectInputStream> stream = new sbFileObjectInputStream();
+  NS_ENSURE_TRUE(stream, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = stream->InitWithFile(file);
+  if (NS_SUCCEEDED(rv)) {
+    rv = ReadSegments(stream);
+    stream->Close();
+  }
+
+  // Don't restore the same segments again on the next start
+  file->Remove(PR_FALSE);
+
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  LOG(("Restored %u play queue segments", mSegments.Length()));
+
+  return NS_OK;
+}
+
+nsresult
+sbPlayQueueService::ReadSegments(sbFileObjectInputStream* aStream)
+{
+  NS_ENSURE_ARG_POINTER(aStream);
+  nsresult rv;
+
+  nsCOMPtr<sbILibraryManager> libraryManager =
+      do_GetService("@songbirdnest.com/Songbird/library/Manager;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // A file of another version is dropped along with its segments
+  PRUint32 version;
+  rv = aStream->ReadUint32(&version);
+  NS_ENSURE_SUCCESS(rv, rv);
+  if (version != SB_PLAYQUEUE_SEGMENTS_SCHEMA_VERSION) {
+    return NS_OK;
+  }
+
+  PRUint32 count;
+  rv = aStream->ReadUint32(&count);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  for (PRUint32 i = 0; i < count; ++i) {
+    nsString libraryGUID, listGUID, anchorGUID;
+    PRBool hasState = PR_FALSE;
+    nsCOMPtr<nsISupports> supports;
+    PRUint32 next, end;
+
+    rv = aStream->ReadString(libraryGUID);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = aStream->ReadString(listGUID);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = aStream->ReadPRBool(&hasState);
+    NS_ENSURE_SUCCESS(rv, rv);
+    if (hasState) {
+      rv = aStream->ReadObject(PR_TRUE, getter_AddRefs(supports));
+      NS_ENSURE_SUCCESS(rv, rv);
+    }
+    rv = aStream->ReadUint32(&next);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = aStream->ReadUint32(&end);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = aStream->ReadString(anchorGUID);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    // The source may have gone away with its library or list
+    nsCOMPtr<sbILibrary> library;
+    rv = libraryManager->GetLibrary(libraryGUID, getter_AddRefs(library));
+    if (NS_FAILED(rv)) {
+      continue;
+    }
+
+    nsCOMPtr<sbIMediaList> list;
+    if (listGUID.Equals(libraryGUID)) {
+      list = library;
+    } else {
+      nsCOMPtr<sbIMediaItem> listAsItem;
+      rv = library->GetMediaItem(listGUID, getter_AddRefs(listAsItem));
+      list = do_QueryInterface(listAsItem);
+      if (NS_FAILED(rv) || !list) {
+        continue;
+      }
+    }
+
+    nsCOMPtr<sbIMediaListViewState> state = do_QueryInterface(supports);
+    nsCOMPtr<sbIMediaListView> view;
+    rv = list->CreateView(state, getter_AddRefs(view));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    PRUint32 length;
+    rv = view->GetLength(&length);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    end = PR_MIN(end, length);
+    if (next >= end) {
+      continue;
+    }
+
+    Segment* segment = mSegments.AppendElement();
+    NS_ENSURE_TRUE(segment, NS_ERROR_OUT_OF_MEMORY);
+    segment->view = view;
+    segment->next = next;
+    segment->end = end;
+
+    // Without its anchor, the rest of the segment is appended
+    if (!anchorGUID.IsEmpty()) {
+      rv = mLibrary->GetMediaItem(anchorGUID,
+                                  getter_AddRefs(segment->anchor));
+      if (NS_FAILED(rv)) {
+        segment->anchor = nsnull;
+      }
+    }
+  }
+
+  return NS_OK;
+}
+
+/* static */ nsresult
+sbPlayQueueService::GetSegmentsFile(nsIFile** aFile)
+{
+  NS_ENSURE_ARG_POINTER(aFile);
+  nsresult rv;
+
+  nsCOMPtr<nsIProperties> dirService =
+    do_GetService("@mozilla.org/file/directory_service;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  nsCOMPtr<nsIFile> file;
+  rv = dirService->Get(NS_APP_USER_PROFILE_50_DIR,
+                       NS_GET_IID(nsIFile),
+                       getter_AddRefs(file));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = file->Append(NS_LITERAL_STRING(SB_PLAYQUEUE_SEGMENTS_FILENAME));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  file.forget(aFile);
+  return NS_OK;
+}
+
+PRBool
+sbPlayQueueService::IsQueueShuffled()
+{
+  if (!mSequencerOnQueue) {
+    return PR_FALSE;
+  }
+
+  nsresult rv;
+  nsCOMPtr<sbIMediacoreManager> manager =
+      do_QueryReferent(mWeakMediacoreManager, &rv);
+  NS_ENSURE_SUCCESS(rv, PR_FALSE);
+
+  nsCOMPtr<sbIMediacoreSequencer> sequencer;
+  rv = manager->GetSequencer(getter_AddRefs(sequencer));
+  NS_ENSURE_SUCCESS(rv, PR_FALSE);
+
+  PRUint32 mode;
+  rv = sequencer->GetMode(&mode);
+  NS_ENSURE_SUCCESS(rv, PR_FALSE);
+
+  return (mode & sbIMediacoreSequencer::MODE_SHUFFLE) != 0;
+}
+
+nsresult
+sbPlayQueueService::QueueSomeSegment(nsIArray* aItems,
+                                     PRUint32 aInsertBeforeIndex)
+{
+  TRACE(("%s[%p]", __FUNCTION__, this));
+  nsresult rv;
+
+  rv = QueueSegment(aItems, aInsertBeforeIndex);
+  if (NS_FAILED(rv)) {
+    QueueSomeSegmentCompleted();
+    return rv;
+  }
+
+  // Listeners expect the queue operation to complete after the call returns
+  nsCOMPtr<nsIRunnable> runnable =
+    NS_NEW_RUNNABLE_METHOD(sbPlayQueueService,
+                           this,
+                           QueueSomeSegmentCompleted);
+  NS_ENSURE_TRUE(runnable, NS_ERROR_OUT_OF_MEMORY);
+
+  rv = NS_DispatchToMainThread(runnable);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+void
+sbPlayQueueService::QueueSomeSegmentCompleted()
+{
+  nsresult rv = NotifyQueueOperationCompleted();
+  NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to complete queue operation");
+
+  mIgnoreListListener = PR_FALSE;
+}
+
+nsresult
+sbPlayQueueService::DrainEnumerator(nsISimpleEnumerator* aMediaItems,
+                                    nsIMutableArray** aItems)
+{
+  NS_ENSURE_ARG_POINTER(aMediaItems);
+  NS_ENSURE_ARG_POINTER(aItems);
+  nsresult rv;
+
+  nsCOMPtr<nsIMutableArray> items =
+    do_CreateInstance("@songbirdnest.com/moz/xpcom/threadsafe-array;1", &rv);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  PRBool hasMore;
+  while (NS_SUCCEEDED(aMediaItems->HasMoreElements(&hasMore)) && hasMore) {
+    nsCOMPtr<nsISupports> supports;
+    rv = aMediaItems->GetNext(getter_AddRefs(supports));
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    nsCOMPtr<sbIMediaItem> item = do_QueryInterface(supports, &rv);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    rv = items->AppendElement(item, PR_FALSE);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+
+  items.forget(aItems);
+
+  return NS_OK;
+}
+
 nsresult
 sbPlayQueueService::CreateMediaList()
 {
@@ -1210,6 +1990,7 @@ sbPlayQueueService::OnListCleared(sbIMediaList* aMediaList,
   }
 
   LOG(("Clearing all items, but not lists, from queue library"));
+  mSegments.Clear();
   nsresult rv = mLibrary->ClearItems();
   NS_ENSURE_SUCCESS(rv, rv);
 
@@ -1263,6 +2044,9 @@ sbPlayQueueService::OnMediacoreEvent(sbIMediacoreEvent* aEvent)
     rv = OnViewChange(aEvent);
     NS_ENSURE_SUCCESS(rv, rv);
 
+    // The queue may now be played shuffled
+    ScheduleExpandSegments();
+
     return NS_OK;
   }
 
@@ -1300,6 +2084,11 @@ sbPlayQueueService::OnMediacoreEvent(sbIMediacoreEvent* aEvent)
       NS_ENSURE_SUCCESS(rv, rv);
       break;
 
+    // Shuffle only sees the items in the queue list, add the pending ones
+    case sbIMediacoreEvent::SEQUENCE_CHANGE:
+      ScheduleExpandSegments();
+      break;
+
     default:
       break;
   }
@@ -1471,8 +2260,24 @@ sbPlayQueueService::Observe(nsISupports* aSubject,
     NS_ENSURE_SUCCESS(rv, rv);
 
     mInitialized = PR_TRUE;
+
+    // Pick up the segments that were pending at the last shutdown
+    rv = RestoreSegments();
+    NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to restore play queue segments");
+    ScheduleExpandSegments();
   }
   else if (!strcmp(SB_LIBRARY_MANAGER_BEFORE_SHUTDOWN_TOPIC, aTopic)) {
+    // Segments of an array only live in memory, so add their pending items to
+    // the list. View segments are saved and restored on the next start.
+    if (mInitialized) {
+      rv = ExpandSegments(PR_TRUE, PR_FALSE);
+      NS_WARN_IF_FALSE(NS_SUCCEEDED(rv),
+                       "Failed to expand play queue segments");
+
+      rv = SaveSegments();
+      NS_WARN_IF_FALSE(NS_SUCCEEDED(rv), "Failed to save play queue segments");
+    }
+
     Finalize();
   }
 
@@ -1539,6 +2344,9 @@ sbPlayQueueService::NotifyQueueOperationCompleted() {
   mListeners.EnumerateEntries(OnQueueCompletedCallback, nsnull);
   mOperationInProgress = PR_FALSE;
 
+  // Expansion waits for asynchronous operations to finish
+  ScheduleExpandSegments();
+
   return NS_OK;
 };
 
@@ -33,6 +33,8 @@
 #include <nsAutoPtr.h>
 #include <nsCOMPtr.h>
 #include <nsTArray.h>
+#include <nsIArray.h>
+#include <nsIMutableArray.h>
 #include <nsIObserver.h>
 #include <nsIGenericFactory.h>
 #include <nsIWeakReference.h>
@@ -51,9 +53,13 @@
 #include "sbPlayQueueLibraryListener.h"
 #include "sbPlayQueueExternalLibraryListener.h"
 
+class nsIFile;
 class nsIStringBundle;
+class sbFileObjectInputStream;
+class sbFileObjectOutputStream;
 class sbIMediaItem;
 class sbIMediaList;
+class sbIMediaListView;
 class sbIDataRemote;
 class sbPlayQueueAsyncListener;
 
@@ -152,6 +158,11 @@ private:
    */
   PRBool mOperationInProgress;
 
+  /**
+   * \brief True if a call to ExpandSegmentsCallback() has been dispatched.
+   */
+  PRBool mExpandPending;
+
   /**
    * \brief Helper for batch operations on mMediaList.
    */
@@ -196,6 +207,111 @@ private:
    */
   nsresult QueueLastInternal(sbIMediaList* aMediaList);
 
+  /**
+   * \brief A range of a source view whose items are queued but not all in
+   *        mMediaList yet.
+   */
+  struct Segment {
+    // view of the source, not shared with the UI; only indices into it are
+    // kept
+    nsCOMPtr<sbIMediaListView> view;
+    // the items of the source, if it is not a view
+    nsCOMPtr<nsIArray> items;
+    // index into the source of the first item not in mMediaList yet
+    PRUint32 next;
+    // index into the source one past the last item of the segment
+    PRUint32 end;
+    // the last item of the segment in mMediaList; the rest goes after it
+    nsCOMPtr<sbIMediaItem> anchor;
+  };
+
+  /**
+   * \brief Segments with pending items, see sbIPlayQueueService::pendingLength
+   */
+  nsTArray<Segment> mSegments;
+
+  /**
+   * \brief Queue the items of aView as a segment, adding the first of them to
+   *        mMediaList directly before aInsertBeforeIndex.
+   */
+  nsresult QueueSegment(sbIMediaListView* aView,
+                        PRUint32          aInsertBeforeIndex);
+
+  /**
+   * \brief Queue aItems as a segment, like the above.
+   */
+  nsresult QueueSegment(nsIArray* aItems,
+                        PRUint32  aInsertBeforeIndex);
+
+  /**
+   * \brief Add the first chunk of the last segment of mSegments, which was
+   *        just appended.
+   */
+  nsresult StartSegment(PRUint32 aInsertBeforeIndex);
+
+  /**
+   * \brief Add the next aCount items of a segment to mMediaList directly
+   *        before aInsertBeforeIndex. Removes the segment once it is done.
+   */
+  nsresult ExpandSegment(PRUint32 aSegment,
+                         PRUint32 aInsertBeforeIndex,
+                         PRUint32 aCount);
+
+  /**
+   * \brief Expand the segments whose items playback is getting close to, or
+   *        all of every segment if aAll is true. View segments are skipped
+   *        if aIncludeViews is false.
+   */
+  nsresult ExpandSegments(PRBool aAll, PRBool aIncludeViews);
+
+  /**
+   * \brief Save the view segments to the profile, so that they are not
+   *        expanded in full at shutdown. Segments of an array have no source
+   *        to refer to and must be expanded before this is called.
+   */
+  nsresult SaveSegments();
+  nsresult WriteSegments(sbFileObjectOutputStream* aStream, PRUint32 aCount);
+
+  /**
+   * \brief Restore the segments saved by SaveSegments() and remove the file.
+   *        Segments whose source list no longer exists are dropped.
+   */
+  nsresult RestoreSegments();
+  nsresult ReadSegments(sbFileObjectInputStream* aStream);
+
+  /**
+   * \brief Get the file the segments are saved to. It may not exist.
+   */
+  static nsresult GetSegmentsFile(nsIFile** aFile);
+
+  /**
+   * \brief True if the sequencer plays mMediaList shuffled. Shuffling only
+   *        sees the items in mMediaList, so segments are expanded in full.
+   */
+  PRBool IsQueueShuffled();
+
+  /**
+   * \brief Queue aItems, the drained enumerator of QueueSomeNext() or
+   *        QueueSomeLast(), as a segment. Completes the queue operation from
+   *        the event loop, like the asynchronous add does.
+   */
+  nsresult QueueSomeSegment(nsIArray* aItems,
+                            PRUint32  aInsertBeforeIndex);
+  void QueueSomeSegmentCompleted();
+
+  /**
+   * \brief Copy the items of aMediaItems into an array.
+   */
+  nsresult DrainEnumerator(nsISimpleEnumerator* aMediaItems,
+                           nsIMutableArray**    aItems);
+
+  /**
+   * \brief Call ExpandSegments() from the event loop, outside of any list
+   *        notification.
+   */
+  void ScheduleExpandSegments();
+  void ExpandSegmentsCallback();
+
   nsresult RefreshIndexFromView();
 
   /**
@@ -38,12 +38,18 @@ function runTest () {
     _prevTestIndex: 0,
     _indexChange: false,
     _nextUri: 0,
+    // items of the segment under test that are not in the list yet, and the
+    // last of its items that is
+    _pendingURIs: [],
+    _anchorURI: null,
 
     // call this between each test
     reset: function () {
       this._testURIArray = [];
       this._testIndex = 0;
       this._nextUri = 0;
+      this._pendingURIs = [];
+      this._anchorURI = null;
       gPQS.clearAll();
     },
 
@@ -143,14 +149,44 @@ function runTest () {
 
     testQueueSomeLast: function(num) {
       var uris = this._generateURIs(num);
-      for (let i = 0; i < uris.length; i++)
+      // Only the first chunk of many items is added right away
+      var added = this._startSegment(uris);
+      for (let i = 0; i < added; i++)
         this._testURIArray.push(uris[i]);
       var items = this._generateItems(uris);
       gPQS.queueSomeLast(ArrayConverter.enumerator(items));
       testPending();
+      assertEqual(gPQS.pendingLength, this._pendingURIs.length);
       this._verifyList();
     },
 
+    testQueueViewLast: function (num) {
+      var uris = this._generateURIs(num);
+      var items = this._generateItems(uris);
+      let simpleList = gLib.createMediaList("simple");
+      simpleList.addSome(ArrayConverter.enumerator(items));
+      gPQS.queueViewLast(simpleList.createView());
+      // Only the first chunk of a long view is added right away
+      var added = this._startSegment(uris);
+      for (let i = 0; i < added; i++)
+        this._testURIArray.push(uris[i]);
+      assertEqual(gPQS.pendingLength, this._pendingURIs.length);
+      this._verifyList();
+    },
+
+    // Move the index to pos and let the service add the next chunk of the
+    // segment, which must be close enough to pos
+    testExpandSegment: function (pos) {
+      this.testSetIndex(pos);
+      this._processPendingEvents();
+      this._expandSegment(100);
+    },
+
+    testExpandPending: function () {
+      gPQS.expandPending();
+      this._expandSegment(this._pendingURIs.length);
+    },
+
     testClearHistory: function () {
       if (this._testIndex > 0)
         this._testURIArray.splice(0, this._testIndex);
@@ -279,6 +315,37 @@ function runTest () {
       this._verifyList();
     },
 
+    _startSegment: function (uris) {
+      var added = uris.length > 100 ? 100 : uris.length;
+      this._pendingURIs = uris.slice(added);
+      this._anchorURI = uris[added - 1];
+      return added;
+    },
+
+    // The next items of the segment go after its anchor, or at the end if
+    // the anchor was removed
+    _expandSegment: function (num) {
+      var insertAt = this._testURIArray.length;
+      for (let i = 0; i < this._testURIArray.length; i++) {
+        if (this._testURIArray[i].equals(this._anchorURI))
+          insertAt = i + 1;
+      }
+      var uris = this._pendingURIs.splice(0, num);
+      for (let i = 0; i < uris.length; i++)
+        this._testURIArray.splice(insertAt + i, 0, uris[i]);
+      this._anchorURI = uris[uris.length - 1];
+      assertEqual(gPQS.pendingLength, this._pendingURIs.length);
+      this._verifyList();
+    },
+
+    _processPendingEvents: function () {
+      var thread = Cc["@mozilla.org/thread-manager;1"]
+                     .getService(Ci.nsIThreadManager)
+                     .currentThread;
+      while (thread.hasPendingEvents())
+        thread.processNextEvent(false);
+    },
+
     _generateItems: function (uris) {
       var items = new Array(uris.length);
       for (var i = 0; i < uris.length; i++)
@@ -461,6 +528,36 @@ function runTest () {
   testFixture.testMoveLast([2,3,4]);
 
 
+  // segment tests
+  testFixture.reset();
+  testFixture.testAdd(5);
+  testFixture.testQueueViewLast(250);
+  testFixture.testAdd(1);
+  // Getting close to the end of the first chunk adds the next one after it,
+  // before the item added since
+  testFixture.testExpandSegment(90);
+  // Once the last item added from the segment is removed, the rest of the
+  // segment is appended
+  testFixture.testRemove([204]);
+  testFixture.testExpandSegment(190);
+  assertEqual(gPQS.pendingLength, 0);
+
+  testFixture.reset();
+  testFixture.testAdd(5);
+  testFixture.testQueueViewLast(250);
+  testFixture.testClearAll();
+  assertEqual(gPQS.pendingLength, 0);
+
+  // Many items from queueSomeLast are queued as a segment too, and
+  // expandPending() adds all of them
+  testFixture.reset();
+  testFixture.testAdd(5);
+  testFixture.testQueueSomeLast(150);
+  testFixture.testAdd(1);
+  testFixture.testExpandPending();
+  assertEqual(gPQS.pendingLength, 0);
+
+
   // clean up
   testFixture.reset();
 
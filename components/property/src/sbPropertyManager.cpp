@@ -903,6 +903,32 @@ NS_METHOD sbPropertyManager::CreateSystemProperties()
                       PR_TRUE, PR_TRUE, NULL);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  //ReplayGain values, stored as text in the same form as the tags
+  //(e.g. "-6.54" dB for gains and "0.987654" for peaks)
+  rv = RegisterText(NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_TRACK_GAIN),
+                    EmptyString(),
+                    stringBundle, PR_FALSE, PR_FALSE, PR_FALSE, 0, PR_FALSE,
+                    PR_TRUE, PR_FALSE, PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = RegisterText(NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_TRACK_PEAK),
+                    EmptyString(),
+                    stringBundle, PR_FALSE, PR_FALSE, PR_FALSE, 0, PR_FALSE,
+                    PR_TRUE, PR_FALSE, PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = RegisterText(NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_ALBUM_GAIN),
+                    EmptyString(),
+                    stringBundle, PR_FALSE, PR_FALSE, PR_FALSE, 0, PR_FALSE,
+                    PR_TRUE, PR_FALSE, PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  rv = RegisterText(NS_LITERAL_STRING(SB_PROPERTY_REPLAYGAIN_ALBUM_PEAK),
+                    EmptyString(),
+                    stringBundle, PR_FALSE, PR_FALSE, PR_FALSE, 0, PR_FALSE,
+                    PR_TRUE, PR_FALSE, PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
   //Key
   rv = RegisterText(NS_LITERAL_STRING(SB_PROPERTY_KEY),
                     NS_LITERAL_STRING("property.key"),
@@ -995,6 +1021,13 @@ NS_METHOD sbPropertyManager::CreateSystemProperties()
                     0, PR_TRUE, PR_TRUE, PR_FALSE);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Entity ID of a partial download, used to resume it
+  rv = RegisterText(NS_LITERAL_STRING(SB_PROPERTY_DOWNLOAD_ENTITY_ID),
+                    EmptyString(),
+                    stringBundle, PR_FALSE, PR_FALSE, PR_FALSE,
+                    0, PR_FALSE, PR_FALSE, PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
   //Hidden
   rv = RegisterBoolean(NS_LITERAL_STRING(SB_PROPERTY_HIDDEN),
                        NS_LITERAL_STRING("property.hidden"),
@@ -1403,6 +1436,13 @@ NS_METHOD sbPropertyManager::CreateSystemProperties()
                        PR_FALSE);
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Cached media inspector results, used to avoid inspecting unchanged files
+  rv = RegisterText(NS_LITERAL_STRING(SB_PROPERTY_INSPECTED_MEDIA_FORMAT),
+                    EmptyString(),
+                    stringBundle, PR_FALSE, PR_FALSE, PR_FALSE, 0, PR_FALSE,
+                    PR_FALSE, PR_FALSE, PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
   // video properties
   rv = RegisterText(NS_LITERAL_STRING(SB_PROPERTY_KEYWORDS),
                     NS_LITERAL_STRING("property.keywords"),
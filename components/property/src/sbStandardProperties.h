@@ -65,6 +65,10 @@
 #define SB_PROPERTY_CHANNELS                  "http://songbirdnest.com/data/1.0#channels"
 #define SB_PROPERTY_SAMPLERATE                "http://songbirdnest.com/data/1.0#sampleRate"
 #define SB_PROPERTY_BPM                       "http://songbirdnest.com/data/1.0#bpm"
+#define SB_PROPERTY_REPLAYGAIN_TRACK_GAIN     "http://songbirdnest.com/data/1.0#replayGainTrackGain"
+#define SB_PROPERTY_REPLAYGAIN_TRACK_PEAK     "http://songbirdnest.com/data/1.0#replayGainTrackPeak"
+#define SB_PROPERTY_REPLAYGAIN_ALBUM_GAIN     "http://songbirdnest.com/data/1.0#replayGainAlbumGain"
+#define SB_PROPERTY_REPLAYGAIN_ALBUM_PEAK     "http://songbirdnest.com/data/1.0#replayGainAlbumPeak"
 #define SB_PROPERTY_KEY                       "http://songbirdnest.com/data/1.0#key"
 #define SB_PROPERTY_LANGUAGE                  "http://songbirdnest.com/data/1.0#language"
 #define SB_PROPERTY_COMMENT                   "http://songbirdnest.com/data/1.0#comment"
@@ -96,6 +100,7 @@
 #define SB_PROPERTY_DOWNLOADBUTTON            "http://songbirdnest.com/data/1.0#downloadButton"
 #define SB_PROPERTY_DOWNLOAD_STATUS_TARGET    "http://songbirdnest.com/data/1.0#downloadStatusTarget"
 #define SB_PROPERTY_DOWNLOAD_DETAILS          "http://songbirdnest.com/data/1.0#downloadDetails"
+#define SB_PROPERTY_DOWNLOAD_ENTITY_ID        "http://songbirdnest.com/data/1.0#downloadEntityID"
 #define SB_PROPERTY_ISSORTABLE                "http://songbirdnest.com/data/1.0#isSortable"
 #define SB_PROPERTY_RAPISCOPEURL              "http://songbirdnest.com/data/1.0#rapiScopeURL"
 #define SB_PROPERTY_RAPISITEID                "http://songbirdnest.com/data/1.0#rapiSiteID"
@@ -119,6 +124,9 @@
 /* boolean: true if the media is DRM protected; false/empty otherwise */
 #define SB_PROPERTY_ISDRMPROTECTED            "http://songbirdnest.com/data/1.0#isDRMProtected"
 #define SB_PROPERTY_DONT_WRITE_METADATA       "http://songbirdnest.com/data/1.0#dontWriteMetadata"
+/* Serialized sbIMediaFormat from the media inspector, along with the content
+ * URL, size and modification time of the file it describes */
+#define SB_PROPERTY_INSPECTED_MEDIA_FORMAT    "http://songbirdnest.com/data/1.0#inspectedMediaFormat"
 
 /** An optional import type applied to a media item according to rules defined
  *  by <import> elements in device info XML files.  The import type can be any
@@ -99,6 +99,9 @@ const static char* sPublicMethods[] =
     "library_write:addSome",
     "library_read:getDistinctValuesForProperty",
 
+    // sbIRemoteMediaList
+    "library_read:getItemProperties",
+
     // sbILibraryResource
     "library_read:getProperty",
     "library_write:setProperty",
@@ -104,6 +104,7 @@ const static char* sPublicMethods[] =
   "library_read:getDistinctValuesForProperty",
 
   // sbIRemoteMediaList
+  "library_read:getItemProperties",
   "internal:getView"
 };
 
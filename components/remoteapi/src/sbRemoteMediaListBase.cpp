@@ -38,14 +38,20 @@
 #include <sbIMediaListViewTreeView.h>
 #include <sbIWrappedMediaItem.h>
 #include <sbIWrappedMediaList.h>
+#include <sbIPropertyInfo.h>
 #include <sbIPropertyManager.h>
 #include <sbPropertiesCID.h>
 #include <sbStandardProperties.h>
 
 #include <nsAutoPtr.h>
+#include <nsCOMArray.h>
+#include <nsComponentManagerUtils.h>
 #include <nsITreeSelection.h>
 #include <nsITreeView.h>
+#include <nsIVariant.h>
+#include <nsMemory.h>
 #include <nsStringGlue.h>
+#include <nsTArray.h>
 #include <prlog.h>
 
 // includes for XPCScriptable impl
@@ -875,6 +881,217 @@ sbRemoteMediaListBase::GetView( sbIMediaListView **aView )
   return NS_OK;
 }
 
+NS_IMETHODIMP
+sbRemoteMediaListBase::GetItemProperties( PRUint32 aStartIndex,
+                                          PRUint32 aCount,
+                                          nsIVariant *aPropertyIDs,
+                                          nsIVariant **_retval )
+{
+  LOG_LIST(( "sbRemoteMediaListBase::GetItemProperties(%d, %d)",
+             aStartIndex,
+             aCount ));
+  NS_ENSURE_ARG_POINTER(aPropertyIDs);
+  NS_ENSURE_ARG_POINTER(_retval);
+
+  nsresult rv;
+
+  // The security mixin has already approved this call for the whole page, so
+  // only the requested properties are left to check, once for all the items
+  nsTArray<nsString> propertyIDs;
+  rv = GetReadablePropertyIDs( aPropertyIDs, propertyIDs );
+  NS_ENSURE_SUCCESS( rv, rv );
+
+  nsCOMPtr<sbIMutablePropertyArray> propertyFilter =
+    do_CreateInstance( SB_MUTABLEPROPERTYARRAY_CONTRACTID, &rv );
+  NS_ENSURE_SUCCESS( rv, rv );
+
+  // The filter values are ignored, so don't validate them
+  rv = propertyFilter->SetStrict(PR_FALSE);
+  NS_ENSURE_SUCCESS( rv, rv );
+
+  PRUint32 propertyCount = propertyIDs.Length();
+  for ( PRUint32 i = 0; i < propertyCount; i++ ) {
+    rv = propertyFilter->AppendProperty( propertyIDs[i], EmptyString() );
+    NS_ENSURE_SUCCESS( rv, rv );
+  }
+
+  PRUint32 length;
+  rv = mMediaList->GetLength(&length);
+  NS_ENSURE_SUCCESS( rv, rv );
+
+  PRUint32 count = 0;
+  if ( aStartIndex < length ) {
+    count = PR_MIN( aCount, length - aStartIndex );
+  }
+
+  // Read the values straight from the items rather than handing out wrapped
+  // media items, which would each go through their own security checks
+  nsCOMArray<nsIVariant> rows;
+  nsTArray<nsString> values;
+  nsTArray<const PRUnichar*> valuePointers;
+  for ( PRUint32 i = 0; i < count; i++ ) {
+    nsCOMPtr<sbIMediaItem> item;
+    rv = mMediaList->GetItemByIndex( aStartIndex + i, getter_AddRefs(item) );
+    NS_ENSURE_SUCCESS( rv, rv );
+
+    nsCOMPtr<sbIPropertyArray> properties;
+    rv = item->GetProperties( propertyFilter, getter_AddRefs(properties) );
+    NS_ENSURE_SUCCESS( rv, rv );
+
+    values.Clear();
+    valuePointers.Clear();
+    for ( PRUint32 j = 0; j < propertyCount; j++ ) {
+      nsString* value = values.AppendElement();
+      NS_ENSURE_TRUE( value, NS_ERROR_OUT_OF_MEMORY );
+
+      rv = properties->GetPropertyValue( propertyIDs[j], *value );
+      if ( NS_FAILED(rv) ) {
+        value->SetIsVoid(PR_TRUE);
+      }
+
+      // Protect against exposing file:// uris to the world.
+      if ( StringBeginsWith( *value, NS_LITERAL_STRING("file:") ) ) {
+        value->AssignLiteral("__BLOCKED__");
+      }
+    }
+
+    // Take the pointers only once the strings have stopped moving
+    for ( PRUint32 j = 0; j < propertyCount; j++ ) {
+      const PRUnichar* valuePointer =
+        values[j].IsVoid() ? nsnull : values[j].BeginReading();
+      NS_ENSURE_TRUE( valuePointers.AppendElement(valuePointer),
+                      NS_ERROR_OUT_OF_MEMORY );
+    }
+
+    nsCOMPtr<nsIWritableVariant> row =
+      do_CreateInstance( NS_VARIANT_CONTRACTID, &rv );
+    NS_ENSURE_SUCCESS( rv, rv );
+
+    if ( propertyCount > 0 ) {
+      rv = row->SetAsArray( nsIDataType::VTYPE_WCHAR_STR,
+                            nsnull,
+                            propertyCount,
+                            valuePointers.Elements() );
+    } else {
+      rv = row->SetAsEmptyArray();
+    }
+    NS_ENSURE_SUCCESS( rv, rv );
+
+    NS_ENSURE_TRUE( rows.AppendObject(row), NS_ERROR_OUT_OF_MEMORY );
+  }
+
+  nsCOMPtr<nsIWritableVariant> variant =
+    do_CreateInstance( NS_VARIANT_CONTRACTID, &rv );
+  NS_ENSURE_SUCCESS( rv, rv );
+
+  if ( count > 0 ) {
+    nsTArray<nsIVariant*> rowPointers( count );
+    for ( PRUint32 i = 0; i < count; i++ ) {
+      rowPointers.AppendElement( rows[i] );
+    }
+
+    // the variant copies the array and holds its own references to the rows
+    rv = variant->SetAsArray( nsIDataType::VTYPE_INTERFACE_IS,
+                              &NS_GET_IID(nsIVariant),
+                              count,
+                              rowPointers.Elements() );
+  } else {
+    rv = variant->SetAsEmptyArray();
+  }
+  NS_ENSURE_SUCCESS( rv, rv );
+
+  return CallQueryInterface( variant, _retval );
+}
+
+// ---------------------------------------------------------------------------
+//
+//                        Helpers
+//
+// ---------------------------------------------------------------------------
+
+nsresult
+sbRemoteMediaListBase::GetReadablePropertyIDs( nsIVariant *aPropertyIDs,
+                                               nsTArray<nsString> &aIDs )
+{
+  NS_ENSURE_ARG_POINTER(aPropertyIDs);
+
+  nsresult rv;
+
+  PRUint16 dataType;
+  rv = aPropertyIDs->GetDataType(&dataType);
+  NS_ENSURE_SUCCESS( rv, rv );
+
+  if ( dataType == nsIDataType::VTYPE_ARRAY ) {
+    PRUint16 type;
+    nsIID iid;
+    PRUint32 count;
+    void* data;
+    rv = aPropertyIDs->GetAsArray( &type, &iid, &count, &data );
+    NS_ENSURE_SUCCESS( rv, rv );
+
+    // Arrays of strings come from scripts as either plain strings or, when
+    // the array holds anything else, as variants
+    if ( type == nsIDataType::VTYPE_WCHAR_STR ) {
+      PRUnichar** ids = static_cast<PRUnichar**>(data);
+      for ( PRUint32 i = 0; i < count; i++ ) {
+        nsString* id = aIDs.AppendElement();
+        if ( id && ids[i] ) {
+          id->Assign(ids[i]);
+        }
+      }
+      NS_FREE_XPCOM_ALLOCATED_POINTER_ARRAY( count, ids );
+    } else if ( type == nsIDataType::VTYPE_INTERFACE_IS &&
+                iid.Equals(NS_GET_IID(nsIVariant)) ) {
+      nsIVariant** ids = static_cast<nsIVariant**>(data);
+      rv = NS_OK;
+      for ( PRUint32 i = 0; i < count && NS_SUCCEEDED(rv); i++ ) {
+        nsString* id = aIDs.AppendElement();
+        if ( !id ) {
+          rv = NS_ERROR_OUT_OF_MEMORY;
+        } else {
+          rv = ids[i] ? ids[i]->GetAsAString(*id) : NS_ERROR_INVALID_ARG;
+        }
+      }
+      NS_FREE_XPCOM_ISUPPORTS_POINTER_ARRAY( count, ids );
+      NS_ENSURE_SUCCESS( rv, rv );
+    } else {
+      NS_Free(data);
+      return NS_ERROR_INVALID_ARG;
+    }
+  } else {
+    // a single property
+    nsString* id = aIDs.AppendElement();
+    NS_ENSURE_TRUE( id, NS_ERROR_OUT_OF_MEMORY );
+    rv = aPropertyIDs->GetAsAString(*id);
+    NS_ENSURE_SUCCESS( rv, rv );
+  }
+
+  nsCOMPtr<sbIPropertyManager> propertyManager =
+    do_GetService( SB_PROPERTYMANAGER_CONTRACTID, &rv );
+  NS_ENSURE_SUCCESS( rv, rv );
+
+  PRUint32 length = aIDs.Length();
+  for ( PRUint32 i = 0; i < length; i++ ) {
+    nsCOMPtr<sbIPropertyInfo> propertyInfo;
+    rv = propertyManager->GetPropertyInfo( aIDs[i],
+                                           getter_AddRefs(propertyInfo) );
+    NS_ENSURE_SUCCESS( rv, rv );
+
+    PRBool readable;
+    rv = propertyInfo->GetRemoteReadable(&readable);
+    NS_ENSURE_SUCCESS( rv, rv );
+
+    if (!readable) {
+      LOG_LIST(( "Attempting to get a property's (%s) value that is not "
+                 "allowed to be read from the remote API!",
+                 NS_LossyConvertUTF16toASCII(aIDs[i]).get() ));
+      return NS_ERROR_FAILURE;
+    }
+  }
+
+  return NS_OK;
+}
+
 
 // ---------------------------------------------------------------------------
 //
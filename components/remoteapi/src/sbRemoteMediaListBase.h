@@ -45,6 +45,7 @@
 #include <nsISecurityCheckedComponent.h>
 #include <nsStringGlue.h>
 #include <nsCOMPtr.h>
+#include <nsTArray.h>
 
 #ifdef PR_LOGGING
 extern PRLogModuleInfo *gRemoteMediaListLog;
@@ -142,6 +143,11 @@ protected:
                            jsval *argv,
                            jsval *rval );
 
+  // Reads a property ID or an array of them from aPropertyIDs, failing if
+  // any of the properties may not be read by web pages
+  static nsresult GetReadablePropertyIDs( nsIVariant *aPropertyIDs,
+                                          nsTArray<nsString> &aIDs );
+
   nsCOMPtr<nsISecurityCheckedComponent> mSecurityMixin;
 
   nsRefPtr<sbRemotePlayer> mRemotePlayer;
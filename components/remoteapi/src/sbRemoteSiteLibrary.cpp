@@ -127,6 +127,9 @@ const static char* sPublicMethods[] =
     "site:removeByIndex",
     "site:getDistinctValuesForProperty",
 
+    // sbIRemoteMediaList
+    "site:getItemProperties",
+
     // sbILibraryResource
     "site:getProperty",
     "site:setProperty",
@@ -106,6 +106,7 @@ const static char* sPublicMethods[] =
   "site:getDistinctValuesForProperty",
 
   // sbIRemoteMediaList
+  "site:getItemProperties",
   "internal:getView"
 };
 
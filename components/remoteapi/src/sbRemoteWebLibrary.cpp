@@ -69,6 +69,9 @@ const static char* sPublicMethods[] =
     "library_read:contains",
     "library_read:getDistinctValuesForProperty",
 
+    // sbIRemoteMediaList
+    "library_read:getItemProperties",
+
     // sbILibraryResource
     "library_read:getProperty",
     "library_read:equals"
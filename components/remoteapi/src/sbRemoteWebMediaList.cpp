@@ -87,6 +87,7 @@ const static char* sPublicMethods[] =
   "site:equals",
 
   // sbIRemoteMediaList
+  "site:getItemProperties",
   "internal:getView"
 };
 
@@ -241,3 +241,11 @@ sbSQLBuilderBase::ToString(nsAString& _retval)
   return NS_ERROR_NOT_IMPLEMENTED;
 }
 
+NS_IMETHODIMP
+sbSQLBuilderBase::ToParameterizedString(nsIMutableArray* aParameters,
+                                        nsAString& _retval)
+{
+  // not meant to be implemented by base class
+  return NS_ERROR_NOT_IMPLEMENTED;
+}
+
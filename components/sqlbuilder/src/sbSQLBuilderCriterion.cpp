@@ -27,8 +27,21 @@
 #include "sbSQLBuilderCriterion.h"
 #include "sbSQLBuilderBase.h"
 
+#include <nsIMutableArray.h>
+#include <nsIVariant.h>
+
+#include <sbVariantUtils.h>
+
 #include "prprf.h"
 
+/*
+ * An in list with more values than this keeps them as literals in a
+ * parameterized statement.  SQLite allows at most 999 parameters in a
+ * statement, and a list that long is unlikely to be run again with other
+ * values anyway.
+ */
+#define SB_SQLBUILDER_MAX_IN_PARAMETERS 32
+
 NS_IMPL_THREADSAFE_ISUPPORTS1(sbSQLBuilderCriterionBase,
                               sbISQLBuilderCriterion)
 
@@ -45,6 +58,12 @@ sbSQLBuilderCriterionBase::sbSQLBuilderCriterionBase(const nsAString& aTableName
 {
 }
 
+NS_IMETHODIMP
+sbSQLBuilderCriterionBase::ToString(nsAString& _retval)
+{
+  return AppendTo(_retval, nsnull);
+}
+
 void
 sbSQLBuilderCriterionBase::AppendMatchTo(nsAString& aStr)
 {
@@ -91,15 +110,20 @@ sbSQLBuilderCriterionBase::AppendTableColumnTo(nsAString& aStr)
   aStr.Append(mColumnName);
 }
 
-void
+nsresult
 sbSQLBuilderCriterionBase::AppendLogicalTo(const nsAString& aOperator,
-                                           nsAString& aStr)
+                                           nsAString& aStr,
+                                           nsIMutableArray* aParameters)
 {
+  nsresult rv;
+
   aStr.AppendLiteral("(");
 
   sbISQLBuilderCriterion* criterion = mLeft;
   nsAutoString str;
-  static_cast<sbSQLBuilderCriterionBase*>(criterion)->ToString(str);
+  rv = static_cast<sbSQLBuilderCriterionBase*>(criterion)->AppendTo(str,
+                                                                    aParameters);
+  NS_ENSURE_SUCCESS(rv, rv);
   aStr.Append(str);
 
   aStr.AppendLiteral(" ");
@@ -108,10 +132,28 @@ sbSQLBuilderCriterionBase::AppendLogicalTo(const nsAString& aOperator,
 
   criterion = mRight;
   str.Truncate();
-  static_cast<sbSQLBuilderCriterionBase*>(criterion)->ToString(str);
+  rv = static_cast<sbSQLBuilderCriterionBase*>(criterion)->AppendTo(str,
+                                                                    aParameters);
+  NS_ENSURE_SUCCESS(rv, rv);
   aStr.Append(str);
 
   aStr.AppendLiteral(")");
+
+  return NS_OK;
+}
+
+nsresult
+sbSQLBuilderCriterionBase::AppendParameterTo(nsIVariant* aValue,
+                                             nsAString& aStr,
+                                             nsIMutableArray* aParameters)
+{
+  NS_ENSURE_TRUE(aValue, NS_ERROR_OUT_OF_MEMORY);
+
+  nsresult rv = aParameters->AppendElement(aValue, PR_FALSE);
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  aStr.AppendLiteral("?");
+  return NS_OK;
 }
 
 // sbSQLBuilderCriterionString
@@ -127,19 +169,26 @@ sbSQLBuilderCriterionString::sbSQLBuilderCriterionString(const nsAString& aTable
 {
 }
 
-NS_IMETHODIMP
-sbSQLBuilderCriterionString::ToString(nsAString& _retval)
+nsresult
+sbSQLBuilderCriterionString::AppendTo(nsAString& _retval,
+                                      nsIMutableArray* aParameters)
 {
   AppendTableColumnTo(_retval);
 
   AppendMatchTo(_retval);
 
-  nsAutoString escapedValue(mValue);
-  SB_EscapeSQL(escapedValue);
+  if (aParameters) {
+    nsresult rv = AppendParameterTo(sbNewVariant(mValue), _retval, aParameters);
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
+  else {
+    nsAutoString escapedValue(mValue);
+    SB_EscapeSQL(escapedValue);
 
-  _retval.AppendLiteral("'");
-  _retval.Append(escapedValue);
-  _retval.AppendLiteral("'");
+    _retval.AppendLiteral("'");
+    _retval.Append(escapedValue);
+    _retval.AppendLiteral("'");
+  }
   if (mMatchType == sbISQLWhereBuilder::MATCH_LIKE ||
       mMatchType == sbISQLWhereBuilder::MATCH_NOTLIKE) {
     _retval.AppendLiteral(" ESCAPE '\\'");
@@ -163,8 +212,9 @@ sbSQLBuilderCriterionBetweenString::sbSQLBuilderCriterionBetweenString(const nsA
 {
 }
 
-NS_IMETHODIMP
-sbSQLBuilderCriterionBetweenString::ToString(nsAString& _retval)
+nsresult
+sbSQLBuilderCriterionBetweenString::AppendTo(nsAString& _retval,
+                                             nsIMutableArray* aParameters)
 {
   AppendTableColumnTo(_retval);
 
@@ -174,6 +224,16 @@ sbSQLBuilderCriterionBetweenString::ToString(nsAString& _retval)
 
   _retval.AppendLiteral(" between ");
 
+  if (aParameters) {
+    nsresult rv;
+    rv = AppendParameterTo(sbNewVariant(mLeftValue), _retval, aParameters);
+    NS_ENSURE_SUCCESS(rv, rv);
+    _retval.AppendLiteral(" and ");
+    rv = AppendParameterTo(sbNewVariant(mRightValue), _retval, aParameters);
+    NS_ENSURE_SUCCESS(rv, rv);
+    return NS_OK;
+  }
+
   nsAutoString escapedLeftValue(mLeftValue);
   SB_EscapeSQL(escapedLeftValue);
 
@@ -202,13 +262,18 @@ sbSQLBuilderCriterionLong::sbSQLBuilderCriterionLong(const nsAString& aTableName
 {
 }
 
-NS_IMETHODIMP
-sbSQLBuilderCriterionLong::ToString(nsAString& _retval)
+nsresult
+sbSQLBuilderCriterionLong::AppendTo(nsAString& _retval,
+                                    nsIMutableArray* aParameters)
 {
   AppendTableColumnTo(_retval);
 
   AppendMatchTo(_retval);
 
+  if (aParameters) {
+    return AppendParameterTo(sbNewVariant(mValue), _retval, aParameters);
+  }
+
   nsAutoString stringValue;
   stringValue.AppendInt(mValue);
   _retval.Append(stringValue);
@@ -228,13 +293,18 @@ sbSQLBuilderCriterionLongLong::sbSQLBuilderCriterionLongLong(const nsAString& aT
 {
 }
 
-NS_IMETHODIMP
-sbSQLBuilderCriterionLongLong::ToString(nsAString& _retval)
+nsresult
+sbSQLBuilderCriterionLongLong::AppendTo(nsAString& _retval,
+                                        nsIMutableArray* aParameters)
 {
   AppendTableColumnTo(_retval);
 
   AppendMatchTo(_retval);
 
+  if (aParameters) {
+    return AppendParameterTo(sbNewVariant(mValue), _retval, aParameters);
+  }
+
   // Unfortunately nsAString has no AppendInt64...
   char out[32] = {0};
   PR_snprintf(out, 32, "%lld", mValue);
@@ -253,8 +323,9 @@ sbSQLBuilderCriterionNull::sbSQLBuilderCriterionNull(const nsAString& aTableName
 {
 }
 
-NS_IMETHODIMP
-sbSQLBuilderCriterionNull::ToString(nsAString& _retval)
+nsresult
+sbSQLBuilderCriterionNull::AppendTo(nsAString& _retval,
+                                    nsIMutableArray* aParameters)
 {
   AppendTableColumnTo(_retval);
 
@@ -278,13 +349,19 @@ sbSQLBuilderCriterionParameter::sbSQLBuilderCriterionParameter(const nsAString&
 {
 }
 
-NS_IMETHODIMP
-sbSQLBuilderCriterionParameter::ToString(nsAString& _retval)
+nsresult
+sbSQLBuilderCriterionParameter::AppendTo(nsAString& _retval,
+                                         nsIMutableArray* aParameters)
 {
   AppendTableColumnTo(_retval);
 
   AppendMatchTo(_retval);
 
+  // The caller binds this one, so its value is left void
+  if (aParameters) {
+    return AppendParameterTo(sbNewVariant(), _retval, aParameters);
+  }
+
   _retval.AppendLiteral("?");
   return NS_OK;
 }
@@ -304,8 +381,9 @@ sbSQLBuilderCriterionTable::sbSQLBuilderCriterionTable(const nsAString& aLeftTab
 {
 }
 
-NS_IMETHODIMP
-sbSQLBuilderCriterionTable::ToString(nsAString& _retval)
+nsresult
+sbSQLBuilderCriterionTable::AppendTo(nsAString& _retval,
+                                     nsIMutableArray* aParameters)
 {
   AppendTableColumnTo(_retval);
 
@@ -330,11 +408,11 @@ sbSQLBuilderCriterionAnd::sbSQLBuilderCriterionAnd(sbISQLBuilderCriterion* aLeft
 {
 }
 
-NS_IMETHODIMP
-sbSQLBuilderCriterionAnd::ToString(nsAString& _retval)
+nsresult
+sbSQLBuilderCriterionAnd::AppendTo(nsAString& _retval,
+                                   nsIMutableArray* aParameters)
 {
-  AppendLogicalTo(NS_LITERAL_STRING("and"), _retval);
-  return NS_OK;
+  return AppendLogicalTo(NS_LITERAL_STRING("and"), _retval, aParameters);
 }
 
 // sbSQLBuilderCriterionOr
@@ -349,11 +427,11 @@ sbSQLBuilderCriterionOr::sbSQLBuilderCriterionOr(sbISQLBuilderCriterion* aLeft,
   mRight = aRight;
 }
 
-NS_IMETHODIMP
-sbSQLBuilderCriterionOr::ToString(nsAString& _retval)
+nsresult
+sbSQLBuilderCriterionOr::AppendTo(nsAString& _retval,
+                                  nsIMutableArray* aParameters)
 {
-  AppendLogicalTo(NS_LITERAL_STRING("or"), _retval);
-  return NS_OK;
+  return AppendLogicalTo(NS_LITERAL_STRING("or"), _retval, aParameters);
 }
 
 // sbSQLBuilderCriterionIn
@@ -414,11 +492,33 @@ sbSQLBuilderCriterionIn::Clear()
 NS_IMETHODIMP
 sbSQLBuilderCriterionIn::ToString(nsAString& _retval)
 {
+  return AppendTo(_retval, nsnull);
+}
+
+nsresult
+sbSQLBuilderCriterionIn::AppendTo(nsAString& _retval,
+                                  nsIMutableArray* aParameters)
+{
+  nsresult rv;
+
   AppendTableColumnTo(_retval);
 
   _retval.AppendLiteral(" in (");
 
   PRUint32 len = mInItems.Length();
+
+  // Subqueries are still parameterized when the values are not
+  nsIMutableArray* valueParameters = aParameters;
+  PRUint32 valueCount = 0;
+  for (PRUint32 i = 0; i < len; i++) {
+    if (mInItems[i].type == eString || mInItems[i].type == eInteger32) {
+      valueCount++;
+    }
+  }
+  if (valueCount > SB_SQLBUILDER_MAX_IN_PARAMETERS) {
+    valueParameters = nsnull;
+  }
+
   for (PRUint32 i = 0; i < len; i++) {
     const sbInItem& ii = mInItems[i];
 
@@ -428,6 +528,14 @@ sbSQLBuilderCriterionIn::ToString(nsAString& _retval)
         break;
       case eString:
       {
+        if (valueParameters) {
+          rv = AppendParameterTo(sbNewVariant(ii.stringValue),
+                                 _retval,
+                                 valueParameters);
+          NS_ENSURE_SUCCESS(rv, rv);
+          break;
+        }
+
         nsAutoString escapedValue(ii.stringValue);
         SB_EscapeSQL(escapedValue);
 
@@ -437,13 +545,25 @@ sbSQLBuilderCriterionIn::ToString(nsAString& _retval)
         break;
       }
       case eInteger32:
-        _retval.AppendInt(ii.int32Value);
+        if (valueParameters) {
+          rv = AppendParameterTo(sbNewVariant(ii.int32Value),
+                                 _retval,
+                                 valueParameters);
+          NS_ENSURE_SUCCESS(rv, rv);
+        }
+        else {
+          _retval.AppendInt(ii.int32Value);
+        }
         break;
       case eSubquery:
       {
-        nsresult rv;
         nsAutoString sql;
-        rv = ii.subquery->ToString(sql);
+        if (aParameters) {
+          rv = ii.subquery->ToParameterizedString(aParameters, sql);
+        }
+        else {
+          rv = ii.subquery->ToString(sql);
+        }
         NS_ENSURE_SUCCESS(rv, rv);
         _retval.Append(sql);
         break;
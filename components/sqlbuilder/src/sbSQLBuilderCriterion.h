@@ -35,10 +35,22 @@
 #include <nsCOMArray.h>
 #include <nsCOMPtr.h>
 
+class nsIMutableArray;
+class nsIVariant;
+
 class sbSQLBuilderCriterionBase : public sbISQLBuilderCriterion
 {
 public:
   NS_DECL_ISUPPORTS
+  NS_DECL_SBISQLBUILDERCRITERION
+
+  /**
+   * \brief Append the criterion to aStr.  If aParameters is not null, values
+   *        are appended as "?" placeholders and the values themselves are
+   *        appended to aParameters, see sbISQLBuilder::toParameterizedString.
+   */
+  virtual nsresult AppendTo(nsAString& aStr,
+                            nsIMutableArray* aParameters) = 0;
 
   sbSQLBuilderCriterionBase(const nsAString& aTableName,
                             const nsAString& aColumnName,
@@ -50,7 +62,12 @@ public:
 protected:
   void AppendMatchTo(nsAString& aStr);
   void AppendTableColumnTo(nsAString& aStr);
-  void AppendLogicalTo(const nsAString& aOperator, nsAString& aStr);
+  nsresult AppendLogicalTo(const nsAString& aOperator,
+                           nsAString& aStr,
+                           nsIMutableArray* aParameters);
+  nsresult AppendParameterTo(nsIVariant* aValue,
+                             nsAString& aStr,
+                             nsIMutableArray* aParameters);
 
   nsString mTableName;
   nsString mColumnName;
@@ -65,7 +82,6 @@ class sbSQLBuilderCriterionString : public sbSQLBuilderCriterionBase
 {
 public:
   NS_DECL_ISUPPORTS_INHERITED
-  NS_DECL_SBISQLBUILDERCRITERION
 
   sbSQLBuilderCriterionString(const nsAString& aTableName,
                               const nsAString& aColumnName,
@@ -73,6 +89,8 @@ public:
                               const nsAString& aValue);
 
   virtual ~sbSQLBuilderCriterionString() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 private:
   nsString mValue;
 };
@@ -81,7 +99,6 @@ class sbSQLBuilderCriterionBetweenString : public sbSQLBuilderCriterionBase
 {
 public:
   NS_DECL_ISUPPORTS_INHERITED
-  NS_DECL_SBISQLBUILDERCRITERION
 
   sbSQLBuilderCriterionBetweenString(const nsAString& aTableName,
                                      const nsAString& aColumnName,
@@ -90,6 +107,8 @@ public:
                                      PRBool aNegate);
 
   virtual ~sbSQLBuilderCriterionBetweenString() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 private:
   nsString mLeftValue;
   nsString mRightValue;
@@ -100,7 +119,6 @@ class sbSQLBuilderCriterionLong : public sbSQLBuilderCriterionBase
 {
 public:
   NS_DECL_ISUPPORTS_INHERITED
-  NS_DECL_SBISQLBUILDERCRITERION
 
   sbSQLBuilderCriterionLong(const nsAString& aTableName,
                             const nsAString& aColumnName,
@@ -108,6 +126,8 @@ public:
                             PRInt32 aValue);
 
   virtual ~sbSQLBuilderCriterionLong() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 private:
   PRInt32 mValue;
 };
@@ -116,7 +136,6 @@ class sbSQLBuilderCriterionLongLong : public sbSQLBuilderCriterionBase
 {
 public:
   NS_DECL_ISUPPORTS_INHERITED
-  NS_DECL_SBISQLBUILDERCRITERION
 
   sbSQLBuilderCriterionLongLong(const nsAString& aTableName,
                             const nsAString& aColumnName,
@@ -124,6 +143,8 @@ public:
                             PRInt64 aValue);
 
   virtual ~sbSQLBuilderCriterionLongLong() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 private:
   PRInt64 mValue;
 };
@@ -132,31 +153,32 @@ class sbSQLBuilderCriterionNull : public sbSQLBuilderCriterionBase
 {
 public:
   NS_DECL_ISUPPORTS_INHERITED
-  NS_DECL_SBISQLBUILDERCRITERION
 
   sbSQLBuilderCriterionNull(const nsAString& aTableName,
                             const nsAString& aColumnName,
                             PRUint32 aMatchType);
   virtual ~sbSQLBuilderCriterionNull() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 };
 
 class sbSQLBuilderCriterionParameter : public sbSQLBuilderCriterionBase
 {
 public:
   NS_DECL_ISUPPORTS_INHERITED
-  NS_DECL_SBISQLBUILDERCRITERION
 
   sbSQLBuilderCriterionParameter(const nsAString& aTableName,
                                  const nsAString& aColumnName,
                                  PRUint32 aMatchType);
   virtual ~sbSQLBuilderCriterionParameter() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 };
 
 class sbSQLBuilderCriterionTable : public sbSQLBuilderCriterionBase
 {
 public:
   NS_DECL_ISUPPORTS_INHERITED
-  NS_DECL_SBISQLBUILDERCRITERION
 
   sbSQLBuilderCriterionTable(const nsAString& aLeftTableName,
                              const nsAString& aLeftColumnName,
@@ -164,6 +186,8 @@ public:
                              const nsAString& aRightTableName,
                              const nsAString& aRightColumnName);
   virtual ~sbSQLBuilderCriterionTable() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 private:
   nsString mRightTableName;
   nsString mRightColumnName;
@@ -173,22 +197,24 @@ class sbSQLBuilderCriterionAnd : public sbSQLBuilderCriterionBase
 {
 public:
   NS_DECL_ISUPPORTS_INHERITED
-  NS_DECL_SBISQLBUILDERCRITERION
 
   sbSQLBuilderCriterionAnd(sbISQLBuilderCriterion* aLeft,
                            sbISQLBuilderCriterion* aRight);
   virtual ~sbSQLBuilderCriterionAnd() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 };
 
 class sbSQLBuilderCriterionOr : public sbSQLBuilderCriterionBase
 {
 public:
   NS_DECL_ISUPPORTS_INHERITED
-  NS_DECL_SBISQLBUILDERCRITERION
 
   sbSQLBuilderCriterionOr(sbISQLBuilderCriterion* aLeft,
                           sbISQLBuilderCriterion* aRight);
   virtual ~sbSQLBuilderCriterionOr() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 };
 
 class sbSQLBuilderCriterionIn : public sbSQLBuilderCriterionBase,
@@ -202,6 +228,8 @@ public:
   sbSQLBuilderCriterionIn(const nsAString& aTableName,
                           const nsAString& aColumnName);
   virtual ~sbSQLBuilderCriterionIn() {};
+
+  virtual nsresult AppendTo(nsAString& aStr, nsIMutableArray* aParameters);
 private:
   enum ParameterType {
     eIsNull,
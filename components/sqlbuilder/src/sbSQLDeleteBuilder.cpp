@@ -58,6 +58,21 @@ sbSQLDeleteBuilder::Reset()
 
 NS_IMETHODIMP
 sbSQLDeleteBuilder::ToString(nsAString& _retval)
+{
+  return Build(_retval, nsnull);
+}
+
+NS_IMETHODIMP
+sbSQLDeleteBuilder::ToParameterizedString(nsIMutableArray* aParameters,
+                                          nsAString& _retval)
+{
+  NS_ENSURE_ARG_POINTER(aParameters);
+  return Build(_retval, aParameters);
+}
+
+nsresult
+sbSQLDeleteBuilder::Build(nsAString& _retval,
+                          nsIMutableArray* aParameters)
 {
   nsresult rv;
   nsAutoString buff;
@@ -66,7 +81,7 @@ sbSQLDeleteBuilder::ToString(nsAString& _retval)
 
   buff.Append(mTableName);
 
-  rv = AppendWhere(buff);
+  rv = AppendWhere(buff, aParameters);
   NS_ENSURE_SUCCESS(rv, rv);
 
   _retval.Assign(buff);
@@ -43,12 +43,17 @@ public:
   NS_FORWARD_SBISQLWHEREBUILDER(sbSQLWhereBuilder::)
   NS_DECL_SBISQLDELETEBUILDER
 
-  // override sbISQLBuilder::ToString and sbISQLBuilder::Reset
+  // override sbISQLBuilder::ToString, sbISQLBuilder::ToParameterizedString
+  // and sbISQLBuilder::Reset
   NS_IMETHOD ToString(nsAString& _result);
+  NS_IMETHOD ToParameterizedString(nsIMutableArray* aParameters,
+                                   nsAString& _result);
   NS_IMETHOD Reset();
 
   sbSQLDeleteBuilder();
 private:
+  nsresult Build(nsAString& _result, nsIMutableArray* aParameters);
+
   nsString mTableName;
 };
 
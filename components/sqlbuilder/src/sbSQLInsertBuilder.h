@@ -46,6 +46,13 @@ public:
   NS_IMETHOD ToString(nsAString& _retval);
   NS_IMETHOD Reset();
 
+  // parameterized statements are not supported
+  NS_IMETHOD ToParameterizedString(nsIMutableArray* aParameters,
+                                   nsAString& _retval)
+  {
+    return sbSQLBuilderBase::ToParameterizedString(aParameters, _retval);
+  }
+
 private:
   enum ParameterType {
     eIsNull,
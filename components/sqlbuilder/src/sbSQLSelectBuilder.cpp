@@ -28,6 +28,10 @@
 #include "sbSQLWhereBuilder.h"
 #include "sbSQLBuilderCriterion.h"
 
+#include <nsIMutableArray.h>
+
+#include <sbVariantUtils.h>
+
 NS_IMPL_ISUPPORTS_INHERITED1(sbSQLSelectBuilder,
                              sbSQLWhereBuilder,
                              sbISQLSelectBuilder)
@@ -158,8 +162,33 @@ sbSQLSelectBuilder::Reset()
   return NS_OK;
 }
 
+// Placeholders the caller binds itself get a void value
+static nsresult
+AppendVoidParameter(nsIMutableArray* aParameters)
+{
+  nsCOMPtr<nsIVariant> value = sbNewVariant().get();
+  NS_ENSURE_TRUE(value, NS_ERROR_OUT_OF_MEMORY);
+
+  return aParameters->AppendElement(value, PR_FALSE);
+}
+
 NS_IMETHODIMP
 sbSQLSelectBuilder::ToString(nsAString& _retval)
+{
+  return Build(_retval, nsnull);
+}
+
+NS_IMETHODIMP
+sbSQLSelectBuilder::ToParameterizedString(nsIMutableArray* aParameters,
+                                          nsAString& _retval)
+{
+  NS_ENSURE_ARG_POINTER(aParameters);
+  return Build(_retval, aParameters);
+}
+
+nsresult
+sbSQLSelectBuilder::Build(nsAString& _retval,
+                          nsIMutableArray* aParameters)
 {
   nsresult rv;
   nsAutoString buff;
@@ -198,7 +227,13 @@ sbSQLSelectBuilder::ToString(nsAString& _retval)
     const sbSubqueryInfo& sq = mSubqueries[i];
     buff.AppendLiteral(", ( ");
     nsAutoString str;
-    sq.subquery->ToString(str);
+    if (aParameters) {
+      rv = sq.subquery->ToParameterizedString(aParameters, str);
+    }
+    else {
+      rv = sq.subquery->ToString(str);
+    }
+    NS_ENSURE_SUCCESS(rv, rv);
     buff.Append(str);
     buff.AppendLiteral(" )");
     if (!sq.alias.IsEmpty()) {
@@ -227,7 +262,13 @@ sbSQLSelectBuilder::ToString(nsAString& _retval)
     if (ji.subquery) {
       buff.AppendLiteral("(");
       nsAutoString str;
-      ji.subquery->ToString(str);
+      if (aParameters) {
+        rv = ji.subquery->ToParameterizedString(aParameters, str);
+      }
+      else {
+        rv = ji.subquery->ToString(str);
+      }
+      NS_ENSURE_SUCCESS(rv, rv);
       buff.Append(str);
       buff.AppendLiteral(")");
     }
@@ -241,7 +282,9 @@ sbSQLSelectBuilder::ToString(nsAString& _retval)
     buff.AppendLiteral(" on ");
     if (ji.criterion) {
       nsAutoString str;
-      static_cast<sbSQLBuilderCriterionBase*>(ji.criterion.get())->ToString(str);
+      rv = static_cast<sbSQLBuilderCriterionBase*>(ji.criterion.get())->
+             AppendTo(str, aParameters);
+      NS_ENSURE_SUCCESS(rv, rv);
       buff.Append(str);
     }
     else {
@@ -269,7 +312,7 @@ sbSQLSelectBuilder::ToString(nsAString& _retval)
     }
   }
 
-  rv = AppendWhere(buff);
+  rv = AppendWhere(buff, aParameters);
   NS_ENSURE_SUCCESS(rv, rv);
 
   // Append group by clause
@@ -321,6 +364,10 @@ sbSQLSelectBuilder::ToString(nsAString& _retval)
     buff.AppendLiteral(" limit ");
     if(mLimitIsParameter) {
       buff.AppendLiteral("?");
+      if (aParameters) {
+        rv = AppendVoidParameter(aParameters);
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
     }
     else {
       buff.AppendInt(mLimit);
@@ -331,6 +378,10 @@ sbSQLSelectBuilder::ToString(nsAString& _retval)
     buff.AppendLiteral(" offset ");
     if(mOffsetIsParameter) {
       buff.AppendLiteral("?");
+      if (aParameters) {
+        rv = AppendVoidParameter(aParameters);
+        NS_ENSURE_SUCCESS(rv, rv);
+      }
     }
     else {
       buff.AppendInt(mOffset);
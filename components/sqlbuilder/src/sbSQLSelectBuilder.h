@@ -46,13 +46,18 @@ public:
   NS_FORWARD_SBISQLWHEREBUILDER(sbSQLWhereBuilder::)
   NS_DECL_SBISQLSELECTBUILDER
 
-  // override sbISQLBuilder::ToString and sbISQLBuilder::Reset
+  // override sbISQLBuilder::ToString, sbISQLBuilder::ToParameterizedString
+  // and sbISQLBuilder::Reset
   NS_IMETHOD ToString(nsAString& _result);
+  NS_IMETHOD ToParameterizedString(nsIMutableArray* aParameters,
+                                   nsAString& _result);
   NS_IMETHOD Reset();
 
   sbSQLSelectBuilder();
   virtual ~sbSQLSelectBuilder();
 private:
+  nsresult Build(nsAString& _result, nsIMutableArray* aParameters);
+
   struct sbOrderInfo
   {
     nsString tableName;
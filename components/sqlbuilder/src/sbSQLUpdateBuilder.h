@@ -48,6 +48,13 @@ public:
   NS_IMETHOD ToString(nsAString& _result);
   NS_IMETHOD Reset();
 
+  // parameterized statements are not supported
+  NS_IMETHOD ToParameterizedString(nsIMutableArray* aParameters,
+                                   nsAString& _result)
+  {
+    return sbSQLBuilderBase::ToParameterizedString(aParameters, _result);
+  }
+
   sbSQLUpdateBuilder();
 private:
   enum AssignmentType {
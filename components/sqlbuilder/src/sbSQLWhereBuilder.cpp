@@ -260,7 +260,8 @@ sbSQLWhereBuilder::Reset()
 }
 
 nsresult
-sbSQLWhereBuilder::AppendWhere(nsAString& aBuffer)
+sbSQLWhereBuilder::AppendWhere(nsAString& aBuffer,
+                               nsIMutableArray* aParameters)
 {
   nsresult rv;
 
@@ -273,7 +274,8 @@ sbSQLWhereBuilder::AppendWhere(nsAString& aBuffer)
         do_QueryInterface(mCritera[i], &rv);
       NS_ENSURE_SUCCESS(rv, rv);
       nsAutoString str;
-      rv = criterion->ToString(str);
+      rv = static_cast<sbSQLBuilderCriterionBase*>(criterion.get())->
+             AppendTo(str, aParameters);
       NS_ENSURE_SUCCESS(rv, rv);
       aBuffer.Append(str);
       if (i + 1 < len) {
@@ -34,6 +34,8 @@
 #include <nsCOMPtr.h>
 #include <nsCOMArray.h>
 
+class nsIMutableArray;
+
 class sbSQLWhereBuilder : public sbSQLBuilderBase,
                           public sbISQLWhereBuilder
 {
@@ -46,7 +48,10 @@ public:
 protected:
   NS_IMETHOD Reset();
 
-  nsresult AppendWhere(nsAString& aBuffer);
+  // If aParameters is not null, the values of the criteria are appended as
+  // placeholders, see sbISQLBuilder::toParameterizedString
+  nsresult AppendWhere(nsAString& aBuffer,
+                       nsIMutableArray* aParameters = nsnull);
 
   nsCOMArray<sbISQLBuilderCriterion> mCritera;
 
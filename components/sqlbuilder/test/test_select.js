@@ -118,6 +118,58 @@ function runTest () {
   sql = "select name from bbc where population >= 20000000000";
   assertEqual(sql, q.toString());
 
+  // Values become placeholders, so queries that only differ in their values
+  // produce the same parameterized statement
+  q = newQuery();
+  q.baseTableName = "bbc"
+  q.addColumn(null, "name");
+  c1 = q.createMatchCriterionString(null, "region",
+                                    Ci.sbISQLBuilder.MATCH_EQUALS,
+                                    "South Asia");
+  c2 = q.createMatchCriterionLong(null, "population",
+                                  Ci.sbISQLBuilder.MATCH_GREATEREQUAL,
+                                  200000000);
+  q.addCriterion(q.createOrCriterion(c1, c2));
+  c = q.createMatchCriterionIn(null, "name");
+  c.addString("France");
+  c.addLong(42);
+  q.addCriterion(c);
+  q.limitIsParameter = true;
+  sql = "select name from bbc where (region = 'South Asia' or population >= 200000000) and name in ('France', 42) limit ?";
+  assertEqual(sql, q.toString());
+
+  var params = Cc["@songbirdnest.com/moz/xpcom/threadsafe-array;1"]
+                 .createInstance(Ci.nsIMutableArray);
+  sql = "select name from bbc where (region = ? or population >= ?) and name in (?, ?) limit ?";
+  assertEqual(sql, q.toParameterizedString(params));
+  assertEqual(params.length, 5);
+  assertEqual(params.queryElementAt(0, Ci.nsIVariant), "South Asia");
+  assertEqual(params.queryElementAt(1, Ci.nsIVariant), 200000000);
+  assertEqual(params.queryElementAt(2, Ci.nsIVariant), "France");
+  assertEqual(params.queryElementAt(3, Ci.nsIVariant), 42);
+  assertEqual(params.queryElementAt(4, Ci.nsIVariant), undefined);
+
+  // A long in list keeps its values as literals
+  q = newQuery();
+  q.baseTableName = "bbc"
+  q.addColumn(null, "name");
+  c = q.createMatchCriterionIn(null, "population");
+  var values = [];
+  for (var i = 0; i < 40; i++) {
+    c.addLong(i);
+    values.push(i);
+  }
+  q.addCriterion(c);
+  q.addCriterion(q.createMatchCriterionString(null, "region",
+                                              Ci.sbISQLBuilder.MATCH_EQUALS,
+                                              "Europe"));
+  params.clear();
+  sql = "select name from bbc where population in (" + values.join(", ") +
+        ") and region = ?";
+  assertEqual(sql, q.toParameterizedString(params));
+  assertEqual(params.length, 1);
+  assertEqual(params.queryElementAt(0, Ci.nsIVariant), "Europe");
+
   return Components.results.NS_OK;
 
 }
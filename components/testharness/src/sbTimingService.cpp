@@ -41,6 +41,7 @@
 #include <nsServiceManagerUtils.h>
 #include <nsXPCOMCID.h>
 
+#include <sbIPerfStatistics.h>
 #include <sbStringUtils.h>
 
 #define NS_APPSTARTUP_CATEGORY           "app-startup"
@@ -375,6 +376,15 @@ sbTimingService::Observe(nsISupports* aSubject,
         
         // Now handle any error from close
         NS_ENSURE_SUCCESS(rvclose, rvclose);
+
+        // Follow the timer results with the hot path statistics recorded
+        // during the run so that both end up in the same log.
+        nsCOMPtr<sbIPerfStatistics> perfStatistics =
+          do_GetService(SB_PERFSTATISTICS_CONTRACTID, &rv);
+        if (NS_SUCCEEDED(rv)) {
+          rv = perfStatistics->DumpToFile(mLogFile, PR_FALSE);
+          NS_ENSURE_SUCCESS(rv, rv);
+        }
       }
     }
   }
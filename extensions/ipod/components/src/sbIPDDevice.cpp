@@ -60,6 +60,7 @@
 
 // Mozilla imports.
 #include <nsIClassInfoImpl.h>
+#include <nsILocalFile.h>
 #include <nsIProgrammingLanguage.h>
 #include <nsIPropertyBag2.h>
 #include <nsIWritablePropertyBag.h>
@@ -211,6 +212,10 @@ sbIPDDevice::ConnectInternal()
   rv = DBConnect();
   NS_ENSURE_SUCCESS(rv, rv);
 
+  // Connect the iPod mapping services.
+  rv = MapConnect();
+  NS_ENSURE_SUCCESS(rv, rv);
+
   // Connect the iPod preference services.
   rv = PrefConnect();
   NS_ENSURE_SUCCESS(rv, rv);
@@ -269,6 +274,9 @@ sbIPDDevice::DeviceSpecificDisconnect()
   // Disconnect the iPod preference services.
   PrefDisconnect();
 
+  // Disconnect the iPod mapping services.
+  MapDisconnect();
+
   // Disconnect the iPod database.
   DBDisconnect();
 
@@ -785,6 +793,10 @@ NS_IMETHODIMP sbIPDDevice::OpenInputStream(nsIURI*          aURI,
 sbIPDDevice::sbIPDDevice(const nsID&     aControllerID,
                          nsIPropertyBag* aProperties) :
 
+  // Mapping services.
+  mIDMapLock(nsnull),
+  mIDMapConnected(PR_FALSE),
+
   // Preference services.
   mPrefLock(nsnull),
   mPrefConnected(PR_FALSE),
@@ -798,6 +810,11 @@ sbIPDDevice::sbIPDDevice(const nsID&     aControllerID,
   mCreationProperties(aProperties),
   mITDB(NULL),
   mITDBDirty(PR_FALSE),
+  mITDBChangeCount(0),
+  mITDBLastFlush(0),
+  mITDBFlushCount(0),
+  mITDBFlushBytes(0),
+  mITDBFlushTime(0),
   mITDBDevice(NULL),
   mConnected(PR_FALSE),
   mIPDStatus(nsnull)
@@ -901,6 +918,8 @@ sbIPDDevice::DBConnect()
 
   // Initialize the iPod database.
   mITDBDirty = PR_FALSE;
+  mITDBChangeCount = 0;
+  mITDBLastFlush = PR_IntervalNow();
   mITDB = itdb_parse(mountPath.get(), &gError);
   if (gError) {
     if (gError->message) {
@@ -937,11 +956,18 @@ sbIPDDevice::DBDisconnect()
   // Operate under the request lock.
   nsAutoMonitor autoDBLock(mDBLock);
 
+  // Write any iPod database changes that have not been written yet.
+  if (mITDB && mITDBDirty) {
+    if (NS_FAILED(DBFlush()))
+      NS_WARNING("Failed to write the iPod database on disconnect.");
+  }
+
   // Dispose of the iPod database and device data records.
   if (mITDB)
     itdb_free(mITDB);
   mITDB = NULL;
   mITDBDirty = PR_FALSE;
+  mITDBChangeCount = 0;
   mMasterPlaylist = NULL;
   if (mITDBDevice)
     itdb_device_free(mITDBDevice);
@@ -1409,22 +1435,55 @@ sbIPDDevice::ImportDatabase()
 
 
 /**
- * Flush all data to the device database.
+ * Mark the device database as dirty.  Each change counts against the budget of
+ * changes after which DBFlush writes the database without being forced to.
+ * This function must be called under the request lock.
+ */
+
+void
+sbIPDDevice::DBChanged()
+{
+  mITDBDirty = PR_TRUE;
+  mITDBChangeCount++;
+}
+
+
+/**
+ * Flush all data to the device database.  Unless aForceFlush is true, the
+ * database is only written if IPOD_DB_FLUSH_CHANGE_BUDGET changes have been
+ * made or IPOD_DB_FLUSH_PERIOD has passed since it was last written; the
+ * remaining changes are written once the request queue drains.
  * This function must be called under the connect lock.
+ *
+ * \param aForceFlush           Write the database if it's dirty at all.
  */
 
 nsresult
-sbIPDDevice::DBFlush()
+sbIPDDevice::DBFlush(PRBool aForceFlush)
 {
   GError   *gError = nsnull;
+  nsresult rv;
 
   // Operate under the request lock.
   nsAutoMonitor autoDBLock(mDBLock);
 
+  // Write the pending ID map changes.
+  rv = IDMapFlush();
+  NS_ENSURE_SUCCESS(rv, rv);
+
   // Do nothing unless database is dirty.
   if (!mITDBDirty)
     return NS_OK;
 
+  // Coalesce writes unless a flush is forced or due.
+  PRIntervalTime startTime = PR_IntervalNow();
+  if (!aForceFlush &&
+      (mITDBChangeCount < IPOD_DB_FLUSH_CHANGE_BUDGET) &&
+      ((PRIntervalTime) (startTime - mITDBLastFlush) <
+       PR_MillisecondsToInterval(IPOD_DB_FLUSH_PERIOD))) {
+    return NS_OK;
+  }
+
   // Write the iPod device database file.
   if (!itdb_write(mITDB, &gError)) {
     if (gError) {
@@ -1448,8 +1507,31 @@ sbIPDDevice::DBFlush()
     NS_ENSURE_TRUE(PR_FALSE, NS_ERROR_FAILURE);
   }
 
+  // Record how much was written and how long it took.
+  PRIntervalTime endTime = PR_IntervalNow();
+  PRIntervalTime flushTime = endTime - startTime;
+  nsCString mountPath = NS_ConvertUTF16toUTF8(mMountPath);
+  gchar* itdbPath = itdb_get_itunesdb_path(mountPath.get());
+  sbAutoGMemPtr autoITDBPath(itdbPath);
+  gchar* itsdPath = itdb_get_itunessd_path(mountPath.get());
+  sbAutoGMemPtr autoITSDPath(itsdPath);
+  PRInt64 flushBytes = DBGetFileSize(itdbPath) + DBGetFileSize(itsdPath);
+  mITDBFlushCount++;
+  mITDBFlushBytes += flushBytes;
+  mITDBFlushTime += flushTime;
+  FIELD_LOG(("Wrote iPod database: %u changes, %lld bytes, %u ms "
+             "(%u writes, %llu bytes, %u ms total)\n",
+             mITDBChangeCount,
+             flushBytes,
+             PR_IntervalToMilliseconds(flushTime),
+             mITDBFlushCount,
+             mITDBFlushBytes,
+             PR_IntervalToMilliseconds(mITDBFlushTime)));
+
   // Database is no longer dirty.
   mITDBDirty = PR_FALSE;
+  mITDBChangeCount = 0;
+  mITDBLastFlush = endTime;
 
   // Force updating of statistics.
   StatsUpdate(PR_TRUE);
@@ -1458,6 +1540,79 @@ sbIPDDevice::DBFlush()
 }
 
 
+/**
+ * Return the size of the device database file specified by aPath, or 0 if it
+ * doesn't exist.
+ *
+ * \param aPath                 Path of the database file.
+ */
+
+PRInt64
+sbIPDDevice::DBGetFileSize(const gchar* aPath)
+{
+  nsresult rv;
+
+  if (!aPath)
+    return 0;
+
+  nsCOMPtr<nsILocalFile> file;
+  rv = NS_NewNativeLocalFile(nsDependentCString(aPath),
+                             PR_FALSE,
+                             getter_AddRefs(file));
+  NS_ENSURE_SUCCESS(rv, 0);
+
+  PRInt64 fileSize;
+  rv = file->GetFileSize(&fileSize);
+  if (NS_FAILED(rv))
+    return 0;
+
+  return fileSize;
+}
+
+
+/**
+ * Return the device to the idle state unless database changes are waiting to
+ * be written.  In that case, the device stays busy so that it isn't ejected
+ * before ProcessQueueDrained writes them.
+ */
+
+void
+sbIPDDevice::ReqIdle()
+{
+  // Check the database dirty state under the request lock.
+  {
+    nsAutoMonitor autoDBLock(mDBLock);
+    if (mITDBDirty)
+      return;
+  }
+  mIPDStatus->Idle();
+}
+
+
+/**
+ * Write the coalesced device database changes once all queued requests have
+ * been processed, and return the device to the idle state.
+ */
+
+nsresult
+sbIPDDevice::ProcessQueueDrained()
+{
+  nsresult rv;
+
+  // Operate under the connect lock.
+  sbAutoReadLock autoConnectLock(mConnectLock);
+  if (!mConnected)
+    return NS_OK;
+
+  // Write the database.
+  rv = DBFlush(PR_TRUE);
+  mIPDStatus->Idle();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+
 /**
  * Connect the device capabilities.
  */
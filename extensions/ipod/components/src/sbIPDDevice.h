@@ -154,6 +154,11 @@
 //
 //   mITDB
 //   mITDBDirty
+//   mITDBChangeCount
+//   mITDBLastFlush
+//   mITDBFlushCount
+//   mITDBFlushBytes
+//   mITDBFlushTime
 //   mITDBDevice
 //   mMasterPlaylist
 //   mIPDStatus
@@ -168,6 +173,13 @@
 //   mSyncPlaylistList
 //   mSyncPlaylistListDirty
 //
+// ID map lock
+//
+//   mIDMapConnected
+//   mIDMapIPodToSB
+//   mIDMapSBToIPod
+//   mIDMapPendingQueries
+//
 // Not locked
 //   mConnectLock
 //   mRequestLock
@@ -205,10 +217,19 @@
 //   IPOD_LOCALE_BUNDLE_PATH    Path to localized string bundle.
 //   IPOD_STATS_UPDATE_PERIOD   Period in milliseconds for updating the iPod
 //                              statistics.
+//   IPOD_DB_FLUSH_CHANGE_BUDGET
+//                              Number of iPod database changes after which the
+//                              database is written even if more requests are
+//                              queued.
+//   IPOD_DB_FLUSH_PERIOD       Period in milliseconds after which a dirty iPod
+//                              database is written even if more requests are
+//                              queued.
 //
 
 #define IPOD_LOCALE_BUNDLE_PATH     "chrome://ipod/locale/IPodDevice.properties"
 #define IPOD_STATS_UPDATE_PERIOD    500
+#define IPOD_DB_FLUSH_CHANGE_BUDGET 250
+#define IPOD_DB_FLUSH_PERIOD        30000
 
 
 //------------------------------------------------------------------------------
@@ -354,6 +375,31 @@ private:
   static const char SBIDDelimiter = ':';
 
 
+  //
+  // iPod device mapping services fields.
+  //
+  //   mIDMapLock               ID map lock.
+  //   mIDMapConnected          True if the ID map has been loaded.
+  //   mIDMapIPodToSB           Map from iPod IDs to Songbird IDs.
+  //   mIDMapSBToIPod           Map from Songbird IDs to iPod IDs.
+  //   mIDMapPendingQueries     ID map database queries not yet executed.
+  //
+  //   IDMapMaxPendingQueries   Maximum number of ID map database queries to
+  //                            hold before executing them.
+  //
+
+  typedef std::map<guint64, nsString>        IDMapIPodToSBMap;
+  typedef std::multimap<nsString, guint64>   IDMapSBToIPodMap;
+
+  static const PRUint32 IDMapMaxPendingQueries = 500;
+
+  PRLock*                       mIDMapLock;
+  PRBool                        mIDMapConnected;
+  IDMapIPodToSBMap              mIDMapIPodToSB;
+  IDMapSBToIPodMap              mIDMapSBToIPod;
+  nsTArray<nsCString>           mIDMapPendingQueries;
+
+
   //
   // iPod device mapping services.
   //
@@ -362,6 +408,10 @@ private:
 
   void MapFinalize();
 
+  nsresult MapConnect();
+
+  void MapDisconnect();
+
 
   //
   // iPod device ID mapping services.
@@ -390,6 +440,8 @@ private:
 
   nsresult IDMapCreateDBQuery(sbIDatabaseQuery** aQuery);
 
+  nsresult IDMapFlush();
+
   nsresult GetSBID(sbIMediaItem* aMediaItem,
                    nsAString&    aSBID);
 
@@ -414,6 +466,10 @@ private:
                         const char*         aQueryStr,
                         sbIDatabaseResult** aDBResult);
 
+  nsresult IDMapLoad();
+
+  void IDMapRemoveMapping(guint64 aIPodID);
+
 
   //----------------------------------------------------------------------------
   //
@@ -974,6 +1030,13 @@ private:
   //   mITDB                    Libgpod iPod database data record.
   //   mITDBDirty               True if the database is dirty and needs to be
   //                            written.
+  //   mITDBChangeCount         Number of changes since the database was last
+  //                            written.
+  //   mITDBLastFlush           Time the database was last written.
+  //   mITDBFlushCount          Number of times the database was written.
+  //   mITDBFlushBytes          Total number of bytes written to the database
+  //                            files.
+  //   mITDBFlushTime           Total time spent writing the database.
   //   mITDBDevice              Libgpod iPod device data record.
   //   mMasterPlaylist          iPod database master playlist.
   //
@@ -1006,6 +1069,11 @@ private:
 
   Itdb_iTunesDB*                mITDB;
   PRBool                        mITDBDirty;
+  PRUint32                      mITDBChangeCount;
+  PRIntervalTime                mITDBLastFlush;
+  PRUint32                      mITDBFlushCount;
+  PRUint64                      mITDBFlushBytes;
+  PRIntervalTime                mITDBFlushTime;
   Itdb_Device*                  mITDBDevice;
   Itdb_Playlist*                mMasterPlaylist;
 
@@ -1029,7 +1097,15 @@ private:
 
   nsresult ImportDatabase();
 
-  nsresult DBFlush();
+  void DBChanged();
+
+  nsresult DBFlush(PRBool aForceFlush = PR_TRUE);
+
+  PRInt64 DBGetFileSize(const gchar* aPath);
+
+  void ReqIdle();
+
+  virtual nsresult ProcessQueueDrained();
 
   nsresult CapabilitiesConnect();
 
@@ -1105,8 +1181,10 @@ private:
 /**
  * Auto-disposal class wrappers.
  *
- *   sbIPDAutoDBFlush           Wrapper to auto-flush the iPod database.
- *   sbIPDAutoIdle              Wrapper to auto idle the iPod device.
+ *   sbIPDAutoDBFlush           Wrapper to auto-flush the iPod database when a
+ *                              flush is due.
+ *   sbIPDAutoIdle              Wrapper to auto idle the iPod device if its
+ *                              database has been written.
  *   sbIPDAutoTrack             Wrapper to auto delete track from the iPod
  *                              device.  First constructor parameter is track
  *                              and the second is the iPod device object.
@@ -1120,13 +1198,13 @@ private:
 SB_AUTO_CLASS(sbIPDAutoDBFlush,
               sbIPDDevice*,
               mValue,
-              mValue->DBFlush(),
+              mValue->DBFlush(PR_FALSE),
               mValue = nsnull);
 
 SB_AUTO_CLASS(sbIPDAutoIdle,
               sbIPDDevice*,
               mValue,
-              mValue->mIPDStatus->Idle(),
+              mValue->ReqIdle(),
               mValue = nsnull);
 
 SB_AUTO_CLASS2(sbIPDAutoTrack,
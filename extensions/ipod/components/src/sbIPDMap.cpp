@@ -50,6 +50,7 @@
 #include <sbIDatabaseResult.h>
 
 // Mozilla imports.
+#include <nsAutoLock.h>
 #include <nsComponentManagerUtils.h>
 #include <prprf.h>
 
@@ -69,6 +70,10 @@ sbIPDDevice::MapInitialize()
 {
   nsresult rv;
 
+  // Create the ID map lock.
+  mIDMapLock = nsAutoLock::NewLock("sbIPDDevice::mIDMapLock");
+  NS_ENSURE_TRUE(mIDMapLock, NS_ERROR_OUT_OF_MEMORY);
+
   // Create the ID map database query object.
   nsCOMPtr<sbIDatabaseQuery> idQuery;
   rv = IDMapCreateDBQuery(getter_AddRefs(idQuery));
@@ -92,6 +97,52 @@ sbIPDDevice::MapInitialize()
 void
 sbIPDDevice::MapFinalize()
 {
+  // Dispose of the ID map lock.
+  if (mIDMapLock)
+    nsAutoLock::DestroyLock(mIDMapLock);
+  mIDMapLock = nsnull;
+}
+
+
+/**
+ * Connect the iPod device mapping services.  The ID map is loaded from the
+ * database so that lookups don't need to query it.
+ */
+
+nsresult
+sbIPDDevice::MapConnect()
+{
+  nsresult rv;
+
+  // Load the ID map.
+  rv = IDMapLoad();
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+
+/**
+ * Disconnect the iPod device mapping services.  Any pending ID map changes are
+ * written to the database.
+ */
+
+void
+sbIPDDevice::MapDisconnect()
+{
+  nsresult rv;
+
+  // Write the pending ID map changes.
+  rv = IDMapFlush();
+  if (NS_FAILED(rv))
+    NS_WARNING("Failed to write the iPod ID map.");
+
+  // Mark the ID map as not connected and dispose of it.
+  nsAutoLock autoIDMapLock(mIDMapLock);
+  mIDMapConnected = PR_FALSE;
+  mIDMapIPodToSB.clear();
+  mIDMapSBToIPod.clear();
+  mIDMapPendingQueries.Clear();
 }
 
 
@@ -102,12 +153,16 @@ sbIPDDevice::MapFinalize()
 //   These services provide support for mapping iPod IDs (e.g., track and
 // playlist IDs) with Songbird library IDs (e.g., media item and media list
 // GUIDs).  These services provide a persistent mapping.
+//   The mapping is kept in memory while the device is connected.  Changes are
+// applied to the in-memory mapping immediately and written to the database in
+// batches by IDMapFlush.
 //
 //------------------------------------------------------------------------------
 
 /**
  * Add a mapping between the Songbird ID specified by aSBID and the iPod ID
- * specified by aIPodID to the ID map.
+ * specified by aIPodID to the ID map.  Any existing mapping for the iPod ID is
+ * replaced.
  *
  * \param aSBID                 Songbird ID to add to map.
  * \param aIPodID               iPod ID to add to map.
@@ -119,10 +174,16 @@ sbIPDDevice::IDMapAdd(nsAString& aSBID,
 {
   nsresult rv;
 
-  // Produce the database query string.
-  char queryStr[256];
-  PR_snprintf(queryStr,
-              sizeof(queryStr),
+  // Produce the database query strings.
+  char deleteQueryStr[256];
+  char insertQueryStr[256];
+  PR_snprintf(deleteQueryStr,
+              sizeof(deleteQueryStr),
+              "DELETE FROM ipod_id_map WHERE ipod_id = \"%08x:%08x\"",
+              (PRUint32) ((aIPodID >> 32) & 0xFFFFFFFF),
+              (PRUint32) (aIPodID & 0xFFFFFFFF));
+  PR_snprintf(insertQueryStr,
+              sizeof(insertQueryStr),
               "INSERT OR REPLACE INTO ipod_id_map"
                 "(songbird_id, ipod_id) VALUES"
                 "(\"%s\", \"%08x:%08x\")",
@@ -130,14 +191,31 @@ sbIPDDevice::IDMapAdd(nsAString& aSBID,
               (PRUint32) ((aIPodID >> 32) & 0xFFFFFFFF),
               (PRUint32) (aIPodID & 0xFFFFFFFF));
 
-  // Create the ID map database query object.
-  nsCOMPtr<sbIDatabaseQuery> idQuery;
-  rv = IDMapCreateDBQuery(getter_AddRefs(idQuery));
-  NS_ENSURE_SUCCESS(rv, rv);
+  // Update the ID map and queue the database queries.
+  PRBool flush;
+  {
+    nsAutoLock autoIDMapLock(mIDMapLock);
+    NS_ENSURE_TRUE(mIDMapConnected, NS_ERROR_NOT_AVAILABLE);
+
+    IDMapRemoveMapping(aIPodID);
+    mIDMapIPodToSB[aIPodID] = aSBID;
+    mIDMapSBToIPod.insert(IDMapSBToIPodMap::value_type(nsString(aSBID),
+                                                       aIPodID));
+
+    NS_ENSURE_TRUE(mIDMapPendingQueries.AppendElement
+                                          (nsDependentCString(deleteQueryStr)),
+                   NS_ERROR_OUT_OF_MEMORY);
+    NS_ENSURE_TRUE(mIDMapPendingQueries.AppendElement
+                                          (nsDependentCString(insertQueryStr)),
+                   NS_ERROR_OUT_OF_MEMORY);
+    flush = mIDMapPendingQueries.Length() >= IDMapMaxPendingQueries;
+  }
 
-  // Execute the query.
-  rv = ExecuteQuery(idQuery, queryStr, nsnull);
-  NS_ENSURE_SUCCESS(rv, rv);
+  // Write the pending changes if too many have accumulated.
+  if (flush) {
+    rv = IDMapFlush();
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
 
   return NS_OK;
 }
@@ -162,14 +240,25 @@ sbIPDDevice::IDMapRemove(guint64 aIPodID)
               (PRUint32) ((aIPodID >> 32) & 0xFFFFFFFF),
               (PRUint32) (aIPodID & 0xFFFFFFFF));
 
-  // Create the ID map database query object.
-  nsCOMPtr<sbIDatabaseQuery> idQuery;
-  rv = IDMapCreateDBQuery(getter_AddRefs(idQuery));
-  NS_ENSURE_SUCCESS(rv, rv);
+  // Update the ID map and queue the database query.
+  PRBool flush;
+  {
+    nsAutoLock autoIDMapLock(mIDMapLock);
+    NS_ENSURE_TRUE(mIDMapConnected, NS_ERROR_NOT_AVAILABLE);
 
-  // Execute the query.
-  rv = ExecuteQuery(idQuery, queryStr, nsnull);
-  NS_ENSURE_SUCCESS(rv, rv);
+    IDMapRemoveMapping(aIPodID);
+
+    NS_ENSURE_TRUE(mIDMapPendingQueries.AppendElement
+                                          (nsDependentCString(queryStr)),
+                   NS_ERROR_OUT_OF_MEMORY);
+    flush = mIDMapPendingQueries.Length() >= IDMapMaxPendingQueries;
+  }
+
+  // Write the pending changes if too many have accumulated.
+  if (flush) {
+    rv = IDMapFlush();
+    NS_ENSURE_SUCCESS(rv, rv);
+  }
 
   return NS_OK;
 }
@@ -187,46 +276,20 @@ nsresult
 sbIPDDevice::IDMapGet(nsAString&         aSBID,
                       nsTArray<guint64>& aIPodIDList)
 {
-  nsresult rv;
-
-  // Produce the database query string.
-  char queryStr[256];
-  PR_snprintf(queryStr,
-              sizeof(queryStr),
-              "SELECT ipod_id FROM ipod_id_map WHERE songbird_id = \"%s\"",
-              NS_ConvertUTF16toUTF8(aSBID).get());
-
-  // Create the ID map database query object.
-  nsCOMPtr<sbIDatabaseQuery> idQuery;
-  rv = IDMapCreateDBQuery(getter_AddRefs(idQuery));
-  NS_ENSURE_SUCCESS(rv, rv);
-
-  // Execute the query.
-  nsCOMPtr<sbIDatabaseResult> dbResult;
-  rv = ExecuteQuery(idQuery, queryStr, getter_AddRefs(dbResult));
-  NS_ENSURE_SUCCESS(rv, rv);
-
-  // Convert results to iPod IDs.
-  PRUint32 rowCount;
-  rv = dbResult->GetRowCount(&rowCount);
+  // Operate under the ID map lock.
+  nsAutoLock autoIDMapLock(mIDMapLock);
+  NS_ENSURE_TRUE(mIDMapConnected, NS_ERROR_NOT_AVAILABLE);
+
+  // Get the mapped iPod IDs.
+  std::pair<IDMapSBToIPodMap::const_iterator,
+            IDMapSBToIPodMap::const_iterator>
+    range = mIDMapSBToIPod.equal_range(nsString(aSBID));
   aIPodIDList.Clear();
-  for (PRUint32 i = 0; i < rowCount; i++) {
-    // Get the next query result string.
-    nsAutoString iPodIDStr;
-    rv = dbResult->GetRowCell(i, 0, iPodIDStr);
-    NS_ENSURE_SUCCESS(rv, rv);
-
-    // Scan the iPod ID from the ID string.
-    guint32 iPodIDHi, iPodIDLo;
-    int     numScanned;
-    numScanned = PR_sscanf(NS_ConvertUTF16toUTF8(iPodIDStr).get(),
-                           "%x:%x\n",
-                           &iPodIDHi,
-                           &iPodIDLo);
-    if (numScanned >= 2) {
-      guint64 iPodID = (((guint64) iPodIDHi) << 32) | ((guint64) iPodIDLo);
-      aIPodIDList.AppendElement(iPodID);
-    }
+  for (IDMapSBToIPodMap::const_iterator iter = range.first;
+       iter != range.second;
+       ++iter) {
+    NS_ENSURE_TRUE(aIPodIDList.AppendElement(iter->second),
+                   NS_ERROR_OUT_OF_MEMORY);
   }
 
   return NS_OK;
@@ -251,17 +314,15 @@ sbIPDDevice::IDMapGet(nsAString& aSBID,
   // Validate arguments.
   NS_ASSERTION(aIPodID, "aIPodID is null");
 
-  // Function variables.
-  nsresult rv;
+  // Operate under the ID map lock.
+  nsAutoLock autoIDMapLock(mIDMapLock);
+  NS_ENSURE_TRUE(mIDMapConnected, NS_ERROR_NOT_AVAILABLE);
 
-  // Get the list of iPod IDs mapped to the Songbird ID.
-  nsTArray<guint64> iPodIDList;
-  rv = IDMapGet(aSBID, iPodIDList);
-  if (NS_FAILED(rv) || (iPodIDList.Length() == 0))
+  // Return the first mapped iPod ID.
+  IDMapSBToIPodMap::const_iterator iter = mIDMapSBToIPod.find(nsString(aSBID));
+  if (iter == mIDMapSBToIPod.end())
     return NS_ERROR_NOT_AVAILABLE;
-
-  // Return the first iPod ID.
-  *aIPodID = iPodIDList[0];
+  *aIPodID = iter->second;
 
   return NS_OK;
 }
@@ -281,34 +342,15 @@ nsresult
 sbIPDDevice::IDMapGet(guint64    aIPodID,
                       nsAString& aSBID)
 {
-  nsresult rv;
-
-  // Produce the database query string.
-  char queryStr[256];
-  PR_snprintf(queryStr,
-              sizeof(queryStr),
-              "SELECT songbird_id FROM ipod_id_map "
-                "WHERE ipod_id = \"%08x:%08x\"",
-              (PRUint32) ((aIPodID >> 32) & 0xFFFFFFFF),
-              (PRUint32) (aIPodID & 0xFFFFFFFF));
-
-  // Create the ID map database query object.
-  nsCOMPtr<sbIDatabaseQuery> idQuery;
-  rv = IDMapCreateDBQuery(getter_AddRefs(idQuery));
-  NS_ENSURE_SUCCESS(rv, rv);
-
-  // Execute the query.
-  nsCOMPtr<sbIDatabaseResult> dbResult;
-  rv = ExecuteQuery(idQuery, queryStr, getter_AddRefs(dbResult));
-  NS_ENSURE_SUCCESS(rv, rv);
+  // Operate under the ID map lock.
+  nsAutoLock autoIDMapLock(mIDMapLock);
+  NS_ENSURE_TRUE(mIDMapConnected, NS_ERROR_NOT_AVAILABLE);
 
-  // Get Songbird ID from the query result.
-  PRUint32 rowCount;
-  rv = dbResult->GetRowCount(&rowCount);
-  if (!(rowCount > 0))
+  // Get the Songbird ID.
+  IDMapIPodToSBMap::const_iterator iter = mIDMapIPodToSB.find(aIPodID);
+  if (iter == mIDMapIPodToSB.end())
     return NS_ERROR_NOT_AVAILABLE;
-  rv = dbResult->GetRowCell(0, 0, aSBID);
-  NS_ENSURE_SUCCESS(rv, rv);
+  aSBID.Assign(iter->second);
 
   return NS_OK;
 }
@@ -425,6 +467,64 @@ sbIPDDevice::IDMapCreateDBQuery(sbIDatabaseQuery** aQuery)
 }
 
 
+/**
+ * Write the pending ID map changes to the ID map database in a single
+ * transaction.
+ */
+
+nsresult
+sbIPDDevice::IDMapFlush()
+{
+  // Function variables.
+  nsresult rv;
+
+  // Serialize ID map database writes under the request lock.
+  nsAutoMonitor autoDBLock(mDBLock);
+
+  // Take the pending queries.
+  nsTArray<nsCString> pendingQueries;
+  {
+    nsAutoLock autoIDMapLock(mIDMapLock);
+    pendingQueries.SwapElements(mIDMapPendingQueries);
+  }
+  if (pendingQueries.Length() == 0)
+    return NS_OK;
+
+  // Create the ID map database query object.
+  nsCOMPtr<sbIDatabaseQuery> idQuery;
+  rv = IDMapCreateDBQuery(getter_AddRefs(idQuery));
+
+  // Add the pending queries within a transaction.
+  if (NS_SUCCEEDED(rv))
+    rv = idQuery->AddQuery(NS_LITERAL_STRING("BEGIN"));
+  for (PRUint32 i = 0; NS_SUCCEEDED(rv) && (i < pendingQueries.Length()); i++)
+    rv = idQuery->AddQuery(NS_ConvertUTF8toUTF16(pendingQueries[i]));
+  if (NS_SUCCEEDED(rv))
+    rv = idQuery->AddQuery(NS_LITERAL_STRING("COMMIT"));
+
+  // Execute the queries.
+  if (NS_SUCCEEDED(rv)) {
+    PRInt32 dbError;
+    rv = idQuery->Execute(&dbError);
+    if (NS_SUCCEEDED(rv) && dbError) {
+      ExecuteQuery(idQuery, "ROLLBACK", nsnull);
+      rv = NS_ERROR_FAILURE;
+    }
+  }
+
+  // If the queries weren't written, put them back in front of any queued
+  // since so that they're retried on the next flush.
+  if (NS_FAILED(rv)) {
+    nsAutoLock autoIDMapLock(mIDMapLock);
+    if (mIDMapConnected)
+      mIDMapPendingQueries.InsertElementsAt(0, pendingQueries);
+  }
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  return NS_OK;
+}
+
+
 /**
  * Return in aSBID the Songbird ID for the media item specified by aMediaItem.
  *
@@ -603,3 +703,102 @@ sbIPDDevice::ExecuteQuery(sbIDatabaseQuery*   aDBQuery,
 }
 
 
+/**
+ * Load the ID map from the ID map database.
+ */
+
+nsresult
+sbIPDDevice::IDMapLoad()
+{
+  nsresult rv;
+
+  // Create the ID map database query object.
+  nsCOMPtr<sbIDatabaseQuery> idQuery;
+  rv = IDMapCreateDBQuery(getter_AddRefs(idQuery));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Read the entire ID map.
+  nsCOMPtr<sbIDatabaseResult> dbResult;
+  rv = ExecuteQuery(idQuery,
+                    "SELECT songbird_id, ipod_id FROM ipod_id_map "
+                      "ORDER BY rowid",
+                    getter_AddRefs(dbResult));
+  NS_ENSURE_SUCCESS(rv, rv);
+
+  // Build the ID maps.  If an iPod ID was mapped more than once, only its
+  // first mapping is used, as when the map was looked up in the database.
+  IDMapIPodToSBMap iPodToSB;
+  IDMapSBToIPodMap sbToIPod;
+  PRUint32 rowCount;
+  rv = dbResult->GetRowCount(&rowCount);
+  NS_ENSURE_SUCCESS(rv, rv);
+  for (PRUint32 i = 0; i < rowCount; i++) {
+    // Get the next mapping.
+    nsAutoString sbID;
+    nsAutoString iPodIDStr;
+    rv = dbResult->GetRowCell(i, 0, sbID);
+    NS_ENSURE_SUCCESS(rv, rv);
+    rv = dbResult->GetRowCell(i, 1, iPodIDStr);
+    NS_ENSURE_SUCCESS(rv, rv);
+
+    // Scan the iPod ID from the ID string.
+    guint32 iPodIDHi, iPodIDLo;
+    int     numScanned;
+    numScanned = PR_sscanf(NS_ConvertUTF16toUTF8(iPodIDStr).get(),
+                           "%x:%x\n",
+                           &iPodIDHi,
+                           &iPodIDLo);
+    if (numScanned < 2)
+      continue;
+    guint64 iPodID = (((guint64) iPodIDHi) << 32) | ((guint64) iPodIDLo);
+
+    // Add the mapping.
+    if (iPodToSB.find(iPodID) != iPodToSB.end())
+      continue;
+    iPodToSB[iPodID] = sbID;
+    sbToIPod.insert(IDMapSBToIPodMap::value_type(nsString(sbID), iPodID));
+  }
+
+  // Install the ID map.
+  {
+    nsAutoLock autoIDMapLock(mIDMapLock);
+    mIDMapIPodToSB.swap(iPodToSB);
+    mIDMapSBToIPod.swap(sbToIPod);
+    mIDMapPendingQueries.Clear();
+    mIDMapConnected = PR_TRUE;
+  }
+
+  return NS_OK;
+}
+
+
+/**
+ * Remove the mapping for the iPod ID specified by aIPodID from the in-memory
+ * ID map.  This function must be called under the ID map lock.
+ *
+ * \param aIPodID               iPod ID to remove from map.
+ */
+
+void
+sbIPDDevice::IDMapRemoveMapping(guint64 aIPodID)
+{
+  // Find the Songbird ID mapped to the iPod ID.
+  IDMapIPodToSBMap::iterator iPodIter = mIDMapIPodToSB.find(aIPodID);
+  if (iPodIter == mIDMapIPodToSB.end())
+    return;
+
+  // Remove the reverse mapping.
+  std::pair<IDMapSBToIPodMap::iterator, IDMapSBToIPodMap::iterator>
+    range = mIDMapSBToIPod.equal_range(iPodIter->second);
+  for (IDMapSBToIPodMap::iterator iter = range.first;
+       iter != range.second;
+       ++iter) {
+    if (iter->second == aIPodID) {
+      mIDMapSBToIPod.erase(iter);
+      break;
+    }
+  }
+
+  // Remove the mapping.
+  mIDMapIPodToSB.erase(iPodIter);
+}
@@ -397,7 +397,7 @@ sbIPDDevice::PlaylistAdd(sbIMediaList*   aMediaList,
   NS_ENSURE_SUCCESS(rv, rv);
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   // Return results.
   *aPlaylist = playlist;
@@ -429,7 +429,7 @@ sbIPDDevice::PlaylistDelete(sbIMediaList* aMediaList)
   itdb_playlist_remove(playlist);
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   return NS_OK;
 }
@@ -479,7 +479,7 @@ sbIPDDevice::PlaylistUpdateProperties(sbIMediaList*  aMediaList,
   }
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   return NS_OK;
 }
@@ -523,7 +523,7 @@ sbIPDDevice::PlaylistAddTrack(sbIMediaList* aMediaList,
   itdb_playlist_add_track(playlist, track, aIndex);
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   return NS_OK;
 }
@@ -566,7 +566,7 @@ sbIPDDevice::PlaylistRemoveTrack(sbIMediaList* aMediaList,
   playlist->members = g_list_delete_link(members, trackMember);
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   return NS_OK;
 }
@@ -588,7 +588,7 @@ sbIPDDevice::PlaylistWipe(sbIMediaList * aMediaList) {
   g_list_free(members);
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   return NS_OK;
 }
@@ -635,7 +635,7 @@ sbIPDDevice::PlaylistMoveTrack(sbIMediaList* aMediaList,
   itdb_playlist_add_track(playlist, track, aIndexTo);
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   return NS_OK;
 }
@@ -681,7 +681,7 @@ sbIPDDevice::ProcessOTGPlaylists()
       otgPlaylistIndex++;
 
       // Mark the iPod database as dirty.
-      mITDBDirty = PR_TRUE;
+      DBChanged();
     }
   }
 
@@ -726,7 +726,7 @@ sbIPDDevice::SetOTGPlaylistName(Itdb_Playlist* aPlaylist,
   aPlaylist->name = cPlaylistName;
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   return NS_OK;
 }
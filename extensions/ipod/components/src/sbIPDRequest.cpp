@@ -818,7 +818,7 @@ sbIPDDevice::ReqHandleSetProperty(TransferRequest * aRequest)
     mMasterPlaylist->name = masterPlaylistName;
 
     // Mark the iPod database as dirty.
-    mITDBDirty = PR_TRUE;
+    DBChanged();
   }
 }
 
@@ -279,7 +279,7 @@ sbIPDDevice::AddTrack(sbIMediaItem* aMediaItem,
   StatsUpdate(PR_FALSE);
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   // Return results.
   *aTrack = track;
@@ -348,7 +348,7 @@ sbIPDDevice::DeleteTrack(Itdb_Track* aTrack)
   StatsUpdate(PR_FALSE);
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   // Update item progress.
   mIPDStatus->ItemProgress(1.0);
@@ -610,7 +610,7 @@ sbIPDDevice::TrackUpdateProperties(sbIMediaItem* aMediaItem,
   SetTrackProperties(track, aMediaItem);
 
   // Mark the iPod database as dirty.
-  mITDBDirty = PR_TRUE;
+  DBChanged();
 
   return NS_OK;
 }
@@ -843,22 +843,26 @@ var LastfmTuner = {
 
 	dataSBCollect: function(primary, secondary, type, callback) {
 		var lib = LibraryUtils.mainLibrary;
-		var collectResults = lib.collectDistinctValues(primary,
-			Ci.sbILibraryStatistics.COLLECT_SUM, secondary, false, 30);
-		var results = new Array();
-		for (var i=0; i<collectResults.length; i++) {
-			var s = collectResults.queryElementAt(i, Ci.nsIVariant)
-					.replace(/&/g, "&amp;").replace(/>/g, "gt;")
-					.replace(/</g, "&lt;").replace(/"/g, "&quot;");
-			var url = encodeURIComponent(s).replace(/'/g, "%27");
-			results.push({
-				type: type,
-				name: s,
-				url: "http://www.last.fm/" + type + "/" + url,
-				stationUrl: "lastfm://" + type + "/" + url
-			});
-		}
-		callback(results);
+		lib.collectDistinctValuesAsync(primary,
+			Ci.sbILibraryStatistics.COLLECT_SUM, secondary, false, 30,
+			function(aResult, collectResults) {
+			if (!Components.isSuccessCode(aResult))
+				return;
+			var results = new Array();
+			for (var i=0; i<collectResults.length; i++) {
+				var s = collectResults.queryElementAt(i, Ci.nsIVariant)
+						.replace(/&/g, "&amp;").replace(/>/g, "gt;")
+						.replace(/</g, "&lt;").replace(/"/g, "&quot;");
+				var url = encodeURIComponent(s).replace(/'/g, "%27");
+				results.push({
+					type: type,
+					name: s,
+					url: "http://www.last.fm/" + type + "/" + url,
+					stationUrl: "lastfm://" + type + "/" + url
+				});
+			}
+			callback(results);
+		});
 	},
 	
 	dataSBMostPlayedArtists: function(populateCallback) {